@@ -22,6 +22,7 @@
 #include "d_englsh.h"
 #include "doomdef.h"
 #include "doomstat.h"
+#include "m_bbox.h"
 #include "m_cheat.h"
 #include "m_controls.h"
 #include "m_misc.h"
@@ -78,8 +79,8 @@
 // scale on entry
 #define INITSCALEMTOF (.2 * FRACUNIT)
 // how much the automap moves window per tic in frame-buffer coordinates
-// moves 140 pixels in 1 second
-#define F_PANINC 4
+// moves 140 (original resolution) pixels in 1 second
+#define F_PANINC (4 << hires)
 // how much zoom-in per tic
 // goes to 2x in 1 second
 #define M_ZOOMIN ((int)(1.02 * FRACUNIT))
@@ -237,6 +238,19 @@ static int markpointnum = 0;                  // next point to be assigned
 
 static int followplayer = 1; // specifies whether to follow the player around
 
+// Lines bucketed by the cells of a coarse grid their bounding boxes touch, so
+// AM_drawWalls only looks at lines near the window. Built the first time the
+// walls are drawn in a level; the zone clears amcells when the level is freed.
+#define AMCELLSHIFT (FRACBITS + 9) // 512 map units
+
+static int *amcells; // amcellcols * amcellrows + 1 offsets into amcelllines
+static int *amcelllines;
+static unsigned int *amvisiblelines; // bitset of lines to draw this frame
+static fixed_t amcellorgx;
+static fixed_t amcellorgy;
+static int amcellcols;
+static int amcellrows;
+
 cheatseq_t cheat_amap = CHEAT("iddt", 0);
 
 static boolean stopped = true;
@@ -373,7 +387,7 @@ static void AM_sizeInit(void)
     f_x = f_y = 0;
     f_w = SCREENWIDTH;
     // Only full-height for detached UI, as fullscreen shows the status bar.
-    f_h = SCREENHEIGHT - (detached_ui ? 0 : ST_HEIGHT);
+    f_h = SCREENHEIGHT - (detached_ui ? 0 : ST_HEIGHT << hires);
 
     fixed_t a = FixedDiv(f_w << FRACBITS, max_w);
     fixed_t b = FixedDiv(f_h << FRACBITS, max_h);
@@ -868,6 +882,7 @@ void AM_drawFline(fline_t *fl, int color)
     register int ax;
     register int ay;
     register int d;
+    byte *dest;
 
     static int fuck = 0;
 
@@ -880,6 +895,22 @@ void AM_drawFline(fline_t *fl, int color)
 
 #define PUTDOT(xx, yy, cc) fb[(yy) * f_w + (xx)] = (cc)
 
+    // Most lines in a level are horizontal or vertical.
+    if (fl->a.y == fl->b.y) {
+        x = fl->a.x < fl->b.x ? fl->a.x : fl->b.x;
+        dx = fl->b.x - fl->a.x;
+        memset(&fb[fl->a.y * f_w + x], color, (dx < 0 ? -dx : dx) + 1);
+        return;
+    }
+    if (fl->a.x == fl->b.x) {
+        y = fl->a.y < fl->b.y ? fl->a.y : fl->b.y;
+        dy = fl->b.y - fl->a.y;
+        dest = &fb[y * f_w + fl->a.x];
+        for (d = dy < 0 ? -dy : dy; d >= 0; d--, dest += f_w)
+            *dest = color;
+        return;
+    }
+
     dx = fl->b.x - fl->a.x;
     ax = 2 * (dx < 0 ? -dx : dx);
     sx = dx < 0 ? -1 : 1;
@@ -973,49 +1004,181 @@ void AM_drawGrid(int color)
     }
 }
 
+// Finds the range of index cells a line's bounding box touches.
+static void AM_lineCells(line_t *line, int *cx1, int *cy1, int *cx2, int *cy2)
+{
+    // Unsigned, as the distance can exceed what a fixed_t holds.
+    *cx1 = ((unsigned int)line->bbox[BOXLEFT] - amcellorgx) >> AMCELLSHIFT;
+    *cx2 = ((unsigned int)line->bbox[BOXRIGHT] - amcellorgx) >> AMCELLSHIFT;
+    *cy1 = ((unsigned int)line->bbox[BOXBOTTOM] - amcellorgy) >> AMCELLSHIFT;
+    *cy2 = ((unsigned int)line->bbox[BOXTOP] - amcellorgy) >> AMCELLSHIFT;
+}
+
 //
-// Determines visible lines, draws them.
-// This is LineDef based, not LineSeg based.
+// AM_buildLineIndex
+// Buckets the level's lines into grid cells for AM_drawWalls.
 //
-void AM_drawWalls(void)
+static void AM_buildLineIndex(void)
 {
     int i;
-    static mline_t l;
+    int cx, cy;
+    int cx1, cy1, cx2, cy2;
+    int numcells;
+    int numentries;
+    int *block;
+    fixed_t maxx, maxy;
+
+    amcellorgx = amcellorgy = 0;
+    maxx = maxy = 0;
+    for (i = 0; i < numlines; i++) {
+        if (i == 0 || lines[i].bbox[BOXLEFT] < amcellorgx)
+            amcellorgx = lines[i].bbox[BOXLEFT];
+        if (i == 0 || lines[i].bbox[BOXBOTTOM] < amcellorgy)
+            amcellorgy = lines[i].bbox[BOXBOTTOM];
+        if (i == 0 || lines[i].bbox[BOXRIGHT] > maxx)
+            maxx = lines[i].bbox[BOXRIGHT];
+        if (i == 0 || lines[i].bbox[BOXTOP] > maxy)
+            maxy = lines[i].bbox[BOXTOP];
+    }
+
+    amcellcols = (int)(((unsigned int)maxx - amcellorgx) >> AMCELLSHIFT) + 1;
+    amcellrows = (int)(((unsigned int)maxy - amcellorgy) >> AMCELLSHIFT) + 1;
+    numcells = amcellcols * amcellrows;
+
+    numentries = 0;
+    for (i = 0; i < numlines; i++) {
+        AM_lineCells(&lines[i], &cx1, &cy1, &cx2, &cy2);
+        numentries += (cx2 - cx1 + 1) * (cy2 - cy1 + 1);
+    }
+
+    block = Z_Malloc((numcells + 1 + numentries + (numlines + 31) / 32)
+                         * sizeof(int),
+                     PU_LEVEL, &amcells);
+    amcelllines = block + numcells + 1;
+    amvisiblelines = (unsigned int *)(amcelllines + numentries);
+    memset(amvisiblelines, 0, (numlines + 31) / 32 * sizeof(int));
 
+    // Count each cell's lines, then turn the counts into the offset just past
+    // each cell's entries and fill the cells backwards.
+    memset(block, 0, (numcells + 1) * sizeof(int));
     for (i = 0; i < numlines; i++) {
-        l.a.x = lines[i].v1->x;
-        l.a.y = lines[i].v1->y;
-        l.b.x = lines[i].v2->x;
-        l.b.y = lines[i].v2->y;
-        if (cheating || (lines[i].flags & ML_MAPPED)) {
-            if ((lines[i].flags & LINE_NEVERSEE) && !cheating)
-                continue;
-            if (!lines[i].backsector) {
-                AM_drawMline(&l, WALLCOLORS + lightlev);
-            } else {
-                if (lines[i].special == 39) { // teleporters
-                    AM_drawMline(&l, WALLCOLORS + WALLRANGE / 2);
-                } else if (lines[i].flags & ML_SECRET) // secret door
-                {
-                    if (cheating)
-                        AM_drawMline(&l, SECRETWALLCOLORS + lightlev);
-                    else
-                        AM_drawMline(&l, WALLCOLORS + lightlev);
-                } else if (lines[i].backsector->floorheight
-                           != lines[i].frontsector->floorheight) {
-                    AM_drawMline(&l,
-                                 FDWALLCOLORS + lightlev); // floor level change
-                } else if (lines[i].backsector->ceilingheight
-                           != lines[i].frontsector->ceilingheight) {
-                    AM_drawMline(&l, CDWALLCOLORS
-                                         + lightlev); // ceiling level change
-                } else if (cheating) {
-                    AM_drawMline(&l, TSWALLCOLORS + lightlev);
-                }
+        AM_lineCells(&lines[i], &cx1, &cy1, &cx2, &cy2);
+        for (cy = cy1; cy <= cy2; cy++)
+            for (cx = cx1; cx <= cx2; cx++)
+                block[cy * amcellcols + cx]++;
+    }
+    for (i = 1; i <= numcells; i++)
+        block[i] += block[i - 1];
+    for (i = numlines - 1; i >= 0; i--) {
+        AM_lineCells(&lines[i], &cx1, &cy1, &cx2, &cy2);
+        for (cy = cy1; cy <= cy2; cy++)
+            for (cx = cx1; cx <= cx2; cx++)
+                amcelllines[--block[cy * amcellcols + cx]] = i;
+    }
+}
+
+// Marks the lines in cells overlapping the window in amvisiblelines.
+static void AM_markVisibleLines(void)
+{
+    int i;
+    int line;
+    int cx, cy;
+    int cx1, cy1, cx2, cy2;
+    int *cell;
+
+    if (m_x2 < amcellorgx || m_y2 < amcellorgy)
+        return;
+
+    cx1 = 0;
+    if (m_x > amcellorgx)
+        cx1 = ((unsigned int)m_x - amcellorgx) >> AMCELLSHIFT;
+    cy1 = 0;
+    if (m_y > amcellorgy)
+        cy1 = ((unsigned int)m_y - amcellorgy) >> AMCELLSHIFT;
+    cx2 = ((unsigned int)m_x2 - amcellorgx) >> AMCELLSHIFT;
+    if (cx2 >= amcellcols)
+        cx2 = amcellcols - 1;
+    cy2 = ((unsigned int)m_y2 - amcellorgy) >> AMCELLSHIFT;
+    if (cy2 >= amcellrows)
+        cy2 = amcellrows - 1;
+
+    for (cy = cy1; cy <= cy2; cy++) {
+        cell = amcells + cy * amcellcols;
+        for (cx = cx1; cx <= cx2; cx++) {
+            for (i = cell[cx]; i < cell[cx + 1]; i++) {
+                line = amcelllines[i];
+                amvisiblelines[line / 32] |= 1u << (line % 32);
+            }
+        }
+    }
+}
+
+//
+// Draws a line in the color for its kind, if it should be shown.
+//
+static void AM_drawWall(line_t *line)
+{
+    static mline_t l;
+
+    l.a.x = line->v1->x;
+    l.a.y = line->v1->y;
+    l.b.x = line->v2->x;
+    l.b.y = line->v2->y;
+    if (cheating || (line->flags & ML_MAPPED)) {
+        if ((line->flags & LINE_NEVERSEE) && !cheating)
+            return;
+        if (!line->backsector) {
+            AM_drawMline(&l, WALLCOLORS + lightlev);
+        } else {
+            if (line->special == 39) { // teleporters
+                AM_drawMline(&l, WALLCOLORS + WALLRANGE / 2);
+            } else if (line->flags & ML_SECRET) // secret door
+            {
+                if (cheating)
+                    AM_drawMline(&l, SECRETWALLCOLORS + lightlev);
+                else
+                    AM_drawMline(&l, WALLCOLORS + lightlev);
+            } else if (line->backsector->floorheight
+                       != line->frontsector->floorheight) {
+                AM_drawMline(&l, FDWALLCOLORS + lightlev); // floor level change
+            } else if (line->backsector->ceilingheight
+                       != line->frontsector->ceilingheight) {
+                AM_drawMline(&l,
+                             CDWALLCOLORS + lightlev); // ceiling level change
+            } else if (cheating) {
+                AM_drawMline(&l, TSWALLCOLORS + lightlev);
             }
-        } else if (plr->powers[pw_allmap]) {
-            if (!(lines[i].flags & LINE_NEVERSEE))
-                AM_drawMline(&l, GRAYS + 3);
+        }
+    } else if (plr->powers[pw_allmap]) {
+        if (!(line->flags & LINE_NEVERSEE))
+            AM_drawMline(&l, GRAYS + 3);
+    }
+}
+
+//
+// Determines visible lines, draws them.
+// This is LineDef based, not LineSeg based.
+//
+void AM_drawWalls(void)
+{
+    int i;
+    int j;
+    unsigned int bits;
+
+    if (!amcells)
+        AM_buildLineIndex();
+
+    // Walk the marked lines in order, so overlapping lines are drawn as they
+    // would be going through all of them.
+    AM_markVisibleLines();
+    for (i = 0; i < (numlines + 31) / 32; i++) {
+        bits = amvisiblelines[i];
+        if (!bits)
+            continue;
+        amvisiblelines[i] = 0;
+        for (j = 0; bits; j++, bits >>= 1) {
+            if (bits & 1)
+                AM_drawWall(&lines[i * 32 + j]);
         }
     }
 }
@@ -1143,8 +1306,10 @@ void AM_drawMarks(void)
             h = 6; // because something's wrong with the wad, i guess
             fx = CXMTOF(markpoints[i].x);
             fy = CYMTOF(markpoints[i].y);
-            if (fx >= f_x && fx <= f_w - w && fy >= f_y && fy <= f_h - h)
-                V_DrawPatch(fx, fy, marknums[i]);
+            // Patches are positioned in original resolution pixels.
+            if (fx >= f_x && fx <= f_w - (w << hires) && fy >= f_y
+                && fy <= f_h - (h << hires))
+                V_DrawPatch(fx >> hires, fy >> hires, marknums[i]);
         }
     }
 }
@@ -2,7 +2,11 @@
 #undef HAVE_LIBPNG
 
 // Define to 1 if you have the `mmap' function.
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_MMAP 1
+#else
 #undef HAVE_MMAP
+#endif
 
 // Define to the full name of this package.
 #define PACKAGE_NAME "actually-doom"
@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "d_bench.h"
+#include "d_loop.h"
+#include "doomgeneric.h"
+#include "g_game.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_counts.h"
+#include "r_main.h"
+#include "w_wad.h"
+
+#define US_PER_MS 1000
+#define US_PER_SEC 1000000
+
+boolean benchmode;
+
+static const char *const partnames[NUMBENCHPARTS] = {
+    "playsim", "bsp", "planes", "masked", "hud", "convert", "encode",
+};
+
+// Only those in the IWAD are played; DEMO4 is in The Ultimate Doom.
+static char *demonames[] = {"demo1", "demo2", "demo3", "demo4"};
+
+#define NUMDEMOS arrlen(demonames)
+
+// What's measured on each run through the demos: the fps over all of them and
+// the bytes sent per frame, then the time per frame of each part and of
+// everything else, then the fps of each demo, then the work of each kind done
+// per frame.
+enum {
+    sample_fps,
+    sample_bytes,
+    sample_parts,
+    sample_other = sample_parts + NUMBENCHPARTS,
+    sample_demos,
+    sample_counts = sample_demos + NUMDEMOS,
+    NUMSAMPLES = sample_counts + NUMWORKCOUNTS
+};
+
+static int numruns = 1;
+static const char *outpath;
+
+static int run;
+static unsigned int demonum = -1;
+static int demosplayed;
+
+static double *samples[NUMSAMPLES];
+
+static uint64_t partstart[NUMBENCHPARTS];
+static uint64_t parttime[NUMBENCHPARTS];
+static int frames;
+static uint64_t bytes;
+
+// When the demo being played started, and the counts then.
+static uint64_t demostart;
+static int demostartgametic;
+static int demostartframes;
+
+// Totals over the demos played in this run.
+static uint64_t runtime;
+static int runtics;
+static int runframes;
+static unsigned int runstartcounts[NUMWORKCOUNTS];
+
+static void Init(void)
+{
+    int p;
+    int i;
+
+    //!
+    // @arg <n>
+    // @category demo
+    //
+    // With -bench, play the demos n times over, reporting the median of
+    // each measurement.
+    //
+
+    p = M_CheckParmWithArgs("-benchruns", 1);
+    if (p) {
+        numruns = atoi(myargv[p + 1]);
+        if (numruns < 1)
+            I_Error("Invalid -benchruns: %s", myargv[p + 1]);
+    }
+
+    //!
+    // @arg <file>
+    // @category demo
+    //
+    // With -bench, also write the results to file as JSON.
+    //
+
+    p = M_CheckParmWithArgs("-benchout", 1);
+    if (p)
+        outpath = myargv[p + 1];
+
+    for (i = 0; i < NUMSAMPLES; i++)
+        samples[i] = I_Realloc(NULL, numruns * sizeof(**samples));
+
+    M_GetWorkCounts(runstartcounts);
+}
+
+static void PrintRates(const char *name, int tics, int frames, uint64_t us)
+{
+    double secs = (double)us / US_PER_SEC;
+
+    printf("bench: %s: %i tics, %i frames in %.3fs: %.1f tics/s, %.1f fps\n",
+           name, tics, frames, secs, tics / secs, frames / secs);
+}
+
+static int CompareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double Median(int sample)
+{
+    static double *sorted;
+
+    if (!sorted)
+        sorted = I_Realloc(NULL, numruns * sizeof(*sorted));
+
+    memcpy(sorted, samples[sample], numruns * sizeof(*sorted));
+    qsort(sorted, numruns, sizeof(*sorted), CompareDoubles);
+
+    if (numruns % 2)
+        return sorted[numruns / 2];
+    return (sorted[numruns / 2 - 1] + sorted[numruns / 2]) / 2;
+}
+
+// Sample variance; 0 for a single run.
+static double Variance(int sample)
+{
+    double mean = 0;
+    double sum = 0;
+    int i;
+
+    if (numruns < 2)
+        return 0;
+
+    for (i = 0; i < numruns; i++)
+        mean += samples[sample][i];
+    mean /= numruns;
+
+    for (i = 0; i < numruns; i++)
+        sum += (samples[sample][i] - mean) * (samples[sample][i] - mean);
+    return sum / (numruns - 1);
+}
+
+static void RecordRun(void)
+{
+    uint64_t other = runtime;
+    unsigned int counts[NUMWORKCOUNTS];
+    int i;
+
+    PrintRates("total", runtics, runframes, runtime);
+
+    samples[sample_fps][run] = runframes * (double)US_PER_SEC / runtime;
+    samples[sample_bytes][run] = (double)bytes / runframes;
+    bytes = 0;
+
+    for (i = 0; i < NUMBENCHPARTS; i++) {
+        samples[sample_parts + i][run] = (double)parttime[i] / runframes;
+        other -= parttime[i];
+        parttime[i] = 0;
+    }
+
+    // Everything else: sound, the rest of the game and renderer, ...
+    samples[sample_other][run] = (double)other / runframes;
+
+    M_GetWorkCounts(counts);
+    for (i = 0; i < NUMWORKCOUNTS; i++) {
+        samples[sample_counts + i][run] =
+            (double)(counts[i] - runstartcounts[i]) / runframes;
+        runstartcounts[i] = counts[i];
+    }
+
+    runtime = 0;
+    runtics = 0;
+    runframes = 0;
+}
+
+static void PrintPart(const char *name, int sample)
+{
+    printf("bench:   %-8s %8.1fus/frame %5.1f%%\n", name, Median(sample),
+           100 * Median(sample) * Median(sample_fps) / US_PER_SEC);
+}
+
+static void PrintResults(void)
+{
+    int i;
+
+    if (numruns > 1)
+        printf("bench: medians of %i runs:\n", numruns);
+
+    printf("bench:   %-8s %8.1f\n", "fps", Median(sample_fps));
+    printf("bench:   %-8s %8.0f bytes/frame\n", "sent", Median(sample_bytes));
+
+    for (i = 0; i < NUMBENCHPARTS; i++)
+        PrintPart(partnames[i], sample_parts + i);
+    PrintPart("other", sample_other);
+
+#ifdef FEATURE_WORK_COUNTS
+    printf("bench: work per frame:\n");
+    for (i = 0; i < NUMWORKCOUNTS; i++) {
+        printf("bench:   %-16s %10.1f\n", workcountnames[i],
+               Median(sample_counts + i));
+    }
+#endif
+}
+
+static void WriteStat(FILE *f, const char *name, int sample, boolean last)
+{
+    int i;
+
+    fprintf(f, "    \"%s\": {\"median\": %.3f, \"variance\": %.3f, \"runs\": [",
+            name, Median(sample), Variance(sample));
+    for (i = 0; i < numruns; i++)
+        fprintf(f, "%s%.3f", i ? ", " : "", samples[sample][i]);
+    fprintf(f, "]}%s\n", last ? "" : ",");
+}
+
+static void WriteResults(void)
+{
+    FILE *f;
+    unsigned int i;
+    int n;
+
+    f = fopen(outpath, "w");
+    if (!f)
+        I_Error("Failed to open %s for writing", outpath);
+
+    fprintf(f, "{\n");
+#ifdef __VERSION__
+    fprintf(f, "  \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+    fprintf(f, "  \"runs\": %i,\n", numruns);
+
+    fprintf(f, "  \"fps\": {\n");
+    WriteStat(f, "total", sample_fps, false);
+    for (i = 0, n = 0; i < NUMDEMOS; i++) {
+        if (W_CheckNumForName(demonames[i]) >= 0) {
+            WriteStat(f, demonames[i], sample_demos + i,
+                      ++n == demosplayed / numruns);
+        }
+    }
+    fprintf(f, "  },\n");
+
+    fprintf(f, "  \"bytes_per_frame\": {\n");
+    WriteStat(f, "sent", sample_bytes, true);
+    fprintf(f, "  },\n");
+
+    fprintf(f, "  \"us_per_frame\": {\n");
+    for (i = 0; i < NUMBENCHPARTS; i++)
+        WriteStat(f, partnames[i], sample_parts + i, false);
+    WriteStat(f, "other", sample_other, true);
+#ifdef FEATURE_WORK_COUNTS
+    fprintf(f, "  },\n");
+
+    fprintf(f, "  \"work_per_frame\": {\n");
+    for (i = 0; i < NUMWORKCOUNTS; i++) {
+        WriteStat(f, workcountnames[i], sample_counts + i,
+                  i == NUMWORKCOUNTS - 1);
+    }
+#endif
+    fprintf(f, "  }\n");
+
+    fprintf(f, "}\n");
+
+    if (fclose(f) != 0)
+        I_Error("Failed to write %s", outpath);
+
+    printf("bench: wrote %s\n", outpath);
+}
+
+void D_BenchNextDemo(void)
+{
+    uint64_t now;
+    int tics;
+
+    // count the view still being drawn in this demo
+    R_FinishPlayerView();
+    now = DG_GetTicksUs();
+
+    if (demonum == -1u && run == 0)
+        Init();
+
+    if (demonum != -1u) {
+        tics = gametic - demostartgametic;
+        PrintRates(demonames[demonum], tics, frames - demostartframes,
+                   now - demostart);
+        samples[sample_demos + demonum][run] =
+            (frames - demostartframes) * (double)US_PER_SEC / (now - demostart);
+        runtime += now - demostart;
+        runtics += tics;
+        runframes += frames - demostartframes;
+        demosplayed++;
+    }
+
+    do {
+        demonum++;
+    } while (demonum < NUMDEMOS && W_CheckNumForName(demonames[demonum]) < 0);
+
+    if (demonum == NUMDEMOS) {
+        if (demosplayed == 0)
+            I_Error("D_BenchNextDemo: No demos to play");
+
+        RecordRun();
+
+        if (++run < numruns) {
+            demonum = -1;
+            D_BenchNextDemo();
+            return;
+        }
+
+        PrintResults();
+        if (outpath)
+            WriteResults();
+        I_Quit();
+    }
+
+    demostart = now;
+    demostartgametic = gametic;
+    demostartframes = frames;
+    G_TimeDemo(demonames[demonum]);
+}
+
+void D_BenchBegin(benchpart_t part)
+{
+    if (benchmode)
+        partstart[part] = DG_GetTicksUs();
+}
+
+void D_BenchEnd(benchpart_t part)
+{
+    if (!benchmode)
+        return;
+
+    parttime[part] += DG_GetTicksUs() - partstart[part];
+
+    // Once per frame.
+    if (part == bench_encode)
+        frames++;
+}
+
+void D_BenchBytes(size_t len)
+{
+    bytes += len;
+}
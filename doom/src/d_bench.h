@@ -0,0 +1,37 @@
+#ifndef __D_BENCH__
+#define __D_BENCH__
+
+#include <stddef.h>
+
+#include "doomtype.h"
+
+// Timing the demos with -bench, as fast as they'll run and with nothing
+// connected, and how long each part of the frame took.
+
+// Parts of the frame that are timed.
+typedef enum {
+    bench_playsim, // P_Ticker
+    bench_bsp,     // R_RenderBSPNode: walls
+    bench_planes,  // R_DrawPlanes: floors and ceilings
+    bench_masked,  // R_DrawMasked: sprites and masked midtextures
+    bench_hud,     // status bar and heads up text
+    bench_convert, // I_ExpandFrame: palette expansion and scaling
+    bench_encode,  // DG_DrawFrame: making the frame to send
+    NUMBENCHPARTS
+} benchpart_t;
+
+extern boolean benchmode;
+
+// Time the next of the IWAD's demos, or once they've all been played as many
+// times over as -benchruns asks, print the results and quit. Called to start
+// the first, then as each one finishes.
+void D_BenchNextDemo(void);
+
+// Bracket each part of the frame; they do nothing without -bench.
+void D_BenchBegin(benchpart_t part);
+void D_BenchEnd(benchpart_t part);
+
+// Count bytes of encoded frames (and anything else) that would have been sent.
+void D_BenchBytes(size_t len);
+
+#endif
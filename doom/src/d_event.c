@@ -22,12 +22,23 @@
 #include <stdlib.h>
 
 #include "d_event.h"
+#include "i_timer.h"
 
-#define MAXEVENTS 64
+// Enough for a burst of input (e.g. a paste) to wait out a slow tic. Must be
+// a power of two.
+#define MAXEVENTS 1024
 
-static event_t events[MAXEVENTS];
-static int eventhead;
-static int eventtail;
+// Posted by one thread and popped by one (possibly other) thread without
+// locking: only the poster writes eventhead and only the popper eventtail.
+static struct {
+    event_t ev;
+    uint64_t time_us;
+} events[MAXEVENTS];
+static unsigned eventhead;
+static unsigned eventtail;
+
+// Events that arrived at or after this time are left for later tics.
+static uint64_t eventcutoff = UINT64_MAX;
 
 //
 // D_PostEvent
@@ -35,27 +46,50 @@ static int eventtail;
 //
 void D_PostEvent(event_t *ev)
 {
-    events[eventhead] = *ev;
-    eventhead = (eventhead + 1) % MAXEVENTS;
+    D_PostEventAt(ev, I_GetTimeUs());
+}
+
+void D_PostEventAt(event_t *ev, uint64_t time_us)
+{
+    unsigned head = __atomic_load_n(&eventhead, __ATOMIC_RELAXED);
+    unsigned tail = __atomic_load_n(&eventtail, __ATOMIC_ACQUIRE);
+
+    // Full; drop the new event rather than one the popper may be reading.
+
+    if (head - tail >= MAXEVENTS) {
+        return;
+    }
+
+    events[head % MAXEVENTS].ev = *ev;
+    events[head % MAXEVENTS].time_us = time_us;
+    __atomic_store_n(&eventhead, head + 1, __ATOMIC_RELEASE);
+}
+
+void D_SetEventCutoff(uint64_t time_us)
+{
+    eventcutoff = time_us;
 }
 
 // Read an event from the queue.
 
 event_t *D_PopEvent(void)
 {
-    event_t *result;
+    // Copied out, as the slot may be reused as soon as it's popped.
+    static event_t result;
+    unsigned tail = __atomic_load_n(&eventtail, __ATOMIC_RELAXED);
+    unsigned head = __atomic_load_n(&eventhead, __ATOMIC_ACQUIRE);
 
-    // No more events waiting.
+    // No more events waiting, or none for this tic.
 
-    if (eventtail == eventhead) {
+    if (tail == head || events[tail % MAXEVENTS].time_us >= eventcutoff) {
         return NULL;
     }
 
-    result = &events[eventtail];
+    result = events[tail % MAXEVENTS].ev;
 
     // Advance to the next event in the queue.
 
-    eventtail = (eventtail + 1) % MAXEVENTS;
+    __atomic_store_n(&eventtail, tail + 1, __ATOMIC_RELEASE);
 
-    return result;
+    return &result;
 }
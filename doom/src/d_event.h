@@ -19,6 +19,8 @@
 #ifndef __D_EVENT__
 #define __D_EVENT__
 
+#include <stdint.h>
+
 //
 // Event handling.
 //
@@ -109,7 +111,17 @@ typedef enum {
 // Called by IO functions when input is detected.
 void D_PostEvent(event_t *ev);
 
-// Read an event from the event queue
+// As D_PostEvent, for input that arrived at time_us (see I_GetTimeUs).
+// Events are dropped while the queue is full.
+void D_PostEventAt(event_t *ev, uint64_t time_us);
+
+// Makes D_PopEvent hold back events that arrived at or after time_us, so the
+// tics built to catch up only see input from their own time. UINT64_MAX to
+// return everything.
+void D_SetEventCutoff(uint64_t time_us);
+
+// Read an event from the event queue; the event is only valid until the next
+// call.
 
 event_t *D_PopEvent(void);
 
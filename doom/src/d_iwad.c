@@ -433,6 +433,24 @@ static char *SearchDirectoryForIWAD(char *dir, int mask, GameMission_t *mission)
     return NULL;
 }
 
+// Returns true if path is absolute, so there's nowhere else to look for
+// it.
+
+static boolean IsAbsolutePath(char *path)
+{
+#ifdef _WIN32
+    if (path[0] != '\0' && path[1] == ':') {
+        return true;
+    }
+
+    if (path[0] == '/') {
+        return true;
+    }
+#endif
+
+    return path[0] == DIR_SEPARATOR;
+}
+
 // When given an IWAD with the '-iwad' parameter,
 // attempt to identify it by its name.
 
@@ -475,6 +493,13 @@ static GameMission_t IdentifyIWADByName(char *name, int mask)
 
 static void BuildIWADDirList(void)
 {
+    // Every search would add the directories again otherwise, and the next
+    //  would look through them all twice over.
+
+    if (iwad_dirs_built) {
+        return;
+    }
+
     AddIWADDir(FILES_DIR);
 
     // Don't run this function again.
@@ -575,7 +600,15 @@ char *D_FindIWAD(int mask, GameMission_t *mission)
 
         iwadfile = myargv[iwadparm + 1];
 
-        result = D_FindWADByName(iwadfile);
+        // An absolute path, like the plugin passes, is used as it is
+        // rather than opened to check it exists first; loading it will
+        // find out anyway, and might be across a slow network.
+
+        if (IsAbsolutePath(iwadfile)) {
+            result = iwadfile;
+        } else {
+            result = D_FindWADByName(iwadfile);
+        }
 
         if (result == NULL) {
             I_Error("IWAD file '%s' not found!", iwadfile);
@@ -16,16 +16,25 @@
 //     Main loop code.
 //
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "d_event.h"
 #include "d_loop.h"
 #include "d_ticcmd.h"
+#include "doomfeatures.h"
 #include "i_system.h"
 #include "i_timer.h"
 #include "i_video.h"
+#include "m_argv.h"
 #include "m_fixed.h"
 #include "net_client.h"
+#include "net_gui.h"
+#include "net_io.h"
+#include "net_loop.h"
+#include "net_query.h"
+#include "net_server.h"
+#include "net_udp.h"
 
 // The complete set of data for a particular tic.
 
@@ -49,6 +58,13 @@ static ticcmd_set_t ticdata[BACKUPTICS];
 
 static int maketic;
 
+// In single player, the ticcmds for tics that are due are built just before
+// they run, rather than when NetUpdate finds they're due, so they take the
+// latest input; latebuild is set then, and duetics is how many are waiting.
+
+static boolean latebuild;
+static int duetics;
+
 // The number of complete tics received from the server so far.
 
 static int recvtic;
@@ -62,6 +78,15 @@ int gametic;
 
 boolean singletics = false;
 
+// Set while frames drawn between tics differ, so rather than waiting for the
+// next tic TryRunTics returns to have another drawn.
+
+boolean drawbetweentics;
+
+// I_GetTime() when the latest tic was run.
+
+int lasttictime;
+
 // Index of the local player.
 
 static int localplayer;
@@ -183,6 +208,7 @@ void NetUpdate(void)
 {
     int nowtime;
     int newtics;
+    uint64_t now_us, tic_us;
     int i;
 
     // If we are running with singletics (timing a demo), this
@@ -214,13 +240,59 @@ void NetUpdate(void)
         newtics = 0;
     }
 
-    // build new ticcmds for console player
+    // leave them for TryRunTics to build, as far ahead as BuildNewTic allows
+    if (latebuild) {
+        duetics += newtics;
+        if (maketic + duetics - gametic / ticdup > 5)
+            duetics = 5 - (maketic - gametic / ticdup);
+        return;
+    }
+
+    // build new ticcmds for console player; when catching up, each tic only
+    // gets the input that arrived by its end, taking the latest tic to end now
+
+    now_us = I_GetTimeUs();
+    tic_us = (uint64_t)ticdup * 1000000 / TICRATE;
 
     for (i = 0; i < newtics; i++) {
+        uint64_t end_ago_us = (uint64_t)(newtics - 1 - i) * tic_us;
+
+        if (end_ago_us > 0) {
+            D_SetEventCutoff(end_ago_us < now_us ? now_us - end_ago_us : 0);
+        } else {
+            D_SetEventCutoff(UINT64_MAX);
+        }
+
         if (!BuildNewTic()) {
             break;
         }
     }
+
+    D_SetEventCutoff(UINT64_MAX);
+}
+
+//
+// BuildDueTic
+// Builds the ticcmd for the tic about to run, which NetUpdate left to be built
+// now; as there, it only gets the input that arrived by its end, taking the
+// latest due tic to end now.
+//
+static void BuildDueTic(void)
+{
+    uint64_t now_us = I_GetTimeUs();
+    uint64_t end_ago_us =
+        (uint64_t)(duetics - 1) * ticdup * 1000000 / TICRATE;
+
+    if (end_ago_us > 0) {
+        D_SetEventCutoff(end_ago_us < now_us ? now_us - end_ago_us : 0);
+    } else {
+        D_SetEventCutoff(UINT64_MAX);
+    }
+
+    BuildNewTic();
+    --duetics;
+
+    D_SetEventCutoff(UINT64_MAX);
 }
 
 static void D_Disconnected(void)
@@ -273,10 +345,38 @@ void D_ReceiveTic(ticcmd_t *ticcmds, boolean *players_mask)
 void D_StartGameLoop(void)
 {
     lasttime = GetAdjustedTime() / ticdup;
+    duetics = 0;
+}
+
+#ifdef FEATURE_MULTIPLAYER
+
+// Block until the game start message is received from the server.
+
+static void BlockUntilStart(net_gamesettings_t *settings)
+{
+    while (!NET_CL_GetSettings(settings)) {
+        NET_CL_Run();
+        NET_SV_Run();
+
+        if (!net_client_connected) {
+            I_Error("Lost connection to server");
+        }
+
+        I_Sleep(10);
+    }
 }
 
+#endif
+
 void D_StartNetGame(net_gamesettings_t *settings)
 {
+#ifdef FEATURE_MULTIPLAYER
+    int i;
+#endif
+
+    offsetms = 0;
+    recvtic = 0;
+
     settings->consoleplayer = 0;
     settings->num_players = 1;
     settings->player_classes[0] = player_class;
@@ -284,8 +384,70 @@ void D_StartNetGame(net_gamesettings_t *settings)
     settings->extratics = 1;
     settings->ticdup = 1;
 
+#ifdef FEATURE_MULTIPLAYER
+
+    //!
+    // @category net
+    //
+    // Use the classic Vanilla sync code in netgames, where the first
+    // player keeps time for everyone, rather than each client adjusting
+    // its clock so that its tics reach the server just in time.
+    //
+
+    settings->new_sync =
+        net_client_connected && M_CheckParm("-oldsync") == 0;
+
+    //!
+    // @category net
+    // @arg <n>
+    //
+    // Send n extra tics in every packet as insurance against dropped
+    // packets.
+    //
+
+    i = M_CheckParmWithArgs("-extratics", 1);
+
+    if (i > 0)
+        settings->extratics = atoi(myargv[i + 1]);
+
+    //!
+    // @category net
+    // @arg <n>
+    //
+    // Reduce the resolution of the game by a factor of n, reducing
+    // the amount of network bandwidth needed.
+    //
+
+    i = M_CheckParmWithArgs("-dup", 1);
+
+    if (i > 0)
+        settings->ticdup = atoi(myargv[i + 1]);
+
+    if (net_client_connected) {
+        // Send our game settings and block until game start is received
+        // from the server.
+
+        NET_CL_StartGame(settings);
+        BlockUntilStart(settings);
+    }
+
+    if (drone) {
+        settings->consoleplayer = 0;
+    }
+
+    // Set the local player and playeringame[] values.
+
+    localplayer = settings->consoleplayer;
+
+    for (i = 0; i < NET_MAXPLAYERS; ++i) {
+        local_playeringame[i] = i < settings->num_players;
+    }
+
+#endif
+
     ticdup = settings->ticdup;
     new_sync = settings->new_sync;
+    latebuild = !net_client_connected && !drone;
 }
 
 boolean D_InitNetGame(net_connect_data_t *connect_data)
@@ -314,8 +476,7 @@ boolean D_InitNetGame(net_connect_data_t *connect_data)
     if (M_CheckParm("-server") > 0 || M_CheckParm("-privateserver") > 0) {
         NET_SV_Init();
         NET_SV_AddModule(&net_loop_server_module);
-        NET_SV_AddModule(&net_sdl_module);
-        NET_SV_RegisterWithMaster();
+        NET_SV_AddModule(&net_udp_module);
 
         net_loop_client_module.InitClient();
         addr = net_loop_client_module.ResolveAddress(NULL);
@@ -348,8 +509,8 @@ boolean D_InitNetGame(net_connect_data_t *connect_data)
         i = M_CheckParmWithArgs("-connect", 1);
 
         if (i > 0) {
-            net_sdl_module.InitClient();
-            addr = net_sdl_module.ResolveAddress(myargv[i + 1]);
+            net_udp_module.InitClient();
+            addr = net_udp_module.ResolveAddress(myargv[i + 1]);
 
             if (addr == NULL) {
                 I_Error("Unable to resolve '%s'\n", myargv[i + 1]);
@@ -397,7 +558,7 @@ static int GetLowTic(void)
 {
     int lowtic;
 
-    lowtic = maketic;
+    lowtic = maketic + duetics;
 
 #ifdef FEATURE_MULTIPLAYER
     if (net_client_connected) {
@@ -534,6 +695,7 @@ void TryRunTics(void)
     // is called.
 
     if (singletics) {
+        duetics = 0;
         BuildNewTic();
     } else {
         NetUpdate();
@@ -584,7 +746,10 @@ void TryRunTics(void)
             return;
         }
 
-        I_Sleep(1);
+        if (drawbetweentics && screenvisible)
+            return;
+
+        I_WaitForNextTic();
     }
 
     // run the count * ticdup dics
@@ -595,6 +760,9 @@ void TryRunTics(void)
             return;
         }
 
+        if (duetics > 0 && maketic == gametic / ticdup)
+            BuildDueTic();
+
         set = &ticdata[(gametic / ticdup) % BACKUPTICS];
 
         if (!net_client_connected) {
@@ -609,6 +777,7 @@ void TryRunTics(void)
 
             loop_interface->RunTic(set->cmds, set->ingame);
             gametic++;
+            lasttictime = I_GetTime();
 
             // modify command for duplicated tics
 
@@ -67,6 +67,11 @@ void D_StartGameLoop(void);
 
 boolean D_InitNetGame(net_connect_data_t *connect_data);
 
+// Invoked by the network code when a complete set of ticcmds is available,
+// or with both NULL when disconnected from the server.
+
+void D_ReceiveTic(ticcmd_t *ticcmds, boolean *players_mask);
+
 // Start game with specified settings. The structure will be updated
 // with the actual settings for the game.
 
@@ -74,5 +79,7 @@ void D_StartNetGame(net_gamesettings_t *settings);
 
 extern boolean singletics;
 extern int gametic, ticdup;
+extern boolean drawbetweentics;
+extern int lasttictime;
 
 #endif
@@ -25,30 +25,42 @@
 
 #include "am_map.h"
 #include "config.h"
+#include "d_bench.h"
 #include "d_englsh.h"
 #include "d_iwad.h"
 #include "d_loop.h"
 #include "d_main.h"
+#include "d_replay.h"
 #include "doomdef.h"
+#include "doomfeatures.h"
 #include "doomgeneric.h"
 #include "doomstat.h"
 #include "f_finale.h"
 #include "f_wipe.h"
 #include "g_game.h"
+#include "g_rewind.h"
+#include "g_seek.h"
 #include "hu_stuff.h"
+#include "i_cpu.h"
 #include "i_endoom.h"
 #include "i_joystick.h"
 #include "i_system.h"
+#include "i_thread.h"
 #include "i_timer.h"
 #include "i_video.h"
 #include "m_argv.h"
 #include "m_config.h"
 #include "m_controls.h"
 #include "m_menu.h"
+#include "m_flight.h"
 #include "m_misc.h"
+#include "m_profile.h"
 #include "net_client.h"
+#include "net_dedicated.h"
+#include "net_query.h"
 #include "p_saveg.h"
 #include "p_setup.h"
+#include "p_tick.h"
 #include "r_draw.h"
 #include "r_main.h"
 #include "r_state.h"
@@ -85,6 +97,7 @@ boolean devparm;     // started game with -devparm
 boolean nomonsters;  // checkparm of -nomonsters
 boolean respawnparm; // checkparm of -respawn
 boolean fastparm;    // checkparm of -fast
+boolean uncapped;    // checkparm of -uncapped
 
 // extern int soundVolume;
 // extern  int  sfxVolume;
@@ -148,6 +161,123 @@ extern boolean setsizeneeded;
 extern int showMessages;
 void R_ExecuteSetViewSize(void);
 
+// The last view drawn, copied back rather than drawn again while nothing in it
+// can have changed, e.g. while paused or in a menu; nothing in the level
+// changes without leveltime advancing. With -viewthread, also where the view
+// the last frame started is kept until this one shows it.
+static struct {
+    byte *data;
+    boolean valid;
+    boolean background; // drawn by the view thread, not yet shown
+    int leveltime;
+    fixed_t fractionaltic;
+    int displayplayer;
+} viewcache;
+
+static void D_CopyView(byte *dest, byte *src)
+{
+    int y;
+    int ofs;
+
+    for (y = viewwindowy; y < viewwindowy + viewheight; y++) {
+        ofs = y * SCREENWIDTH + viewwindowx;
+        memcpy(dest + ofs, src + ofs, scaledviewwidth);
+    }
+}
+
+// Whether the cached view is of the moment about to be drawn.
+static boolean D_ViewCacheCurrent(void)
+{
+    return viewcache.leveltime == leveltime
+           && viewcache.fractionaltic == fractionaltic
+           && viewcache.displayplayer == displayplayer;
+}
+
+static void D_DrawView(void)
+{
+    if (viewcache.valid && viewcache.background) {
+        D_CopyView(I_VideoBuffer, viewcache.data);
+        viewcache.background = false;
+        return;
+    }
+
+    if (viewcache.valid && D_ViewCacheCurrent()) {
+        D_CopyView(I_VideoBuffer, viewcache.data);
+        return;
+    }
+
+    R_RenderPlayerView(&players[displayplayer]);
+
+    if (!viewcache.data)
+        viewcache.data = I_Realloc(NULL, SCREENWIDTH * SCREENHEIGHT);
+
+    D_CopyView(viewcache.data, I_VideoBuffer);
+    viewcache.valid = true;
+    viewcache.background = false;
+    viewcache.leveltime = leveltime;
+    viewcache.fractionaltic = fractionaltic;
+    viewcache.displayplayer = displayplayer;
+}
+
+//
+// D_StartView
+// With -viewthread, start drawing the view for the next frame to show while
+// the tics before it run, unless the cached one will do.
+//
+static void D_StartView(void)
+{
+    if (!viewthread || gamestate != GS_LEVEL || automapactive || !gametic)
+        return;
+
+    if (viewcache.valid && D_ViewCacheCurrent())
+        return;
+
+    R_StartPlayerView(&players[displayplayer]);
+
+    viewcache.valid = false;
+    viewcache.leveltime = leveltime;
+    viewcache.fractionaltic = fractionaltic;
+    viewcache.displayplayer = displayplayer;
+}
+
+//
+// D_FrameFrozen
+// With the UI detached, only the view and its border are drawn into the
+// frame, and neither changes while the game's paused, or stopped behind a
+// menu, once the view's been drawn; the UI over it is sent as its state.
+//
+static boolean D_FrameFrozen(void)
+{
+    return detached_ui && gamestate == GS_LEVEL && gametic && !automapactive
+           && !testcontrols
+           && (paused || (menuactive && !netgame && !demoplayback))
+           && viewcache.valid && !viewcache.background && D_ViewCacheCurrent();
+}
+
+//
+// D_SetFractionalTic
+// How far time is through the latest tic, if things moved in it and frames
+// are drawn between tics.
+//
+static void D_SetFractionalTic(void)
+{
+    int64_t frac;
+
+    fractionaltic = FRACUNIT;
+
+    if (uncapped && !singletics && gamestate == GS_LEVEL
+        && savedpositionstime == leveltime - 1) {
+        frac = (int64_t)I_GetTimeUs() * TICRATE * FRACUNIT / 1000000
+               - (int64_t)lasttictime * FRACUNIT;
+        if (frac < 0)
+            fractionaltic = 0;
+        else if (frac < FRACUNIT)
+            fractionaltic = frac;
+    }
+
+    drawbetweentics = fractionaltic < FRACUNIT;
+}
+
 void D_Display(void)
 {
     static boolean viewactivestate = false;
@@ -156,18 +286,33 @@ void D_Display(void)
     static boolean fullscreen = false;
     static gamestate_t oldgamestate = -1;
     static int old_detached_ui;
+    static boolean frozenstate = false;
     int nowtime;
     int tics;
     int wipestart;
     int y;
     boolean done;
     boolean wipe;
+    boolean frozen;
     boolean redrawsbar = false;
     boolean redrawborder = false;
 
     if (nodrawers)
         return; // for comparative timing / profiling
 
+    // the view started last frame is drawn into the frame buffer, which is
+    // about to be drawn over
+    if (R_FinishPlayerView()) {
+        if (!viewcache.data)
+            viewcache.data = I_Realloc(NULL, SCREENWIDTH * SCREENHEIGHT);
+
+        D_CopyView(viewcache.data, I_VideoBuffer);
+        viewcache.valid = true;
+        viewcache.background = true;
+    }
+
+    D_SetFractionalTic();
+
     if (detached_ui != old_detached_ui) {
         redrawsbar = true; // force status bar redraw
 
@@ -181,15 +326,24 @@ void D_Display(void)
         R_ExecuteSetViewSize();
         oldgamestate = -1; // force background redraw
         redrawborder = true;
+        viewcache.valid = false;
     }
 
-    // save the current screen if about to wipe
+    // save the current screen if about to wipe; not when benchmarking, as
+    // wipes take as long however fast the game runs
     if (gamestate != wipegamestate) {
-        wipe = true;
-        wipe_StartScreen();
+        wipe = !benchmode;
+        if (wipe)
+            wipe_StartScreen();
+        viewcache.valid = false; // likely a new level
     } else
         wipe = false;
 
+    // Once drawn while frozen, the frame is shown again as it was, so long as
+    // nothing's been changed.
+    frozen = frozenstate && D_FrameFrozen() && !wipe && !redrawborder
+             && detached_ui == old_detached_ui;
+
     if (gamestate == GS_LEVEL && gametic)
         HU_Erase();
 
@@ -204,7 +358,9 @@ void D_Display(void)
             redrawsbar = true;
         if (inhelpscreensstate && !inhelpscreens)
             redrawsbar = true; // just put away the help screen
+        D_BenchBegin(bench_hud);
         ST_Drawer(viewheight == SCREENHEIGHT, redrawsbar);
+        D_BenchEnd(bench_hud);
         fullscreen = viewheight == SCREENHEIGHT;
         break;
 
@@ -225,15 +381,18 @@ void D_Display(void)
     I_UpdateNoBlit();
 
     // draw the view directly
-    if (gamestate == GS_LEVEL && !automapactive && gametic)
-        R_RenderPlayerView(&players[displayplayer]);
+    if (gamestate == GS_LEVEL && !automapactive && gametic && !frozen)
+        D_DrawView();
 
-    if (gamestate == GS_LEVEL && gametic)
+    if (gamestate == GS_LEVEL && gametic) {
+        D_BenchBegin(bench_hud);
         HU_Drawer();
+        D_BenchEnd(bench_hud);
+    }
 
     // clean up border stuff
     if (gamestate != oldgamestate && gamestate != GS_LEVEL)
-        I_SetPalette(W_CacheLumpName("PLAYPAL", PU_CACHE));
+        I_SetPlaypal(0);
 
     // see if the border needs to be initially drawn
     if (gamestate == GS_LEVEL && oldgamestate != GS_LEVEL) {
@@ -245,7 +404,7 @@ void D_Display(void)
     if (gamestate == GS_LEVEL && !automapactive) {
         if (menuactive || menuactivestate || !viewactivestate)
             redrawborder = true;
-        if (redrawborder)
+        if (redrawborder && !frozen)
             R_DrawViewBorder(); // erase old menu stuff
     }
 
@@ -263,9 +422,10 @@ void D_Display(void)
             if (automapactive)
                 y = 4;
             else
-                y = viewwindowy + 4;
-            V_DrawPatchDirect(viewwindowx + (scaledviewwidth - 68) / 2, y,
-                              W_CacheLumpName("M_PAUSE", PU_CACHE));
+                y = (viewwindowy >> hires) + 4;
+            V_DrawPatchDirect(
+                (viewwindowx + (scaledviewwidth - (68 << hires)) / 2) >> hires,
+                y, W_CacheLumpName("M_PAUSE", PU_CACHE));
         }
     }
 
@@ -274,14 +434,19 @@ void D_Display(void)
     inhelpscreensstate = inhelpscreens;
     oldgamestate = wipegamestate = gamestate;
     old_detached_ui = detached_ui;
+    frozenstate = !wipe && D_FrameFrozen();
 
     // menus go directly to the screen
     M_Drawer();  // menu is drawn even on top of everything
     NetUpdate(); // send out any new accumulation
 
     // normal update
-    if (!wipe) {
+    if (frozen) {
+        I_RepeatUpdate();
+        return;
+    } else if (!wipe) {
         I_FinishUpdate(); // page flip or blit buffer
+        D_StartView();
         return;
     }
 
@@ -294,7 +459,7 @@ void D_Display(void)
         do {
             nowtime = I_GetTime();
             tics = nowtime - wipestart;
-            I_Sleep(1);
+            I_WaitForNextTic();
         } while (tics <= 0);
 
         wipestart = nowtime;
@@ -347,9 +512,14 @@ void D_BindVariables(void)
     M_BindVariable("detaillevel", &detailLevel);
     M_BindVariable("snd_channels", &snd_channels);
     M_BindVariable("vanilla_savegame_limit", &vanilla_savegame_limit);
+    M_BindVariable("compressed_savegames", &compressed_savegames);
+    M_BindVariable("delta_savegames", &delta_savegames);
     M_BindVariable("vanilla_demo_limit", &vanilla_demo_limit);
+    M_BindVariable("rewind_interval", &rewind_interval);
+    M_BindVariable("rewind_memory", &rewind_memory);
     M_BindVariable("show_endoom", &show_endoom);
     M_BindVariable("detached_ui", &detached_ui);
+    M_BindVariable("indexed_frames", &indexed_frames);
 
     // Multiplayer chat macros
 
@@ -386,6 +556,10 @@ boolean D_GrabMouseCallback(void)
 
 void doomgeneric_Tick(void)
 {
+    // When the last frame in a level was drawn, or 0 if it wasn't.
+    static uint64_t lastframetime;
+    uint64_t now;
+
     // frame syncronous IO operations
     I_StartFrame();
 
@@ -395,8 +569,32 @@ void doomgeneric_Tick(void)
 
     // Update display, next frame, with current state.
     if (screenvisible) {
+        DG_StartDisplay();
         D_Display();
+
+        now = I_GetTimeUs();
+        if (lastframetime != 0 && gamestate == GS_LEVEL) {
+            StatFrameTime(now - lastframetime);
+            M_FlightFrame(now - lastframetime);
+        }
+        lastframetime = gamestate == GS_LEVEL ? now : 0;
     }
+
+    Z_EndFrame();
+}
+
+//
+// D_FastDemoLoop
+// Runs tics back to back, with nothing drawn or sent, until the demo ends
+// and G_CheckDemoStatus quits.
+//
+static void D_FastDemoLoop(void)
+{
+    main_loop_started = true;
+    D_StartGameLoop();
+
+    while (true)
+        TryRunTics();
 }
 
 //
@@ -415,6 +613,10 @@ void D_DoomLoop(void)
     if (demorecording)
         G_BeginRecording();
 
+    // Don't catch up on the tics spent waiting.
+    if (DG_AwaitClient())
+        D_StartGameLoop();
+
     main_loop_started = true;
 
     TryRunTics();
@@ -853,11 +1055,53 @@ static void D_Endoom(void)
 //
 // D_DoomMain
 //
+
+// How long each step of startup took, printed once they're all done.
+#define MAXSTARTUPSTEPS 16
+
+static struct {
+    const char *name;
+    uint64_t us;
+} startupsteps[MAXSTARTUPSTEPS];
+static int numstartupsteps;
+static uint64_t startupstepstart;
+
+// Ends the current startup step, if any, and starts the one named.
+static void D_StartupStep(const char *name)
+{
+    uint64_t now = DG_GetTicksUs();
+
+    if (numstartupsteps > 0)
+        startupsteps[numstartupsteps - 1].us = now - startupstepstart;
+
+    if (name != NULL && numstartupsteps < MAXSTARTUPSTEPS)
+        startupsteps[numstartupsteps++].name = name;
+
+    startupstepstart = now;
+}
+
+static void D_PrintStartupProfile(void)
+{
+    uint64_t total = 0;
+    int i;
+
+    D_StartupStep(NULL);
+
+    printf("Startup:");
+    for (i = 0; i < numstartupsteps; i++) {
+        printf(" %s %.1fms,", startupsteps[i].name,
+               startupsteps[i].us / 1000.0);
+        total += startupsteps[i].us;
+    }
+    printf(" total %.1fms\n", total / 1000.0);
+}
+
 void D_DoomMain(void)
 {
     int p;
     char file[256];
-    char demolumpname[9];
+    static char demolumpname[9];
+    boolean loaded;
 
     I_AtExit(D_Endoom, false);
 
@@ -866,6 +1110,7 @@ void D_DoomMain(void)
     I_PrintBanner(PACKAGE_STRING);
 
     printf("Z_Init: Init zone memory allocation daemon. \n");
+    D_StartupStep("Z_Init");
     Z_Init();
 
 #ifdef FEATURE_MULTIPLAYER
@@ -883,18 +1128,6 @@ void D_DoomMain(void)
         // Never returns
     }
 
-    //!
-    // @category net
-    //
-    // Query the Internet master server for a global list of active
-    // servers.
-    //
-
-    if (M_CheckParm("-search")) {
-        NET_MasterQuery();
-        exit(0);
-    }
-
     //!
     // @arg <address>
     // @category net
@@ -947,6 +1180,15 @@ void D_DoomMain(void)
 
     fastparm = M_CheckParm("-fast");
 
+    //!
+    // @category video
+    //
+    // Draw as many frames as the display takes, moving things smoothly
+    // between tics, rather than one frame per tic.
+    //
+
+    uncapped = M_CheckParm("-uncapped");
+
     //!
     // @vanilla
     //
@@ -1034,10 +1276,12 @@ void D_DoomMain(void)
 
     // init subsystems
     printf("V_Init: allocate screens.\n");
+    D_StartupStep("V_Init");
     V_Init();
 
     // Load configuration files before initialising other subsystems.
     printf("M_LoadDefaults: Load system defaults.\n");
+    D_StartupStep("M_LoadDefaults");
     M_SetConfigFilenames("default.cfg", PROGRAM_PREFIX "doom.cfg");
     D_BindVariables();
     M_LoadDefaults();
@@ -1058,7 +1302,9 @@ void D_DoomMain(void)
     modifiedgame = false;
 
     printf("W_Init: Init WADfiles.\n");
-    D_AddFile(iwadfile);
+    D_StartupStep("W_Init");
+    if (!D_AddFile(iwadfile))
+        I_Error("IWAD file '%s' not found!", iwadfile);
 
     W_CheckCorrectIWAD(doom);
 
@@ -1108,6 +1354,9 @@ void D_DoomMain(void)
         p = M_CheckParmWithArgs("-timedemo", 1);
     }
 
+    if (!p)
+        p = M_CheckParmWithArgs("-fastdemo", 1);
+
     if (p) {
         // With Vanilla you have to specify the file without extension,
         // but make that optional.
@@ -1117,7 +1366,8 @@ void D_DoomMain(void)
             snprintf(file, sizeof(file), "%s.lmp", myargv[p + 1]);
         }
 
-        if (D_AddFile(file)) {
+        loaded = D_AddFile(file);
+        if (loaded) {
             M_StringCopy(demolumpname, lumpinfo[numlumps - 1].name,
                          sizeof(demolumpname));
         } else {
@@ -1129,6 +1379,10 @@ void D_DoomMain(void)
         }
 
         printf("Playing demo %s.\n", file);
+
+        // Not when timing the screen's framerate.
+        if (p != M_CheckParm("-timedemo"))
+            G_InitDemoSeek(loaded ? file : NULL);
     }
 
     I_AtExit((atexit_func_t)G_CheckDemoStatus, true);
@@ -1214,7 +1468,11 @@ void D_DoomMain(void)
     }
 
     printf("I_Init: Setting up machine state.\n");
+    D_StartupStep("I_Init");
+    I_InitCPU();
     I_CheckIsScreensaver();
+    I_SetSchedulingOptions();
+    I_InitWorkers();
     I_InitTimer();
     I_InitJoystick();
     I_InitSound(true);
@@ -1351,28 +1609,37 @@ void D_DoomMain(void)
     }
 
     printf("M_Init: Init miscellaneous info.\n");
+    D_StartupStep("M_Init");
     M_Init();
 
     printf("R_Init: Init DOOM refresh daemon - ");
+    D_StartupStep("R_Init");
     R_Init();
 
     printf("\nP_Init: Init Playloop state.\n");
+    D_StartupStep("P_Init");
     P_Init();
 
     printf("S_Init: Setting up sound.\n");
+    D_StartupStep("S_Init");
     S_Init(sfxVolume * 8, musicVolume * 8);
 
     printf("D_CheckNetGame: Checking network game status.\n");
+    D_StartupStep("D_CheckNetGame");
     D_CheckNetGame();
 
     PrintGameVersion();
 
     printf("HU_Init: Setting up heads up display.\n");
+    D_StartupStep("HU_Init");
     HU_Init();
 
     printf("ST_Init: Init status bar.\n");
+    D_StartupStep("ST_Init");
     ST_Init();
 
+    D_PrintStartupProfile();
+
     // If Doom II without a MAP01 lump, this is a store demo.
     // Moved this here so that MAP01 isn't constantly looked up
     // in the main loop.
@@ -1380,11 +1647,24 @@ void D_DoomMain(void)
     if (gamemode == commercial && W_CheckNumForName("map01") < 0)
         storedemo = true;
 
+    //!
+    // @arg <file>
+    // @category demo
+    //
+    // At exit, write the frame and tic times of each level completed to
+    // file, or to stdout if it's "-": how many, their 50th, 95th and 99th
+    // percentiles and the longest.
+    //
+
     if (M_CheckParmWithArgs("-statdump", 1)) {
         I_AtExit(StatDump, true);
         printf("External statistics registered.\n");
     }
 
+    M_ProfileInit();
+    M_FlightInit();
+    D_ReplayInit();
+
     //!
     // @arg <x>
     // @category demo
@@ -1415,6 +1695,17 @@ void D_DoomMain(void)
         return;
     }
 
+    if (fastdemo) {
+        G_TimeDemo(demolumpname);
+        D_FastDemoLoop();
+    }
+
+    if (benchmode) {
+        D_BenchNextDemo();
+        D_DoomLoop();
+        return;
+    }
+
     if (startloadgame >= 0) {
         M_StringCopy(file, P_SaveGameFile(startloadgame), sizeof(file));
         G_LoadGame(file);
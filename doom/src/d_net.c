@@ -19,20 +19,22 @@
 
 #include "d_loop.h"
 #include "d_main.h"
+#include "d_replay.h"
 #include "doomdef.h"
 #include "doomstat.h"
 #include "g_game.h"
+#include "g_seek.h"
+#include "i_timer.h"
 #include "m_argv.h"
+#include "m_flight.h"
 #include "m_menu.h"
 #include "m_misc.h"
+#include "statdump.h"
 #include "w_checksum.h"
 #include "w_wad.h"
 
 ticcmd_t *netcmds;
 
-boolean net_client_connected = false;
-boolean drone = false;
-
 // Called when a player leaves the game
 
 static void PlayerQuitGame(player_t *player)
@@ -60,6 +62,9 @@ static void RunTic(ticcmd_t *cmds, boolean *ingame)
 {
     extern boolean advancedemo;
     unsigned int i;
+    boolean inlevel;
+    uint64_t start;
+    uint64_t us;
 
     // Check for player quits.
 
@@ -77,7 +82,20 @@ static void RunTic(ticcmd_t *cmds, boolean *ingame)
     if (advancedemo)
         D_DoAdvanceDemo();
 
+    // Only tics played out within a level are counted towards it, not those
+    // loading or leaving one.
+    inlevel = gamestate == GS_LEVEL;
+    start = I_GetTimeUs();
     G_Ticker();
+    if (inlevel && gamestate == GS_LEVEL) {
+        us = I_GetTimeUs() - start;
+        StatTicTime(us);
+        M_FlightTic(us);
+    }
+
+    G_SeekDemo();
+
+    D_ReplayTic();
 }
 
 static loop_interface_t doom_loop_interface = {D_ProcessEvents, G_BuildTiccmd,
@@ -73,6 +73,8 @@ typedef struct player_s {
     //  including viewpoint bobbing during movement.
     // Focal origin above r.z
     fixed_t viewz;
+    // viewz at the start of the tic, for drawing between tics.
+    fixed_t oldviewz;
     // Base height above floor for viewz.
     fixed_t viewheight;
     // Bob/squat speed.
@@ -146,6 +148,10 @@ typedef struct player_s {
     // True if secret level has been done.
     boolean didsecret;
 
+    // Set whenever health, armor, ammo, weapons or keys change, so the
+    // detached status display is only sent on change. Not saved.
+    boolean statusdirty;
+
 } player_t;
 
 //
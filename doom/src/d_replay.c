@@ -0,0 +1,173 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "d_loop.h"
+#include "d_replay.h"
+#include "doomstat.h"
+#include "i_system.h"
+#include "i_video.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "m_random.h"
+#include "p_local.h"
+
+// 64-bit FNV-1a.
+#define HASHBASIS UINT64_C(0xcbf29ce484222325)
+#define HASHPRIME UINT64_C(0x100000001b3)
+
+static FILE *recordfile;
+static FILE *checkfile;
+static const char *checkpath;
+
+static int numtics;
+static int numframes;
+
+static uint64_t HashBytes(uint64_t hash, const void *data, size_t len)
+{
+    const byte *p = data;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= HASHPRIME;
+    }
+    return hash;
+}
+
+static uint64_t HashInt(uint64_t hash, int32_t v)
+{
+    return HashBytes(hash, &v, sizeof(v));
+}
+
+static void CheckEnd(void)
+{
+    char golden[64];
+
+    if (fgets(golden, sizeof(golden), checkfile) != NULL) {
+        golden[strcspn(golden, "\n")] = '\0';
+        I_Error("D_ReplayCheck: Ended before %s in %s", golden, checkpath);
+    }
+
+    printf("D_ReplayCheck: %i tics and %i frames match %s\n", numtics,
+           numframes, checkpath);
+}
+
+static void CloseRecord(void)
+{
+    if (fclose(recordfile) != 0)
+        fprintf(stderr, "D_ReplayRecord: Failed to write\n");
+    else
+        printf("D_ReplayRecord: Wrote %i tics and %i frames\n", numtics,
+               numframes);
+}
+
+void D_ReplayInit(void)
+{
+    int p;
+
+    //!
+    // @arg <file>
+    // @category demo
+    //
+    // Write a hash of the playsim (every mobj and the P_Random index)
+    // after each tic and of each frame to file, for -replaycheck to
+    // compare against. Best used with -bench, which plays the demos
+    // without a client.
+    //
+
+    p = M_CheckParmWithArgs("-replayrecord", 1);
+    if (p) {
+        recordfile = fopen(myargv[p + 1], "w");
+        if (!recordfile)
+            I_Error("D_ReplayInit: Failed to open %s", myargv[p + 1]);
+        I_AtExit(CloseRecord, false);
+    }
+
+    //!
+    // @arg <file>
+    // @category demo
+    //
+    // Compare the hashes of each tic and frame against those written to
+    // file by -replayrecord, stopping at the first tic or frame that
+    // differs.
+    //
+
+    p = M_CheckParmWithArgs("-replaycheck", 1);
+    if (p) {
+        checkpath = myargv[p + 1];
+        checkfile = fopen(checkpath, "r");
+        if (!checkfile)
+            I_Error("D_ReplayInit: Failed to open %s", checkpath);
+        I_AtExit(CheckEnd, false);
+    }
+}
+
+// Record or check a line of the form "<kind> <gametic> <hash>".
+static void Replay(const char *kind, uint64_t hash)
+{
+    char line[64];
+    char golden[64];
+
+    M_snprintf(line, sizeof(line), "%s %i %016" PRIx64 "\n", kind, gametic,
+               hash);
+
+    if (recordfile)
+        fputs(line, recordfile);
+
+    if (checkfile) {
+        if (fgets(golden, sizeof(golden), checkfile) == NULL)
+            I_Error("D_ReplayCheck: %s %i is past the end of %s", kind,
+                    gametic, checkpath);
+
+        if (strcmp(line, golden) != 0) {
+            *strchr(line, '\n') = '\0';
+            golden[strcspn(golden, "\n")] = '\0';
+            I_Error("D_ReplayCheck: First difference: %s, expected %s",
+                    line, golden);
+        }
+    }
+}
+
+void D_ReplayTic(void)
+{
+    thinker_t *th;
+    mobj_t *mo;
+    uint64_t hash = HASHBASIS;
+
+    if (!recordfile && !checkfile)
+        return;
+
+    numtics++;
+    hash = HashInt(hash, prndindex);
+
+    if (gamestate == GS_LEVEL) {
+        for (th = thinkerclasscap[th_mobj].cnext;
+             th != &thinkerclasscap[th_mobj]; th = th->cnext) {
+            mo = (mobj_t *)th;
+            hash = HashInt(hash, mo->x);
+            hash = HashInt(hash, mo->y);
+            hash = HashInt(hash, mo->z);
+            hash = HashInt(hash, mo->angle);
+            hash = HashInt(hash, mo->momx);
+            hash = HashInt(hash, mo->momy);
+            hash = HashInt(hash, mo->momz);
+            hash = HashInt(hash, mo->health);
+            hash = HashInt(hash, mo->state - states);
+            hash = HashInt(hash, mo->flags);
+        }
+    }
+
+    Replay("tic", hash);
+}
+
+void D_ReplayFrame(void)
+{
+    if (!recordfile && !checkfile)
+        return;
+
+    numframes++;
+    Replay("frame",
+           HashBytes(HASHBASIS, I_VideoBuffer, SCREENWIDTH * SCREENHEIGHT));
+}
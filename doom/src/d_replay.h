@@ -0,0 +1,15 @@
+#ifndef __D_REPLAY__
+#define __D_REPLAY__
+
+// Checking that demos still play out and draw the same, with -replayrecord
+// writing a hash of the playsim after each tic and of each frame to a file,
+// and -replaycheck comparing them against one written earlier.
+
+// Check for -replayrecord and -replaycheck.
+void D_ReplayInit(void);
+
+// Called after each tic is run and as each frame is finished.
+void D_ReplayTic(void);
+void D_ReplayFrame(void);
+
+#endif
@@ -35,11 +35,28 @@ typedef void (*think_t)(struct thinker_s *);
 
 #define THINKER_REMOVED ((think_t)(-1))
 
+// Whether a thinker is being run each tic; see P_SleepThinker.
+typedef enum {
+    ts_awake,
+    ts_drowsy, // goes to sleep once it has finished thinking
+    ts_asleep, // on the sleep list rather than the thinker list
+    ts_waking  // waiting to be put back in the thinker list
+} thinkersleep_t;
+
 // Doubly linked list of actors.
 typedef struct thinker_s {
     struct thinker_s *prev;
     struct thinker_s *next;
     think_t function;
+
+    // Links in the list of thinkers of the same class.
+    struct thinker_s *cprev;
+    struct thinker_s *cnext;
+
+    // Rises along the thinker list, so a woken thinker can be put back
+    // where it was.
+    int order;
+    thinkersleep_t sleep;
 } thinker_t;
 
 #endif
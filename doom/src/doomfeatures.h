@@ -25,10 +25,15 @@
 
 // Enables multiplayer support (network games)
 
-#undef FEATURE_MULTIPLAYER
+#define FEATURE_MULTIPLAYER
 
 // Enables sound output
 
 #undef FEATURE_SOUND
 
+// Enables counting the work done by the renderer and playsim each frame, for
+// the stats and -bench (see m_counts.h)
+
+#define FEATURE_WORK_COUNTS
+
 #endif /* #ifndef DOOM_FEATURES_H */
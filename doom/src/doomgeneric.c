@@ -1,9 +1,13 @@
 #include <stdlib.h>
 
+#include "d_bench.h"
 #include "doomgeneric.h"
+#include "doomstat.h"
+#include "i_system.h"
 #include "m_argv.h"
 
 byte *DG_ScreenBuffer = NULL;
+screen_mode_t *DG_ScreenMode = NULL;
 
 void M_FindResponseFile(void);
 void D_DoomMain(void);
@@ -16,6 +20,49 @@ void doomgeneric_Create(int argc, char **argv)
 
     M_FindResponseFile();
 
+    //!
+    // @arg <scale>
+    // @category video
+    //
+    // Render at scale (1, 2 or 4) times the original 320x200 resolution.
+    //
+
+    int p = M_CheckParmWithArgs("-hires", 1);
+    if (p > 0) {
+        switch (atoi(myargv[p + 1])) {
+        case 1:
+            hires = 0;
+            break;
+        case 2:
+            hires = 1;
+            break;
+        case 4:
+            hires = 2;
+            break;
+        default:
+            I_Error("Invalid -hires scale: %s", myargv[p + 1]);
+        }
+    }
+
+    //!
+    // @category demo
+    //
+    // Time the IWAD's demos as fast as they'll play, without a client, and
+    // print how long each part of the frame took.
+    //
+
+    benchmode = M_CheckParm("-bench");
+
+    //!
+    // @arg <demo>
+    // @category demo
+    //
+    // Play back the demo as fast as possible without a client, running
+    // just the playsim with nothing drawn, then print the tics per second.
+    //
+
+    fastdemo = M_CheckParmWithArgs("-fastdemo", 1) > 0;
+
     DG_ScreenBuffer = malloc(DOOMGENERIC_SCREEN_BUF_SIZE);
 
     DG_Init();
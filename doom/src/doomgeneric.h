@@ -10,11 +10,28 @@
 #include "p_saveg.h"
 #include "wi_stuff.h"
 
-#define DOOMGENERIC_SCREEN_BUF_SIZE (SCREENWIDTH * SCREENHEIGHT * 3)
+// Largest factor DG_ScreenMode may scale frames by.
+#define DOOMGENERIC_MAX_SCALE 4
+
+// Enough for the largest DG_ScreenMode, which is never used with hires.
+#define DOOMGENERIC_SCREEN_BUF_SIZE                               \
+    (hires ? SCREENWIDTH * SCREENHEIGHT * 3                       \
+           : ORIGWIDTH * SCREENHEIGHT_4_3 * DOOMGENERIC_MAX_SCALE \
+                 * DOOMGENERIC_MAX_SCALE * 3)
 
 // R8G8B8; 3 bytes per pixel.
+// May point to a different buffer each frame; only to be used by the frontend
+// while it's encoding one.
 extern byte *DG_ScreenBuffer;
 
+// If not NULL, the mode (see i_scale.h) used to scale the frame written to
+// DG_ScreenBuffer, which is then mode->width by mode->height pixels. Like
+// DG_ScreenBuffer, may be changed for each frame.
+extern screen_mode_t *DG_ScreenMode;
+
+// If true, send paletted frames over the socket rather than R8G8B8 ones.
+extern int indexed_frames;
+
 void doomgeneric_Create(int argc, char **argv);
 void doomgeneric_Tick(void);
 
@@ -29,6 +46,9 @@ typedef struct {
     // If type == IN_MOUSEBUTTONS: bitfield of mouse buttons.
     // See the comment in d_event.h within event_t for more info.
     byte value;
+
+    // DG_GetTicksUs() when the input was received.
+    uint64_t time_us;
 } input_t;
 
 // TODO: finale
@@ -81,13 +101,49 @@ typedef struct {
     int par;
 } duiwistats_t;
 
+// Frame or tic times over a level, in microseconds.
+typedef struct {
+    unsigned count;
+    unsigned p50;
+    unsigned p95;
+    unsigned p99;
+    unsigned max;
+} duitimes_t;
+
+// How far behind the frontend is with sending to the client.
+typedef struct {
+    unsigned queued_bytes;  // Queued to be sent, here or by the socket.
+    unsigned frame_credits; // Frames the client will take without asking.
+    boolean encoding;       // Whether the last frame is still being sent.
+} duitransport_t;
+
 void DG_Init(void);
+// Called once everything has loaded, just before the game loop starts. Returns
+// whether it waited for the client to connect (see -standby).
+boolean DG_AwaitClient(void);
 void DG_WipeTick(void);
+// Called before D_Display draws the next frame.
+void DG_StartDisplay(void);
 void DG_OnGameMessage(const char *prefix, const char *msg);
 void DG_OnMenuMessage(const char *msg);
 void DG_OnSetAutomapTitle(const char *title);
 void DG_OnSetFinaleText(finalestage_t stage, const char *text);
+// palette is 256 gamma-corrected R8G8B8 colours; index is that of the PLAYPAL
+// palette it is (see I_SetPlaypal), or -1 if it's not one.
+void DG_OnSetPalette(const byte *palette, int index);
+// Called as the intermission starts with how long the level's frames and tics
+// took.
+void DG_OnLevelTimes(const char *map, const duitimes_t *frames,
+                     const duitimes_t *tics);
+// For reports of slow frames; may be called from I_Error on any thread.
+void DG_GetTransport(duitransport_t *transport);
+// Called with the frame drawn to I_VideoBuffer. The frontend expands it to
+// DG_ScreenBuffer with I_ExpandFrame if needed, possibly on another thread from
+// a copy, so I_VideoBuffer is free to be drawn to again once this returns.
 void DG_DrawFrame(void);
+// Called instead of DG_DrawFrame when I_VideoBuffer is unchanged from the last
+// frame drawn; only what changed of the detached UI need be sent.
+void DG_RepeatFrame(void);
 void DG_DrawDetachedUI(duitype_t ui);
 // "vars" may be in temporary storage!
 void DG_DrawMenu(duimenutype_t type, const menu_t *menu, short selected_i,
@@ -95,9 +151,24 @@ void DG_DrawMenu(duimenutype_t type, const menu_t *menu, short selected_i,
 // "stats" may be in temporary storage!
 void DG_DrawIntermission(stateenum_t state, const duiwistats_t *stats);
 void DG_DrawFinaleText(int count);
-void DG_SleepMs(uint32_t ms);
+// Returns true if the client plays sound, so mixed sound effects should be
+// passed to DG_OnSoundSamples.
+boolean DG_WantsSound(void);
+// samples is frames pairs of left and right signed 16-bit little-endian
+// samples at rate Hz, continuing from the last call.
+void DG_OnSoundSamples(const byte *samples, unsigned frames, unsigned rate);
+// Sleep until DG_GetTicksUs() reaches end_us. May return early if there's
+// input to handle.
+void DG_SleepUntilUs(uint64_t end_us);
+// Also return early from DG_SleepUntilUs once fd is readable, so that packets
+// from the netgame socket are handled as soon as they arrive.
+void DG_SetWakeFd(int fd);
 uint32_t DG_GetTicksMs(void);
+uint64_t DG_GetTicksUs(void);
 boolean DG_GetInput(input_t *input);
+// Returns true if the mouse moved since the last call, setting dx and dy to how
+// far in mouse counts (dy positive downwards).
+boolean DG_GetMouseMotion(int *dx, int *dy);
 void DG_SetWindowTitle(const char *title);
 
 #endif // DOOM_GENERIC
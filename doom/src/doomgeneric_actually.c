@@ -2,11 +2,18 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
@@ -18,24 +25,86 @@
 #include <sys/ucred.h>
 #endif
 
+#include "d_bench.h"
 #include "d_items.h"
+#include "d_loop.h"
 #include "d_player.h"
 #include "doomgeneric.h"
+#include "doomgeneric_capture.h"
+#include "doomgeneric_cells.h"
+#include "doomgeneric_quality.h"
+#include "doomgeneric_sixel.h"
+#include "doomgeneric_deflate.h"
 #include "doomstat.h"
+#include "i_cpu.h"
+#include "i_scale.h"
+#include "i_sound.h"
 #include "i_system.h"
 #include "i_video.h"
 #include "m_argv.h"
 #include "m_config.h"
+#include "m_counts.h"
+#include "m_misc.h"
+#include "m_profile.h"
+#include "p_local.h"
+#include "r_main.h"
+#include "w_wad.h"
+#include "z_zone.h"
 
 #define LOG_PRE "[actually-doom] "
 
-#define NS_PER_MS (1000 * 1000)
+#define NS_PER_US 1000
+#define US_PER_MS 1000
 #define MS_PER_SEC 1000
 
 // Sentinel value from CMSG_PRESS_KEY indicating that the key is actually a
 // bitfield of currently pressed mouse buttons.
 #define PK_MOUSEBUTTONS 0xff
 
+// Type sent in AMSG_MENU when no menu is open.
+#define MENU_CLOSED 0xff
+
+// Bumped whenever a change to the messages below would break an older client.
+#define PROTOCOL_VERSION 8
+
+// Optional features, advertised as a bitfield by each side: by the engine in
+// AMSG_INIT as what it can do, and by the client in CMSG_HELLO as what it can
+// handle. Only mutually supported features are used.
+enum {
+    // AMSG_FRAME_DELTA and AMSG_FRAME_INDEXED_DELTA.
+    CAP_FRAME_DELTA = 1 << 0,
+    // AMSG_FRAME_INDEXED(_DELTA) and AMSG_PALETTE; preferred over AMSG_FRAME
+    // as they're a third of the size.
+    CAP_FRAME_INDEXED = 1 << 1,
+    // AMSG_FRAME_CELLS via CMSG_SET_CELL_GRID.
+    CAP_FRAME_CELLS = 1 << 2,
+    // Frame slot ring via CMSG_SET_FRAME_SHM_NAME.
+    CAP_FRAME_SHM = 1 << 3,
+    // CMSG_GRANT_FRAMES.
+    CAP_GRANT_FRAMES = 1 << 4,
+    // AMSG_STATS.
+    CAP_STATS = 1 << 5,
+    // Frame slots holding just the changed region; see AMSG_FRAME_SHM_READY.
+    CAP_FRAME_SHM_REGIONS = 1 << 6,
+    // AMSG_FRAME_ZLIB; preferred over other socket frames, as it's usually far
+    // smaller.
+    CAP_FRAME_ZLIB = 1 << 7,
+    // CMSG_SET_FRAME_SCALE and AMSG_FRAME_SIZE.
+    CAP_FRAME_SCALE = 1 << 8,
+    // AMSG_SOUND.
+    CAP_SOUND = 1 << 9,
+    // AMSG_FRAME_SIXEL via CMSG_SET_SIXEL_SCALE.
+    CAP_FRAME_SIXEL = 1 << 10,
+    // AMSG_CACHE_PALETTE and AMSG_USE_PALETTE in place of AMSG_PALETTE.
+    CAP_PALETTE_CACHE = 1 << 11,
+    // CMSG_SET_CELL_ORIGIN.
+    CAP_CELL_ORIGIN = 1 << 12,
+    // AMSG_CACHE_FRAME and AMSG_USE_FRAME.
+    CAP_FRAME_CACHE = 1 << 13,
+    // AMSG_FRAME_SIXEL_REGION.
+    CAP_SIXEL_REGIONS = 1 << 14,
+};
+
 // Message types are 8-bit values.
 // Strings are 16-bit lengths followed by 8-bit data (not NUL-terminated).
 //
@@ -47,7 +116,117 @@ enum {
     //   detached_ui_bits: u8 (see duitype_t for meaning)
     AMSG_FRAME = 0,
 
-    // AMSG_FRAME_SHM_READY (no payload)
+    // AMSG_FRAME_DELTA,
+    //   span_count: u16,
+    //   spans: {y: u16, x: u16, len: u16, pixels: u24[len] (R8G8B8)}[],
+    //   detached_ui_bits: u8 (see duitype_t for meaning)
+    //   Pixels outside of the spans are unchanged from the previous frame.
+    //   Only sent if the client has CAP_FRAME_DELTA.
+    AMSG_FRAME_DELTA = 12,
+
+    // AMSG_FRAME_INDEXED,
+    //   pixels: u8[res_x * res_y] (indices into the AMSG_PALETTE palette),
+    //   detached_ui_bits: u8 (see duitype_t for meaning)
+    //   Sent instead of AMSG_FRAME if the client has CAP_FRAME_INDEXED or the
+    //   indexed_frames config var is set.
+    AMSG_FRAME_INDEXED = 14,
+
+    // AMSG_FRAME_INDEXED_DELTA,
+    //   Like AMSG_FRAME_DELTA, but pixels are u8[len] palette indices.
+    //   Sent instead of AMSG_FRAME_DELTA when AMSG_FRAME_INDEXED would be.
+    AMSG_FRAME_INDEXED_DELTA = 15,
+
+    // AMSG_PALETTE, colours: u24[256] (R8G8B8)
+    //   Only sent if frames are indexed; precedes the first AMSG_FRAME_INDEXED,
+    //   then is sent again only when the palette changes.
+    AMSG_PALETTE = 13,
+
+    // AMSG_CACHE_PALETTE, index: u8, colours: u24[256] (R8G8B8)
+    //   Like AMSG_PALETTE, but the client also keeps the palette as index,
+    //   replacing any it kept as that before. Sent instead of AMSG_PALETTE for
+    //   PLAYPAL's palettes if the client has CAP_PALETTE_CACHE.
+    AMSG_CACHE_PALETTE = 24,
+
+    // AMSG_USE_PALETTE, index: u8
+    //   Like AMSG_PALETTE, but switches to the palette kept as index by an
+    //   earlier AMSG_CACHE_PALETTE. Sent instead of that once the client has
+    //   the palette, so flashes of the screen cost just this message.
+    AMSG_USE_PALETTE = 25,
+
+    // AMSG_FRAME_ZLIB,
+    //   x: u16, y: u16, width: u16, height: u16,
+    //   data_len: u32,
+    //   data: u8[data_len],
+    //   detached_ui_bits: u8 (see duitype_t for meaning)
+    //   Sent instead of other pixel frames if the client has CAP_FRAME_ZLIB.
+    //   data is a zlib (RFC 1950) stream of the width * height R8G8B8 pixels
+    //   within the rectangle, which bounds those that changed since the last
+    //   frame (empty, with no data, if none did), like AMSG_FRAME_SHM_READY
+    //   with CAP_FRAME_SHM_REGIONS. Suits the kitty graphics protocol's o=z.
+    AMSG_FRAME_ZLIB = 18,
+
+    // AMSG_FRAME_SIZE, width: u16, height: u16
+    //   Sent in reply to CMSG_SET_FRAME_SCALE. Frames sent via shared memory or
+    //   as AMSG_FRAME_ZLIB after this are this size (rather than res_x by
+    //   res_y), as are their rectangles.
+    AMSG_FRAME_SIZE = 19,
+
+    // AMSG_FRAME_CELLS,
+    //   cells_len: u32,
+    //   cells: u8[cells_len],
+    //   detached_ui_bits: u8 (see duitype_t for meaning)
+    //   Sent instead of other socket frames if CMSG_SET_CELL_GRID set a grid.
+    //   cells is ready to be written to the terminal; it draws the cells that
+    //   changed since the last AMSG_FRAME_CELLS, or clears the terminal and
+    //   draws every cell if CMSG_SET_CELL_GRID was sent since then (without
+    //   clearing, if CMSG_SET_CELL_ORIGIN placed the grid within the terminal).
+    AMSG_FRAME_CELLS = 16,
+
+    // AMSG_FRAME_SIXEL,
+    //   data_len: u32,
+    //   data: u8[data_len],
+    //   detached_ui_bits: u8 (see duitype_t for meaning)
+    //   Sent instead of other socket frames if CMSG_SET_SIXEL_SCALE set a
+    //   scale. data is a sixel image of the whole frame, scaled up by that
+    //   scale, ready to be written to the terminal; it's empty if the frame
+    //   is unchanged from the last.
+    AMSG_FRAME_SIXEL = 23,
+
+    // AMSG_FRAME_SIXEL_REGION,
+    //   Like AMSG_FRAME_SIXEL, but the image only sets the pixels within the
+    //   rectangle bounding those that changed since the last frame, leaving
+    //   the rest transparent, so it must be drawn over the last frame. Sent
+    //   instead of that if the client has CAP_SIXEL_REGIONS, except for an
+    //   AMSG_FRAME_SIXEL of the whole frame at least every
+    //   FRAME_KEYFRAME_INTERVAL images, or after CMSG_WANT_KEYFRAME. Never
+    //   kept by AMSG_CACHE_FRAME.
+    AMSG_FRAME_SIXEL_REGION = 28,
+
+    // AMSG_CACHE_FRAME, slot: u8
+    //   The client also keeps the image of the AMSG_FRAME_SIXEL that follows
+    //   as slot (0 to FRAME_CACHE_SLOTS - 1), replacing any it kept as that
+    //   before. Only sent if the client has CAP_FRAME_CACHE.
+    AMSG_CACHE_FRAME = 26,
+
+    // AMSG_USE_FRAME,
+    //   slot: u8,
+    //   detached_ui_bits: u8 (see duitype_t for meaning)
+    //   Like an AMSG_FRAME_SIXEL of the image kept as slot by an earlier
+    //   AMSG_CACHE_FRAME. Sent instead of that once the client has the frame,
+    //   so screens alternating between a few (like the blinking menu cursor)
+    //   cost just this message.
+    AMSG_USE_FRAME = 27,
+
+    // AMSG_FRAME_SHM_READY,
+    //   slot: u8, x: u16, y: u16, width: u16, height: u16
+    //   slot is the index of the frame ring slot holding the frame; its shared
+    //   memory object is named "<name>.<slot>" (see CMSG_SET_FRAME_SHM_NAME).
+    //   if the client has CAP_FRAME_SHM_REGIONS: the rectangle bounds the
+    //     pixels that changed since the last frame (empty if none did), and
+    //     the slot holds just those within it, packed from the start
+    //     (width * height R8G8B8 pixels). Unless it covers the whole frame,
+    //     this relies on the client having the last frame.
+    //   else: the rectangle covers the whole frame, which the slot holds.
     AMSG_FRAME_SHM_READY = 3,
 
     // AMSG_PLAYER_STATUS,
@@ -72,7 +251,14 @@ enum {
     // AMSG_FINALE_TEXT text: string
     AMSG_FINALE_TEXT = 10,
 
-    // AMSG_FRAME_MENU, type: u8, item_lumps: string[], selected_i: u8
+    // AMSG_MENU_ITEMS, type: u8, item_lumps: string[]
+    //   The lump names of a menu type's items, sent before the first AMSG_MENU
+    //   of that type; later ones refer to them by type alone.
+    AMSG_MENU_ITEMS = 22,
+
+    // AMSG_MENU, type: u8 (MENU_CLOSED if no menu is open)
+    //   if type != MENU_CLOSED:
+    //     selected_i: u8
     //   if type == DMENU_OPTIONS:
     //      toggle_bits: u8 (bit 0: low_detail, 1: messages_on)
     //      mouse_sensitivity: i8,
@@ -83,33 +269,128 @@ enum {
     //   else if type == DMENU_LOAD_GAME or DMENU_SAVE_GAME:
     //      save_slots: string[],
     //      save_slot_edit_i: i8,
-    AMSG_FRAME_MENU = 8,
-
-    // AMSG_FRAME_INTERMISSION, state: i8 (see stateenum_t)
-    //   if state == StatCount:
-    //      kills_percent: i32,
-    //      items_percent: i32,
-    //      secret_percent: i32,
-    //      time_total_secs: i32,
-    //      par_total_secs: i32,
-    AMSG_FRAME_INTERMISSION = 9,
-
-    // AMSG_FRAME_FINALE, text_len: u16
-    AMSG_FRAME_FINALE = 11,
+    //   Like AMSG_INTERMISSION and AMSG_FINALE, sent before a frame only if it
+    //   differs from what was last sent; it applies until the next one.
+    AMSG_MENU = 8,
+
+    // AMSG_INTERMISSION, shown: u8
+    //   if shown:
+    //     state: i8 (see stateenum_t)
+    //     if state == StatCount:
+    //        kills_percent: i32,
+    //        items_percent: i32,
+    //        secret_percent: i32,
+    //        time_total_secs: i32,
+    //        par_total_secs: i32,
+    AMSG_INTERMISSION = 9,
+
+    // AMSG_FINALE, text_len: u16 (0 if no finale text is shown)
+    AMSG_FINALE = 11,
+
+    // AMSG_LEVEL_TIMES,
+    //   map: string,
+    //   frames: u32, frame_p50_us: u32, frame_p95_us: u32, frame_p99_us: u32,
+    //   frame_max_us: u32,
+    //   tics: u32, tic_p50_us: u32, tic_p95_us: u32, tic_p99_us: u32,
+    //   tic_max_us: u32
+    //   Sent as the intermission starts with how many frames were drawn and
+    //   tics run in the level just finished, and percentiles of how long they
+    //   took. Frame times are from the end of one frame to that of the next.
+    //   Percentiles are rounded up to the next 100us, short of the max.
+    AMSG_LEVEL_TIMES = 20,
+
+    // AMSG_SOUND,
+    //   rate: u32,
+    //   frame_count: u16,
+    //   samples: i16[frame_count * 2] (left then right of each frame)
+    //   Sound effects mixed since the last AMSG_SOUND, at rate Hz. Sent about
+    //   once per frame drawn (silence included, so playback keeps time) if the
+    //   client has CAP_SOUND.
+    AMSG_SOUND = 21,
 
     // AMSG_SET_TITLE, title: string
     AMSG_SET_TITLE = 1,
 
     // AMSG_QUIT (no payload)
     AMSG_QUIT = 2,
+
+    // AMSG_STATS,
+    //   interval_ms: u32,
+    //   tics: u16,
+    //   frames: u16,
+    //   render_us: u32,
+    //   convert_us: u32,
+    //   send_us: u32,
+    //   bytes_sent: u32,
+    //   max_queued_bytes: u32,
+    //   max_visplanes: u16,
+    //   max_drawsegs: u16,
+    //   max_vissprites: u16,
+    //   max_openings: u32,
+    //   zone_purges: u32,
+    //   zone_kib: u32,
+    //   zone_static_kib: u32,
+    //   zone_static_blocks: u32,
+    //   zone_level_kib: u32,
+    //   zone_level_blocks: u32,
+    //   zone_cache_kib: u32,
+    //   zone_cache_blocks: u32,
+    //   zone_largest_free_kib: u32,
+    //   zone_mallocs: u32,
+    //   zone_rover_steps: u32,
+    //   parked_monsters: u32,
+    //   deferred_looks: u32,
+    //   peak_rss_kib: u32,
+    //   simd_features: u32,
+    //   work_count_len: u8,
+    //   work_counts: u32[work_count_len]
+    //   Sent about every STATS_INTERVAL_MS with totals for the interval, if the
+    //   client has CAP_STATS.
+    //   render_us is the time from the start of drawing a frame until it was
+    //   finished, convert_us is the time from then until it was queued for
+    //   sending (palette expansion, cell encoding, etc.), send_us is the time
+    //   spent sending. max_visplanes, etc. are the most of each of the
+    //   renderer's pools used by a frame in the interval. zone_purges is
+    //   how many cached blocks the zone allocator freed to make room, and
+    //   zone_kib is the size of the zone at the end of the interval.
+    //   zone_static_kib, etc. are what is in use at the end of the interval by
+    //   blocks that last the whole execution (PU_STATIC to PU_MUSIC), the
+    //   level (PU_LEVEL, PU_LEVSPEC) and purgable blocks. zone_mallocs is
+    //   how many allocations searched the zone in the interval and
+    //   zone_rover_steps how many blocks they stepped over between them.
+    //   parked_monsters is how many far away monsters are sleeping between
+    //   looks for players with -farlook at the end of the interval, and
+    //   deferred_looks how many times monsters were put to sleep so.
+    //   peak_rss_kib is the most resident memory the process has used.
+    //   simd_features are the CPU_* features (see i_cpu.h) used by the
+    //   variants of kernels installed at startup. work_counts are how much of
+    //   each kind of work the renderer and playsim did in the interval, in the
+    //   order of workcount_t (see m_counts.h); none if they aren't counted.
+    AMSG_STATS = 17,
 };
 
 // Incoming message types from the client. Same properties as above.
 enum {
+    // CMSG_HELLO, protocol_version: u16, caps: u16 (see CAP_*)
+    //   Should be sent first, after receiving "AMSG_INIT". Until then, no
+    //   optional features are used. If protocol_version differs from
+    //   PROTOCOL_VERSION, the engine quits.
+    CMSG_HELLO = 6,
+
     // CMSG_WANT_FRAME (no payload)
+    //   Send a frame when one is next drawn. Like CMSG_GRANT_FRAMES with a
+    //   count of 1, but only if no frame credits are left.
     CMSG_WANT_FRAME = 0,
 
-    // CMSG_SET_FRAME_SHM_NAME, name: string
+    // CMSG_GRANT_FRAMES, count: u8
+    //   Grant credits for this many more frames to be sent as they're drawn,
+    //   without waiting for them to be requested (up to FRAME_MAX_CREDITS).
+    CMSG_GRANT_FRAMES = 5,
+
+    // CMSG_SET_FRAME_SHM_NAME, name: string, slot_count: u8
+    //   if name is empty: frames are sent over the socket instead.
+    //   else: slot_count shared memory objects (1 to FRAME_SHM_MAX_SLOTS) are
+    //         created as a ring for frames to be written into.
     CMSG_SET_FRAME_SHM_NAME = 2,
 
     // CMSG_PRESS_KEY, key: u8, pressed: u8
@@ -121,41 +402,319 @@ enum {
 
     // CMSG_SET_CONFIG_VAR, name: string, value: string
     CMSG_SET_CONFIG_VAR = 3,
+
+    // CMSG_WANT_KEYFRAME (no payload)
+    //   Send the next frame in full, rather than just what changed; for when
+    //   the client lost track of the last.
+    CMSG_WANT_KEYFRAME = 7,
+
+    // CMSG_SET_CELL_GRID,
+    //   width: u16, height: u16, true_colour: u8, half_blocks: u8
+    //   if width or height is 0: frames not sent via shared memory are sent as
+    //                            pixels (the default).
+    //   else: they're sent as AMSG_FRAME_CELLS for a terminal of this size,
+    //         using 24-bit RGB colours if true_colour, else xterm-256 colours.
+    //         If half_blocks, each cell shows two pixels (stacked vertically)
+    //         using U+2580 UPPER HALF BLOCK.
+    CMSG_SET_CELL_GRID = 4,
+
+    // CMSG_SET_FRAME_SCALE, scale: u8, aspect_correct: u8
+    //   Scale frames sent via shared memory or as AMSG_FRAME_ZLIB up by scale
+    //   (1 to DOOMGENERIC_MAX_SCALE) using the i_scale.c modes, so the terminal
+    //   needn't. If aspect_correct, they're also stretched vertically to the
+    //   4:3 aspect ratio DOOM was meant to be displayed at (multiples of
+    //   320x240). Replied to with AMSG_FRAME_SIZE. Frames stay unscaled when
+    //   already rendered at a higher resolution via -hires.
+    CMSG_SET_FRAME_SCALE = 8,
+
+    // CMSG_MOUSE_MOTION, dx: i16, dy: i16
+    //   Relative motion of the mouse in mouse counts (roughly pixels), with dy
+    //   positive downwards. Motion is accumulated until the next tic, which
+    //   gets it all as one event; the client may likewise accumulate motion
+    //   and send it about once a tic.
+    CMSG_MOUSE_MOTION = 9,
+
+    // CMSG_SET_CONFIG_VARS, count: u16, (name: string, value: string)[count]
+    //   Like count CMSG_SET_CONFIG_VARs, applied in order.
+    CMSG_SET_CONFIG_VARS = 10,
+
+    // CMSG_SET_SIXEL_SCALE, scale: u8
+    //   if scale is 0: stop sending AMSG_FRAME_SIXEL (the default).
+    //   else: send frames not sent via shared memory as AMSG_FRAME_SIXEL,
+    //         scaled up by scale (1 to DOOMGENERIC_MAX_SCALE). Takes
+    //         precedence over CMSG_SET_CELL_GRID.
+    CMSG_SET_SIXEL_SCALE = 11,
+
+    // CMSG_SET_CELL_ORIGIN, row: u16, col: u16
+    //   if row or col is 0: AMSG_FRAME_CELLS' grid fills the terminal (the
+    //                       default).
+    //   else: the grid's top-left cell is at this 1-indexed row and column of
+    //         a terminal it only covers part of, such as the client's own
+    //         screen; cells are positioned accordingly, and frames drawing
+    //         every cell don't clear the terminal first. The next frame draws
+    //         every cell. Also affects viewers.
+    CMSG_SET_CELL_ORIGIN = 12,
 };
 
+// Features the client said it handles in CMSG_HELLO.
+static uint16_t client_caps;
+
+// The -listen argument; listen_sock_path is the socket file to delete, unless
+// listening on TCP.
+static const char *listen_addr;
 static const char *listen_sock_path;
+static boolean listen_tcp;
 static int listen_sock_fd = -1;
 static int comm_sock_fd = -1;
-static char frame_shm_name[NAME_MAX];
-static int frame_shm_fd = -1;
+// With -standby, whether the client is yet to be accepted by DG_AwaitClient.
+static boolean standby;
+// Set by DG_SetWakeFd.
+static int wake_fd = -1;
+
+// With -viewers, the listener socket stays open after the client connects, and
+// later connections are viewers: they're sent a copy of everything sent to the
+// client from AMSG_INIT on, starting from freshly sent frames and status, but
+// nothing they send is acted upon. Frames the client has sent through shared
+// memory can't be shown by them.
+#define MAX_VIEWERS 8
+#define VIEWER_SNDBUF_SIZE (1 << 20)
+static int viewer_fds[MAX_VIEWERS];
+static int viewer_count;
+
+#ifdef MSG_NOSIGNAL
+#define COMM_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define COMM_SEND_FLAGS 0 // SO_NOSIGPIPE is set instead.
+#endif
+#define VIEWER_SEND_FLAGS (MSG_DONTWAIT | COMM_SEND_FLAGS)
 
-// Enough for a whole frame and (a decent amount) of leeway.
-#define COMM_SEND_BUF_CAP (2 * DOOMGENERIC_SCREEN_BUF_SIZE)
+// Frame slots are created and mapped once, then re-used for later frames unless
+// the reader unlinked the object after consuming it (like kitty does), in which
+// case a fresh object is created in its place.
+#define FRAME_SHM_MAX_SLOTS 8
+// Room for the ".<slot>" suffix of slot object names.
+#define FRAME_SHM_SLOT_SUFFIX_LEN 2
 
+typedef struct {
+    int fd;
+    byte *p;
+    size_t size;
+} frameslot_t;
+
+static char frame_shm_name[NAME_MAX - FRAME_SHM_SLOT_SUFFIX_LEN];
+static frameslot_t frame_shm_slots[FRAME_SHM_MAX_SLOTS];
+static unsigned frame_shm_slot_count;
+static unsigned frame_shm_slot_i;
+
+// Frame buffer used when sending AMSG_FRAMEs; DG_ScreenBuffer otherwise points
+// directly into the mapping of the frame slot being written to.
+static byte *socket_frame_buf;
+
+// Scale mode set by CMSG_SET_FRAME_SCALE; NULL if frames aren't scaled.
+static screen_mode_t *frame_scale_mode;
+static int frame_scale = 1;
+static boolean frame_scale_aspect_correct;
+
+// Send a full AMSG_FRAME instead of an AMSG_FRAME_DELTA at least this often.
+#define FRAME_KEYFRAME_INTERVAL 150
+
+// Copy of the paletted I_VideoBuffer last sent, which deltas (and changed frame
+// slot regions) are encoded against.
+static byte *prev_frame;
+static boolean prev_frame_valid;
+static boolean prev_frame_indexed;
+static unsigned frames_since_keyframe;
+
+// Compressed pixels of the changed region of AMSG_FRAME_ZLIBs; only allocated
+// once the first is sent, as clients without CAP_FRAME_ZLIB never need it.
+static byte *zlib_buf;
+
+int indexed_frames;
+static byte palette[256 * 3];
+// PLAYPAL palette it is, or -1; see DG_OnSetPalette.
+static int palette_index = -1;
+// The palette of the last frame encoded, and whether it was sent as an
+// AMSG_PALETTE.
+static byte encoded_palette[256 * 3];
+static boolean palette_sent;
+// Palettes sent as AMSG_CACHE_PALETTE, which the client keeps; a bit for each
+// index set.
+static byte cached_palettes[MAXPLAYPALS][256 * 3];
+static unsigned cached_palettes_bits;
+
+// Frames sent as AMSG_CACHE_FRAME, which the client keeps, by a hash of their
+// pixels and palette; the least recently used is replaced. shown_frame_hash is
+// that of the frame the client last showed, if shown_frame_valid.
+#define FRAME_CACHE_SLOTS 8
 static struct {
-    char data[COMM_SEND_BUF_CAP];
+    uint64_t hash;
+    unsigned last_used;
+    boolean valid;
+} cached_frames[FRAME_CACHE_SLOTS];
+static unsigned cached_frames_clock;
+static uint64_t shown_frame_hash;
+static boolean shown_frame_valid;
+
+// Detached UI overlays are sent only when they change, so one left open costs
+// nothing. What the drawers report for the frame being drawn is compared
+// against what was last sent as the frame is; anything not drawn is closed.
+// As many as m_menu has savegamestrings.
+#define MAX_SAVE_SLOTS 10
+
+typedef struct {
+    boolean menu_open;
+    duimenutype_t menu_type;
+    short menu_selected_i;
+    duimenuvars_t menu_vars; // save_slots is NULL; see menu_save_slots.
+    char menu_save_slots[MAX_SAVE_SLOTS][SAVESTRINGSIZE];
+
+    boolean intermission_shown;
+    stateenum_t intermission_state;
+    boolean intermission_has_stats;
+    duiwistats_t intermission_stats;
+
+    int finale_text_len;
+} overlays_t;
+
+static overlays_t drawn_overlays;
+static overlays_t sent_overlays;
+static boolean sent_overlays_valid;
+// Bit per duimenutype_t whose AMSG_MENU_ITEMS was sent.
+static unsigned menu_items_sent_bits;
+
+// Number of frames that may be sent without the client asking for more.
+#define FRAME_MAX_CREDITS 16
+static unsigned frame_credits;
+
+// Enough for a whole indexed frame and (a decent amount) of leeway. Large
+// payloads from buffers that are stable until the next flush (like RGB frames)
+// are referenced rather than copied, so don't count towards this.
+#define COMM_SEND_BUF_CAP ((size_t)2 * SCREENWIDTH * SCREENHEIGHT)
+// Smallest payload worth referencing rather than copying.
+#define COMM_SEND_REF_MIN_LEN 256
+// Max segments sent per syscall; within the limits of any sane platform.
+#define COMM_SEND_IOV_CAP 64
+
+typedef struct {
+    char *data; // COMM_SEND_BUF_CAP bytes.
     size_t len;
-} comm_send_buf;
+
+    // Segments to send in order; either ranges of data or referenced buffers.
+    // data from seg_start onwards isn't covered by a segment yet.
+    struct iovec iov[COMM_SEND_IOV_CAP];
+    int iov_len;
+    size_t seg_start;
+} sendbuf_t;
+
+static sendbuf_t comm_send_buf;
+
+// What the encoder thread is sending, swapped out of comm_send_buf so that
+// messages can be queued behind it meanwhile; see Comm_SendFrame.
+static sendbuf_t comm_frame_buf;
+
+#define STATS_INTERVAL_MS 1000
+
+static struct {
+    uint64_t start_us;
+    int start_gametic;
+    unsigned frames;
+    uint32_t render_us;
+    uint32_t convert_us;
+    uint32_t send_us;
+    uint32_t bytes_sent;
+    uint32_t max_queued_bytes;
+    zonestats_t start_zone;
+    unsigned start_deferred_looks;
+    unsigned start_work_counts[NUMWORKCOUNTS];
+} stats;
+
+// When work on the current frame started, for stats.
+static uint64_t frame_start_us;
+
+// How long the last encoded frame took to draw, and then to encode, for the
+// quality controller. Written by whichever thread encodes frames.
+static unsigned encoded_render_us, encoded_convert_us;
 
 static volatile sig_atomic_t interrupted;
-static uint32_t clock_start_ms;
+static uint64_t clock_start_us;
 static byte enabled_dui_types;
 static boolean comm_writing_msg;
 
-#define COMM_WRITE_MSG(block)      \
-    do {                           \
-        assert(!comm_writing_msg); \
-        comm_writing_msg = true;   \
-        block;                     \
-        comm_writing_msg = false;  \
+// Whether the client still has the last frame drawn as it was, so that
+// DG_RepeatFrame needn't send it again; anything but input from the client may
+// change how frames are sent, so clears it. repeat_dui_types is the frame's
+// enabled_dui_types.
+static boolean frame_repeatable;
+static byte repeat_dui_types;
+
+// Guards comm_send_buf and what sending it touches (the viewers and stats)
+// against the encoder thread, which sends frames itself. Recursive, so that
+// quitting while holding it can still send AMSG_QUIT.
+static pthread_mutex_t comm_mutex;
+
+// Serializes sends to the client. Taken after comm_mutex, if both are held.
+static pthread_mutex_t comm_sock_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// errno of a send that failed, or 0. Failures are only acted upon by the main
+// thread (see Comm_CheckSendError), as only it may quit; until then, anything
+// more to send is dropped.
+static int comm_send_errno;
+
+#define COMM_LOCKED(block)                 \
+    do {                                   \
+        pthread_mutex_lock(&comm_mutex);   \
+        block;                             \
+        pthread_mutex_unlock(&comm_mutex); \
     } while (0)
 
-// Only used for received comms and buffered key state changes, so size doesn't
-// need to be high. Keep this a power of 2 to make wrapping fast (compiler can
-// optimize modulos into bit-ANDs).
+#define COMM_WRITE_MSG(block)          \
+    COMM_LOCKED({                      \
+        assert(!comm_writing_msg);     \
+        comm_writing_msg = true;       \
+        block;                         \
+        comm_writing_msg = false;      \
+    })
+
+// A frame drawn by the game, to be encoded and sent.
+typedef struct {
+    const byte *pixels;  // SCREENWIDTH * SCREENHEIGHT palette indices.
+    const byte *palette; // 256 R8G8B8 colours.
+    int palette_index;   // PLAYPAL palette it is, or -1.
+    byte dui_types;      // enabled_dui_types as it was drawn.
+    uint64_t start_us;   // When work on it started and finished, for stats.
+    uint64_t finished_us;
+} frame_t;
+
+// Unless disabled, frames are encoded and sent by a thread of their own while
+// the main thread runs the next tics and draws the next frame. It's handed a
+// copy of one frame at a time, alternating between two copies so the next can
+// be made while the last is encoded. The main thread waits for it to finish
+// the last before handing over the next, and before changing anything it uses
+// (see WaitForEncoder).
+static boolean encoder_running;
+static pthread_t encoder_thread;
+
+// Guards encoder_frame and encoder_stopping. The encoder waits on encoder_cond
+// for a frame, and signals encoder_idle_cond when it's done with it.
+static pthread_mutex_t encoder_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t encoder_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t encoder_idle_cond = PTHREAD_COND_INITIALIZER;
+static frame_t *encoder_frame; // NULL if idle.
+static boolean encoder_stopping;
+
+static frame_t encoder_frames[2];
+static byte *encoder_pixels[2];
+static byte encoder_palettes[2][256 * 3];
+static unsigned encoder_frame_i;
+
+// How long to wait at exit for the encoder to finish a frame before assuming
+// it's stuck sending to a client that stopped reading.
+#define ENCODER_STOP_TIMEOUT_MS 100
+
+// Only used for received comms, so size doesn't need to be high. Keep this a
+// power of 2 to make wrapping fast (compiler can optimize modulos into
+// bit-ANDs).
 #define RINGBUF_SIZE 512
-// Max length one less than size, as start_i == end_i means empty, not full.
-#define RINGBUF_CAP (RINGBUF_SIZE - 1)
 
 typedef struct {
     char data[RINGBUF_SIZE];
@@ -164,7 +723,23 @@ typedef struct {
 } ringbuf_t;
 
 static ringbuf_t comm_recv_buf;
-static ringbuf_t key_buf;
+
+// Keys pressed or released (or mouse button changes), and when they were
+// received, waiting for DG_GetInput.
+#define KEY_QUEUE_SIZE 256
+static struct {
+    struct {
+        uint8_t key;
+        uint8_t pressed;
+        uint64_t time_us;
+    } keys[KEY_QUEUE_SIZE];
+    size_t start_i;
+    size_t end_i;
+} key_queue;
+
+// Mouse motion received since the last DG_GetMouseMotion.
+static int32_t mouse_motion_x;
+static int32_t mouse_motion_y;
 
 typedef struct {
     int health;
@@ -181,6 +756,8 @@ static void SigintHandler(int signum)
     (void)signum;
     // Generally try to handle SIGINTs with a graceful shutdown, but it may be
     // possible that DOOM code triggers syscalls without handling EINTR nicely..
+    // Also used for SIGTERM, so persistent frame slots are deleted when the
+    // client kills us.
     interrupted = true;
 }
 
@@ -215,9 +792,10 @@ static boolean Ring_Read16(ringbuf_t *r, uint16_t *v)
     if (Ring_GetLen(r) < 2)
         return false;
 
-    *v = r->data[r->start_i++];
+    // Cast, as char may be signed.
+    *v = (uint8_t)r->data[r->start_i++];
     r->start_i %= RINGBUF_SIZE;
-    *v |= r->data[r->start_i++] << 8;
+    *v |= (uint8_t)r->data[r->start_i++] << 8;
     r->start_i %= RINGBUF_SIZE;
     return true;
 }
@@ -248,54 +826,245 @@ static boolean Ring_ReadBytes(ringbuf_t *r, byte *p, size_t len)
     return true;
 }
 
-static boolean Ring_Write8(ringbuf_t *r, uint8_t v)
+// Cover the data written since the last segment with a new one.
+static void Comm_EndCopiedSegment(void)
 {
-    if (Ring_IsFull(r))
-        return false;
+    assert(comm_send_buf.iov_len < COMM_SEND_IOV_CAP);
+    if (comm_send_buf.seg_start == comm_send_buf.len)
+        return;
 
-    r->data[r->end_i++] = v;
-    r->end_i %= RINGBUF_SIZE;
-    return true;
+    comm_send_buf.iov[comm_send_buf.iov_len++] = (struct iovec){
+        .iov_base = comm_send_buf.data + comm_send_buf.seg_start,
+        .iov_len = comm_send_buf.len - comm_send_buf.seg_start,
+    };
+    comm_send_buf.seg_start = comm_send_buf.len;
+}
+
+static uint64_t GetClockUs(void);
+
+static void DropViewer(int i, const char *reason)
+{
+    fprintf(stderr, LOG_PRE "Viewer disconnected: %s\n", reason);
+    close(viewer_fds[i]);
+    viewer_fds[i] = viewer_fds[--viewer_count];
+}
+
+// Viewers are never waited on; one that can't take everything at once has
+// fallen too far behind to be caught up, so it's dropped.
+static void SendToViewers(const struct iovec *iov, int iov_len)
+{
+    size_t len = 0;
+    for (int i = 0; i < iov_len; ++i)
+        len += iov[i].iov_len;
+
+    struct msghdr msg = {.msg_iov = (struct iovec *)iov, .msg_iovlen = iov_len};
+    for (int i = 0; i < viewer_count;) {
+        ssize_t ret = sendmsg(viewer_fds[i], &msg, VIEWER_SEND_FLAGS);
+        if (ret == -1 && errno == EINTR)
+            continue;
+
+        if (ret == -1) {
+            DropViewer(i, strerror(errno));
+        } else if ((size_t)ret < len) {
+            DropViewer(i, "it fell behind");
+        } else {
+            ++i;
+        }
+    }
+}
+
+// Sends iov to the client, returning the errno of a failed send, or 0.
+static int Comm_SendIov(struct iovec *iov, int iov_len, boolean closing)
+{
+    while (iov_len > 0) {
+        // Partial sends don't report EINTR, so check for it here too.
+        if (interrupted && !closing)
+            return EINTR;
+
+        // Send everything in one go with sendmsg, which unlike writev takes
+        // flags.
+        struct msghdr msg = {.msg_iov = iov, .msg_iovlen = iov_len};
+        // A closed connection is reported as EPIPE, not by SIGPIPE; likelier
+        // when the client is on another host.
+        ssize_t ret = sendmsg(comm_sock_fd, &msg,
+                              COMM_SEND_FLAGS | (closing ? MSG_DONTWAIT : 0));
+        if (ret == -1 && closing)
+            return 0; // Best-effort; don't block or spin when closing.
+        if (ret == -1 && errno != EINTR)
+            return errno;
+
+        // Skip past what was sent.
+        for (size_t sent = ret > 0 ? ret : 0; sent > 0;) {
+            if (sent < iov->iov_len) {
+                iov->iov_base = (char *)iov->iov_base + sent;
+                iov->iov_len -= sent;
+                break;
+            }
+            sent -= iov->iov_len;
+            ++iov;
+            --iov_len;
+        }
+    }
+
+    return 0;
+}
+
+static size_t GetIovLen(const struct iovec *iov, int iov_len)
+{
+    size_t len = 0;
+    for (int i = 0; i < iov_len; ++i)
+        len += iov[i].iov_len;
+
+    return len;
+}
+
+static void AddSendStats(uint64_t start_us, size_t queued_len)
+{
+    stats.send_us += GetClockUs() - start_us;
+    stats.bytes_sent += queued_len;
+    if (queued_len > stats.max_queued_bytes)
+        stats.max_queued_bytes = queued_len;
+}
+
+static void ResetSendBuf(sendbuf_t *b)
+{
+    b->len = 0;
+    b->iov_len = 0;
+    b->seg_start = 0;
+}
+
+// Within COMM_LOCKED, with comm_sock_mutex held too.
+static void Comm_FlushSendLocked(boolean closing)
+{
+    if (comm_sock_fd < 0) {
+        // Nobody to send it to, e.g. when benchmarking.
+        Comm_EndCopiedSegment();
+        D_BenchBytes(GetIovLen(comm_send_buf.iov, comm_send_buf.iov_len));
+        ResetSendBuf(&comm_send_buf);
+        return;
+    }
+
+    Comm_EndCopiedSegment();
+    struct iovec *iov = comm_send_buf.iov;
+    int iov_len = comm_send_buf.iov_len;
+    if (iov_len == 0)
+        return;
+    if (comm_send_errno != 0)
+        goto done; // About to quit anyway.
+
+    M_ProfileBegin(prof_flushsend);
+    uint64_t start_us = GetClockUs();
+    size_t queued_len = GetIovLen(iov, iov_len);
+
+    // Before sending to the client, which advances iov past what was sent.
+    if (viewer_count > 0)
+        SendToViewers(iov, iov_len);
+
+    comm_send_errno = Comm_SendIov(iov, iov_len, closing);
+
+    AddSendStats(start_us, queued_len);
+    M_ProfileEnd(prof_flushsend);
+
+done:
+    ResetSendBuf(&comm_send_buf);
 }
 
 static void Comm_FlushSend(boolean closing)
 {
-    if (comm_send_buf.len == 0 || comm_sock_fd < 0)
+    pthread_mutex_lock(&comm_sock_mutex);
+    Comm_FlushSendLocked(closing);
+    pthread_mutex_unlock(&comm_sock_mutex);
+}
+
+// Like Comm_FlushSend, but while the encoder thread is sending a frame, leaves
+// what's queued for it to send next rather than waiting for the frame to
+// drain.
+static void Comm_TryFlushSend(void)
+{
+    if (pthread_mutex_trylock(&comm_sock_mutex) != 0)
         return;
 
-    for (size_t sent = 0; sent < comm_send_buf.len;) {
-        size_t send_len = comm_send_buf.len - sent;
+    Comm_FlushSendLocked(false);
+    pthread_mutex_unlock(&comm_sock_mutex);
+}
 
-        ssize_t ret = send(comm_sock_fd, comm_send_buf.data + sent, send_len,
-                           closing ? MSG_DONTWAIT : 0);
-        if (ret == -1 && !closing) {
-            switch (errno) {
-            case EINTR:
-                if (interrupted)
-                    I_Quit();
-                break;
+// For the encoder thread, outside of COMM_LOCKED: sends what's queued, ending
+// with the frame it just wrote. comm_mutex is only held to take it out of
+// comm_send_buf, so while it drains to the client, other messages can still
+// be queued without waiting on it, and are sent straight after.
+static void Comm_SendFrame(void)
+{
+    pthread_mutex_lock(&comm_mutex);
+    Comm_EndCopiedSegment();
+    if (comm_sock_fd < 0 || comm_send_errno != 0
+        || comm_send_buf.iov_len == 0) {
+        Comm_FlushSend(false);
+        pthread_mutex_unlock(&comm_mutex);
+        return;
+    }
 
-            case ECONNRESET:
-            case EPIPE:
-                fprintf(stderr,
-                        LOG_PRE "Communications connection was closed; "
-                                "quitting: %s\n",
-                        strerror(errno));
-                I_Quit(); // noreturn
-                abort();
+    pthread_mutex_lock(&comm_sock_mutex);
+    sendbuf_t spare = comm_frame_buf;
+    comm_frame_buf = comm_send_buf;
+    comm_send_buf = spare;
+
+    M_ProfileBegin(prof_flushsend);
+    uint64_t start_us = GetClockUs();
+    struct iovec *iov = comm_frame_buf.iov;
+    int iov_len = comm_frame_buf.iov_len;
+    size_t queued_len = GetIovLen(iov, iov_len);
+    if (viewer_count > 0)
+        SendToViewers(iov, iov_len);
+    pthread_mutex_unlock(&comm_mutex);
+
+    int err = Comm_SendIov(iov, iov_len, false);
+    ResetSendBuf(&comm_frame_buf);
+    pthread_mutex_unlock(&comm_sock_mutex);
+
+    COMM_LOCKED({
+        if (comm_send_errno == 0)
+            comm_send_errno = err;
+        AddSendStats(start_us, queued_len);
+        M_ProfileEnd(prof_flushsend);
+
+        // What was queued behind the frame.
+        Comm_FlushSend(false);
+    });
+}
 
-            default:
-                I_Error(LOG_PRE "Failed to send %zu byte(s) to communications "
-                                "socket: %s",
-                        send_len, strerror(errno));
-            }
-        }
+// Quits if a send failed. Only for the main thread, outside of COMM_LOCKED.
+static void Comm_CheckSendError(void)
+{
+    int err;
+    COMM_LOCKED(err = comm_send_errno);
+
+    switch (err) {
+    case 0:
+        return;
+
+    case EINTR:
+        I_Quit();
+        break;
 
-        if (ret > 0)
-            sent += ret;
+    case ECONNRESET:
+    case EPIPE:
+        fprintf(stderr,
+                LOG_PRE "Communications connection was closed; quitting: %s\n",
+                strerror(err));
+        I_Quit();
+        break;
+
+    default:
+        I_Error(LOG_PRE "Failed to send to communications socket: %s",
+                strerror(err));
     }
+}
 
-    comm_send_buf.len = 0;
+// True if buffers referenced via Comm_WriteBytesRef are yet to be sent.
+static boolean Comm_HasSendRefs(void)
+{
+    // Segments only exist before a flush if a buffer was referenced.
+    return comm_send_buf.iov_len > 0;
 }
 
 static void Comm_Write8(uint8_t v)
@@ -350,6 +1119,28 @@ static void Comm_WriteBytes(const byte *p, size_t len)
     }
 }
 
+// Like Comm_WriteBytes, but may send straight from p instead of copying it, in
+// which case p must not change until the next Comm_FlushSend; flush first if
+// Comm_HasSendRefs returns true.
+static void Comm_WriteBytesRef(const byte *p, size_t len)
+{
+    assert(comm_writing_msg);
+    if (len < COMM_SEND_REF_MIN_LEN) {
+        Comm_WriteBytes(p, len);
+        return;
+    }
+
+    // Need room for the copied segment before this, this and any after it.
+    if (comm_send_buf.iov_len + 3 > COMM_SEND_IOV_CAP)
+        Comm_FlushSend(false);
+
+    Comm_EndCopiedSegment();
+    comm_send_buf.iov[comm_send_buf.iov_len++] = (struct iovec){
+        .iov_base = (void *)p,
+        .iov_len = len,
+    };
+}
+
 static void Comm_WriteString(const char *s)
 {
     assert(comm_writing_msg);
@@ -368,6 +1159,70 @@ static void Comm_WriteString(const char *s)
 }
 
 static void UnlinkFrameShm(void);
+static void WaitForEncoder(void);
+static void ClearFrameCache(void);
+
+static void WriteFrameSize(void)
+{
+    COMM_WRITE_MSG({
+        Comm_Write8(AMSG_FRAME_SIZE);
+        Comm_Write16(frame_scale_mode ? frame_scale_mode->width : SCREENWIDTH);
+        Comm_Write16(frame_scale_mode ? frame_scale_mode->height
+                                      : SCREENHEIGHT);
+    });
+}
+
+static void SetFrameScale(int scale, boolean aspect_correct)
+{
+    static screen_mode_t *const scale_modes[] = {
+        &mode_scale_1x,
+        &mode_scale_2x,
+        &mode_scale_3x,
+        &mode_scale_4x,
+    };
+    static screen_mode_t *const stretch_modes[] = {
+        &mode_stretch_1x,
+        &mode_stretch_2x,
+        &mode_stretch_3x,
+        &mode_stretch_4x,
+    };
+    assert(scale >= 1 && (size_t)scale <= arrlen(scale_modes));
+
+    // The modes only scale frames of the original resolution.
+    if (hires && (scale > 1 || aspect_correct)) {
+        fprintf(stderr, LOG_PRE "Warning: Frames can't be scaled further when "
+                                "using -hires; sending them unscaled\n");
+        scale = 1;
+        aspect_correct = false;
+    }
+
+    // Unscaled frames are written straight to DG_ScreenBuffer.
+    frame_scale_mode = aspect_correct ? stretch_modes[scale - 1]
+                       : scale > 1    ? scale_modes[scale - 1]
+                                      : NULL;
+    frame_scale = scale;
+    frame_scale_aspect_correct = aspect_correct;
+    if (frame_scale_mode && frame_scale_mode->InitMode) {
+        // Blends are looked up against the base palette; palette effects (like
+        // the red tint when hurt) are applied to the result.
+        frame_scale_mode->InitMode(W_CacheLumpName("PLAYPAL", PU_CACHE));
+    }
+
+    // The client has no frame of the new size to apply changes to.
+    prev_frame_valid = false;
+    WriteFrameSize();
+}
+
+static void SetConfigVar(char *name, char *value)
+{
+    printf("CMSG_SET_CONFIG_VAR: name=\"%s\", value=\"%s\"\n", name, value);
+    if (!M_SetVariable(name, value)) {
+        fprintf(stderr,
+                LOG_PRE "Warning: Failed to set config variable \"%s\"; "
+                        "maybe it isn't bound\n",
+                name);
+    }
+}
 
 static void Comm_HandleReceivedMsgs(void)
 {
@@ -383,6 +1238,7 @@ static void Comm_HandleReceivedMsgs(void)
             struct {
                 uint16_t len;
                 char name[arrlen(frame_shm_name)];
+                uint8_t slot_count;
             } set_frame_shm_name;
 
             struct {
@@ -390,11 +1246,43 @@ static void Comm_HandleReceivedMsgs(void)
                 uint8_t pressed;
             } press_key;
 
+            uint8_t grant_frames_count;
+
             struct {
+                uint16_t count; // Left to read, if CMSG_SET_CONFIG_VARS.
                 uint16_t len;
                 char name[64];
                 char value[128];
             } set_config_var;
+
+            struct {
+                uint16_t width;
+                uint16_t height;
+                uint8_t true_colour;
+                uint8_t half_blocks;
+            } set_cell_grid;
+
+            struct {
+                uint16_t protocol_version;
+                uint16_t caps;
+            } hello;
+
+            struct {
+                uint8_t scale;
+                uint8_t aspect_correct;
+            } set_frame_scale;
+
+            struct {
+                uint16_t dx;
+                uint16_t dy;
+            } mouse_motion;
+
+            uint8_t sixel_scale;
+
+            struct {
+                uint16_t row;
+                uint16_t col;
+            } set_cell_origin;
         } v;
     } state = {0};
 
@@ -408,9 +1296,29 @@ static void Comm_HandleReceivedMsgs(void)
         switch (state.msg_type) {
         case CMSG_WANT_FRAME:
             // No payload.
+            if (frame_credits == 0)
+                frame_credits = 1;
             screenvisible = true;
             break;
 
+        case CMSG_WANT_KEYFRAME:
+            // No payload.
+            WaitForEncoder();
+            prev_frame_valid = false;
+            Sixel_Invalidate();
+            shown_frame_valid = false;
+            break;
+
+        case CMSG_GRANT_FRAMES:
+            if (!Ring_Read8(&comm_recv_buf, &state.v.grant_frames_count))
+                return;
+
+            frame_credits += state.v.grant_frames_count;
+            if (frame_credits > FRAME_MAX_CREDITS)
+                frame_credits = FRAME_MAX_CREDITS;
+            screenvisible = frame_credits > 0;
+            break;
+
         case CMSG_SET_FRAME_SHM_NAME:
             switch (state.stage) {
             case 1:
@@ -438,13 +1346,38 @@ static void Comm_HandleReceivedMsgs(void)
                 // this buffer, but still nice to do.
                 state.v.set_frame_shm_name
                     .name[state.v.set_frame_shm_name.len] = '\0';
+                ++state.stage;
+                // fallthrough
+
+            case 3:
+                if (!Ring_Read8(&comm_recv_buf,
+                                &state.v.set_frame_shm_name.slot_count))
+                    return;
+
+                if (state.v.set_frame_shm_name.len > 0
+                    && (state.v.set_frame_shm_name.slot_count == 0
+                        || state.v.set_frame_shm_name.slot_count
+                               > FRAME_SHM_MAX_SLOTS)) {
+                    I_Error(LOG_PRE "Requested frame data shared memory slot "
+                                    "count out of range; max: %d, count: "
+                                    "%" PRIu8,
+                            FRAME_SHM_MAX_SLOTS,
+                            state.v.set_frame_shm_name.slot_count);
+                }
 
+                WaitForEncoder();
                 UnlinkFrameShm();
                 memcpy(frame_shm_name, state.v.set_frame_shm_name.name,
                        state.v.set_frame_shm_name.len);
                 frame_shm_name[state.v.set_frame_shm_name.len] = '\0';
-                printf(LOG_PRE "CMSG_SET_FRAME_SHM_NAME: name=\"%s\"\n",
-                       frame_shm_name);
+                frame_shm_slot_count =
+                    state.v.set_frame_shm_name.len > 0
+                        ? state.v.set_frame_shm_name.slot_count
+                        : 0;
+                frame_shm_slot_i = 0;
+                printf(LOG_PRE "CMSG_SET_FRAME_SHM_NAME: name=\"%s\", "
+                               "slot_count=%u\n",
+                       frame_shm_name, frame_shm_slot_count);
                 break;
 
             default:
@@ -464,12 +1397,13 @@ static void Comm_HandleReceivedMsgs(void)
                 if (!Ring_Read8(&comm_recv_buf, &state.v.press_key.pressed))
                     return;
 
-                if (Ring_GetLen(&key_buf) + 2 <= RINGBUF_CAP) {
-                    boolean ok = true;
-                    ok = ok && Ring_Write8(&key_buf, state.v.press_key.key);
-                    ok = ok && Ring_Write8(&key_buf, state.v.press_key.pressed);
-                    assert(ok);
-                    (void)ok;
+                size_t next_i = (key_queue.end_i + 1) % KEY_QUEUE_SIZE;
+                if (next_i != key_queue.start_i) {
+                    key_queue.keys[key_queue.end_i].key = state.v.press_key.key;
+                    key_queue.keys[key_queue.end_i].pressed =
+                        state.v.press_key.pressed;
+                    key_queue.keys[key_queue.end_i].time_us = DG_GetTicksUs();
+                    key_queue.end_i = next_i;
                 } else {
                     fprintf(stderr,
                             LOG_PRE "Warning: Key buffer full; dropping "
@@ -484,8 +1418,20 @@ static void Comm_HandleReceivedMsgs(void)
             }
             break;
 
+        case CMSG_SET_CONFIG_VARS:
+            if (state.stage == 1) {
+                if (!Ring_Read16(&comm_recv_buf,
+                                 &state.v.set_config_var.count))
+                    return;
+                if (state.v.set_config_var.count == 0)
+                    break;
+                ++state.stage;
+            }
+            // fallthrough
+
         case CMSG_SET_CONFIG_VAR:
-            switch (state.stage) {
+            // CMSG_SET_CONFIG_VARS reads the count at stage 1.
+            switch (state.stage - (state.msg_type == CMSG_SET_CONFIG_VARS)) {
             case 1:
                 if (!Ring_Read16(&comm_recv_buf, &state.v.set_config_var.len))
                     return;
@@ -532,15 +1478,12 @@ static void Comm_HandleReceivedMsgs(void)
                     return;
                 state.v.set_config_var.value[state.v.set_config_var.len] = '\0';
 
-                printf("CMSG_SET_CONFIG_VAR: name=\"%s\", value=\"%s\"\n",
-                       state.v.set_config_var.name,
-                       state.v.set_config_var.value);
-                if (!M_SetVariable(state.v.set_config_var.name,
-                                   state.v.set_config_var.value)) {
-                    fprintf(stderr,
-                            LOG_PRE "Warning: Failed to set config variable "
-                                    "\"%s\"; maybe it isn't bound\n",
-                            state.v.set_config_var.name);
+                SetConfigVar(state.v.set_config_var.name,
+                             state.v.set_config_var.value);
+                if (state.msg_type == CMSG_SET_CONFIG_VARS
+                    && --state.v.set_config_var.count > 0) {
+                    state.stage = 2; // Read the next name.
+                    continue;
                 }
                 break;
 
@@ -549,71 +1492,395 @@ static void Comm_HandleReceivedMsgs(void)
             }
             break;
 
-        default:
-            fprintf(stderr,
-                    LOG_PRE "Received unknown message type %" PRIu8
-                            "; quitting\n",
-                    state.msg_type);
-            I_Quit();
-        }
+        case CMSG_SET_CELL_GRID:
+            switch (state.stage) {
+            case 1:
+                if (!Ring_Read16(&comm_recv_buf, &state.v.set_cell_grid.width))
+                    return;
+                ++state.stage;
+                // fallthrough
 
-        // Finished previous message; prepare for a new one.
-        state.stage = 0;
-    }
-}
+            case 2:
+                if (!Ring_Read16(&comm_recv_buf,
+                                 &state.v.set_cell_grid.height))
+                    return;
+                ++state.stage;
+                // fallthrough
 
-static void Comm_Receive(void)
-{
-    while (true) {
-        // Read into both halves of the ringbuf, in case it wraps. Be careful to
-        // leave the last slot untouched, as size == cap - 1 is used to indicate
-        // a full buffer (to disambiguate between start_i == end_i, which is
-        // used to indicate an empty one).
-        struct iovec iovs[2] = {
-            {
-                .iov_base = comm_recv_buf.data + comm_recv_buf.end_i,
-                .iov_len = (comm_recv_buf.start_i > comm_recv_buf.end_i
-                                ? comm_recv_buf.start_i - 1
-                                : RINGBUF_SIZE - (comm_recv_buf.start_i == 0))
-                           - comm_recv_buf.end_i,
-            },
-            {
-                .iov_base = comm_recv_buf.data,
-                .iov_len =
-                    comm_recv_buf.start_i > 0
-                            && comm_recv_buf.start_i < comm_recv_buf.end_i
-                        ? comm_recv_buf.start_i - 1
-                        : 0,
-            },
-        };
+            case 3:
+                if (!Ring_Read8(&comm_recv_buf,
+                                &state.v.set_cell_grid.true_colour))
+                    return;
+                ++state.stage;
+                // fallthrough
 
-        ssize_t recv_ret = recvmsg(comm_sock_fd,
-                                   &(struct msghdr){
-                                       .msg_iov = iovs,
-                                       .msg_iovlen = arrlen(iovs),
-                                   },
-                                   MSG_DONTWAIT);
-        if (recv_ret == 0) {
-            fprintf(stderr,
-                    LOG_PRE "EOF while reading from communications socket; "
-                            "quitting\n");
-            I_Quit();
-        } else if (recv_ret < 0) {
-            switch (errno) {
-#if EAGAIN != EWOULDBLOCK
-            case EAGAIN:
-#endif
-            case EWOULDBLOCK:
-                return; // No data.
+            case 4:
+                if (!Ring_Read8(&comm_recv_buf,
+                                &state.v.set_cell_grid.half_blocks))
+                    return;
 
-            case EINTR:
-                if (interrupted)
-                    I_Quit();
-                continue;
-            }
+                printf(LOG_PRE "CMSG_SET_CELL_GRID: width=%" PRIu16
+                               ", height=%" PRIu16 ", true_colour=%" PRIu8
+                               ", half_blocks=%" PRIu8 "\n",
+                       state.v.set_cell_grid.width,
+                       state.v.set_cell_grid.height,
+                       state.v.set_cell_grid.true_colour,
+                       state.v.set_cell_grid.half_blocks);
+                WaitForEncoder();
+                Cells_SetGrid(state.v.set_cell_grid.width,
+                              state.v.set_cell_grid.height,
+                              state.v.set_cell_grid.true_colour != 0,
+                              state.v.set_cell_grid.half_blocks != 0);
+
+                // Cells this wide average away the extra columns drawn in
+                // high detail anyway, so don't spend time drawing them.
+                R_SetForceLowDetail(lowdetail_cells,
+                                    state.v.set_cell_grid.width > 0
+                                    && state.v.set_cell_grid.width * 2
+                                           < SCREENWIDTH);
+                break;
 
-            I_Error(LOG_PRE "Unexpected error while reading from "
-                            "communications socket: %s",
+            default:
+                abort();
+            }
+            break;
+
+        case CMSG_HELLO:
+            switch (state.stage) {
+            case 1:
+                if (!Ring_Read16(&comm_recv_buf,
+                                 &state.v.hello.protocol_version))
+                    return;
+                ++state.stage;
+                // fallthrough
+
+            case 2:
+                if (!Ring_Read16(&comm_recv_buf, &state.v.hello.caps))
+                    return;
+
+                printf(LOG_PRE "CMSG_HELLO: protocol_version=%" PRIu16
+                               ", caps=0x%" PRIx16 "\n",
+                       state.v.hello.protocol_version, state.v.hello.caps);
+                if (state.v.hello.protocol_version != PROTOCOL_VERSION) {
+                    I_Error(LOG_PRE "Client protocol version %" PRIu16
+                                    " is incompatible with ours (%d); "
+                                    "rebuild DOOM and make sure it matches "
+                                    "the plugin",
+                            state.v.hello.protocol_version, PROTOCOL_VERSION);
+                }
+                WaitForEncoder();
+                client_caps = state.v.hello.caps;
+                break;
+
+            default:
+                abort();
+            }
+            break;
+
+        case CMSG_SET_FRAME_SCALE:
+            switch (state.stage) {
+            case 1:
+                if (!Ring_Read8(&comm_recv_buf,
+                                &state.v.set_frame_scale.scale))
+                    return;
+                ++state.stage;
+                // fallthrough
+
+            case 2:
+                if (!Ring_Read8(&comm_recv_buf,
+                                &state.v.set_frame_scale.aspect_correct))
+                    return;
+
+                printf(LOG_PRE "CMSG_SET_FRAME_SCALE: scale=%" PRIu8
+                               ", aspect_correct=%" PRIu8 "\n",
+                       state.v.set_frame_scale.scale,
+                       state.v.set_frame_scale.aspect_correct);
+                if (state.v.set_frame_scale.scale == 0
+                    || state.v.set_frame_scale.scale > DOOMGENERIC_MAX_SCALE) {
+                    I_Error(LOG_PRE "Requested frame scale out of range; max: "
+                                    "%d, scale: %" PRIu8,
+                            DOOMGENERIC_MAX_SCALE,
+                            state.v.set_frame_scale.scale);
+                }
+                WaitForEncoder();
+                SetFrameScale(state.v.set_frame_scale.scale,
+                              state.v.set_frame_scale.aspect_correct != 0);
+                break;
+
+            default:
+                abort();
+            }
+            break;
+
+        case CMSG_MOUSE_MOTION:
+            switch (state.stage) {
+            case 1:
+                if (!Ring_Read16(&comm_recv_buf, &state.v.mouse_motion.dx))
+                    return;
+                ++state.stage;
+                // fallthrough
+
+            case 2:
+                if (!Ring_Read16(&comm_recv_buf, &state.v.mouse_motion.dy))
+                    return;
+
+                mouse_motion_x += (int16_t)state.v.mouse_motion.dx;
+                mouse_motion_y += (int16_t)state.v.mouse_motion.dy;
+                break;
+
+            default:
+                abort();
+            }
+            break;
+
+        case CMSG_SET_SIXEL_SCALE:
+            if (!Ring_Read8(&comm_recv_buf, &state.v.sixel_scale))
+                return;
+
+            printf(LOG_PRE "CMSG_SET_SIXEL_SCALE: scale=%" PRIu8 "\n",
+                   state.v.sixel_scale);
+            if (state.v.sixel_scale > DOOMGENERIC_MAX_SCALE) {
+                I_Error(LOG_PRE "Requested sixel scale out of range; max: %d, "
+                                "scale: %" PRIu8,
+                        DOOMGENERIC_MAX_SCALE, state.v.sixel_scale);
+            }
+            WaitForEncoder();
+            Sixel_SetScale(state.v.sixel_scale);
+            ClearFrameCache();
+            break;
+
+        case CMSG_SET_CELL_ORIGIN:
+            switch (state.stage) {
+            case 1:
+                if (!Ring_Read16(&comm_recv_buf, &state.v.set_cell_origin.row))
+                    return;
+                ++state.stage;
+                // fallthrough
+
+            case 2:
+                if (!Ring_Read16(&comm_recv_buf, &state.v.set_cell_origin.col))
+                    return;
+
+                printf(LOG_PRE "CMSG_SET_CELL_ORIGIN: row=%" PRIu16
+                               ", col=%" PRIu16 "\n",
+                       state.v.set_cell_origin.row,
+                       state.v.set_cell_origin.col);
+                WaitForEncoder();
+                Cells_SetOrigin(state.v.set_cell_origin.row,
+                                state.v.set_cell_origin.col);
+                break;
+
+            default:
+                abort();
+            }
+            break;
+
+        default:
+            fprintf(stderr,
+                    LOG_PRE "Received unknown message type %" PRIu8
+                            "; quitting\n",
+                    state.msg_type);
+            I_Quit();
+        }
+
+        if (state.msg_type != CMSG_PRESS_KEY
+            && state.msg_type != CMSG_MOUSE_MOTION
+            && state.msg_type != CMSG_GRANT_FRAMES)
+            frame_repeatable = false;
+
+        // Finished previous message; prepare for a new one.
+        state.stage = 0;
+    }
+}
+
+// "AMSG_INIT":
+//   res_x: u16, res_y: u16, protocol_version: u16, caps: u16 (see CAP_*)
+//   Sent first, to the client and to each viewer.
+#define INIT_MSG_LEN 8
+
+static void PutInitMsg(byte *p)
+{
+    uint16_t caps = CAP_FRAME_DELTA | CAP_FRAME_INDEXED | CAP_FRAME_CELLS
+                    | CAP_GRANT_FRAMES | CAP_STATS | CAP_FRAME_ZLIB
+                    | CAP_FRAME_SCALE | CAP_SOUND | CAP_FRAME_SIXEL
+                    | CAP_PALETTE_CACHE | CAP_CELL_ORIGIN | CAP_FRAME_CACHE
+                    | CAP_SIXEL_REGIONS;
+#ifndef __ANDROID__
+    caps |= CAP_FRAME_SHM | CAP_FRAME_SHM_REGIONS;
+#endif
+
+    const uint16_t values[] = {SCREENWIDTH, SCREENHEIGHT, PROTOCOL_VERSION,
+                               caps};
+    for (size_t i = 0; i < arrlen(values); ++i) {
+        p[i * 2] = values[i] & 0xff;
+        p[i * 2 + 1] = values[i] >> 8;
+    }
+}
+
+// Over TCP, send small messages straight away rather than batching them up
+// with Nagle's algorithm.
+static void SetNoDelay(int fd)
+{
+    if (listen_tcp)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+}
+
+static void AddViewer(int fd)
+{
+    if (viewer_count == MAX_VIEWERS) {
+        fprintf(stderr,
+                LOG_PRE "Warning: Refusing a viewer; %d are already watching\n",
+                viewer_count);
+        close(fd);
+        return;
+    }
+
+    // Best-effort room for a few frames, so a viewer isn't dropped as soon as
+    // its Nvim is briefly busy.
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &(int){VIEWER_SNDBUF_SIZE},
+               sizeof(int));
+    SetNoDelay(fd);
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &(int){1}, sizeof(int));
+#endif
+
+    // The viewer's stream begins after everything already queued for the
+    // client, so it starts on a message boundary.
+    WaitForEncoder();
+    COMM_LOCKED(Comm_FlushSend(false));
+
+    byte init_msg[INIT_MSG_LEN];
+    PutInitMsg(init_msg);
+    if (send(fd, init_msg, sizeof init_msg, VIEWER_SEND_FLAGS)
+        != sizeof init_msg) {
+        fprintf(stderr, LOG_PRE "Warning: Failed to greet a viewer: %s\n",
+                strerror(errno));
+        close(fd);
+        return;
+    }
+
+    COMM_LOCKED(viewer_fds[viewer_count++] = fd);
+    printf(LOG_PRE "A viewer has connected (%d watching)\n", viewer_count);
+    if (frame_shm_name[0] != '\0') {
+        fprintf(stderr, LOG_PRE "Warning: Frames are sent via shared memory, "
+                                "which viewers can't show\n");
+    }
+
+    // Resend what the viewer missed. The client gets it again too, which is
+    // harmless: a keyframe, the palette, the player's status and overlays.
+    prev_frame_valid = false;
+    frame_repeatable = false;
+    palette_sent = false;
+    cached_palettes_bits = 0;
+    ClearFrameCache();
+    Cells_Invalidate();
+    Sixel_Invalidate();
+    players[consoleplayer].statusdirty = true;
+    sent_overlays_valid = false;
+    menu_items_sent_bits = 0;
+    if (frame_scale_mode)
+        WriteFrameSize();
+}
+
+static void CloseListenSocket(void);
+
+// Accepts new viewers and discards anything sent by the existing ones.
+static void Comm_ServeViewers(void)
+{
+    int fd;
+    while ((fd = accept(listen_sock_fd, NULL, NULL)) != -1)
+        AddViewer(fd);
+
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR
+        && errno != ECONNABORTED) {
+        fprintf(stderr,
+                LOG_PRE "Warning: Failed to accept a viewer; no longer "
+                        "accepting them: %s\n",
+                strerror(errno));
+        CloseListenSocket();
+    }
+
+    COMM_LOCKED({
+        for (int i = 0; i < viewer_count;) {
+            char discard[256];
+            ssize_t ret =
+                recv(viewer_fds[i], discard, sizeof discard, MSG_DONTWAIT);
+            if (ret > 0 || (ret == -1 && errno == EINTR))
+                continue;
+
+            if (ret == 0) {
+                DropViewer(i, "it closed the connection");
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                DropViewer(i, strerror(errno));
+            } else {
+                ++i;
+            }
+        }
+    });
+}
+
+static void Comm_Receive(void)
+{
+    if (comm_sock_fd < 0)
+        return;
+    if (listen_sock_fd >= 0)
+        Comm_ServeViewers();
+
+    while (true) {
+        // Read into both halves of the ringbuf, in case it wraps. Be careful to
+        // leave the last slot untouched, as size == cap - 1 is used to indicate
+        // a full buffer (to disambiguate between start_i == end_i, which is
+        // used to indicate an empty one).
+        struct iovec iovs[2] = {
+            {
+                .iov_base = comm_recv_buf.data + comm_recv_buf.end_i,
+                .iov_len = (comm_recv_buf.start_i > comm_recv_buf.end_i
+                                ? comm_recv_buf.start_i - 1
+                                : RINGBUF_SIZE - (comm_recv_buf.start_i == 0))
+                           - comm_recv_buf.end_i,
+            },
+            {
+                .iov_base = comm_recv_buf.data,
+                .iov_len =
+                    comm_recv_buf.start_i > 0
+                            && comm_recv_buf.start_i < comm_recv_buf.end_i
+                        ? comm_recv_buf.start_i - 1
+                        : 0,
+            },
+        };
+
+        ssize_t recv_ret = recvmsg(comm_sock_fd,
+                                   &(struct msghdr){
+                                       .msg_iov = iovs,
+                                       .msg_iovlen = arrlen(iovs),
+                                   },
+                                   MSG_DONTWAIT);
+        if (recv_ret == 0) {
+            fprintf(stderr,
+                    LOG_PRE "EOF while reading from communications socket; "
+                            "quitting\n");
+            // Nobody is listening anymore; stop polling the socket so exit
+            // functions that wait (e.g. shutting down a netgame server)
+            // don't see the EOF again and re-enter I_Quit.
+            close(comm_sock_fd);
+            comm_sock_fd = -1;
+            I_Quit();
+        } else if (recv_ret < 0) {
+            switch (errno) {
+#if EAGAIN != EWOULDBLOCK
+            case EAGAIN:
+#endif
+            case EWOULDBLOCK:
+                return; // No data.
+
+            case EINTR:
+                if (interrupted)
+                    I_Quit();
+                continue;
+            }
+
+            I_Error(LOG_PRE "Unexpected error while reading from "
+                            "communications socket: %s",
                     strerror(errno));
         }
         comm_recv_buf.end_i += recv_ret;
@@ -626,6 +1893,8 @@ static void Comm_Receive(void)
         } else if (Ring_IsFull(&comm_recv_buf)) {
             fprintf(stderr, LOG_PRE "Communications read buffer overflow; "
                                     "quitting\n");
+            close(comm_sock_fd);
+            comm_sock_fd = -1;
             I_Quit();
         }
     }
@@ -633,6 +1902,99 @@ static void Comm_Receive(void)
 
 static void MaybeSendPlayerStatus(void);
 
+// Writes the KiB and blocks in use by zone tags first to last, for AMSG_STATS.
+static void WriteZoneUsage(int first, int last)
+{
+    uint32_t bytes = 0;
+    uint32_t blocks = 0;
+    for (int tag = first; tag <= last; tag++) {
+        bytes += zonestats.tagbytes[tag];
+        blocks += zonestats.tagblocks[tag];
+    }
+    Comm_Write32(bytes >> 10);
+    Comm_Write32(blocks);
+}
+
+static void ResetStats(uint64_t now_us)
+{
+    memset(&stats, 0, sizeof stats);
+    memset(&maxpoolusage, 0, sizeof maxpoolusage);
+    stats.start_us = now_us;
+    stats.start_gametic = gametic;
+    stats.start_zone = zonestats;
+    stats.start_deferred_looks = deferredlooks;
+    M_GetWorkCounts(stats.start_work_counts);
+}
+
+static uint32_t PeakRssKib(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss >> 10; // In bytes, rather than KiB.
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static void WriteWorkCounts(void)
+{
+#ifdef FEATURE_WORK_COUNTS
+    unsigned counts[NUMWORKCOUNTS];
+    M_GetWorkCounts(counts);
+
+    Comm_Write8(NUMWORKCOUNTS);
+    for (int i = 0; i < NUMWORKCOUNTS; ++i)
+        Comm_Write32(counts[i] - stats.start_work_counts[i]);
+#else
+    Comm_Write8(0);
+#endif
+}
+
+static void MaybeSendStats(void)
+{
+    uint64_t now_us = GetClockUs();
+    uint64_t interval_us = now_us - stats.start_us;
+    if (interval_us < STATS_INTERVAL_MS * US_PER_MS)
+        return;
+    if (!(client_caps & CAP_STATS)) {
+        COMM_LOCKED(ResetStats(now_us));
+        return;
+    }
+
+    // The encoder thread adds to the stats while holding comm_mutex.
+    COMM_WRITE_MSG({
+        Comm_Write8(AMSG_STATS);
+        Comm_Write32(interval_us / US_PER_MS);
+        Comm_Write16(gametic - stats.start_gametic);
+        Comm_Write16(stats.frames);
+        Comm_Write32(stats.render_us);
+        Comm_Write32(stats.convert_us);
+        Comm_Write32(stats.send_us);
+        Comm_Write32(stats.bytes_sent);
+        Comm_Write32(stats.max_queued_bytes);
+        Comm_Write16(maxpoolusage.visplanes);
+        Comm_Write16(maxpoolusage.drawsegs);
+        Comm_Write16(maxpoolusage.vissprites);
+        Comm_Write32(maxpoolusage.openings);
+        Comm_Write32(zonestats.purges - stats.start_zone.purges);
+        Comm_Write32(Z_ZoneSize() >> 10);
+        WriteZoneUsage(PU_STATIC, PU_MUSIC);
+        WriteZoneUsage(PU_LEVEL, PU_LEVSPEC);
+        WriteZoneUsage(PU_PURGELEVEL, PU_CACHE);
+        Comm_Write32(Z_LargestFreeBlock() >> 10);
+        Comm_Write32(zonestats.mallocs - stats.start_zone.mallocs);
+        Comm_Write32(zonestats.roversteps - stats.start_zone.roversteps);
+        Comm_Write32(parkedlookers);
+        Comm_Write32(deferredlooks - stats.start_deferred_looks);
+        Comm_Write32(PeakRssKib());
+        Comm_Write32(cpufeaturesused);
+        WriteWorkCounts();
+        ResetStats(now_us);
+    });
+}
+
 int main(int argc, char **argv)
 {
     // Set buffering to what's usually the default when run within a terminal.
@@ -642,9 +2004,11 @@ int main(int argc, char **argv)
     setvbuf(stderr, NULL, _IONBF, 0); // No buffering for stderr.
 
     struct sigaction sa = {.sa_handler = SigintHandler};
-    if (sigemptyset(&sa.sa_mask) == -1 || sigaction(SIGINT, &sa, NULL) == -1) {
+    if (sigemptyset(&sa.sa_mask) == -1 || sigaction(SIGINT, &sa, NULL) == -1
+        || sigaction(SIGTERM, &sa, NULL) == -1) {
         fprintf(stderr,
-                LOG_PRE "Warning: Failed to install SIGINT handler: %s\n",
+                LOG_PRE "Warning: Failed to install SIGINT/SIGTERM handler: "
+                        "%s\n",
                 strerror(errno));
     }
 
@@ -652,8 +2016,10 @@ int main(int argc, char **argv)
     while (true) {
         if (gamestate == GS_LEVEL)
             MaybeSendPlayerStatus();
+        MaybeSendStats();
 
-        Comm_FlushSend(false);
+        COMM_LOCKED(Comm_TryFlushSend());
+        Comm_CheckSendError();
         Comm_Receive();
         doomgeneric_Tick();
     }
@@ -664,13 +2030,37 @@ void DG_WipeTick(void)
     // Screen wipes loop within D_Display, which means we should probably limit
     // this function to simple actions and defer messages that may change game
     // state and such.
-    Comm_FlushSend(false);
+    I_UpdateSound(); // Keep sound going.
+    COMM_LOCKED(Comm_TryFlushSend());
+    Comm_CheckSendError();
     Comm_Receive();
+    frame_start_us = GetClockUs(); // Next wipe frame is drawn after this.
+}
+
+void DG_StartDisplay(void)
+{
+    frame_start_us = GetClockUs();
+}
+
+static void GetFrameShmSlotName(char *buf, size_t size, unsigned slot)
+{
+    int len = snprintf(buf, size, "%s.%u", frame_shm_name, slot);
+    assert(len > 0 && (size_t)len < size);
+    (void)len;
 }
 
-static void CloseFrameShm(void)
+static void CloseFrameShmSlot(frameslot_t *slot)
 {
-    if (frame_shm_fd >= 0 && close(frame_shm_fd) == -1) {
+    if (!slot->p)
+        return;
+
+    if (munmap(slot->p, slot->size) == -1) {
+        fprintf(stderr,
+                LOG_PRE
+                "Warning: Failed to unmap frame data shared memory: %s\n",
+                strerror(errno));
+    }
+    if (close(slot->fd) == -1) {
         fprintf(
             stderr,
             LOG_PRE
@@ -678,23 +2068,34 @@ static void CloseFrameShm(void)
             strerror(errno));
     }
 
-    frame_shm_fd = -1;
+    slot->p = NULL;
+    slot->fd = -1;
 }
 
 static void UnlinkFrameShm(void)
 {
+    for (unsigned i = 0; i < frame_shm_slot_count; ++i) {
+        CloseFrameShmSlot(&frame_shm_slots[i]);
+
 #ifndef __ANDROID__
-    if (frame_shm_name[0] != '\0' && shm_unlink(frame_shm_name) == -1
-        && errno != ENOENT) { // May have been unlinked already by the client.
-        fprintf(
-            stderr,
-            LOG_PRE
-            "Warning: Failed to delete frame data shared memory object: %s\n",
-            strerror(errno));
-    }
+        char name[NAME_MAX];
+        GetFrameShmSlotName(name, sizeof name, i);
+        // May have been unlinked already by the client.
+        if (shm_unlink(name) == -1 && errno != ENOENT) {
+            fprintf(stderr,
+                    LOG_PRE "Warning: Failed to delete frame data shared "
+                            "memory object: %s\n",
+                    strerror(errno));
+        }
 #endif
+    }
 
     frame_shm_name[0] = '\0';
+    frame_shm_slot_count = 0;
+    // Don't leave it dangling into an unmapped slot.
+    DG_ScreenBuffer = socket_frame_buf;
+    // Client may not have the last socket frame anymore.
+    prev_frame_valid = false;
 }
 
 static void CloseListenSocket(void)
@@ -717,15 +2118,19 @@ static void CloseListenSocket(void)
     listen_sock_path = NULL;
 }
 
+static void StopEncoder(void);
+
 static void Cleanup(void)
 {
+    StopEncoder();
     CloseListenSocket();
 
     if (comm_sock_fd >= 0) {
-        if (!comm_writing_msg)
+        // Don't write if that requires flushing, which may block.
+        if (!comm_writing_msg && comm_send_buf.len < COMM_SEND_BUF_CAP)
             COMM_WRITE_MSG(Comm_Write8(AMSG_QUIT));
 
-        Comm_FlushSend(true);
+        COMM_LOCKED(Comm_FlushSend(true));
         if (close(comm_sock_fd) == -1) {
             fprintf(stderr,
                     LOG_PRE
@@ -735,11 +2140,13 @@ static void Cleanup(void)
     }
     comm_sock_fd = -1;
 
-    CloseFrameShm();
+    while (viewer_count > 0)
+        close(viewer_fds[--viewer_count]);
+
     UnlinkFrameShm();
 }
 
-static uint32_t GetClockMs(void)
+static uint64_t GetClockUs(void)
 {
     struct timespec tp;
 
@@ -755,245 +2162,1275 @@ static uint32_t GetClockMs(void)
                 strerror(errno));
     }
 
-    return (tp.tv_sec * MS_PER_SEC) + (tp.tv_nsec / NS_PER_MS);
+    return ((uint64_t)tp.tv_sec * MS_PER_SEC * US_PER_MS)
+           + (tp.tv_nsec / NS_PER_US);
 }
 
-void DG_Init(void)
+// Grid that cell frames are encoded for with "-benchframes cells": a
+// 160-column terminal, with half blocks covering the frame's 4:3 aspect.
+#define BENCH_CELL_GRID_WIDTH 160
+#define BENCH_CELL_GRID_HEIGHT 60
+
+static void SetBenchFrameFormat(void)
 {
-    int p = M_CheckParmWithArgs("-listen", 1);
-    if (p == 0)
-        I_Error(LOG_PRE "\"-listen <socket_path>\" argument required");
+    //!
+    // @arg <format>
+    // @category demo
+    //
+    // With -bench, encode frames as format: zlib (the default), rgb,
+    // delta, indexed, indexed-delta, cells, sixel or sixel-regions. The
+    // demos draw the same frames every time, so runs with each compare the
+    // bytes per frame and the time spent encoding them.
+    //
+
+    int p = M_CheckParmWithArgs("-benchframes", 1);
+    const char *format = p ? myargv[p + 1] : "zlib";
+
+    if (strcmp(format, "zlib") == 0) {
+        client_caps = CAP_FRAME_DELTA | CAP_FRAME_ZLIB;
+    } else if (strcmp(format, "rgb") == 0) {
+        client_caps = 0;
+    } else if (strcmp(format, "delta") == 0) {
+        client_caps = CAP_FRAME_DELTA;
+    } else if (strcmp(format, "indexed") == 0) {
+        client_caps = CAP_FRAME_INDEXED | CAP_PALETTE_CACHE;
+    } else if (strcmp(format, "indexed-delta") == 0) {
+        client_caps = CAP_FRAME_DELTA | CAP_FRAME_INDEXED | CAP_PALETTE_CACHE;
+    } else if (strcmp(format, "cells") == 0) {
+        client_caps = CAP_FRAME_CELLS;
+        Cells_SetGrid(BENCH_CELL_GRID_WIDTH, BENCH_CELL_GRID_HEIGHT, true,
+                      true);
+    } else if (strcmp(format, "sixel") == 0) {
+        client_caps = CAP_FRAME_SIXEL;
+        Sixel_SetScale(2);
+    } else if (strcmp(format, "sixel-regions") == 0) {
+        client_caps = CAP_FRAME_SIXEL | CAP_SIXEL_REGIONS;
+        Sixel_SetScale(2);
+    } else {
+        I_Error(LOG_PRE "Unknown -benchframes format: %s", format);
+    }
 
-    const char *sock_path = myargv[p + 1];
-    size_t sock_path_len = strlen(sock_path);
-    struct sockaddr_un listen_sock_addr = {.sun_family = AF_UNIX};
+    printf(LOG_PRE "Benchmarking %s frames\n", format);
+}
 
-    if (sock_path_len + 1 > sizeof listen_sock_addr.sun_path) {
-        I_Error(LOG_PRE "Listener socket path too long; max: %zu, size: %zu",
-                (sizeof listen_sock_addr.sun_path) - 1, sock_path_len);
-    }
+static void *MallocOrError(size_t size)
+{
+    void *p = malloc(size);
+    if (!p)
+        I_Error(LOG_PRE "Failed to allocate %zu byte(s)", size);
+    return p;
+}
+
+static void StartEncoder(void);
+
+// Waits for the client to connect to the listener socket, then greets it.
+static void AcceptClient(void)
+{
+    while ((comm_sock_fd = accept(listen_sock_fd, NULL, NULL)) == -1) {
+        switch (errno) {
+        case ECONNABORTED:
+        case EPERM:
+            fprintf(stderr,
+                    LOG_PRE "Warning: Failed to accept a connection: %s\n",
+                    strerror(errno));
+            break;
+
+        case EINTR:
+            if (interrupted)
+                I_Quit();
+            break;
+
+        default:
+            I_Error(LOG_PRE "Unexpected error while listening for connections: "
+                            "%s",
+                    strerror(errno));
+        }
+    }
+
+    SetNoDelay(comm_sock_fd);
+#ifdef SO_NOSIGPIPE
+    setsockopt(comm_sock_fd, SOL_SOCKET, SO_NOSIGPIPE, &(int){1}, sizeof(int));
+#endif
+
+#ifdef __linux__
+    struct ucred creds;
+    if (!listen_tcp
+        && getsockopt(comm_sock_fd, SOL_SOCKET, SO_PEERCRED, &creds,
+                      &(socklen_t){sizeof creds})
+               == 0) {
+        printf(LOG_PRE "PID %jd has connected\n", (intmax_t)creds.pid);
+    } else {
+        printf(LOG_PRE "A client has connected\n");
+    }
+#elif defined(__APPLE__)
+    pid_t peer_pid = 0;
+    socklen_t peer_pid_len = sizeof(peer_pid);
+    if (!listen_tcp
+        && getsockopt(comm_sock_fd, SOL_LOCAL, LOCAL_PEERPID, &peer_pid,
+                      &peer_pid_len)
+               == 0) {
+        printf(LOG_PRE "PID %jd has connected\n", (intmax_t)peer_pid);
+    } else {
+        printf(LOG_PRE "A client has connected\n");
+    }
+#else
+    printf(LOG_PRE "A client has connected\n");
+#endif
+
+    //!
+    // @category obscure
+    //
+    // Keep listening after the client connects, letting up to 8 more
+    // connect as read-only viewers of the game.
+    //
+
+    if (M_CheckParm("-viewers")) {
+        if (fcntl(listen_sock_fd, F_SETFL, O_NONBLOCK) == -1) {
+            I_Error(LOG_PRE "Failed to listen for viewers: %s",
+                    strerror(errno));
+        }
+        printf(LOG_PRE "Viewers may connect to \"%s\"\n", listen_addr);
+    } else {
+        CloseListenSocket();
+    }
+
+    stats.start_us = GetClockUs();
+    stats.start_zone = zonestats;
+    socket_frame_buf = DG_ScreenBuffer;
+
+    byte init_msg[INIT_MSG_LEN];
+    PutInitMsg(init_msg);
+    COMM_WRITE_MSG(Comm_WriteBytes(init_msg, sizeof init_msg));
+
+    StartEncoder();
+}
+
+static void ListenUnix(const char *sock_path)
+{
+    size_t sock_path_len = strlen(sock_path);
+    struct sockaddr_un listen_sock_addr = {.sun_family = AF_UNIX};
+
+    if (sock_path_len + 1 > sizeof listen_sock_addr.sun_path) {
+        I_Error(LOG_PRE "Listener socket path too long; max: %zu, size: %zu",
+                (sizeof listen_sock_addr.sun_path) - 1, sock_path_len);
+    }
+
+    if ((listen_sock_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+        I_Error(LOG_PRE "Failed to create listener socket: %s",
+                strerror(errno));
+    }
+
+    I_AtExit(Cleanup, true);
+    // Bounds already checked above.
+    strcpy(listen_sock_addr.sun_path, sock_path);
+
+    if (bind(listen_sock_fd, (struct sockaddr *)&listen_sock_addr,
+             sizeof listen_sock_addr)
+        == -1) {
+        I_Error(LOG_PRE "Failed to bind listener socket to path \"%s\": %s",
+                sock_path, strerror(errno));
+    }
+
+    // Bound now, so this path has our socket file.
+    listen_sock_path = sock_path;
+}
+
+// Listens on addr, "[host]:port"; an empty host (or "*") means every
+// interface, and an IPv6 one may be bracketed.
+static void ListenTcp(const char *addr)
+{
+    const char *colon = strrchr(addr, ':');
+    if (!colon)
+        I_Error(LOG_PRE "Expected \"tcp:[host]:port\", got \"tcp:%s\"", addr);
+
+    char host[256];
+    size_t host_len = colon - addr;
+    if (host_len >= 2 && addr[0] == '[' && addr[host_len - 1] == ']') {
+        ++addr;
+        host_len -= 2;
+    }
+    if (host_len >= sizeof host)
+        I_Error(LOG_PRE "Listener host name too long: %zu", host_len);
+    memcpy(host, addr, host_len);
+    host[host_len] = '\0';
+
+    struct addrinfo hints = {.ai_family = AF_UNSPEC,
+                             .ai_socktype = SOCK_STREAM,
+                             .ai_flags = AI_PASSIVE};
+    struct addrinfo *res;
+    boolean any = host[0] == '\0' || strcmp(host, "*") == 0;
+    int err = getaddrinfo(any ? NULL : host, colon + 1, &hints, &res);
+    if (err != 0) {
+        I_Error(LOG_PRE "Failed to resolve listener address \"%s\": %s",
+                listen_addr, gai_strerror(err));
+    }
+
+    I_AtExit(Cleanup, true);
+
+    // The first address that can be bound; with no host, AI_PASSIVE gives the
+    // wildcard addresses.
+    err = 0;
+    for (struct addrinfo *ai = res; ai && listen_sock_fd < 0; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1) {
+            err = errno;
+            continue;
+        }
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == -1) {
+            err = errno;
+            close(fd);
+            continue;
+        }
+        listen_sock_fd = fd;
+    }
+    freeaddrinfo(res);
+
+    if (listen_sock_fd < 0) {
+        I_Error(LOG_PRE "Failed to bind listener socket to \"%s\": %s",
+                listen_addr, strerror(err));
+    }
+    listen_tcp = true;
+}
+
+void DG_Init(void)
+{
+    pthread_mutexattr_t attr;
+    if (pthread_mutexattr_init(&attr) != 0
+        || pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0
+        || pthread_mutex_init(&comm_mutex, &attr) != 0)
+        I_Error(LOG_PRE "Failed to create communications mutex");
+    pthread_mutexattr_destroy(&attr);
+
+    // Sized for the resolution, which is set by now.
+    prev_frame = MallocOrError(SCREENWIDTH * SCREENHEIGHT);
+    comm_send_buf.data = MallocOrError(COMM_SEND_BUF_CAP);
+    comm_frame_buf.data = MallocOrError(COMM_SEND_BUF_CAP);
+
+    if (fastdemo) {
+        // Nothing is drawn or sent.
+        clock_start_us = GetClockUs();
+        return;
+    }
+
+    Quality_Init();
+    Capture_Init();
+
+    if (benchmode) {
+        // Encode frames for the benchmark as they're sent over the socket
+        // when there's no shared memory, then drop them.
+        SetBenchFrameFormat();
+        frame_credits = 1;
+        screenvisible = true;
+        clock_start_us = GetClockUs();
+        socket_frame_buf = DG_ScreenBuffer;
+        return;
+    }
+
+    // Either the path of a Unix socket, or "tcp:[host]:port" to listen on
+    // TCP, e.g. to be played from Nvim on another host; anyone who can reach
+    // the port can connect, so only on a trusted network.
+    int p = M_CheckParmWithArgs("-listen", 1);
+    if (p == 0)
+        I_Error(LOG_PRE "\"-listen <socket_path>\" argument required");
+
+    listen_addr = myargv[p + 1];
+    if (strncmp(listen_addr, "tcp:", 4) == 0)
+        ListenTcp(listen_addr + 4);
+    else
+        ListenUnix(listen_addr);
+
+    if (listen(listen_sock_fd, 2) != 0) {
+        I_Error(LOG_PRE "Failed to listen on actually-doom socket: %s",
+                strerror(errno));
+    }
+
+    // The plugin connects as soon as it sees this; see listening_line in
+    // game.lua.
+    printf(LOG_PRE "Listening for connections on socket \"%s\"...\n",
+           listen_addr);
+
+    clock_start_us = GetClockUs();
+
+    //!
+    // @category obscure
+    //
+    // Load everything, then wait for the client to connect before starting
+    // the game, costing nothing in the meantime. Quits if stdout is closed
+    // while waiting, like when the process that started us has gone away.
+    //
+
+    standby = M_CheckParm("-standby") > 0;
+    if (!standby)
+        AcceptClient();
+}
+
+boolean DG_AwaitClient(void)
+{
+    if (!standby)
+        return false;
+
+    printf(LOG_PRE "Loaded; waiting for a connection\n");
+
+    // Wait for a connection or for stdout to be closed; POLLERR and POLLHUP
+    // are reported for the latter without asking.
+    struct pollfd pfds[] = {{.fd = listen_sock_fd, .events = POLLIN},
+                            {.fd = STDOUT_FILENO}};
+    while (!(pfds[0].revents & POLLIN)) {
+        if (interrupted)
+            I_Quit();
+
+        if (poll(pfds, arrlen(pfds), -1) == -1) {
+            if (errno != EINTR)
+                I_Error(LOG_PRE "Failed to wait for a connection: %s",
+                        strerror(errno));
+            continue;
+        }
+        if (pfds[1].revents & (POLLERR | POLLHUP)) {
+            fprintf(stderr,
+                    LOG_PRE "Nobody's left to connect while on standby; "
+                            "quitting\n");
+            I_Quit();
+        }
+    }
+
+    standby = false;
+    AcceptClient();
+    return true;
+}
+
+
+static void MaybeSendPlayerStatus(void)
+{
+    player_t *p = &players[consoleplayer];
+
+    // The game marks the player when anything shown here changes.
+    if (!p->statusdirty)
+        return;
+    p->statusdirty = false;
+
+    player_status_t status;
+    status.health = p->health;
+    status.armorpoints = p->armorpoints;
+
+    ammotype_t ready_ammo_type = weaponinfo[p->readyweapon].ammo;
+    status.ready_ammo =
+        ready_ammo_type == am_noammo ? -1 : p->ammo[ready_ammo_type];
+
+    memcpy(status.ammo, p->ammo, sizeof p->ammo);
+    memcpy(status.maxammo, p->maxammo, sizeof p->maxammo);
+
+    status.arms_bits = 0;
+    for (int i = 0; i < 6; ++i) // Slots numbered 2-7.
+        status.arms_bits |= !!p->weaponowned[i + 1] << i;
+
+    status.key_bits = 0;
+    status.key_bits |= p->cards[it_bluecard] || p->cards[it_blueskull];
+    status.key_bits |= (p->cards[it_yellowcard] || p->cards[it_yellowskull])
+                       << 1;
+    status.key_bits |= (p->cards[it_redcard] || p->cards[it_redskull]) << 2;
+
+    COMM_WRITE_MSG({
+        Comm_Write8(AMSG_PLAYER_STATUS);
+
+        assert((int16_t)status.health == status.health);
+        Comm_Write16(status.health);
+
+        assert((int16_t)status.armorpoints == status.armorpoints);
+        Comm_Write16(status.armorpoints);
+
+        assert((int16_t)status.ready_ammo == status.ready_ammo);
+        Comm_Write16(status.ready_ammo);
+
+        for (int i = 0; i < NUMAMMO; ++i) {
+            assert((int16_t)status.ammo[i] == status.ammo[i]);
+            Comm_Write16(status.ammo[i]);
+        }
+        for (int i = 0; i < NUMAMMO; ++i) {
+            assert((int16_t)status.maxammo[i] == status.maxammo[i]);
+            Comm_Write16(status.maxammo[i]);
+        }
+
+        Comm_Write8(status.arms_bits);
+        Comm_Write8(status.key_bits);
+    });
+}
+
+#ifndef __ANDROID__
+// Returns the mapping of a frame ring slot, (re-)creating its shared memory
+// object if it doesn't exist yet or if the reader has since unlinked it.
+static byte *AcquireFrameShmSlot(unsigned i, size_t size)
+{
+    frameslot_t *slot = &frame_shm_slots[i];
+
+    // The frame size changed since the slot was last used, so it needs a
+    // freshly sized object too.
+    if (slot->p && slot->size != size)
+        CloseFrameShmSlot(slot);
+
+    if (slot->p) {
+        // macOS doesn't report link counts for shared memory objects, so it
+        // always takes the fresh object path below.
+        struct stat st;
+        if (fstat(slot->fd, &st) == -1) {
+            I_Error(LOG_PRE "Failed to stat frame data shared memory object: "
+                            "%s",
+                    strerror(errno));
+        }
+        if (st.st_nlink > 0)
+            return slot->p;
+
+        // The reader consumed and unlinked the object (like kitty does), so
+        // writing into it is pointless; replace it.
+        CloseFrameShmSlot(slot);
+    }
+
+    char name[NAME_MAX];
+    GetFrameShmSlotName(name, sizeof name, i);
+
+    // Always unlink before creating to ensure a fresh shared memory object.
+    // Especially important on macOS where ftruncate can only be called once.
+    if (shm_unlink(name) == -1 && errno != ENOENT) {
+        fprintf(stderr,
+                LOG_PRE "Warning: Failed to unlink old shared memory: %s\n",
+                strerror(errno));
+    }
+
+    int fd = shm_open(name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        I_Error(LOG_PRE "Failed to create frame data shared memory object: %s",
+                strerror(errno));
+    }
+
+    while (ftruncate(fd, size) == -1) {
+        if (errno == EINTR) {
+            if (interrupted)
+                I_Quit();
+            continue;
+        }
+        I_Error(LOG_PRE "Failed to set size of frame data shared memory: %s",
+                strerror(errno));
+    }
+
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        I_Error(LOG_PRE "Failed to map frame data shared memory: %s",
+                strerror(errno));
+    }
+
+    // Only reported once, as slots are recreated whenever a reader unlinks
+    // them. Only slots of a huge page or more benefit; shmem_enabled in
+    // /sys/kernel/mm/transparent_hugepage must also allow it.
+    static boolean huge_pages_reported;
+    if (I_AdviseHugePages(p, size) && !huge_pages_reported) {
+        printf(LOG_PRE "Frame ring shared memory in huge pages\n");
+        huge_pages_reported = true;
+    }
+
+    // Keep the file descriptor open so we can check whether it was unlinked.
+    slot->fd = fd;
+    slot->p = p;
+    slot->size = size;
+    return p;
+}
+#endif
+
+// Whether socket frames are sent as palette indices.
+static boolean UseIndexedFrames(void)
+{
+    return indexed_frames || (client_caps & CAP_FRAME_INDEXED);
+}
+
+// Whether socket pixel frames are sent as AMSG_FRAME_ZLIB.
+static boolean UseZlibFrames(void)
+{
+    return client_caps & CAP_FRAME_ZLIB;
+}
+
+// Size of the frame written to DG_ScreenBuffer, in pixels.
+static int GetFrameWidth(void)
+{
+    return DG_ScreenMode ? DG_ScreenMode->width : SCREENWIDTH;
+}
+static int GetFrameHeight(void)
+{
+    return DG_ScreenMode ? DG_ScreenMode->height : SCREENHEIGHT;
+}
+
+// Points DG_ScreenBuffer and DG_ScreenMode at where the frame's RGB pixels are
+// wanted, returning false if they aren't needed.
+static boolean BeginFrame(void)
+{
+#ifndef __ANDROID__
+    if (frame_shm_name[0] != '\0') {
+        // Have the palette expansion write straight into the frame slot.
+        DG_ScreenMode = frame_scale_mode;
+        DG_ScreenBuffer = AcquireFrameShmSlot(
+            frame_shm_slot_i, (size_t)GetFrameWidth() * GetFrameHeight() * 3);
+        return true;
+    }
+#endif
+
+    // The last frame may have been sent straight from socket_frame_buf.
+    COMM_LOCKED({
+        if (Comm_HasSendRefs())
+            Comm_FlushSend(false);
+    });
+    DG_ScreenBuffer = socket_frame_buf;
+    DG_ScreenMode = UseZlibFrames() ? frame_scale_mode : NULL;
+    // Sixel, cells and indexed frames are made from the paletted pixels.
+    return !Sixel_IsEnabled() && !Cells_HasGrid()
+           && (UseZlibFrames() || !UseIndexedFrames());
+}
+
+// Returns whether row y changed from prev_frame, and if so, the range of pixels
+// that changed (x2 exclusive).
+static boolean FindRowChange(const frame_t *f, int y, int *x1, int *x2)
+{
+    const byte *row = f->pixels + y * SCREENWIDTH;
+    const byte *prev_row = prev_frame + y * SCREENWIDTH;
+    if (memcmp(row, prev_row, SCREENWIDTH) == 0)
+        return false;
+
+    *x1 = 0;
+    *x2 = SCREENWIDTH;
+    while (row[*x1] == prev_row[*x1])
+        ++*x1;
+    while (row[*x2 - 1] == prev_row[*x2 - 1])
+        --*x2;
+    return true;
+}
+
+// Finds the rectangle bounding the pixels that changed from prev_frame (x2 and
+// y2 exclusive); empty if none did.
+static void FindChangedRegion(const frame_t *f, int *x1, int *y1, int *x2,
+                              int *y2)
+{
+    *x1 = SCREENWIDTH;
+    *y1 = SCREENHEIGHT;
+    *x2 = *y2 = 0;
+    for (int y = 0; y < SCREENHEIGHT; ++y) {
+        int row_x1, row_x2;
+        if (!FindRowChange(f, y, &row_x1, &row_x2))
+            continue;
+
+        *x1 = row_x1 < *x1 ? row_x1 : *x1;
+        *x2 = row_x2 > *x2 ? row_x2 : *x2;
+        *y1 = y < *y1 ? y : *y1;
+        *y2 = y + 1;
+    }
+    if (*y2 == 0)
+        *x1 = *y1 = *x2 = *y2 = 0; // Nothing changed.
+}
+
+// Maps a rectangle of the paletted frame (like from FindChangedRegion) to that of
+// DG_ScreenBuffer covering the same pixels after scaling by DG_ScreenMode.
+static void ScaleRegion(int *x1, int *y1, int *x2, int *y2)
+{
+    if (!DG_ScreenMode)
+        return;
+
+    if (frame_scale_aspect_correct) {
+        // Every 5 rows are stretched into 6, blended only from within those 5.
+        *y1 = *y1 / 5 * 6;
+        *y2 = (*y2 + 4) / 5 * 6;
+    }
+    *x1 *= frame_scale;
+    *y1 *= frame_scale;
+    *x2 *= frame_scale;
+    *y2 *= frame_scale;
+}
+
+// Expands the frame to RGB in DG_ScreenBuffer. Frames sent as the region that
+// changed since prev_frame are only expanded within it, with its rows packed
+// together, as they're sent; others are expanded whole. The region is returned
+// in the scaled frame's coordinates (x2 and y2 exclusive).
+static void ExpandFrame(const frame_t *f, int *x1, int *y1, int *x2, int *y2)
+{
+    boolean regions;
+    if (frame_shm_name[0] != '\0') {
+        regions = (client_caps & CAP_FRAME_SHM_REGIONS) && prev_frame_valid
+                  && !prev_frame_indexed;
+    } else if (UseZlibFrames()) {
+        regions = prev_frame_valid && !prev_frame_indexed
+                  && ++frames_since_keyframe < FRAME_KEYFRAME_INTERVAL;
+        if (!regions)
+            frames_since_keyframe = 0;
+    } else {
+        // Deltas of socket frames are found from the RGB pixels themselves.
+        I_ExpandFrame(f->pixels, f->palette);
+        return;
+    }
+
+    *x1 = *y1 = 0;
+    *x2 = SCREENWIDTH;
+    *y2 = SCREENHEIGHT;
+    if (regions)
+        FindChangedRegion(f, x1, y1, x2, y2);
+    ScaleRegion(x1, y1, x2, y2);
+    I_ExpandFrameRegion(f->pixels, f->palette, *x1, *y1, *x2, *y2,
+                        DG_ScreenBuffer);
+}
+
+// Sends the region of the frame from ExpandFrame.
+static void SendZlibFrame(const frame_t *f, int x1, int y1, int x2, int y2)
+{
+    size_t region_size = (size_t)(x2 - x1) * (y2 - y1) * 3;
+    if (zlib_buf == NULL)
+        zlib_buf = MallocOrError(DEFLATE_BOUND(DOOMGENERIC_SCREEN_BUF_SIZE));
+    size_t zlib_len = region_size > 0
+                          ? Deflate_Zlib(DG_ScreenBuffer, region_size, zlib_buf)
+                          : 0;
+
+    // zlib_buf isn't touched again until BeginFrame flushes the send.
+    COMM_WRITE_MSG({
+        Comm_Write8(AMSG_FRAME_ZLIB);
+        Comm_Write16(x1);
+        Comm_Write16(y1);
+        Comm_Write16(x2 - x1);
+        Comm_Write16(y2 - y1);
+        Comm_Write32(zlib_len);
+        Comm_WriteBytesRef(zlib_buf, zlib_len);
+        Comm_Write8(f->dui_types);
+    });
+
+    memcpy(prev_frame, f->pixels, SCREENWIDTH * SCREENHEIGHT);
+    prev_frame_valid = true;
+    prev_frame_indexed = false;
+}
+
+static void SendPalette(const frame_t *f)
+{
+    int i = f->palette_index;
+    if (!(client_caps & CAP_PALETTE_CACHE) || i < 0) {
+        COMM_WRITE_MSG({
+            Comm_Write8(AMSG_PALETTE);
+            Comm_WriteBytes(f->palette, sizeof encoded_palette);
+        });
+        return;
+    }
+
+    // The cached palette may be from before usegamma changed.
+    if ((cached_palettes_bits & 1u << i)
+        && memcmp(cached_palettes[i], f->palette, sizeof cached_palettes[i])
+               == 0) {
+        COMM_WRITE_MSG({
+            Comm_Write8(AMSG_USE_PALETTE);
+            Comm_Write8(i);
+        });
+        return;
+    }
+
+    memcpy(cached_palettes[i], f->palette, sizeof cached_palettes[i]);
+    cached_palettes_bits |= 1u << i;
+    COMM_WRITE_MSG({
+        Comm_Write8(AMSG_CACHE_PALETTE);
+        Comm_Write8(i);
+        Comm_WriteBytes(f->palette, sizeof cached_palettes[i]);
+    });
+}
+
+static void SendSocketFrame(const frame_t *f)
+{
+    // Range of changed pixels within each row; x1 == x2 if unchanged.
+    static struct {
+        uint16_t x1;
+        uint16_t x2; // Exclusive.
+    } row_spans[MAXHEIGHT];
+
+    // Indexed frames send the paletted pixels as-is, costing a byte each.
+    boolean indexed = UseIndexedFrames();
+    const byte *pixels = indexed ? f->pixels : DG_ScreenBuffer;
+    size_t pixel_size = indexed ? 1 : 3;
+    size_t frame_size = SCREENWIDTH * SCREENHEIGHT * pixel_size;
+
+    if (indexed && !palette_sent) {
+        SendPalette(f);
+        palette_sent = true;
+    }
+
+    boolean keyframe = !prev_frame_valid || prev_frame_indexed != indexed
+                       || !(client_caps & CAP_FRAME_DELTA)
+                       || ++frames_since_keyframe >= FRAME_KEYFRAME_INTERVAL;
+    unsigned span_count = 0;
+
+    if (!keyframe) {
+        size_t delta_len = 0;
+
+        for (int y = 0; y < SCREENHEIGHT; ++y) {
+            int x1 = 0, x2 = 0;
+            if (FindRowChange(f, y, &x1, &x2)) {
+                ++span_count;
+                delta_len += 6 + (x2 - x1) * pixel_size;
+            }
+
+            row_spans[y].x1 = x1;
+            row_spans[y].x2 = x2;
+        }
+
+        // Not worth it if it's about as large as the whole frame anyway.
+        keyframe = delta_len >= frame_size;
+    }
+
+    // The paletted pixels may change before the next flush, so only RGB frames
+    // from socket_frame_buf can be sent without copying.
+    void (*write_pixels)(const byte *, size_t) =
+        indexed ? Comm_WriteBytes : Comm_WriteBytesRef;
+
+    if (keyframe) {
+        COMM_WRITE_MSG({
+            Comm_Write8(indexed ? AMSG_FRAME_INDEXED : AMSG_FRAME);
+            write_pixels(pixels, frame_size);
+            Comm_Write8(f->dui_types);
+        });
+        frames_since_keyframe = 0;
+    } else {
+        COMM_WRITE_MSG({
+            Comm_Write8(indexed ? AMSG_FRAME_INDEXED_DELTA : AMSG_FRAME_DELTA);
+            Comm_Write16(span_count);
+
+            for (int y = 0; y < SCREENHEIGHT; ++y) {
+                if (row_spans[y].x1 == row_spans[y].x2)
+                    continue;
+
+                Comm_Write16(y);
+                Comm_Write16(row_spans[y].x1);
+                Comm_Write16(row_spans[y].x2 - row_spans[y].x1);
+                write_pixels(
+                    pixels
+                        + (y * SCREENWIDTH + row_spans[y].x1) * pixel_size,
+                    (row_spans[y].x2 - row_spans[y].x1) * pixel_size);
+            }
+
+            Comm_Write8(f->dui_types);
+        });
+    }
+
+    memcpy(prev_frame, f->pixels, SCREENWIDTH * SCREENHEIGHT);
+    prev_frame_valid = true;
+    prev_frame_indexed = indexed;
+}
+
+static void SendCellsFrame(const frame_t *f)
+{
+    // The last frame may have been sent straight from the encoder's buffer.
+    COMM_LOCKED({
+        if (Comm_HasSendRefs())
+            Comm_FlushSend(false);
+    });
+
+    size_t cells_len;
+    const char *cells = Cells_Encode(f->pixels, f->palette, &cells_len);
+
+    COMM_WRITE_MSG({
+        Comm_Write8(AMSG_FRAME_CELLS);
+        Comm_Write32(cells_len);
+        Comm_WriteBytesRef((const byte *)cells, cells_len);
+        Comm_Write8(f->dui_types);
+    });
+
+    // The client's copy of the pixels is now stale.
+    prev_frame_valid = false;
+}
+
+static void ClearFrameCache(void)
+{
+    memset(cached_frames, 0, sizeof cached_frames);
+    shown_frame_valid = false;
+}
+
+// 64-bit hash of the frame's pixels and palette, a word at a time; both are
+// multiples of 8 bytes long.
+static uint64_t HashFrame(const frame_t *f)
+{
+    const struct {
+        const byte *p;
+        size_t len;
+    } parts[] = {
+        {f->pixels, SCREENWIDTH * SCREENHEIGHT},
+        {f->palette, 256 * 3},
+    };
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+
+    for (size_t i = 0; i < arrlen(parts); ++i) {
+        for (size_t j = 0; j < parts[i].len; j += 8) {
+            uint64_t word;
+            memcpy(&word, parts[i].p + j, sizeof word);
+            hash = (hash ^ word) * UINT64_C(0x9e3779b97f4a7c15);
+            hash ^= hash >> 29;
+        }
+    }
+    return hash;
+}
+
+// If the client keeps the frame, sends AMSG_USE_FRAME (or an empty frame if
+// it's still showing it) and returns true. Otherwise returns false, with *slot
+// set to the least recently used, to keep the frame as once encoded.
+static boolean SendCachedFrame(const frame_t *f, uint64_t hash, int *slot)
+{
+    boolean shown = shown_frame_valid && hash == shown_frame_hash;
+    shown_frame_hash = hash;
+    shown_frame_valid = true;
+    *slot = 0;
+
+    for (int i = 0; i < FRAME_CACHE_SLOTS; ++i) {
+        if (cached_frames[i].valid && cached_frames[i].hash == hash) {
+            cached_frames[i].last_used = ++cached_frames_clock;
+            COMM_WRITE_MSG({
+                if (shown) {
+                    Comm_Write8(AMSG_FRAME_SIXEL);
+                    Comm_Write32(0);
+                } else {
+                    Comm_Write8(AMSG_USE_FRAME);
+                    Comm_Write8(i);
+                }
+                Comm_Write8(f->dui_types);
+            });
+            return true;
+        }
+
+        if (!cached_frames[*slot].valid)
+            continue;
+        if (!cached_frames[i].valid
+            || cached_frames[i].last_used < cached_frames[*slot].last_used)
+            *slot = i;
+    }
+    return false;
+}
+
+static void SendSixelFrame(const frame_t *f)
+{
+    // The last frame may have been sent straight from the encoder's buffer.
+    COMM_LOCKED({
+        if (Comm_HasSendRefs())
+            Comm_FlushSend(false);
+    });
+
+    boolean cache = client_caps & CAP_FRAME_CACHE;
+    uint64_t hash = cache ? HashFrame(f) : 0;
+    int slot = -1;
+    if (cache && SendCachedFrame(f, hash, &slot)) {
+        // The encoder's last frame is no longer the one shown.
+        Sixel_Invalidate();
+        return;
+    }
+
+    // Regions are drawn over whatever the terminal shows, so whole images are
+    // still sent every so often to repair anything else drawn over them.
+    boolean region = (client_caps & CAP_SIXEL_REGIONS)
+                     && frames_since_keyframe < FRAME_KEYFRAME_INTERVAL;
+    boolean whole;
+    size_t sixel_len;
+    const char *sixel =
+        Sixel_Encode(f->pixels, f->palette, region, &sixel_len, &whole);
+    if (sixel_len > 0)
+        frames_since_keyframe = whole ? 0 : frames_since_keyframe + 1;
+    // Only the whole images of frames that changed are kept.
+    cache = cache && sixel_len > 0 && whole;
+    if (cache) {
+        cached_frames[slot].hash = hash;
+        cached_frames[slot].last_used = ++cached_frames_clock;
+        cached_frames[slot].valid = true;
+    }
+
+    COMM_WRITE_MSG({
+        if (cache) {
+            Comm_Write8(AMSG_CACHE_FRAME);
+            Comm_Write8(slot);
+        }
+        Comm_Write8(whole ? AMSG_FRAME_SIXEL : AMSG_FRAME_SIXEL_REGION);
+        Comm_Write32(sixel_len);
+        if (sixel_len > 0)
+            Comm_WriteBytesRef((const byte *)sixel, sixel_len);
+        Comm_Write8(f->dui_types);
+    });
+
+    // The client's copy of the pixels is now stale.
+    prev_frame_valid = false;
+}
+
+static void WriteMenu(const overlays_t *o)
+{
+    Comm_Write8(AMSG_MENU);
+    if (!o->menu_open) {
+        Comm_Write8(MENU_CLOSED);
+        return;
+    }
+
+    // TODO: unsigned vs signed; will this trick work??
+    assert((uint8_t)o->menu_type == o->menu_type);
+    Comm_Write8(o->menu_type);
+
+    // TODO: unsigned vs signed; will this trick work??
+    assert((uint8_t)o->menu_selected_i == o->menu_selected_i);
+    Comm_Write8(o->menu_selected_i);
+
+    const duimenuvars_t *vars = &o->menu_vars;
+    switch (o->menu_type) {
+    case DMENU_OPTIONS: {
+        byte toggle_bits = 0;
+        toggle_bits |= vars->options.low_detail;
+        toggle_bits |= vars->options.messages_on << 1;
+        Comm_Write8(toggle_bits);
+
+        assert((int8_t)vars->options.mouse_sensitivity
+               == vars->options.mouse_sensitivity);
+        Comm_Write8(vars->options.mouse_sensitivity);
+
+        assert((int8_t)vars->options.screen_size == vars->options.screen_size);
+        Comm_Write8(vars->options.screen_size);
+    } break;
+
+    case DMENU_SOUND:
+        assert((int8_t)vars->sound.sfx_volume == vars->sound.sfx_volume);
+        Comm_Write8(vars->sound.sfx_volume);
+
+        assert((int8_t)vars->sound.music_volume == vars->sound.music_volume);
+        Comm_Write8(vars->sound.music_volume);
+        break;
+
+    case DMENU_LOAD_GAME:
+    case DMENU_SAVE_GAME:
+        // TODO: unsigned vs signed; will this trick work??
+        assert((uint16_t)vars->load_or_save_game.save_slot_count
+               == vars->load_or_save_game.save_slot_count);
+        Comm_Write16(vars->load_or_save_game.save_slot_count);
 
-    if ((listen_sock_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
-        I_Error(LOG_PRE "Failed to create listener socket: %s",
-                strerror(errno));
-    }
+        for (int i = 0; i < vars->load_or_save_game.save_slot_count; ++i)
+            Comm_WriteString(o->menu_save_slots[i]);
 
-    I_AtExit(Cleanup, true);
-    // Bounds already checked above.
-    strcpy(listen_sock_addr.sun_path, sock_path);
+        assert((int8_t)vars->load_or_save_game.save_slot_edit_i
+               == vars->load_or_save_game.save_slot_edit_i);
+        Comm_Write8(vars->load_or_save_game.save_slot_edit_i);
+        break;
 
-    if (bind(listen_sock_fd, (struct sockaddr *)&listen_sock_addr,
-             sizeof listen_sock_addr)
-        == -1) {
-        I_Error(LOG_PRE "Failed to bind listener socket to path \"%s\": %s",
-                sock_path, strerror(errno));
+    default:
+        break;
     }
+}
 
-    // Bound now, so this path has our socket file.
-    listen_sock_path = sock_path;
+static void WriteIntermission(const overlays_t *o)
+{
+    Comm_Write8(AMSG_INTERMISSION);
+    Comm_Write8(o->intermission_shown);
+    if (!o->intermission_shown)
+        return;
 
-    if (listen(listen_sock_fd, 2) != 0) {
-        I_Error(LOG_PRE "Failed to listen on actually-doom socket: %s",
-                strerror(errno));
-    }
+    assert((int8_t)o->intermission_state == o->intermission_state);
+    Comm_Write8(o->intermission_state);
 
-    printf(LOG_PRE "Listening for connections on socket \"%s\"...\n",
-           sock_path);
+    if (o->intermission_has_stats) {
+        const duiwistats_t *stats = &o->intermission_stats;
 
-    while ((comm_sock_fd = accept(listen_sock_fd, NULL, NULL)) == -1) {
-        switch (errno) {
-        case ECONNABORTED:
-        case EPERM:
-            fprintf(stderr,
-                    LOG_PRE "Warning: Failed to accept a connection: %s\n",
-                    strerror(errno));
-            break;
+        assert((int32_t)stats->kills == stats->kills);
+        Comm_Write32(stats->kills);
 
-        case EINTR:
-            if (interrupted)
-                I_Quit();
-            break;
+        assert((int32_t)stats->items == stats->items);
+        Comm_Write32(stats->items);
 
-        default:
-            I_Error(LOG_PRE "Unexpected error while listening for connections: "
-                            "%s",
-                    strerror(errno));
-        }
+        assert((int32_t)stats->secret == stats->secret);
+        Comm_Write32(stats->secret);
+
+        assert((int32_t)stats->time == stats->time);
+        Comm_Write32(stats->time);
+
+        assert((int32_t)stats->par == stats->par);
+        Comm_Write32(stats->par);
     }
+}
 
-#ifdef __linux__
-    struct ucred creds;
-    if (getsockopt(comm_sock_fd, SOL_SOCKET, SO_PEERCRED, &creds,
-                   &(socklen_t){sizeof creds})
-        == 0) {
-        printf(LOG_PRE "PID %jd has connected\n", (intmax_t)creds.pid);
-    } else {
-        printf(LOG_PRE "A client has connected\n");
+static void WriteFinale(const overlays_t *o)
+{
+    Comm_Write8(AMSG_FINALE);
+    // TODO: unsigned vs signed; will this trick work??
+    assert((uint16_t)o->finale_text_len == o->finale_text_len);
+    Comm_Write16(o->finale_text_len);
+}
+
+// Sends the overlays drawn for this frame that differ from those last sent,
+// then starts afresh for the next frame.
+static void SendChangedOverlays(void)
+{
+    const overlays_t *d = &drawn_overlays, *s = &sent_overlays;
+    boolean all = !sent_overlays_valid;
+
+    if (all || d->menu_open != s->menu_open || d->menu_type != s->menu_type
+        || d->menu_selected_i != s->menu_selected_i
+        || memcmp(&d->menu_vars, &s->menu_vars, sizeof d->menu_vars) != 0
+        || memcmp(d->menu_save_slots, s->menu_save_slots,
+                  sizeof d->menu_save_slots)
+               != 0) {
+        COMM_WRITE_MSG(WriteMenu(d));
     }
-#elif defined(__APPLE__)
-    pid_t peer_pid = 0;
-    socklen_t peer_pid_len = sizeof(peer_pid);
-    if (getsockopt(comm_sock_fd, SOL_LOCAL, LOCAL_PEERPID, &peer_pid,
-                   &peer_pid_len)
-        == 0) {
-        printf(LOG_PRE "PID %jd has connected\n", (intmax_t)peer_pid);
-    } else {
-        printf(LOG_PRE "A client has connected\n");
+
+    if (all || d->intermission_shown != s->intermission_shown
+        || d->intermission_state != s->intermission_state
+        || d->intermission_has_stats != s->intermission_has_stats
+        || memcmp(&d->intermission_stats, &s->intermission_stats,
+                  sizeof d->intermission_stats)
+               != 0) {
+        COMM_WRITE_MSG(WriteIntermission(d));
     }
-#else
-    printf(LOG_PRE "A client has connected\n");
-#endif
 
-    CloseListenSocket();
-    clock_start_ms = GetClockMs();
+    if (all || d->finale_text_len != s->finale_text_len)
+        COMM_WRITE_MSG(WriteFinale(d));
 
-    // "AMSG_INIT": res_x: u16, res_y: u16
-    COMM_WRITE_MSG({
-        Comm_Write16(SCREENWIDTH);
-        Comm_Write16(SCREENHEIGHT);
-    });
+    memcpy(&sent_overlays, &drawn_overlays, sizeof sent_overlays);
+    sent_overlays_valid = true;
+    // Zeroed, so padding and unused fields compare equal between frames.
+    memset(&drawn_overlays, 0, sizeof drawn_overlays);
 }
 
-static void MaybeSendPlayerStatus(void)
+// Converts, encodes and sends a frame. Called by the encoder thread if it's
+// running, otherwise by the main thread.
+static void EncodeFrame(const frame_t *f)
 {
-    static player_status_t last_status = {0};
-
-    const player_t *p = &players[consoleplayer];
+    D_BenchBegin(bench_convert);
+    // Unchanged paletted pixels may now have different RGB colours.
+    if (memcmp(f->palette, encoded_palette, sizeof encoded_palette) != 0) {
+        memcpy(encoded_palette, f->palette, sizeof encoded_palette);
+        palette_sent = false;
+        if (frame_shm_name[0] != '\0' || !UseIndexedFrames())
+            prev_frame_valid = false;
+    }
+    int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+    if (BeginFrame())
+        ExpandFrame(f, &x1, &y1, &x2, &y2);
+    D_BenchEnd(bench_convert);
 
-    player_status_t status;
-    status.health = p->health;
-    status.armorpoints = p->armorpoints;
+    D_BenchBegin(bench_encode);
+    if (frame_shm_name[0] == '\0') {
+        // Just send pixels (or cells) over the socket with player status
+        // information.
+        if (Sixel_IsEnabled())
+            SendSixelFrame(f);
+        else if (Cells_HasGrid())
+            SendCellsFrame(f);
+        else if (UseZlibFrames())
+            SendZlibFrame(f, x1, y1, x2, y2);
+        else
+            SendSocketFrame(f);
+        goto end;
+    }
 
-    ammotype_t ready_ammo_type = weaponinfo[p->readyweapon].ammo;
-    status.ready_ammo =
-        ready_ammo_type == am_noammo ? -1 : p->ammo[ready_ammo_type];
+#ifndef __ANDROID__
+    // The frame was already written into the slot by way of BeginFrame, so
+    // it just needs announcing. No msync needed; MAP_SHARED mappings of the
+    // same object are coherent between processes.
+    unsigned slot_i = frame_shm_slot_i;
+    assert(DG_ScreenBuffer == frame_shm_slots[slot_i].p);
+    frame_shm_slot_i = (frame_shm_slot_i + 1) % frame_shm_slot_count;
 
-    memcpy(status.ammo, p->ammo, sizeof p->ammo);
-    memcpy(status.maxammo, p->maxammo, sizeof p->maxammo);
+    COMM_WRITE_MSG({
+        Comm_Write8(AMSG_FRAME_SHM_READY);
+        Comm_Write8(slot_i);
+        Comm_Write16(x1);
+        Comm_Write16(y1);
+        Comm_Write16(x2 - x1);
+        Comm_Write16(y2 - y1);
+    });
 
-    status.arms_bits = 0;
-    for (int i = 0; i < 6; ++i) // Slots numbered 2-7.
-        status.arms_bits |= !!p->weaponowned[i + 1] << i;
+    memcpy(prev_frame, f->pixels, SCREENWIDTH * SCREENHEIGHT);
+    prev_frame_valid = true;
+    prev_frame_indexed = false;
+#else
+    I_Error(
+        LOG_PRE
+        "Shared memory object support not implemented on Android; quitting");
+#endif
 
-    status.key_bits = 0;
-    status.key_bits |= p->cards[it_bluecard] || p->cards[it_blueskull];
-    status.key_bits |= (p->cards[it_yellowcard] || p->cards[it_yellowskull])
-                       << 1;
-    status.key_bits |= (p->cards[it_redcard] || p->cards[it_redskull]) << 2;
+end:
+    D_BenchEnd(bench_encode);
+
+    COMM_LOCKED({
+        encoded_render_us = f->finished_us - f->start_us;
+        encoded_convert_us = GetClockUs() - f->finished_us;
+        ++stats.frames;
+        stats.render_us += encoded_render_us;
+        stats.convert_us += encoded_convert_us;
+    });
 
-    if (status.health == last_status.health
-        && status.armorpoints == last_status.armorpoints
-        && status.ready_ammo == last_status.ready_ammo
-        && memcmp(status.ammo, last_status.ammo, sizeof status.ammo) == 0
-        && memcmp(status.maxammo, last_status.maxammo, sizeof status.maxammo)
-               == 0
-        && status.arms_bits == last_status.arms_bits
-        && status.key_bits == last_status.key_bits) {
-        return; // Unchanged.
-    }
+    // Send it now rather than leaving it for the main thread.
+    if (encoder_running && pthread_equal(pthread_self(), encoder_thread))
+        Comm_SendFrame();
+}
 
-    COMM_WRITE_MSG({
-        Comm_Write8(AMSG_PLAYER_STATUS);
+// Waits for the encoder thread to be done with the frame it was last given, if
+// it's running. Anything it uses mustn't be changed until then.
+static void WaitForEncoder(void)
+{
+    if (!encoder_running)
+        return;
 
-        assert((int16_t)status.health == status.health);
-        Comm_Write16(status.health);
+    pthread_mutex_lock(&encoder_mutex);
+    while (encoder_frame)
+        pthread_cond_wait(&encoder_idle_cond, &encoder_mutex);
+    pthread_mutex_unlock(&encoder_mutex);
+}
 
-        assert((int16_t)status.armorpoints == status.armorpoints);
-        Comm_Write16(status.armorpoints);
+static void *EncoderMain(void *arg)
+{
+    (void)arg;
 
-        assert((int16_t)status.ready_ammo == status.ready_ammo);
-        Comm_Write16(status.ready_ammo);
+    pthread_mutex_lock(&encoder_mutex);
+    while (true) {
+        while (!encoder_frame && !encoder_stopping)
+            pthread_cond_wait(&encoder_cond, &encoder_mutex);
+        if (!encoder_frame)
+            break; // Stopping.
 
-        for (int i = 0; i < NUMAMMO; ++i) {
-            assert((int16_t)status.ammo[i] == status.ammo[i]);
-            Comm_Write16(status.ammo[i]);
-        }
-        for (int i = 0; i < NUMAMMO; ++i) {
-            assert((int16_t)status.maxammo[i] == status.maxammo[i]);
-            Comm_Write16(status.maxammo[i]);
-        }
+        pthread_mutex_unlock(&encoder_mutex);
+        EncodeFrame(encoder_frame);
+        pthread_mutex_lock(&encoder_mutex);
 
-        Comm_Write8(status.arms_bits);
-        Comm_Write8(status.key_bits);
-    });
+        encoder_frame = NULL;
+        pthread_cond_broadcast(&encoder_idle_cond);
+    }
+    pthread_mutex_unlock(&encoder_mutex);
 
-    last_status = status;
+    return NULL;
 }
 
-void DG_DrawFrame(void)
+static void StartEncoder(void)
 {
-    if (frame_shm_name[0] == '\0') {
-        // Just send pixels over the socket with player status information.
-        COMM_WRITE_MSG({
-            Comm_Write8(AMSG_FRAME);
-            Comm_WriteBytes(DG_ScreenBuffer, DOOMGENERIC_SCREEN_BUF_SIZE);
-            Comm_Write8(enabled_dui_types);
-        });
+    //!
+    // @category video
+    //
+    // Encode and send frames on the main thread, rather than on a thread of
+    // their own while the next frame is run and drawn.
+    //
+
+    // -lowmem goes without the thread's copies of the screen.
+    if (M_CheckParm("-noencodethread") || M_CheckParm("-profile")
+        || I_LowMemoryBudget() > 0 || sysconf(_SC_NPROCESSORS_ONLN) <= 1)
+        return;
 
-        goto end;
-    }
+    for (int i = 0; i < 2; ++i)
+        encoder_pixels[i] = MallocOrError(SCREENWIDTH * SCREENHEIGHT);
 
-#ifndef __ANDROID__
-    // Old file descriptor should already be closed, but make sure anyway.
-    CloseFrameShm();
+    // Signals are for the main thread, which quits in response.
+    sigset_t set, old_set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, &old_set);
+    int err = pthread_create(&encoder_thread, NULL, EncoderMain, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
 
-    // Always unlink before creating to ensure a fresh shared memory object.
-    // Especially important on macOS where ftruncate can only be called once.
-    if (shm_unlink(frame_shm_name) == -1 && errno != ENOENT) {
+    if (err != 0) {
         fprintf(stderr,
-                LOG_PRE "Warning: Failed to unlink old shared memory: %s\n",
-                strerror(errno));
+                LOG_PRE "Warning: Failed to start the encoder thread; "
+                        "encoding frames on the main thread: %s\n",
+                strerror(err));
+        return;
     }
+    encoder_running = true;
+}
 
-    frame_shm_fd =
-        shm_open(frame_shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
-    if (frame_shm_fd == -1) {
-        I_Error(LOG_PRE "Failed to create frame data shared memory object: %s",
-                strerror(errno));
-    }
+static void StopEncoder(void)
+{
+    if (!encoder_running || pthread_equal(pthread_self(), encoder_thread))
+        return;
 
-    while (ftruncate(frame_shm_fd, DOOMGENERIC_SCREEN_BUF_SIZE) == -1) {
-        if (errno == EINTR) {
-            if (interrupted)
-                I_Quit();
-            continue;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += ENCODER_STOP_TIMEOUT_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+
+    pthread_mutex_lock(&encoder_mutex);
+    encoder_stopping = true;
+    pthread_cond_signal(&encoder_cond);
+    int err = 0;
+    while (encoder_frame && err != ETIMEDOUT) {
+        err = pthread_cond_timedwait(&encoder_idle_cond, &encoder_mutex,
+                                     &deadline);
+    }
+    boolean stuck = encoder_frame != NULL;
+    pthread_mutex_unlock(&encoder_mutex);
+
+    if (stuck) {
+        // Likely blocked sending to a client that stopped reading; make the
+        // send fail rather than wait on it.
+        shutdown(comm_sock_fd, SHUT_WR);
+
+        // Otherwise, it may be waiting on comm_mutex, which is ours if we're
+        // quitting from within a message; don't wait for it then.
+        if (pthread_mutex_trylock(&comm_mutex) == 0) {
+            boolean ours = comm_writing_msg;
+            pthread_mutex_unlock(&comm_mutex);
+            if (ours) {
+                pthread_detach(encoder_thread);
+                encoder_running = false;
+                return;
+            }
         }
-        I_Error(LOG_PRE "Failed to set size of frame data shared memory: %s",
-                strerror(errno));
     }
 
-    void *p = mmap(NULL, DOOMGENERIC_SCREEN_BUF_SIZE, PROT_READ | PROT_WRITE,
-                   MAP_SHARED, frame_shm_fd, 0);
-    if (p == MAP_FAILED) {
-        I_Error(LOG_PRE "Failed to map frame data shared memory: %s",
-                strerror(errno));
-    }
-    // File descriptor need not be kept open after mapping.
-    CloseFrameShm();
+    pthread_join(encoder_thread, NULL);
+    encoder_running = false;
+}
 
-    memcpy(p, DG_ScreenBuffer, DOOMGENERIC_SCREEN_BUF_SIZE);
+void DG_DrawFrame(void)
+{
+    uint64_t now_us = GetClockUs();
 
-    if (msync(p, DOOMGENERIC_SCREEN_BUF_SIZE, MS_SYNC) == -1) {
-        I_Error(LOG_PRE "Failed to synchronize frame data shared memory: %s",
-                strerror(errno));
+    Capture_AddFrame(I_VideoBuffer, palette);
+
+    if (!encoder_running) {
+        SendChangedOverlays();
+        EncodeFrame(&(frame_t){I_VideoBuffer, palette, palette_index,
+                               enabled_dui_types, frame_start_us, now_us});
+        Quality_AddFrame(encoded_render_us + encoded_convert_us);
+    } else {
+        // Copied while the encoder may still be busy with the last frame.
+        frame_t *f = &encoder_frames[encoder_frame_i];
+        memcpy(encoder_pixels[encoder_frame_i], I_VideoBuffer,
+               SCREENWIDTH * SCREENHEIGHT);
+        memcpy(encoder_palettes[encoder_frame_i], palette, sizeof palette);
+        *f = (frame_t){encoder_pixels[encoder_frame_i],
+                       encoder_palettes[encoder_frame_i], palette_index,
+                       enabled_dui_types, frame_start_us, now_us};
+        encoder_frame_i ^= 1;
+
+        // The overlays drawn with this frame are sent just before it.
+        WaitForEncoder();
+        SendChangedOverlays();
+
+        // Drawing the next frame overlaps encoding the last, so whichever
+        // takes longer is what limits the frame rate.
+        Quality_AddFrame(encoded_render_us > encoded_convert_us
+                             ? encoded_render_us
+                             : encoded_convert_us);
+
+        pthread_mutex_lock(&encoder_mutex);
+        encoder_frame = f;
+        pthread_cond_signal(&encoder_cond);
+        pthread_mutex_unlock(&encoder_mutex);
     }
 
-    if (munmap(p, DOOMGENERIC_SCREEN_BUF_SIZE) == -1) {
-        fprintf(stderr,
-                LOG_PRE
-                "Warning: Failed to unmap frame data shared memory: %s\n",
-                strerror(errno));
+    if (frame_credits > 0 && !benchmode)
+        --frame_credits;
+    screenvisible = frame_credits > 0;
+    frame_repeatable = true;
+    repeat_dui_types = enabled_dui_types;
+    enabled_dui_types = 0;
+}
+
+void DG_RepeatFrame(void)
+{
+    if (!frame_repeatable || enabled_dui_types != repeat_dui_types) {
+        DG_DrawFrame();
+        return;
     }
 
-    COMM_WRITE_MSG(Comm_Write8(AMSG_FRAME_SHM_READY));
-#else
-    I_Error(
-        LOG_PRE
-        "Shared memory object support not implemented on Android; quitting");
-#endif
+    Capture_AddFrame(I_VideoBuffer, palette);
 
-end:
-    screenvisible = false;
+    // Only the overlays (like the menu) may have changed. No frame is sent, so
+    // no credit is spent on one, and the client stays free to grant more.
+    WaitForEncoder();
+    SendChangedOverlays();
     enabled_dui_types = 0;
 }
 
@@ -1006,104 +3443,73 @@ void DG_DrawDetachedUI(duitype_t ui)
 void DG_DrawMenu(duimenutype_t type, const menu_t *menu, short selected_i,
                  const duimenuvars_t *vars)
 {
-    COMM_WRITE_MSG({
-        Comm_Write8(AMSG_FRAME_MENU);
+    overlays_t *o = &drawn_overlays;
 
-        // TODO: unsigned vs signed; will this trick work??
-        assert((uint8_t)type == type);
-        Comm_Write8(type);
+    if (!(menu_items_sent_bits & (1u << type))) {
+        menu_items_sent_bits |= 1u << type;
 
-        // TODO: unsigned vs signed; will this trick work??
-        assert((uint16_t)menu->numitems == menu->numitems);
-        Comm_Write16(menu->numitems);
-        for (int i = 0; i < menu->numitems; i++)
-            Comm_WriteString(menu->menuitems[i].name);
+        COMM_WRITE_MSG({
+            Comm_Write8(AMSG_MENU_ITEMS);
 
-        // TODO: unsigned vs signed; will this trick work??
-        assert((uint8_t)selected_i == selected_i);
-        Comm_Write8(selected_i);
-
-        switch (type) {
-        case DMENU_OPTIONS: {
-            byte toggle_bits = 0;
-            toggle_bits |= vars->options.low_detail;
-            toggle_bits |= vars->options.messages_on << 1;
-            Comm_Write8(toggle_bits);
-
-            assert((int8_t)vars->options.mouse_sensitivity
-                   == vars->options.mouse_sensitivity);
-            Comm_Write8(vars->options.mouse_sensitivity);
-
-            assert((int8_t)vars->options.screen_size
-                   == vars->options.screen_size);
-            Comm_Write8(vars->options.screen_size);
-        } break;
-
-        case DMENU_SOUND:
-            assert((int8_t)vars->sound.sfx_volume == vars->sound.sfx_volume);
-            Comm_Write8(vars->sound.sfx_volume);
-
-            assert((int8_t)vars->sound.music_volume
-                   == vars->sound.music_volume);
-            Comm_Write8(vars->sound.music_volume);
-            break;
+            assert((uint8_t)type == type);
+            Comm_Write8(type);
 
-        case DMENU_LOAD_GAME:
-        case DMENU_SAVE_GAME:
             // TODO: unsigned vs signed; will this trick work??
-            assert((uint16_t)vars->load_or_save_game.save_slot_count
-                   == vars->load_or_save_game.save_slot_count);
-            Comm_Write16(vars->load_or_save_game.save_slot_count);
-
-            for (int i = 0; i < vars->load_or_save_game.save_slot_count; ++i)
-                Comm_WriteString(vars->load_or_save_game.save_slots[i]);
-
-            assert((int8_t)vars->load_or_save_game.save_slot_edit_i
-                   == vars->load_or_save_game.save_slot_edit_i);
-            Comm_Write8(vars->load_or_save_game.save_slot_edit_i);
-            break;
+            assert((uint16_t)menu->numitems == menu->numitems);
+            Comm_Write16(menu->numitems);
+            for (int i = 0; i < menu->numitems; i++)
+                Comm_WriteString(menu->menuitems[i].name);
+        });
+    }
 
-        default:
-            assert(!vars);
+    o->menu_open = true;
+    o->menu_type = type;
+    o->menu_selected_i = selected_i;
+
+    // Copied field by field so that padding stays zeroed for comparing.
+    switch (type) {
+    case DMENU_OPTIONS:
+        o->menu_vars.options = vars->options;
+        break;
+
+    case DMENU_SOUND:
+        o->menu_vars.sound = vars->sound;
+        break;
+
+    case DMENU_LOAD_GAME:
+    case DMENU_SAVE_GAME: {
+        int count = vars->load_or_save_game.save_slot_count;
+        assert(count <= (int)arrlen(o->menu_save_slots));
+
+        o->menu_vars.load_or_save_game.save_slot_count = count;
+        o->menu_vars.load_or_save_game.save_slot_edit_i =
+            vars->load_or_save_game.save_slot_edit_i;
+        for (int i = 0; i < count; ++i) {
+            M_StringCopy(o->menu_save_slots[i],
+                         vars->load_or_save_game.save_slots[i],
+                         SAVESTRINGSIZE);
         }
-    });
+    } break;
+
+    default:
+        assert(!vars);
+    }
 }
 
 void DG_DrawIntermission(stateenum_t state, const duiwistats_t *stats)
 {
-    COMM_WRITE_MSG({
-        Comm_Write8(AMSG_FRAME_INTERMISSION);
-
-        assert((int8_t)state == state);
-        Comm_Write8(state);
-
-        if (stats) {
-            assert((int32_t)stats->kills == stats->kills);
-            Comm_Write32(stats->kills);
-
-            assert((int32_t)stats->items == stats->items);
-            Comm_Write32(stats->items);
+    overlays_t *o = &drawn_overlays;
 
-            assert((int32_t)stats->secret == stats->secret);
-            Comm_Write32(stats->secret);
-
-            assert((int32_t)stats->time == stats->time);
-            Comm_Write32(stats->time);
-
-            assert((int32_t)stats->par == stats->par);
-            Comm_Write32(stats->par);
-        }
-    });
+    o->intermission_shown = true;
+    o->intermission_state = state;
+    o->intermission_has_stats = stats != NULL;
+    if (stats)
+        o->intermission_stats = *stats;
 }
 
 void DG_DrawFinaleText(int count)
 {
-    COMM_WRITE_MSG({
-        Comm_Write8(AMSG_FRAME_FINALE);
-        // TODO: unsigned vs signed; will this trick work??
-        assert((uint16_t)count == count);
-        Comm_Write16(count);
-    });
+    drawn_overlays.finale_text_len = count;
 }
 
 void DG_OnGameMessage(const char *prefix, const char *msg)
@@ -1118,6 +3524,50 @@ void DG_OnGameMessage(const char *prefix, const char *msg)
     });
 }
 
+static void WriteTimes(const duitimes_t *times)
+{
+    Comm_Write32(times->count);
+    Comm_Write32(times->p50);
+    Comm_Write32(times->p95);
+    Comm_Write32(times->p99);
+    Comm_Write32(times->max);
+}
+
+void DG_OnLevelTimes(const char *map, const duitimes_t *frames,
+                     const duitimes_t *tics)
+{
+    COMM_WRITE_MSG({
+        Comm_Write8(AMSG_LEVEL_TIMES);
+        Comm_WriteString(map);
+        WriteTimes(frames);
+        WriteTimes(tics);
+    });
+}
+
+void DG_GetTransport(duitransport_t *transport)
+{
+    int outq = 0;
+
+    // Left out if another thread's busy with it, as I_Error may be waiting
+    // for that thread.
+    transport->queued_bytes = 0;
+    if (pthread_mutex_trylock(&comm_mutex) == 0) {
+        transport->queued_bytes =
+            GetIovLen(comm_send_buf.iov, comm_send_buf.iov_len)
+            + comm_send_buf.len - comm_send_buf.seg_start;
+        pthread_mutex_unlock(&comm_mutex);
+    }
+
+#ifdef TIOCOUTQ
+    if (comm_sock_fd >= 0 && ioctl(comm_sock_fd, TIOCOUTQ, &outq) == 0)
+        transport->queued_bytes += outq;
+#endif
+
+    transport->frame_credits = frame_credits;
+    transport->encoding =
+        __atomic_load_n(&encoder_frame, __ATOMIC_RELAXED) != NULL;
+}
+
 void DG_OnMenuMessage(const char *msg)
 {
     COMM_WRITE_MSG({
@@ -1146,21 +3596,20 @@ void DG_OnSetFinaleText(finalestage_t stage, const char *text)
 
 boolean DG_GetInput(input_t *input)
 {
-    // Initialize pressed to silence bogus GCC -Wmaybe-uninitialized; we always
-    // push at least two bytes to the key_buf.
-    uint8_t key, pressed = 0;
-    if (!Ring_Read8(&key_buf, &key))
+    if (key_queue.start_i == key_queue.end_i)
         return false;
 
-    boolean ok = Ring_Read8(&key_buf, &pressed);
-    assert(ok);
-    (void)ok;
+    uint8_t key = key_queue.keys[key_queue.start_i].key;
+    uint8_t pressed = key_queue.keys[key_queue.start_i].pressed;
+    uint64_t time_us = key_queue.keys[key_queue.start_i].time_us;
+    key_queue.start_i = (key_queue.start_i + 1) % KEY_QUEUE_SIZE;
 
     if (pressed == PK_MOUSEBUTTONS) {
         // key is instead a bitfield of currently pressed mouse buttons.
         *input = (input_t){
             .type = IN_MOUSEBUTTONS,
             .value = key,
+            .time_us = time_us,
         };
         return true;
     }
@@ -1173,29 +3622,104 @@ boolean DG_GetInput(input_t *input)
     *input = (input_t){
         .type = pressed ? IN_KEYDOWN : IN_KEYUP,
         .value = key,
+        .time_us = time_us,
     };
     return true;
 }
 
-void DG_SleepMs(uint32_t ms)
+boolean DG_GetMouseMotion(int *dx, int *dy)
 {
-    struct timespec duration = {.tv_nsec = ms * NS_PER_MS};
+    if (mouse_motion_x == 0 && mouse_motion_y == 0)
+        return false;
 
-    while (nanosleep(&duration, &duration) == -1) {
-        if (errno == EINTR) {
-            if (interrupted)
-                I_Quit();
-            // Could consider clock_nanosleep instead to avoid time drift from
-            // repeated signal interrupts, but don't care.
-            continue;
+    *dx = mouse_motion_x;
+    *dy = mouse_motion_y;
+    mouse_motion_x = mouse_motion_y = 0;
+    return true;
+}
+
+boolean DG_WantsSound(void)
+{
+    return client_caps & CAP_SOUND;
+}
+
+void DG_OnSoundSamples(const byte *samples, unsigned frames, unsigned rate)
+{
+    COMM_WRITE_MSG({
+        Comm_Write8(AMSG_SOUND);
+        Comm_Write32(rate);
+        Comm_Write16(frames);
+        Comm_WriteBytes(samples, (size_t)frames * 4);
+    });
+}
+
+void DG_SleepUntilUs(uint64_t end_us)
+{
+    // Wait on the socket rather than just sleeping so that input is handled as
+    // soon as it's received. The deadline is absolute, so waking early or late
+    // from one wait doesn't shift the next; as poll's timeout is in whole
+    // milliseconds, the last fraction of one is slept instead.
+    struct pollfd pfds[] = {{.fd = comm_sock_fd, .events = POLLIN},
+                            {.fd = wake_fd, .events = POLLIN}};
+    uint64_t now_us;
+    int ret;
+
+    while ((now_us = DG_GetTicksUs()) < end_us) {
+        uint64_t left_us = end_us - now_us;
+
+        if (left_us < US_PER_MS) {
+            struct timespec ts = {.tv_nsec = left_us * NS_PER_US};
+            ret = nanosleep(&ts, NULL);
+        } else {
+            pfds[0].fd = comm_sock_fd; // May have been closed while quitting.
+            ret = poll(pfds, 2, left_us / US_PER_MS);
+        }
+
+        if (ret == -1) {
+            if (errno == EINTR) {
+                if (interrupted)
+                    I_Quit();
+                continue;
+            }
+            I_Error(LOG_PRE "Unexpected error while sleeping: %s",
+                    strerror(errno));
+        }
+
+        if (ret > 0) {
+            if (pfds[0].revents != 0)
+                Comm_Receive();
+            return;
         }
-        I_Error(LOG_PRE "Unexpected error while sleeping: %s", strerror(errno));
     }
 }
 
+void DG_SetWakeFd(int fd)
+{
+    wake_fd = fd;
+}
+
 uint32_t DG_GetTicksMs(void)
 {
-    return GetClockMs() - clock_start_ms;
+    return DG_GetTicksUs() / US_PER_MS;
+}
+
+uint64_t DG_GetTicksUs(void)
+{
+    return GetClockUs() - clock_start_us;
+}
+
+void DG_OnSetPalette(const byte *new_palette, int index)
+{
+    palette_index = index;
+
+    // Not every caller of I_SetPalette checks whether it actually changed
+    // (e.g: when the gamestate changes).
+    if (memcmp(palette, new_palette, sizeof palette) == 0)
+        return;
+
+    // EncodeFrame notices the change when it's next given a frame.
+    memcpy(palette, new_palette, sizeof palette);
+    frame_repeatable = false;
 }
 
 void DG_SetWindowTitle(const char *title)
@@ -0,0 +1,246 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomgeneric_capture.h"
+#include "i_system.h"
+#include "i_thread.h"
+#include "i_timer.h"
+#include "i_video.h"
+#include "m_argv.h"
+
+#define LOG_PRE "[actually-doom] "
+
+// Frames per second of the stream; the game's tic rate, so every tic drawn
+// gets a frame of its own.
+#define CAPTURE_FPS 35
+// Frames that can be waiting to be written at once, and how many times over
+// they can be written between them; a second of the stream.
+#define CAPTURE_SLOTS 8
+#define CAPTURE_MAX_QUEUED CAPTURE_FPS
+
+typedef struct {
+    byte *pixels;
+    byte palette[256 * 3];
+    // Times the frame is written, for those not drawn before it.
+    int repeats;
+    // Set by the I/O job if writing the frame failed.
+    int error;
+    boolean pending;
+    unsigned int ticket;
+} captureslot_t;
+
+static FILE *stream;
+static const char *filename;
+static captureslot_t slots[CAPTURE_SLOTS];
+
+// The frame's Y, U and V planes; only touched by the I/O jobs.
+static byte *planes;
+
+// When the first frame was drawn, and the frames of the stream since, whether
+// queued to be written or dropped.
+static uint64_t start_us;
+static unsigned stream_frames;
+static unsigned repeated_frames;
+static unsigned dropped_frames;
+
+static void WriteFrameJob(void *data)
+{
+    captureslot_t *slot = data;
+    int size = SCREENWIDTH * SCREENHEIGHT;
+    byte y[256], u[256], v[256];
+    int i;
+
+    // BT.601 in the limited range players assume for YUV4MPEG2.
+    for (i = 0; i < 256; ++i) {
+        int r = slot->palette[i * 3];
+        int g = slot->palette[i * 3 + 1];
+        int b = slot->palette[i * 3 + 2];
+
+        y[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        u[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        v[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+
+    for (i = 0; i < size; ++i) {
+        byte p = slot->pixels[i];
+        planes[i] = y[p];
+        planes[size + i] = u[p];
+        planes[2 * size + i] = v[p];
+    }
+
+    slot->error = 0;
+    for (i = 0; i < slot->repeats; ++i) {
+        if (fputs("FRAME\n", stream) == EOF
+            || fwrite(planes, 3, size, stream) != (size_t)size) {
+            slot->error = errno ? errno : EIO;
+            return;
+        }
+    }
+
+    // So a player reading the pipe shows the frame now, not a buffer later.
+    if (fflush(stream) != 0)
+        slot->error = errno ? errno : EIO;
+}
+
+static void StopCapture(void)
+{
+    int i;
+
+    for (i = 0; i < CAPTURE_SLOTS; ++i) {
+        if (slots[i].pending)
+            I_WaitIO(slots[i].ticket);
+        free(slots[i].pixels);
+        slots[i].pixels = NULL;
+        slots[i].pending = false;
+    }
+
+    fclose(stream);
+    stream = NULL;
+    free(planes);
+    planes = NULL;
+
+    printf(LOG_PRE "Captured %u frames to %s (%u repeated, %u dropped)\n",
+           stream_frames - dropped_frames, filename, repeated_frames,
+           dropped_frames);
+}
+
+// Returns a slot that isn't waiting to be written, or NULL if there's none or
+// writing failed, in which case the capture is stopped. Sets *queued to the
+// frames still waiting to be written, counting repeats.
+static captureslot_t *FreeSlot(int *queued)
+{
+    captureslot_t *free_slot = NULL;
+    int i;
+
+    *queued = 0;
+
+    for (i = 0; i < CAPTURE_SLOTS; ++i) {
+        captureslot_t *slot = &slots[i];
+
+        if (slot->pending) {
+            if (!I_IODone(slot->ticket)) {
+                *queued += slot->repeats;
+                continue;
+            }
+
+            slot->pending = false;
+            if (slot->error != 0) {
+                fprintf(stderr, LOG_PRE "Stopped capturing; writing %s: %s\n",
+                        filename, strerror(slot->error));
+                StopCapture();
+                return NULL;
+            }
+        }
+
+        if (free_slot == NULL)
+            free_slot = slot;
+    }
+
+    return free_slot;
+}
+
+static void Shutdown(void)
+{
+    if (stream != NULL)
+        StopCapture();
+}
+
+void Capture_Init(void)
+{
+    //!
+    // @arg <file>
+    // @category video
+    //
+    // Record the frames drawn to file, as a YUV4MPEG2 stream at 35 frames
+    // per second. file can be a named pipe being read by a player or
+    // encoder, like mpv or ffmpeg, which DOOM waits for before starting.
+    //
+
+    int p = M_CheckParmWithArgs("-capture", 1);
+    int i;
+
+    if (!p)
+        return;
+
+    filename = myargv[p + 1];
+    stream = fopen(filename, "wb");
+    if (stream == NULL) {
+        fprintf(stderr, LOG_PRE "Failed to open %s for capturing: %s\n",
+                filename, strerror(errno));
+        return;
+    }
+
+    // The player closing the pipe should stop the capture, not the game.
+    signal(SIGPIPE, SIG_IGN);
+
+    // Pixels are shown at the 4:3 aspect ratio DOOM was made for.
+    if (fprintf(stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A%d:%d C444\n",
+                SCREENWIDTH, SCREENHEIGHT, CAPTURE_FPS, 4 * SCREENHEIGHT,
+                3 * SCREENWIDTH)
+            < 0
+        || fflush(stream) != 0) {
+        fprintf(stderr, LOG_PRE "Failed to write to %s for capturing: %s\n",
+                filename, strerror(errno));
+        fclose(stream);
+        stream = NULL;
+        return;
+    }
+
+    for (i = 0; i < CAPTURE_SLOTS; ++i)
+        slots[i].pixels = I_Realloc(NULL, SCREENWIDTH * SCREENHEIGHT);
+    planes = I_Realloc(NULL, 3 * SCREENWIDTH * SCREENHEIGHT);
+
+    I_AtExit(Shutdown, true);
+    printf(LOG_PRE "Capturing frames to %s\n", filename);
+}
+
+void Capture_AddFrame(const byte *pixels, const byte *palette)
+{
+    captureslot_t *slot;
+    uint64_t now_us;
+    unsigned due;
+    int queued;
+    int repeats;
+
+    if (stream == NULL)
+        return;
+
+    now_us = I_GetTimeUs();
+    if (stream_frames == 0)
+        start_us = now_us;
+
+    // Frames drawn faster than the stream's rate are left out; those it
+    // should have had since the last, while none were drawn, are made up by
+    // repeating this one.
+    due = (now_us - start_us) * CAPTURE_FPS / 1000000 + 1;
+    if (stream_frames >= due)
+        return;
+
+    slot = FreeSlot(&queued);
+    if (stream == NULL)
+        return;
+
+    // Those that don't fit are dropped, rather than repeating the next in
+    // their place, which would only leave the writes further behind.
+    repeats = due - stream_frames;
+    if (slot == NULL)
+        repeats = 0;
+    else if (repeats > CAPTURE_MAX_QUEUED - queued)
+        repeats = CAPTURE_MAX_QUEUED - queued;
+
+    dropped_frames += due - stream_frames - repeats;
+    stream_frames = due;
+    if (repeats <= 0)
+        return;
+
+    memcpy(slot->pixels, pixels, SCREENWIDTH * SCREENHEIGHT);
+    memcpy(slot->palette, palette, sizeof slot->palette);
+    slot->repeats = repeats;
+    repeated_frames += repeats - 1;
+
+    slot->pending = true;
+    slot->ticket = I_QueueIO(WriteFrameJob, slot);
+}
@@ -0,0 +1,20 @@
+#ifndef DOOMGENERIC_CAPTURE
+#define DOOMGENERIC_CAPTURE
+
+#include "doomtype.h"
+
+// Records the frames drawn to the file or pipe given by -capture, as a
+// YUV4MPEG2 stream at 35 frames per second that players like mpv and ffmpeg
+// read as it's written. Frames are converted and written on the I/O thread;
+// while every buffer is still waiting to be written, frames are dropped
+// rather than holding up the game. Frames the game didn't draw in time, like
+// while a level loads, are filled in by repeating the next.
+
+// Read -capture and write the stream's header; does nothing more without it.
+void Capture_Init(void);
+
+// Account for a frame of SCREENWIDTH * SCREENHEIGHT palette indices into
+// palette (256 R8G8B8 colours) having been drawn.
+void Capture_AddFrame(const byte *pixels, const byte *palette);
+
+#endif
@@ -0,0 +1,433 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomgeneric_cells.h"
+#include "i_system.h"
+#include "i_video.h"
+#include "m_argv.h"
+
+#define LOG_PRE "[actually-doom] "
+
+// Reset attributes, clear screen, clear scrollback, cursor to 1,1.
+#define CELLS_FULL_HEADER "\33[m\33[2J\33[3J\33[H"
+// Reset attributes.
+#define CELLS_HEADER "\33[m"
+// Longest sequence emitted per cell, the cursor position including the grid's
+// origin: "\33[RRRRRR;CCCCCCH\33[38;2;RRR;GGG;BBBm\33[48;2;RRR;GGG;BBBm▀".
+#define CELLS_MAX_CELL_LEN 57
+
+// UTF-8 encoded U+2580 UPPER HALF BLOCK.
+#define CELLS_UPPER_HALF_BLOCK "\xe2\x96\x80"
+
+static unsigned grid_width, grid_height;
+static boolean grid_true_colour;
+static boolean grid_half_blocks;
+static boolean grid_dither;
+static boolean grid_nearest;
+
+// 1-indexed terminal row and column of the grid's top-left cell; 0 if the grid
+// fills the terminal, which full frames then clear.
+static unsigned origin_row, origin_col;
+
+// Range of pixels covered by each column and row of the grid; end exclusive.
+// With half blocks, each row of cells is made of two rows here.
+static uint16_t *col_x1, *col_x2;
+static uint16_t *row_y1, *row_y2;
+
+static char *out_buf;
+
+// Per-column R, G and B sums for the pixel row being box filtered.
+static uint32_t *col_sums;
+
+// The palette packed as R | G << 21 | B << 42, so that a column's pixels in a
+// row are summed with one add each. 21 bits holds 255 times the widest frame.
+#define PACKED_SHIFT 21
+#define PACKED_MASK ((UINT64_C(1) << PACKED_SHIFT) - 1)
+static uint64_t packed_palette[256];
+
+// Top and bottom colours of each cell from the box filter; like prev_colours.
+static long *colours;
+
+// Top and bottom colours of each cell as of the last encoded frame, so only
+// cells that changed need to be drawn. Not valid after the grid is set, which
+// forces a full redraw.
+static long *prev_colours;
+static boolean prev_colours_valid;
+
+// https://gist.github.com/MicahElliott/719710?permalink_comment_id=1442838#gistcomment-1442838
+// Keep this sorted.
+static const int cube_levels[] = {0, 95, 135, 175, 215, 255};
+
+// NearestCubeIndex for each channel value; filled by Cells_SetGrid.
+static byte nearest_cube[256];
+
+// 4x4 Bayer matrix for the ordered dither.
+static const byte bayer[4][4] = {
+    {0, 8, 2, 10},
+    {12, 4, 14, 6},
+    {3, 11, 1, 9},
+    {15, 7, 13, 5},
+};
+
+static int NearestCubeIndex(int x)
+{
+    int min_diff = abs(x - cube_levels[0]);
+    for (int i = 1; i < (int)arrlen(cube_levels); ++i) {
+        int diff = abs(x - cube_levels[i]);
+        if (diff >= min_diff) {
+            // Levels are sorted, so we can return as soon as the difference
+            // starts increasing again.
+            return i - 1;
+        }
+        min_diff = diff;
+    }
+    return arrlen(cube_levels) - 1;
+}
+
+static int DistSq(int r, int g, int b, int r2, int g2, int b2)
+{
+    return (r - r2) * (r - r2) + (g - g2) * (g - g2) + (b - b2) * (b - b2);
+}
+
+// Convert RGB to the closest xterm-256 colour. Excludes the first 16 system
+// colours. Not intended to be super accurate.
+static int RGBToXterm256(int r, int g, int b)
+{
+    // Cube colour.
+    int ri = nearest_cube[r];
+    int gi = nearest_cube[g];
+    int bi = nearest_cube[b];
+    int cube_dist = DistSq(r, g, b, cube_levels[ri], cube_levels[gi],
+                           cube_levels[bi]);
+
+    // Grayscale (232-255): 24 shades from levels 8-238 (in increments of 10).
+    int brightness = (r + g + b) / 3;
+    int gray_i = (brightness - 3) / 10; // Rounded from (brightness - 8) / 10.
+    gray_i = gray_i < 0 ? 0 : gray_i > 23 ? 23 : gray_i;
+    int gray_level = 8 + gray_i * 10;
+    int gray_dist = DistSq(r, g, b, gray_level, gray_level, gray_level);
+
+    if (gray_dist < cube_dist)
+        return 232 + gray_i; // Gray is closer.
+    return 16 + 36 * ri + 6 * gi + bi; // Cube is closer.
+}
+
+static char *PutDecimal(char *p, unsigned v)
+{
+    char digits[10];
+    int len = 0;
+
+    do {
+        digits[len++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+
+    while (len > 0)
+        *p++ = digits[--len];
+    return p;
+}
+
+static void *ReallocOrError(void *p, size_t size)
+{
+    p = realloc(p, size);
+    if (!p && size > 0)
+        I_Error(LOG_PRE "Failed to allocate %zu byte(s) for cell grid", size);
+    return p;
+}
+
+void Cells_SetGrid(unsigned width, unsigned height, boolean true_colour,
+                   boolean half_blocks)
+{
+    grid_true_colour = true_colour;
+    prev_colours_valid = false;
+
+    if (nearest_cube[255] == 0) {
+        for (int i = 0; i < 256; ++i)
+            nearest_cube[i] = NearestCubeIndex(i);
+
+        //!
+        // @category video
+        //
+        // Apply an ordered dither to cell frames drawn with xterm-256
+        // colours, trading a fine pattern for smoother gradients.
+        //
+
+        grid_dither = M_CheckParm("-celldither") > 0;
+    }
+
+    if (width == grid_width && height == grid_height
+        && half_blocks == grid_half_blocks)
+        return;
+
+    grid_width = width;
+    grid_height = height;
+    grid_half_blocks = half_blocks;
+    unsigned pix_rows = half_blocks ? height * 2 : height;
+    size_t cell_count = (size_t)width * height;
+
+    col_x1 = ReallocOrError(col_x1, width * sizeof *col_x1);
+    col_x2 = ReallocOrError(col_x2, width * sizeof *col_x2);
+    row_y1 = ReallocOrError(row_y1, pix_rows * sizeof *row_y1);
+    row_y2 = ReallocOrError(row_y2, pix_rows * sizeof *row_y2);
+    col_sums = ReallocOrError(col_sums, width * 3 * sizeof *col_sums);
+    colours = ReallocOrError(colours, cell_count * 2 * sizeof *colours);
+    prev_colours =
+        ReallocOrError(prev_colours, cell_count * 2 * sizeof *prev_colours);
+    out_buf = ReallocOrError(out_buf, sizeof CELLS_FULL_HEADER
+                                          + cell_count * CELLS_MAX_CELL_LEN);
+
+    // Cells smaller than a pixel still cover at least one.
+    for (unsigned x = 0; x < width; ++x) {
+        col_x1[x] = (unsigned long)x * SCREENWIDTH / width;
+        col_x2[x] = (unsigned long)(x + 1) * SCREENWIDTH / width;
+        if (col_x2[x] <= col_x1[x])
+            col_x2[x] = col_x1[x] + 1;
+    }
+    for (unsigned y = 0; y < pix_rows; ++y) {
+        row_y1[y] = (unsigned long)y * SCREENHEIGHT / pix_rows;
+        row_y2[y] = (unsigned long)(y + 1) * SCREENHEIGHT / pix_rows;
+        if (row_y2[y] <= row_y1[y])
+            row_y2[y] = row_y1[y] + 1;
+    }
+}
+
+boolean Cells_HasGrid(void)
+{
+    return grid_width > 0 && grid_height > 0;
+}
+
+void Cells_SetNearest(boolean nearest)
+{
+    grid_nearest = nearest;
+}
+
+void Cells_SetOrigin(unsigned row, unsigned col)
+{
+    if (row == 0 || col == 0)
+        row = col = 0;
+
+    origin_row = row;
+    origin_col = col;
+    prev_colours_valid = false;
+}
+
+void Cells_Invalidate(void)
+{
+    prev_colours_valid = false;
+}
+
+static int ClampColour(int x)
+{
+    return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+// Packs the averaged colour of the cell (or half of one) at x, y as
+// R | G << 8 | B << 16 if using true colour, else as an xterm-256 colour.
+static long PackColour(unsigned x, unsigned y, unsigned r, unsigned g,
+                       unsigned b)
+{
+    if (grid_true_colour)
+        return (long)(r | g << 8 | b << 16);
+
+    if (grid_dither) {
+        // About half a step between cube levels either way.
+        int d = bayer[y % 4][x % 4] * 5 / 2 - 19;
+        return RGBToXterm256(ClampColour(r + d), ClampColour(g + d),
+                             ClampColour(b + d));
+    }
+    return RGBToXterm256(r, g, b);
+}
+
+// Box filter the frame down to the grid, filling colours with the averaged
+// colour of the pixels covered by each cell (or half of one). Works a pixel
+// row at a time, so each row of the frame is read once, front to back.
+// That's already one read per pixel whatever the grid size, which is also
+// what building a summed-area table would cost before any lookups, so the
+// cell sums are accumulated directly instead.
+static void BoxFilter(const byte *frame, const byte *palette)
+{
+    unsigned pix_rows = grid_half_blocks ? grid_height * 2 : grid_height;
+
+    for (int i = 0; i < 256; ++i) {
+        packed_palette[i] = palette[i * 3]
+                            | (uint64_t)palette[i * 3 + 1] << PACKED_SHIFT
+                            | (uint64_t)palette[i * 3 + 2] << PACKED_SHIFT * 2;
+    }
+
+    for (unsigned y = 0; y < pix_rows; ++y) {
+        memset(col_sums, 0, grid_width * 3 * sizeof *col_sums);
+
+        for (unsigned py = row_y1[y]; py < row_y2[y]; ++py) {
+            const byte *row = frame + py * SCREENWIDTH;
+            uint32_t *sums = col_sums;
+
+            for (unsigned x = 0; x < grid_width; ++x, sums += 3) {
+                uint64_t sum = 0;
+                for (unsigned px = col_x1[x]; px < col_x2[x]; ++px)
+                    sum += packed_palette[row[px]];
+                sums[0] += sum & PACKED_MASK;
+                sums[1] += sum >> PACKED_SHIFT & PACKED_MASK;
+                sums[2] += sum >> PACKED_SHIFT * 2;
+            }
+        }
+
+        // Both halves of a cell are the same colour without half blocks.
+        long *out = grid_half_blocks
+                        ? &colours[y / 2 * grid_width * 2 + y % 2]
+                        : &colours[y * grid_width * 2];
+        unsigned row_count = row_y2[y] - row_y1[y];
+        const uint32_t *sums = col_sums;
+
+        for (unsigned x = 0; x < grid_width; ++x, sums += 3, out += 2) {
+            unsigned pix_count = (col_x2[x] - col_x1[x]) * row_count;
+            long colour =
+                PackColour(x, y, (sums[0] + pix_count / 2) / pix_count,
+                           (sums[1] + pix_count / 2) / pix_count,
+                           (sums[2] + pix_count / 2) / pix_count);
+            out[0] = colour;
+            if (!grid_half_blocks)
+                out[1] = colour;
+        }
+    }
+}
+
+// Like BoxFilter, but only reads the pixel at the centre of each cell (or half
+// of one), so costs one read per cell rather than one per pixel.
+static void NearestFilter(const byte *frame, const byte *palette)
+{
+    unsigned pix_rows = grid_half_blocks ? grid_height * 2 : grid_height;
+
+    for (unsigned y = 0; y < pix_rows; ++y) {
+        const byte *row = frame + (row_y1[y] + row_y2[y]) / 2 * SCREENWIDTH;
+        long *out = grid_half_blocks
+                        ? &colours[y / 2 * grid_width * 2 + y % 2]
+                        : &colours[y * grid_width * 2];
+
+        for (unsigned x = 0; x < grid_width; ++x, out += 2) {
+            const byte *rgb = &palette[row[(col_x1[x] + col_x2[x]) / 2] * 3];
+            long colour = PackColour(x, y, rgb[0], rgb[1], rgb[2]);
+            out[0] = colour;
+            if (!grid_half_blocks)
+                out[1] = colour;
+        }
+    }
+}
+
+// Set the foreground or background colour to that from PackColour.
+static char *PutColour(char *p, boolean foreground, long colour)
+{
+    memcpy(p, foreground ? "\33[38;" : "\33[48;", 5);
+    p += 5;
+
+    if (grid_true_colour) {
+        // RGB "true" colour.
+        *p++ = '2';
+        *p++ = ';';
+        p = PutDecimal(p, colour & 0xff);
+        *p++ = ';';
+        p = PutDecimal(p, (colour >> 8) & 0xff);
+        *p++ = ';';
+        p = PutDecimal(p, (colour >> 16) & 0xff);
+    } else {
+        // xterm-256 colour.
+        *p++ = '5';
+        *p++ = ';';
+        p = PutDecimal(p, colour);
+    }
+
+    *p++ = 'm';
+    return p;
+}
+
+const char *Cells_Encode(const byte *frame, const byte *palette, size_t *len)
+{
+    boolean full = !prev_colours_valid;
+    boolean shared = origin_row > 0;
+    unsigned row_base = shared ? origin_row : 1;
+    unsigned col_base = shared ? origin_col : 1;
+    char *p = out_buf;
+
+    // Drawing every cell covers anything already there, so only clear the
+    // terminal if it's ours alone.
+    if (full && !shared) {
+        memcpy(p, CELLS_FULL_HEADER, sizeof CELLS_FULL_HEADER - 1);
+        p += sizeof CELLS_FULL_HEADER - 1;
+    } else {
+        memcpy(p, CELLS_HEADER, sizeof CELLS_HEADER - 1);
+        p += sizeof CELLS_HEADER - 1;
+    }
+
+    // Where the terminal's cursor is, if known, and the current colours.
+    boolean cursor_known = full && !shared;
+    unsigned cursor_x = 0, cursor_y = 0;
+    long cur_fg = -1, cur_bg = -1;
+
+    if (grid_nearest)
+        NearestFilter(frame, palette);
+    else
+        BoxFilter(frame, palette);
+
+    for (unsigned y = 0; y < grid_height; ++y) {
+        for (unsigned x = 0; x < grid_width; ++x) {
+            long top = colours[(y * grid_width + x) * 2];
+            long bottom = colours[(y * grid_width + x) * 2 + 1];
+
+            long *prev_colour = &prev_colours[(y * grid_width + x) * 2];
+            if (!full && prev_colour[0] == top && prev_colour[1] == bottom)
+                continue;
+            prev_colour[0] = top;
+            prev_colour[1] = bottom;
+
+            // Move the cursor here if it isn't already, as cheaply as we can.
+            if (!cursor_known || cursor_x != x || cursor_y != y) {
+                if (cursor_known && cursor_y + 1 == y && x == 0
+                    && col_base == 1) {
+                    memcpy(p, "\r\n", 2);
+                    p += 2;
+                } else if (cursor_known && cursor_y == y && cursor_x < x) {
+                    // Cursor forward.
+                    memcpy(p, "\33[", 2);
+                    p = PutDecimal(p + 2, x - cursor_x);
+                    *p++ = 'C';
+                } else {
+                    // Cursor position (1-indexed).
+                    memcpy(p, "\33[", 2);
+                    p = PutDecimal(p + 2, y + row_base);
+                    *p++ = ';';
+                    p = PutDecimal(p, x + col_base);
+                    *p++ = 'H';
+                }
+            }
+
+            // Only emit escape sequences for colours that changed. If both
+            // halves are the same colour, a space only needs the background.
+            if (bottom != cur_bg) {
+                p = PutColour(p, false, bottom);
+                cur_bg = bottom;
+            }
+            if (top == bottom) {
+                *p++ = ' ';
+            } else {
+                if (top != cur_fg) {
+                    p = PutColour(p, true, top);
+                    cur_fg = top;
+                }
+                memcpy(p, CELLS_UPPER_HALF_BLOCK,
+                       sizeof CELLS_UPPER_HALF_BLOCK - 1);
+                p += sizeof CELLS_UPPER_HALF_BLOCK - 1;
+            }
+
+            // Line wrapping is disabled, so the cursor stays put at the end of
+            // the line.
+            cursor_known = true;
+            cursor_x = x + 1 < grid_width ? x + 1 : x;
+            cursor_y = y;
+        }
+    }
+
+    prev_colours_valid = true;
+    *len = p - out_buf;
+    return out_buf;
+}
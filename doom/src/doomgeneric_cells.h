@@ -0,0 +1,44 @@
+#ifndef DOOMGENERIC_CELLS
+#define DOOMGENERIC_CELLS
+
+#include <stddef.h>
+
+#include "doomtype.h"
+
+// Encodes paletted frames as a stream of terminal escape sequences, drawing
+// each cell of a terminal grid as a space with the averaged colour of the
+// pixels it covers as its background, or as an upper half block with the
+// averaged colours of the top and bottom halves as its foreground and
+// background.
+
+// Set the size of the terminal grid to encode frames for. If true_colour is
+// set, emit 24-bit RGB colours; otherwise, the closest xterm-256 colour. If
+// half_blocks is set, draw cells as half blocks, doubling vertical resolution.
+// The next encoded frame redraws every cell; later ones only draw the cells
+// that changed.
+void Cells_SetGrid(unsigned width, unsigned height, boolean true_colour,
+                   boolean half_blocks);
+
+// Returns true if a non-empty grid was set.
+boolean Cells_HasGrid(void);
+
+// If set, colour each cell (or half of one) with the pixel at its centre rather
+// than averaging every pixel it covers; cheaper, but blockier.
+void Cells_SetNearest(boolean nearest);
+
+// Place the grid's top-left cell at the 1-indexed row and col of a terminal it
+// only covers part of, so it can be drawn straight over a region of another
+// program's screen: frames are positioned accordingly, and full ones draw every
+// cell without clearing the terminal first. If row or col is 0, the grid fills
+// the terminal (the default). The next encoded frame redraws every cell.
+void Cells_SetOrigin(unsigned row, unsigned col);
+
+// Have the next encoded frame redraw every cell, like after Cells_SetGrid.
+void Cells_Invalidate(void);
+
+// frame is SCREENWIDTH * SCREENHEIGHT palette indices, palette is 256 R8G8B8
+// colours. Returns the encoded frame, which remains valid until the next call
+// to Cells_Encode or Cells_SetGrid.
+const char *Cells_Encode(const byte *frame, const byte *palette, size_t *len);
+
+#endif
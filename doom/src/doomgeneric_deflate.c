@@ -0,0 +1,198 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "doomgeneric_deflate.h"
+#include "i_system.h"
+#include "i_thread.h"
+
+#define WINDOW_SIZE 32768
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+// Matches shorter than 4 bytes can take more bits than the literals they'd
+// replace, which would break DEFLATE_BOUND.
+#define MIN_MATCH 4
+#define MAX_MATCH 258
+// How many earlier positions with the same hash to try matching against.
+#define MAX_CHAIN 8
+
+static const uint16_t len_base[] = {3,  4,  5,  6,   7,   8,   9,   10,  11, 13,
+                                    15, 17, 19, 23,  27,  31,  35,  43,  51, 59,
+                                    67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t len_extra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                    1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                    4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+static const uint8_t dist_extra[] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                     4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                     9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Most recent position of each hash, and the previous position with the same
+// hash as each position within the window; -1 if none. Each thread that
+// compresses, like the encoder's and the game's for savegames, has its own,
+// allocated on its first call.
+static THREAD_LOCAL int32_t *hash_head;
+static THREAD_LOCAL int32_t *hash_prev;
+
+static THREAD_LOCAL struct {
+    byte *p;
+    uint64_t bits;
+    unsigned bit_count;
+} out;
+
+// Bits are packed starting from the least significant bit of each byte.
+static void PutBits(uint32_t v, unsigned count)
+{
+    out.bits |= (uint64_t)v << out.bit_count;
+    out.bit_count += count;
+    while (out.bit_count >= 8) {
+        *out.p++ = out.bits & 0xff;
+        out.bits >>= 8;
+        out.bit_count -= 8;
+    }
+}
+
+// Huffman codes are packed starting from their most significant bit, unlike
+// everything else.
+static void PutCode(uint32_t code, unsigned count)
+{
+    uint32_t reversed = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+    PutBits(reversed, count);
+}
+
+// Write a literal/length symbol using the fixed Huffman code.
+static void PutLitLen(unsigned sym)
+{
+    if (sym < 144)
+        PutCode(0x30 + sym, 8);
+    else if (sym < 256)
+        PutCode(0x190 + sym - 144, 9);
+    else if (sym < 280)
+        PutCode(sym - 256, 7);
+    else
+        PutCode(0xc0 + sym - 280, 8);
+}
+
+static void PutMatch(unsigned len, unsigned dist)
+{
+    unsigned i = arrlen(len_base) - 1;
+    while (len_base[i] > len)
+        --i;
+    PutLitLen(257 + i);
+    PutBits(len - len_base[i], len_extra[i]);
+
+    i = arrlen(dist_base) - 1;
+    while (dist_base[i] > dist)
+        --i;
+    PutCode(i, 5); // Fixed distance codes are all 5 bits.
+    PutBits(dist - dist_base[i], dist_extra[i]);
+}
+
+static unsigned Hash(const byte *p)
+{
+    uint32_t v = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static uint32_t Adler32(const byte *p, size_t len)
+{
+    uint32_t a = 1, b = 0;
+    while (len > 0) {
+        // Largest run that can't overflow b before reducing it.
+        size_t run_len = len < 5552 ? len : 5552;
+        len -= run_len;
+        while (run_len-- > 0) {
+            a += *p++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return b << 16 | a;
+}
+
+size_t Deflate_Zlib(const byte *in, size_t len, byte *out_p)
+{
+    out.p = out_p;
+    out.bits = 0;
+    out.bit_count = 0;
+
+    // zlib header: deflate with a 32K window, no preset dictionary, "fastest"
+    // compression level; checksum bits make it a multiple of 31.
+    *out.p++ = 0x78;
+    *out.p++ = 0x01;
+
+    // Final block, fixed Huffman codes.
+    PutBits(1, 1);
+    PutBits(1, 2);
+
+    if (hash_head == NULL) {
+        hash_head = I_Realloc(NULL, HASH_SIZE * sizeof(*hash_head));
+        hash_prev = I_Realloc(NULL, WINDOW_SIZE * sizeof(*hash_prev));
+    }
+
+    memset(hash_head, 0xff, HASH_SIZE * sizeof(*hash_head));
+    size_t i = 0;
+    while (i < len) {
+        unsigned best_len = 0, best_dist = 0;
+
+        if (len - i >= MIN_MATCH) {
+            unsigned h = Hash(in + i);
+            size_t max_len = len - i < MAX_MATCH ? len - i : MAX_MATCH;
+            int32_t pos = hash_head[h];
+
+            for (int chain = 0;
+                 chain < MAX_CHAIN && pos >= 0 && i - pos <= WINDOW_SIZE;
+                 ++chain) {
+                unsigned match_len = 0;
+                while (match_len < max_len
+                       && in[pos + match_len] == in[i + match_len])
+                    ++match_len;
+
+                if (match_len > best_len) {
+                    best_len = match_len;
+                    best_dist = i - pos;
+                    if (best_len == max_len)
+                        break;
+                }
+                pos = hash_prev[pos % WINDOW_SIZE];
+            }
+
+            hash_prev[i % WINDOW_SIZE] = hash_head[h];
+            hash_head[h] = i;
+        }
+
+        if (best_len < MIN_MATCH) {
+            PutLitLen(in[i++]);
+            continue;
+        }
+
+        PutMatch(best_len, best_dist);
+        // Keep the positions covered by the match findable by later matches.
+        size_t match_end = i + best_len;
+        for (++i; i < match_end; ++i) {
+            if (len - i >= MIN_MATCH) {
+                unsigned h = Hash(in + i);
+                hash_prev[i % WINDOW_SIZE] = hash_head[h];
+                hash_head[h] = i;
+            }
+        }
+    }
+
+    PutLitLen(256); // End of block.
+    PutBits(0, 7); // Flush to a byte boundary.
+
+    uint32_t adler = Adler32(in, len);
+    *out.p++ = adler >> 24;
+    *out.p++ = (adler >> 16) & 0xff;
+    *out.p++ = (adler >> 8) & 0xff;
+    *out.p++ = adler & 0xff;
+
+    return out.p - out_p;
+}
@@ -0,0 +1,22 @@
+#ifndef DOOMGENERIC_DEFLATE
+#define DOOMGENERIC_DEFLATE
+
+#include <stddef.h>
+
+#include "doomtype.h"
+
+// Minimal zlib (RFC 1950) stream encoder for sending compressed frames and
+// writing compressed savegames, so we needn't depend on zlib itself. Uses a
+// single block of fixed Huffman codes, with greedy LZ77 matching; frames are
+// mostly long runs of the same colour, and savegames of zeroes, which this
+// handles fine. M_InflateZlib reads the streams back.
+
+// Largest possible size of the output when compressing len bytes.
+#define DEFLATE_BOUND(len) ((len) + (len) / 8 + 16)
+
+// Compress len bytes from in, writing the zlib stream to out, which must have
+// room for DEFLATE_BOUND(len) bytes. Returns the length of the stream. Can be
+// called from more than one thread at once.
+size_t Deflate_Zlib(const byte *in, size_t len, byte *out);
+
+#endif
@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "doomgeneric_cells.h"
+#include "doomgeneric_quality.h"
+#include "m_argv.h"
+#include "r_main.h"
+
+#define LOG_PRE "[actually-doom] "
+
+// Frames averaged before deciding whether to change level.
+#define QUALITY_WINDOW_FRAMES 16
+// Only raise quality while frames take under this percentage of the budget;
+// the level above costs more, so needs room to fit.
+#define QUALITY_RAISE_PERCENT 60
+// Windows in a row with room to spare before raising quality. Doubled each
+// time raising it had to be undone straight away, up to the maximum.
+#define QUALITY_RAISE_WINDOWS 4
+#define QUALITY_MAX_RAISE_WINDOWS 64
+
+// From best to cheapest; each level also does what the ones above it do.
+typedef enum {
+    quality_full,
+    quality_nearest_cells,
+    quality_low_detail,
+    NUMQUALITYLEVELS
+} qualitylevel_t;
+
+static const char *const level_names[NUMQUALITYLEVELS] = {
+    "full",
+    "nearest cells",
+    "low detail",
+};
+
+// Microseconds each frame may take, or 0 if not controlling quality.
+static unsigned budget_us;
+
+static qualitylevel_t level;
+static unsigned window_frames;
+static uint64_t window_us;
+static unsigned spare_windows;
+static unsigned raise_windows = QUALITY_RAISE_WINDOWS;
+static boolean just_raised;
+
+void Quality_Init(void)
+{
+    //!
+    // @arg <fps>
+    // @category video
+    //
+    // Lower the quality of frames while drawing and encoding them can't keep
+    // up with this many per second, and raise it again once it easily can.
+    //
+
+    int p = M_CheckParmWithArgs("-targetfps", 1);
+    if (p) {
+        int fps = atoi(myargv[p + 1]);
+        if (fps > 0)
+            budget_us = 1000000 / fps;
+    }
+}
+
+// Nearest sampling only makes a difference with a cell grid, so skip past it
+// otherwise rather than waiting a window to find it didn't help.
+static boolean LevelHelps(qualitylevel_t l)
+{
+    return l != quality_nearest_cells || Cells_HasGrid();
+}
+
+static void SetLevel(qualitylevel_t l, unsigned avg_us)
+{
+    level = l;
+    Cells_SetNearest(level >= quality_nearest_cells);
+    R_SetForceLowDetail(lowdetail_quality, level >= quality_low_detail);
+
+    printf(LOG_PRE "Quality level now %s; frames took %u us on average, "
+                   "for a budget of %u us\n",
+           level_names[level], avg_us, budget_us);
+}
+
+void Quality_AddFrame(unsigned frame_us)
+{
+    if (budget_us == 0 || frame_us == 0)
+        return;
+
+    window_us += frame_us;
+    if (++window_frames < QUALITY_WINDOW_FRAMES)
+        return;
+
+    unsigned avg_us = window_us / window_frames;
+    boolean raised_last = just_raised;
+    window_frames = 0;
+    window_us = 0;
+    just_raised = false;
+
+    if (avg_us > budget_us) {
+        spare_windows = 0;
+        qualitylevel_t l = level + 1;
+        while (l < NUMQUALITYLEVELS && !LevelHelps(l))
+            ++l;
+        if (l >= NUMQUALITYLEVELS)
+            return;
+
+        if (raised_last && raise_windows < QUALITY_MAX_RAISE_WINDOWS)
+            raise_windows *= 2;
+        SetLevel(l, avg_us);
+    } else if ((uint64_t)avg_us * 100
+               < (uint64_t)budget_us * QUALITY_RAISE_PERCENT) {
+        if (level == quality_full || ++spare_windows < raise_windows)
+            return;
+
+        spare_windows = 0;
+        qualitylevel_t l = level - 1;
+        while (l > quality_full && !LevelHelps(l))
+            --l;
+        just_raised = true;
+        SetLevel(l, avg_us);
+    } else {
+        spare_windows = 0;
+    }
+}
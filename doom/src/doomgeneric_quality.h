@@ -0,0 +1,17 @@
+#ifndef DOOMGENERIC_QUALITY
+#define DOOMGENERIC_QUALITY
+
+// Steps frame quality down while frames take longer than -targetfps allows,
+// and back up once there's plenty of time to spare: first colouring cells by
+// the pixel at their centre rather than averaging them, then drawing in low
+// detail.
+
+// Read -targetfps; does nothing more without it.
+void Quality_Init(void);
+
+// Account for a frame that took frame_us to draw and encode, changing the
+// quality level if needed. Only to be called while the encoder is idle, as
+// the level changes how cells are encoded.
+void Quality_AddFrame(unsigned frame_us);
+
+#endif
@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomgeneric_sixel.h"
+#include "i_system.h"
+#include "i_video.h"
+
+#define LOG_PRE "[actually-doom] "
+
+// Longest colour introducer, which also defines the register:
+// "#NNN;2;PPP;PPP;PPP".
+#define SIXEL_MAX_COLOUR_LEN 19
+// Longest run of sixels: "!NNNNN?".
+#define SIXEL_MAX_RUN_LEN 7
+
+static unsigned sixel_scale;
+
+static char *out_buf;
+static size_t out_cap;
+
+// Sixels of each colour for every column of the band of 6 rows being encoded,
+// SCREENWIDTH for each of the 256 colours; each colour's columns are cleared
+// again once they're drawn.
+static byte *band_sixels;
+static boolean band_used[256];
+static byte band_colours[256];
+// Columns of the band each colour is used within; x2 exclusive.
+static int band_x1[256], band_x2[256];
+
+// Introducers defining each colour of the palette, rebuilt only when it
+// changes.
+static char colour_defs[256][SIXEL_MAX_COLOUR_LEN + 1];
+static byte defs_palette[256 * 3];
+static boolean defs_valid;
+
+// The last frame encoded, so that an unchanged frame needn't be sent again.
+static byte *prev_frame;
+static boolean prev_frame_valid;
+
+static char *PutDecimal(char *p, unsigned v)
+{
+    char digits[10];
+    int len = 0;
+
+    do {
+        digits[len++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+
+    while (len > 0)
+        *p++ = digits[--len];
+    return p;
+}
+
+static void *ReallocOrError(void *p, size_t size)
+{
+    p = realloc(p, size);
+    if (!p && size > 0)
+        I_Error(LOG_PRE "Failed to allocate %zu byte(s) for sixels", size);
+    return p;
+}
+
+// Makes room for len more bytes after p, which points into out_buf, returning
+// where p is afterwards.
+static char *Reserve(char *p, size_t len)
+{
+    size_t used = p - out_buf;
+    if (used + len <= out_cap)
+        return p;
+
+    out_cap = (used + len) * 2;
+    out_buf = ReallocOrError(out_buf, out_cap);
+    return out_buf + used;
+}
+
+void Sixel_SetScale(unsigned scale)
+{
+    sixel_scale = scale;
+    prev_frame_valid = false;
+
+    if (scale > 0 && !band_sixels) {
+        band_sixels = ReallocOrError(NULL, (size_t)256 * SCREENWIDTH);
+        memset(band_sixels, 0, (size_t)256 * SCREENWIDTH);
+        prev_frame = ReallocOrError(NULL, SCREENWIDTH * SCREENHEIGHT);
+    }
+}
+
+boolean Sixel_IsEnabled(void)
+{
+    return sixel_scale > 0;
+}
+
+void Sixel_Invalidate(void)
+{
+    prev_frame_valid = false;
+}
+
+static void BuildColourDefs(const byte *palette)
+{
+    for (int i = 0; i < 256; ++i) {
+        // Sixel colours are percentages.
+        snprintf(colour_defs[i], sizeof colour_defs[i], "#%d;2;%d;%d;%d", i,
+                 (palette[i * 3] * 100 + 127) / 255,
+                 (palette[i * 3 + 1] * 100 + 127) / 255,
+                 (palette[i * 3 + 2] * 100 + 127) / 255);
+    }
+
+    memcpy(defs_palette, palette, sizeof defs_palette);
+    defs_valid = true;
+}
+
+// Puts count repeats of the sixel c, using a repeat introducer when shorter.
+static char *PutRun(char *p, char c, unsigned count)
+{
+    if (count >= 4) {
+        *p++ = '!';
+        p = PutDecimal(p, count);
+        *p++ = c;
+    } else {
+        while (count-- > 0)
+            *p++ = c;
+    }
+    return p;
+}
+
+// Finds the rectangle bounding the pixels of frame that changed from
+// prev_frame (x2 and y2 exclusive); returns false if none did.
+static boolean FindChangedRegion(const byte *frame, int *x1, int *y1, int *x2,
+                                 int *y2)
+{
+    *x1 = SCREENWIDTH;
+    *x2 = 0;
+    *y1 = -1;
+    for (int y = 0; y < SCREENHEIGHT; ++y) {
+        const byte *row = frame + y * SCREENWIDTH;
+        const byte *prev_row = prev_frame + y * SCREENWIDTH;
+        if (memcmp(row, prev_row, SCREENWIDTH) == 0)
+            continue;
+
+        int row_x1 = 0, row_x2 = SCREENWIDTH;
+        while (row[row_x1] == prev_row[row_x1])
+            ++row_x1;
+        while (row[row_x2 - 1] == prev_row[row_x2 - 1])
+            --row_x2;
+
+        *x1 = row_x1 < *x1 ? row_x1 : *x1;
+        *x2 = row_x2 > *x2 ? row_x2 : *x2;
+        if (*y1 < 0)
+            *y1 = y;
+        *y2 = y + 1;
+    }
+    return *y1 >= 0;
+}
+
+const char *Sixel_Encode(const byte *frame, const byte *palette,
+                         boolean region, size_t *len, boolean *whole)
+{
+    if (!defs_valid
+        || memcmp(palette, defs_palette, sizeof defs_palette) != 0) {
+        BuildColourDefs(palette);
+        prev_frame_valid = false;
+    }
+
+    // Bounds of what's encoded, in unscaled pixels.
+    int x1 = 0, y1 = 0, x2 = SCREENWIDTH, y2 = SCREENHEIGHT;
+    if (prev_frame_valid) {
+        int cx1, cy1, cx2, cy2;
+        if (!FindChangedRegion(frame, &cx1, &cy1, &cx2, &cy2)) {
+            *len = 0;
+            *whole = true;
+            return out_buf;
+        }
+        if (region) {
+            x1 = cx1;
+            y1 = cy1;
+            x2 = cx2;
+            y2 = cy2;
+        }
+    }
+    *whole = x1 == 0 && y1 == 0 && x2 == SCREENWIDTH && y2 == SCREENHEIGHT;
+    memcpy(prev_frame, frame, SCREENWIDTH * SCREENHEIGHT);
+    prev_frame_valid = true;
+
+    // Registers are only defined before their first use in the image.
+    boolean defined[256] = {false};
+    unsigned height = SCREENHEIGHT * sixel_scale;
+    // Bands of 6 rows holding the region; the pixels of the region's rows
+    // are all set, the rest of the band's too, as they're the same.
+    unsigned band_y1 = (unsigned)y1 * sixel_scale / 6 * 6;
+    unsigned band_y2 = (unsigned)y2 * sixel_scale;
+
+    // Pixel aspect ratio of 1:1, with pixels left unset being transparent,
+    // followed by the size of the image. Outside of a region, nothing is set,
+    // so the last frame drawn shows through there.
+    char *p = Reserve(out_buf, 32 + band_y1 / 6);
+    p += sprintf(p, "\33P0;1q\"1;1;%u;%u", SCREENWIDTH * sixel_scale, height);
+
+    // Skip the bands above the region.
+    for (unsigned y = 0; y < band_y1; y += 6)
+        *p++ = '-';
+
+    for (unsigned y = band_y1; y < band_y2; y += 6) {
+        int colour_count = 0;
+
+        for (unsigned i = 0; i < 6 && y + i < height; ++i) {
+            const byte *row =
+                frame + (size_t)((y + i) / sixel_scale) * SCREENWIDTH;
+
+            for (int x = x1; x < x2; ++x) {
+                byte c = row[x];
+                byte *sixels = band_sixels + (size_t)c * SCREENWIDTH;
+                if (!band_used[c]) {
+                    band_used[c] = true;
+                    band_colours[colour_count++] = c;
+                    band_x1[c] = x;
+                    band_x2[c] = x + 1;
+                } else if (x < band_x1[c]) {
+                    band_x1[c] = x;
+                } else if (x >= band_x2[c]) {
+                    band_x2[c] = x + 1;
+                }
+                sixels[x] |= 1 << i;
+            }
+        }
+
+        for (int i = 0; i < colour_count; ++i) {
+            byte c = band_colours[i];
+            byte *sixels = band_sixels + (size_t)c * SCREENWIDTH;
+            band_used[c] = false;
+
+            p = Reserve(p, 1 + SIXEL_MAX_COLOUR_LEN
+                               + (size_t)SCREENWIDTH * SIXEL_MAX_RUN_LEN + 1);
+
+            // Carriage return to overlay the band with this colour.
+            if (i > 0)
+                *p++ = '$';
+
+            if (!defined[c]) {
+                size_t def_len = strlen(colour_defs[c]);
+                memcpy(p, colour_defs[c], def_len);
+                p += def_len;
+                defined[c] = true;
+            } else {
+                *p++ = '#';
+                p = PutDecimal(p, c);
+            }
+
+            // Skip to the colour's first column; those after its last needn't
+            // be drawn.
+            int end = band_x2[c];
+            p = PutRun(p, '?', band_x1[c] * sixel_scale);
+
+            for (int x = band_x1[c]; x < end;) {
+                int run = 1;
+                while (x + run < end && sixels[x + run] == sixels[x])
+                    ++run;
+
+                p = PutRun(p, '?' + sixels[x], run * sixel_scale);
+                x += run;
+            }
+            memset(sixels + band_x1[c], 0, end - band_x1[c]);
+        }
+
+        // Next band; not after the last, which could scroll the terminal.
+        if (y + 6 < band_y2)
+            *p++ = '-';
+    }
+
+    p = Reserve(p, 2);
+    memcpy(p, "\33\\", 2);
+    p += 2;
+
+    *len = p - out_buf;
+    return out_buf;
+}
@@ -0,0 +1,32 @@
+#ifndef DOOMGENERIC_SIXEL
+#define DOOMGENERIC_SIXEL
+
+#include <stddef.h>
+
+#include "doomtype.h"
+
+// Encodes paletted frames as sixel images. DOOM's 256 colours map straight onto
+// sixel colour registers, so there's no quantising to do; each image defines
+// just the registers it uses.
+
+// Set the factor to scale frames up by (1 to DOOMGENERIC_MAX_SCALE), or 0 to
+// stop encoding them as sixels.
+void Sixel_SetScale(unsigned scale);
+
+// Returns true if a non-zero scale was set.
+boolean Sixel_IsEnabled(void);
+
+// Have the next frame encoded even if it's unchanged from the last.
+void Sixel_Invalidate(void);
+
+// frame is SCREENWIDTH * SCREENHEIGHT palette indices, palette is 256 R8G8B8
+// colours. Returns the encoded image, which is empty if the frame and palette
+// are unchanged from the last, and remains valid until the next call to
+// Sixel_Encode or Sixel_SetScale.
+// If region is true, only the rectangle bounding the pixels that changed from
+// the last frame is set, leaving the rest transparent, so the image is meant to
+// be drawn over the last. *whole is set to false if that left anything out.
+const char *Sixel_Encode(const byte *frame, const byte *palette,
+                         boolean region, size_t *len, boolean *whole);
+
+#endif
@@ -140,6 +140,12 @@ extern boolean viewactive;
 
 extern boolean nodrawers;
 
+// Run a demo's playsim alone, as fast as it will go (-fastdemo).
+extern boolean fastdemo;
+
+// Draw frames between tics, not just after each tic.
+extern boolean uncapped;
+
 extern boolean testcontrols;
 extern int testcontrols_mousespeed;
 
@@ -85,6 +85,9 @@ static textscreen_t textscreens[] = {
 char *finaletext;
 char *finaleflat;
 
+// The background of the text or cast screen as drawn.
+static vscreencache_t backgroundcache;
+
 void F_StartCast(void);
 void F_CastTicker(void);
 boolean F_CastResponder(event_t *ev);
@@ -129,6 +132,7 @@ void F_StartFinale(void)
 
     finalestage = F_STAGE_TEXT;
     finalecount = 0;
+    backgroundcache.valid = false;
     DG_OnSetFinaleText(finalestage, finaletext);
 }
 
@@ -203,18 +207,19 @@ void F_TextWrite(void)
     int cy;
 
     // erase the entire screen to a tiled background
-    src = W_CacheLumpName(finaleflat, PU_CACHE);
-    dest = I_VideoBuffer;
+    if (!V_RestoreScreenCache(&backgroundcache)) {
+        src = W_CacheLumpName(finaleflat, PU_CACHE);
+        dest = I_VideoBuffer;
 
-    for (y = 0; y < SCREENHEIGHT; y++) {
-        for (x = 0; x < SCREENWIDTH / 64; x++) {
-            memcpy(dest, src + ((y & 63) << 6), 64);
-            dest += 64;
-        }
-        if (SCREENWIDTH & 63) {
-            memcpy(dest, src + ((y & 63) << 6), SCREENWIDTH & 63);
-            dest += (SCREENWIDTH & 63);
+        // Each flat pixel covers 1 << hires by 1 << hires screen pixels.
+        for (y = 0; y < SCREENHEIGHT; y++) {
+            byte *row = src + (((y >> hires) & 63) << 6);
+
+            for (x = 0; x < SCREENWIDTH; x++)
+                *dest++ = row[(x >> hires) & 63];
         }
+
+        V_SaveScreenCache(&backgroundcache);
     }
 
     // draw some of the text onto the screen
@@ -247,7 +252,7 @@ void F_TextWrite(void)
         }
 
         w = SHORT(hu_font[c]->width);
-        if (cx + w > SCREENWIDTH)
+        if (cx + w > ORIGWIDTH)
             break;
         V_DrawPatch(cx, cy, hu_font[c]);
         cx += w;
@@ -286,7 +291,7 @@ castinfo_t castorder[] = {{CC_ZOMBIE, MT_POSSESSED},
 
 int castnum;
 int casttics;
-state_t *caststate;
+const state_t *caststate;
 boolean castdeath;
 int castframes;
 int castonmelee;
@@ -303,6 +308,7 @@ void F_StartCast(void)
     casttics = caststate->tics;
     castdeath = false;
     finalestage = F_STAGE_CAST;
+    backgroundcache.valid = false;
     castframes = 0;
     castonmelee = 0;
     castattacking = false;
@@ -527,7 +533,10 @@ void F_CastDrawer(void)
     patch_t *patch;
 
     // erase the entire screen to a background
-    V_DrawPatch(0, 0, W_CacheLumpName("BOSSBACK", PU_CACHE));
+    if (!V_RestoreScreenCache(&backgroundcache)) {
+        V_DrawPatch(0, 0, W_CacheLumpName("BOSSBACK", PU_CACHE));
+        V_SaveScreenCache(&backgroundcache);
+    }
 
     if (detached_ui)
         DG_DrawFinaleText(UINT16_MAX);
@@ -549,6 +558,8 @@ void F_CastDrawer(void)
 
 //
 // F_DrawPatchCol
+// x is in original resolution pixels;
+//  with hires, the column is scaled up to match.
 //
 void F_DrawPatchCol(int x, patch_t *patch, int col)
 {
@@ -557,19 +568,23 @@ void F_DrawPatchCol(int x, patch_t *patch, int col)
     byte *dest;
     byte *desttop;
     int count;
+    int i;
+    int sx;
 
     column = (column_t *)((byte *)patch + LONG(patch->columnofs[col]));
-    desttop = I_VideoBuffer + x;
+    desttop = I_VideoBuffer + (x << hires);
 
     // step through the posts in a column
     while (column->topdelta != 0xff) {
-        source = (byte *)column + 3;
-        dest = desttop + column->topdelta * SCREENWIDTH;
-        count = column->length;
-
-        while (count--) {
-            *dest = *source++;
-            dest += SCREENWIDTH;
+        for (sx = 0; sx < 1 << hires; sx++) {
+            source = (byte *)column + 3;
+            dest = desttop + sx + (column->topdelta * SCREENWIDTH << hires);
+            count = column->length << hires;
+
+            for (i = 0; i < count; i++) {
+                *dest = source[i >> hires];
+                dest += SCREENWIDTH;
+            }
         }
         column = (column_t *)((byte *)column + column->length + 4);
     }
@@ -597,7 +612,7 @@ void F_BunnyScroll(void)
     if (scrolled < 0)
         scrolled = 0;
 
-    for (x = 0; x < SCREENWIDTH; x++) {
+    for (x = 0; x < ORIGWIDTH; x++) {
         if (x + scrolled < 320)
             F_DrawPatchCol(x, p1, x + scrolled);
         else
@@ -607,7 +622,7 @@ void F_BunnyScroll(void)
     if (finalecount < 1130)
         return;
     if (finalecount < 1180) {
-        V_DrawPatch((SCREENWIDTH - 13 * 8) / 2, (SCREENHEIGHT - 8 * 8) / 2,
+        V_DrawPatch((ORIGWIDTH - 13 * 8) / 2, (ORIGHEIGHT - 8 * 8) / 2,
                     W_CacheLumpName("END0", PU_CACHE));
         laststage = 0;
         return;
@@ -622,7 +637,7 @@ void F_BunnyScroll(void)
     }
 
     snprintf(name, 10, "END%i", stage);
-    V_DrawPatch((SCREENWIDTH - 13 * 8) / 2, (SCREENHEIGHT - 8 * 8) / 2,
+    V_DrawPatch((ORIGWIDTH - 13 * 8) / 2, (ORIGHEIGHT - 8 * 8) / 2,
                 W_CacheLumpName(name, PU_CACHE));
 }
 
@@ -20,10 +20,10 @@
 
 #include "doomtype.h"
 #include "f_wipe.h"
+#include "i_system.h"
 #include "i_video.h"
 #include "m_random.h"
 #include "v_video.h"
-#include "z_zone.h"
 
 //
 //                       SCREEN WIPE PACKAGE
@@ -36,23 +36,6 @@ static byte *wipe_scr_start;
 static byte *wipe_scr_end;
 static byte *wipe_scr;
 
-void wipe_shittyColMajorXform(short *array, int width, int height)
-{
-    int x;
-    int y;
-    short *dest;
-
-    dest = (short *)Z_Malloc(width * height * 2, PU_STATIC, 0);
-
-    for (y = 0; y < height; y++)
-        for (x = 0; x < width; x++)
-            dest[x * height + y] = array[y * width + x];
-
-    memcpy(array, dest, width * height * 2);
-
-    Z_Free(dest);
-}
-
 int wipe_initColorXForm(int width, int height, int ticks)
 {
     (void)ticks;
@@ -106,7 +89,32 @@ int wipe_exitColorXForm(int width, int height, int ticks)
     return 0;
 }
 
+// The melt moves the screen in pairs of pixels. Adjacent pairs that moved
+// the same way during a wipe step are blitted together, one row at a time,
+// straight from the row-major start and end screens.
+typedef struct {
+    int x;      // first pixel column
+    int width;  // in pixels
+    int top;    // first row changed this step
+    int bottom; // rows above come from the end screen, rows below from start
+} meltrun_t;
+
 static int *y;
+static int *melttop;
+static meltrun_t *meltruns;
+
+// Allocated once and kept for later wipes.
+static void wipe_AllocBuffers(void)
+{
+    if (wipe_scr_start)
+        return;
+
+    wipe_scr_start = I_Realloc(NULL, SCREENWIDTH * SCREENHEIGHT);
+    wipe_scr_end = I_Realloc(NULL, SCREENWIDTH * SCREENHEIGHT);
+    y = I_Realloc(NULL, SCREENWIDTH * sizeof(*y));
+    melttop = I_Realloc(NULL, SCREENWIDTH / 2 * sizeof(*melttop));
+    meltruns = I_Realloc(NULL, SCREENWIDTH / 2 * sizeof(*meltruns));
+}
 
 int wipe_initMelt(int width, int height, int ticks)
 {
@@ -117,16 +125,11 @@ int wipe_initMelt(int width, int height, int ticks)
     // copy start screen to main screen
     memcpy(wipe_scr, wipe_scr_start, width * height);
 
-    // makes this wipe faster (in theory)
-    // to have stuff in column-major format
-    wipe_shittyColMajorXform((short *)wipe_scr_start, width / 2, height);
-    wipe_shittyColMajorXform((short *)wipe_scr_end, width / 2, height);
-
     // setup initial column positions
     // (y<0 => not ready to scroll yet)
-    y = (int *)Z_Malloc(width * sizeof(int), PU_STATIC, 0);
+    // With hires, these are picked for the original columns, then scaled.
     y[0] = -(M_Random() % 16);
-    for (i = 1; i < width; i++) {
+    for (i = 1; i < width >> hires; i++) {
         r = (M_Random() % 3) - 1;
         y[i] = y[i - 1] + r;
         if (y[i] > 0)
@@ -134,6 +137,10 @@ int wipe_initMelt(int width, int height, int ticks)
         else if (y[i] == -16)
             y[i] = -15;
     }
+    if (hires) {
+        for (i = width - 1; i >= 0; i--)
+            y[i] = y[i >> hires] << hires;
+    }
 
     return 0;
 }
@@ -141,45 +148,76 @@ int wipe_initMelt(int width, int height, int ticks)
 int wipe_doMelt(int width, int height, int ticks)
 {
     int i;
-    int j;
     int dy;
-    int idx;
-
-    short *s;
-    short *d;
+    int row;
+    int numruns;
+    int toprow;
+    byte *src;
+    byte *dest;
+    meltrun_t *run;
     boolean done = true;
 
-    width /= 2;
+    // Advance the columns for every tick first; only the final positions
+    // matter for what ends up on screen.
+    for (i = 0; i < width / 2; i++)
+        melttop[i] = height;
 
     while (ticks--) {
-        for (i = 0; i < width; i++) {
+        for (i = 0; i < width / 2; i++) {
             if (y[i] < 0) {
-                y[i]++;
+                y[i] += 1 << hires;
                 done = false;
             } else if (y[i] < height) {
-                dy = (y[i] < 16) ? y[i] + 1 : 8;
+                dy = (y[i] < 16 << hires) ? y[i] + (1 << hires) : 8 << hires;
                 if (y[i] + dy >= height)
                     dy = height - y[i];
-                s = &((short *)wipe_scr_end)[i * height + y[i]];
-                d = &((short *)wipe_scr)[y[i] * width + i];
-                idx = 0;
-                for (j = dy; j; j--) {
-                    d[idx] = *(s++);
-                    idx += width;
-                }
+                if (melttop[i] == height)
+                    melttop[i] = y[i];
                 y[i] += dy;
-                s = &((short *)wipe_scr_start)[i * height];
-                d = &((short *)wipe_scr)[y[i] * width + i];
-                idx = 0;
-                for (j = height - y[i]; j; j--) {
-                    d[idx] = *(s++);
-                    idx += width;
-                }
                 done = false;
             }
         }
     }
 
+    // Group the columns that moved into runs.
+    numruns = 0;
+    toprow = height;
+    for (i = 0; i < width / 2; i++) {
+        if (melttop[i] == height)
+            continue;
+
+        if (numruns > 0) {
+            run = &meltruns[numruns - 1];
+            if (run->x + run->width == i * 2 && run->top == melttop[i]
+                && run->bottom == y[i]) {
+                run->width += 2;
+                continue;
+            }
+        }
+
+        run = &meltruns[numruns++];
+        run->x = i * 2;
+        run->width = 2;
+        run->top = melttop[i];
+        run->bottom = y[i];
+        if (run->top < toprow)
+            toprow = run->top;
+    }
+
+    for (row = toprow; row < height; row++) {
+        dest = wipe_scr + row * width;
+        for (i = 0; i < numruns; i++) {
+            run = &meltruns[i];
+            if (row < run->top)
+                continue;
+            if (row < run->bottom)
+                src = wipe_scr_end + row * width;
+            else
+                src = wipe_scr_start + (row - run->bottom) * width;
+            memcpy(dest + run->x, src + run->x, run->width);
+        }
+    }
+
     return done;
 }
 
@@ -189,22 +227,18 @@ int wipe_exitMelt(int width, int height, int ticks)
     (void)height;
     (void)ticks;
 
-    Z_Free(y);
-    Z_Free(wipe_scr_start);
-    Z_Free(wipe_scr_end);
     return 0;
 }
 
 int wipe_StartScreen(void)
 {
-    wipe_scr_start = Z_Malloc(SCREENWIDTH * SCREENHEIGHT, PU_STATIC, NULL);
+    wipe_AllocBuffers();
     I_ReadScreen(wipe_scr_start);
     return 0;
 }
 
 int wipe_EndScreen(int x, int y, int width, int height)
 {
-    wipe_scr_end = Z_Malloc(SCREENWIDTH * SCREENHEIGHT, PU_STATIC, NULL);
     I_ReadScreen(wipe_scr_end);
     V_DrawBlock(x, y, width, height, wipe_scr_start); // restore start scr.
     return 0;
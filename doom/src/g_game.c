@@ -19,9 +19,12 @@
 #include <string.h>
 
 #include "am_map.h"
+#include "d_bench.h"
 #include "d_englsh.h"
 #include "d_loop.h"
 #include "d_main.h"
+#include "g_rewind.h"
+#include "g_seek.h"
 #include "doomdef.h"
 #include "doomstat.h"
 #include "f_finale.h"
@@ -33,11 +36,14 @@
 #include "m_controls.h"
 #include "m_menu.h"
 #include "m_misc.h"
+#include "m_profile.h"
 #include "m_random.h"
+#include "m_writer.h"
 #include "net_defs.h"
 #include "p_local.h"
 #include "p_saveg.h"
 #include "p_setup.h"
+#include "p_spec.h"
 #include "p_tick.h"
 #include "r_draw.h"
 #include "r_main.h"
@@ -73,6 +79,9 @@ void G_DoCompleted(void);
 void G_DoVictory(void);
 void G_DoWorldDone(void);
 void G_DoSaveGame(void);
+static void G_DoSaveSnapshot(void);
+static void G_DoLoadSnapshot(void);
+static boolean G_SnapshotResponder(int key);
 
 // Gamestate the last time G_Ticker was called.
 
@@ -97,6 +106,8 @@ boolean usergame;  // ok to save / end game
 boolean timingdemo; // if true, exit with report on completion
 boolean nodrawers;  // for comparative timing purposes
 int starttime;      // for comparative timing purposes
+boolean fastdemo;
+static uint64_t fastdemostart;
 
 boolean viewactive;
 
@@ -121,6 +132,16 @@ boolean netdemo;
 byte *demobuffer;
 byte *demo_p;
 byte *demoend;
+
+// A demo being recorded is streamed to its file as it goes: demobuffer only
+// holds what's been recorded since the last time it was passed on to the
+// writer, which is every second or so.
+#define DEMOBUFFERSIZE (16 * 1024)
+
+static writer_t *demowriter;
+static int demowritten; // bytes passed on to demowriter
+static int demoflushtic;
+static int demolimit; // for vanilla_demo_limit
 boolean singledemo; // quit after playing a demo from cmdline
 
 boolean precache = true; // if true, load all graphics at start
@@ -195,12 +216,12 @@ static boolean *joybuttons = &joyarray[1]; // allow [-1]
 static int savegameslot;
 static char savedescription[32];
 
-#define BODYQUESIZE 32
-
 mobj_t *bodyque[BODYQUESIZE];
 int bodyqueslot;
 
 int vanilla_savegame_limit = 1;
+int compressed_savegames = 1;
+int delta_savegames = 0;
 int vanilla_demo_limit = 1;
 
 int G_CmdChecksum(ticcmd_t *cmd)
@@ -560,6 +581,7 @@ void G_DoLoadLevel(void)
     }
 
     P_SetupLevel(gameepisode, gamemap);
+    G_ClearRewind();
     displayplayer = consoleplayer; // view the guy you are playing
     gameaction = ga_nothing;
     Z_CheckHeap();
@@ -641,6 +663,14 @@ boolean G_Responder(event_t *ev)
         return true;
     }
 
+    // rewinding works in demos too, scrubbing back through them
+    if (gamestate == GS_LEVEL && ev->type == ev_keydown
+        && ev->data1 == key_rewind && gameaction == ga_nothing
+        && G_CanRewind()) {
+        gameaction = ga_rewind;
+        return true;
+    }
+
     // any other key pops up menu if in demos
     if (gameaction == ga_nothing && !singledemo
         && (demoplayback || gamestate == GS_DEMOSCREEN)) {
@@ -695,6 +725,8 @@ boolean G_Responder(event_t *ev)
     case ev_keydown:
         if (ev->data1 == key_pause) {
             sendpause = true;
+        } else if (gamestate == GS_LEVEL && G_SnapshotResponder(ev->data1)) {
+            // taken or restored next tic
         } else if (ev->data1 < NUMKEYS) {
             gamekeydown[ev->data1] = true;
         }
@@ -735,6 +767,7 @@ void G_Ticker(void)
     int i;
     int buf;
     ticcmd_t *cmd;
+    char *shotmessage;
 
     // do player reborns if needed
     for (i = 0; i < MAXPLAYERS; i++)
@@ -769,15 +802,32 @@ void G_Ticker(void)
             G_DoWorldDone();
             break;
         case ga_screenshot:
+            R_FinishPlayerView(); // not half drawn
             V_ScreenShot("DOOM%02i.%s");
-            players[consoleplayer].message = "screen shot";
             gameaction = ga_nothing;
             break;
+        case ga_savesnapshot:
+            G_DoSaveSnapshot();
+            break;
+        case ga_loadsnapshot:
+            G_DoLoadSnapshot();
+            break;
+        case ga_rewind:
+            G_DoRewind();
+            break;
         case ga_nothing:
             break;
         }
     }
 
+    // report screenshots once they're written
+    shotmessage = V_ScreenShotWritten();
+    if (shotmessage != NULL)
+        players[consoleplayer].message = shotmessage;
+
+    if (demoplayback)
+        G_DemoSeekTicker();
+
     // get commands, check consistancy,
     // and build new consistancy check
     buf = (gametic / ticdup) % BACKUPTICS;
@@ -868,7 +918,12 @@ void G_Ticker(void)
     // do main actions
     switch (gamestate) {
     case GS_LEVEL:
+        D_BenchBegin(bench_playsim);
+        M_ProfileBegin(prof_ticker);
         P_Ticker();
+        M_ProfileEnd(prof_ticker);
+        D_BenchEnd(bench_playsim);
+        G_RewindTicker();
         ST_Ticker();
         AM_Ticker();
         HU_Ticker();
@@ -1189,6 +1244,8 @@ void G_DoCompleted(void)
     if (automapactive)
         AM_Stop();
 
+    Z_PrintStats();
+
     if (gamemode != commercial) {
         // Chex Quest ends after 5 levels, rather than 8.
 
@@ -1305,6 +1362,10 @@ void G_DoCompleted(void)
     StatCopy(&wminfo);
 
     WI_Start(&wminfo);
+
+    // The intermission leaves the disk idle for seconds; use them to read
+    // the next level.
+    P_PrefetchLevel(gameepisode, wminfo.next + 1);
 }
 
 //
@@ -1362,29 +1423,68 @@ void G_LoadGame(char *name)
 
 void G_DoLoadGame(void)
 {
-    int savedleveltime;
-
     gameaction = ga_nothing;
 
-    save_stream = fopen(savename, "rb");
-
-    if (save_stream == NULL) {
+    // Read the whole file at once, then parse it from memory.
+    if (!P_ReadSaveGame(savename)) {
         return;
     }
 
-    savegame_error = false;
+    G_ClearRewind();
+    G_UnArchiveGame(false);
+    savegame_delta = false;
+}
+
+//
+// G_ArchiveGame
+//
+void G_ArchiveGame(char *description)
+{
+    P_BeginSaveGame();
+
+    P_WriteSaveGameHeader(description);
+
+    P_ArchivePlayers();
+    P_ArchiveWorld();
+    P_ArchiveThinkers();
+    P_ArchiveSpecials();
+
+    P_WriteSaveGameEOF();
+}
+
+//
+// G_UnArchiveGame
+//
+void G_UnArchiveGame(boolean keeplevel)
+{
+    int savedleveltime;
+    int oldskill;
+    int oldepisode;
+    int oldmap;
+
+    oldskill = gameskill;
+    oldepisode = gameepisode;
+    oldmap = gamemap;
 
     if (!P_ReadSaveGameHeader()) {
-        fclose(save_stream);
         return;
     }
 
-    savedleveltime = leveltime;
+    if (keeplevel && gamestate == GS_LEVEL && gameskill == oldskill
+        && gameepisode == oldepisode && gamemap == oldmap) {
+        // Everything the archives don't put back is reset as it would
+        // be by P_SetupLevel; the thinkers are replaced.
+        bodyqueslot = 0;
+        iquehead = iquetail = 0;
+        P_ClearActiveSpecials();
+    } else {
+        savedleveltime = leveltime;
 
-    // load a base level
-    G_InitNew(gameskill, gameepisode, gamemap);
+        // load a base level
+        G_InitNew(gameskill, gameepisode, gamemap);
 
-    leveltime = savedleveltime;
+        leveltime = savedleveltime;
+    }
 
     // dearchive all the modifications
     P_UnArchivePlayers();
@@ -1395,8 +1495,6 @@ void G_DoLoadGame(void)
     if (!P_ReadSaveGameEOF())
         I_Error("Bad savegame");
 
-    fclose(save_stream);
-
     if (setsizeneeded)
         R_ExecuteSetViewSize();
 
@@ -1404,6 +1502,90 @@ void G_DoLoadGame(void)
     R_FillBackScreen();
 }
 
+//
+// In-memory snapshots of the level, for going back to over and over
+// when practising part of it. Each is a savegame kept in memory.
+//
+
+typedef struct {
+    byte *data; // NULL until taken
+    int length;
+    int size;
+} snapshot_t;
+
+static snapshot_t snapshots[arrlen(key_snapshot_save)];
+static int snapshotslot;
+static char snapshotmessage[32];
+
+static boolean G_SnapshotResponder(int key)
+{
+    unsigned int i;
+
+    // They'd break demo and network sync.
+    if (netgame || demorecording || demoplayback)
+        return false;
+
+    for (i = 0; i < arrlen(snapshots); i++) {
+        if (key != 0 && key == key_snapshot_save[i]) {
+            snapshotslot = i;
+            gameaction = ga_savesnapshot;
+            return true;
+        }
+        if (key != 0 && key == key_snapshot_load[i]) {
+            snapshotslot = i;
+            gameaction = ga_loadsnapshot;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void G_DoSaveSnapshot(void)
+{
+    snapshot_t *snapshot;
+    char description[SAVESTRINGSIZE] = "snapshot";
+
+    gameaction = ga_nothing;
+    snapshot = &snapshots[snapshotslot];
+
+    savegame_exact = true;
+    G_ArchiveGame(description);
+    savegame_exact = false;
+
+    if (save_length > snapshot->size) {
+        snapshot->data = I_Realloc(snapshot->data, save_length);
+        snapshot->size = save_length;
+    }
+    memcpy(snapshot->data, save_buffer, save_length);
+    snapshot->length = save_length;
+
+    M_snprintf(snapshotmessage, sizeof(snapshotmessage), "snapshot %i taken",
+               snapshotslot + 1);
+    players[consoleplayer].message = snapshotmessage;
+}
+
+static void G_DoLoadSnapshot(void)
+{
+    snapshot_t *snapshot;
+
+    gameaction = ga_nothing;
+    snapshot = &snapshots[snapshotslot];
+
+    if (snapshot->data == NULL) {
+        M_snprintf(snapshotmessage, sizeof(snapshotmessage),
+                   "no snapshot %i", snapshotslot + 1);
+        players[consoleplayer].message = snapshotmessage;
+        return;
+    }
+
+    G_ClearRewind();
+    P_ReadSaveGameBuffer(snapshot->data, snapshot->length);
+    savegame_exact = true;
+    G_UnArchiveGame(true);
+    savegame_exact = false;
+}
+
 //
 // G_SaveGame
 // Called by the menu task.
@@ -1421,11 +1603,16 @@ void G_DoSaveGame(void)
     char *savegame_file;
     char *temp_savegame_file;
     char *recovery_savegame_file;
+    FILE *save_stream;
 
     recovery_savegame_file = NULL;
     temp_savegame_file = P_TempSaveGameFile();
     savegame_file = P_SaveGameFile(savegameslot);
 
+    // The previous savegame may still be being written to the
+    // temporary file.
+    P_FinishSaveGameWrite();
+
     // Open the savegame file for writing.  We write to a temporary file
     // and then rename it at the end if it was successfully written.
     // This prevents an existing savegame from being overwritten by
@@ -1443,42 +1630,38 @@ void G_DoSaveGame(void)
         }
     }
 
-    savegame_error = false;
-
-    P_WriteSaveGameHeader(savedescription);
-
-    P_ArchivePlayers();
-    P_ArchiveWorld();
-    P_ArchiveThinkers();
-    P_ArchiveSpecials();
-
-    P_WriteSaveGameEOF();
+    // The savegame is put together in memory, then written out on
+    // another thread so the game doesn't wait on the disk.
+    savegame_delta = compressed_savegames && delta_savegames;
+    G_ArchiveGame(savedescription);
+    if (compressed_savegames)
+        P_CompressSaveGame();
+    savegame_delta = false;
 
     // Enforce the same savegame size limit as in Vanilla Doom,
-    // except if the vanilla_savegame_limit setting is turned off.
+    // except if the vanilla_savegame_limit setting is turned off;
+    // compressed savegames are held to it as they're written.
 
-    if (vanilla_savegame_limit && ftell(save_stream) > SAVEGAMESIZE) {
+    if (vanilla_savegame_limit && save_length > SAVEGAMESIZE) {
         I_Error("Savegame buffer overrun");
     }
 
-    // Finish up, close the savegame file.
-
-    fclose(save_stream);
-
     if (recovery_savegame_file != NULL) {
-        // We failed to save to the normal location, but we wrote a
-        // recovery file to the temp directory. Now we can bomb out
+        // We failed to save to the normal location, but we can write a
+        // recovery file to the temp directory. Then we can bomb out
         // with an error.
+        fwrite(save_buffer, 1, save_length, save_stream);
+        fclose(save_stream);
         I_Error("Failed to open savegame file '%s' for writing.\n"
                 "But your game has been saved to '%s' for recovery.",
                 temp_savegame_file, recovery_savegame_file);
     }
 
-    // Now rename the temporary savegame file to the actual savegame
-    // file, overwriting the old savegame if there was one there.
+    // Write and close the temporary savegame file, then rename it to
+    // the actual savegame file, overwriting the old savegame if there
+    // was one there.
 
-    remove(savegame_file);
-    rename(temp_savegame_file, savegame_file);
+    P_WriteSaveGame(save_stream, temp_savegame_file, savegame_file);
 
     gameaction = ga_nothing;
     M_StringCopy(savedescription, "", sizeof(savedescription));
@@ -1595,17 +1778,23 @@ void G_InitNew(skill_t skill, int episode, int map)
         respawnmonsters = false;
 
     if (fastparm || (skill == sk_nightmare && gameskill != sk_nightmare)) {
+        state_t *st = Info_WritableStates();
+        mobjinfo_t *info = Info_WritableMobjInfo();
+
         for (i = S_SARG_RUN1; i <= S_SARG_PAIN2; i++)
-            states[i].tics >>= 1;
-        mobjinfo[MT_BRUISERSHOT].speed = 20 * FRACUNIT;
-        mobjinfo[MT_HEADSHOT].speed = 20 * FRACUNIT;
-        mobjinfo[MT_TROOPSHOT].speed = 20 * FRACUNIT;
+            st[i].tics >>= 1;
+        info[MT_BRUISERSHOT].speed = 20 * FRACUNIT;
+        info[MT_HEADSHOT].speed = 20 * FRACUNIT;
+        info[MT_TROOPSHOT].speed = 20 * FRACUNIT;
     } else if (skill != sk_nightmare && gameskill == sk_nightmare) {
+        state_t *st = Info_WritableStates();
+        mobjinfo_t *info = Info_WritableMobjInfo();
+
         for (i = S_SARG_RUN1; i <= S_SARG_PAIN2; i++)
-            states[i].tics <<= 1;
-        mobjinfo[MT_BRUISERSHOT].speed = 15 * FRACUNIT;
-        mobjinfo[MT_HEADSHOT].speed = 10 * FRACUNIT;
-        mobjinfo[MT_TROOPSHOT].speed = 10 * FRACUNIT;
+            st[i].tics <<= 1;
+        info[MT_BRUISERSHOT].speed = 15 * FRACUNIT;
+        info[MT_HEADSHOT].speed = 10 * FRACUNIT;
+        info[MT_TROOPSHOT].speed = 10 * FRACUNIT;
     }
 
     // force players to be initialized upon first level load
@@ -1670,7 +1859,8 @@ void G_InitNew(skill_t skill, int episode, int map)
 
 void G_ReadDemoTiccmd(ticcmd_t *cmd)
 {
-    if (*demo_p == DEMOMARKER) {
+    // A demo whose recording was cut short by a crash has no end marker.
+    if (demoend - demo_p < (longtics ? 5 : 4) || *demo_p == DEMOMARKER) {
         // end of demo data stream
         G_CheckDemoStatus();
         return;
@@ -1690,36 +1880,30 @@ void G_ReadDemoTiccmd(ticcmd_t *cmd)
     cmd->buttons = (unsigned char)*demo_p++;
 }
 
-// Increase the size of the demo buffer to allow unlimited demos
+// Pass what's been recorded on to be written to the demo file.
 
-static void IncreaseDemoBuffer(void)
+static void FlushDemo(void)
 {
-    int current_length;
-    byte *new_demobuffer;
-    byte *new_demop;
-    int new_length;
-
-    // Find the current size
-
-    current_length = demoend - demobuffer;
-
-    // Generate a new buffer twice the size
-    new_length = current_length * 2;
-
-    new_demobuffer = Z_Malloc(new_length, PU_STATIC, 0);
-    new_demop = new_demobuffer + (demo_p - demobuffer);
-
-    // Copy over the old data
-
-    memcpy(new_demobuffer, demobuffer, current_length);
-
-    // Free the old buffer and point the demo pointers at the new buffer.
+    M_QueueWrite(demowriter, demobuffer, demo_p - demobuffer);
+    demowritten += demo_p - demobuffer;
+    demo_p = demobuffer;
+    demoflushtic = gametic;
+}
 
-    Z_Free(demobuffer);
+int G_DemoOffset(void)
+{
+    return demowritten + (demo_p - demobuffer);
+}
 
-    demobuffer = new_demobuffer;
-    demo_p = new_demop;
-    demoend = demobuffer + new_length;
+void G_SetDemoOffset(int offset)
+{
+    if (offset < demowritten) {
+        M_TruncateWriter(demowriter, offset);
+        demowritten = offset;
+        demo_p = demobuffer;
+    } else {
+        demo_p = demobuffer + (offset - demowritten);
+    }
 }
 
 void G_WriteDemoTiccmd(ticcmd_t *cmd)
@@ -1729,6 +1913,11 @@ void G_WriteDemoTiccmd(ticcmd_t *cmd)
     if (gamekeydown[key_demo_quit]) // press q to end demo recording
         G_CheckDemoStatus();
 
+    // Write out what's been recorded every second, so no more than that is
+    // lost if the game crashes.
+    if (gametic - demoflushtic >= TICRATE || demo_p > demoend - 16)
+        FlushDemo();
+
     demo_start = demo_p;
 
     *demo_p++ = cmd->forwardmove;
@@ -1748,17 +1937,11 @@ void G_WriteDemoTiccmd(ticcmd_t *cmd)
     // reset demo pointer back
     demo_p = demo_start;
 
-    if (demo_p > demoend - 16) {
-        if (vanilla_demo_limit) {
-            // no more space
-            G_CheckDemoStatus();
-            return;
-        } else {
-            // Vanilla demo limit disabled: unlimited
-            // demo lengths!
-
-            IncreaseDemoBuffer();
-        }
+    // With the Vanilla demo limit disabled, demo lengths are unlimited!
+    if (vanilla_demo_limit && G_DemoOffset() > demolimit - 16) {
+        // no more space
+        G_CheckDemoStatus();
+        return;
     }
 
     G_ReadDemoTiccmd(cmd); // make SURE it is exactly the same
@@ -1790,8 +1973,9 @@ void G_RecordDemo(char *name)
     i = M_CheckParmWithArgs("-maxdemo", 1);
     if (i)
         maxsize = atoi(myargv[i + 1]) * 1024;
-    demobuffer = Z_Malloc(maxsize, PU_STATIC, NULL);
-    demoend = demobuffer + maxsize;
+    demolimit = maxsize;
+    demobuffer = Z_Malloc(DEMOBUFFERSIZE, PU_STATIC, NULL);
+    demoend = demobuffer + DEMOBUFFERSIZE;
 
     demorecording = true;
 }
@@ -1831,6 +2015,12 @@ void G_BeginRecording(void)
 
     lowres_turn = !longtics;
 
+    demowriter = M_OpenWriter(demoname);
+    if (demowriter == NULL)
+        I_Error("G_BeginRecording: Couldn't open %s", demoname);
+    demowritten = 0;
+    demoflushtic = gametic;
+
     demo_p = demobuffer;
 
     // Save the right version code for this demo
@@ -1909,6 +2099,7 @@ void G_DoPlayDemo(void)
 
     gameaction = ga_nothing;
     demobuffer = demo_p = W_CacheLumpName(defdemoname, PU_STATIC);
+    demoend = demobuffer + W_LumpLength(W_GetNumForName(defdemoname));
 
     demoversion = *demo_p++;
 
@@ -1955,9 +2146,12 @@ void G_DoPlayDemo(void)
     G_InitNew(skill, episode, map);
     precache = true;
     starttime = I_GetTime();
+    fastdemostart = I_GetTimeUs();
 
     usergame = false;
     demoplayback = true;
+
+    G_StartDemoSeek(demobuffer, demoend - demobuffer, defdemoname);
 }
 
 //
@@ -1971,7 +2165,7 @@ void G_TimeDemo(char *name)
     // Disable rendering the screen entirely.
     //
 
-    nodrawers = M_CheckParm("-nodraw");
+    nodrawers = fastdemo || M_CheckParm("-nodraw");
 
     timingdemo = true;
     singletics = true;
@@ -1993,8 +2187,18 @@ void G_TimeDemo(char *name)
 boolean G_CheckDemoStatus(void)
 {
     int endtime;
+    uint64_t us;
 
-    if (timingdemo) {
+    if (timingdemo && fastdemo) {
+        us = I_GetTimeUs() - fastdemostart;
+        printf("fastdemo: %i tics in %.3fs: %.0f tics/s\n", gametic,
+               us / 1e6, gametic * 1e6 / (us ? us : 1));
+        timingdemo = false;
+        demoplayback = false;
+        I_Quit();
+    }
+
+    if (timingdemo && !benchmode) {
         float fps;
         int realtics;
 
@@ -2022,7 +2226,9 @@ boolean G_CheckDemoStatus(void)
         nomonsters = false;
         consoleplayer = 0;
 
-        if (singledemo)
+        if (benchmode)
+            D_BenchNextDemo();
+        else if (singledemo)
             I_Quit();
         else
             D_AdvanceDemo();
@@ -2032,9 +2238,11 @@ boolean G_CheckDemoStatus(void)
 
     if (demorecording) {
         *demo_p++ = DEMOMARKER;
-        M_WriteFile(demoname, demobuffer, demo_p - demobuffer);
-        Z_Free(demobuffer);
+        FlushDemo();
         demorecording = false;
+        if (!M_CloseWriter(demowriter))
+            I_Error("Failed to write demo %s", demoname);
+        Z_Free(demobuffer);
         I_Error("Demo %s recorded", demoname);
     }
 
@@ -43,6 +43,12 @@ void G_LoadGame(char *name);
 
 void G_DoLoadGame(void);
 
+// Put the game together as a savegame in memory, or load it from the one in
+// memory (see p_saveg.h). If keeplevel is set and the savegame is of the
+// level being played, that's reused as it is rather than loaded again.
+void G_ArchiveGame(char *description);
+void G_UnArchiveGame(boolean keeplevel);
+
 // Called by M_Responder.
 void G_SaveGame(int slot, char *description);
 
@@ -55,6 +61,12 @@ void G_PlayDemo(char *name);
 void G_TimeDemo(char *name);
 boolean G_CheckDemoStatus(void);
 
+// How far into the demo being played back or recorded demo_p is, counting
+// what has already been written out, and moving it back there, which drops
+// anything recorded since.
+int G_DemoOffset(void);
+void G_SetDemoOffset(int offset);
+
 void G_ExitLevel(void);
 void G_SecretExitLevel(void);
 
@@ -73,5 +85,7 @@ void G_DrawMouseSpeedBox(void);
 int G_VanillaVersionCode(void);
 
 extern int vanilla_savegame_limit;
+extern int compressed_savegames;
+extern int delta_savegames;
 extern int vanilla_demo_limit;
 #endif
@@ -0,0 +1,501 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "d_main.h"
+#include "d_player.h"
+#include "doomgeneric_deflate.h"
+#include "doomstat.h"
+#include "g_game.h"
+#include "g_rewind.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_inflate.h"
+#include "m_misc.h"
+#include "p_local.h"
+#include "p_saveg.h"
+#include "p_tick.h"
+#include "s_sound.h"
+
+// How far G_DoRewind goes back.
+#define REWINDTICS TICRATE
+
+// Shortest run of bytes a delta copies rather than stores.
+#define MINMATCH 8
+
+int rewind_interval = TICRATE;
+int rewind_memory = 4096;
+
+extern boolean timingdemo;
+
+typedef struct {
+    int leveltime;
+    int demooffset; // of demo_p, when playing or recording a demo
+
+    // The newest point's snapshot whole, and each other's as a delta from
+    // the snapshot of the point after it, compressed, which is deltalength
+    // bytes once inflated.
+    byte *data;
+    int length;
+    int deltalength;
+} rewindpoint_t;
+
+typedef struct {
+    ticcmd_t cmd;
+    int demooffset; // once the ticcmd had been read or written
+} rewindtic_t;
+
+static rewindpoint_t *points;
+static int numpoints;
+static int maxpoints;
+
+// The tics run since the oldest point: tics[i] took the level from
+// points[0].leveltime + i.
+static rewindtic_t *tics;
+static int numtics;
+static int maxtics;
+
+// Bytes of snapshots, deltas and tics kept.
+static int memoryused;
+
+// Where snapshots are made from deltas, and deltas from snapshots.
+static byte *snapshotbufs[2];
+static int snapshotsizes[2];
+static byte *deltabuf;
+static int deltasize;
+static byte *packbuf;
+static int packsize;
+static int *matchtable;
+static int matchbits;
+
+static char rewindmessage[32];
+
+static void Reserve(byte **buf, int *size, int needed)
+{
+    if (needed > *size) {
+        *size = needed;
+        *buf = I_Realloc(*buf, *size);
+    }
+}
+
+//
+// Deltas
+//
+// A delta makes one snapshot from another, the reference: the snapshot's
+// length and then runs of literal bytes, each followed by how far the
+// shift into the reference changes and how many bytes to copy from the
+// reference at that shift, all as varints. Mobjs coming and going move
+// everything archived after them along, hence the shift.
+//
+
+static byte *WriteVarint(byte *p, unsigned int value)
+{
+    while (value >= 0x80) {
+        *p++ = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    *p++ = value;
+    return p;
+}
+
+static const byte *ReadVarint(const byte *p, const byte *end,
+                              unsigned int *value)
+{
+    int shift;
+
+    *value = 0;
+    shift = 0;
+    do {
+        if (p == end || shift > 28)
+            I_Error("G_DoRewind: Bad delta");
+        *value |= (unsigned int)(*p & 0x7f) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+
+    return p;
+}
+
+static int MatchLength(const byte *ref, int reflen, const byte *src,
+                       int srclen, int pos, int shift)
+{
+    int n;
+
+    if (pos + shift < 0)
+        return 0;
+
+    n = 0;
+    while (pos + n < srclen && pos + shift + n < reflen
+           && src[pos + n] == ref[pos + shift + n]) {
+        n++;
+    }
+    return n;
+}
+
+static unsigned int HashMatch(const byte *p)
+{
+    uint32_t a;
+    uint32_t b;
+
+    memcpy(&a, p, 4);
+    memcpy(&b, p + 4, 4);
+    return ((a * 0x9e3779b1u) ^ (b * 0x85ebca77u)) >> (32 - matchbits);
+}
+
+//
+// EncodeDelta
+// Make the delta from ref to src in deltabuf, returning its length.
+//
+static int EncodeDelta(const byte *ref, int reflen, const byte *src,
+                       int srclen)
+{
+    byte *p;
+    int tablesize;
+    int pos;
+    int litstart;
+    int shift;
+    int lastshift;
+    int change;
+    int candidate;
+    int n;
+    int i;
+
+    // Each run copies at least MINMATCH bytes, so this is the worst case.
+    Reserve(&deltabuf, &deltasize, srclen * 3 + 32);
+
+    // Index the reference by the bytes at each 4-byte boundary, where
+    // mobjs and almost every field start.
+    tablesize = 1 << matchbits;
+    if (matchtable == NULL || tablesize < reflen / 4) {
+        matchbits = 10;
+        while ((1 << matchbits) < reflen / 4)
+            matchbits++;
+        tablesize = 1 << matchbits;
+        matchtable = I_Realloc(matchtable, tablesize * sizeof(*matchtable));
+    }
+    for (i = 0; i < tablesize; i++)
+        matchtable[i] = -1;
+    for (i = 0; i + MINMATCH <= reflen; i += 4)
+        matchtable[HashMatch(ref + i)] = i;
+
+    p = WriteVarint(deltabuf, srclen);
+    pos = litstart = 0;
+    shift = lastshift = 0;
+
+    while (pos < srclen) {
+        n = MatchLength(ref, reflen, src, srclen, pos, shift);
+
+        if (n < MINMATCH && pos % 4 == 0 && pos + MINMATCH <= srclen) {
+            candidate = matchtable[HashMatch(src + pos)];
+            if (candidate >= 0 && candidate - pos != shift) {
+                i = MatchLength(ref, reflen, src, srclen, pos,
+                                candidate - pos);
+                if (i >= MINMATCH) {
+                    shift = candidate - pos;
+                    n = i;
+                }
+            }
+        }
+
+        if (n < MINMATCH) {
+            pos++;
+            continue;
+        }
+
+        change = shift - lastshift;
+        lastshift = shift;
+
+        p = WriteVarint(p, pos - litstart);
+        memcpy(p, src + litstart, pos - litstart);
+        p += pos - litstart;
+        p = WriteVarint(p, change >= 0 ? (unsigned int)change * 2
+                                       : (unsigned int)-change * 2 - 1);
+        p = WriteVarint(p, n);
+
+        pos += n;
+        litstart = pos;
+    }
+
+    if (litstart < srclen) {
+        p = WriteVarint(p, srclen - litstart);
+        memcpy(p, src + litstart, srclen - litstart);
+        p += srclen - litstart;
+        p = WriteVarint(p, 0);
+        p = WriteVarint(p, 0);
+    }
+
+    return p - deltabuf;
+}
+
+// The length of the snapshot a delta makes.
+static int DeltaLength(const byte *delta, int deltalen)
+{
+    unsigned int length;
+
+    ReadVarint(delta, delta + deltalen, &length);
+    return length;
+}
+
+//
+// ApplyDelta
+// Make the snapshot the delta from ref makes in out, which must be
+// DeltaLength bytes.
+//
+static void ApplyDelta(const byte *ref, int reflen, const byte *delta,
+                       int deltalen, byte *out)
+{
+    const byte *p;
+    const byte *end;
+    unsigned int length;
+    unsigned int pos;
+    unsigned int n;
+    int shift;
+
+    p = delta;
+    end = delta + deltalen;
+    p = ReadVarint(p, end, &length);
+    pos = 0;
+    shift = 0;
+
+    while (pos < length) {
+        p = ReadVarint(p, end, &n);
+        if (n > length - pos || n > (unsigned int)(end - p))
+            I_Error("G_DoRewind: Bad delta");
+        memcpy(out + pos, p, n);
+        p += n;
+        pos += n;
+
+        p = ReadVarint(p, end, &n);
+        shift += (n & 1) ? -(int)((n + 1) / 2) : (int)(n / 2);
+
+        p = ReadVarint(p, end, &n);
+        if (n > length - pos
+            || (n > 0
+                && ((int)pos + shift < 0 || (int)(pos + n) + shift > reflen))) {
+            I_Error("G_DoRewind: Bad delta");
+        }
+        memcpy(out + pos, ref + pos + shift, n);
+        pos += n;
+    }
+}
+
+//
+// Rewinding
+//
+
+static boolean RewindAllowed(void)
+{
+    // It would break network sync, and be timed with the demo.
+    return gamestate == GS_LEVEL && !netgame && !timingdemo
+           && rewind_interval > 0 && rewind_memory > 0;
+}
+
+static int DemoOffset(void)
+{
+    return demoplayback || demorecording ? G_DemoOffset() : 0;
+}
+
+void G_ClearRewind(void)
+{
+    int i;
+
+    for (i = 0; i < numpoints; i++)
+        free(points[i].data);
+
+    numpoints = 0;
+    numtics = 0;
+    memoryused = 0;
+}
+
+static void DropOldestPoint(void)
+{
+    int dropped;
+
+    dropped = points[1].leveltime - points[0].leveltime;
+
+    memoryused -= points[0].length + dropped * (int)sizeof(*tics);
+    free(points[0].data);
+
+    numpoints--;
+    memmove(points, points + 1, numpoints * sizeof(*points));
+    numtics -= dropped;
+    memmove(tics, tics + dropped, numtics * sizeof(*tics));
+}
+
+static void TakePoint(void)
+{
+    char description[SAVESTRINGSIZE] = "rewind";
+    rewindpoint_t *point;
+    int length;
+    int packed;
+
+    savegame_exact = true;
+    G_ArchiveGame(description);
+    savegame_exact = false;
+
+    // What was the newest snapshot is kept as a delta from this one.
+    if (numpoints > 0) {
+        point = &points[numpoints - 1];
+        length =
+            EncodeDelta(save_buffer, save_length, point->data, point->length);
+        Reserve(&packbuf, &packsize, DEFLATE_BOUND(length));
+        packed = Deflate_Zlib(deltabuf, length, packbuf);
+        point->data = I_Realloc(point->data, packed);
+        memcpy(point->data, packbuf, packed);
+        memoryused += packed - point->length;
+        point->length = packed;
+        point->deltalength = length;
+    }
+
+    if (numpoints == maxpoints) {
+        maxpoints = maxpoints ? maxpoints * 2 : 64;
+        points = I_Realloc(points, maxpoints * sizeof(*points));
+    }
+
+    point = &points[numpoints++];
+    point->leveltime = leveltime;
+    point->demooffset = DemoOffset();
+    point->data = I_Realloc(NULL, save_length);
+    memcpy(point->data, save_buffer, save_length);
+    point->length = save_length;
+    point->deltalength = 0;
+    memoryused += save_length;
+
+    while (numpoints > 1 && memoryused / 1024 >= rewind_memory)
+        DropOldestPoint();
+}
+
+void G_RewindTicker(void)
+{
+    rewindtic_t *tic;
+
+    if (!RewindAllowed()) {
+        G_ClearRewind();
+        return;
+    }
+
+    if (numpoints > 0) {
+        // Paused, or in the menu.
+        if (leveltime == points[0].leveltime + numtics)
+            return;
+
+        // Loaded or otherwise moved on without running the tic.
+        if (leveltime != points[0].leveltime + numtics + 1)
+            G_ClearRewind();
+    }
+
+    if (numpoints > 0) {
+        if (numtics == maxtics) {
+            maxtics = maxtics ? maxtics * 2 : 1024;
+            tics = I_Realloc(tics, maxtics * sizeof(*tics));
+        }
+
+        tic = &tics[numtics++];
+        tic->cmd = players[consoleplayer].cmd;
+        tic->demooffset = DemoOffset();
+        memoryused += sizeof(*tic);
+    }
+
+    if (numpoints == 0
+        || leveltime - points[numpoints - 1].leveltime >= rewind_interval) {
+        TakePoint();
+    }
+}
+
+boolean G_CanRewind(void)
+{
+    return RewindAllowed() && numpoints > 0
+           && leveltime > points[0].leveltime;
+}
+
+void G_DoRewind(void)
+{
+    rewindpoint_t *point;
+    const byte *snapshot;
+    boolean waspaused;
+    int length;
+    int newlength;
+    int target;
+    int base;
+    int buf;
+    int i;
+    int k;
+
+    gameaction = ga_nothing;
+
+    if (!G_CanRewind())
+        return;
+
+    base = points[0].leveltime;
+    target = leveltime - REWINDTICS;
+    if (target < base)
+        target = base;
+
+    for (k = numpoints - 1; points[k].leveltime > target; k--)
+        ;
+    point = &points[k];
+
+    // Make its snapshot from the newest through the deltas in between.
+    snapshot = points[numpoints - 1].data;
+    length = points[numpoints - 1].length;
+    buf = 0;
+    for (i = numpoints - 2; i >= k; i--) {
+        Reserve(&deltabuf, &deltasize, points[i].deltalength);
+        if (!M_InflateZlib(points[i].data, points[i].length, deltabuf,
+                           points[i].deltalength)) {
+            I_Error("G_DoRewind: Bad delta");
+        }
+        newlength = DeltaLength(deltabuf, points[i].deltalength);
+        Reserve(&snapshotbufs[buf], &snapshotsizes[buf], newlength);
+        ApplyDelta(snapshot, length, deltabuf, points[i].deltalength,
+                   snapshotbufs[buf]);
+        snapshot = snapshotbufs[buf];
+        length = newlength;
+        buf ^= 1;
+    }
+
+    P_ReadSaveGameBuffer(snapshot, length);
+
+    // Forget what came after; the point is now the newest, kept whole.
+    for (i = k + 1; i < numpoints; i++) {
+        memoryused -= points[i].length;
+        free(points[i].data);
+    }
+    numpoints = k + 1;
+
+    if (point->length != length || point->data != snapshot) {
+        memoryused += length - point->length;
+        point->data = I_Realloc(point->data, length);
+        memcpy(point->data, save_buffer, length);
+        point->length = length;
+        point->deltalength = 0;
+    }
+
+    savegame_exact = true;
+    G_UnArchiveGame(true);
+    savegame_exact = false;
+
+    // Run on from the point to the tic being rewound to, as it was run.
+    waspaused = paused;
+    paused = false;
+    for (i = point->leveltime - base; i < target - base; i++) {
+        players[consoleplayer].cmd = tics[i].cmd;
+        P_Ticker();
+    }
+    paused = waspaused;
+
+    if (demoplayback || demorecording) {
+        G_SetDemoOffset(target > point->leveltime
+                            ? tics[target - base - 1].demooffset
+                            : point->demooffset);
+    }
+
+    memoryused -= (numtics - (target - base)) * (int)sizeof(*tics);
+    numtics = target - base;
+
+    // Not the sounds of the tics run over again.
+    S_StopSounds();
+
+    M_snprintf(rewindmessage, sizeof(rewindmessage), "rewound to %i:%02i",
+               target / TICRATE / 60, target / TICRATE % 60);
+    players[consoleplayer].message = rewindmessage;
+}
@@ -0,0 +1,28 @@
+#ifndef __G_REWIND__
+#define __G_REWIND__
+
+#include "doomtype.h"
+
+// Rewinding the level as it's played, or as a demo plays or is recorded.
+// An exact snapshot is taken every rewind_interval tics, and the ticcmds run
+// since kept, so any tic since the oldest snapshot can be gone back to by
+// running the playsim on from the one before. All but the newest snapshot
+// are kept as deltas from the one after, in at most rewind_memory KB.
+
+extern int rewind_interval;
+extern int rewind_memory;
+
+// Forget everything there is to rewind to, when the level is changed or
+// loaded.
+void G_ClearRewind(void);
+
+// Called after each tic of the level is run.
+void G_RewindTicker(void);
+
+// Whether there's anything to rewind to.
+boolean G_CanRewind(void);
+
+// Go back a second, for ga_rewind.
+void G_DoRewind(void);
+
+#endif
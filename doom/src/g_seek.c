@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomstat.h"
+#include "g_game.h"
+#include "g_rewind.h"
+#include "g_seek.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "p_saveg.h"
+#include "s_sound.h"
+#include "sha1.h"
+#include "w_checksum.h"
+#include "z_zone.h"
+
+// How often a snapshot is taken for the index.
+#define SEEKINTERVAL (30 * TICRATE)
+
+// Bumped whenever exact savegames change, to have old indexes rebuilt.
+#define SEEKVERSION 1
+
+// An index is this header, then each snapshot's tic, demo offset and length
+// and the snapshot itself, all little-endian.
+#define SEEKMAGIC "DOOMSEEK"
+#define HEADERSIZE (8 + 4 + 2 * sizeof(sha1_digest_t) + 4)
+#define ENTRYHEADERSIZE 12
+
+typedef struct {
+    int tic;
+    int demooffset;
+    byte *data;
+    int length;
+} seekentry_t;
+
+static boolean enabled;
+static char *demofile;
+static char *indexfile;
+
+// The index is only used with the demo and WADs it was made with.
+static sha1_digest_t demosum;
+static sha1_digest_t wadsum;
+static int demolength;
+
+static seekentry_t *entries;
+static int numentries;
+static int maxentries;
+static int numread; // of entries, from the index file
+
+// Tics of the demo run so far, and where -seek is going to, or -1.
+static int demotic;
+static int seektic = -1;
+
+static void PutInt(byte *p, int value)
+{
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = (value >> 24) & 0xff;
+}
+
+static int GetInt(const byte *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static void AddEntry(int tic, int demooffset, const byte *data, int length)
+{
+    seekentry_t *entry;
+
+    if (numentries == maxentries) {
+        maxentries = maxentries ? maxentries * 2 : 64;
+        entries = I_Realloc(entries, maxentries * sizeof(*entries));
+    }
+
+    entry = &entries[numentries++];
+    entry->tic = tic;
+    entry->demooffset = demooffset;
+    entry->data = I_Realloc(NULL, length);
+    memcpy(entry->data, data, length);
+    entry->length = length;
+}
+
+static void ReadIndex(void)
+{
+    byte *buf;
+    int length;
+    int count;
+    int pos;
+    int tic;
+    int demooffset;
+    int entrylength;
+    int i;
+
+    if (!M_FileExists(indexfile))
+        return;
+
+    length = M_ReadFile(indexfile, &buf);
+
+    // Made for something else: it's rebuilt.
+    if (length < (int)HEADERSIZE || memcmp(buf, SEEKMAGIC, 8) != 0
+        || GetInt(buf + 8) != SEEKVERSION
+        || memcmp(buf + 12, demosum, sizeof(demosum)) != 0
+        || memcmp(buf + 12 + sizeof(demosum), wadsum, sizeof(wadsum)) != 0) {
+        Z_Free(buf);
+        return;
+    }
+
+    count = GetInt(buf + HEADERSIZE - 4);
+    pos = HEADERSIZE;
+    for (i = 0; i < count; i++) {
+        if (length - pos < ENTRYHEADERSIZE)
+            break;
+        tic = GetInt(buf + pos);
+        demooffset = GetInt(buf + pos + 4);
+        entrylength = GetInt(buf + pos + 8);
+        pos += ENTRYHEADERSIZE;
+
+        if (entrylength < 0 || entrylength > length - pos || demooffset < 0
+            || demooffset > demolength) {
+            break;
+        }
+        AddEntry(tic, demooffset, buf + pos, entrylength);
+        pos += entrylength;
+    }
+
+    // A damaged index is written again whole.
+    numread = i == count ? numentries : 0;
+
+    Z_Free(buf);
+}
+
+static void WriteIndex(void)
+{
+    byte *buf;
+    byte *p;
+    int length;
+    int i;
+
+    if (numentries <= numread)
+        return;
+
+    length = HEADERSIZE;
+    for (i = 0; i < numentries; i++)
+        length += ENTRYHEADERSIZE + entries[i].length;
+
+    buf = I_Realloc(NULL, length);
+    memcpy(buf, SEEKMAGIC, 8);
+    PutInt(buf + 8, SEEKVERSION);
+    memcpy(buf + 12, demosum, sizeof(demosum));
+    memcpy(buf + 12 + sizeof(demosum), wadsum, sizeof(wadsum));
+    PutInt(buf + HEADERSIZE - 4, numentries);
+
+    p = buf + HEADERSIZE;
+    for (i = 0; i < numentries; i++) {
+        PutInt(p, entries[i].tic);
+        PutInt(p + 4, entries[i].demooffset);
+        PutInt(p + 8, entries[i].length);
+        memcpy(p + ENTRYHEADERSIZE, entries[i].data, entries[i].length);
+        p += ENTRYHEADERSIZE + entries[i].length;
+    }
+
+    if (!M_WriteFile(indexfile, buf, length))
+        fprintf(stderr, "WriteIndex: Failed to write %s\n", indexfile);
+
+    free(buf);
+}
+
+void G_InitDemoSeek(const char *file)
+{
+    const char *arg;
+    int minutes;
+    int seconds;
+    int p;
+
+    enabled = true;
+    if (file != NULL)
+        demofile = M_StringDuplicate(file);
+
+    //!
+    // @arg <tic>
+    // @category demo
+    //
+    // Start the demo given with -playdemo or -fastdemo this far in, as tics
+    // or minutes:seconds. The first time a demo is played back, an index is
+    // kept beside it (as <demo>.lmp.idx) to make this quick.
+    //
+
+    p = M_CheckParmWithArgs("-seek", 1);
+    if (p) {
+        arg = myargv[p + 1];
+        if (sscanf(arg, "%d:%d", &minutes, &seconds) == 2)
+            seektic = (minutes * 60 + seconds) * TICRATE;
+        else
+            seektic = atoi(arg);
+    }
+
+    // Including what was indexed when quitting partway through the demo.
+    I_AtExit(WriteIndex, false);
+}
+
+void G_StartDemoSeek(const byte *demo, int length, const char *lumpname)
+{
+    sha1_context_t context;
+
+    demotic = 0;
+
+    if (!enabled || indexfile != NULL)
+        return;
+
+    SHA1_Init(&context);
+    SHA1_Update(&context, (byte *)demo, length);
+    SHA1_Final(demosum, &context);
+    W_Checksum(wadsum);
+    demolength = length;
+
+    // Demos inside WADs have theirs kept with the savegames.
+    if (demofile != NULL)
+        indexfile = M_StringJoin(demofile, ".idx", NULL);
+    else
+        indexfile = M_StringJoin(savegamedir, lumpname, ".lmp.idx", NULL);
+
+    ReadIndex();
+}
+
+void G_DemoSeekTicker(void)
+{
+    char description[SAVESTRINGSIZE] = "seek";
+    int next;
+
+    if (enabled && gamestate == GS_LEVEL) {
+        next = numentries > 0 ? entries[numentries - 1].tic : 0;
+        if (demotic >= next + SEEKINTERVAL) {
+            savegame_exact = true;
+            G_ArchiveGame(description);
+            savegame_exact = false;
+            AddEntry(demotic, G_DemoOffset(), save_buffer, save_length);
+        }
+    }
+
+    demotic++;
+}
+
+void G_SeekDemo(void)
+{
+    seekentry_t *entry;
+    int target;
+    int i;
+
+    if (seektic < 0 || !demoplayback)
+        return;
+
+    target = seektic;
+    seektic = -1;
+
+    // Go to the last snapshot before the tic, if that's ahead.
+    entry = NULL;
+    for (i = 0; i < numentries && entries[i].tic <= target; i++)
+        entry = &entries[i];
+
+    if (entry != NULL && entry->tic > demotic) {
+        G_ClearRewind();
+        P_ReadSaveGameBuffer(entry->data, entry->length);
+        precache = false;
+        savegame_exact = true;
+        G_UnArchiveGame(true);
+        savegame_exact = false;
+        precache = true;
+
+        // Loading another level with G_InitNew stops demo playback.
+        demoplayback = true;
+        usergame = false;
+
+        G_SetDemoOffset(entry->demooffset);
+        demotic = entry->tic;
+    }
+
+    // Run on to the tic with nothing drawn, as with -fastdemo. Where the
+    // demo ends first, G_CheckDemoStatus quits.
+    while (demoplayback && demotic < target)
+        G_Ticker();
+
+    // Not the sounds of the tics run.
+    S_StopSounds();
+}
@@ -0,0 +1,24 @@
+#ifndef __G_SEEK__
+#define __G_SEEK__
+
+#include "doomtype.h"
+
+// Seeking the demo played back from the command line to any tic, with
+// -seek. The first time a demo is played back, an exact snapshot of it is
+// taken every so often and kept in an index file beside it; seeking restores
+// the last one before the tic and only runs the playsim on from there.
+
+// Called for -playdemo and -fastdemo, with the demo's file or NULL if it's a
+// lump of a WAD.
+void G_InitDemoSeek(const char *demofile);
+
+// Called by G_DoPlayDemo once the demo has started.
+void G_StartDemoSeek(const byte *demo, int length, const char *lumpname);
+
+// Called just before each tic's ticcmds are read from the demo.
+void G_DemoSeekTicker(void);
+
+// Called after each tic is run, to seek once the demo has started.
+void G_SeekDemo(void);
+
+#endif
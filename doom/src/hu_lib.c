@@ -84,19 +84,19 @@ void HUlib_drawTextLine(hu_textline_t *l, boolean drawcursor)
         c = toupper((int)l->l[i]);
         if (c != ' ' && c >= l->sc && c <= '_') {
             w = SHORT(l->f[c - l->sc]->width);
-            if (x + w > SCREENWIDTH)
+            if (x + w > ORIGWIDTH)
                 break;
             V_DrawPatchDirect(x, l->y, l->f[c - l->sc]);
             x += w;
         } else {
             x += 4;
-            if (x >= SCREENWIDTH)
+            if (x >= ORIGWIDTH)
                 break;
         }
     }
 
     // draw the cursor if requested
-    if (drawcursor && x + SHORT(l->f['_' - l->sc]->width) <= SCREENWIDTH) {
+    if (drawcursor && x + SHORT(l->f['_' - l->sc]->width) <= ORIGWIDTH) {
         V_DrawPatchDirect(x, l->y, l->f['_' - l->sc]);
     }
 }
@@ -113,9 +113,10 @@ void HUlib_eraseTextLine(hu_textline_t *l)
     // (because of a recent change back from the automap)
 
     if (!automapactive && viewwindowx && l->needsupdate) {
+        // Erased in screen rows, which are scaled with hires.
         lh = SHORT(l->f[0]->height) + 1;
-        for (y = l->y, yoffset = y * SCREENWIDTH; y < l->y + lh;
-             y++, yoffset += SCREENWIDTH) {
+        for (y = l->y << hires, yoffset = y * SCREENWIDTH;
+             y < (l->y + lh) << hires; y++, yoffset += SCREENWIDTH) {
             if (y < viewwindowy || y >= viewwindowy + viewheight)
                 R_VideoErase(yoffset, SCREENWIDTH); // erase entire line
             else {
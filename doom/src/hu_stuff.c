@@ -30,6 +30,7 @@
 #include "r_main.h"
 #include "s_sound.h"
 #include "sounds.h"
+#include "v_video.h"
 #include "w_wad.h"
 #include "z_zone.h"
 
@@ -156,6 +157,7 @@ void HU_Init(void)
         assert(len < 9);
         (void)len;
         hu_font[i] = (patch_t *)W_CacheLumpName(buffer, PU_STATIC);
+        V_CachePatchSpans(hu_font[i]);
     }
 }
 
@@ -0,0 +1,89 @@
+#include <stdio.h>
+
+#include "i_cpu.h"
+#include "i_video.h"
+#include "m_argv.h"
+#include "r_draw.h"
+
+int cpufeatures;
+int cpufeaturesused;
+
+static const struct {
+    int feature;
+    const char *name;
+} featurenames[] = {
+    {CPU_SSE2, "SSE2"},
+    {CPU_SSSE3, "SSSE3"},
+    {CPU_AVX2, "AVX2"},
+    {CPU_NEON, "NEON"},
+};
+
+static int DetectFeatures(void)
+{
+    int features = 0;
+
+#ifdef I_CPU_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        features |= CPU_SSE2;
+    if (__builtin_cpu_supports("ssse3"))
+        features |= CPU_SSSE3;
+    // Also checks the OS saves the AVX registers.
+    if (__builtin_cpu_supports("avx2"))
+        features |= CPU_AVX2;
+#elif defined(__ARM_NEON)
+    features |= CPU_NEON;
+#endif
+
+    return features;
+}
+
+static const char *FeatureName(int feature)
+{
+    size_t i;
+
+    for (i = 0; i < arrlen(featurenames); i++) {
+        if (featurenames[i].feature == feature)
+            return featurenames[i].name;
+    }
+
+    return "generic";
+}
+
+static void PrintFeatures(int features)
+{
+    size_t i;
+
+    if (features == 0)
+        printf(" none");
+
+    for (i = 0; i < arrlen(featurenames); i++) {
+        if (features & featurenames[i].feature)
+            printf(" %s", featurenames[i].name);
+    }
+}
+
+void I_InitCPU(void)
+{
+    int spans;
+    int expand;
+
+    //!
+    // @category obscure
+    //
+    // Don't use SIMD variants of kernels, like drawing spans and expanding
+    // frames to RGB, even if the CPU supports them.
+    //
+
+    if (!M_ParmExists("-nosimd"))
+        cpufeatures = DetectFeatures();
+
+    spans = R_InstallSpanDrawer();
+    expand = I_InstallFrameExpander();
+    cpufeaturesused = spans | expand;
+
+    printf("I_InitCPU: CPU features:");
+    PrintFeatures(cpufeatures);
+    printf("; spans %s, frame expansion %s\n", FeatureName(spans),
+           FeatureName(expand));
+}
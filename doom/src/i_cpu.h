@@ -0,0 +1,32 @@
+#ifndef __I_CPU__
+#define __I_CPU__
+
+#include "doomtype.h"
+
+// Kernels with SIMD variants, like drawing spans and expanding frames to RGB,
+// are called through function pointers, installed once at startup by
+// I_InitCPU for the best variant the CPU runs; the binary itself is built for
+// whatever CPU it lands on. Variants for x86 are compiled with the target
+// attribute, so need no -m flags.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define I_CPU_X86
+#endif
+
+// CPU features that variants use.
+#define CPU_SSE2 (1 << 0)
+#define CPU_SSSE3 (1 << 1)
+#define CPU_AVX2 (1 << 2)
+#define CPU_NEON (1 << 3)
+
+// The features detected, or none with -nosimd.
+extern int cpufeatures;
+
+// The features used by the variants installed.
+extern int cpufeaturesused;
+
+// Detect the CPU's features, install each kernel's variant and print which.
+// Called once from D_DoomMain, before the kernels are used.
+void I_InitCPU(void);
+
+#endif
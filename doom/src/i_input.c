@@ -21,6 +21,7 @@
 #include "doomgeneric.h"
 #include "doomkeys.h"
 #include "doomtype.h"
+#include "i_timer.h"
 #include "i_video.h"
 
 int vanilla_keyboard_mapping = 1;
@@ -29,6 +30,10 @@ int vanilla_keyboard_mapping = 1;
 
 static int shiftdown = 0;
 
+// Mouse buttons currently down, as in ev_mouse events.
+
+static int mousebuttons = 0;
+
 // Lookup table for mapping ASCII characters to their equivalent when
 // shift is pressed on an American layout keyboard:
 static const char shiftxform[] = {
@@ -94,10 +99,24 @@ static void UpdateShiftStatus(int pressed, unsigned char key)
     }
 }
 
+static int AccelerateMouse(int val)
+{
+    if (val < 0)
+        return -AccelerateMouse(-val);
+
+    if (val > mouse_threshold) {
+        return (int)((val - mouse_threshold) * mouse_acceleration
+                     + mouse_threshold);
+    } else {
+        return val;
+    }
+}
+
 void I_GetEvent(void)
 {
     input_t input;
     event_t event;
+    int dx, dy;
 
     while (DG_GetInput(&input)) {
         switch (input.type) {
@@ -126,21 +145,33 @@ void I_GetEvent(void)
             }
 
             if (event.data1 != 0) {
-                D_PostEvent(&event);
+                D_PostEventAt(&event, I_TicksUsToTimeUs(input.time_us));
             }
         } break;
 
         case IN_MOUSEBUTTONS:
+            mousebuttons = input.value;
             event.type = ev_mouse;
-            event.data1 = input.value;
+            event.data1 = mousebuttons;
             event.data2 = event.data3 = 0;
-            D_PostEvent(&event);
+            D_PostEventAt(&event, I_TicksUsToTimeUs(input.time_us));
             break;
 
         default:
             abort();
         }
     }
+
+    // All the motion since the last tic goes in one event, after any button
+    // changes so they don't reset it.
+
+    if (DG_GetMouseMotion(&dx, &dy)) {
+        event.type = ev_mouse;
+        event.data1 = mousebuttons;
+        event.data2 = AccelerateMouse(dx);
+        event.data3 = -AccelerateMouse(dy);
+        D_PostEvent(&event);
+    }
 }
 
 void I_InitInput(void) {}
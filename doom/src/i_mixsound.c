@@ -0,0 +1,322 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "doomgeneric.h"
+#include "doomtype.h"
+#include "i_sound.h"
+#include "i_system.h"
+#include "m_misc.h"
+#include "w_wad.h"
+#include "z_zone.h"
+
+// Mixes sound effects and music in software and hands the result to
+// DG_OnSoundSamples for the client to play, keeping pace with the clock rather
+// than with tics.
+
+#define US_PER_SEC 1000000
+
+#define NUM_CHANNELS 16
+
+// Music plays at the gain of a centred sound effect at full volume, out of 256.
+#define MUSIC_GAIN 128
+
+// Most sound mixed by one update. After a longer stall (like loading a level),
+// sound skips ahead rather than falling behind.
+#define MAX_MIX_MS 100
+
+// A sound effect resampled to snd_samplerate.
+typedef struct {
+    unsigned length;
+    int16_t samples[];
+} cachedsfx_t;
+
+typedef struct {
+    // NULL if not playing.
+    const cachedsfx_t *sfx;
+    unsigned pos;
+    // Out of 256.
+    int left_gain;
+    int right_gain;
+} mixchannel_t;
+
+// driver_data of sounds that can't be played, so they're only looked at once.
+static cachedsfx_t invalid_sfx;
+
+static boolean use_sfx_prefix;
+
+static mixchannel_t channels[NUM_CHANNELS];
+
+static unsigned mix_rate;
+static unsigned max_mix_frames;
+static int32_t *mix_buf;
+static int16_t *music_buf;
+static byte *out_buf;
+
+// When the mixer started, and how many frames it's mixed (or skipped) since.
+static uint64_t start_us;
+static uint64_t mixed_frames;
+
+static void GetSfxLumpName(sfxinfo_t *sfxinfo, char *buf, size_t buf_len)
+{
+    // Linked sounds play the lump of the sound they're linked to.
+    if (sfxinfo->link != NULL)
+        sfxinfo = sfxinfo->link;
+
+    // Doom adds a DS* prefix to sound lumps; Heretic and Hexen don't.
+    if (use_sfx_prefix)
+        M_snprintf(buf, buf_len, "ds%s", sfxinfo->name);
+    else
+        M_StringCopy(buf, sfxinfo->name, buf_len);
+}
+
+static int Mixer_GetSfxLumpNum(sfxinfo_t *sfxinfo)
+{
+    char namebuf[9];
+
+    GetSfxLumpName(sfxinfo, namebuf, sizeof(namebuf));
+    return W_CheckNumForName(namebuf);
+}
+
+// Decodes a DMX sound lump: format (3): u16, sample_rate: u16, length: u32,
+// then length unsigned 8-bit samples, the first and last 16 of which DMX
+// skips. Returns &invalid_sfx if it isn't one.
+static cachedsfx_t *DecodeSfx(const byte *data, unsigned lumplen)
+{
+    cachedsfx_t *sfx;
+    unsigned src_rate;
+    unsigned length;
+
+    if (lumplen < 8 || data[0] != 0x03 || data[1] != 0x00)
+        return &invalid_sfx;
+
+    src_rate = data[2] | (data[3] << 8);
+    length = data[4] | (data[5] << 8) | (data[6] << 16)
+             | ((unsigned)data[7] << 24);
+
+    // DMX also doesn't play sounds of 48 samples or fewer.
+    if (src_rate == 0 || length > lumplen - 8 || length <= 48)
+        return &invalid_sfx;
+
+    const byte *src = data + 8 + 16;
+    length -= 32;
+
+    // Linearly interpolate between source samples, stepping through them in
+    // 16.16 fixed point.
+    unsigned out_len = (uint64_t)length * mix_rate / src_rate;
+    uint32_t step = ((uint64_t)src_rate << 16) / mix_rate;
+
+    sfx = I_Realloc(NULL, sizeof(*sfx) + out_len * sizeof(*sfx->samples));
+    sfx->length = out_len;
+    for (unsigned i = 0; i < out_len; ++i) {
+        uint64_t pos = (uint64_t)i * step;
+        unsigned j = pos >> 16;
+        int frac = pos & 0xffff;
+        int a = src[j];
+        int b = j + 1 < length ? src[j + 1] : a;
+        int v = (a << 16) + (b - a) * frac;
+
+        sfx->samples[i] = (v >> 8) - 0x8000;
+    }
+
+    return sfx;
+}
+
+static const cachedsfx_t *GetCachedSfx(sfxinfo_t *sfxinfo)
+{
+    if (sfxinfo->link != NULL)
+        sfxinfo = sfxinfo->link;
+
+    if (sfxinfo->driver_data == NULL) {
+        int lumpnum = Mixer_GetSfxLumpNum(sfxinfo);
+
+        if (lumpnum < 0) {
+            sfxinfo->driver_data = &invalid_sfx;
+        } else {
+            const byte *data = W_CacheLumpNum(lumpnum, PU_STATIC);
+
+            sfxinfo->driver_data = DecodeSfx(data, W_LumpLength(lumpnum));
+            W_ReleaseLumpNum(lumpnum);
+        }
+    }
+
+    return sfxinfo->driver_data;
+}
+
+static void Mixer_CacheSounds(sfxinfo_t *sounds, int num_sounds)
+{
+    for (int i = 0; i < num_sounds; ++i)
+        GetCachedSfx(&sounds[i]);
+}
+
+static boolean Mixer_Init(boolean _use_sfx_prefix)
+{
+    use_sfx_prefix = _use_sfx_prefix;
+
+    if (snd_samplerate <= 0 || snd_samplerate > 0xffff * 1000 / MAX_MIX_MS)
+        I_Error("Invalid snd_samplerate: %d", snd_samplerate);
+
+    mix_rate = snd_samplerate;
+    max_mix_frames = mix_rate * MAX_MIX_MS / 1000;
+    mix_buf = I_Realloc(NULL, max_mix_frames * 2 * sizeof(*mix_buf));
+    music_buf = I_Realloc(NULL, max_mix_frames * sizeof(*music_buf));
+    out_buf = I_Realloc(NULL, max_mix_frames * 4);
+
+    start_us = DG_GetTicksUs();
+    mixed_frames = 0;
+    return true;
+}
+
+static void Mixer_Shutdown(void)
+{
+    for (int i = 0; i < NUM_CHANNELS; ++i)
+        channels[i].sfx = NULL;
+}
+
+// Moves each playing channel on by frames, stopping those that reach the end.
+static void AdvanceChannels(uint64_t frames)
+{
+    for (int i = 0; i < NUM_CHANNELS; ++i) {
+        mixchannel_t *c = &channels[i];
+
+        if (c->sfx == NULL)
+            continue;
+
+        if (frames >= c->sfx->length - c->pos)
+            c->sfx = NULL;
+        else
+            c->pos += frames;
+    }
+}
+
+static void MixChannels(unsigned frames)
+{
+    for (unsigned i = 0; i < frames * 2; ++i)
+        mix_buf[i] = 0;
+
+    // Music that isn't ready yet is left out rather than waited for.
+    unsigned music_frames = I_OPL_ReadMusic(music_buf, frames);
+
+    for (unsigned i = 0; i < music_frames; ++i) {
+        mix_buf[i * 2] += music_buf[i] * MUSIC_GAIN;
+        mix_buf[i * 2 + 1] += music_buf[i] * MUSIC_GAIN;
+    }
+
+    // Kept simple enough for the compiler to vectorise. At most NUM_CHANNELS
+    // and the music of 16-bit samples scaled by up to 256 can't overflow 32
+    // bits.
+    for (int i = 0; i < NUM_CHANNELS; ++i) {
+        const mixchannel_t *c = &channels[i];
+
+        if (c->sfx == NULL)
+            continue;
+
+        const int16_t *samples = c->sfx->samples + c->pos;
+        unsigned len = c->sfx->length - c->pos;
+        int left_gain = c->left_gain;
+        int right_gain = c->right_gain;
+
+        if (len > frames)
+            len = frames;
+        for (unsigned j = 0; j < len; ++j) {
+            mix_buf[j * 2] += samples[j] * left_gain;
+            mix_buf[j * 2 + 1] += samples[j] * right_gain;
+        }
+    }
+
+    for (unsigned i = 0; i < frames * 2; ++i) {
+        int32_t v = mix_buf[i] / 256;
+
+        if (v < INT16_MIN)
+            v = INT16_MIN;
+        else if (v > INT16_MAX)
+            v = INT16_MAX;
+
+        out_buf[i * 2] = (uint16_t)v & 0xff;
+        out_buf[i * 2 + 1] = (uint16_t)v >> 8;
+    }
+}
+
+static void Mixer_Update(void)
+{
+    uint64_t due_frames = (DG_GetTicksUs() - start_us) * mix_rate / US_PER_SEC;
+    unsigned frames;
+
+    if (due_frames - mixed_frames > max_mix_frames) {
+        AdvanceChannels(due_frames - mixed_frames - max_mix_frames);
+        mixed_frames = due_frames - max_mix_frames;
+    }
+    frames = due_frames - mixed_frames;
+    mixed_frames = due_frames;
+
+    if (frames == 0)
+        return;
+
+    // Nothing's listening; just keep track of which sounds are still playing.
+    if (!DG_WantsSound()) {
+        AdvanceChannels(frames);
+        return;
+    }
+
+    MixChannels(frames);
+    AdvanceChannels(frames);
+    DG_OnSoundSamples(out_buf, frames, mix_rate);
+}
+
+static void Mixer_UpdateSoundParams(int channel, int vol, int sep)
+{
+    if (channel < 0 || channel >= NUM_CHANNELS)
+        return;
+
+    // vol is 0 to 127 and sep 0 (left) to 254 (right), like Chocolate Doom's
+    // SDL panning.
+    channels[channel].left_gain = ((254 - sep) * vol * 256) / (127 * 255);
+    channels[channel].right_gain = (sep * vol * 256) / (127 * 255);
+}
+
+static int Mixer_StartSound(sfxinfo_t *sfxinfo, int channel, int vol, int sep)
+{
+    const cachedsfx_t *sfx;
+
+    if (channel < 0 || channel >= NUM_CHANNELS)
+        return -1;
+
+    sfx = GetCachedSfx(sfxinfo);
+    if (sfx->length == 0)
+        return -1;
+
+    channels[channel].sfx = sfx;
+    channels[channel].pos = 0;
+    Mixer_UpdateSoundParams(channel, vol, sep);
+    return channel;
+}
+
+static void Mixer_StopSound(int channel)
+{
+    if (channel >= 0 && channel < NUM_CHANNELS)
+        channels[channel].sfx = NULL;
+}
+
+static boolean Mixer_SoundIsPlaying(int channel)
+{
+    return channel >= 0 && channel < NUM_CHANNELS
+           && channels[channel].sfx != NULL;
+}
+
+static snddevice_t sound_mixer_devices[] = {
+    SNDDEVICE_SB,          SNDDEVICE_PAS,         SNDDEVICE_GUS,
+    SNDDEVICE_WAVEBLASTER, SNDDEVICE_SOUNDCANVAS, SNDDEVICE_AWE32,
+};
+
+sound_module_t sound_mixer_module = {
+    sound_mixer_devices,
+    arrlen(sound_mixer_devices),
+    Mixer_Init,
+    Mixer_Shutdown,
+    Mixer_GetSfxLumpNum,
+    Mixer_Update,
+    Mixer_UpdateSoundParams,
+    Mixer_StartSound,
+    Mixer_StopSound,
+    Mixer_SoundIsPlaying,
+    Mixer_CacheSounds,
+};
@@ -0,0 +1,770 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomtype.h"
+#include "i_sound.h"
+#include "i_system.h"
+#include "opl.h"
+#include "w_wad.h"
+#include "z_zone.h"
+
+// Plays MUS music through the OPL2 emulator, using the instruments in the
+// GENMIDI lump like DMX did. The emulator runs on its own thread, which fills
+// a ring of samples for the sound effects mixer to take from with
+// I_OPL_ReadMusic, and sleeps whenever the ring is full or nothing's playing.
+
+#define GENMIDI_HEADER "#OPL_II#"
+#define GENMIDI_NUM_INSTRS 128
+#define GENMIDI_NUM_PERCUSSION 47
+#define GENMIDI_INSTR_LEN 36
+
+#define GENMIDI_FLAG_FIXED 0x0001 // plays at fixed_note
+#define GENMIDI_FLAG_2VOICE 0x0004 // plays both voices
+
+#define NUM_VOICES 9
+#define NUM_MUS_CHANNELS 16
+#define MUS_PERCUSSION_CHANNEL 15
+
+// MUS delays are in 140ths of a second.
+#define MUS_TICS_PER_SEC 140
+
+// Samples in the ring, and rendered at a time. A command takes effect within
+// the ring's length of sound (about 90ms at 44.1kHz).
+#define RING_LEN 4096
+#define CHUNK_LEN 512
+
+#define MAXCOMMANDS 32
+
+typedef struct {
+    byte tremolo;
+    byte attack;
+    byte sustain;
+    byte waveform;
+    byte scale;
+    byte level;
+} genmidi_op_t;
+
+typedef struct {
+    genmidi_op_t modulator;
+    byte feedback;
+    genmidi_op_t carrier;
+    int base_note_offset;
+} genmidi_voice_t;
+
+typedef struct {
+    int flags;
+    int fine_tuning;
+    int fixed_note;
+    genmidi_voice_t voices[2];
+} genmidi_instr_t;
+
+typedef struct {
+    byte *score;
+    int len;
+} song_t;
+
+typedef struct {
+    int instrument;
+    int volume;
+    int note_volume; // of the last note played
+    int bend; // in 32nds of a semitone
+} muschannel_t;
+
+typedef struct {
+    // -1 if free.
+    int channel;
+    int key;
+    int note_volume;
+    const genmidi_instr_t *instr;
+    const genmidi_voice_t *voice;
+    boolean second; // playing the instrument's second voice
+    unsigned age; // when it was keyed on, to steal the oldest
+    int reg_volume;
+} voice_t;
+
+typedef enum {
+    CMD_PLAY,
+    CMD_PLAY_LOOPING,
+    CMD_STOP,
+    CMD_PAUSE,
+    CMD_RESUME,
+    CMD_VOLUME,
+    CMD_FREE,
+} cmdtype_t;
+
+typedef struct {
+    cmdtype_t type;
+    song_t *song;
+    int volume;
+} command_t;
+
+static boolean initialized;
+static unsigned rate;
+static genmidi_instr_t instrs[GENMIDI_NUM_INSTRS + GENMIDI_NUM_PERCUSSION];
+
+// Only used by the main thread.
+static boolean music_playing;
+
+static pthread_t thread;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+// Guarded by mutex. Commands from the main thread, waiting between
+// numhandled and numqueued, and samples for it, waiting between ring_read and
+// ring_written; both wrap around.
+static command_t commands[MAXCOMMANDS];
+static unsigned numqueued;
+static unsigned numhandled;
+static int16_t ring[RING_LEN];
+static unsigned ring_read;
+static unsigned ring_written;
+
+// The rest is only used by the music thread.
+
+static song_t *song;
+static boolean looping;
+static boolean paused;
+static int music_volume = 127;
+static int pos; // in song->score
+static uint64_t tics; // MUS tics played up to the next event
+static uint64_t loop_tics; // when the song last started over
+static uint64_t samples_played;
+
+static muschannel_t channels[NUM_MUS_CHANNELS];
+static voice_t voices[NUM_VOICES];
+static unsigned key_ons;
+
+// DMX's curve from MUS volumes to OPL volumes: steep at first, then flatter.
+static int VolumeMapping(int volume)
+{
+    return volume * (254 - volume) / 127;
+}
+
+static void ParseOperator(genmidi_op_t *op, const byte *data)
+{
+    op->tremolo = data[0];
+    op->attack = data[1];
+    op->sustain = data[2];
+    op->waveform = data[3];
+    op->scale = data[4];
+    op->level = data[5];
+}
+
+// GENMIDI instruments are flags: u16, fine_tuning: u8, fixed_note: u8, then
+// two voices of a modulator operator, feedback: u8, a carrier operator, one
+// unused byte and base_note_offset: i16.
+static void ParseInstrument(genmidi_instr_t *instr, const byte *data)
+{
+    int i;
+
+    instr->flags = data[0] | (data[1] << 8);
+    instr->fine_tuning = data[2];
+    instr->fixed_note = data[3];
+
+    for (i = 0; i < 2; ++i) {
+        const byte *v = data + 4 + i * 16;
+        genmidi_voice_t *voice = &instr->voices[i];
+
+        ParseOperator(&voice->modulator, v);
+        voice->feedback = v[6];
+        ParseOperator(&voice->carrier, v + 7);
+        voice->base_note_offset = (int16_t)(v[14] | (v[15] << 8));
+    }
+}
+
+static void WriteOperator(int op, const genmidi_op_t *data, boolean silent)
+{
+    OPL_WriteRegister(0x40 + op, data->scale | (silent ? 0x3f : data->level));
+    OPL_WriteRegister(0x20 + op, data->tremolo);
+    OPL_WriteRegister(0x60 + op, data->attack);
+    OPL_WriteRegister(0x80 + op, data->sustain);
+    OPL_WriteRegister(0xe0 + op, data->waveform);
+}
+
+// Register offsets of each voice's modulator; its carrier is 3 above.
+static const int voice_operators[NUM_VOICES] = {
+    0x00, 0x01, 0x02, 0x08, 0x09, 0x0a, 0x10, 0x11, 0x12,
+};
+
+static void SetVoiceVolume(voice_t *voice)
+{
+    const genmidi_voice_t *gm = voice->voice;
+    int op = voice_operators[voice - voices];
+    int midi_volume;
+    int full_volume;
+    int car_volume;
+    int mod_volume;
+
+    midi_volume =
+        2 * (VolumeMapping(channels[voice->channel].volume * music_volume / 127)
+             + 1);
+    full_volume = (VolumeMapping(voice->note_volume) * midi_volume) >> 9;
+    car_volume = 0x3f - full_volume;
+
+    if (car_volume == voice->reg_volume)
+        return;
+    voice->reg_volume = car_volume;
+    OPL_WriteRegister(0x40 + op + 3, car_volume | (gm->carrier.scale & 0xc0));
+
+    // Without frequency modulation the modulator is heard too.
+    if ((gm->feedback & 0x01) != 0 && gm->modulator.level != 0x3f) {
+        mod_volume = gm->modulator.level;
+        if (mod_volume < car_volume)
+            mod_volume = car_volume;
+        OPL_WriteRegister(0x40 + op,
+                          mod_volume | (gm->modulator.scale & 0xc0));
+    }
+}
+
+// Writes the voice's frequency, keying it on if key_on is set.
+static void WriteFrequency(voice_t *voice, boolean key_on)
+{
+    int index = voice - voices;
+    int note = voice->key;
+    double bend;
+    double freq;
+    int block;
+    int fnum;
+
+    if (voice->instr->flags & GENMIDI_FLAG_FIXED)
+        note = voice->instr->fixed_note;
+    else
+        note += voice->voice->base_note_offset;
+    while (note < 0)
+        note += 12;
+    while (note > 95)
+        note -= 12;
+
+    // In 32nds of a semitone, like the channel's bend.
+    bend = channels[voice->channel].bend;
+    if (voice->second)
+        bend += voice->instr->fine_tuning / 2 - 64;
+
+    freq = 440 * pow(2, (note - 69 + bend / 32) / 12);
+
+    // The lowest block that fits it in 10 bits of fnum, for the most precision.
+    for (block = 0; block < 7; ++block) {
+        if (freq * (1 << (20 - block)) / 49716 < 1023.5)
+            break;
+    }
+    fnum = (int)(freq * (1 << (20 - block)) / 49716 + 0.5);
+    if (fnum > 1023)
+        fnum = 1023;
+
+    OPL_WriteRegister(0xa0 + index, fnum & 0xff);
+    OPL_WriteRegister(0xb0 + index,
+                      (key_on ? 0x20 : 0) | (block << 2) | (fnum >> 8));
+}
+
+static void ReleaseVoice(voice_t *voice)
+{
+    OPL_WriteRegister(0xb0 + (voice - voices), 0);
+    voice->channel = -1;
+}
+
+static voice_t *AllocateVoice(void)
+{
+    voice_t *oldest = &voices[0];
+    int i;
+
+    for (i = 0; i < NUM_VOICES; ++i) {
+        if (voices[i].channel < 0)
+            return &voices[i];
+        if (voices[i].age < oldest->age)
+            oldest = &voices[i];
+    }
+
+    ReleaseVoice(oldest);
+    return oldest;
+}
+
+static void VoiceKeyOn(int channel, const genmidi_instr_t *instr, int second,
+                       int key, int volume)
+{
+    voice_t *voice = AllocateVoice();
+    const genmidi_voice_t *gm = &instr->voices[second];
+    int op = voice_operators[voice - voices];
+
+    voice->channel = channel;
+    voice->key = key;
+    voice->note_volume = volume;
+    voice->instr = instr;
+    voice->voice = gm;
+    voice->second = second;
+    voice->age = key_ons++;
+
+    WriteOperator(op + 3, &gm->carrier, true);
+    WriteOperator(op, &gm->modulator, (gm->feedback & 0x01) != 0);
+    OPL_WriteRegister(0xc0 + (voice - voices), gm->feedback);
+
+    voice->reg_volume = -1;
+    SetVoiceVolume(voice);
+    WriteFrequency(voice, true);
+}
+
+static void NoteOn(int channel, int key, int volume)
+{
+    const genmidi_instr_t *instr;
+
+    if (channel == MUS_PERCUSSION_CHANNEL) {
+        if (key < 35 || key >= 35 + GENMIDI_NUM_PERCUSSION)
+            return;
+        instr = &instrs[GENMIDI_NUM_INSTRS + key - 35];
+    } else {
+        instr = &instrs[channels[channel].instrument];
+    }
+
+    VoiceKeyOn(channel, instr, 0, key, volume);
+    if (instr->flags & GENMIDI_FLAG_2VOICE)
+        VoiceKeyOn(channel, instr, 1, key, volume);
+}
+
+static void NoteOff(int channel, int key)
+{
+    int i;
+
+    for (i = 0; i < NUM_VOICES; ++i) {
+        if (voices[i].channel == channel && voices[i].key == key)
+            ReleaseVoice(&voices[i]);
+    }
+}
+
+static void AllNotesOff(int channel)
+{
+    int i;
+
+    for (i = 0; i < NUM_VOICES; ++i) {
+        if (voices[i].channel == channel || channel < 0)
+            ReleaseVoice(&voices[i]);
+    }
+}
+
+// Rewrites the frequency or volume of the voices playing on a channel, or on
+// any channel if it's -1.
+static void UpdateChannelVoices(int channel, boolean frequency)
+{
+    int i;
+
+    for (i = 0; i < NUM_VOICES; ++i) {
+        if (voices[i].channel < 0
+            || (channel >= 0 && voices[i].channel != channel))
+            continue;
+        if (frequency)
+            WriteFrequency(&voices[i], true);
+        else
+            SetVoiceVolume(&voices[i]);
+    }
+}
+
+static void ResetChannels(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_MUS_CHANNELS; ++i) {
+        channels[i].instrument = 0;
+        channels[i].volume = 100;
+        channels[i].note_volume = 127;
+        channels[i].bend = 0;
+    }
+}
+
+static void StartSong(song_t *s, boolean loop)
+{
+    AllNotesOff(-1);
+    ResetChannels();
+    song = s;
+    looping = loop;
+    pos = 0;
+    tics = 0;
+    loop_tics = 0;
+    samples_played = 0;
+}
+
+static void StopSong(void)
+{
+    AllNotesOff(-1);
+    song = NULL;
+}
+
+static int ReadByte(void)
+{
+    if (pos >= song->len)
+        return -1;
+    return song->score[pos++];
+}
+
+// Plays MUS events up to the next delay. Each is a byte of last: 1 bit,
+// type: 3 bits and channel: 4 bits, then data depending on its type, then if
+// last is set, a delay in tics with 7 bits to each byte, big-endian, and the
+// top bit set on all but the last.
+static void PlayEvents(void)
+{
+    int event;
+    int channel;
+    int data;
+    int value;
+    int delay;
+
+    while (song != NULL) {
+        event = ReadByte();
+        if (event < 0) {
+            StopSong();
+            return;
+        }
+        channel = event & 0x0f;
+
+        switch ((event >> 4) & 0x07) {
+        case 0: // release note
+            NoteOff(channel, ReadByte() & 0x7f);
+            break;
+        case 1: // play note, then its volume if the top bit is set
+            data = ReadByte();
+            if (data & 0x80)
+                channels[channel].note_volume = ReadByte() & 0x7f;
+            NoteOn(channel, data & 0x7f, channels[channel].note_volume);
+            break;
+        case 2: // pitch bend: 128 is none, 0 and 255 about 2 semitones
+            channels[channel].bend = (ReadByte() & 0xff) / 2 - 64;
+            UpdateChannelVoices(channel, true);
+            break;
+        case 3: // system event
+            data = ReadByte() & 0x7f;
+            if (data == 10 || data == 11) {
+                AllNotesOff(channel);
+            } else if (data == 14) {
+                channels[channel].bend = 0;
+                UpdateChannelVoices(channel, true);
+            }
+            break;
+        case 4: // controller
+            data = ReadByte() & 0x7f;
+            value = ReadByte() & 0x7f;
+            if (data == 0) {
+                channels[channel].instrument = value;
+            } else if (data == 3) {
+                channels[channel].volume = value;
+                UpdateChannelVoices(channel, false);
+            }
+            break;
+        case 5: // end of measure
+            break;
+        case 6: // end of score
+            // Songs without delays would loop forever without playing.
+            if (!looping || tics == loop_tics) {
+                StopSong();
+                return;
+            }
+            AllNotesOff(-1);
+            loop_tics = tics;
+            pos = 0;
+            continue;
+        default: // unknown; give up on the song
+            StopSong();
+            return;
+        }
+
+        if (event & 0x80) {
+            delay = 0;
+            do {
+                data = ReadByte();
+                delay = delay * 128 + (data & 0x7f);
+            } while (data >= 0 && (data & 0x80));
+
+            if (delay > 0) {
+                tics += delay;
+                return;
+            }
+        }
+    }
+}
+
+static void RenderMusic(int16_t *samples, unsigned count)
+{
+    uint64_t next_event = 0;
+    unsigned n;
+
+    while (count > 0) {
+        if (song != NULL) {
+            next_event = tics * rate / MUS_TICS_PER_SEC;
+            while (song != NULL && next_event <= samples_played) {
+                PlayEvents();
+                next_event = tics * rate / MUS_TICS_PER_SEC;
+            }
+        }
+
+        n = count;
+        if (song != NULL && next_event - samples_played < n)
+            n = next_event - samples_played;
+
+        OPL_Render(samples, n);
+        samples += n;
+        count -= n;
+        samples_played += n;
+    }
+}
+
+static void HandleCommand(const command_t *cmd)
+{
+    switch (cmd->type) {
+    case CMD_PLAY:
+    case CMD_PLAY_LOOPING:
+        StartSong(cmd->song, cmd->type == CMD_PLAY_LOOPING);
+        paused = false;
+        break;
+    case CMD_STOP:
+        StopSong();
+        break;
+    case CMD_PAUSE:
+        paused = true;
+        break;
+    case CMD_RESUME:
+        paused = false;
+        break;
+    case CMD_VOLUME:
+        music_volume = cmd->volume;
+        UpdateChannelVoices(-1, false);
+        break;
+    case CMD_FREE:
+        if (song == cmd->song)
+            StopSong();
+        free(cmd->song->score);
+        free(cmd->song);
+        break;
+    }
+}
+
+static void *MusicMain(void *arg)
+{
+    command_t cmds[MAXCOMMANDS];
+    int16_t chunk[CHUNK_LEN];
+    unsigned numcmds;
+    unsigned space;
+    boolean flush;
+    boolean render;
+    unsigned i;
+
+    (void)arg;
+
+    while (1) {
+        pthread_mutex_lock(&mutex);
+        while (numhandled == numqueued
+               && (song == NULL || paused
+                   || RING_LEN - (ring_written - ring_read) < CHUNK_LEN))
+            pthread_cond_wait(&wake_cond, &mutex);
+
+        numcmds = 0;
+        for (; numhandled != numqueued; numhandled++)
+            cmds[numcmds++] = commands[numhandled % MAXCOMMANDS];
+        space = RING_LEN - (ring_written - ring_read);
+        pthread_cond_signal(&queue_cond);
+        pthread_mutex_unlock(&mutex);
+
+        // What's waiting in the ring is dropped when songs start or stop,
+        // so they do so promptly.
+        flush = false;
+        for (i = 0; i < numcmds; ++i) {
+            HandleCommand(&cmds[i]);
+            flush |= cmds[i].type == CMD_PLAY
+                     || cmds[i].type == CMD_PLAY_LOOPING
+                     || cmds[i].type == CMD_STOP;
+        }
+
+        render = song != NULL && !paused && (flush || space >= CHUNK_LEN);
+        if (render)
+            RenderMusic(chunk, CHUNK_LEN);
+
+        pthread_mutex_lock(&mutex);
+        if (flush)
+            ring_written = ring_read;
+        if (render) {
+            // Only this thread fills the ring, so there's still room.
+            for (i = 0; i < CHUNK_LEN; ++i)
+                ring[(ring_written + i) % RING_LEN] = chunk[i];
+            ring_written += CHUNK_LEN;
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+    return NULL;
+}
+
+static void QueueCommand(cmdtype_t type, song_t *s, int volume)
+{
+    command_t *cmd;
+
+    pthread_mutex_lock(&mutex);
+    while (numqueued - numhandled == MAXCOMMANDS)
+        pthread_cond_wait(&queue_cond, &mutex);
+
+    cmd = &commands[numqueued++ % MAXCOMMANDS];
+    cmd->type = type;
+    cmd->song = s;
+    cmd->volume = volume;
+
+    pthread_cond_signal(&wake_cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+unsigned I_OPL_ReadMusic(int16_t *samples, unsigned count)
+{
+    unsigned n;
+    unsigned i;
+
+    if (!initialized)
+        return 0;
+
+    pthread_mutex_lock(&mutex);
+
+    n = ring_written - ring_read;
+    if (n > count)
+        n = count;
+    for (i = 0; i < n; ++i)
+        samples[i] = ring[(ring_read + i) % RING_LEN];
+    ring_read += n;
+
+    if (n > 0)
+        pthread_cond_signal(&wake_cond);
+    pthread_mutex_unlock(&mutex);
+
+    return n;
+}
+
+static boolean I_OPL_InitMusic(void)
+{
+    const byte *lump;
+    int lumpnum;
+    int err;
+    int i;
+
+    if (initialized)
+        return true;
+
+    lumpnum = W_CheckNumForName("GENMIDI");
+    if (lumpnum < 0
+        || W_LumpLength(lumpnum)
+               < 8 + (GENMIDI_NUM_INSTRS + GENMIDI_NUM_PERCUSSION)
+                         * GENMIDI_INSTR_LEN)
+        return false;
+
+    lump = W_CacheLumpNum(lumpnum, PU_STATIC);
+    if (memcmp(lump, GENMIDI_HEADER, strlen(GENMIDI_HEADER)) != 0) {
+        W_ReleaseLumpNum(lumpnum);
+        return false;
+    }
+    for (i = 0; i < GENMIDI_NUM_INSTRS + GENMIDI_NUM_PERCUSSION; ++i)
+        ParseInstrument(&instrs[i], lump + 8 + i * GENMIDI_INSTR_LEN);
+    W_ReleaseLumpNum(lumpnum);
+
+    if (snd_samplerate <= 0)
+        return false;
+    rate = snd_samplerate;
+
+    // Before the thread starts, it's the only one that touches the chip.
+    OPL_Init(rate);
+    OPL_WriteRegister(0x01, 0x20); // let operators choose waveforms
+    for (i = 0; i < NUM_VOICES; ++i)
+        voices[i].channel = -1;
+    ResetChannels();
+
+    err = pthread_create(&thread, NULL, MusicMain, NULL);
+    if (err != 0) {
+        I_Error("I_OPL_InitMusic: Failed to start thread: %s",
+                strerror(err));
+    }
+
+    initialized = true;
+    return true;
+}
+
+static void I_OPL_ShutdownMusic(void)
+{
+    if (initialized)
+        QueueCommand(CMD_STOP, NULL, 0);
+    music_playing = false;
+}
+
+static void I_OPL_SetMusicVolume(int volume)
+{
+    QueueCommand(CMD_VOLUME, NULL, volume);
+}
+
+static void I_OPL_PauseSong(void)
+{
+    QueueCommand(CMD_PAUSE, NULL, 0);
+}
+
+static void I_OPL_ResumeSong(void)
+{
+    QueueCommand(CMD_RESUME, NULL, 0);
+}
+
+// MUS files start with "MUS\x1a", then score_len: u16, score_start: u16, and
+// more that OPL playback doesn't need.
+static void *I_OPL_RegisterSong(void *data, int len)
+{
+    const byte *mus = data;
+    song_t *s;
+    int score_len;
+    int score_start;
+
+    if (len < 8 || memcmp(mus, "MUS\x1a", 4) != 0)
+        return NULL;
+
+    score_len = mus[4] | (mus[5] << 8);
+    score_start = mus[6] | (mus[7] << 8);
+    if (score_start > len)
+        return NULL;
+    if (score_len > len - score_start)
+        score_len = len - score_start;
+
+    // The lump is released once the song's unregistered, which the music
+    // thread may not have caught up with.
+    s = I_Realloc(NULL, sizeof(*s));
+    s->score = I_Realloc(NULL, score_len > 0 ? score_len : 1);
+    memcpy(s->score, mus + score_start, score_len);
+    s->len = score_len;
+    return s;
+}
+
+static void I_OPL_UnRegisterSong(void *handle)
+{
+    if (handle != NULL)
+        QueueCommand(CMD_FREE, handle, 0);
+}
+
+static void I_OPL_PlaySong(void *handle, boolean loop)
+{
+    if (handle == NULL)
+        return;
+    QueueCommand(loop ? CMD_PLAY_LOOPING : CMD_PLAY, handle, 0);
+    music_playing = true;
+}
+
+static void I_OPL_StopSong(void)
+{
+    QueueCommand(CMD_STOP, NULL, 0);
+    music_playing = false;
+}
+
+static boolean I_OPL_MusicIsPlaying(void)
+{
+    return music_playing;
+}
+
+static snddevice_t music_opl_devices[] = {
+    SNDDEVICE_ADLIB,
+    SNDDEVICE_SB,
+};
+
+music_module_t music_opl_module = {
+    music_opl_devices,   arrlen(music_opl_devices), I_OPL_InitMusic,
+    I_OPL_ShutdownMusic, I_OPL_SetMusicVolume,      I_OPL_PauseSong,
+    I_OPL_ResumeSong,    I_OPL_RegisterSong,        I_OPL_UnRegisterSong,
+    I_OPL_PlaySong,      I_OPL_StopSong,            I_OPL_MusicIsPlaying,
+    NULL,
+};
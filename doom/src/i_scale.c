@@ -69,7 +69,7 @@ void I_InitScale(byte *_src_buffer, byte *_dest_buffer, int _dest_pitch)
 //
 
 // 1x scale doesn't really do any scaling: it just copies the buffer
-// a line at a time for when pitch != SCREENWIDTH (!native_surface)
+// a line at a time for when pitch != ORIGWIDTH (!native_surface)
 
 static boolean I_Scale1x(int x1, int y1, int x2, int y2)
 {
@@ -79,20 +79,20 @@ static boolean I_Scale1x(int x1, int y1, int x2, int y2)
 
     // Need to byte-copy from buffer into the screen buffer
 
-    bufp = src_buffer + y1 * SCREENWIDTH + x1;
+    bufp = src_buffer + y1 * ORIGWIDTH + x1;
     screenp = (byte *)dest_buffer + y1 * dest_pitch + x1;
 
     for (y = y1; y < y2; ++y) {
         memcpy(screenp, bufp, w);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     return true;
 }
 
 screen_mode_t mode_scale_1x = {
-    SCREENWIDTH, SCREENHEIGHT, NULL, I_Scale1x, false,
+    ORIGWIDTH, ORIGHEIGHT, NULL, I_Scale1x, false,
 };
 
 // 2x scale (640x400)
@@ -104,7 +104,7 @@ static boolean I_Scale2x(int x1, int y1, int x2, int y2)
     int multi_pitch;
 
     multi_pitch = dest_pitch * 2;
-    bufp = src_buffer + y1 * SCREENWIDTH + x1;
+    bufp = src_buffer + y1 * ORIGWIDTH + x1;
     screenp = (byte *)dest_buffer + (y1 * dest_pitch + x1) * 2;
     screenp2 = screenp + dest_pitch;
 
@@ -123,14 +123,14 @@ static boolean I_Scale2x(int x1, int y1, int x2, int y2)
         }
         screenp += multi_pitch;
         screenp2 += multi_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     return true;
 }
 
 screen_mode_t mode_scale_2x = {
-    SCREENWIDTH * 2, SCREENHEIGHT * 2, NULL, I_Scale2x, false,
+    ORIGWIDTH * 2, ORIGHEIGHT * 2, NULL, I_Scale2x, false,
 };
 
 // 3x scale (960x600)
@@ -142,7 +142,7 @@ static boolean I_Scale3x(int x1, int y1, int x2, int y2)
     int multi_pitch;
 
     multi_pitch = dest_pitch * 3;
-    bufp = src_buffer + y1 * SCREENWIDTH + x1;
+    bufp = src_buffer + y1 * ORIGWIDTH + x1;
     screenp = (byte *)dest_buffer + (y1 * dest_pitch + x1) * 3;
     screenp2 = screenp + dest_pitch;
     screenp3 = screenp + dest_pitch * 2;
@@ -169,14 +169,14 @@ static boolean I_Scale3x(int x1, int y1, int x2, int y2)
         screenp += multi_pitch;
         screenp2 += multi_pitch;
         screenp3 += multi_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     return true;
 }
 
 screen_mode_t mode_scale_3x = {
-    SCREENWIDTH * 3, SCREENHEIGHT * 3, NULL, I_Scale3x, false,
+    ORIGWIDTH * 3, ORIGHEIGHT * 3, NULL, I_Scale3x, false,
 };
 
 // 4x scale (1280x800)
@@ -188,7 +188,7 @@ static boolean I_Scale4x(int x1, int y1, int x2, int y2)
     int multi_pitch;
 
     multi_pitch = dest_pitch * 4;
-    bufp = src_buffer + y1 * SCREENWIDTH + x1;
+    bufp = src_buffer + y1 * ORIGWIDTH + x1;
     screenp = (byte *)dest_buffer + (y1 * dest_pitch + x1) * 4;
     screenp2 = screenp + dest_pitch;
     screenp3 = screenp + dest_pitch * 2;
@@ -225,14 +225,14 @@ static boolean I_Scale4x(int x1, int y1, int x2, int y2)
         screenp2 += multi_pitch;
         screenp3 += multi_pitch;
         screenp4 += multi_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     return true;
 }
 
 screen_mode_t mode_scale_4x = {
-    SCREENWIDTH * 4, SCREENHEIGHT * 4, NULL, I_Scale4x, false,
+    ORIGWIDTH * 4, ORIGHEIGHT * 4, NULL, I_Scale4x, false,
 };
 
 // 5x scale (1600x1000)
@@ -244,7 +244,7 @@ static boolean I_Scale5x(int x1, int y1, int x2, int y2)
     int multi_pitch;
 
     multi_pitch = dest_pitch * 5;
-    bufp = src_buffer + y1 * SCREENWIDTH + x1;
+    bufp = src_buffer + y1 * ORIGWIDTH + x1;
     screenp = (byte *)dest_buffer + (y1 * dest_pitch + x1) * 5;
     screenp2 = screenp + dest_pitch;
     screenp3 = screenp + dest_pitch * 2;
@@ -293,14 +293,14 @@ static boolean I_Scale5x(int x1, int y1, int x2, int y2)
         screenp3 += multi_pitch;
         screenp4 += multi_pitch;
         screenp5 += multi_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     return true;
 }
 
 screen_mode_t mode_scale_5x = {
-    SCREENWIDTH * 5, SCREENHEIGHT * 5, NULL, I_Scale5x, false,
+    ORIGWIDTH * 5, ORIGHEIGHT * 5, NULL, I_Scale5x, false,
 };
 
 // Search through the given palette, finding the nearest color that matches
@@ -439,7 +439,7 @@ static inline void WriteBlendedLine1x(byte *dest, byte *src1, byte *src2,
 {
     int x;
 
-    for (x = 0; x < SCREENWIDTH; ++x) {
+    for (x = 0; x < ORIGWIDTH; ++x) {
         *dest = stretch_table[*src1 * 256 + *src2];
         ++dest;
         ++src1;
@@ -456,65 +456,65 @@ static boolean I_Stretch1x(int x1, int y1, int x2, int y2)
 
     // Only works with full screen update
 
-    if (x1 != 0 || y1 != 0 || x2 != SCREENWIDTH || y2 != SCREENHEIGHT) {
+    if (x1 != 0 || y1 != 0 || x2 != ORIGWIDTH || y2 != ORIGHEIGHT) {
         return false;
     }
 
     // Need to byte-copy from buffer into the screen buffer
 
-    bufp = src_buffer + y1 * SCREENWIDTH + x1;
+    bufp = src_buffer + y1 * ORIGWIDTH + x1;
     screenp = (byte *)dest_buffer + y1 * dest_pitch + x1;
 
     // For every 5 lines of src_buffer, 6 lines are written to dest_buffer
     // (200 -> 240)
 
-    for (y = 0; y < SCREENHEIGHT; y += 5) {
+    for (y = 0; y < ORIGHEIGHT; y += 5) {
         // 100% line 0
-        memcpy(screenp, bufp, SCREENWIDTH);
+        memcpy(screenp, bufp, ORIGWIDTH);
         screenp += dest_pitch;
 
         // 20% line 0, 80% line 1
-        WriteBlendedLine1x(screenp, bufp, bufp + SCREENWIDTH,
+        WriteBlendedLine1x(screenp, bufp, bufp + ORIGWIDTH,
                            stretch_tables[0]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 40% line 1, 60% line 2
-        WriteBlendedLine1x(screenp, bufp, bufp + SCREENWIDTH,
+        WriteBlendedLine1x(screenp, bufp, bufp + ORIGWIDTH,
                            stretch_tables[1]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 60% line 2, 40% line 3
-        WriteBlendedLine1x(screenp, bufp + SCREENWIDTH, bufp,
+        WriteBlendedLine1x(screenp, bufp + ORIGWIDTH, bufp,
                            stretch_tables[1]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 80% line 3, 20% line 4
-        WriteBlendedLine1x(screenp, bufp + SCREENWIDTH, bufp,
+        WriteBlendedLine1x(screenp, bufp + ORIGWIDTH, bufp,
                            stretch_tables[0]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 100% line 4
-        memcpy(screenp, bufp, SCREENWIDTH);
+        memcpy(screenp, bufp, ORIGWIDTH);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     return true;
 }
 
 screen_mode_t mode_stretch_1x = {
-    SCREENWIDTH, SCREENHEIGHT_4_3, I_InitStretchTables, I_Stretch1x, true,
+    ORIGWIDTH, SCREENHEIGHT_4_3, I_InitStretchTables, I_Stretch1x, true,
 };
 
 static inline void WriteLine2x(byte *dest, byte *src)
 {
     int x;
 
-    for (x = 0; x < SCREENWIDTH; ++x) {
+    for (x = 0; x < ORIGWIDTH; ++x) {
         dest[0] = *src;
         dest[1] = *src;
         dest += 2;
@@ -528,7 +528,7 @@ static inline void WriteBlendedLine2x(byte *dest, byte *src1, byte *src2,
     int x;
     int val;
 
-    for (x = 0; x < SCREENWIDTH; ++x) {
+    for (x = 0; x < ORIGWIDTH; ++x) {
         val = stretch_table[*src1 * 256 + *src2];
         dest[0] = val;
         dest[1] = val;
@@ -547,19 +547,19 @@ static boolean I_Stretch2x(int x1, int y1, int x2, int y2)
 
     // Only works with full screen update
 
-    if (x1 != 0 || y1 != 0 || x2 != SCREENWIDTH || y2 != SCREENHEIGHT) {
+    if (x1 != 0 || y1 != 0 || x2 != ORIGWIDTH || y2 != ORIGHEIGHT) {
         return false;
     }
 
     // Need to byte-copy from buffer into the screen buffer
 
-    bufp = src_buffer + y1 * SCREENWIDTH + x1;
+    bufp = src_buffer + y1 * ORIGWIDTH + x1;
     screenp = (byte *)dest_buffer + y1 * dest_pitch + x1;
 
     // For every 5 lines of src_buffer, 12 lines are written to dest_buffer.
     // (200 -> 480)
 
-    for (y = 0; y < SCREENHEIGHT; y += 5) {
+    for (y = 0; y < ORIGHEIGHT; y += 5) {
         // 100% line 0
         WriteLine2x(screenp, bufp);
         screenp += dest_pitch;
@@ -569,20 +569,20 @@ static boolean I_Stretch2x(int x1, int y1, int x2, int y2)
         screenp += dest_pitch;
 
         // 40% line 0, 60% line 1
-        WriteBlendedLine2x(screenp, bufp, bufp + SCREENWIDTH,
+        WriteBlendedLine2x(screenp, bufp, bufp + ORIGWIDTH,
                            stretch_tables[1]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 100% line 1
         WriteLine2x(screenp, bufp);
         screenp += dest_pitch;
 
         // 80% line 1, 20% line 2
-        WriteBlendedLine2x(screenp, bufp + SCREENWIDTH, bufp,
+        WriteBlendedLine2x(screenp, bufp + ORIGWIDTH, bufp,
                            stretch_tables[0]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 100% line 2
         WriteLine2x(screenp, bufp);
@@ -593,20 +593,20 @@ static boolean I_Stretch2x(int x1, int y1, int x2, int y2)
         screenp += dest_pitch;
 
         // 20% line 2, 80% line 3
-        WriteBlendedLine2x(screenp, bufp, bufp + SCREENWIDTH,
+        WriteBlendedLine2x(screenp, bufp, bufp + ORIGWIDTH,
                            stretch_tables[0]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 100% line 3
         WriteLine2x(screenp, bufp);
         screenp += dest_pitch;
 
         // 60% line 3, 40% line 4
-        WriteBlendedLine2x(screenp, bufp + SCREENWIDTH, bufp,
+        WriteBlendedLine2x(screenp, bufp + ORIGWIDTH, bufp,
                            stretch_tables[1]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 100% line 4
         WriteLine2x(screenp, bufp);
@@ -615,14 +615,14 @@ static boolean I_Stretch2x(int x1, int y1, int x2, int y2)
         // 100% line 4
         WriteLine2x(screenp, bufp);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     return true;
 }
 
 screen_mode_t mode_stretch_2x = {
-    SCREENWIDTH * 2, SCREENHEIGHT_4_3 * 2, I_InitStretchTables, I_Stretch2x,
+    ORIGWIDTH * 2, SCREENHEIGHT_4_3 * 2, I_InitStretchTables, I_Stretch2x,
     false,
 };
 
@@ -630,7 +630,7 @@ static inline void WriteLine3x(byte *dest, byte *src)
 {
     int x;
 
-    for (x = 0; x < SCREENWIDTH; ++x) {
+    for (x = 0; x < ORIGWIDTH; ++x) {
         dest[0] = *src;
         dest[1] = *src;
         dest[2] = *src;
@@ -645,7 +645,7 @@ static inline void WriteBlendedLine3x(byte *dest, byte *src1, byte *src2,
     int x;
     int val;
 
-    for (x = 0; x < SCREENWIDTH; ++x) {
+    for (x = 0; x < ORIGWIDTH; ++x) {
         val = stretch_table[*src1 * 256 + *src2];
         dest[0] = val;
         dest[1] = val;
@@ -665,19 +665,19 @@ static boolean I_Stretch3x(int x1, int y1, int x2, int y2)
 
     // Only works with full screen update
 
-    if (x1 != 0 || y1 != 0 || x2 != SCREENWIDTH || y2 != SCREENHEIGHT) {
+    if (x1 != 0 || y1 != 0 || x2 != ORIGWIDTH || y2 != ORIGHEIGHT) {
         return false;
     }
 
     // Need to byte-copy from buffer into the screen buffer
 
-    bufp = src_buffer + y1 * SCREENWIDTH + x1;
+    bufp = src_buffer + y1 * ORIGWIDTH + x1;
     screenp = (byte *)dest_buffer + y1 * dest_pitch + x1;
 
     // For every 5 lines of src_buffer, 18 lines are written to dest_buffer.
     // (200 -> 720)
 
-    for (y = 0; y < SCREENHEIGHT; y += 5) {
+    for (y = 0; y < ORIGHEIGHT; y += 5) {
         // 100% line 0
         WriteLine3x(screenp, bufp);
         screenp += dest_pitch;
@@ -691,10 +691,10 @@ static boolean I_Stretch3x(int x1, int y1, int x2, int y2)
         screenp += dest_pitch;
 
         // 60% line 0, 40% line 1
-        WriteBlendedLine3x(screenp, bufp + SCREENWIDTH, bufp,
+        WriteBlendedLine3x(screenp, bufp + ORIGWIDTH, bufp,
                            stretch_tables[1]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 100% line 1
         WriteLine3x(screenp, bufp);
@@ -709,10 +709,10 @@ static boolean I_Stretch3x(int x1, int y1, int x2, int y2)
         screenp += dest_pitch;
 
         // 20% line 1, 80% line 2
-        WriteBlendedLine3x(screenp, bufp, bufp + SCREENWIDTH,
+        WriteBlendedLine3x(screenp, bufp, bufp + ORIGWIDTH,
                            stretch_tables[0]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 100% line 2
         WriteLine3x(screenp, bufp);
@@ -723,10 +723,10 @@ static boolean I_Stretch3x(int x1, int y1, int x2, int y2)
         screenp += dest_pitch;
 
         // 80% line 2, 20% line 3
-        WriteBlendedLine3x(screenp, bufp + SCREENWIDTH, bufp,
+        WriteBlendedLine3x(screenp, bufp + ORIGWIDTH, bufp,
                            stretch_tables[0]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 100% line 3
         WriteLine3x(screenp, bufp);
@@ -741,10 +741,10 @@ static boolean I_Stretch3x(int x1, int y1, int x2, int y2)
         screenp += dest_pitch;
 
         // 40% line 3, 60% line 4
-        WriteBlendedLine3x(screenp, bufp, bufp + SCREENWIDTH,
+        WriteBlendedLine3x(screenp, bufp, bufp + ORIGWIDTH,
                            stretch_tables[1]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 100% line 4
         WriteLine3x(screenp, bufp);
@@ -757,14 +757,14 @@ static boolean I_Stretch3x(int x1, int y1, int x2, int y2)
         // 100% line 4
         WriteLine3x(screenp, bufp);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     return true;
 }
 
 screen_mode_t mode_stretch_3x = {
-    SCREENWIDTH * 3, SCREENHEIGHT_4_3 * 3, I_InitStretchTables, I_Stretch3x,
+    ORIGWIDTH * 3, SCREENHEIGHT_4_3 * 3, I_InitStretchTables, I_Stretch3x,
     false,
 };
 
@@ -772,7 +772,7 @@ static inline void WriteLine4x(byte *dest, byte *src)
 {
     int x;
 
-    for (x = 0; x < SCREENWIDTH; ++x) {
+    for (x = 0; x < ORIGWIDTH; ++x) {
         dest[0] = *src;
         dest[1] = *src;
         dest[2] = *src;
@@ -788,7 +788,7 @@ static inline void WriteBlendedLine4x(byte *dest, byte *src1, byte *src2,
     int x;
     int val;
 
-    for (x = 0; x < SCREENWIDTH; ++x) {
+    for (x = 0; x < ORIGWIDTH; ++x) {
         val = stretch_table[*src1 * 256 + *src2];
         dest[0] = val;
         dest[1] = val;
@@ -809,19 +809,19 @@ static boolean I_Stretch4x(int x1, int y1, int x2, int y2)
 
     // Only works with full screen update
 
-    if (x1 != 0 || y1 != 0 || x2 != SCREENWIDTH || y2 != SCREENHEIGHT) {
+    if (x1 != 0 || y1 != 0 || x2 != ORIGWIDTH || y2 != ORIGHEIGHT) {
         return false;
     }
 
     // Need to byte-copy from buffer into the screen buffer
 
-    bufp = src_buffer + y1 * SCREENWIDTH + x1;
+    bufp = src_buffer + y1 * ORIGWIDTH + x1;
     screenp = (byte *)dest_buffer + y1 * dest_pitch + x1;
 
     // For every 5 lines of src_buffer, 24 lines are written to dest_buffer.
     // (200 -> 960)
 
-    for (y = 0; y < SCREENHEIGHT; y += 5) {
+    for (y = 0; y < ORIGHEIGHT; y += 5) {
         // 100% line 0
         WriteLine4x(screenp, bufp);
         screenp += dest_pitch;
@@ -839,10 +839,10 @@ static boolean I_Stretch4x(int x1, int y1, int x2, int y2)
         screenp += dest_pitch;
 
         // 90% line 0, 20% line 1
-        WriteBlendedLine4x(screenp, bufp + SCREENWIDTH, bufp,
+        WriteBlendedLine4x(screenp, bufp + ORIGWIDTH, bufp,
                            stretch_tables[0]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 100% line 1
         WriteLine4x(screenp, bufp);
@@ -861,10 +861,10 @@ static boolean I_Stretch4x(int x1, int y1, int x2, int y2)
         screenp += dest_pitch;
 
         // 60% line 1, 40% line 2
-        WriteBlendedLine4x(screenp, bufp + SCREENWIDTH, bufp,
+        WriteBlendedLine4x(screenp, bufp + ORIGWIDTH, bufp,
                            stretch_tables[1]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 100% line 2
         WriteLine4x(screenp, bufp);
@@ -883,10 +883,10 @@ static boolean I_Stretch4x(int x1, int y1, int x2, int y2)
         screenp += dest_pitch;
 
         // 40% line 2, 60% line 3
-        WriteBlendedLine4x(screenp, bufp, bufp + SCREENWIDTH,
+        WriteBlendedLine4x(screenp, bufp, bufp + ORIGWIDTH,
                            stretch_tables[1]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 100% line 3
         WriteLine4x(screenp, bufp);
@@ -905,10 +905,10 @@ static boolean I_Stretch4x(int x1, int y1, int x2, int y2)
         screenp += dest_pitch;
 
         // 20% line 3, 80% line 4
-        WriteBlendedLine4x(screenp, bufp, bufp + SCREENWIDTH,
+        WriteBlendedLine4x(screenp, bufp, bufp + ORIGWIDTH,
                            stretch_tables[0]);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
 
         // 100% line 4
         WriteLine4x(screenp, bufp);
@@ -925,14 +925,14 @@ static boolean I_Stretch4x(int x1, int y1, int x2, int y2)
         // 100% line 4
         WriteLine4x(screenp, bufp);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     return true;
 }
 
 screen_mode_t mode_stretch_4x = {
-    SCREENWIDTH * 4, SCREENHEIGHT_4_3 * 4, I_InitStretchTables, I_Stretch4x,
+    ORIGWIDTH * 4, SCREENHEIGHT_4_3 * 4, I_InitStretchTables, I_Stretch4x,
     false,
 };
 
@@ -940,7 +940,7 @@ static inline void WriteLine5x(byte *dest, byte *src)
 {
     int x;
 
-    for (x = 0; x < SCREENWIDTH; ++x) {
+    for (x = 0; x < ORIGWIDTH; ++x) {
         dest[0] = *src;
         dest[1] = *src;
         dest[2] = *src;
@@ -960,19 +960,19 @@ static boolean I_Stretch5x(int x1, int y1, int x2, int y2)
 
     // Only works with full screen update
 
-    if (x1 != 0 || y1 != 0 || x2 != SCREENWIDTH || y2 != SCREENHEIGHT) {
+    if (x1 != 0 || y1 != 0 || x2 != ORIGWIDTH || y2 != ORIGHEIGHT) {
         return false;
     }
 
     // Need to byte-copy from buffer into the screen buffer
 
-    bufp = src_buffer + y1 * SCREENWIDTH + x1;
+    bufp = src_buffer + y1 * ORIGWIDTH + x1;
     screenp = (byte *)dest_buffer + y1 * dest_pitch + x1;
 
     // For every 1 line of src_buffer, 6 lines are written to dest_buffer.
     // (200 -> 1200)
 
-    for (y = 0; y < SCREENHEIGHT; y += 1) {
+    for (y = 0; y < ORIGHEIGHT; y += 1) {
         // 100% line 0
         WriteLine5x(screenp, bufp);
         screenp += dest_pitch;
@@ -996,7 +996,7 @@ static boolean I_Stretch5x(int x1, int y1, int x2, int y2)
         // 100% line 0
         WriteLine5x(screenp, bufp);
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     // test hack for Porsche Monty... scan line simulation:
@@ -1016,7 +1016,7 @@ static boolean I_Stretch5x(int x1, int y1, int x2, int y2)
 }
 
 screen_mode_t mode_stretch_5x = {
-    SCREENWIDTH * 5, SCREENHEIGHT_4_3 * 5, I_InitStretchTables, I_Stretch5x,
+    ORIGWIDTH * 5, SCREENHEIGHT_4_3 * 5, I_InitStretchTables, I_Stretch5x,
     false,
 };
 
@@ -1040,7 +1040,7 @@ static inline void WriteSquashedLine1x(byte *dest, byte *src)
 {
     int x;
 
-    for (x = 0; x < SCREENWIDTH;) {
+    for (x = 0; x < ORIGWIDTH;) {
         // Draw in blocks of 5
 
         // 80% pixel 0,   20% pixel 1
@@ -1073,25 +1073,25 @@ static boolean I_Squash1x(int x1, int y1, int x2, int y2)
 
     // Only works with full screen update
 
-    if (x1 != 0 || y1 != 0 || x2 != SCREENWIDTH || y2 != SCREENHEIGHT) {
+    if (x1 != 0 || y1 != 0 || x2 != ORIGWIDTH || y2 != ORIGHEIGHT) {
         return false;
     }
 
     bufp = src_buffer;
     screenp = (byte *)dest_buffer;
 
-    for (y = 0; y < SCREENHEIGHT; ++y) {
+    for (y = 0; y < ORIGHEIGHT; ++y) {
         WriteSquashedLine1x(screenp, bufp);
 
         screenp += dest_pitch;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     return true;
 }
 
 screen_mode_t mode_squash_1x = {
-    SCREENWIDTH_4_3, SCREENHEIGHT, I_InitStretchTables, I_Squash1x, true,
+    SCREENWIDTH_4_3, ORIGHEIGHT, I_InitStretchTables, I_Squash1x, true,
 };
 
 //
@@ -1107,7 +1107,7 @@ static inline void WriteSquashedLine2x(byte *dest, byte *src)
 
     dest2 = dest + dest_pitch;
 
-    for (x = 0; x < SCREENWIDTH;) {
+    for (x = 0; x < ORIGWIDTH;) {
         // Draw in blocks of 5
 
         // 100% pixel 0
@@ -1164,18 +1164,18 @@ static boolean I_Squash2x(int x1, int y1, int x2, int y2)
 
     // Only works with full screen update
 
-    if (x1 != 0 || y1 != 0 || x2 != SCREENWIDTH || y2 != SCREENHEIGHT) {
+    if (x1 != 0 || y1 != 0 || x2 != ORIGWIDTH || y2 != ORIGHEIGHT) {
         return false;
     }
 
     bufp = src_buffer;
     screenp = (byte *)dest_buffer;
 
-    for (y = 0; y < SCREENHEIGHT; ++y) {
+    for (y = 0; y < ORIGHEIGHT; ++y) {
         WriteSquashedLine2x(screenp, bufp);
 
         screenp += dest_pitch * 2;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     return true;
@@ -1183,7 +1183,7 @@ static boolean I_Squash2x(int x1, int y1, int x2, int y2)
 
 screen_mode_t mode_squash_2x = {
     SCREENWIDTH_4_3 * 2,
-    SCREENHEIGHT * 2,
+    ORIGHEIGHT * 2,
     I_InitStretchTables,
     I_Squash2x,
     false,
@@ -1199,7 +1199,7 @@ static inline void WriteSquashedLine3x(byte *dest, byte *src)
     dest2 = dest + dest_pitch;
     dest3 = dest + dest_pitch * 2;
 
-    for (x = 0; x < SCREENWIDTH;) {
+    for (x = 0; x < ORIGWIDTH;) {
         // Every 2 pixels is expanded to 5 pixels
 
         // 100% pixel 0 x2
@@ -1242,18 +1242,18 @@ static boolean I_Squash3x(int x1, int y1, int x2, int y2)
 
     // Only works with full screen update
 
-    if (x1 != 0 || y1 != 0 || x2 != SCREENWIDTH || y2 != SCREENHEIGHT) {
+    if (x1 != 0 || y1 != 0 || x2 != ORIGWIDTH || y2 != ORIGHEIGHT) {
         return false;
     }
 
     bufp = src_buffer;
     screenp = (byte *)dest_buffer;
 
-    for (y = 0; y < SCREENHEIGHT; ++y) {
+    for (y = 0; y < ORIGHEIGHT; ++y) {
         WriteSquashedLine3x(screenp, bufp);
 
         screenp += dest_pitch * 3;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     return true;
@@ -1275,7 +1275,7 @@ static inline void WriteSquashedLine4x(byte *dest, byte *src)
     dest3 = dest + dest_pitch * 2;
     dest4 = dest + dest_pitch * 3;
 
-    for (x = 0; x < SCREENWIDTH;) {
+    for (x = 0; x < ORIGWIDTH;) {
         // Draw in blocks of 5
 
         // 100% pixel 0  x3
@@ -1346,18 +1346,18 @@ static boolean I_Squash4x(int x1, int y1, int x2, int y2)
 
     // Only works with full screen update
 
-    if (x1 != 0 || y1 != 0 || x2 != SCREENWIDTH || y2 != SCREENHEIGHT) {
+    if (x1 != 0 || y1 != 0 || x2 != ORIGWIDTH || y2 != ORIGHEIGHT) {
         return false;
     }
 
     bufp = src_buffer;
     screenp = (byte *)dest_buffer;
 
-    for (y = 0; y < SCREENHEIGHT; ++y) {
+    for (y = 0; y < ORIGHEIGHT; ++y) {
         WriteSquashedLine4x(screenp, bufp);
 
         screenp += dest_pitch * 4;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     return true;
@@ -1365,7 +1365,7 @@ static boolean I_Squash4x(int x1, int y1, int x2, int y2)
 
 screen_mode_t mode_squash_4x = {
     SCREENWIDTH_4_3 * 4,
-    SCREENHEIGHT * 4,
+    ORIGHEIGHT * 4,
     I_InitStretchTables,
     I_Squash4x,
     false,
@@ -1384,7 +1384,7 @@ static inline void WriteSquashedLine5x(byte *dest, byte *src)
     dest4 = dest + dest_pitch * 3;
     dest5 = dest + dest_pitch * 4;
 
-    for (x = 0; x < SCREENWIDTH; ++x) {
+    for (x = 0; x < ORIGWIDTH; ++x) {
         // Draw in blocks of 5
 
         // 100% pixel 0  x4
@@ -1408,18 +1408,18 @@ static boolean I_Squash5x(int x1, int y1, int x2, int y2)
 
     // Only works with full screen update
 
-    if (x1 != 0 || y1 != 0 || x2 != SCREENWIDTH || y2 != SCREENHEIGHT) {
+    if (x1 != 0 || y1 != 0 || x2 != ORIGWIDTH || y2 != ORIGHEIGHT) {
         return false;
     }
 
     bufp = src_buffer;
     screenp = (byte *)dest_buffer;
 
-    for (y = 0; y < SCREENHEIGHT; ++y) {
+    for (y = 0; y < ORIGHEIGHT; ++y) {
         WriteSquashedLine5x(screenp, bufp);
 
         screenp += dest_pitch * 5;
-        bufp += SCREENWIDTH;
+        bufp += ORIGWIDTH;
     }
 
     return true;
@@ -1427,7 +1427,7 @@ static boolean I_Squash5x(int x1, int y1, int x2, int y2)
 
 screen_mode_t mode_squash_5x = {
     SCREENWIDTH_4_3 * 5,
-    SCREENHEIGHT * 5,
+    ORIGHEIGHT * 5,
     I_InitStretchTables,
     I_Squash5x,
     false,
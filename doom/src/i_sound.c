@@ -70,6 +70,15 @@ static sound_module_t *sound_modules[] = {
 #ifdef FEATURE_SOUND
     &DG_sound_module,
 #endif
+    &sound_mixer_module,
+    NULL,
+};
+
+static music_module_t *music_modules[] = {
+#ifdef FEATURE_SOUND
+    &DG_music_module,
+#endif
+    &music_opl_module,
     NULL,
 };
 
@@ -117,9 +126,24 @@ static void InitSfxModule(boolean use_sfx_prefix)
 
 static void InitMusicModule(void)
 {
-#ifdef FEATURE_SOUND
-    music_module = &DG_music_module;
-#endif /* FEATURE_SOUND */
+    int i;
+
+    music_module = NULL;
+
+    for (i = 0; music_modules[i] != NULL; ++i) {
+        // Is the music device in the list of devices supported
+        // by this module?
+
+        if (SndDeviceInList(snd_musicdevice, music_modules[i]->sound_devices,
+                            music_modules[i]->num_sound_devices)) {
+            // Initialize the module
+
+            if (music_modules[i]->Init()) {
+                music_module = music_modules[i];
+                return;
+            }
+        }
+    }
 }
 
 //
@@ -234,12 +234,17 @@ extern sound_module_t DG_sound_module;
 extern music_module_t DG_music_module;
 #endif
 extern sound_module_t sound_pcsound_module;
+extern sound_module_t sound_mixer_module;
 extern music_module_t music_opl_module;
 
 // For OPL module:
 
 extern int opl_io_port;
 
+// Takes up to count samples of mono music from the OPL module, returning how
+// many there were.
+unsigned I_OPL_ReadMusic(int16_t *samples, unsigned count);
+
 // For native music module:
 
 extern char *timidity_cfg_path;
@@ -15,6 +15,7 @@
 // DESCRIPTION:
 //
 
+#include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -24,12 +25,21 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #endif
 
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 #include "config.h"
 #include "doomtype.h"
 #include "i_system.h"
+#include "i_video.h"
 #include "m_argv.h"
 #include "m_misc.h"
 
@@ -40,6 +50,16 @@
 #define DEFAULT_RAM 6 /* MiB */
 #define MIN_RAM 6     /* MiB */
 
+// Extra heap for the screen sized buffers allocated from the zone (the frame
+// buffer, wipe screens, background, etc.) when rendering at a higher
+// resolution; the defaults above already fit them at the original resolution.
+#define HIRES_RAM \
+    ((8 * (SCREENWIDTH * SCREENHEIGHT - ORIGWIDTH * ORIGHEIGHT) >> 20) + 1)
+
+// Zone memory is aligned to this with -hugepages, the size of a transparent
+// huge page on x86-64 and most arm64 kernels.
+#define HUGEPAGE_SIZE (2 << 20)
+
 typedef struct atexit_listentry_s atexit_listentry_t;
 
 struct atexit_listentry_s {
@@ -97,7 +117,14 @@ static byte *AutoAllocMemory(int *size, int default_ram, int min_ram)
 
         *size = default_ram * 1024 * 1024;
 
-        zonemem = malloc(*size);
+        if (M_ParmExists("-hugepages")) {
+#ifndef _WIN32
+            if (posix_memalign((void **)&zonemem, HUGEPAGE_SIZE, *size) != 0)
+                zonemem = NULL;
+#endif
+        } else {
+            zonemem = malloc(*size);
+        }
 
         // Failed to allocate?  Reduce zone size until we reach a size
         // that is acceptable.
@@ -127,18 +154,234 @@ byte *I_ZoneBase(int *size)
     if (p > 0) {
         default_ram = atoi(myargv[p + 1]);
         min_ram = default_ram;
+    } else if (I_LowMemoryBudget() > 0) {
+        // The zone grows from a quarter of the budget as it's needed.
+        default_ram = I_LowMemoryBudget() >> 22;
+        if (default_ram < 1)
+            default_ram = 1;
+        min_ram = default_ram;
     } else {
         default_ram = DEFAULT_RAM;
         min_ram = MIN_RAM;
+
+        if (hires) {
+            default_ram += HIRES_RAM;
+            min_ram += HIRES_RAM;
+        }
     }
 
     zonemem = AutoAllocMemory(size, default_ram, min_ram);
 
-    printf("zone memory: %p, %x allocated for zone\n", (void *)zonemem, *size);
+    printf("zone memory: %p, %x allocated for zone%s\n", (void *)zonemem, *size,
+           I_AdviseHugePages(zonemem, *size) ? " in huge pages" : "");
 
     return zonemem;
 }
 
+int I_LowMemoryBudget(void)
+{
+    static int budget = -1;
+    int p;
+
+    if (budget >= 0)
+        return budget;
+
+    //!
+    // @arg <mb>
+    //
+    // Keep memory use low, to run alongside other heavy programs. The heap
+    // starts at a quarter of mb MiB and grows to no more than mb, purging
+    // cached graphics and sounds past that; composite textures get an
+    // eighth of it, and frames are sent straight from the screen buffer
+    // rather than copied for an encoder thread.
+    //
+
+    p = M_CheckParmWithArgs("-lowmem", 1);
+    budget = 0;
+
+    if (p > 0) {
+        budget = atoi(myargv[p + 1]);
+        if (budget < MIN_RAM)
+            I_Error("I_LowMemoryBudget: -lowmem needs at least %d MiB",
+                    MIN_RAM);
+        budget <<= 20;
+    }
+
+    return budget;
+}
+
+boolean I_AdviseHugePages(void *p, size_t size)
+{
+    // Only warned about once; the frame ring calls this for every new slot.
+    static boolean warned;
+
+    //!
+    // @category obscure
+    //
+    // Back the zone heap and the shared memory frame ring with transparent
+    // huge pages, where the kernel supports them, for fewer TLB misses.
+    //
+
+    if (!M_ParmExists("-hugepages"))
+        return false;
+
+#ifdef MADV_HUGEPAGE
+    if (madvise(p, size, MADV_HUGEPAGE) == 0)
+        return true;
+
+    if (!warned)
+        fprintf(stderr, "I_AdviseHugePages: madvise failed: %s\n",
+                strerror(errno));
+#else
+    (void)p;
+    (void)size;
+    if (!warned)
+        fprintf(stderr, "I_AdviseHugePages: Not supported on this system\n");
+#endif
+    warned = true;
+    return false;
+}
+
+void *I_MapSharedMemory(const char *name, size_t size, boolean *created)
+{
+#ifdef _WIN32
+    (void)name;
+    (void)size;
+    *created = false;
+    return NULL;
+#else
+    struct stat st;
+    void *p;
+    int fd;
+
+    fd = shm_open(name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        fprintf(stderr, "I_MapSharedMemory: Failed to open %s: %s\n", name,
+                strerror(errno));
+        return NULL;
+    }
+
+    // Another process may be creating the object at the same time; macOS
+    // only lets its size be set once, so whichever is second just checks it.
+    *created = false;
+    if (fstat(fd, &st) == 0 && st.st_size == 0)
+        *created = ftruncate(fd, size) == 0;
+    if (!*created && (fstat(fd, &st) != 0 || (size_t)st.st_size != size)) {
+        fprintf(stderr, "I_MapSharedMemory: %s isn't the expected size\n",
+                name);
+        close(fd);
+        return NULL;
+    }
+
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "I_MapSharedMemory: Failed to map %s: %s\n", name,
+                strerror(errno));
+        return NULL;
+    }
+
+    return p;
+#endif
+}
+
+#ifdef __linux__
+// Parses a list of CPUs like "2,3" or "0-3,6" into set.
+static boolean ParseCPUList(const char *list, cpu_set_t *set)
+{
+    char *end;
+    long first, last;
+
+    CPU_ZERO(set);
+
+    while (*list != '\0') {
+        first = last = strtol(list, &end, 10);
+        if (end == list || first < 0)
+            return false;
+        if (*end == '-') {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list || last < first)
+                return false;
+        }
+        if (last >= CPU_SETSIZE)
+            return false;
+        for (; first <= last; ++first)
+            CPU_SET(first, set);
+
+        if (*end == ',')
+            ++end;
+        else if (*end != '\0')
+            return false;
+        list = end;
+    }
+
+    return CPU_COUNT(set) > 0;
+}
+#endif
+
+void I_SetSchedulingOptions(void)
+{
+    int p;
+
+    //!
+    // @arg <cpus>
+    // @category obscure
+    //
+    // Only run on the given CPUs, like "2,3" or "0-3,6". Worker threads
+    // started later are pinned to the same CPUs. Only supported on Linux.
+    //
+
+    p = M_CheckParmWithArgs("-cpus", 1);
+    if (p) {
+#ifdef __linux__
+        cpu_set_t set;
+
+        if (!ParseCPUList(myargv[p + 1], &set))
+            I_Error("Invalid -cpus: %s", myargv[p + 1]);
+
+        if (sched_setaffinity(0, sizeof(set), &set) == 0) {
+            printf("I_SetSchedulingOptions: Pinned to CPUs %s\n",
+                   myargv[p + 1]);
+        } else {
+            fprintf(stderr,
+                    "I_SetSchedulingOptions: Failed to pin to CPUs %s: %s\n",
+                    myargv[p + 1], strerror(errno));
+        }
+#else
+        fprintf(stderr, "I_SetSchedulingOptions: -cpus is only supported on "
+                        "Linux\n");
+#endif
+    }
+
+    //!
+    // @arg <n>
+    // @category obscure
+    //
+    // Set the niceness of the process to n, from -20 (scheduled first) to
+    // 19. Raising priority (going below 0) usually needs privileges; if
+    // they're missing, it's left as it is. Threads started later inherit
+    // it.
+    //
+
+    p = M_CheckParmWithArgs("-nice", 1);
+    if (p) {
+#ifndef _WIN32
+        int nice = atoi(myargv[p + 1]);
+
+        if (setpriority(PRIO_PROCESS, 0, nice) == 0) {
+            printf("I_SetSchedulingOptions: Niceness set to %i\n", nice);
+        } else {
+            fprintf(stderr,
+                    "I_SetSchedulingOptions: Not permitted to set niceness to "
+                    "%i: %s\n",
+                    nice, strerror(errno));
+        }
+#endif
+    }
+}
+
 void I_PrintBanner(char *msg)
 {
     int i;
@@ -239,9 +482,11 @@ void I_Quit(void)
 
 static boolean already_quitting = false;
 
+// The message I_Error is quitting with, once it's written.
+static char errormessage[512];
+
 void I_Error(char *error, ...)
 {
-    char msgbuf[512];
     va_list argptr;
     atexit_listentry_t *entry;
 
@@ -261,8 +506,8 @@ void I_Error(char *error, ...)
 
     // Write a copy of the message into buffer.
     va_start(argptr, error);
-    memset(msgbuf, 0, sizeof(msgbuf));
-    M_vsnprintf(msgbuf, sizeof(msgbuf), error, argptr);
+    memset(errormessage, 0, sizeof(errormessage));
+    M_vsnprintf(errormessage, sizeof(errormessage), error, argptr);
     va_end(argptr);
 
     // Shutdown. Here might be other errors.
@@ -280,6 +525,31 @@ void I_Error(char *error, ...)
     exit(1);
 }
 
+//
+// I_ErrorMessage
+//
+
+const char *I_ErrorMessage(void)
+{
+    return errormessage[0] != '\0' ? errormessage : NULL;
+}
+
+//
+// I_Realloc
+//
+
+void *I_Realloc(void *ptr, size_t size)
+{
+    void *new_ptr;
+
+    new_ptr = realloc(ptr, size);
+
+    if (size != 0 && new_ptr == NULL)
+        I_Error("I_Realloc: failed on reallocation of %zu bytes", size);
+
+    return new_ptr;
+}
+
 //
 // Read Access Violation emulation.
 //
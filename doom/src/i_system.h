@@ -19,6 +19,8 @@
 #ifndef __I_SYSTEM__
 #define __I_SYSTEM__
 
+#include <stddef.h>
+
 #include "d_ticcmd.h"
 
 typedef void (*atexit_func_t)(void);
@@ -31,8 +33,25 @@ void I_Init(void);
 // for the zone management.
 byte *I_ZoneBase(int *size);
 
+// The heap budget given by -lowmem, in bytes, or 0 without it.
+int I_LowMemoryBudget(void);
+
 boolean I_ConsoleStdout(void);
 
+// Pin the process to the CPUs given by -cpus and set its niceness to -nice,
+// reporting what was applied.
+void I_SetSchedulingOptions(void);
+
+// With -hugepages, ask for the page-aligned region to be backed by
+// transparent huge pages. Returns true if that was asked for and accepted.
+boolean I_AdviseHugePages(void *p, size_t size);
+
+// Map the named POSIX shared memory object of size bytes, creating it zeroed
+// if it doesn't exist, for sharing with other processes. It's left in place
+// once the process exits. Returns NULL if that fails or it exists with
+// another size; *created is set if this process created it.
+void *I_MapSharedMemory(const char *name, size_t size, boolean *created);
+
 // Asynchronous interrupt functions should maintain private queues
 // that are read by the synchronous functions
 // to be converted into events.
@@ -49,6 +68,13 @@ void I_Quit(void);
 
 void I_Error(char *error, ...);
 
+// The message I_Error is quitting with, for exit functions to report, or NULL
+// if it isn't.
+const char *I_ErrorMessage(void);
+
+// realloc that calls I_Error on failure.
+void *I_Realloc(void *ptr, size_t size);
+
 void I_Tactile(int on, int off, int total);
 
 boolean I_GetMemoryValue(unsigned int offset, void *value, int size);
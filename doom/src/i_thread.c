@@ -0,0 +1,417 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomtype.h"
+#include "i_system.h"
+#include "i_thread.h"
+#include "m_argv.h"
+#include "m_counts.h"
+
+static pthread_t threads[MAX_WORKERS - 1];
+static int worker_count = 1;
+
+// Held by whichever thread is running the workers.
+static pthread_mutex_t run_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+// Bumped for each job, so workers can tell when there is a new one.
+static unsigned job_generation;
+static workerfunc_t job_func;
+static void *job_data;
+// Threads yet to finish the current job, excluding the main thread.
+static int busy_count;
+
+static void *WorkerMain(void *arg)
+{
+    int worker_i = (int)(intptr_t)arg;
+    unsigned seen_generation = 0;
+
+    M_AttachWorkCounts();
+
+    while (1) {
+        pthread_mutex_lock(&mutex);
+        while (job_generation == seen_generation)
+            pthread_cond_wait(&start_cond, &mutex);
+        seen_generation = job_generation;
+        workerfunc_t func = job_func;
+        void *data = job_data;
+        pthread_mutex_unlock(&mutex);
+
+        func(worker_i, data);
+
+        pthread_mutex_lock(&mutex);
+        if (--busy_count == 0)
+            pthread_cond_signal(&done_cond);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    return NULL;
+}
+
+void I_InitWorkers(void)
+{
+    int count = 1;
+    int p;
+
+    // For the main thread.
+    M_AttachWorkCounts();
+
+    //!
+    // @arg <n>
+    // @category obscure
+    //
+    // Split work like drawing floors and ceilings between n threads,
+    // including the main one.
+    //
+
+    p = M_CheckParmWithArgs("-workers", 1);
+
+    // Its old name, from when only floors and ceilings used the workers.
+    if (!p)
+        p = M_CheckParmWithArgs("-renderthreads", 1);
+
+    if (p)
+        count = atoi(myargv[p + 1]);
+    if (count > MAX_WORKERS)
+        count = MAX_WORKERS;
+
+    for (; worker_count < count; ++worker_count) {
+        int err = pthread_create(&threads[worker_count - 1], NULL, WorkerMain,
+                                 (void *)(intptr_t)worker_count);
+        if (err != 0)
+            I_Error("I_InitWorkers: Failed to start thread: %s", strerror(err));
+    }
+}
+
+int I_WorkerCount(void)
+{
+    return worker_count;
+}
+
+static void RunWorkers(workerfunc_t func, void *data)
+{
+    pthread_mutex_lock(&mutex);
+    job_func = func;
+    job_data = data;
+    busy_count = worker_count - 1;
+    ++job_generation;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&mutex);
+
+    func(0, data);
+
+    pthread_mutex_lock(&mutex);
+    while (busy_count > 0)
+        pthread_cond_wait(&done_cond, &mutex);
+    pthread_mutex_unlock(&mutex);
+}
+
+void I_RunWorkers(workerfunc_t func, void *data)
+{
+    if (worker_count == 1) {
+        func(0, data);
+        return;
+    }
+
+    pthread_mutex_lock(&run_mutex);
+    RunWorkers(func, data);
+    pthread_mutex_unlock(&run_mutex);
+}
+
+//
+// Fork/join jobs.
+// Each worker has a deque of consecutive job numbers, packed into one word so
+//  it can be popped and stolen from without locks: the owner takes jobs from
+//  the front, and others that have run out take half of what's left from the
+//  back.
+//
+#define JOBRANGE(first, end) \
+    ((uint64_t)(uint32_t)(end) << 32 | (uint32_t)(first))
+
+typedef struct {
+    uint64_t range;
+    // Keep each deque to its own cache line.
+    byte pad[64 - sizeof(uint64_t)];
+} jobdeque_t;
+
+static jobdeque_t deques[MAX_WORKERS];
+static jobfunc_t jobs_func;
+static void *jobs_data;
+
+static boolean PopJob(jobdeque_t *deque, int *job_i)
+{
+    uint64_t range = __atomic_load_n(&deque->range, __ATOMIC_RELAXED);
+    uint32_t first;
+    uint32_t end;
+
+    do {
+        first = (uint32_t)range;
+        end = (uint32_t)(range >> 32);
+        if (first >= end)
+            return false;
+    } while (!__atomic_compare_exchange_n(&deque->range, &range,
+                                          JOBRANGE(first + 1, end), true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    *job_i = first;
+    return true;
+}
+
+// Move the back half of victim's jobs into deque, which must be empty.
+static boolean StealJobs(jobdeque_t *victim, jobdeque_t *deque)
+{
+    uint64_t range = __atomic_load_n(&victim->range, __ATOMIC_RELAXED);
+    uint32_t first;
+    uint32_t end;
+    uint32_t split;
+
+    do {
+        first = (uint32_t)range;
+        end = (uint32_t)(range >> 32);
+        if (first >= end)
+            return false;
+        split = end - (end - first + 1) / 2;
+    } while (!__atomic_compare_exchange_n(&victim->range, &range,
+                                          JOBRANGE(first, split), true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    __atomic_store_n(&deque->range, JOBRANGE(split, end), __ATOMIC_RELAXED);
+    return true;
+}
+
+static void JobsWorker(int worker_i, void *data)
+{
+    jobdeque_t *deque = &deques[worker_i];
+    int job_i;
+    int i;
+
+    (void)data;
+
+    while (1) {
+        while (PopJob(deque, &job_i))
+            jobs_func(worker_i, job_i, jobs_data);
+
+        for (i = 1; i < worker_count; i++) {
+            if (StealJobs(&deques[(worker_i + i) % worker_count], deque))
+                break;
+        }
+        if (i == worker_count)
+            break;
+    }
+}
+
+void I_RunJobs(jobfunc_t func, void *data, int count)
+{
+    int i;
+
+    if (worker_count == 1) {
+        for (i = 0; i < count; i++)
+            func(0, i, data);
+        return;
+    }
+
+    pthread_mutex_lock(&run_mutex);
+
+    for (i = 0; i < worker_count; i++) {
+        deques[i].range = JOBRANGE(count * i / worker_count,
+                                   count * (i + 1) / worker_count);
+    }
+
+    jobs_func = func;
+    jobs_data = data;
+    RunWorkers(JobsWorker, NULL);
+
+    pthread_mutex_unlock(&run_mutex);
+}
+
+//
+// I/O jobs.
+// Run one at a time, in the order queued, on a thread of their own, so they
+//  never hold up the workers; they're expected to block on the disk.
+//
+typedef struct iojob_s {
+    iojobfunc_t func;
+    void *data;
+    struct iojob_s *next;
+} iojob_t;
+
+static pthread_t io_thread;
+static boolean io_started;
+
+// Everything below is guarded by io_mutex.
+static pthread_mutex_t io_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_queued_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t io_done_cond = PTHREAD_COND_INITIALIZER;
+
+static iojob_t *io_head;
+static iojob_t *io_tail;
+// Tickets handed out, and jobs finished; a job's ticket is its place in the
+// queue, counting from 1.
+static unsigned int io_queued;
+static unsigned int io_done;
+
+static void *IOMain(void *arg)
+{
+    iojob_t *job;
+
+    (void)arg;
+    M_AttachWorkCounts();
+
+    pthread_mutex_lock(&io_mutex);
+
+    while (1) {
+        while (io_head == NULL)
+            pthread_cond_wait(&io_queued_cond, &io_mutex);
+        job = io_head;
+        io_head = job->next;
+        if (io_head == NULL)
+            io_tail = NULL;
+        pthread_mutex_unlock(&io_mutex);
+
+        job->func(job->data);
+        free(job);
+
+        pthread_mutex_lock(&io_mutex);
+        io_done++;
+        pthread_cond_broadcast(&io_done_cond);
+    }
+
+    return NULL;
+}
+
+unsigned int I_QueueIO(iojobfunc_t func, void *data)
+{
+    iojob_t *job;
+    unsigned int ticket;
+    int err;
+
+    job = I_Realloc(NULL, sizeof(*job));
+    job->func = func;
+    job->data = data;
+    job->next = NULL;
+
+    pthread_mutex_lock(&io_mutex);
+
+    if (!io_started) {
+        err = pthread_create(&io_thread, NULL, IOMain, NULL);
+        if (err != 0)
+            I_Error("I_QueueIO: Failed to start thread: %s", strerror(err));
+        io_started = true;
+    }
+
+    if (io_tail != NULL)
+        io_tail->next = job;
+    else
+        io_head = job;
+    io_tail = job;
+    ticket = ++io_queued;
+
+    pthread_cond_signal(&io_queued_cond);
+    pthread_mutex_unlock(&io_mutex);
+
+    return ticket;
+}
+
+void I_WaitIO(unsigned int ticket)
+{
+    pthread_mutex_lock(&io_mutex);
+    while ((int)(io_done - ticket) < 0)
+        pthread_cond_wait(&io_done_cond, &io_mutex);
+    pthread_mutex_unlock(&io_mutex);
+}
+
+boolean I_IODone(unsigned int ticket)
+{
+    boolean done;
+
+    pthread_mutex_lock(&io_mutex);
+    done = (int)(io_done - ticket) >= 0;
+    pthread_mutex_unlock(&io_mutex);
+
+    return done;
+}
+
+//
+// Background job.
+// One at a time, on a thread of its own, for the main thread to carry on
+//  with something else meanwhile.
+//
+static pthread_t background_thread;
+static boolean background_started;
+
+// Everything below is guarded by background_mutex.
+static pthread_mutex_t background_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t background_start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t background_done_cond = PTHREAD_COND_INITIALIZER;
+
+static backgroundfunc_t background_func;
+static void *background_data;
+static boolean background_busy;
+
+static void *BackgroundMain(void *arg)
+{
+    backgroundfunc_t func;
+
+    (void)arg;
+    M_AttachWorkCounts();
+
+    pthread_mutex_lock(&background_mutex);
+
+    while (1) {
+        while (background_func == NULL)
+            pthread_cond_wait(&background_start_cond, &background_mutex);
+        func = background_func;
+        background_func = NULL;
+        pthread_mutex_unlock(&background_mutex);
+
+        func(background_data);
+
+        pthread_mutex_lock(&background_mutex);
+        background_busy = false;
+        pthread_cond_signal(&background_done_cond);
+    }
+
+    return NULL;
+}
+
+void I_StartBackground(backgroundfunc_t func, void *data)
+{
+    int err;
+
+    pthread_mutex_lock(&background_mutex);
+
+    if (background_busy)
+        I_Error("I_StartBackground: the last job hasn't been waited for");
+
+    if (!background_started) {
+        err = pthread_create(&background_thread, NULL, BackgroundMain, NULL);
+        if (err != 0) {
+            I_Error("I_StartBackground: Failed to start thread: %s",
+                    strerror(err));
+        }
+        background_started = true;
+
+        // Don't exit from under a job.
+        I_AtExit(I_WaitBackground, false);
+    }
+
+    background_func = func;
+    background_data = data;
+    background_busy = true;
+
+    pthread_cond_signal(&background_start_cond);
+    pthread_mutex_unlock(&background_mutex);
+}
+
+void I_WaitBackground(void)
+{
+    pthread_mutex_lock(&background_mutex);
+    while (background_busy)
+        pthread_cond_wait(&background_done_cond, &background_mutex);
+    pthread_mutex_unlock(&background_mutex);
+}
@@ -0,0 +1,61 @@
+#ifndef __I_THREAD__
+#define __I_THREAD__
+
+#include "doomtype.h"
+
+// The engine's threads: a pool of workers for splitting up per-frame work,
+// like drawing floors and ceilings, a thread for long-running I/O, like
+// writing savegames, and one for work that runs alongside the main thread,
+// like drawing the view while the next tics run. Subsystems queue jobs here
+// rather than starting threads of their own.
+
+// Storage class for globals that each worker needs its own copy of.
+#define THREAD_LOCAL __thread
+
+// Most workers that can be started, including the main thread.
+#define MAX_WORKERS 8
+
+typedef void (*workerfunc_t)(int worker_i, void *data);
+typedef void (*jobfunc_t)(int worker_i, int job_i, void *data);
+typedef void (*iojobfunc_t)(void *data);
+typedef void (*backgroundfunc_t)(void *data);
+
+// Start the workers asked for by -workers, clamped to MAX_WORKERS. Only to be
+// called once, after I_SetSchedulingOptions so they inherit its settings.
+void I_InitWorkers(void);
+
+// The number of workers jobs are split between, including the main thread.
+int I_WorkerCount(void);
+
+// Call func on every worker at once, with worker_i from 0 to
+// I_WorkerCount() - 1 (0 being the calling thread), and return once all have
+// finished. Calls from different threads take turns with the workers.
+void I_RunWorkers(workerfunc_t func, void *data);
+
+// Call func for every job_i from 0 to count - 1, split between the workers,
+// and return once all have finished. Each worker starts on an even share of
+// consecutive jobs, then steals from the others once it runs out, so uneven
+// jobs still finish together. Not to be called from a job.
+void I_RunJobs(jobfunc_t func, void *data, int count);
+
+// Queue func to be called with data on the I/O thread, after every job queued
+// before it, starting the thread if needed. Returns a ticket for I_WaitIO.
+unsigned int I_QueueIO(iojobfunc_t func, void *data);
+
+// Wait for the I/O job with the given ticket, and so all those before it, to
+// finish.
+void I_WaitIO(unsigned int ticket);
+
+// Returns whether the I/O job with the given ticket has finished, without
+// waiting.
+boolean I_IODone(unsigned int ticket);
+
+// Call func with data on the background thread, starting it if needed, and
+// return straight away. Only one background job runs at a time; the last must
+// have been waited for with I_WaitBackground.
+void I_StartBackground(backgroundfunc_t func, void *data);
+
+// Wait for the background job started last, if it hasn't finished.
+void I_WaitBackground(void);
+
+#endif
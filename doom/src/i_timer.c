@@ -23,56 +23,80 @@
 #include "doomgeneric.h"
 #include "i_timer.h"
 
-//
-// I_GetTime
-// returns time in 1/35th second tics
-//
+#define US_PER_MS 1000
+#define US_PER_SEC 1000000
 
-static uint32_t basetime = 0;
+// DG_GetTicksUs() when the timer was first read.
+static uint64_t basetime = 0;
 
 int I_GetTicks(void)
 {
     return DG_GetTicksMs();
 }
 
-int I_GetTime(void)
+//
+// I_GetTimeUs
+// Same as I_GetTime, but returns time in microseconds; the others are
+// derived from it.
+//
+
+uint64_t I_GetTimeUs(void)
 {
-    uint32_t ticks;
+    uint64_t ticks;
 
-    ticks = I_GetTicks();
+    ticks = DG_GetTicksUs();
 
     if (basetime == 0)
         basetime = ticks;
 
-    ticks -= basetime;
+    return ticks - basetime;
+}
+
+uint64_t I_TicksUsToTimeUs(uint64_t ticks_us)
+{
+    if (basetime == 0)
+        I_GetTimeUs();
 
-    return (ticks * TICRATE) / 1000;
+    return ticks_us > basetime ? ticks_us - basetime : 0;
 }
 
 //
-// Same as I_GetTime, but returns time in milliseconds
+// I_GetTime
+// returns time in 1/35th second tics
 //
 
-int I_GetTimeMS(void)
+int I_GetTime(void)
 {
-    uint32_t ticks;
-
-    ticks = I_GetTicks();
+    return (I_GetTimeUs() * TICRATE) / US_PER_SEC;
+}
 
-    if (basetime == 0)
-        basetime = ticks;
+//
+// Same as I_GetTime, but returns time in milliseconds
+//
 
-    return ticks - basetime;
+int I_GetTimeMS(void)
+{
+    return I_GetTimeUs() / US_PER_MS;
 }
 
 // Sleep for a specified number of ms
 
 void I_Sleep(int ms)
 {
-    // SDL_Delay(ms);
-    // usleep (ms * 1000);
+    DG_SleepUntilUs(DG_GetTicksUs() + (uint64_t)ms * US_PER_MS);
+}
+
+// Sleeps until the deadline of the next tic itself rather than for a number
+// of milliseconds, so oversleeping one tic doesn't delay the next.
+
+void I_WaitForNextTic(void)
+{
+    uint64_t now_us = I_GetTimeUs();
+    uint64_t tic = (now_us * TICRATE) / US_PER_SEC;
+    // First microsecond in which I_GetTime will return the next tic.
+    uint64_t next_tic_us = ((tic + 1) * US_PER_SEC + TICRATE - 1) / TICRATE;
 
-    DG_SleepMs(ms);
+    DG_SleepUntilUs(basetime + next_tic_us);
 }
 
 void I_WaitVBL(int count)
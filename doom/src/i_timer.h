@@ -19,6 +19,8 @@
 #ifndef __I_TIMER__
 #define __I_TIMER__
 
+#include <stdint.h>
+
 #define TICRATE 35
 
 // Called by D_DoomLoop,
@@ -28,9 +30,18 @@ int I_GetTime(void);
 // returns current time in ms
 int I_GetTimeMS(void);
 
+// returns current time in microseconds
+uint64_t I_GetTimeUs(void);
+
+// Converts a DG_GetTicksUs() time to the time returned by I_GetTimeUs.
+uint64_t I_TicksUsToTimeUs(uint64_t ticks_us);
+
 // Pause for a specified number of ms
 void I_Sleep(int ms);
 
+// Pause until the next tic is due; may return early if there's input.
+void I_WaitForNextTic(void);
+
 // Initialize timer
 void I_InitTimer(void);
 
@@ -20,10 +20,21 @@
 
 #include <string.h>
 
+#include "i_cpu.h"
+
+#ifdef I_CPU_X86
+#include <immintrin.h>
+#endif
+
 #include "config.h"
+#include "d_replay.h"
 #include "doomgeneric.h"
+#include "i_scale.h"
+#include "i_system.h"
 #include "i_video.h"
+#include "m_profile.h"
 #include "tables.h"
+#include "w_wad.h"
 #include "z_zone.h"
 
 int usemouse = 0;
@@ -36,12 +47,29 @@ typedef struct {
 
 static col_t colors[256];
 
+// The palette last passed to I_ExpandFrame, padded to 4 bytes per colour, so
+// each pixel can be expanded with a single (unaligned) 4-byte store rather
+// than three 1-byte ones.
+static byte expand_palette[256 * 3];
+static byte padded_colors[256][4];
+
+// PLAYPAL's palettes with gamma correction applied, composed again only when
+// usegamma changes.
+static byte playpals[MAXPLAYPALS][256 * 3];
+static int playpals_count;
+static int playpals_gamma = -1;
+
+// Paletted frame scaled by DG_ScreenMode, if any.
+static byte *scaled_buf;
+
 void I_GetEvent(void);
 
 // The screen buffer; this is modified to draw things to the screen
 
 byte *I_VideoBuffer = NULL;
 
+int hires = 0;
+
 // If true, game is running as a screensaver
 
 boolean screensaver_mode = false;
@@ -71,17 +99,91 @@ int usegamma = 0;
 
 static uint16_t rgb565_palette[256];
 
-void cmap_to_fb(byte *out, byte *in, int in_pixels)
+void cmap_to_fb(byte *out, const byte *in, int in_pixels)
 {
     int i;
-    col_t c;
 
-    for (i = 0; i < in_pixels; i++) {
-        c = colors[*in++]; /* R:8 G:8 B:8 format! */
-        *out++ = c.r;
-        *out++ = c.g;
-        *out++ = c.b;
+    if (in_pixels <= 0)
+        return;
+
+    // Each store writes a junk 4th byte that the next pixel overwrites, so the
+    // last pixel must only write 3 bytes to not overrun the output.
+    for (i = 0; i < in_pixels - 1; i++) {
+        memcpy(out, padded_colors[*in++], 4); /* R:8 G:8 B:8 format! */
+        out += 3;
     }
+    memcpy(out, padded_colors[*in], 3);
+}
+
+#ifdef I_CPU_X86
+// Packs the R8G8B8 of each padded colour to the front of each 16-byte lane.
+#define PACK_COLORS \
+    0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1
+
+// Like cmap_to_fb, but 4 pixels at a time. Each store writes 4 junk bytes
+// that the next overwrites, so the last few pixels are left to cmap_to_fb.
+__attribute__((target("ssse3"))) static void cmap_to_fb_ssse3(
+    byte *out, const byte *in, int in_pixels)
+{
+    const __m128i pack = _mm_setr_epi8(PACK_COLORS);
+    uint32_t c[4];
+
+    for (; in_pixels >= 6; in_pixels -= 4) {
+        memcpy(&c[0], padded_colors[in[0]], 4);
+        memcpy(&c[1], padded_colors[in[1]], 4);
+        memcpy(&c[2], padded_colors[in[2]], 4);
+        memcpy(&c[3], padded_colors[in[3]], 4);
+        _mm_storeu_si128(
+            (__m128i *)out,
+            _mm_shuffle_epi8(_mm_setr_epi32(c[0], c[1], c[2], c[3]), pack));
+        out += 12;
+        in += 4;
+    }
+
+    cmap_to_fb(out, in, in_pixels);
+}
+
+// Like cmap_to_fb_ssse3, but 8 pixels at a time, gathering their colours.
+__attribute__((target("avx2"))) static void cmap_to_fb_avx2(
+    byte *out, const byte *in, int in_pixels)
+{
+    const __m256i pack = _mm256_setr_epi8(PACK_COLORS, PACK_COLORS);
+    __m256i pixels;
+
+    for (; in_pixels >= 10; in_pixels -= 8) {
+        pixels = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)in));
+        pixels = _mm256_i32gather_epi32((const int *)padded_colors, pixels, 4);
+        pixels = _mm256_shuffle_epi8(pixels, pack);
+        _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(pixels));
+        _mm_storeu_si128((__m128i *)(out + 12),
+                         _mm256_extracti128_si256(pixels, 1));
+        out += 24;
+        in += 8;
+    }
+
+    cmap_to_fb(out, in, in_pixels);
+}
+#endif
+
+// cmap_to_fb or a SIMD variant of it, installed by I_InstallFrameExpander.
+static void (*expandfunc)(byte *out, const byte *in, int in_pixels) =
+    cmap_to_fb;
+
+int I_InstallFrameExpander(void)
+{
+#ifdef I_CPU_X86
+    if (cpufeatures & CPU_AVX2) {
+        expandfunc = cmap_to_fb_avx2;
+        return CPU_AVX2;
+    }
+    if (cpufeatures & CPU_SSSE3) {
+        expandfunc = cmap_to_fb_ssse3;
+        return CPU_SSSE3;
+    }
+#endif
+
+    expandfunc = cmap_to_fb;
+    return 0;
 }
 
 void I_InitGraphics(void)
@@ -92,6 +194,8 @@ void I_InitGraphics(void)
     /* Allocate screen to draw to */
     I_VideoBuffer = (byte *)Z_Malloc(SCREENWIDTH * SCREENHEIGHT, PU_STATIC,
                                      NULL); // For DOOM to draw on
+    // Allocated up front, as frames may be expanded off the main thread.
+    scaled_buf = Z_Malloc(DOOMGENERIC_SCREEN_BUF_SIZE / 3, PU_STATIC, NULL);
 
     extern void I_InitInput(void);
     I_InitInput();
@@ -117,22 +221,74 @@ void I_UpdateNoBlit(void) {}
 
 void I_FinishUpdate(void)
 {
-    int y;
-    byte *line_in, *line_out;
+    D_ReplayFrame();
+
+    M_ProfileBegin(prof_finishupdate);
+    M_ProfileBegin(prof_drawframe);
+    DG_DrawFrame();
+    M_ProfileEnd(prof_drawframe);
+    M_ProfileEnd(prof_finishupdate);
+}
+
+//
+// I_RepeatUpdate
+// Like I_FinishUpdate, for a frame left as it was last finished.
+//
+
+void I_RepeatUpdate(void)
+{
+    D_ReplayFrame();
+
+    M_ProfileBegin(prof_finishupdate);
+    M_ProfileBegin(prof_drawframe);
+    DG_RepeatFrame();
+    M_ProfileEnd(prof_drawframe);
+    M_ProfileEnd(prof_finishupdate);
+}
+
+void I_ExpandFrameRegion(const byte *frame, const byte *palette, int x1,
+                         int y1, int x2, int y2, byte *out)
+{
+    const byte *line_in;
+    int i, y, width;
 
-    /* DRAW SCREEN */
-    line_in = I_VideoBuffer;
-    line_out = (unsigned char *)DG_ScreenBuffer;
+    if (x1 >= x2 || y1 >= y2)
+        return;
 
-    y = SCREENHEIGHT;
+    if (memcmp(palette, expand_palette, sizeof expand_palette) != 0) {
+        memcpy(expand_palette, palette, sizeof expand_palette);
+        for (i = 0; i < 256; ++i)
+            memcpy(padded_colors[i], &palette[i * 3], 3);
+    }
 
-    while (y--) {
-        cmap_to_fb(line_out, line_in, SCREENWIDTH);
-        line_out += SCREENWIDTH * 3; // R8G8B8 (3 bytes per pixel)
-        line_in += SCREENWIDTH;
+    line_in = frame;
+    width = SCREENWIDTH;
+
+    if (DG_ScreenMode) {
+        // The aspect ratio correcting modes only support full updates, but
+        // the cheaper paletted pixels are what's scaled; only the region is
+        // expanded.
+        I_InitScale((byte *)frame, scaled_buf, DG_ScreenMode->width);
+        DG_ScreenMode->DrawScreen(0, 0, ORIGWIDTH, ORIGHEIGHT);
+        line_in = scaled_buf;
+        width = DG_ScreenMode->width;
     }
 
-    DG_DrawFrame();
+    line_in += (size_t)y1 * width + x1;
+
+    for (y = y1; y < y2; ++y) {
+        expandfunc(out, line_in, x2 - x1);
+        out += (x2 - x1) * 3; // R8G8B8 (3 bytes per pixel)
+        line_in += width;
+    }
+}
+
+void I_ExpandFrame(const byte *frame, const byte *palette)
+{
+    int width = DG_ScreenMode ? DG_ScreenMode->width : SCREENWIDTH;
+    int height = DG_ScreenMode ? DG_ScreenMode->height : SCREENHEIGHT;
+
+    I_ExpandFrameRegion(frame, palette, 0, 0, width, height, DG_ScreenBuffer);
 }
 
 //
@@ -155,6 +311,7 @@ void I_ReadScreen(byte *scr)
 void I_SetPalette(byte *palette)
 {
     int i;
+    byte rgb[256 * 3];
     // col_t* c;
 
     // for (i = 0; i < 256; i++)
@@ -172,10 +329,39 @@ void I_SetPalette(byte *palette)
      * map to the right pixel format over here! */
 
     for (i = 0; i < 256; ++i) {
-        colors[i].r = gammatable[usegamma][*palette++];
-        colors[i].g = gammatable[usegamma][*palette++];
-        colors[i].b = gammatable[usegamma][*palette++];
+        rgb[i * 3] = colors[i].r = gammatable[usegamma][*palette++];
+        rgb[i * 3 + 1] = colors[i].g = gammatable[usegamma][*palette++];
+        rgb[i * 3 + 2] = colors[i].b = gammatable[usegamma][*palette++];
     }
+
+    DG_OnSetPalette(rgb, -1);
+}
+
+void I_SetPlaypal(int index)
+{
+    int lump, i, j;
+    const byte *playpal;
+
+    if (playpals_gamma != usegamma) {
+        lump = W_GetNumForName("PLAYPAL");
+        playpal = W_CacheLumpNum(lump, PU_STATIC);
+        playpals_count = W_LumpLength(lump) / (256 * 3);
+        if (playpals_count > MAXPLAYPALS)
+            playpals_count = MAXPLAYPALS;
+
+        for (i = 0; i < playpals_count; ++i) {
+            for (j = 0; j < 256 * 3; ++j)
+                playpals[i][j] = gammatable[usegamma][*playpal++];
+        }
+
+        W_ReleaseLumpNum(lump);
+        playpals_gamma = usegamma;
+    }
+
+    if (index < 0 || index >= playpals_count)
+        I_Error("I_SetPlaypal: PLAYPAL has no palette %d", index);
+
+    DG_OnSetPalette(playpals[index], index);
 }
 
 // Given an RGB value, find the closest matching palette index.
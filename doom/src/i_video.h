@@ -21,10 +21,26 @@
 
 #include "doomtype.h"
 
+// Resolution of the original game, which 2D graphics are still laid out in.
+
+#define ORIGWIDTH 320
+#define ORIGHEIGHT 200
+
+// Largest supported value of hires; 1280x800.
+
+#define MAXHIRES 2
+#define MAXWIDTH (ORIGWIDTH << MAXHIRES)
+#define MAXHEIGHT (ORIGHEIGHT << MAXHIRES)
+
+// Log2 of how many times larger than the original resolution the game is
+// rendered at; set by -hires at startup, then never changed.
+
+extern int hires;
+
 // Screen width and height.
 
-#define SCREENWIDTH 320
-#define SCREENHEIGHT 200
+#define SCREENWIDTH (ORIGWIDTH << hires)
+#define SCREENHEIGHT (ORIGHEIGHT << hires)
 
 // Screen width used for "squash" scale functions
 
@@ -100,10 +116,33 @@ void I_ShutdownGraphics(void);
 
 // Takes full 8 bit values.
 void I_SetPalette(byte *palette);
+
+// Most palettes in PLAYPAL; the original IWADs have 14: the normal one, then
+// those flashed when hurt, picking items up and wearing the radiation suit.
+#define MAXPLAYPALS 14
+
+// Set the palette to PLAYPAL's palette with this index, composed with the
+// gamma correction beforehand, so that flashing between them is cheap.
+void I_SetPlaypal(int index);
 int I_GetPaletteIndex(int r, int g, int b);
 
 void I_UpdateNoBlit(void);
 void I_FinishUpdate(void);
+void I_RepeatUpdate(void);
+
+// Write frame (SCREENWIDTH * SCREENHEIGHT palette indices) to DG_ScreenBuffer
+// as R8G8B8 using palette (256 R8G8B8 colours), scaled by DG_ScreenMode if
+// set. Only called from one thread at a time, though not always the main one.
+void I_ExpandFrame(const byte *frame, const byte *palette);
+
+// Install the variant of the frame expansion kernel for cpufeatures, returning
+// the CPU_* feature it uses, or 0.
+int I_InstallFrameExpander(void);
+
+// Like I_ExpandFrame, but only the region from x1, y1 to x2, y2 (exclusive) of
+// the scaled frame, written to out with its rows packed together.
+void I_ExpandFrameRegion(const byte *frame, const byte *palette, int x1,
+                         int y1, int x2, int y2, byte *out);
 
 void I_ReadScreen(byte *scr);
 
@@ -1138,18 +1138,23 @@ typedef enum {
     NUMSTATES
 } statenum_t;
 
+// Only the fields read on every state change, packed into 16 bytes so state
+// cycling touches as few cache lines as possible.
 typedef struct {
-    spritenum_t sprite;
-    int frame;
-    int tics;
-    // void (*action) ();
+    short sprite;         // spritenum_t
+    unsigned short frame; // frame number | FF_FULLBRIGHT
+    short tics;
+    short nextstate; // statenum_t
     actionf_t action;
-    statenum_t nextstate;
+} state_t;
+
+typedef struct {
     int misc1;
     int misc2;
-} state_t;
+} statemisc_t;
 
-extern state_t states[NUMSTATES];
+extern const state_t *states;
+extern const statemisc_t statemisc[NUMSTATES];
 extern char *sprnames[];
 
 typedef enum {
@@ -1321,6 +1326,9 @@ typedef struct {
 
 } mobjinfo_t;
 
-extern mobjinfo_t mobjinfo[NUMMOBJTYPES];
+extern const mobjinfo_t *mobjinfo;
+
+state_t *Info_WritableStates(void);
+mobjinfo_t *Info_WritableMobjInfo(void);
 
 #endif
@@ -22,6 +22,7 @@
 #include <string.h>
 
 #include "config.h"
+#include "doomfeatures.h"
 #include "doomkeys.h"
 #include "doomtype.h"
 #include "i_system.h"
@@ -664,6 +665,15 @@ static default_t doom_defaults_list[] = {
     //
 
     CONFIG_VARIABLE_INT(detached_ui),
+
+    //!
+    // (actually-doom)
+    //
+    // Send frames over the socket as palette indices, with the palette sent
+    // separately, rather than as 24-bit RGB.
+    //
+
+    CONFIG_VARIABLE_INT(indexed_frames),
 };
 
 static default_collection_t doom_defaults = {
@@ -836,6 +846,22 @@ static default_t extra_defaults_list[] = {
 
     CONFIG_VARIABLE_INT(vanilla_savegame_limit),
 
+    //!
+    // If non-zero, savegames are written compressed, which Vanilla Doom
+    // can't load.  Compressed and uncompressed savegames can both be
+    // loaded either way.
+    //
+
+    CONFIG_VARIABLE_INT(compressed_savegames),
+
+    //!
+    // If non-zero, compressed savegames only keep the sectors, lines and
+    // things that have changed since the level was loaded, so can only be
+    // loaded with the same WADs and options they were saved with.
+    //
+
+    CONFIG_VARIABLE_INT(delta_savegames),
+
     //!
     // @game doom strife
     //
@@ -847,6 +873,23 @@ static default_t extra_defaults_list[] = {
 
     CONFIG_VARIABLE_INT(vanilla_demo_limit),
 
+    //!
+    // Number of tics between the snapshots kept for rewinding the level.
+    // Rewinding runs the level on from the snapshot before, so a shorter
+    // interval makes it quicker but takes more memory.  If this has a
+    // value of zero, rewinding is disabled.
+    //
+
+    CONFIG_VARIABLE_INT(rewind_interval),
+
+    //!
+    // Most memory to keep rewind snapshots in, in KB; the oldest are
+    // dropped once it is used up.  If this has a value of zero,
+    // rewinding is disabled.
+    //
+
+    CONFIG_VARIABLE_INT(rewind_memory),
+
     //!
     // If non-zero, the game behaves like Vanilla Doom, always assuming
     // an American keyboard mapping.  If this has a value of zero, the
@@ -1254,6 +1297,60 @@ static default_t extra_defaults_list[] = {
 
     CONFIG_VARIABLE_KEY(key_spy),
 
+    //!
+    // Keyboard shortcut to take in-memory snapshot 1 of the level.
+    //
+
+    CONFIG_VARIABLE_KEY(key_snapshot_save1),
+
+    //!
+    // Keyboard shortcut to go back to in-memory snapshot 1.
+    //
+
+    CONFIG_VARIABLE_KEY(key_snapshot_load1),
+
+    //!
+    // Keyboard shortcut to take in-memory snapshot 2 of the level.
+    //
+
+    CONFIG_VARIABLE_KEY(key_snapshot_save2),
+
+    //!
+    // Keyboard shortcut to go back to in-memory snapshot 2.
+    //
+
+    CONFIG_VARIABLE_KEY(key_snapshot_load2),
+
+    //!
+    // Keyboard shortcut to take in-memory snapshot 3 of the level.
+    //
+
+    CONFIG_VARIABLE_KEY(key_snapshot_save3),
+
+    //!
+    // Keyboard shortcut to go back to in-memory snapshot 3.
+    //
+
+    CONFIG_VARIABLE_KEY(key_snapshot_load3),
+
+    //!
+    // Keyboard shortcut to take in-memory snapshot 4 of the level.
+    //
+
+    CONFIG_VARIABLE_KEY(key_snapshot_save4),
+
+    //!
+    // Keyboard shortcut to go back to in-memory snapshot 4.
+    //
+
+    CONFIG_VARIABLE_KEY(key_snapshot_load4),
+
+    //!
+    // Keyboard shortcut to rewind the level by a second.
+    //
+
+    CONFIG_VARIABLE_KEY(key_rewind),
+
     //!
     // Keyboard shortcut to increase the screen size.
     //
@@ -1549,15 +1646,64 @@ static default_collection_t extra_defaults = {
     NULL,
 };
 
-// Search a collection for a variable
+// Open-addressed hash index of the variables of both collections, built on
+// the first lookup; enough slots to keep it at most half full.
 
-static default_t *SearchCollection(default_collection_t *collection, char *name)
+#define DEFAULT_INDEX_SIZE 1024
+
+static default_t *default_index[DEFAULT_INDEX_SIZE];
+static boolean default_index_built = false;
+
+static unsigned int DefaultNameHash(const char *name)
 {
-    int i;
+    // djb2, as in W_LumpNameHash.
+
+    unsigned int result = 5381;
+
+    while (*name != '\0') {
+        result = ((result << 5) ^ result) ^ (unsigned char)*name++;
+    }
+
+    return result;
+}
+
+static void IndexCollection(default_collection_t *collection)
+{
+    unsigned int i;
+    int j;
+
+    for (j = 0; j < collection->numdefaults; ++j) {
+        i = DefaultNameHash(collection->defaults[j].name);
+
+        while (default_index[i % DEFAULT_INDEX_SIZE] != NULL) {
+            ++i;
+        }
+
+        default_index[i % DEFAULT_INDEX_SIZE] = &collection->defaults[j];
+    }
+}
+
+// Search both collections for a variable, the main one first.
+
+static default_t *SearchDefaults(const char *name)
+{
+    unsigned int i;
+
+    if (!default_index_built) {
+        if (2 * (doom_defaults.numdefaults + extra_defaults.numdefaults)
+            > DEFAULT_INDEX_SIZE) {
+            I_Error("SearchDefaults: DEFAULT_INDEX_SIZE too small");
+        }
 
-    for (i = 0; i < collection->numdefaults; ++i) {
-        if (!strcmp(name, collection->defaults[i].name)) {
-            return &collection->defaults[i];
+        IndexCollection(&doom_defaults);
+        IndexCollection(&extra_defaults);
+        default_index_built = true;
+    }
+
+    for (i = DefaultNameHash(name); default_index[i % DEFAULT_INDEX_SIZE];
+         ++i) {
+        if (!strcmp(name, default_index[i % DEFAULT_INDEX_SIZE]->name)) {
+            return default_index[i % DEFAULT_INDEX_SIZE];
         }
     }
 
@@ -1867,13 +2013,7 @@ static default_t *GetDefaultForName(char *name)
 {
     default_t *result;
 
-    // Try the main list and the extras
-
-    result = SearchCollection(&doom_defaults, name);
-
-    if (result == NULL) {
-        result = SearchCollection(&extra_defaults, name);
-    }
+    result = SearchDefaults(name);
 
     // Not found? Internal error.
 
@@ -1905,7 +2045,9 @@ boolean M_SetVariable(char *name, char *value)
 {
     default_t *variable;
 
-    variable = GetDefaultForName(name);
+    // Names may come from the client, so an unknown one isn't fatal here.
+
+    variable = SearchDefaults(name);
 
     if (variable == NULL || !variable->bound) {
         return false;
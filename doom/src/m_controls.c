@@ -106,6 +106,15 @@ int key_pause = KEY_PAUSE;
 int key_demo_quit = 'q';
 int key_spy = KEY_F12;
 
+// In-memory snapshot keys:
+
+int key_snapshot_save[4] = {'['};
+int key_snapshot_load[4] = {']'};
+
+// Rewind the level by a second:
+
+int key_rewind = KEY_BACKSPACE;
+
 // Multiplayer chat keys:
 
 int key_multi_msg = 't';
@@ -337,6 +346,9 @@ void M_BindMapControls(void)
 
 void M_BindMenuControls(void)
 {
+    char name[32];
+    unsigned int i;
+
     M_BindVariable("key_menu_activate", &key_menu_activate);
     M_BindVariable("key_menu_up", &key_menu_up);
     M_BindVariable("key_menu_down", &key_menu_down);
@@ -364,6 +376,15 @@ void M_BindMenuControls(void)
     M_BindVariable("key_menu_screenshot", &key_menu_screenshot);
     M_BindVariable("key_demo_quit", &key_demo_quit);
     M_BindVariable("key_spy", &key_spy);
+
+    for (i = 0; i < arrlen(key_snapshot_save); ++i) {
+        M_snprintf(name, sizeof(name), "key_snapshot_save%i", i + 1);
+        M_BindVariable(name, &key_snapshot_save[i]);
+        M_snprintf(name, sizeof(name), "key_snapshot_load%i", i + 1);
+        M_BindVariable(name, &key_snapshot_load[i]);
+    }
+
+    M_BindVariable("key_rewind", &key_rewind);
 }
 
 void M_BindChatControls(unsigned int num_players)
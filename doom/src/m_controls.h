@@ -58,6 +58,10 @@ extern int key_pause;
 extern int key_multi_msg;
 extern int key_multi_msgplayer[8];
 
+extern int key_snapshot_save[4];
+extern int key_snapshot_load[4];
+extern int key_rewind;
+
 extern int key_weapon1;
 extern int key_weapon2;
 extern int key_weapon3;
@@ -0,0 +1,69 @@
+#include <string.h>
+
+#include "m_counts.h"
+
+// The main thread, the workers, the I/O thread and the background thread.
+#define MAXCOUNTEDTHREADS (MAX_WORKERS + 2)
+
+const char *const workcountnames[NUMWORKCOUNTS] = {
+    "bsp_nodes",
+    "segs",
+    "visplanes",
+    "spans",
+    "columns",
+    "pixels",
+    "vissprites",
+    "sight_checks",
+    "reject_hits",
+    "path_traverses",
+    "blockmap_cells",
+    "thinkers",
+    "removed_thinkers",
+    "zmallocs",
+};
+
+#ifdef FEATURE_WORK_COUNTS
+
+THREAD_LOCAL unsigned int workcounts[NUMWORKCOUNTS];
+
+static unsigned int *threadcounts[MAXCOUNTEDTHREADS];
+static int numcountedthreads;
+
+void M_AttachWorkCounts(void)
+{
+    int i = __atomic_fetch_add(&numcountedthreads, 1, __ATOMIC_RELAXED);
+
+    if (i < MAXCOUNTEDTHREADS)
+        __atomic_store_n(&threadcounts[i], workcounts, __ATOMIC_RELEASE);
+}
+
+void M_GetWorkCounts(unsigned int counts[NUMWORKCOUNTS])
+{
+    unsigned int *thread;
+    int i;
+    int j;
+
+    memset(counts, 0, NUMWORKCOUNTS * sizeof(*counts));
+
+    for (i = 0; i < MAXCOUNTEDTHREADS; i++) {
+        thread = __atomic_load_n(&threadcounts[i], __ATOMIC_ACQUIRE);
+        if (thread == NULL)
+            continue;
+
+        for (j = 0; j < NUMWORKCOUNTS; j++)
+            counts[j] += __atomic_load_n(&thread[j], __ATOMIC_RELAXED);
+    }
+}
+
+#else
+
+void M_AttachWorkCounts(void)
+{
+}
+
+void M_GetWorkCounts(unsigned int counts[NUMWORKCOUNTS])
+{
+    memset(counts, 0, NUMWORKCOUNTS * sizeof(*counts));
+}
+
+#endif
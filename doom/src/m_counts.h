@@ -0,0 +1,47 @@
+#ifndef __M_COUNTS__
+#define __M_COUNTS__
+
+#include "doomfeatures.h"
+#include "i_thread.h"
+
+// Counts of the work done in the hot paths of the renderer and playsim, to
+// tell why a frame is slow rather than only that it is. Each thread counts
+// into its own copy, summed by M_GetWorkCounts. Without FEATURE_WORK_COUNTS,
+// M_CountWork compiles to nothing, and the counts stay at 0.
+
+typedef enum {
+    work_bspnodes,        // R_RenderBSPNode calls
+    work_segs,            // drawsegs stored by R_StoreWallRange
+    work_visplanes,       // visplanes started by R_FindPlane and R_CheckPlane
+    work_spans,           // spans drawn
+    work_columns,         // columns drawn
+    work_pixels,          // written by both; past the view's, it's overdraw
+    work_vissprites,      // R_NewVisSprite calls
+    work_sightchecks,     // P_CheckSight calls
+    work_rejecthits,      // of those, settled by the REJECT lump
+    work_pathtraverses,   // P_PathTraverse calls
+    work_blockcells,      // blockmap cells whose lines or things were iterated
+    work_thinkers,        // thinkers run by P_RunThinkers
+    work_removedthinkers, // thinkers it freed
+    work_zmallocs,        // Z_Malloc calls
+    NUMWORKCOUNTS
+} workcount_t;
+
+extern const char *const workcountnames[NUMWORKCOUNTS];
+
+#ifdef FEATURE_WORK_COUNTS
+extern THREAD_LOCAL unsigned int workcounts[NUMWORKCOUNTS];
+#define M_CountWork(count, n) (workcounts[count] += (n))
+#else
+#define M_CountWork(count, n) ((void)0)
+#endif
+
+// Have the calling thread's counts included by M_GetWorkCounts; done by each
+// of the engine's threads as it starts.
+void M_AttachWorkCounts(void);
+
+// Set counts to the totals counted by every thread so far. Those of a view
+// being drawn on another thread may be part way through.
+void M_GetWorkCounts(unsigned int counts[NUMWORKCOUNTS]);
+
+#endif
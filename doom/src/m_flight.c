@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "d_loop.h"
+#include "doomgeneric.h"
+#include "doomstat.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "m_flight.h"
+#include "m_misc.h"
+#include "p_local.h"
+#include "r_main.h"
+#include "z_zone.h"
+
+// Frames kept; the oldest are overwritten once it's full. Only those of the
+// last WINDOWUS are written out, so this is enough for hundreds of frames a
+// second.
+#define RINGSIZE 2048
+#define WINDOWUS (5 * 1000000)
+
+// Snapshots written at most; a level that hitches all over shouldn't fill the
+// disk.
+#define MAXSNAPSHOTS 16
+
+typedef struct {
+    uint64_t end;      // I_GetTimeUs when it was drawn.
+    uint32_t frametime;
+    uint32_t tictime;  // Spent running its tics.
+    int tics;
+    int gametic;
+    poolusage_t pools;
+    unsigned int zonebytes;
+    unsigned int purges; // Purgable blocks freed to make room for it.
+} flightframe_t;
+
+static boolean recording;
+static uint64_t thresholdus;
+static char *snapshotdir;
+
+static flightframe_t ring[RINGSIZE];
+static unsigned int numframes;
+
+// Tics run since the last frame.
+static int frametics;
+static uint64_t frametictime;
+static unsigned int framepurges;
+
+static int numsnapshots;
+// When the last snapshot was written; the frames it covered, and any slow
+// ones straight after from writing it, aren't written again.
+static uint64_t lastsnapshot;
+
+static unsigned int ZoneBytesUsed(void)
+{
+    unsigned int bytes = 0;
+    int tag;
+
+    for (tag = 0; tag < PU_NUM_TAGS; tag++)
+        bytes += zonestats.tagbytes[tag];
+
+    return bytes;
+}
+
+static void WriteJSONString(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(f, "\\u%04x", *s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void WriteContext(FILE *f)
+{
+    char map[9] = "";
+    mobj_t *mo = players[consoleplayer].mo;
+    duitransport_t transport;
+    thinker_t *th;
+    int thinkers = 0;
+
+    // Left empty until a level's loaded.
+    if (gamemap != 0 && gamemode == commercial)
+        M_snprintf(map, sizeof(map), "MAP%02d", gamemap);
+    else if (gamemap != 0)
+        M_snprintf(map, sizeof(map), "E%dM%d", gameepisode, gamemap);
+
+    if (thinkercap.next != NULL) {
+        for (th = thinkercap.next; th != &thinkercap; th = th->next)
+            thinkers++;
+    }
+
+    DG_GetTransport(&transport);
+
+    fprintf(f, "\"map\": ");
+    WriteJSONString(f, map);
+    fprintf(f, ",\n\"gamestate\": %d,\n\"gametic\": %d,\n\"leveltime\": %d,\n",
+            gamestate, gametic, leveltime);
+
+    if (gamestate == GS_LEVEL && mo != NULL) {
+        fprintf(f,
+                "\"player\": {\"x\": %.3f, \"y\": %.3f, \"z\": %.3f, "
+                "\"angle\": %.2f},\n",
+                (double)mo->x / FRACUNIT, (double)mo->y / FRACUNIT,
+                (double)mo->z / FRACUNIT, mo->angle * (360.0 / 4294967296.0));
+    } else {
+        fprintf(f, "\"player\": null,\n");
+    }
+
+    fprintf(f, "\"thinkers\": %d,\n", thinkers);
+    fprintf(f,
+            "\"zone\": {\"size_kib\": %u, \"used_kib\": %u, "
+            "\"purges\": %u},\n",
+            Z_ZoneSize() >> 10, ZoneBytesUsed() >> 10, zonestats.purges);
+    fprintf(f,
+            "\"transport\": {\"queued_bytes\": %u, \"frame_credits\": %u, "
+            "\"encoding\": %s},\n",
+            transport.queued_bytes, transport.frame_credits,
+            transport.encoding ? "true" : "false");
+}
+
+// Write the frames of the last WINDOWUS, oldest first.
+static void WriteFrames(FILE *f, uint64_t now)
+{
+    flightframe_t *frame;
+    unsigned int first;
+    unsigned int i;
+
+    first = numframes > RINGSIZE ? numframes - RINGSIZE : 0;
+    while (first != numframes && now - ring[first % RINGSIZE].end > WINDOWUS)
+        first++;
+
+    fprintf(f, "\"frames\": [\n");
+    for (i = first; i != numframes; i++) {
+        frame = &ring[i % RINGSIZE];
+        fprintf(f,
+                "{\"ago_us\": %u, \"frame_us\": %u, \"tics\": %d, "
+                "\"tic_us\": %u, \"gametic\": %d, \"visplanes\": %d, "
+                "\"drawsegs\": %d, \"vissprites\": %d, \"openings\": %d, "
+                "\"zone_used_kib\": %u, \"purges\": %u}%s\n",
+                (unsigned int)(now - frame->end), frame->frametime,
+                frame->tics, frame->tictime, frame->gametic,
+                frame->pools.visplanes, frame->pools.drawsegs,
+                frame->pools.vissprites, frame->pools.openings,
+                frame->zonebytes >> 10, frame->purges,
+                i + 1 != numframes ? "," : "");
+    }
+    fprintf(f, "]}\n");
+}
+
+// Write a snapshot of the recorded frames and the game's state, named after
+// why; message is the slow frame's time or I_Error's message.
+static void WriteSnapshot(const char *reason, const char *message)
+{
+    char stamp[32];
+    char *path;
+    FILE *f;
+    time_t t = time(NULL);
+    uint64_t now = I_GetTimeUs();
+
+    if (numsnapshots == MAXSNAPSHOTS) {
+        printf("M_FlightInit: Stopped after %d slow frame snapshots\n",
+               MAXSNAPSHOTS);
+        numsnapshots++;
+        return;
+    } else if (numsnapshots > MAXSNAPSHOTS) {
+        return;
+    }
+
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&t));
+    path = M_StringJoin(snapshotdir, DIR_SEPARATOR_S, reason, "-", stamp,
+                        ".json", NULL);
+    numsnapshots++;
+    lastsnapshot = now;
+
+    f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "M_FlightInit: Failed to open %s for writing\n",
+                path);
+        free(path);
+        return;
+    }
+
+    fprintf(f, "{\"reason\": ");
+    WriteJSONString(f, reason);
+    fprintf(f, ",\n\"message\": ");
+    WriteJSONString(f, message);
+    fprintf(f, ",\n\"threshold_us\": %u,\n", (unsigned int)thresholdus);
+    WriteContext(f);
+    WriteFrames(f, now);
+
+    if (fclose(f) != 0)
+        fprintf(stderr, "M_FlightInit: Failed to write %s\n", path);
+    else
+        printf("M_FlightInit: Wrote a snapshot to %s: %s\n", path, message);
+
+    free(path);
+}
+
+void M_FlightTic(uint64_t us)
+{
+    if (!recording)
+        return;
+
+    frametics++;
+    frametictime += us;
+}
+
+void M_FlightFrame(uint64_t us)
+{
+    flightframe_t *frame;
+    char message[64];
+
+    if (!recording)
+        return;
+
+    frame = &ring[numframes++ % RINGSIZE];
+    frame->end = I_GetTimeUs();
+    frame->frametime = us;
+    frame->tictime = frametictime;
+    frame->tics = frametics;
+    frame->gametic = gametic;
+    frame->pools = lastpoolusage;
+    frame->zonebytes = ZoneBytesUsed();
+    frame->purges = zonestats.purges - framepurges;
+
+    frametics = 0;
+    frametictime = 0;
+    framepurges = zonestats.purges;
+
+    if (us > thresholdus
+        && (numsnapshots == 0 || frame->end - lastsnapshot > WINDOWUS)) {
+        M_snprintf(message, sizeof(message), "Frame took %u.%03u ms",
+                   (unsigned int)(us / 1000), (unsigned int)(us % 1000));
+        WriteSnapshot("slowframe", message);
+    }
+}
+
+static void WriteErrorSnapshot(void)
+{
+    const char *message = I_ErrorMessage();
+
+    if (message != NULL)
+        WriteSnapshot("error", message);
+}
+
+void M_FlightInit(void)
+{
+    int p;
+
+    //!
+    // @arg <ms>
+    // @category obscure
+    //
+    // Keep the times and counters of the last 5 seconds of frames played in
+    // a level, and write them out as JSON, with the map, player, thinker
+    // count, zone usage and frames waiting to be sent, whenever a frame
+    // takes longer than ms milliseconds, or the game quits with an error.
+    //
+
+    p = M_CheckParmWithArgs("-slowframes", 1);
+    if (!p)
+        return;
+
+    thresholdus = (uint64_t)atoi(myargv[p + 1]) * 1000;
+
+    //!
+    // @arg <directory>
+    // @category obscure
+    //
+    // Write the snapshots of -slowframes to directory, rather than the
+    // current directory.
+    //
+
+    p = M_CheckParmWithArgs("-slowframedir", 1);
+    if (p) {
+        snapshotdir = myargv[p + 1];
+        M_MakeDirectory(snapshotdir);
+    } else {
+        snapshotdir = ".";
+    }
+
+    recording = true;
+    framepurges = zonestats.purges;
+    I_AtExit(WriteErrorSnapshot, true);
+}
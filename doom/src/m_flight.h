@@ -0,0 +1,19 @@
+#ifndef __M_FLIGHT__
+#define __M_FLIGHT__
+
+#include <stdint.h>
+
+// A flight recorder for hitches: with -slowframes, the times and counters of
+// the last few seconds of frames played in a level are kept, and written out
+// with what the game was doing whenever a frame is slow, or I_Error quits.
+
+// Check for -slowframes, and if given, start recording.
+void M_FlightInit(void);
+
+// A tic run in a level, taking us; counted towards the next frame.
+void M_FlightTic(uint64_t us);
+
+// A frame drawn in a level, us since the last.
+void M_FlightFrame(uint64_t us);
+
+#endif
@@ -0,0 +1,365 @@
+#include <string.h>
+
+#include "m_inflate.h"
+
+// Decoding DEFLATE data (RFC 1951) one bit at a time, after Mark Adler's
+// puff.c: small rather than fast, which is plenty for lumps and savegames.
+
+#define MAXBITS 15
+#define MAXLCODES 286
+#define MAXDCODES 30
+#define FIXLCODES 288
+
+typedef struct {
+    const byte *in;
+    unsigned int inlen;
+    unsigned int incnt;
+    unsigned int bitbuf;
+    unsigned int bitcnt;
+    boolean overrun; // ran out of input; pretends it's followed by zeroes
+
+    byte *out;
+    unsigned int outlen;
+    unsigned int outcnt;
+} inflate_t;
+
+// Codes of each length, and the symbols ordered by code.
+typedef struct {
+    short count[MAXBITS + 1];
+    short symbol[FIXLCODES];
+} huffman_t;
+
+static const short lbase[29] = {3,  4,  5,  6,   7,   8,   9,   10,  11, 13,
+                                15, 17, 19, 23,  27,  31,  35,  43,  51, 59,
+                                67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const short lext[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                               2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const short dbase[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+static const short dext[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                               4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                               9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static huffman_t fixedlencode;
+static huffman_t fixeddistcode;
+static boolean fixedbuilt;
+
+static unsigned int Get16(const byte *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int Bits(inflate_t *s, unsigned int need)
+{
+    unsigned int val;
+
+    val = s->bitbuf;
+    while (s->bitcnt < need) {
+        if (s->incnt == s->inlen)
+            s->overrun = true;
+        else
+            val |= (unsigned int)s->in[s->incnt++] << s->bitcnt;
+        s->bitcnt += 8;
+    }
+
+    s->bitbuf = val >> need;
+    s->bitcnt -= need;
+
+    return val & ((1u << need) - 1);
+}
+
+static int Decode(inflate_t *s, const huffman_t *h)
+{
+    int code, first, index, count;
+    int len;
+
+    code = first = index = 0;
+
+    for (len = 1; len <= MAXBITS; len++) {
+        code |= Bits(s, 1);
+        count = h->count[len];
+        if (code - count < first)
+            return h->symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+// Returns 0 for a complete code, more if it's incomplete, less if it's
+// over-subscribed.
+static int Construct(huffman_t *h, const short *length, int n)
+{
+    short offs[MAXBITS + 1];
+    int symbol;
+    int len;
+    int left;
+
+    for (len = 0; len <= MAXBITS; len++)
+        h->count[len] = 0;
+    for (symbol = 0; symbol < n; symbol++)
+        h->count[length[symbol]]++;
+    if (h->count[0] == n)
+        return 0;
+
+    left = 1;
+    for (len = 1; len <= MAXBITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0)
+            return left;
+    }
+
+    offs[1] = 0;
+    for (len = 1; len < MAXBITS; len++)
+        offs[len + 1] = offs[len] + h->count[len];
+
+    for (symbol = 0; symbol < n; symbol++) {
+        if (length[symbol] != 0)
+            h->symbol[offs[length[symbol]]++] = symbol;
+    }
+
+    return left;
+}
+
+static boolean Stored(inflate_t *s)
+{
+    unsigned int len;
+
+    // Discard what's left of the current byte.
+    s->bitbuf = 0;
+    s->bitcnt = 0;
+
+    if (s->inlen - s->incnt < 4)
+        return false;
+    len = Get16(s->in + s->incnt);
+    if (Get16(s->in + s->incnt + 2) != (~len & 0xffff))
+        return false;
+    s->incnt += 4;
+
+    if (s->inlen - s->incnt < len || s->outlen - s->outcnt < len)
+        return false;
+    memcpy(s->out + s->outcnt, s->in + s->incnt, len);
+    s->incnt += len;
+    s->outcnt += len;
+
+    return true;
+}
+
+static boolean Codes(inflate_t *s, const huffman_t *lencode,
+                     const huffman_t *distcode)
+{
+    int symbol;
+    unsigned int len;
+    unsigned int dist;
+
+    do {
+        symbol = Decode(s, lencode);
+        if (symbol < 0 || s->overrun)
+            return false;
+
+        if (symbol < 256) {
+            if (s->outcnt == s->outlen)
+                return false;
+            s->out[s->outcnt++] = symbol;
+        } else if (symbol > 256) {
+            symbol -= 257;
+            if (symbol >= 29)
+                return false;
+            len = lbase[symbol] + Bits(s, lext[symbol]);
+
+            symbol = Decode(s, distcode);
+            if (symbol < 0 || symbol >= 30)
+                return false;
+            dist = dbase[symbol] + Bits(s, dext[symbol]);
+
+            if (dist > s->outcnt || s->outlen - s->outcnt < len)
+                return false;
+            for (; len > 0; len--, s->outcnt++)
+                s->out[s->outcnt] = s->out[s->outcnt - dist];
+        }
+    } while (symbol != 256);
+
+    return true;
+}
+
+static boolean Fixed(inflate_t *s)
+{
+    short lengths[FIXLCODES];
+    int symbol;
+
+    if (!fixedbuilt) {
+        for (symbol = 0; symbol < 144; symbol++)
+            lengths[symbol] = 8;
+        for (; symbol < 256; symbol++)
+            lengths[symbol] = 9;
+        for (; symbol < 280; symbol++)
+            lengths[symbol] = 7;
+        for (; symbol < FIXLCODES; symbol++)
+            lengths[symbol] = 8;
+        Construct(&fixedlencode, lengths, FIXLCODES);
+
+        for (symbol = 0; symbol < MAXDCODES; symbol++)
+            lengths[symbol] = 5;
+        Construct(&fixeddistcode, lengths, MAXDCODES);
+
+        fixedbuilt = true;
+    }
+
+    return Codes(s, &fixedlencode, &fixeddistcode);
+}
+
+static boolean Dynamic(inflate_t *s)
+{
+    static const short order[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                    11, 4,  12, 3, 13, 2, 14, 1, 15};
+    short lengths[MAXLCODES + MAXDCODES];
+    huffman_t lencode, distcode;
+    int nlen, ndist, ncode;
+    int index;
+    int symbol;
+    int len;
+    int err;
+
+    nlen = Bits(s, 5) + 257;
+    ndist = Bits(s, 5) + 1;
+    ncode = Bits(s, 4) + 4;
+    if (nlen > MAXLCODES || ndist > MAXDCODES)
+        return false;
+
+    for (index = 0; index < ncode; index++)
+        lengths[order[index]] = Bits(s, 3);
+    for (; index < 19; index++)
+        lengths[order[index]] = 0;
+
+    // The code lengths code must be complete.
+    if (Construct(&lencode, lengths, 19) != 0)
+        return false;
+
+    index = 0;
+    while (index < nlen + ndist) {
+        symbol = Decode(s, &lencode);
+        if (symbol < 0 || s->overrun)
+            return false;
+
+        if (symbol < 16) {
+            lengths[index++] = symbol;
+            continue;
+        }
+
+        len = 0;
+        if (symbol == 16) {
+            if (index == 0)
+                return false;
+            len = lengths[index - 1];
+            symbol = 3 + Bits(s, 2);
+        } else if (symbol == 17) {
+            symbol = 3 + Bits(s, 3);
+        } else {
+            symbol = 11 + Bits(s, 7);
+        }
+
+        if (index + symbol > nlen + ndist)
+            return false;
+        while (symbol--)
+            lengths[index++] = len;
+    }
+
+    // There has to be an end-of-block code.
+    if (lengths[256] == 0)
+        return false;
+
+    // Incomplete codes are only allowed with a single length.
+    err = Construct(&lencode, lengths, nlen);
+    if (err < 0 || (err > 0 && nlen - lencode.count[0] != 1))
+        return false;
+
+    err = Construct(&distcode, lengths + nlen, ndist);
+    if (err < 0 || (err > 0 && ndist - distcode.count[0] != 1))
+        return false;
+
+    return Codes(s, &lencode, &distcode);
+}
+
+boolean M_Inflate(const byte *in, unsigned int inlen, byte *out,
+                  unsigned int outlen)
+{
+    inflate_t s;
+    boolean last;
+    boolean ok;
+
+    memset(&s, 0, sizeof(s));
+    s.in = in;
+    s.inlen = inlen;
+    s.out = out;
+    s.outlen = outlen;
+
+    do {
+        last = Bits(&s, 1);
+
+        switch (Bits(&s, 2)) {
+        case 0:
+            ok = Stored(&s);
+            break;
+        case 1:
+            ok = Fixed(&s);
+            break;
+        case 2:
+            ok = Dynamic(&s);
+            break;
+        default:
+            ok = false;
+            break;
+        }
+
+        if (!ok || s.overrun)
+            return false;
+    } while (!last);
+
+    return s.outcnt == outlen;
+}
+
+static unsigned int Adler32(const byte *p, unsigned int len)
+{
+    unsigned int a = 1, b = 0;
+    unsigned int run;
+
+    while (len > 0) {
+        // Largest run that can't overflow b before reducing it.
+        run = len < 5552 ? len : 5552;
+        len -= run;
+        while (run-- > 0) {
+            a += *p++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+boolean M_InflateZlib(const byte *in, unsigned int inlen, byte *out,
+                      unsigned int outlen)
+{
+    unsigned int adler;
+
+    // Deflated, without a preset dictionary, then the data's Adler-32.
+    if (inlen < 6 || (in[0] & 0x0f) != 8 || ((in[0] << 8) | in[1]) % 31 != 0
+        || (in[1] & 0x20) != 0) {
+        return false;
+    }
+
+    if (!M_Inflate(in + 2, inlen - 6, out, outlen))
+        return false;
+
+    in += inlen - 4;
+    adler = ((unsigned int)in[0] << 24) | (in[1] << 16) | (in[2] << 8) | in[3];
+
+    return adler == Adler32(out, outlen);
+}
@@ -0,0 +1,17 @@
+#ifndef __M_INFLATE__
+#define __M_INFLATE__
+
+#include "doomtype.h"
+
+// Decompressing DEFLATE data, for zip archives and compressed savegames.
+
+// Inflate raw DEFLATE data (RFC 1951), which must fill out exactly.
+boolean M_Inflate(const byte *in, unsigned int inlen, byte *out,
+                  unsigned int outlen);
+
+// Inflate a zlib stream (RFC 1950), as written by Deflate_Zlib, which must
+// fill out exactly and match its checksum.
+boolean M_InflateZlib(const byte *in, unsigned int inlen, byte *out,
+                      unsigned int outlen);
+
+#endif
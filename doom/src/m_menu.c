@@ -317,6 +317,9 @@ void M_ReadSaveStrings(void)
     int i;
     char name[256];
 
+    // Don't miss a savegame still being written.
+    P_FinishSaveGameWrite();
+
     for (i = 0; i < load_end; i++) {
         M_StringCopy(name, P_SaveGameFile(i), sizeof(name));
 
@@ -1083,7 +1086,7 @@ void M_WriteText(int x, int y, char *string)
         }
 
         w = SHORT(hu_font[c]->width);
-        if (cx + w > SCREENWIDTH)
+        if (cx + w > ORIGWIDTH)
             break;
         V_DrawPatchDirect(cx, cy, hu_font[c]);
         cx += w;
@@ -1386,7 +1389,7 @@ boolean M_Responder(event_t *ev)
             if (usegamma > 4)
                 usegamma = 0;
             players[consoleplayer].message = gammamsg[usegamma];
-            I_SetPalette(W_CacheLumpName("PLAYPAL", PU_CACHE));
+            I_SetPlaypal(0);
             return true;
         }
     }
@@ -1579,7 +1582,7 @@ void M_Drawer(void)
         }
 
         start = 0;
-        y = SCREENHEIGHT / 2 - M_StringHeight(messageString) / 2;
+        y = ORIGHEIGHT / 2 - M_StringHeight(messageString) / 2;
         while (messageString[start] != '\0') {
             int foundnewline = 0;
 
@@ -1601,7 +1604,7 @@ void M_Drawer(void)
                 start += strlen(string);
             }
 
-            x = SCREENWIDTH / 2 - M_StringWidth(string) / 2;
+            x = ORIGWIDTH / 2 - M_StringWidth(string) / 2;
             M_WriteText(x, y, string);
             y += SHORT(hu_font[0]->height);
         }
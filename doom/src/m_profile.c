@@ -0,0 +1,106 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "doomgeneric.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_profile.h"
+
+// Spans kept; the oldest are overwritten once it's full. About 30s of
+// frames at 35fps, or a few seconds with -uncapped.
+#define RINGSIZE (1 << 15)
+
+typedef struct {
+    uint32_t zone;
+    uint64_t start;
+    uint64_t end;
+} span_t;
+
+boolean profiling;
+
+static const char *const zonenames[NUMPROFZONES] = {
+    "R_RenderPlayerView", "R_DrawPlanes",   "R_DrawMasked",
+    "P_Ticker",           "P_RunThinkers",  "I_FinishUpdate",
+    "DG_DrawFrame",       "Comm_FlushSend",
+};
+
+static const char *outpath;
+
+static uint64_t zonestart[NUMPROFZONES];
+static span_t ring[RINGSIZE];
+// Ever recorded; wraps around the ring. Views drawn with -viewthread record
+// their zones alongside the main thread's.
+static unsigned int numspans;
+
+void M_ProfileBeginZone(profzone_t zone)
+{
+    zonestart[zone] = DG_GetTicksUs();
+}
+
+void M_ProfileEndZone(profzone_t zone)
+{
+    span_t *span =
+        &ring[__atomic_fetch_add(&numspans, 1, __ATOMIC_RELAXED) % RINGSIZE];
+
+    span->zone = zone;
+    span->start = zonestart[zone];
+    span->end = DG_GetTicksUs();
+}
+
+// Write the ring, oldest first, as complete ("X") trace events.
+static void WriteTrace(void)
+{
+    FILE *f;
+    span_t *span;
+    unsigned int first;
+    unsigned int i;
+
+    f = fopen(outpath, "w");
+    if (!f) {
+        fprintf(stderr, "M_ProfileInit: Failed to open %s for writing\n",
+                outpath);
+        return;
+    }
+
+    first = numspans > RINGSIZE ? numspans - RINGSIZE : 0;
+
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (i = first; i != numspans; i++) {
+        span = &ring[i % RINGSIZE];
+        fprintf(f,
+                "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, "
+                "\"ts\": %" PRIu64 ", \"dur\": %" PRIu64 "}%s\n",
+                zonenames[span->zone], span->start, span->end - span->start,
+                i + 1 != numspans ? "," : "");
+    }
+    fprintf(f, "]}\n");
+
+    if (fclose(f) != 0)
+        fprintf(stderr, "M_ProfileInit: Failed to write %s\n", outpath);
+    else
+        printf("M_ProfileInit: Wrote %u spans to %s\n", numspans - first,
+               outpath);
+}
+
+void M_ProfileInit(void)
+{
+    int p;
+
+    //!
+    // @arg <file>
+    // @category obscure
+    //
+    // Time the renderer, playsim and frame sending, writing the most recent
+    // spans to file at exit as Chrome trace events (for chrome://tracing or
+    // Perfetto).
+    //
+
+    p = M_CheckParmWithArgs("-profile", 1);
+    if (!p)
+        return;
+
+    outpath = myargv[p + 1];
+    profiling = true;
+    I_AtExit(WriteTrace, true);
+}
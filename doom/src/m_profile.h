@@ -0,0 +1,43 @@
+#ifndef __M_PROFILE__
+#define __M_PROFILE__
+
+#include "doomtype.h"
+
+// Scoped timers around the hot paths, recorded with -profile into a ring of
+// the most recent spans and written out at exit as Chrome trace events.
+
+// What's timed.
+typedef enum {
+    prof_renderplayerview, // R_RenderPlayerView
+    prof_drawplanes,       // R_DrawPlanes
+    prof_drawmasked,       // R_DrawMasked
+    prof_ticker,           // P_Ticker
+    prof_runthinkers,      // P_RunThinkers
+    prof_finishupdate,     // I_FinishUpdate
+    prof_drawframe,        // DG_DrawFrame
+    prof_flushsend,        // Comm_FlushSend
+    NUMPROFZONES
+} profzone_t;
+
+extern boolean profiling;
+
+// Check for -profile, and if given, start recording.
+void M_ProfileInit(void);
+
+void M_ProfileBeginZone(profzone_t zone);
+void M_ProfileEndZone(profzone_t zone);
+
+// Bracket each zone; without -profile, these only test profiling. Zones may
+// nest, but a zone can't be entered again before it ends.
+#define M_ProfileBegin(zone)          \
+    do {                              \
+        if (profiling)                \
+            M_ProfileBeginZone(zone); \
+    } while (0)
+#define M_ProfileEnd(zone)          \
+    do {                            \
+        if (profiling)              \
+            M_ProfileEndZone(zone); \
+    } while (0)
+
+#endif
@@ -29,4 +29,7 @@ int P_Random(void);
 // Fix randoms for demos.
 void M_ClearRandom(void);
 
+// Position in the table of the next P_Random.
+extern int prndindex;
+
 #endif
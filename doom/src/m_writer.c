@@ -0,0 +1,142 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "i_system.h"
+#include "i_thread.h"
+#include "m_misc.h"
+#include "m_writer.h"
+
+struct writer_s {
+    FILE *stream;
+    char *filename;
+
+    // Guarded by mutex: what's queued to be written next, and whether an I/O
+    // job has been queued to write it that hasn't yet taken it.
+    pthread_mutex_t mutex;
+    byte *queued;
+    int queuedlength;
+    int queuedsize;
+    boolean jobqueued;
+
+    // What the I/O job is writing; only touched by it.
+    byte *batch;
+    int batchsize;
+
+    // Of the last I/O job queued; only touched by the main thread.
+    unsigned int ticket;
+
+    // errno from the first write that failed, or 0. Guarded by mutex.
+    int error;
+};
+
+static void WriteJob(void *data)
+{
+    writer_t *writer = data;
+    byte *batch;
+    int length;
+    int size;
+    int error;
+
+    // Take what's queued, leaving the last batch's buffer to queue in.
+    pthread_mutex_lock(&writer->mutex);
+    batch = writer->queued;
+    length = writer->queuedlength;
+    size = writer->queuedsize;
+    writer->queued = writer->batch;
+    writer->queuedsize = writer->batchsize;
+    writer->queuedlength = 0;
+    writer->batch = batch;
+    writer->batchsize = size;
+    writer->jobqueued = false;
+    pthread_mutex_unlock(&writer->mutex);
+
+    error = 0;
+    if (fwrite(batch, 1, length, writer->stream) != (size_t)length
+        || fflush(writer->stream) != 0) {
+        error = errno ? errno : EIO;
+    }
+
+    pthread_mutex_lock(&writer->mutex);
+    if (writer->error == 0)
+        writer->error = error;
+    pthread_mutex_unlock(&writer->mutex);
+}
+
+writer_t *M_OpenWriter(const char *filename)
+{
+    writer_t *writer;
+    FILE *stream;
+
+    stream = fopen(filename, "wb");
+    if (stream == NULL)
+        return NULL;
+
+    writer = I_Realloc(NULL, sizeof(*writer));
+    memset(writer, 0, sizeof(*writer));
+    writer->stream = stream;
+    writer->filename = M_StringDuplicate(filename);
+    pthread_mutex_init(&writer->mutex, NULL);
+
+    return writer;
+}
+
+void M_QueueWrite(writer_t *writer, const void *data, int length)
+{
+    pthread_mutex_lock(&writer->mutex);
+
+    if (writer->queuedlength + length > writer->queuedsize) {
+        writer->queuedsize = (writer->queuedlength + length) * 2;
+        writer->queued = I_Realloc(writer->queued, writer->queuedsize);
+    }
+    memcpy(writer->queued + writer->queuedlength, data, length);
+    writer->queuedlength += length;
+
+    if (!writer->jobqueued) {
+        writer->jobqueued = true;
+        writer->ticket = I_QueueIO(WriteJob, writer);
+    }
+
+    pthread_mutex_unlock(&writer->mutex);
+}
+
+void M_TruncateWriter(writer_t *writer, int length)
+{
+    I_WaitIO(writer->ticket);
+
+    // Nothing touches the stream until something more is queued.
+    pthread_mutex_lock(&writer->mutex);
+    if (ftruncate(fileno(writer->stream), length) != 0
+        || fseek(writer->stream, length, SEEK_SET) != 0) {
+        if (writer->error == 0)
+            writer->error = errno;
+    }
+    pthread_mutex_unlock(&writer->mutex);
+}
+
+boolean M_CloseWriter(writer_t *writer)
+{
+    boolean ok;
+
+    I_WaitIO(writer->ticket);
+
+    if (fclose(writer->stream) != 0 && writer->error == 0)
+        writer->error = errno;
+
+    ok = writer->error == 0;
+    if (!ok) {
+        fprintf(stderr, "M_CloseWriter: Error while writing %s: %s\n",
+                writer->filename, strerror(writer->error));
+    }
+
+    pthread_mutex_destroy(&writer->mutex);
+    free(writer->queued);
+    free(writer->batch);
+    free(writer->filename);
+    free(writer);
+
+    return ok;
+}
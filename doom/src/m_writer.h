@@ -0,0 +1,27 @@
+#ifndef __M_WRITER__
+#define __M_WRITER__
+
+#include "doomtype.h"
+
+// Files appended to on the I/O thread, so the game never waits on the disk
+// while writing out something long-running, like a demo being recorded.
+// Each batch queued is flushed once written, so a crash loses at most what
+// was queued since.
+
+typedef struct writer_s writer_t;
+
+// Create or replace filename, or return NULL if it can't be opened.
+writer_t *M_OpenWriter(const char *filename);
+
+// Queue length bytes of data to be appended to the file.
+void M_QueueWrite(writer_t *writer, const void *data, int length);
+
+// Cut the file back to its first length bytes, once everything queued has
+// been written; what's queued next is appended from there.
+void M_TruncateWriter(writer_t *writer, int length);
+
+// Write what's still queued, close the file and free the writer, returning
+// whether all of it was written.
+boolean M_CloseWriter(writer_t *writer);
+
+#endif
@@ -0,0 +1,152 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     The client waiting "screen" when we are waiting for the server to
+//     start the game. There is no screen to draw it on yet, so it is
+//     printed to the console instead; the game is launched by the
+//     controlling player once enough players have joined.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "net_client.h"
+#include "net_gui.h"
+#include "net_server.h"
+
+// Number of players (including drones) to wait for before launching.
+
+static int expected_nodes;
+
+static int last_num_players = -1;
+static int last_num_drones = -1;
+
+static void PrintPlayers(void)
+{
+    int i;
+
+    if (net_client_wait_data.num_players == last_num_players
+        && net_client_wait_data.num_drones == last_num_drones) {
+        return;
+    }
+
+    last_num_players = net_client_wait_data.num_players;
+    last_num_drones = net_client_wait_data.num_drones;
+
+    printf("Waiting for game start: %i of %i players",
+           net_client_wait_data.num_players, net_client_wait_data.max_players);
+
+    if (net_client_wait_data.num_drones > 0) {
+        printf(", %i observer%s", net_client_wait_data.num_drones,
+               net_client_wait_data.num_drones > 1 ? "s" : "");
+    }
+
+    printf("\n");
+
+    for (i = 0; i < net_client_wait_data.num_players; ++i) {
+        printf("  %i. %s (%s)%s\n", i + 1,
+               net_client_wait_data.player_names[i],
+               net_client_wait_data.player_addrs[i],
+               i == net_client_wait_data.consoleplayer ? " <- you" : "");
+    }
+}
+
+static void CheckAutoLaunch(void)
+{
+    int nodes;
+
+    if (net_client_received_wait_data && net_client_wait_data.is_controller
+        && expected_nodes > 0) {
+        nodes = net_client_wait_data.num_players
+                + net_client_wait_data.num_drones;
+
+        if (nodes >= expected_nodes) {
+            NET_CL_LaunchGame();
+            expected_nodes = 0;
+        }
+    }
+}
+
+static void CheckSHA1Sums(void)
+{
+    static boolean had_warning = false;
+
+    if (!net_client_received_wait_data || had_warning) {
+        return;
+    }
+
+    if (memcmp(net_local_wad_sha1sum, net_client_wait_data.wad_sha1sum,
+               sizeof(sha1_digest_t))
+        != 0) {
+        printf("Warning: the WADs being used differ from those of the "
+               "server.\nThis may cause the game to desync.\n");
+        had_warning = true;
+    }
+
+    if (net_local_is_freedoom
+        != (unsigned int)net_client_wait_data.is_freedoom) {
+        printf("Warning: one of the players is using Freedoom and the "
+               "other isn't.\nThis may cause the game to desync.\n");
+        had_warning = true;
+    }
+}
+
+static void ParseCommandLineArgs(void)
+{
+    int i;
+
+    //!
+    // @arg <n>
+    // @category net
+    //
+    // Autostart the netgame when n nodes (clients) have joined the server.
+    // This is only used by the controller (the first player to join); the
+    // default is 2.
+    //
+
+    i = M_CheckParmWithArgs("-nodes", 1);
+
+    if (i > 0) {
+        expected_nodes = atoi(myargv[i + 1]);
+    } else {
+        expected_nodes = 2;
+    }
+}
+
+void NET_WaitForLaunch(void)
+{
+    ParseCommandLineArgs();
+
+    while (net_waiting_for_launch) {
+        if (net_client_received_wait_data) {
+            PrintPlayers();
+        }
+
+        CheckAutoLaunch();
+        CheckSHA1Sums();
+
+        NET_CL_Run();
+        NET_SV_Run();
+
+        if (!net_client_connected) {
+            I_Error("Lost connection to server");
+        }
+
+        I_Sleep(10);
+    }
+}
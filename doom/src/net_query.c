@@ -0,0 +1,221 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Querying servers to find their current status.
+//
+
+#include <stdio.h>
+
+#include "d_mode.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_misc.h"
+#include "net_defs.h"
+#include "net_io.h"
+#include "net_packet.h"
+#include "net_query.h"
+#include "net_structrw.h"
+#include "net_udp.h"
+
+// Queries are sent again this often, in case either they or the replies
+// to them were lost.
+
+#define QUERY_RESEND_PERIOD 250
+
+// Servers answering one query that are kept track of.
+
+#define MAX_RESPONSES 16
+
+static net_context_t *query_context;
+
+static net_addr_t *responders[MAX_RESPONSES];
+static int num_responders;
+
+static void NET_Query_Init(void)
+{
+    if (query_context == NULL) {
+        query_context = NET_NewContext();
+        NET_AddModule(query_context, &net_udp_module);
+        net_udp_module.InitClient();
+    }
+
+    num_responders = 0;
+}
+
+// Send a query to the given address, or broadcast it to the LAN if NULL
+
+static void NET_Query_SendQuery(net_addr_t *addr)
+{
+    net_packet_t *request;
+
+    request = NET_NewPacket(10);
+    NET_WriteInt16(request, NET_PACKET_TYPE_QUERY);
+
+    if (addr == NULL) {
+        NET_SendBroadcast(query_context, request);
+    } else {
+        NET_SendPacket(addr, request);
+    }
+
+    NET_FreePacket(request);
+}
+
+// Returns true if a response from this address has not been seen before,
+// in which case it's remembered.
+
+static boolean NET_Query_NewResponder(net_addr_t *addr)
+{
+    int i;
+
+    for (i = 0; i < num_responders; ++i) {
+        if (responders[i] == addr) {
+            return false;
+        }
+    }
+
+    if (num_responders >= MAX_RESPONSES) {
+        return false;
+    }
+
+    responders[num_responders] = addr;
+    ++num_responders;
+
+    return true;
+}
+
+// Query the given address (or the LAN, if NULL) for up to timeout ms,
+// invoking the callback once for each server that responds. Stops at the
+// first response if first_only is set. Returns the number of servers found.
+
+static int NET_Query_Run(net_addr_t *addr, int timeout, boolean first_only,
+                         net_query_callback_t callback, void *user_data)
+{
+    net_addr_t *recv_addr;
+    net_packet_t *packet;
+    net_querydata_t querydata;
+    unsigned int packet_type;
+    int start_time, last_send_time, nowtime;
+
+    NET_Query_Init();
+
+    start_time = I_GetTimeMS();
+    last_send_time = -1;
+
+    for (;;) {
+        nowtime = I_GetTimeMS();
+
+        if (nowtime - start_time > timeout) {
+            break;
+        }
+
+        if (last_send_time < 0
+            || nowtime - last_send_time > QUERY_RESEND_PERIOD) {
+            NET_Query_SendQuery(addr);
+            last_send_time = nowtime;
+        }
+
+        while (NET_RecvPacket(query_context, &recv_addr, &packet)) {
+            if (NET_ReadInt16(packet, &packet_type)
+                && packet_type == NET_PACKET_TYPE_QUERY_RESPONSE
+                && NET_ReadQueryData(packet, &querydata)
+                && NET_Query_NewResponder(recv_addr)) {
+                callback(recv_addr, &querydata, nowtime - last_send_time,
+                         user_data);
+            }
+
+            NET_FreePacket(packet);
+
+            if (first_only && num_responders > 0) {
+                return num_responders;
+            }
+        }
+
+        I_Sleep(10);
+    }
+
+    return num_responders;
+}
+
+static void PrintHeader(void)
+{
+    printf("\n%-20s %6s %-7s %-10s %s\n", "Address", "Ping", "Players",
+           "Game", "Description");
+    printf("==============================================================="
+           "=======\n");
+}
+
+static void PrintResponse(net_addr_t *addr, net_querydata_t *data,
+                          unsigned int ping_time, void *user_data)
+{
+    char players[16];
+
+    (void)user_data;
+
+    M_snprintf(players, sizeof(players), "%i/%i", data->num_players,
+               data->max_players);
+
+    printf("%-20s %4ims %-7s %-10s %s%s\n", NET_AddrToString(addr),
+           ping_time, players, D_GameMissionString(data->gamemission),
+           data->description, data->server_state != 0 ? " (in game)" : "");
+}
+
+static void NoteResponse(net_addr_t *addr, net_querydata_t *data,
+                         unsigned int ping_time, void *user_data)
+{
+    (void)data;
+    (void)ping_time;
+
+    *(net_addr_t **)user_data = addr;
+}
+
+void NET_LANQuery(void)
+{
+    printf("\nSearching for servers on local LAN ...\n");
+
+    PrintHeader();
+
+    if (NET_Query_Run(NULL, 1000, false, PrintResponse, NULL) == 0) {
+        printf("No servers found.\n");
+    }
+}
+
+void NET_QueryAddress(char *addr_str)
+{
+    net_addr_t *addr;
+
+    NET_Query_Init();
+
+    addr = NET_ResolveAddress(query_context, addr_str);
+
+    if (addr == NULL) {
+        I_Error("NET_QueryAddress: Host '%s' not found!", addr_str);
+    }
+
+    printf("\nQuerying '%s'...\n", addr_str);
+
+    PrintHeader();
+
+    if (NET_Query_Run(addr, 5000, true, PrintResponse, NULL) == 0) {
+        I_Error("No response from '%s'", addr_str);
+    }
+}
+
+net_addr_t *NET_FindLANServer(void)
+{
+    net_addr_t *result = NULL;
+
+    NET_Query_Run(NULL, 2000, true, NoteResponse, &result);
+
+    return result;
+}
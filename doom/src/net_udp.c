@@ -0,0 +1,338 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Networking module which uses UDP sockets
+//
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "doomgeneric.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "net_defs.h"
+#include "net_io.h"
+#include "net_packet.h"
+#include "net_udp.h"
+#include "z_zone.h"
+
+//
+// NETWORKING
+//
+
+#define DEFAULT_PORT 2342
+
+// Larger than any packet sent: game data is split so it stays well within
+// a single Ethernet frame.
+
+#define MAX_PACKET_SIZE 4096
+
+static int port = DEFAULT_PORT;
+static int udpsocket = -1;
+
+typedef struct {
+    net_addr_t net_addr;
+    struct sockaddr_in sa;
+} addrpair_t;
+
+static addrpair_t **addr_table;
+static int addr_table_size = 0;
+
+// Finds an address by searching the table.  If the address is not found,
+// it is added to the table, so the same sender always maps to the same
+// net_addr_t.
+
+static net_addr_t *NET_UDP_FindAddress(const struct sockaddr_in *sa)
+{
+    addrpair_t *new_entry;
+    int empty_entry = -1;
+    int i;
+
+    for (i = 0; i < addr_table_size; ++i) {
+        if (addr_table[i] == NULL) {
+            if (empty_entry < 0)
+                empty_entry = i;
+        } else if (addr_table[i]->sa.sin_addr.s_addr == sa->sin_addr.s_addr
+                   && addr_table[i]->sa.sin_port == sa->sin_port) {
+            return &addr_table[i]->net_addr;
+        }
+    }
+
+    // Was not found in list.  We need to add it.
+    // Is there any space in the table? If not, double its size.
+
+    if (empty_entry < 0) {
+        empty_entry = addr_table_size;
+        addr_table_size = addr_table_size > 0 ? addr_table_size * 2 : 16;
+        addr_table = I_Realloc(addr_table,
+                               addr_table_size * sizeof(*addr_table));
+
+        for (i = empty_entry; i < addr_table_size; ++i)
+            addr_table[i] = NULL;
+    }
+
+    // Add a new entry
+
+    new_entry = Z_Malloc(sizeof(addrpair_t), PU_STATIC, 0);
+
+    new_entry->sa = *sa;
+    new_entry->net_addr.handle = &new_entry->sa;
+    new_entry->net_addr.module = &net_udp_module;
+
+    addr_table[empty_entry] = new_entry;
+
+    return &new_entry->net_addr;
+}
+
+static void NET_UDP_FreeAddress(net_addr_t *addr)
+{
+    int i;
+
+    for (i = 0; i < addr_table_size; ++i) {
+        if (addr_table[i] != NULL && addr == &addr_table[i]->net_addr) {
+            Z_Free(addr_table[i]);
+            addr_table[i] = NULL;
+            return;
+        }
+    }
+
+    I_Error("NET_UDP_FreeAddress: Attempted to remove an unused address!");
+}
+
+// Opens the socket, bound to the given port (0 for any), once for both
+// client and server use.
+
+static boolean NET_UDP_OpenSocket(int bind_port)
+{
+    struct sockaddr_in sa;
+    int one = 1;
+    int tos = IPTOS_LOWDELAY;
+    int flags;
+
+    if (udpsocket >= 0)
+        return true;
+
+    udpsocket = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (udpsocket < 0) {
+        I_Error("NET_UDP_OpenSocket: Unable to create a socket: %s",
+                strerror(errno));
+    }
+
+    // Packets are polled for between tics, never waited on.
+
+    flags = fcntl(udpsocket, F_GETFL);
+
+    if (flags < 0 || fcntl(udpsocket, F_SETFL, flags | O_NONBLOCK) < 0) {
+        I_Error("NET_UDP_OpenSocket: Unable to make the socket "
+                "non-blocking: %s",
+                strerror(errno));
+    }
+
+    // Needed for LAN searches; failing only breaks those.
+
+    setsockopt(udpsocket, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+
+    // Game data is tiny and time-critical, so ask for it to be queued
+    // ahead of bulk traffic. Not every network honours this.
+
+    setsockopt(udpsocket, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_ANY);
+    sa.sin_port = htons(bind_port);
+
+    if (bind(udpsocket, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        I_Error("NET_UDP_OpenSocket: Unable to bind to port %i: %s",
+                bind_port, strerror(errno));
+    }
+
+    // Packets arriving cut short the sleeps between tics.
+
+    DG_SetWakeFd(udpsocket);
+
+    return true;
+}
+
+static void NET_UDP_ReadPortParm(void)
+{
+    int p;
+
+    //!
+    // @arg <n>
+    // @category net
+    //
+    // Use the specified UDP port for communications, instead of
+    // the default (2342).
+    //
+
+    p = M_CheckParmWithArgs("-port", 1);
+
+    if (p > 0) {
+        port = atoi(myargv[p + 1]);
+    }
+}
+
+static boolean NET_UDP_InitClient(void)
+{
+    NET_UDP_ReadPortParm();
+
+    return NET_UDP_OpenSocket(0);
+}
+
+static boolean NET_UDP_InitServer(void)
+{
+    NET_UDP_ReadPortParm();
+
+    return NET_UDP_OpenSocket(port);
+}
+
+static void NET_UDP_SendPacket(net_addr_t *addr, net_packet_t *packet)
+{
+    struct sockaddr_in sa;
+
+    if (udpsocket < 0)
+        return;
+
+    if (addr == &net_broadcast_addr) {
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+        sa.sin_port = htons(port);
+    } else {
+        sa = *(struct sockaddr_in *)addr->handle;
+    }
+
+    // A packet that can't be sent right now is as good as one lost on
+    // the way, which the protocol already copes with.
+
+    sendto(udpsocket, packet->data, packet->len, 0, (struct sockaddr *)&sa,
+           sizeof(sa));
+}
+
+static boolean NET_UDP_RecvPacket(net_addr_t **addr, net_packet_t **packet)
+{
+    static byte buf[MAX_PACKET_SIZE];
+    struct sockaddr_in sa;
+    socklen_t sa_len;
+    ssize_t result;
+
+    if (udpsocket < 0)
+        return false;
+
+    for (;;) {
+        sa_len = sizeof(sa);
+        result = recvfrom(udpsocket, buf, sizeof(buf), 0,
+                          (struct sockaddr *)&sa, &sa_len);
+
+        if (result >= 0) {
+            break;
+        }
+
+        // Errors such as ICMP port unreachable replies are reported once,
+        // and only mean that a packet sent earlier was lost.
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return false;
+        }
+    }
+
+    if (sa.sin_family != AF_INET) {
+        return false;
+    }
+
+    *packet = NET_NewPacket(result);
+    memcpy((*packet)->data, buf, result);
+    (*packet)->len = result;
+
+    *addr = NET_UDP_FindAddress(&sa);
+
+    return true;
+}
+
+static void NET_UDP_AddrToString(net_addr_t *addr, char *buffer,
+                                 int buffer_len)
+{
+    struct sockaddr_in *sa;
+    char host[INET_ADDRSTRLEN];
+
+    sa = addr->handle;
+
+    inet_ntop(AF_INET, &sa->sin_addr, host, sizeof(host));
+
+    if (ntohs(sa->sin_port) != DEFAULT_PORT) {
+        M_snprintf(buffer, buffer_len, "%s:%i", host, ntohs(sa->sin_port));
+    } else {
+        M_snprintf(buffer, buffer_len, "%s", host);
+    }
+}
+
+static net_addr_t *NET_UDP_ResolveAddress(char *address)
+{
+    struct addrinfo hints;
+    struct addrinfo *result;
+    struct sockaddr_in sa;
+    char *colon;
+    char *host;
+    int addr_port;
+    int err;
+
+    if (address == NULL) {
+        return NULL;
+    }
+
+    colon = strrchr(address, ':');
+    host = M_StringDuplicate(address);
+
+    if (colon != NULL) {
+        host[colon - address] = '\0';
+        addr_port = atoi(colon + 1);
+    } else {
+        addr_port = port;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    err = getaddrinfo(host, NULL, &hints, &result);
+    free(host);
+
+    if (err != 0) {
+        return NULL;
+    }
+
+    sa = *(struct sockaddr_in *)result->ai_addr;
+    sa.sin_port = htons(addr_port);
+    freeaddrinfo(result);
+
+    return NET_UDP_FindAddress(&sa);
+}
+
+// Complete module
+
+net_module_t net_udp_module = {
+    NET_UDP_InitClient,   NET_UDP_InitServer,   NET_UDP_SendPacket,
+    NET_UDP_RecvPacket,   NET_UDP_AddrToString, NET_UDP_FreeAddress,
+    NET_UDP_ResolveAddress,
+};
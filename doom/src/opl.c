@@ -0,0 +1,463 @@
+#include <math.h>
+#include <string.h>
+
+#include "doomtype.h"
+#include "opl.h"
+
+#define NUM_CHANNELS 9
+#define NUM_OPERATORS (NUM_CHANNELS * 2)
+
+// The chip's own sample rate: its 3.58MHz clock over 72.
+#define NATIVE_RATE 49716.0
+
+#define TWO_PI 6.28318531f
+
+#define SINE_BITS 10
+#define SINE_LEN (1 << SINE_BITS)
+
+// Attenuation, in dB, at which an operator can no longer be heard.
+#define SILENT_DB 96.0f
+
+// Attenuation is turned into gain through a table in steps of ATTEN_STEP dB.
+#define ATTEN_STEP 0.125f
+#define ATTEN_LEN (96 * 8 + 1) // to SILENT_DB
+
+// Full-scale output of one operator.
+#define OUTPUT_SCALE 8192
+
+typedef enum {
+    ENV_OFF,
+    ENV_ATTACK,
+    ENV_DECAY,
+    ENV_SUSTAIN,
+    ENV_RELEASE,
+} envstage_t;
+
+typedef struct {
+    // From the registers.
+    boolean tremolo;
+    boolean vibrato;
+    boolean sustained; // holds at the sustain level until released
+    boolean ksr;
+    int mult;
+    int ksl;
+    int level;
+    int attack;
+    int decay;
+    int sustain;
+    int release;
+    int waveform;
+
+    // Worked out from them by UpdateOperator. Rates are per sample.
+    uint32_t phase_inc;
+    float attack_coef;
+    float decay_step;
+    float release_step;
+    float sustain_db;
+    float base_db; // total level and key scaling
+
+    uint32_t phase; // fraction of a cycle
+    envstage_t stage;
+    float env_db;
+} operator_t;
+
+typedef struct {
+    int fnum;
+    int block;
+    boolean key_on;
+    int feedback;
+    boolean additive;
+    // The modulator's last two outputs, for feedback.
+    float feedback_out[2];
+} channel_t;
+
+static unsigned rate;
+
+static channel_t channels[NUM_CHANNELS];
+// Each channel's modulator, then carrier.
+static operator_t operators[NUM_OPERATORS];
+
+static boolean waveform_select;
+static boolean note_select;
+static boolean deep_tremolo;
+static boolean deep_vibrato;
+
+static float waveforms[4][SINE_LEN];
+static float atten_gain[ATTEN_LEN];
+
+// Low frequency oscillators for tremolo and vibrato.
+static uint32_t tremolo_phase;
+static uint32_t tremolo_inc;
+static uint32_t vibrato_phase;
+static uint32_t vibrato_inc;
+
+// Register offsets of each operator, from which channels take their
+// modulator at +0 and carrier at +3.
+static const int channel_offsets[NUM_CHANNELS] = {
+    0x00, 0x01, 0x02, 0x08, 0x09, 0x0a, 0x10, 0x11, 0x12,
+};
+
+// MULT, doubled.
+static const int mult_x2[16] = {
+    1, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 20, 24, 24, 30, 30,
+};
+
+// Key scale level attenuation in octave 7, by the top 4 bits of fnum, in dB.
+// Each octave lower is 6dB less.
+static const float ksl_db[16] = {
+    0.0f,  9.0f,  12.0f, 13.875f, 15.0f,  16.125f, 16.875f, 17.625f,
+    18.0f, 18.75f, 19.125f, 19.5f, 19.875f, 20.25f, 20.625f, 21.0f,
+};
+
+// Cycles of phase offset per unit of the modulator's last two outputs, for
+// each feedback setting.
+static const float feedback_scale[8] = {
+    0, 1 / 64.0f, 1 / 32.0f, 1 / 16.0f, 1 / 8.0f, 1 / 4.0f, 1 / 2.0f, 1,
+};
+
+// Right shifts of ksl_db for each KSL setting: none, 3, 1.5 and 6dB/octave.
+static const int ksl_shift[4] = {-1, 1, 2, 0};
+
+// The operator at a register offset (the low 5 bits of the register), or -1.
+static int OperatorAt(int offset)
+{
+    int i;
+
+    for (i = 0; i < NUM_CHANNELS; ++i) {
+        if (offset == channel_offsets[i])
+            return i * 2;
+        if (offset == channel_offsets[i] + 3)
+            return i * 2 + 1;
+    }
+
+    return -1;
+}
+
+static void InitTables(void)
+{
+    int i;
+
+    for (i = 0; i < SINE_LEN; ++i) {
+        float s = sinf(TWO_PI * i / SINE_LEN);
+
+        waveforms[0][i] = s;
+        waveforms[1][i] = s > 0 ? s : 0;
+        waveforms[2][i] = fabsf(s);
+        // Only the rising quarters of the absolute sine.
+        waveforms[3][i] = (i & (SINE_LEN / 4)) ? 0 : fabsf(s);
+    }
+
+    for (i = 0; i < ATTEN_LEN; ++i)
+        atten_gain[i] = powf(10, -(i * ATTEN_STEP) / 20);
+}
+
+// An envelope rate of 1 to 15 with key scaling added, 0 to 63 (0 to 3 being
+// "never").
+static int EffectiveRate(int r, int rof)
+{
+    if (r == 0)
+        return 0;
+    r = r * 4 + rof;
+    return r > 63 ? 63 : r;
+}
+
+// Samples taken at an effective rate to go through an envelope phase that
+// takes base_ms at rate 4.
+static float RateSamples(int r, float base_ms)
+{
+    return base_ms / 1000 * rate * powf(2, (4 - r) / 4.0f);
+}
+
+static void UpdateOperator(int op_index)
+{
+    operator_t *op = &operators[op_index];
+    const channel_t *ch = &channels[op_index / 2];
+    double freq;
+    float ksl;
+    int ksn;
+    int rof;
+    int r;
+
+    freq = ch->fnum * NATIVE_RATE / (1 << (20 - ch->block));
+    freq *= mult_x2[op->mult] / 2.0;
+    op->phase_inc = (uint32_t)(freq / rate * 4294967296.0);
+
+    // The key scale number: the block and the top of fnum.
+    ksn = ch->block * 2 + ((ch->fnum >> (note_select ? 8 : 9)) & 1);
+    rof = op->ksr ? ksn : ksn >> 2;
+
+    r = EffectiveRate(op->attack, rof);
+    if (r >= 60)
+        op->attack_coef = 1;
+    else if (r == 0)
+        op->attack_coef = 0;
+    else
+        op->attack_coef = 1 - powf(0.1f / SILENT_DB,
+                                   1 / RateSamples(r, 2826));
+
+    // Decay and release take 39280ms to fall 96dB at rate 4.
+    r = EffectiveRate(op->decay, rof);
+    op->decay_step = r == 0 ? 0 : SILENT_DB / RateSamples(r, 39280);
+    r = EffectiveRate(op->release, rof);
+    op->release_step = r == 0 ? 0 : SILENT_DB / RateSamples(r, 39280);
+
+    op->sustain_db = op->sustain == 15 ? 93 : op->sustain * 3;
+
+    ksl = 0;
+    if (ksl_shift[op->ksl] >= 0) {
+        ksl = ksl_db[ch->fnum >> 6] - 6 * (7 - ch->block);
+        if (ksl < 0)
+            ksl = 0;
+        ksl /= 1 << ksl_shift[op->ksl];
+    }
+    op->base_db = op->level * 0.75f + ksl;
+}
+
+static void UpdateChannel(int ch)
+{
+    UpdateOperator(ch * 2);
+    UpdateOperator(ch * 2 + 1);
+}
+
+static void KeyOn(int ch)
+{
+    int i;
+
+    for (i = ch * 2; i < ch * 2 + 2; ++i) {
+        operators[i].phase = 0;
+        operators[i].stage = ENV_ATTACK;
+    }
+    channels[ch].feedback_out[0] = channels[ch].feedback_out[1] = 0;
+}
+
+static void KeyOff(int ch)
+{
+    int i;
+
+    for (i = ch * 2; i < ch * 2 + 2; ++i) {
+        if (operators[i].stage != ENV_OFF)
+            operators[i].stage = ENV_RELEASE;
+    }
+}
+
+void OPL_Init(unsigned _rate)
+{
+    int i;
+
+    rate = _rate;
+    InitTables();
+
+    memset(channels, 0, sizeof(channels));
+    memset(operators, 0, sizeof(operators));
+    for (i = 0; i < NUM_OPERATORS; ++i)
+        operators[i].env_db = SILENT_DB;
+
+    waveform_select = false;
+    note_select = false;
+    deep_tremolo = false;
+    deep_vibrato = false;
+
+    tremolo_phase = vibrato_phase = 0;
+    tremolo_inc = (uint32_t)(3.7 / rate * 4294967296.0);
+    vibrato_inc = (uint32_t)(6.1 / rate * 4294967296.0);
+
+    for (i = 0; i < NUM_CHANNELS; ++i)
+        UpdateChannel(i);
+}
+
+void OPL_WriteRegister(int reg, int value)
+{
+    operator_t *op;
+    channel_t *ch;
+    int i;
+
+    reg &= 0xff;
+    value &= 0xff;
+
+    switch (reg & 0xe0) {
+    case 0x20:
+    case 0x40:
+    case 0x60:
+    case 0x80:
+    case 0xe0:
+        i = OperatorAt(reg & 0x1f);
+        if (i < 0)
+            return;
+        op = &operators[i];
+
+        switch (reg & 0xe0) {
+        case 0x20:
+            op->tremolo = (value & 0x80) != 0;
+            op->vibrato = (value & 0x40) != 0;
+            op->sustained = (value & 0x20) != 0;
+            op->ksr = (value & 0x10) != 0;
+            op->mult = value & 0x0f;
+            break;
+        case 0x40:
+            op->ksl = value >> 6;
+            op->level = value & 0x3f;
+            break;
+        case 0x60:
+            op->attack = value >> 4;
+            op->decay = value & 0x0f;
+            break;
+        case 0x80:
+            op->sustain = value >> 4;
+            op->release = value & 0x0f;
+            break;
+        case 0xe0:
+            op->waveform = value & 0x03;
+            break;
+        }
+        UpdateOperator(i);
+        return;
+    }
+
+    if (reg == 0x01) {
+        waveform_select = (value & 0x20) != 0;
+    } else if (reg == 0x08) {
+        note_select = (value & 0x40) != 0;
+        for (i = 0; i < NUM_CHANNELS; ++i)
+            UpdateChannel(i);
+    } else if (reg == 0xbd) {
+        deep_tremolo = (value & 0x80) != 0;
+        deep_vibrato = (value & 0x40) != 0;
+    } else if (reg >= 0xa0 && reg <= 0xa8) {
+        ch = &channels[reg - 0xa0];
+        ch->fnum = (ch->fnum & 0x300) | value;
+        UpdateChannel(reg - 0xa0);
+    } else if (reg >= 0xb0 && reg <= 0xb8) {
+        ch = &channels[reg - 0xb0];
+        ch->fnum = (ch->fnum & 0xff) | ((value & 0x03) << 8);
+        ch->block = (value >> 2) & 0x07;
+        UpdateChannel(reg - 0xb0);
+
+        if ((value & 0x20) && !ch->key_on)
+            KeyOn(reg - 0xb0);
+        else if (!(value & 0x20) && ch->key_on)
+            KeyOff(reg - 0xb0);
+        ch->key_on = (value & 0x20) != 0;
+    } else if (reg >= 0xc0 && reg <= 0xc8) {
+        ch = &channels[reg - 0xc0];
+        ch->feedback = (value >> 1) & 0x07;
+        ch->additive = (value & 0x01) != 0;
+    }
+}
+
+// Moves an operator's envelope on by a sample.
+static void AdvanceEnvelope(operator_t *op)
+{
+    switch (op->stage) {
+    case ENV_OFF:
+        break;
+    case ENV_ATTACK:
+        op->env_db -= op->env_db * op->attack_coef;
+        if (op->env_db < 0.1f) {
+            op->env_db = 0;
+            op->stage = ENV_DECAY;
+        }
+        break;
+    case ENV_DECAY:
+        op->env_db += op->decay_step;
+        if (op->env_db >= op->sustain_db) {
+            op->env_db = op->sustain_db;
+            op->stage = ENV_SUSTAIN;
+        }
+        break;
+    case ENV_SUSTAIN:
+        // Percussive sounds carry on fading at the release rate.
+        if (op->sustained)
+            break;
+        /* fall through */
+    case ENV_RELEASE:
+        op->env_db += op->release_step;
+        if (op->env_db >= SILENT_DB) {
+            op->env_db = SILENT_DB;
+            op->stage = ENV_OFF;
+        }
+        break;
+    }
+}
+
+// An operator's output this sample, between -1 and 1, with its phase offset
+// by some cycles. Moves it on to the next sample.
+static float OperatorOutput(operator_t *op, float offset, float tremolo_db,
+                            float vibrato)
+{
+    float atten = op->env_db + op->base_db;
+    float out = 0;
+    uint32_t i;
+
+    if (op->tremolo)
+        atten += tremolo_db;
+
+    if (atten < SILENT_DB) {
+        i = (op->phase >> (32 - SINE_BITS))
+            + (uint32_t)(int32_t)(offset * SINE_LEN);
+        out = waveforms[waveform_select ? op->waveform : 0][i & (SINE_LEN - 1)]
+              * atten_gain[(int)(atten / ATTEN_STEP)];
+    }
+
+    if (op->vibrato)
+        op->phase += (uint32_t)(op->phase_inc * vibrato);
+    else
+        op->phase += op->phase_inc;
+    AdvanceEnvelope(op);
+
+    return out;
+}
+
+void OPL_Render(int16_t *samples, unsigned count)
+{
+    float tremolo_db;
+    float vibrato;
+    float fb_offset;
+    float mod;
+    float out;
+    long v;
+    channel_t *ch;
+    operator_t *ops;
+    unsigned i;
+    int j;
+
+    for (i = 0; i < count; ++i) {
+        // Tremolo is a triangle of 1 or 4.8dB; vibrato 7 or 14 cents.
+        tremolo_db = (deep_tremolo ? 4.8f : 1.0f)
+                     * fabsf((int32_t)tremolo_phase / 2147483648.0f);
+        vibrato = 1 + (deep_vibrato ? 0.0081f : 0.0040f)
+                          * sinf(vibrato_phase / 4294967296.0f * TWO_PI);
+        tremolo_phase += tremolo_inc;
+        vibrato_phase += vibrato_inc;
+
+        out = 0;
+        for (j = 0; j < NUM_CHANNELS; ++j) {
+            ch = &channels[j];
+            ops = &operators[j * 2];
+
+            if (ops[0].stage == ENV_OFF && ops[1].stage == ENV_OFF)
+                continue;
+
+            fb_offset = (ch->feedback_out[0] + ch->feedback_out[1])
+                        * feedback_scale[ch->feedback];
+            mod = OperatorOutput(&ops[0], fb_offset, tremolo_db, vibrato);
+            ch->feedback_out[0] = ch->feedback_out[1];
+            ch->feedback_out[1] = mod;
+
+            // Frequency modulation shifts the carrier's phase by up to 4
+            // cycles.
+            if (ch->additive) {
+                out += mod;
+                out += OperatorOutput(&ops[1], 0, tremolo_db, vibrato);
+            } else {
+                out += OperatorOutput(&ops[1], mod * 4, tremolo_db, vibrato);
+            }
+        }
+
+        v = lrintf(out * OUTPUT_SCALE);
+        if (v < INT16_MIN)
+            v = INT16_MIN;
+        else if (v > INT16_MAX)
+            v = INT16_MAX;
+        samples[i] = v;
+    }
+}
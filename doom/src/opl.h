@@ -0,0 +1,20 @@
+#ifndef OPL_H
+#define OPL_H
+
+#include <stdint.h>
+
+// A software Yamaha YM3812 (OPL2), programmed through its registers like the
+// real chip, rendering mono at any sample rate. It's an approximation of the
+// chip's sound (melodic mode only), not a cycle-accurate emulation.
+//
+// There's one chip, and it's not thread-safe: only one thread may use it.
+
+// Resets every register and sets the rate samples are rendered at.
+void OPL_Init(unsigned rate);
+
+void OPL_WriteRegister(int reg, int value);
+
+// Renders count samples, advancing the chip by that long.
+void OPL_Render(int16_t *samples, unsigned count);
+
+#endif
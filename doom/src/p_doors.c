@@ -228,7 +228,7 @@ int EV_DoDoor(line_t *line, vldoor_e type)
 
         // new door thinker
         rtn = 1;
-        door = Z_Malloc(sizeof(*door), PU_LEVSPEC, 0);
+        door = P_AllocThinker(sizeof(*door));
         P_AddThinker(&door->thinker);
         sec->specialdata = door;
 
@@ -408,7 +408,7 @@ void EV_VerticalDoor(line_t *line, mobj_t *thing)
     }
 
     // new door thinker
-    door = Z_Malloc(sizeof(*door), PU_LEVSPEC, 0);
+    door = P_AllocThinker(sizeof(*door));
     P_AddThinker(&door->thinker);
     sec->specialdata = door;
     door->thinker.function = T_VerticalDoor;
@@ -456,7 +456,7 @@ void P_SpawnDoorCloseIn30(sector_t *sec)
 {
     vldoor_t *door;
 
-    door = Z_Malloc(sizeof(*door), PU_LEVSPEC, 0);
+    door = P_AllocThinker(sizeof(*door));
 
     P_AddThinker(&door->thinker);
 
@@ -478,7 +478,7 @@ void P_SpawnDoorRaiseIn5Mins(sector_t *sec)
 {
     vldoor_t *door;
 
-    door = Z_Malloc(sizeof(*door), PU_LEVSPEC, 0);
+    door = P_AllocThinker(sizeof(*door));
 
     P_AddThinker(&door->thinker);
 
@@ -687,7 +687,7 @@ EV_SlidingDoor
     // Init sliding door vars
     if (!door)
     {
-        door = Z_Malloc (sizeof(*door), PU_LEVSPEC, 0);
+        door = P_AllocThinker(sizeof(*door));
         P_AddThinker (&door->thinker);
         sec->specialdata = door;
 
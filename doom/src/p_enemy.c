@@ -20,12 +20,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "d_loop.h"
 #include "doomdef.h"
 #include "doomstat.h"
 #include "g_game.h"
 #include "i_system.h"
+#include "m_argv.h"
 #include "m_random.h"
 #include "p_local.h"
 #include "p_spec.h"
@@ -59,6 +61,131 @@ dirtype_t diags[] = {DI_NORTHWEST, DI_NORTHEAST, DI_SOUTHWEST, DI_SOUTHEAST};
 
 void A_Fall(mobj_t *actor);
 
+//
+// LOOK WHEEL
+//
+// With -farlook, a monster that looks for players and finds none, none of
+// them within that distance and no noise in its sector, then sleeps for
+// a second before carrying on. It waits in the wheel's slot for the tic
+// it's due; noise reaching its sector, damage or a change of state wake it
+// sooner. The wheel changes when monsters notice players, so it is not
+// used in demos or netgames.
+//
+
+#define LOOKWHEELSIZE 64 // a power of two above FARLOOKTICS
+#define FARLOOKTICS TICRATE
+
+static int farlookdist; // in map units, or 0
+static mobj_t *lookwheel[LOOKWHEELSIZE];
+
+int parkedlookers;
+unsigned int deferredlooks;
+
+//
+// P_InitLookWheel
+//
+void P_InitLookWheel(void)
+{
+    int p;
+
+    //!
+    // @arg <units>
+    // @category game
+    //
+    // Have monsters waiting for a player further away than this from every
+    // player look for one less often. Ignored while recording or playing
+    // back demos and in netgames.
+    //
+
+    p = M_CheckParmWithArgs("-farlook", 1);
+    if (p)
+        farlookdist = atoi(myargv[p + 1]);
+}
+
+//
+// P_ClearLookWheel
+// Empties the wheel, before the level's mobjs are freed.
+//
+void P_ClearLookWheel(void)
+{
+    memset(lookwheel, 0, sizeof(lookwheel));
+    parkedlookers = 0;
+}
+
+//
+// P_UnparkLooker
+// Takes a monster out of the wheel, if it's in it.
+//
+void P_UnparkLooker(mobj_t *mo)
+{
+    if (!mo->lookprev)
+        return;
+
+    *mo->lookprev = mo->looknext;
+    if (mo->looknext)
+        mo->looknext->lookprev = mo->lookprev;
+    mo->lookprev = NULL;
+    parkedlookers--;
+}
+
+//
+// P_RunLookWheel
+// Wakes the monsters due to look again this tic.
+//
+void P_RunLookWheel(void)
+{
+    mobj_t **slot;
+    mobj_t *mo;
+
+    slot = &lookwheel[leveltime & (LOOKWHEELSIZE - 1)];
+    while ((mo = *slot) != NULL) {
+        P_UnparkLooker(mo);
+        P_WakeThinker(&mo->thinker);
+    }
+}
+
+static boolean FarFromPlayers(mobj_t *actor)
+{
+    mobj_t *mo;
+    int i;
+
+    if (farlookdist <= 0 || demoplayback || demorecording || netgame)
+        return false;
+
+    for (i = 0; i < MAXPLAYERS; i++) {
+        if (!playeringame[i] || !players[i].mo)
+            continue;
+
+        // in map units, as the map can be wider than fixed_t can hold
+        mo = players[i].mo;
+        if (P_AproxDistance((mo->x >> FRACBITS) - (actor->x >> FRACBITS),
+                            (mo->y >> FRACBITS) - (actor->y >> FRACBITS))
+            < farlookdist) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void ParkLooker(mobj_t *actor)
+{
+    mobj_t **slot;
+
+    P_UnparkLooker(actor);
+
+    slot = &lookwheel[(leveltime + FARLOOKTICS) & (LOOKWHEELSIZE - 1)];
+    actor->looknext = *slot;
+    actor->lookprev = slot;
+    if (*slot)
+        (*slot)->lookprev = &actor->looknext;
+    *slot = actor;
+
+    parkedlookers++;
+    deferredlooks++;
+    P_SleepThinker(&actor->thinker);
+}
+
 //
 // ENEMY THINKING
 // Enemies are allways spawned
@@ -69,48 +196,102 @@ void A_Fall(mobj_t *actor);
 
 //
 // Called by P_NoiseAlert.
-// Recursively traverse adjacent sectors,
+// Traverse adjacent sectors,
 // sound blocking lines cut off traversal.
 //
+// This floods from a stack of sectors still to visit rather than
+// recursing. A sector is visited again whenever the sound reaches it
+// through fewer sound blocking lines, so the sectors end up marked the
+// same as in vanilla whatever order they are visited in.
+//
 
 mobj_t *soundtarget;
 
-void P_RecursiveSound(sector_t *sec, int soundblocks)
-{
-    int i;
-    line_t *check;
-    sector_t *other;
+typedef struct {
+    sector_t *sector;
+    int soundblocks;
+} soundvisit_t;
+
+static soundvisit_t *soundstack;
+static int maxsoundstack;
 
-    // wake up all monsters in this sector
+static void PushSound(int *count, sector_t *sec, int soundblocks)
+{
     if (sec->validcount == validcount
         && sec->soundtraversed <= soundblocks + 1) {
         return; // already flooded
     }
 
-    sec->validcount = validcount;
-    sec->soundtraversed = soundblocks + 1;
-    sec->soundtarget = soundtarget;
+    if (*count == maxsoundstack) {
+        maxsoundstack = maxsoundstack ? maxsoundstack * 2 : 256;
+        soundstack =
+            I_Realloc(soundstack, maxsoundstack * sizeof(*soundstack));
+    }
 
-    for (i = 0; i < sec->linecount; i++) {
-        check = sec->lines[i];
-        if (!(check->flags & ML_TWOSIDED))
-            continue;
+    soundstack[*count].sector = sec;
+    soundstack[*count].soundblocks = soundblocks;
+    ++*count;
+}
 
-        P_LineOpening(check);
+void P_RecursiveSound(sector_t *sec, int soundblocks)
+{
+    int count;
+    int i;
+    sectorlink_t *link;
+    line_t *check;
+    fixed_t top;
+    fixed_t bottom;
+    mobj_t *mo;
 
-        if (openrange <= 0)
-            continue; // closed door
+    count = 0;
+    PushSound(&count, sec, soundblocks);
 
-        if (sides[check->sidenum[0]].sector == sec)
-            other = sides[check->sidenum[1]].sector;
-        else
-            other = sides[check->sidenum[0]].sector;
+    while (count > 0) {
+        --count;
+        sec = soundstack[count].sector;
+        soundblocks = soundstack[count].soundblocks;
 
-        if (check->flags & ML_SOUNDBLOCK) {
-            if (!soundblocks)
-                P_RecursiveSound(other, 1);
-        } else
-            P_RecursiveSound(other, soundblocks);
+        // wake up all monsters in this sector
+        if (sec->validcount == validcount
+            && sec->soundtraversed <= soundblocks + 1) {
+            continue; // already flooded
+        }
+
+        sec->validcount = validcount;
+        sec->soundtraversed = soundblocks + 1;
+        sec->soundtarget = soundtarget;
+
+        if (farlookdist > 0) {
+            for (mo = sec->thinglist; mo; mo = mo->snext) {
+                if (mo->lookprev) {
+                    P_UnparkLooker(mo);
+                    P_WakeThinker(&mo->thinker);
+                }
+            }
+        }
+
+        for (i = 0; i < sec->neighbourcount; i++) {
+            link = &sec->neighbours[i];
+            check = link->line;
+
+            // The same test as P_LineOpening's openrange, without
+            // touching the globals it sets.
+            top = check->frontsector->ceilingheight;
+            if (check->backsector->ceilingheight < top)
+                top = check->backsector->ceilingheight;
+            bottom = check->frontsector->floorheight;
+            if (check->backsector->floorheight > bottom)
+                bottom = check->backsector->floorheight;
+
+            if (top - bottom <= 0)
+                continue; // closed door
+
+            if (check->flags & ML_SOUNDBLOCK) {
+                if (!soundblocks)
+                    PushSound(&count, link->other, 1);
+            } else
+                PushSound(&count, link->other, soundblocks);
+        }
     }
 }
 
@@ -295,7 +476,7 @@ boolean P_TryWalk(mobj_t *actor)
     return true;
 }
 
-void P_NewChaseDir(mobj_t *actor)
+static void NewChaseDir(mobj_t *actor)
 {
     fixed_t deltax;
     fixed_t deltay;
@@ -403,6 +584,18 @@ void P_NewChaseDir(mobj_t *actor)
     actor->movedir = DI_NODIR; // can not move
 }
 
+//
+// P_NewChaseDir
+// Every move tried is at most speed away, so they share a neighbourhood (see
+// P_StartNeighbourhood).
+//
+void P_NewChaseDir(mobj_t *actor)
+{
+    P_StartNeighbourhood(actor, actor->info->speed * FRACUNIT);
+    NewChaseDir(actor);
+    P_EndNeighbourhood();
+}
+
 //
 // P_LookForPlayers
 // If allaround is false, only look 180 degrees in front.
@@ -472,10 +665,8 @@ void A_KeenDie(mobj_t *mo)
 
     // scan the remaining thinkers
     // to see if all Keens are dead
-    for (th = thinkercap.next; th != &thinkercap; th = th->next) {
-        if (th->function != P_MobjThinker)
-            continue;
-
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj];
+         th = th->cnext) {
         mo2 = (mobj_t *)th;
         if (mo2 != mo && mo2->type == mo->type && mo2->health > 0) {
             // other Keen not dead
@@ -512,8 +703,11 @@ void A_Look(mobj_t *actor)
             goto seeyou;
     }
 
-    if (!P_LookForPlayers(actor, false))
+    if (!P_LookForPlayers(actor, false)) {
+        if (!targ && FarFromPlayers(actor))
+            ParkLooker(actor);
         return;
+    }
 
     // go into chase state
 seeyou:
@@ -1002,7 +1196,7 @@ void A_VileChase(mobj_t *actor)
     int bx;
     int by;
 
-    mobjinfo_t *info;
+    const mobjinfo_t *info;
     mobj_t *temp;
 
     if (actor->movedir != DI_NODIR) {
@@ -1149,8 +1343,9 @@ void A_VileAttack(mobj_t *actor)
         return;
 
     // move the fire between the vile and the player
-    fire->x = actor->target->x - FixedMul(24 * FRACUNIT, finecosine[an]);
-    fire->y = actor->target->y - FixedMul(24 * FRACUNIT, finesine[an]);
+    P_MoveThingInPlace(
+        fire, actor->target->x - FixedMul(24 * FRACUNIT, finecosine[an]),
+        actor->target->y - FixedMul(24 * FRACUNIT, finesine[an]));
     P_RadiusAttack(fire, actor, 70);
 }
 
@@ -1280,12 +1475,11 @@ void A_PainShootSkull(mobj_t *actor, angle_t angle)
     // count total number of skull currently on the level
     count = 0;
 
-    currentthinker = thinkercap.next;
-    while (currentthinker != &thinkercap) {
-        if ((currentthinker->function == P_MobjThinker)
-            && ((mobj_t *)currentthinker)->type == MT_SKULL)
+    currentthinker = thinkerclasscap[th_mobj].cnext;
+    while (currentthinker != &thinkerclasscap[th_mobj]) {
+        if (((mobj_t *)currentthinker)->type == MT_SKULL)
             count++;
-        currentthinker = currentthinker->next;
+        currentthinker = currentthinker->cnext;
     }
 
     // if there are allready 20 skulls on the level,
@@ -1477,10 +1671,8 @@ void A_BossDeath(mobj_t *mo)
 
     // scan the remaining thinkers to see
     // if all bosses are dead
-    for (th = thinkercap.next; th != &thinkercap; th = th->next) {
-        if (th->function != P_MobjThinker)
-            continue;
-
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj];
+         th = th->cnext) {
         mo2 = (mobj_t *)th;
         if (mo2 != mo && mo2->type == mo->type && mo2->health > 0) {
             // other boss not dead
@@ -1586,12 +1778,8 @@ void A_BrainAwake(mobj_t *mo)
     numbraintargets = 0;
     braintargeton = 0;
 
-    thinker = thinkercap.next;
-    for (thinker = thinkercap.next; thinker != &thinkercap;
-         thinker = thinker->next) {
-        if (thinker->function != P_MobjThinker)
-            continue; // not a mobj
-
+    for (thinker = thinkerclasscap[th_mobj].cnext;
+         thinker != &thinkerclasscap[th_mobj]; thinker = thinker->cnext) {
         m = (mobj_t *)thinker;
 
         if (m->type == MT_BOSSTARGET) {
@@ -37,6 +37,8 @@ result_e T_MovePlane(sector_t *sector, fixed_t speed, fixed_t dest,
     boolean flag;
     fixed_t lastpos;
 
+    P_ClearSightCache();
+
     switch (floorOrCeiling) {
     case 0:
         // FLOOR
@@ -221,7 +223,7 @@ int EV_DoFloor(line_t *line, floor_e floortype)
 
         // new floor thinker
         rtn = 1;
-        floor = Z_Malloc(sizeof(*floor), PU_LEVSPEC, 0);
+        floor = P_AllocThinker(sizeof(*floor));
         P_AddThinker(&floor->thinker);
         sec->specialdata = floor;
         floor->thinker.function = T_MoveFloor;
@@ -394,7 +396,7 @@ int EV_BuildStairs(line_t *line, stair_e type)
 
         // new floor thinker
         rtn = 1;
-        floor = Z_Malloc(sizeof(*floor), PU_LEVSPEC, 0);
+        floor = P_AllocThinker(sizeof(*floor));
         P_AddThinker(&floor->thinker);
         sec->specialdata = floor;
         floor->thinker.function = T_MoveFloor;
@@ -444,7 +446,7 @@ int EV_BuildStairs(line_t *line, stair_e type)
 
                 sec = tsec;
                 secnum = newsecnum;
-                floor = Z_Malloc(sizeof(*floor), PU_LEVSPEC, 0);
+                floor = P_AllocThinker(sizeof(*floor));
 
                 P_AddThinker(&floor->thinker);
 
@@ -76,6 +76,7 @@ boolean P_GiveAmmo(player_t *player, ammotype_t ammo, int num)
 
     if (player->ammo[ammo] > player->maxammo[ammo])
         player->ammo[ammo] = player->maxammo[ammo];
+    player->statusdirty = true;
 
     // If non zero ammo,
     // don't change up weapons,
@@ -140,6 +141,7 @@ boolean P_GiveWeapon(player_t *player, weapontype_t weapon, boolean dropped)
 
         player->bonuscount += BONUSADD;
         player->weaponowned[weapon] = true;
+        player->statusdirty = true;
 
         if (deathmatch)
             P_GiveAmmo(player, weaponinfo[weapon].ammo, 5);
@@ -168,6 +170,7 @@ boolean P_GiveWeapon(player_t *player, weapontype_t weapon, boolean dropped)
     } else {
         gaveweapon = true;
         player->weaponowned[weapon] = true;
+        player->statusdirty = true;
         player->pendingweapon = weapon;
     }
 
@@ -577,6 +580,7 @@ void P_TouchSpecialThing(mobj_t *special, mobj_t *toucher)
         player->itemcount++;
     P_RemoveMobj(special);
     player->bonuscount += BONUSADD;
+    player->statusdirty = true;
     if (player == &players[consoleplayer])
         S_StartSound(NULL, sound);
 }
@@ -694,6 +698,9 @@ void P_DamageMobj(mobj_t *target, mobj_t *inflictor, mobj_t *source, int damage)
     if (target->health <= 0)
         return;
 
+    // It may be thrust or change state.
+    P_WakeThinker(&target->thinker);
+
     if (target->flags & MF_SKULLFLY) {
         target->momx = target->momy = target->momz = 0;
     }
@@ -757,6 +764,7 @@ void P_DamageMobj(mobj_t *target, mobj_t *inflictor, mobj_t *source, int damage)
         player->health -= damage; // mirror mobj health here for Dave
         if (player->health < 0)
             player->health = 0;
+        player->statusdirty = true;
 
         player->attacker = source;
         player->damagecount += damage; // add damage after armor / invuln
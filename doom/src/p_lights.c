@@ -17,6 +17,12 @@
 //      Muzzle flash?
 //
 
+#include <string.h>
+
+#include "doomstat.h"
+#include "i_system.h"
+#include "i_thread.h"
+#include "m_argv.h"
 #include "m_random.h"
 #include "p_local.h"
 #include "p_spec.h"
@@ -28,17 +34,15 @@
 //
 
 //
-// T_FireFlicker
+// FireFlickerStep
+// The part of T_FireFlicker after the countdown runs out, with the random
+// number it uses passed in.
 //
-void T_FireFlicker(thinker_t *thinker)
+static void FireFlickerStep(fireflicker_t *flick, int random)
 {
-    fireflicker_t *flick = (fireflicker_t *)thinker;
     int amount;
 
-    if (--flick->count)
-        return;
-
-    amount = (P_Random() & 3) * 16;
+    amount = (random & 3) * 16;
 
     if (flick->sector->lightlevel - amount < flick->minlight)
         flick->sector->lightlevel = flick->minlight;
@@ -48,6 +52,19 @@ void T_FireFlicker(thinker_t *thinker)
     flick->count = 4;
 }
 
+//
+// T_FireFlicker
+//
+void T_FireFlicker(thinker_t *thinker)
+{
+    fireflicker_t *flick = (fireflicker_t *)thinker;
+
+    if (--flick->count)
+        return;
+
+    FireFlickerStep(flick, P_Random());
+}
+
 //
 // P_SpawnFireFlicker
 //
@@ -59,7 +76,7 @@ void P_SpawnFireFlicker(sector_t *sector)
     // Nothing special about it during gameplay.
     sector->special = 0;
 
-    flick = Z_Malloc(sizeof(*flick), PU_LEVSPEC, 0);
+    flick = P_AllocThinker(sizeof(*flick));
 
     P_AddThinker(&flick->thinker);
 
@@ -75,6 +92,22 @@ void P_SpawnFireFlicker(sector_t *sector)
 // BROKEN LIGHT FLASHING
 //
 
+//
+// LightFlashStep
+// The part of T_LightFlash after the countdown runs out, with the random
+// number it uses passed in.
+//
+static void LightFlashStep(lightflash_t *flash, int random)
+{
+    if (flash->sector->lightlevel == flash->maxlight) {
+        flash->sector->lightlevel = flash->minlight;
+        flash->count = (random & flash->mintime) + 1;
+    } else {
+        flash->sector->lightlevel = flash->maxlight;
+        flash->count = (random & flash->maxtime) + 1;
+    }
+}
+
 //
 // T_LightFlash
 // Do flashing lights.
@@ -86,13 +119,7 @@ void T_LightFlash(thinker_t *thinker)
     if (--flash->count)
         return;
 
-    if (flash->sector->lightlevel == flash->maxlight) {
-        flash->sector->lightlevel = flash->minlight;
-        flash->count = (P_Random() & flash->mintime) + 1;
-    } else {
-        flash->sector->lightlevel = flash->maxlight;
-        flash->count = (P_Random() & flash->maxtime) + 1;
-    }
+    LightFlashStep(flash, P_Random());
 }
 
 //
@@ -107,7 +134,7 @@ void P_SpawnLightFlash(sector_t *sector)
     // nothing special about it during gameplay
     sector->special = 0;
 
-    flash = Z_Malloc(sizeof(*flash), PU_LEVSPEC, 0);
+    flash = P_AllocThinker(sizeof(*flash));
 
     P_AddThinker(&flash->thinker);
 
@@ -153,7 +180,7 @@ void P_SpawnStrobeFlash(sector_t *sector, int fastOrSlow, int inSync)
 {
     strobe_t *flash;
 
-    flash = Z_Malloc(sizeof(*flash), PU_LEVSPEC, 0);
+    flash = P_AllocThinker(sizeof(*flash));
 
     P_AddThinker(&flash->thinker);
 
@@ -200,27 +227,21 @@ void EV_StartLightStrobing(line_t *line)
 void EV_TurnTagLightsOff(line_t *line)
 {
     int i;
-    int j;
+    int secnum;
     int min;
     sector_t *sector;
     sector_t *tsec;
-    line_t *templine;
-
-    sector = sectors;
-
-    for (j = 0; j < numsectors; j++, sector++) {
-        if (sector->tag == line->tag) {
-            min = sector->lightlevel;
-            for (i = 0; i < sector->linecount; i++) {
-                templine = sector->lines[i];
-                tsec = getNextSector(templine, sector);
-                if (!tsec)
-                    continue;
-                if (tsec->lightlevel < min)
-                    min = tsec->lightlevel;
-            }
-            sector->lightlevel = min;
+
+    secnum = -1;
+    while ((secnum = P_FindSectorFromLineTag(line, secnum)) >= 0) {
+        sector = &sectors[secnum];
+        min = sector->lightlevel;
+        for (i = 0; i < sector->neighbourcount; i++) {
+            tsec = sector->neighbours[i].other;
+            if (tsec->lightlevel < min)
+                min = tsec->lightlevel;
         }
+        sector->lightlevel = min;
     }
 }
 
@@ -229,33 +250,26 @@ void EV_TurnTagLightsOff(line_t *line)
 //
 void EV_LightTurnOn(line_t *line, int bright)
 {
-    int i;
+    int secnum;
     int j;
     sector_t *sector;
     sector_t *temp;
-    line_t *templine;
-
-    sector = sectors;
-
-    for (i = 0; i < numsectors; i++, sector++) {
-        if (sector->tag == line->tag) {
-            // bright = 0 means to search
-            // for highest light level
-            // surrounding sector
-            if (!bright) {
-                for (j = 0; j < sector->linecount; j++) {
-                    templine = sector->lines[j];
-                    temp = getNextSector(templine, sector);
-
-                    if (!temp)
-                        continue;
-
-                    if (temp->lightlevel > bright)
-                        bright = temp->lightlevel;
-                }
+
+    secnum = -1;
+    while ((secnum = P_FindSectorFromLineTag(line, secnum)) >= 0) {
+        sector = &sectors[secnum];
+        // bright = 0 means to search
+        // for highest light level
+        // surrounding sector
+        if (!bright) {
+            for (j = 0; j < sector->neighbourcount; j++) {
+                temp = sector->neighbours[j].other;
+
+                if (temp->lightlevel > bright)
+                    bright = temp->lightlevel;
             }
-            sector->lightlevel = bright;
         }
+        sector->lightlevel = bright;
     }
 }
 
@@ -292,7 +306,7 @@ void P_SpawnGlowingLight(sector_t *sector)
 {
     glow_t *g;
 
-    g = Z_Malloc(sizeof(*g), PU_LEVSPEC, 0);
+    g = P_AllocThinker(sizeof(*g));
 
     P_AddThinker(&g->thinker);
 
@@ -304,3 +318,209 @@ void P_SpawnGlowingLight(sector_t *sector)
 
     sector->special = 0;
 }
+
+//
+// PARALLEL LIGHT BATCH
+//
+// With -parallellights, P_RunThinkers passes the light thinkers to
+// P_BatchLightThinker instead of running them in place, and P_RunLightBatch
+// then runs them all on the worker threads. A light only touches itself and
+// its sector's lightlevel, and every light of a sector goes to the same
+// worker in list order, so the result doesn't depend on the worker count.
+// The random numbers the flashing lights need are drawn beforehand in list
+// order; that puts them after the other thinkers' draws, which is not what
+// vanilla does, so demos and netgames never batch.
+//
+
+typedef struct {
+    thinker_t *thinker;
+    sector_t *sector;
+    size_t size;
+    // Drawn for this tic by P_RunLightBatch if the light needs one.
+    int random;
+} batchlight_t;
+
+// Big enough to hold a copy of any light thinker.
+typedef union {
+    fireflicker_t flicker;
+    lightflash_t flash;
+    strobe_t strobe;
+    glow_t glow;
+} anylight_t;
+
+boolean parallellights;
+static boolean checklightbatch;
+
+static batchlight_t *lightbatch;
+static int numlightbatch;
+static int maxlightbatch;
+
+// For -checklightbatch: the batch before it ran, and after a serial run.
+static anylight_t *lightsnapshot;
+static anylight_t *lightresult;
+static short *snapshotlevels;
+static short *resultlevels;
+
+//
+// P_InitLightBatch
+//
+void P_InitLightBatch(void)
+{
+    //!
+    // Run sector lighting effects on the -renderthreads workers. This
+    // changes the order random numbers are drawn in, so it is ignored
+    // while recording or playing back demos and in netgames.
+    //
+
+    parallellights = M_CheckParm("-parallellights") > 0;
+
+    //!
+    // With -parallellights, also run each batch of lights serially and
+    // stop with an error if the results differ.
+    //
+
+    checklightbatch = M_CheckParm("-checklightbatch") > 0;
+}
+
+//
+// P_BatchLightThinker
+// Queue the thinker for P_RunLightBatch if it is a light, returning whether
+// it was.
+//
+boolean P_BatchLightThinker(thinker_t *thinker)
+{
+    batchlight_t *light;
+    int newmax;
+
+    if (thinker->function != T_FireFlicker && thinker->function != T_LightFlash
+        && thinker->function != T_StrobeFlash && thinker->function != T_Glow) {
+        return false;
+    }
+
+    if (numlightbatch == maxlightbatch) {
+        newmax = maxlightbatch ? maxlightbatch * 2 : 64;
+        lightbatch = I_Realloc(lightbatch, newmax * sizeof(*lightbatch));
+        lightsnapshot =
+            I_Realloc(lightsnapshot, newmax * sizeof(*lightsnapshot));
+        lightresult = I_Realloc(lightresult, newmax * sizeof(*lightresult));
+        snapshotlevels =
+            I_Realloc(snapshotlevels, newmax * sizeof(*snapshotlevels));
+        resultlevels = I_Realloc(resultlevels, newmax * sizeof(*resultlevels));
+        maxlightbatch = newmax;
+    }
+
+    light = &lightbatch[numlightbatch++];
+    light->thinker = thinker;
+    light->random = 0;
+
+    if (thinker->function == T_FireFlicker) {
+        light->sector = ((fireflicker_t *)thinker)->sector;
+        light->size = sizeof(fireflicker_t);
+    } else if (thinker->function == T_LightFlash) {
+        light->sector = ((lightflash_t *)thinker)->sector;
+        light->size = sizeof(lightflash_t);
+    } else if (thinker->function == T_StrobeFlash) {
+        light->sector = ((strobe_t *)thinker)->sector;
+        light->size = sizeof(strobe_t);
+    } else {
+        light->sector = ((glow_t *)thinker)->sector;
+        light->size = sizeof(glow_t);
+    }
+
+    return true;
+}
+
+//
+// RunBatchedLight
+// Like calling the thinker, but using the random number drawn for it.
+//
+static void RunBatchedLight(batchlight_t *light)
+{
+    thinker_t *thinker = light->thinker;
+    fireflicker_t *flick;
+    lightflash_t *flash;
+
+    if (thinker->function == T_FireFlicker) {
+        flick = (fireflicker_t *)thinker;
+        if (!--flick->count)
+            FireFlickerStep(flick, light->random);
+    } else if (thinker->function == T_LightFlash) {
+        flash = (lightflash_t *)thinker;
+        if (!--flash->count)
+            LightFlashStep(flash, light->random);
+    } else {
+        thinker->function(thinker);
+    }
+}
+
+static void LightBatchWorker(int worker_i, void *data)
+{
+    int workers = *(int *)data;
+    int i;
+
+    for (i = 0; i < numlightbatch; ++i) {
+        if ((lightbatch[i].sector - sectors) % workers == worker_i)
+            RunBatchedLight(&lightbatch[i]);
+    }
+}
+
+//
+// P_RunLightBatch
+// Run the lights queued by P_BatchLightThinker this tic.
+//
+void P_RunLightBatch(void)
+{
+    batchlight_t *light;
+    int workers;
+    int i;
+
+    // Only the last tic of a countdown draws a random number.
+    for (i = 0; i < numlightbatch; ++i) {
+        light = &lightbatch[i];
+        if ((light->thinker->function == T_FireFlicker
+             && ((fireflicker_t *)light->thinker)->count == 1)
+            || (light->thinker->function == T_LightFlash
+                && ((lightflash_t *)light->thinker)->count == 1)) {
+            light->random = P_Random();
+        }
+    }
+
+    if (checklightbatch) {
+        for (i = 0; i < numlightbatch; ++i) {
+            light = &lightbatch[i];
+            memcpy(&lightsnapshot[i], light->thinker, light->size);
+            snapshotlevels[i] = light->sector->lightlevel;
+        }
+
+        workers = 1;
+        LightBatchWorker(0, &workers);
+
+        for (i = 0; i < numlightbatch; ++i) {
+            light = &lightbatch[i];
+            memcpy(&lightresult[i], light->thinker, light->size);
+            resultlevels[i] = light->sector->lightlevel;
+        }
+        for (i = 0; i < numlightbatch; ++i) {
+            light = &lightbatch[i];
+            memcpy(light->thinker, &lightsnapshot[i], light->size);
+            light->sector->lightlevel = snapshotlevels[i];
+        }
+    }
+
+    workers = I_WorkerCount();
+    I_RunWorkers(LightBatchWorker, &workers);
+
+    if (checklightbatch) {
+        for (i = 0; i < numlightbatch; ++i) {
+            light = &lightbatch[i];
+            if (memcmp(light->thinker, &lightresult[i], light->size)
+                || light->sector->lightlevel != resultlevels[i]) {
+                I_Error("P_RunLightBatch: Light in sector %d differs from "
+                        "a serial run",
+                        (int)(light->sector - sectors));
+            }
+        }
+    }
+
+    numlightbatch = 0;
+}
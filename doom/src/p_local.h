@@ -36,6 +36,13 @@
 #define MAPBMASK (MAPBLOCKSIZE - 1)
 #define MAPBTOFRAC (MAPBLOCKSHIFT - FRACBITS)
 
+// Things in blocks holding more than FINEBLOCKTHINGS are also found through
+// finer cells, FINEBLOCKUNITS across (see P_FineThingsIterator).
+#define FINEBLOCKUNITS 32
+#define FINEBLOCKSHIFT (FRACBITS + 5)
+#define FINEBLOCKSPERBLOCK (MAPBLOCKUNITS / FINEBLOCKUNITS)
+#define FINEBLOCKTHINGS 16
+
 // player radius for movement checking
 #define PLAYERRADIUS 16 * FRACUNIT
 
@@ -61,9 +68,27 @@
 // both the head and tail of the thinker list
 extern thinker_t thinkercap;
 
+// Thinkers are also kept in a list per class, in the same order as
+// thinkercap, for code that only wants one kind. Thinkers leave their class
+// list once they're removed.
+typedef enum {
+    th_mobj,    // P_MobjThinker
+    th_special, // sector specials: movers and lights
+    NUMTHCLASSES
+} thclass_t;
+
+// both the head and tail of each class list
+extern thinker_t thinkerclasscap[NUMTHCLASSES];
+
 void P_InitThinkers(void);
+void *P_AllocThinker(size_t size);
+void P_FreeThinker(thinker_t *thinker);
+void P_ClearThinkerMemory(void);
 void P_AddThinker(thinker_t *thinker);
 void P_RemoveThinker(thinker_t *thinker);
+void P_SleepThinker(thinker_t *thinker);
+void P_WakeThinker(thinker_t *thinker);
+void P_WakeAllThinkers(void);
 
 //
 // P_PSPR
@@ -91,9 +116,15 @@ extern int itemrespawntime[ITEMQUESIZE];
 extern int iquehead;
 extern int iquetail;
 
+// Dead players' bodies, the oldest removed once there are too many.
+#define BODYQUESIZE 32
+
+extern mobj_t *bodyque[BODYQUESIZE];
+
 void P_RespawnSpecials(void);
 
 mobj_t *P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type);
+void P_StopInterpolating(mobj_t *mobj);
 
 void P_RemoveMobj(mobj_t *th);
 mobj_t *P_SubstNullMobj(mobj_t *th);
@@ -110,6 +141,21 @@ void P_SpawnPlayerMissile(mobj_t *source, mobjtype_t type);
 //
 void P_NoiseAlert(mobj_t *target, mobj_t *emmiter);
 
+void P_InitLookWheel(void);
+void P_ClearLookWheel(void);
+void P_RunLookWheel(void);
+void P_UnparkLooker(mobj_t *mo);
+
+// Monsters waiting in the look wheel, and how many times monsters have
+// been put in it, for stats.
+extern int parkedlookers;
+extern unsigned int deferredlooks;
+
+// The boss brain's spawn spots, in the order it shoots cubes at them.
+extern mobj_t *braintargets[32];
+extern int numbraintargets;
+extern int braintargeton;
+
 //
 // P_MAPUTL
 //
@@ -130,14 +176,16 @@ typedef struct {
     } d;
 } intercept_t;
 
-// Extended MAXINTERCEPTS, to allow for intercepts overrun emulation.
+// The size of the intercepts table in vanilla, past which overruns are
+// emulated (see InterceptsOverrun()). intercepts itself grows as needed.
 
 #define MAXINTERCEPTS_ORIGINAL 128
-#define MAXINTERCEPTS (MAXINTERCEPTS_ORIGINAL + 61)
 
-extern intercept_t intercepts[MAXINTERCEPTS];
+extern intercept_t *intercepts;
 extern intercept_t *intercept_p;
 
+boolean P_EmulateOverruns(void);
+
 typedef boolean (*traverser_t)(intercept_t *in);
 
 fixed_t P_AproxDistance(fixed_t dx, fixed_t dy);
@@ -154,8 +202,94 @@ extern fixed_t lowfloor;
 
 void P_LineOpening(line_t *linedef);
 
+void P_MoveThingInPlace(mobj_t *thing, fixed_t x, fixed_t y);
+
+// How many things are linked into a block, and how many of those are wider
+// than the others can be.
+typedef struct {
+    int numthings;
+    short numwide; // radius over MAXRADIUS
+    short numhuge; // radius over 2 * MAXRADIUS
+} blockthings_t;
+
+extern blockthings_t *blockthings;
+
+void P_InitFineBlocks(void);
+
 boolean P_BlockLinesIterator(int x, int y, boolean (*func)(line_t *));
 boolean P_BlockThingsIterator(int x, int y, boolean (*func)(mobj_t *));
+boolean P_FineThingsIterator(int x, int y, const fixed_t *box,
+                             boolean (*func)(mobj_t *));
+
+//
+// P_DEFINE_BLOCKLINESITERATOR / P_DEFINE_BLOCKTHINGSITERATOR
+// Define a static boolean name(int x, int y) that does the same as
+// P_BlockLinesIterator / P_BlockThingsIterator with func, but calls func
+// directly, so the compiler can inline hot callbacks into the loop.
+//
+#define P_DEFINE_BLOCKLINESITERATOR(name, func)                               \
+    static boolean name(int x, int y)                                          \
+    {                                                                          \
+        int *list;                                                             \
+        line_t *ld;                                                            \
+                                                                               \
+        if (x < 0 || y < 0 || x >= bmapwidth || y >= bmapheight)               \
+            return true;                                                       \
+                                                                               \
+        list = blockmaplump + blockmap[y * bmapwidth + x];                     \
+        for (; *list != -1; list++) {                                          \
+            ld = &lines[*list];                                                \
+            if (ld->validcount == validcount)                                  \
+                continue;                                                      \
+            ld->validcount = validcount;                                       \
+            if (!func(ld))                                                     \
+                return false;                                                  \
+        }                                                                      \
+        return true;                                                           \
+    }
+
+#define P_DEFINE_BLOCKTHINGSITERATOR(name, func)                              \
+    static boolean name(int x, int y)                                          \
+    {                                                                          \
+        mobj_t *mobj;                                                          \
+                                                                               \
+        if (x < 0 || y < 0 || x >= bmapwidth || y >= bmapheight)               \
+            return true;                                                       \
+                                                                               \
+        mobj = blocklinks[y * bmapwidth + x];                                  \
+        for (; mobj; mobj = mobj->bnext) {                                     \
+            if (!func(mobj))                                                   \
+                return false;                                                  \
+        }                                                                      \
+        return true;                                                           \
+    }
+
+//
+// P_DEFINE_BOXTHINGSITERATOR
+// Like P_DEFINE_BLOCKTHINGSITERATOR, but defines name(int x, int y,
+// const fixed_t *box) for a func that passes over, without side effects,
+// every thing whose centre is further outside box than its radius. Crowded
+// blocks then only visit the things near box, through P_FineThingsIterator,
+// in the same order.
+//
+#define P_DEFINE_BOXTHINGSITERATOR(name, func)                                \
+    static boolean name(int x, int y, const fixed_t *box)                      \
+    {                                                                          \
+        mobj_t *mobj;                                                          \
+                                                                               \
+        if (x < 0 || y < 0 || x >= bmapwidth || y >= bmapheight)               \
+            return true;                                                       \
+                                                                               \
+        if (blockthings[y * bmapwidth + x].numthings > FINEBLOCKTHINGS)        \
+            return P_FineThingsIterator(x, y, box, func);                      \
+                                                                               \
+        mobj = blocklinks[y * bmapwidth + x];                                  \
+        for (; mobj; mobj = mobj->bnext) {                                     \
+            if (!func(mobj))                                                   \
+                return false;                                                  \
+        }                                                                      \
+        return true;                                                           \
+    }
 
 #define PT_ADDLINES 1
 #define PT_ADDTHINGS 2
@@ -166,8 +300,15 @@ extern divline_t trace;
 boolean P_PathTraverse(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
                        int flags, boolean (*trav)(intercept_t *));
 
+void P_StartPathFan(fixed_t x, fixed_t y, angle_t angle, angle_t spread,
+                    fixed_t distance);
+void P_EndPathFan(void);
+boolean P_FanTraverse(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
+                      angle_t angle, int flags, boolean (*trav)(intercept_t *));
+
 void P_UnsetThingPosition(mobj_t *thing);
 void P_SetThingPosition(mobj_t *thing);
+void P_ClearSectorNodes(void);
 
 //
 // P_MAP
@@ -187,19 +328,21 @@ extern line_t *ceilingline;
 // exceeded.  So we have to support more than 8 specials.
 //
 // We keep the original limit, to detect what variables in memory were
-// overwritten (see SpechitOverrun())
+// overwritten (see SpechitOverrun()). spechit itself grows as needed.
 
-#define MAXSPECIALCROSS 20
 #define MAXSPECIALCROSS_ORIGINAL 8
 
-extern line_t *spechit[MAXSPECIALCROSS];
+extern line_t **spechit;
 extern int numspechit;
 
 boolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y);
+void P_StartNeighbourhood(mobj_t *thing, fixed_t reach);
+void P_EndNeighbourhood(void);
 boolean P_TryMove(mobj_t *thing, fixed_t x, fixed_t y);
 boolean P_TeleportMove(mobj_t *thing, fixed_t x, fixed_t y);
 void P_SlideMove(mobj_t *mo);
 boolean P_CheckSight(mobj_t *t1, mobj_t *t2);
+void P_ClearSightCache(void);
 void P_UseLines(player_t *player);
 
 boolean P_ChangeSector(sector_t *sector, boolean crunch);
@@ -217,8 +360,8 @@ void P_RadiusAttack(mobj_t *spot, mobj_t *source, int damage);
 // P_SETUP
 //
 extern byte *rejectmatrix;  // for fast sight rejection
-extern short *blockmaplump; // offsets in blockmap are from here
-extern short *blockmap;
+extern int *blockmaplump; // offsets in blockmap are from here
+extern int *blockmap;
 extern int bmapwidth;
 extern int bmapheight; // in mapblocks
 extern fixed_t bmaporgx;
@@ -24,6 +24,7 @@
 #include "i_system.h"
 #include "m_argv.h"
 #include "m_bbox.h"
+#include "m_counts.h"
 #include "m_misc.h"
 #include "m_random.h"
 #include "p_local.h"
@@ -74,8 +75,9 @@ line_t *ceilingline;
 // keep track of special lines as they are hit,
 // but don't process them until the move is proven valid
 
-line_t *spechit[MAXSPECIALCROSS];
+line_t **spechit;
 int numspechit;
+static int maxspechit;
 
 //
 // TELEPORT MOVE
@@ -111,6 +113,8 @@ boolean PIT_StompThing(mobj_t *thing)
     return true;
 }
 
+P_DEFINE_BLOCKTHINGSITERATOR(StompThingsIterator, PIT_StompThing)
+
 //
 // P_TeleportMove
 //
@@ -158,7 +162,7 @@ boolean P_TeleportMove(mobj_t *thing, fixed_t x, fixed_t y)
 
     for (bx = xl; bx <= xh; bx++)
         for (by = yl; by <= yh; by++)
-            if (!P_BlockThingsIterator(bx, by, PIT_StompThing))
+            if (!StompThingsIterator(bx, by))
                 return false;
 
     // the move is ok,
@@ -235,11 +239,16 @@ boolean PIT_CheckLine(line_t *ld)
 
     // if contacted a special line, add it to the list
     if (ld->special) {
+        if (numspechit == maxspechit) {
+            maxspechit = maxspechit ? maxspechit * 2 : 32;
+            spechit = I_Realloc(spechit, maxspechit * sizeof(*spechit));
+        }
+
         spechit[numspechit] = ld;
         numspechit++;
 
         // fraggle: spechits overrun emulation code from prboom-plus
-        if (numspechit > MAXSPECIALCROSS_ORIGINAL) {
+        if (numspechit > MAXSPECIALCROSS_ORIGINAL && P_EmulateOverruns()) {
             SpechitOverrun(ld);
         }
     }
@@ -247,6 +256,8 @@ boolean PIT_CheckLine(line_t *ld)
     return true;
 }
 
+P_DEFINE_BLOCKLINESITERATOR(CheckLinesIterator, PIT_CheckLine)
+
 //
 // PIT_CheckThing
 //
@@ -335,6 +346,274 @@ boolean PIT_CheckThing(mobj_t *thing)
     return !(thing->flags & MF_SOLID);
 }
 
+P_DEFINE_BOXTHINGSITERATOR(CheckThingsIterator, PIT_CheckThing)
+
+//
+// NEIGHBOURHOODS
+// P_NewChaseDir may try moving a monster in several directions before one
+// works, each checking much the same lines and things. Once a second
+// position is checked for it, those that any of its moves could touch are
+// gathered block by block, in the order P_CheckPosition would visit them,
+// and the rest of its checks only visit those. What's left out would have
+// been passed over without side effects, and a failed move changes nothing
+// gathered, so the results are the same.
+//
+
+static struct {
+    mobj_t *thing; // NULL if no neighbourhood is started
+    fixed_t x;
+    fixed_t y;
+    fixed_t radius;
+    int checks;
+    boolean gathered;
+
+    fixed_t box[4]; // covers the thing in every position it may be checked
+
+    // Blocks of things and lines gathered, as P_CheckPosition finds them.
+    int txl, txh, tyl, tyh;
+    int lxl, lxh, lyl, lyh;
+} neighbourhood;
+
+// The things and lines gathered for each block, x major; the n-th block's
+// start at thingstarts[n] and linestarts[n], and end at the next block's.
+static mobj_t **nbthings;
+static int *nbthingstarts;
+static int maxnbthings;
+static int maxnbthingstarts;
+static line_t **nblines;
+static int *nblinestarts;
+static int maxnblines;
+static int maxnblinestarts;
+
+//
+// P_StartNeighbourhood
+// Checks of positions up to reach from where thing is may be done from a
+// neighbourhood until P_EndNeighbourhood, as long as thing doesn't move.
+//
+void P_StartNeighbourhood(mobj_t *thing, fixed_t reach)
+{
+    neighbourhood.thing = thing;
+    neighbourhood.x = thing->x;
+    neighbourhood.y = thing->y;
+    neighbourhood.radius = thing->radius;
+    neighbourhood.checks = 0;
+    neighbourhood.gathered = false;
+
+    neighbourhood.box[BOXTOP] = thing->y + thing->radius + reach;
+    neighbourhood.box[BOXBOTTOM] = thing->y - thing->radius - reach;
+    neighbourhood.box[BOXRIGHT] = thing->x + thing->radius + reach;
+    neighbourhood.box[BOXLEFT] = thing->x - thing->radius - reach;
+}
+
+//
+// P_EndNeighbourhood
+//
+void P_EndNeighbourhood(void)
+{
+    neighbourhood.thing = NULL;
+}
+
+static void GatherNeighbourhoodThings(void)
+{
+    fixed_t *box;
+    mobj_t *mobj;
+    int numblocks;
+    int count;
+    int bx;
+    int by;
+
+    box = neighbourhood.box;
+    neighbourhood.txl = (box[BOXLEFT] - bmaporgx - MAXRADIUS) >> MAPBLOCKSHIFT;
+    neighbourhood.txh = (box[BOXRIGHT] - bmaporgx + MAXRADIUS) >> MAPBLOCKSHIFT;
+    neighbourhood.tyl =
+        (box[BOXBOTTOM] - bmaporgy - MAXRADIUS) >> MAPBLOCKSHIFT;
+    neighbourhood.tyh = (box[BOXTOP] - bmaporgy + MAXRADIUS) >> MAPBLOCKSHIFT;
+
+    numblocks = (neighbourhood.txh - neighbourhood.txl + 1)
+                * (neighbourhood.tyh - neighbourhood.tyl + 1);
+    if (numblocks + 1 > maxnbthingstarts) {
+        maxnbthingstarts = numblocks + 1;
+        nbthingstarts = I_Realloc(nbthingstarts,
+                                  maxnbthingstarts * sizeof(*nbthingstarts));
+    }
+
+    count = 0;
+    numblocks = 0;
+    for (bx = neighbourhood.txl; bx <= neighbourhood.txh; bx++) {
+        for (by = neighbourhood.tyl; by <= neighbourhood.tyh; by++) {
+            nbthingstarts[numblocks++] = count;
+            if (bx < 0 || by < 0 || bx >= bmapwidth || by >= bmapheight)
+                continue;
+
+            M_CountWork(work_blockcells, 1);
+            mobj = blocklinks[by * bmapwidth + bx];
+            for (; mobj; mobj = mobj->bnext) {
+                // What PIT_CheckThing passes over from every position.
+                if (!(mobj->flags & (MF_SOLID | MF_SPECIAL | MF_SHOOTABLE))
+                    || mobj->x <= box[BOXLEFT] - mobj->radius
+                    || mobj->x >= box[BOXRIGHT] + mobj->radius
+                    || mobj->y <= box[BOXBOTTOM] - mobj->radius
+                    || mobj->y >= box[BOXTOP] + mobj->radius
+                    || mobj == neighbourhood.thing) {
+                    continue;
+                }
+
+                if (count == maxnbthings) {
+                    maxnbthings = maxnbthings ? maxnbthings * 2 : 64;
+                    nbthings =
+                        I_Realloc(nbthings, maxnbthings * sizeof(*nbthings));
+                }
+                nbthings[count++] = mobj;
+            }
+        }
+    }
+    nbthingstarts[numblocks] = count;
+}
+
+static void GatherNeighbourhoodLines(void)
+{
+    fixed_t *box;
+    line_t *ld;
+    int *list;
+    int numblocks;
+    int count;
+    int bx;
+    int by;
+
+    box = neighbourhood.box;
+    neighbourhood.lxl = (box[BOXLEFT] - bmaporgx) >> MAPBLOCKSHIFT;
+    neighbourhood.lxh = (box[BOXRIGHT] - bmaporgx) >> MAPBLOCKSHIFT;
+    neighbourhood.lyl = (box[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT;
+    neighbourhood.lyh = (box[BOXTOP] - bmaporgy) >> MAPBLOCKSHIFT;
+
+    numblocks = (neighbourhood.lxh - neighbourhood.lxl + 1)
+                * (neighbourhood.lyh - neighbourhood.lyl + 1);
+    if (numblocks + 1 > maxnblinestarts) {
+        maxnblinestarts = numblocks + 1;
+        nblinestarts =
+            I_Realloc(nblinestarts, maxnblinestarts * sizeof(*nblinestarts));
+    }
+
+    // Lines in several blocks are kept in each, to be skipped with
+    // validcount as P_CheckPosition would.
+    count = 0;
+    numblocks = 0;
+    for (bx = neighbourhood.lxl; bx <= neighbourhood.lxh; bx++) {
+        for (by = neighbourhood.lyl; by <= neighbourhood.lyh; by++) {
+            nblinestarts[numblocks++] = count;
+            if (bx < 0 || by < 0 || bx >= bmapwidth || by >= bmapheight)
+                continue;
+
+            M_CountWork(work_blockcells, 1);
+            list = blockmaplump + blockmap[by * bmapwidth + bx];
+            for (; *list != -1; list++) {
+                ld = &lines[*list];
+
+                // What PIT_CheckLine passes over from every position.
+                if (box[BOXRIGHT] <= ld->bbox[BOXLEFT]
+                    || box[BOXLEFT] >= ld->bbox[BOXRIGHT]
+                    || box[BOXTOP] <= ld->bbox[BOXBOTTOM]
+                    || box[BOXBOTTOM] >= ld->bbox[BOXTOP]
+                    || P_BoxOnLineSide(box, ld) != -1) {
+                    continue;
+                }
+
+                if (count == maxnblines) {
+                    maxnblines = maxnblines ? maxnblines * 2 : 64;
+                    nblines = I_Realloc(nblines, maxnblines * sizeof(*nblines));
+                }
+                nblines[count++] = ld;
+            }
+        }
+    }
+    nblinestarts[numblocks] = count;
+}
+
+//
+// UseNeighbourhood
+// Whether checking thing where tmbbox is can be done from the neighbourhood,
+// gathering it if this is the time.
+//
+static boolean UseNeighbourhood(mobj_t *thing)
+{
+    if (thing != neighbourhood.thing || thing->x != neighbourhood.x
+        || thing->y != neighbourhood.y || thing->radius != neighbourhood.radius
+        || tmbbox[BOXLEFT] < neighbourhood.box[BOXLEFT]
+        || tmbbox[BOXRIGHT] > neighbourhood.box[BOXRIGHT]
+        || tmbbox[BOXBOTTOM] < neighbourhood.box[BOXBOTTOM]
+        || tmbbox[BOXTOP] > neighbourhood.box[BOXTOP]) {
+        return false;
+    }
+
+    // The first move tried usually works, so don't gather for it alone.
+    if (!neighbourhood.gathered) {
+        if (neighbourhood.checks++ == 0)
+            return false;
+
+        GatherNeighbourhoodThings();
+        GatherNeighbourhoodLines();
+        neighbourhood.gathered = true;
+    }
+    return true;
+}
+
+//
+// CheckNeighbourhood
+// The rest of P_CheckPosition, from the neighbourhood.
+//
+static boolean CheckNeighbourhood(void)
+{
+    int xl;
+    int xh;
+    int yl;
+    int yh;
+    int bx;
+    int by;
+    int n;
+    int i;
+    line_t *ld;
+
+    xl = (tmbbox[BOXLEFT] - bmaporgx - MAXRADIUS) >> MAPBLOCKSHIFT;
+    xh = (tmbbox[BOXRIGHT] - bmaporgx + MAXRADIUS) >> MAPBLOCKSHIFT;
+    yl = (tmbbox[BOXBOTTOM] - bmaporgy - MAXRADIUS) >> MAPBLOCKSHIFT;
+    yh = (tmbbox[BOXTOP] - bmaporgy + MAXRADIUS) >> MAPBLOCKSHIFT;
+
+    for (bx = xl; bx <= xh; bx++) {
+        for (by = yl; by <= yh; by++) {
+            n = (bx - neighbourhood.txl)
+                    * (neighbourhood.tyh - neighbourhood.tyl + 1)
+                + by - neighbourhood.tyl;
+            for (i = nbthingstarts[n]; i < nbthingstarts[n + 1]; i++) {
+                if (!PIT_CheckThing(nbthings[i]))
+                    return false;
+            }
+        }
+    }
+
+    xl = (tmbbox[BOXLEFT] - bmaporgx) >> MAPBLOCKSHIFT;
+    xh = (tmbbox[BOXRIGHT] - bmaporgx) >> MAPBLOCKSHIFT;
+    yl = (tmbbox[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT;
+    yh = (tmbbox[BOXTOP] - bmaporgy) >> MAPBLOCKSHIFT;
+
+    for (bx = xl; bx <= xh; bx++) {
+        for (by = yl; by <= yh; by++) {
+            n = (bx - neighbourhood.lxl)
+                    * (neighbourhood.lyh - neighbourhood.lyl + 1)
+                + by - neighbourhood.lyl;
+            for (i = nblinestarts[n]; i < nblinestarts[n + 1]; i++) {
+                ld = nblines[i];
+                if (ld->validcount == validcount)
+                    continue;
+                ld->validcount = validcount;
+                if (!PIT_CheckLine(ld))
+                    return false;
+            }
+        }
+    }
+
+    return true;
+}
+
 //
 // MOVEMENT CLIPPING
 //
@@ -400,6 +679,9 @@ boolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y)
     if (tmflags & MF_NOCLIP)
         return true;
 
+    if (UseNeighbourhood(thing))
+        return CheckNeighbourhood();
+
     // Check things first, possibly picking things up.
     // The bounding box is extended by MAXRADIUS
     // because mobj_ts are grouped into mapblocks
@@ -412,7 +694,7 @@ boolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y)
 
     for (bx = xl; bx <= xh; bx++)
         for (by = yl; by <= yh; by++)
-            if (!P_BlockThingsIterator(bx, by, PIT_CheckThing))
+            if (!CheckThingsIterator(bx, by, tmbbox))
                 return false;
 
     // check lines
@@ -423,7 +705,7 @@ boolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y)
 
     for (bx = xl; bx <= xh; bx++)
         for (by = yl; by <= yh; by++)
-            if (!P_BlockLinesIterator(bx, by, PIT_CheckLine))
+            if (!CheckLinesIterator(bx, by))
                 return false;
 
     return true;
@@ -526,6 +808,10 @@ boolean P_ThingHeightClip(mobj_t *thing)
             thing->z = thing->ceilingz - thing->height;
     }
 
+    // only things on the floor sleep, and one left above it must fall
+    if (thing->z != thing->floorz)
+        P_WakeThinker(&thing->thinker);
+
     if (thing->ceilingz - thing->floorz < thing->height)
         return false;
 
@@ -1023,8 +1309,8 @@ void P_LineAttack(mobj_t *t1, angle_t angle, fixed_t distance, fixed_t slope,
     attackrange = distance;
     aimslope = slope;
 
-    P_PathTraverse(t1->x, t1->y, x2, y2, PT_ADDLINES | PT_ADDTHINGS,
-                   PTR_ShootTraverse);
+    P_FanTraverse(t1->x, t1->y, x2, y2, angle << ANGLETOFINESHIFT,
+                  PT_ADDLINES | PT_ADDTHINGS, PTR_ShootTraverse);
 }
 
 //
@@ -1130,6 +1416,8 @@ boolean PIT_RadiusAttack(mobj_t *thing)
     return true;
 }
 
+P_DEFINE_BOXTHINGSITERATOR(RadiusAttackIterator, PIT_RadiusAttack)
+
 //
 // P_RadiusAttack
 // Source is the creature that caused the explosion at spot.
@@ -1145,6 +1433,7 @@ void P_RadiusAttack(mobj_t *spot, mobj_t *source, int damage)
     int yh;
 
     fixed_t dist;
+    fixed_t box[4];
 
     dist = (damage + MAXRADIUS) << FRACBITS;
     yh = (spot->y + dist - bmaporgy) >> MAPBLOCKSHIFT;
@@ -1155,9 +1444,15 @@ void P_RadiusAttack(mobj_t *spot, mobj_t *source, int damage)
     bombsource = source;
     bombdamage = damage;
 
+    // Things further away than damage plus their radius are out of range.
+    box[BOXTOP] = spot->y + (damage << FRACBITS);
+    box[BOXBOTTOM] = spot->y - (damage << FRACBITS);
+    box[BOXRIGHT] = spot->x + (damage << FRACBITS);
+    box[BOXLEFT] = spot->x - (damage << FRACBITS);
+
     for (y = yl; y <= yh; y++)
         for (x = xl; x <= xh; x++)
-            P_BlockThingsIterator(x, y, PIT_RadiusAttack);
+            RadiusAttackIterator(x, y, box);
 }
 
 //
@@ -1230,6 +1525,8 @@ boolean PIT_ChangeSector(mobj_t *thing)
     return true;
 }
 
+P_DEFINE_BLOCKTHINGSITERATOR(ChangeSectorIterator, PIT_ChangeSector)
+
 //
 // P_ChangeSector
 //
@@ -1237,15 +1534,39 @@ boolean P_ChangeSector(sector_t *sector, boolean crunch)
 {
     int x;
     int y;
+    msecnode_t *node;
 
     nofit = false;
     crushchange = crunch;
 
-    // re-check heights for all things near the moving sector
-    for (x = sector->blockbox[BOXLEFT]; x <= sector->blockbox[BOXRIGHT]; x++)
-        for (y = sector->blockbox[BOXBOTTOM]; y <= sector->blockbox[BOXTOP];
-             y++)
-            P_BlockThingsIterator(x, y, PIT_ChangeSector);
+    // Vanilla checks everything in the blockmap near the sector, in blockmap
+    // order, which demos and netgames need to stay in sync.
+    if (demoplayback || demorecording || netgame) {
+        // re-check heights for all things near the moving sector
+        for (x = sector->blockbox[BOXLEFT]; x <= sector->blockbox[BOXRIGHT];
+             x++)
+            for (y = sector->blockbox[BOXBOTTOM];
+                 y <= sector->blockbox[BOXTOP]; y++)
+                ChangeSectorIterator(x, y);
+
+        return nofit;
+    }
+
+    // Otherwise just the things touching it. Checking one can unlink others
+    // (picking up items, say), so start again from the head of the list
+    // after each, skipping those already checked.
+    for (node = sector->touching_thinglist; node; node = node->m_snext)
+        node->visited = false;
+
+    do {
+        for (node = sector->touching_thinglist; node; node = node->m_snext) {
+            if (!node->visited) {
+                node->visited = true;
+                PIT_ChangeSector(node->m_thing);
+                break;
+            }
+        }
+    } while (node);
 
     return nofit;
 }
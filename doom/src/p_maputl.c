@@ -21,12 +21,16 @@
 //
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "doomstat.h"
+#include "i_system.h"
 #include "m_bbox.h"
+#include "m_counts.h"
 #include "p_local.h"
 #include "r_main.h"
 #include "r_state.h"
+#include "z_zone.h"
 
 //
 // P_AproxDistance
@@ -239,7 +243,8 @@ fixed_t P_InterceptVector(divline_t *v2, divline_t *v1)
 // P_LineOpening
 // Sets opentop and openbottom to the window
 // through a two sided line.
-// OPTIMIZE: keep this precalculated
+// This is only a few compares on the two sectors, which is as cheap as
+// checking a per-line cache would be, so it isn't precalculated.
 //
 fixed_t opentop;
 fixed_t openbottom;
@@ -280,6 +285,330 @@ void P_LineOpening(line_t *linedef)
 // THING POSITION SETTING
 //
 
+//
+// AddSectorThing
+// Append the thing to sec->things, which is kept in the reverse order of
+// sec->thinglist.
+//
+static void AddSectorThing(sector_t *sec, mobj_t *thing)
+{
+    sectorthing_t *things;
+
+    if (sec->numthings == sec->maxthings) {
+        sec->maxthings = sec->maxthings ? sec->maxthings * 2 : 8;
+        things = Z_Malloc(sec->maxthings * sizeof(*things), PU_LEVEL, NULL);
+        if (sec->things) {
+            memcpy(things, sec->things, sec->numthings * sizeof(*things));
+            Z_Free(sec->things);
+        }
+        sec->things = things;
+    }
+
+    sec->things[sec->numthings].x = thing->x;
+    sec->things[sec->numthings].y = thing->y;
+    sec->things[sec->numthings].mobj = thing;
+    sec->numthings++;
+}
+
+//
+// FindSectorThing
+//
+static sectorthing_t *FindSectorThing(sector_t *sec, mobj_t *thing)
+{
+    int i;
+
+    for (i = sec->numthings - 1; i >= 0; i--) {
+        if (sec->things[i].mobj == thing)
+            return &sec->things[i];
+    }
+
+    I_Error("FindSectorThing: Thing not in its sector");
+    return NULL;
+}
+
+//
+// RemoveSectorThing
+//
+static void RemoveSectorThing(sector_t *sec, mobj_t *thing)
+{
+    sectorthing_t *st;
+
+    st = FindSectorThing(sec, thing);
+    sec->numthings--;
+    memmove(st, st + 1, (sec->things + sec->numthings - st) * sizeof(*st));
+}
+
+//
+// SECTOR NODES
+// Things in the blockmap are linked to each sector their bounding boxes
+// touch, so that a moving floor or ceiling need only check the things on it
+// (see P_ChangeSector()).
+//
+
+// Nodes that were unlinked, for reuse; linked by m_snext.
+static msecnode_t *freesecnodes;
+
+//
+// P_ClearSectorNodes
+// Call when the level's memory is freed.
+//
+void P_ClearSectorNodes(void)
+{
+    freesecnodes = NULL;
+}
+
+//
+// AddSectorNode
+// Link the thing and sector, if they aren't already.
+//
+static void AddSectorNode(mobj_t *thing, sector_t *sec)
+{
+    msecnode_t *node;
+
+    for (node = thing->touching_sectorlist; node; node = node->m_tnext) {
+        if (node->m_sector == sec)
+            return;
+    }
+
+    if (freesecnodes) {
+        node = freesecnodes;
+        freesecnodes = node->m_snext;
+    } else {
+        node = Z_Malloc(sizeof(*node), PU_LEVEL, NULL);
+    }
+
+    node->m_sector = sec;
+    node->m_thing = thing;
+    node->visited = false;
+
+    node->m_tnext = thing->touching_sectorlist;
+    thing->touching_sectorlist = node;
+
+    node->m_sprev = NULL;
+    node->m_snext = sec->touching_thinglist;
+    if (sec->touching_thinglist)
+        sec->touching_thinglist->m_sprev = node;
+    sec->touching_thinglist = node;
+}
+
+//
+// LinkSectorNodes
+// Link the thing to the sector it's in and those on either side of every
+// line its bounding box crosses.
+//
+static void LinkSectorNodes(mobj_t *thing)
+{
+    fixed_t box[4];
+    int xl, xh, yl, yh;
+    int bx, by;
+    int *list;
+    line_t *ld;
+
+    box[BOXTOP] = thing->y + thing->radius;
+    box[BOXBOTTOM] = thing->y - thing->radius;
+    box[BOXRIGHT] = thing->x + thing->radius;
+    box[BOXLEFT] = thing->x - thing->radius;
+
+    xl = (box[BOXLEFT] - bmaporgx) >> MAPBLOCKSHIFT;
+    xh = (box[BOXRIGHT] - bmaporgx) >> MAPBLOCKSHIFT;
+    yl = (box[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT;
+    yh = (box[BOXTOP] - bmaporgy) >> MAPBLOCKSHIFT;
+
+    if (xl < 0)
+        xl = 0;
+    if (yl < 0)
+        yl = 0;
+    if (xh >= bmapwidth)
+        xh = bmapwidth - 1;
+    if (yh >= bmapheight)
+        yh = bmapheight - 1;
+
+    // Lines in several blocks are checked again rather than marked with
+    // validcount, which this may be called in the middle of using.
+    for (bx = xl; bx <= xh; bx++) {
+        for (by = yl; by <= yh; by++) {
+            M_CountWork(work_blockcells, 1);
+            list = blockmaplump + blockmap[by * bmapwidth + bx];
+            for (; *list != -1; list++) {
+                ld = &lines[*list];
+
+                if (box[BOXRIGHT] <= ld->bbox[BOXLEFT]
+                    || box[BOXLEFT] >= ld->bbox[BOXRIGHT]
+                    || box[BOXTOP] <= ld->bbox[BOXBOTTOM]
+                    || box[BOXBOTTOM] >= ld->bbox[BOXTOP]) {
+                    continue;
+                }
+                if (P_BoxOnLineSide(box, ld) != -1)
+                    continue;
+
+                AddSectorNode(thing, ld->frontsector);
+                if (ld->backsector)
+                    AddSectorNode(thing, ld->backsector);
+            }
+        }
+    }
+
+    AddSectorNode(thing, thing->subsector->sector);
+}
+
+//
+// UnlinkSectorNodes
+//
+static void UnlinkSectorNodes(mobj_t *thing)
+{
+    msecnode_t *node;
+    msecnode_t *next;
+
+    for (node = thing->touching_sectorlist; node; node = next) {
+        next = node->m_tnext;
+
+        if (node->m_snext)
+            node->m_snext->m_sprev = node->m_sprev;
+        if (node->m_sprev)
+            node->m_sprev->m_snext = node->m_snext;
+        else
+            node->m_sector->touching_thinglist = node->m_snext;
+
+        node->m_snext = freesecnodes;
+        freesecnodes = node;
+    }
+
+    thing->touching_sectorlist = NULL;
+}
+
+//
+// P_MoveThingInPlace
+// For moving a thing without relinking it, as vanilla does in A_Fire:
+// update the position the renderer sees.
+//
+void P_MoveThingInPlace(mobj_t *thing, fixed_t x, fixed_t y)
+{
+    sectorthing_t *st;
+
+    thing->x = x;
+    thing->y = y;
+
+    if (!(thing->flags & MF_NOSECTOR)) {
+        st = FindSectorThing(thing->subsector->sector, thing);
+        st->x = x;
+        st->y = y;
+    }
+}
+
+//
+// FINE BLOCKS
+// Blocks crowded with things are searched through finer cells, so checks
+// near a few of them needn't pass over them all. Each block is split into
+// FINEBLOCKSPERBLOCK cells across and down, and a thing is linked into the
+// one its centre is in as well as its block.
+//
+
+blockthings_t *blockthings;
+
+static mobj_t **fineblocklinks;
+static int fineblockwidth;
+static int maxfineblocks;
+static int maxblockthings;
+
+// Stamped on things as they're linked into a block.
+static unsigned int blockstamp;
+
+// The things P_FineThingsIterator has found, for each call in progress; a
+// func may call it again.
+static mobj_t **finethings;
+static int numfinethings;
+static int maxfinethings;
+
+//
+// P_InitFineBlocks
+// Call once the blockmap is loaded, before any things are linked in.
+//
+void P_InitFineBlocks(void)
+{
+    int count;
+
+    count = bmapwidth * bmapheight;
+    if (count > maxblockthings) {
+        maxblockthings = count;
+        blockthings =
+            I_Realloc(blockthings, maxblockthings * sizeof(*blockthings));
+    }
+    memset(blockthings, 0, count * sizeof(*blockthings));
+
+    fineblockwidth = bmapwidth * FINEBLOCKSPERBLOCK;
+    count *= FINEBLOCKSPERBLOCK * FINEBLOCKSPERBLOCK;
+    if (count > maxfineblocks) {
+        maxfineblocks = count;
+        fineblocklinks =
+            I_Realloc(fineblocklinks, maxfineblocks * sizeof(*fineblocklinks));
+    }
+    memset(fineblocklinks, 0, count * sizeof(*fineblocklinks));
+}
+
+//
+// LinkFineBlock
+// Link a thing just linked into the block at blockx, blocky into its cell.
+//
+static void LinkFineBlock(mobj_t *thing, int blockx, int blocky)
+{
+    blockthings_t *bt;
+    mobj_t **link;
+    int finex;
+    int finey;
+
+    finex = (thing->x - bmaporgx) >> FINEBLOCKSHIFT;
+    finey = (thing->y - bmaporgy) >> FINEBLOCKSHIFT;
+    thing->fineblock = finey * fineblockwidth + finex;
+    thing->blockstamp = ++blockstamp;
+    thing->blockradius = thing->radius;
+
+    link = &fineblocklinks[thing->fineblock];
+    thing->fprev = NULL;
+    thing->fnext = *link;
+    if (*link)
+        (*link)->fprev = thing;
+    *link = thing;
+
+    bt = &blockthings[blocky * bmapwidth + blockx];
+    bt->numthings++;
+    if (thing->blockradius > MAXRADIUS)
+        bt->numwide++;
+    if (thing->blockradius > 2 * MAXRADIUS)
+        bt->numhuge++;
+}
+
+//
+// UnlinkFineBlock
+//
+static void UnlinkFineBlock(mobj_t *thing)
+{
+    blockthings_t *bt;
+    int finex;
+    int finey;
+
+    if (thing->fineblock < 0)
+        return;
+
+    if (thing->fnext)
+        thing->fnext->fprev = thing->fprev;
+    if (thing->fprev)
+        thing->fprev->fnext = thing->fnext;
+    else
+        fineblocklinks[thing->fineblock] = thing->fnext;
+
+    finex = thing->fineblock % fineblockwidth;
+    finey = thing->fineblock / fineblockwidth;
+    bt = &blockthings[finey / FINEBLOCKSPERBLOCK * bmapwidth
+                      + finex / FINEBLOCKSPERBLOCK];
+    bt->numthings--;
+    if (thing->blockradius > MAXRADIUS)
+        bt->numwide--;
+    if (thing->blockradius > 2 * MAXRADIUS)
+        bt->numhuge--;
+
+    thing->fineblock = -1;
+}
+
 //
 // P_UnsetThingPosition
 // Unlinks a thing from block map and sectors.
@@ -302,10 +631,14 @@ void P_UnsetThingPosition(mobj_t *thing)
             thing->sprev->snext = thing->snext;
         else
             thing->subsector->sector->thinglist = thing->snext;
+
+        RemoveSectorThing(thing->subsector->sector, thing);
     }
 
     if (!(thing->flags & MF_NOBLOCKMAP)) {
         // inert things don't need to be in blockmap
+        UnlinkFineBlock(thing);
+
         // unlink from block map
         if (thing->bnext)
             thing->bnext->bprev = thing->bprev;
@@ -322,6 +655,8 @@ void P_UnsetThingPosition(mobj_t *thing)
             }
         }
     }
+
+    UnlinkSectorNodes(thing);
 }
 
 //
@@ -353,6 +688,8 @@ void P_SetThingPosition(mobj_t *thing)
             sec->thinglist->sprev = thing;
 
         sec->thinglist = thing;
+
+        AddSectorThing(sec, thing);
     }
 
     // link into blockmap
@@ -370,10 +707,14 @@ void P_SetThingPosition(mobj_t *thing)
                 (*link)->bprev = thing;
 
             *link = thing;
+            LinkFineBlock(thing, blockx, blocky);
         } else {
             // thing is off the map
             thing->bnext = thing->bprev = NULL;
+            thing->fineblock = -1;
         }
+
+        LinkSectorNodes(thing);
     }
 }
 
@@ -396,13 +737,15 @@ void P_SetThingPosition(mobj_t *thing)
 boolean P_BlockLinesIterator(int x, int y, boolean (*func)(line_t *))
 {
     int offset;
-    short *list;
+    int *list;
     line_t *ld;
 
     if (x < 0 || y < 0 || x >= bmapwidth || y >= bmapheight) {
         return true;
     }
 
+    M_CountWork(work_blockcells, 1);
+
     offset = y * bmapwidth + x;
 
     offset = *(blockmap + offset);
@@ -432,6 +775,8 @@ boolean P_BlockThingsIterator(int x, int y, boolean (*func)(mobj_t *))
         return true;
     }
 
+    M_CountWork(work_blockcells, 1);
+
     for (mobj = blocklinks[y * bmapwidth + x]; mobj; mobj = mobj->bnext) {
         if (!func(mobj))
             return false;
@@ -439,11 +784,106 @@ boolean P_BlockThingsIterator(int x, int y, boolean (*func)(mobj_t *))
     return true;
 }
 
+//
+// P_FineThingsIterator
+// Calls func for the things in the block near box, in the order
+// P_BlockThingsIterator would, skipping those whose centres are further
+// outside box than their radius: func must pass over those anyway, without
+// side effects (see P_DEFINE_BOXTHINGSITERATOR).
+//
+
+static int CompareBlockStamps(const void *a, const void *b)
+{
+    unsigned int sa = (*(mobj_t *const *)a)->blockstamp;
+    unsigned int sb = (*(mobj_t *const *)b)->blockstamp;
+
+    // Latest linked first, as in blocklinks, even once the stamps wrap.
+    return (int)(sb - sa);
+}
+
+boolean P_FineThingsIterator(int x, int y, const fixed_t *box,
+                             boolean (*func)(mobj_t *))
+{
+    blockthings_t *bt;
+    fixed_t margin;
+    mobj_t *mobj;
+    int xl, xh, yl, yh;
+    int fx, fy;
+    int first;
+    int i;
+    boolean result;
+
+    if (x < 0 || y < 0 || x >= bmapwidth || y >= bmapheight)
+        return true;
+
+    M_CountWork(work_blockcells, 1);
+
+    bt = &blockthings[y * bmapwidth + x];
+    if (bt->numhuge > 0) {
+        // Cells around box wide enough for these would cover the block.
+        for (mobj = blocklinks[y * bmapwidth + x]; mobj; mobj = mobj->bnext) {
+            if (!func(mobj))
+                return false;
+        }
+        return true;
+    }
+    margin = bt->numwide > 0 ? 2 * MAXRADIUS : MAXRADIUS;
+
+    xl = (box[BOXLEFT] - margin - bmaporgx) >> FINEBLOCKSHIFT;
+    xh = (box[BOXRIGHT] + margin - bmaporgx) >> FINEBLOCKSHIFT;
+    yl = (box[BOXBOTTOM] - margin - bmaporgy) >> FINEBLOCKSHIFT;
+    yh = (box[BOXTOP] + margin - bmaporgy) >> FINEBLOCKSHIFT;
+
+    if (xl < x * FINEBLOCKSPERBLOCK)
+        xl = x * FINEBLOCKSPERBLOCK;
+    if (xh >= (x + 1) * FINEBLOCKSPERBLOCK)
+        xh = (x + 1) * FINEBLOCKSPERBLOCK - 1;
+    if (yl < y * FINEBLOCKSPERBLOCK)
+        yl = y * FINEBLOCKSPERBLOCK;
+    if (yh >= (y + 1) * FINEBLOCKSPERBLOCK)
+        yh = (y + 1) * FINEBLOCKSPERBLOCK - 1;
+
+    first = numfinethings;
+    for (fy = yl; fy <= yh; fy++) {
+        for (fx = xl; fx <= xh; fx++) {
+            mobj = fineblocklinks[fy * fineblockwidth + fx];
+            for (; mobj; mobj = mobj->fnext) {
+                if (numfinethings == maxfinethings) {
+                    maxfinethings = maxfinethings ? maxfinethings * 2 : 256;
+                    finethings = I_Realloc(
+                        finethings, maxfinethings * sizeof(*finethings));
+                }
+                finethings[numfinethings++] = mobj;
+            }
+        }
+    }
+
+    qsort(finethings + first, numfinethings - first, sizeof(*finethings),
+          CompareBlockStamps);
+
+    // Things func links into the block go at the head of its chain, which
+    // has been passed by then, so aren't visited either way.
+    result = true;
+    for (i = first; i < numfinethings; i++) {
+        if (!func(finethings[i])) {
+            result = false;
+            break;
+        }
+    }
+    numfinethings = first;
+
+    return result;
+}
+
 //
 // INTERCEPT ROUTINES
 //
-intercept_t intercepts[MAXINTERCEPTS];
+intercept_t *intercepts;
 intercept_t *intercept_p;
+static int maxintercepts;
+
+// The intercepts in the order P_TraverseIntercepts visits them.
+static intercept_t **sortedintercepts;
 
 divline_t trace;
 boolean earlyout;
@@ -451,6 +891,36 @@ int ptflags;
 
 static void InterceptsOverrun(int num_intercepts, intercept_t *intercept);
 
+//
+// P_EmulateOverruns
+// Whether to emulate what vanilla does when its fixed-size tables overflow.
+// That is only needed to stay in sync with vanilla, in demos and netgames;
+// otherwise the tables just grow.
+//
+boolean P_EmulateOverruns(void)
+{
+    return demoplayback || demorecording || netgame;
+}
+
+//
+// NewIntercept
+// Make room for one more intercept at intercept_p.
+//
+static void NewIntercept(void)
+{
+    int count;
+
+    count = intercept_p - intercepts;
+    if (count < maxintercepts)
+        return;
+
+    maxintercepts = maxintercepts ? maxintercepts * 2 : 256;
+    intercepts = I_Realloc(intercepts, maxintercepts * sizeof(*intercepts));
+    intercept_p = intercepts + count;
+    sortedintercepts = I_Realloc(sortedintercepts,
+                                 maxintercepts * sizeof(*sortedintercepts));
+}
+
 //
 // PIT_AddLineIntercepts.
 // Looks for lines in the given block
@@ -493,6 +963,7 @@ boolean PIT_AddLineIntercepts(line_t *ld)
         return false; // stop checking
     }
 
+    NewIntercept();
     intercept_p->frac = frac;
     intercept_p->isaline = true;
     intercept_p->d.line = ld;
@@ -554,6 +1025,7 @@ boolean PIT_AddThingIntercepts(mobj_t *thing)
     if (frac < 0)
         return true; // behind source
 
+    NewIntercept();
     intercept_p->frac = frac;
     intercept_p->isaline = false;
     intercept_p->d.thing = thing;
@@ -563,6 +1035,18 @@ boolean PIT_AddThingIntercepts(mobj_t *thing)
     return true; // keep going
 }
 
+// Nearest first; vanilla rescans for the nearest each time, taking the
+// first added on ties, so those stay in the order they were added.
+static int CompareIntercepts(const void *a, const void *b)
+{
+    const intercept_t *ia = *(intercept_t *const *)a;
+    const intercept_t *ib = *(intercept_t *const *)b;
+
+    if (ia->frac != ib->frac)
+        return ia->frac < ib->frac ? -1 : 1;
+    return ia < ib ? -1 : ia > ib;
+}
+
 //
 // P_TraverseIntercepts
 // Returns true if the traverser function returns true
@@ -571,24 +1055,20 @@ boolean PIT_AddThingIntercepts(mobj_t *thing)
 boolean P_TraverseIntercepts(traverser_t func, fixed_t maxfrac)
 {
     int count;
-    fixed_t dist;
-    intercept_t *scan;
+    int i;
     intercept_t *in;
 
     count = intercept_p - intercepts;
 
-    in = 0; // shut up compiler warning
+    for (i = 0; i < count; i++)
+        sortedintercepts[i] = &intercepts[i];
+    qsort(sortedintercepts, count, sizeof(*sortedintercepts),
+          CompareIntercepts);
 
-    while (count--) {
-        dist = INT_MAX;
-        for (scan = intercepts; scan < intercept_p; scan++) {
-            if (scan->frac < dist) {
-                dist = scan->frac;
-                in = scan;
-            }
-        }
+    for (i = 0; i < count; i++) {
+        in = sortedintercepts[i];
 
-        if (dist > maxfrac)
+        if (in->frac > maxfrac)
             return true; // checked everything in range
 
 #if 0 // UNUSED
@@ -605,8 +1085,6 @@ boolean P_TraverseIntercepts(traverser_t func, fixed_t maxfrac)
 
         if (!func(in))
             return false; // don't bother going farther
-
-        in->frac = INT_MAX;
     }
 
     return true; // everything was traversed
@@ -704,8 +1182,8 @@ static void InterceptsOverrun(int num_intercepts, intercept_t *intercept)
 {
     int location;
 
-    if (num_intercepts <= MAXINTERCEPTS_ORIGINAL) {
-        // No overrun
+    if (num_intercepts <= MAXINTERCEPTS_ORIGINAL || !P_EmulateOverruns()) {
+        // No overrun, or none to emulate
 
         return;
     }
@@ -725,14 +1203,13 @@ static void InterceptsOverrun(int num_intercepts, intercept_t *intercept)
 }
 
 //
-// P_PathTraverse
-// Traces a line from x1,y1 to x2,y2,
-// calling the traverser function for each.
-// Returns true if the traverser function returns true
-// for all lines.
+// PathIntercepts
+// Gathers the intercepts of the trace from x1,y1 to x2,y2 by walking
+// the blockmap blocks it passes through.
+// Returns false if earlyout and a solid line hit.
 //
-boolean P_PathTraverse(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
-                       int flags, boolean (*trav)(intercept_t *))
+static boolean PathIntercepts(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
+                              int flags)
 {
     fixed_t xt1;
     fixed_t yt1;
@@ -755,6 +1232,8 @@ boolean P_PathTraverse(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
 
     int count;
 
+    M_CountWork(work_pathtraverses, 1);
+
     earlyout = flags & PT_EARLYOUT;
 
     validcount++;
@@ -841,6 +1320,233 @@ boolean P_PathTraverse(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
             mapy += mapystep;
         }
     }
+    return true;
+}
+
+//
+// P_PathTraverse
+// Traces a line from x1,y1 to x2,y2,
+// calling the traverser function for each.
+// Returns true if the traverser function returns true
+// for all lines.
+//
+boolean P_PathTraverse(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
+                       int flags, boolean (*trav)(intercept_t *))
+{
+    if (!PathIntercepts(x1, y1, x2, y2, flags))
+        return false; // early out
+
     // go through the sorted list
     return P_TraverseIntercepts(trav, FRACUNIT);
 }
+
+//
+// PATH FANS
+//
+// A shotgun fires all its pellets from one spot, a few degrees apart.
+// Rather than walk the blockmap for the lines of every pellet, those near
+// the fan are gathered once, each with the arc it covers as seen from the
+// origin, and a trace only tests the lines whose arc it lies in. Things
+// are still found by walking the blockmap per trace: they die and spawn
+// between pellets, and vanilla only finds them in the blocks a trace
+// enters.
+//
+// Intercepts with equal fracs may be traversed in another order than the
+// walk gives, and the intercept count differs, so fans are not used where
+// vanilla's behaviour must be matched.
+//
+
+typedef struct {
+    line_t *line;
+    angle_t start; // the arc the line covers, widened by FANMARGIN
+    angle_t width;
+} fanline_t;
+
+// Well above the error of the angle tables the arcs and traces come from.
+#define FANMARGIN ANG1
+
+static boolean fanactive;
+static fixed_t fanorigx; // origin as passed in
+static fixed_t fanorigy;
+static fixed_t fanx; // origin as P_PathTraverse nudges it
+static fixed_t fany;
+static angle_t fanstart;
+static angle_t fanwidth;
+static int fanblocks[4]; // blocks the lines were gathered from
+
+static fanline_t *fanlines;
+static int numfanlines;
+static int maxfanlines;
+
+static boolean PIT_AddFanLine(line_t *ld)
+{
+    fixed_t dx1;
+    fixed_t dy1;
+    fixed_t dx2;
+    fixed_t dy2;
+    angle_t start;
+    angle_t width;
+    fanline_t *fl;
+
+    dx1 = ld->v1->x - fanx;
+    dy1 = ld->v1->y - fany;
+    dx2 = ld->v2->x - fanx;
+    dy2 = ld->v2->y - fany;
+
+    // The angle tables lose their precision very close to the origin, and
+    // a line passing by it covers about half the circle anyway.
+    if ((abs(dx1) < 16 * FRACUNIT && abs(dy1) < 16 * FRACUNIT)
+        || (abs(dx2) < 16 * FRACUNIT && abs(dy2) < 16 * FRACUNIT)) {
+        start = 0;
+        width = ANG_MAX;
+    } else {
+        start = R_PointToAngle2(0, 0, dx1, dy1);
+        width = R_PointToAngle2(0, 0, dx2, dy2) - start;
+
+        if (width > ANG180) {
+            start += width;
+            width = -width;
+        }
+
+        if (width >= ANG180 - 2 * FANMARGIN) {
+            start = 0;
+            width = ANG_MAX;
+        } else {
+            start -= FANMARGIN;
+            width += 2 * FANMARGIN;
+        }
+    }
+
+    // no pellet can reach it
+    if (fanstart - start > width && start - fanstart > fanwidth)
+        return true;
+
+    if (numfanlines == maxfanlines) {
+        maxfanlines = maxfanlines ? 2 * maxfanlines : 256;
+        fanlines = I_Realloc(fanlines, maxfanlines * sizeof(*fanlines));
+    }
+
+    fl = &fanlines[numfanlines++];
+    fl->line = ld;
+    fl->start = start;
+    fl->width = width;
+
+    return true;
+}
+
+//
+// P_StartPathFan
+// Prepares for traces of up to distance from x,y, at most spread either
+// side of angle, to be made through P_FanTraverse.
+//
+void P_StartPathFan(fixed_t x, fixed_t y, angle_t angle, angle_t spread,
+                    fixed_t distance)
+{
+    fixed_t box[4];
+    angle_t a;
+    int bx;
+    int by;
+
+    fanactive = false;
+
+    if (P_EmulateOverruns())
+        return;
+
+    fanorigx = x;
+    fanorigy = y;
+    fanx = x;
+    fany = y;
+    fanstart = angle - spread;
+    fanwidth = 2 * spread;
+
+    // don't side exactly on a line, as P_PathTraverse does
+    if (((fanx - bmaporgx) & (MAPBLOCKSIZE - 1)) == 0)
+        fanx += FRACUNIT;
+
+    if (((fany - bmaporgy) & (MAPBLOCKSIZE - 1)) == 0)
+        fany += FRACUNIT;
+
+    // Bound the fan by its origin, the ends of its edges and any end
+    // pointing along an axis.
+    M_ClearBox(box);
+    M_AddToBox(box, x, y);
+    M_AddToBox(box, fanx, fany);
+
+    for (a = 0;; a += ANG90) {
+        if (a - fanstart <= fanwidth) {
+            M_AddToBox(box,
+                       x + (distance >> FRACBITS)
+                               * finecosine[a >> ANGLETOFINESHIFT],
+                       y + (distance >> FRACBITS)
+                               * finesine[a >> ANGLETOFINESHIFT]);
+        }
+        if (a == ANG270)
+            break;
+    }
+
+    a = fanstart >> ANGLETOFINESHIFT;
+    M_AddToBox(box, x + (distance >> FRACBITS) * finecosine[a],
+               y + (distance >> FRACBITS) * finesine[a]);
+    a = (fanstart + fanwidth) >> ANGLETOFINESHIFT;
+    M_AddToBox(box, x + (distance >> FRACBITS) * finecosine[a],
+               y + (distance >> FRACBITS) * finesine[a]);
+
+    fanblocks[BOXLEFT] = (box[BOXLEFT] - bmaporgx) >> MAPBLOCKSHIFT;
+    fanblocks[BOXRIGHT] = (box[BOXRIGHT] - bmaporgx) >> MAPBLOCKSHIFT;
+    fanblocks[BOXBOTTOM] = (box[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT;
+    fanblocks[BOXTOP] = (box[BOXTOP] - bmaporgy) >> MAPBLOCKSHIFT;
+
+    numfanlines = 0;
+    validcount++;
+
+    for (by = fanblocks[BOXBOTTOM]; by <= fanblocks[BOXTOP]; by++) {
+        for (bx = fanblocks[BOXLEFT]; bx <= fanblocks[BOXRIGHT]; bx++)
+            P_BlockLinesIterator(bx, by, PIT_AddFanLine);
+    }
+
+    fanactive = true;
+}
+
+//
+// P_EndPathFan
+//
+void P_EndPathFan(void)
+{
+    fanactive = false;
+}
+
+//
+// P_FanTraverse
+// P_PathTraverse for a trace along angle, using the lines gathered by
+// P_StartPathFan if the trace lies within the fan.
+//
+boolean P_FanTraverse(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
+                      angle_t angle, int flags, boolean (*trav)(intercept_t *))
+{
+    fanline_t *fl;
+    fanline_t *end;
+    int bx;
+    int by;
+
+    bx = (x2 - bmaporgx) >> MAPBLOCKSHIFT;
+    by = (y2 - bmaporgy) >> MAPBLOCKSHIFT;
+
+    if (!fanactive || (flags & PT_EARLYOUT) || x1 != fanorigx
+        || y1 != fanorigy || angle - fanstart > fanwidth
+        || bx < fanblocks[BOXLEFT] || bx > fanblocks[BOXRIGHT]
+        || by < fanblocks[BOXBOTTOM] || by > fanblocks[BOXTOP]) {
+        return P_PathTraverse(x1, y1, x2, y2, flags, trav);
+    }
+
+    PathIntercepts(x1, y1, x2, y2, flags & ~PT_ADDLINES);
+
+    if (flags & PT_ADDLINES) {
+        end = fanlines + numfanlines;
+        for (fl = fanlines; fl < end; fl++) {
+            if (angle - fl->start <= fl->width)
+                PIT_AddLineIntercepts(fl->line);
+        }
+    }
+
+    return P_TraverseIntercepts(trav, FRACUNIT);
+}
@@ -25,6 +25,7 @@
 #include "i_system.h"
 #include "m_random.h"
 #include "p_local.h"
+#include "p_spec.h"
 #include "r_main.h"
 #include "s_sound.h"
 #include "sounds.h"
@@ -42,11 +43,13 @@ int test;
 
 boolean P_SetMobjState(mobj_t *mobj, statenum_t state)
 {
-    state_t *st;
+    const state_t *st;
+
+    P_WakeThinker(&mobj->thinker);
 
     do {
         if (state == S_NULL) {
-            mobj->state = (state_t *)S_NULL;
+            mobj->state = (const state_t *)S_NULL;
             P_RemoveMobj(mobj);
             return false;
         }
@@ -383,6 +386,15 @@ void P_MobjThinker(thinker_t *thinker)
 {
     mobj_t *mobj = (mobj_t *)thinker;
 
+    // Nothing below does anything to a mobj at rest in a state that never
+    // ends, so it can sleep until something moves it or changes its state.
+    if (!mobj->momx && !mobj->momy && !mobj->momz && mobj->z == mobj->floorz
+        && mobj->tics == -1 && !mobj->player && !(mobj->flags & MF_SKULLFLY)
+        && (!respawnmonsters || !(mobj->flags & MF_COUNTKILL))) {
+        P_SleepThinker(thinker);
+        return;
+    }
+
     // momentum movement
     if (mobj->momx || mobj->momy || (mobj->flags & MF_SKULLFLY)) {
         P_XYMovement(mobj);
@@ -435,10 +447,10 @@ void P_MobjThinker(thinker_t *thinker)
 mobj_t *P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type)
 {
     mobj_t *mobj;
-    state_t *st;
-    mobjinfo_t *info;
+    const state_t *st;
+    const mobjinfo_t *info;
 
-    mobj = Z_Malloc(sizeof(*mobj), PU_LEVEL, NULL);
+    mobj = P_AllocThinker(sizeof(*mobj));
     memset(mobj, 0, sizeof(*mobj));
     info = &mobjinfo[type];
 
@@ -467,6 +479,9 @@ mobj_t *P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type)
     // set subsector and/or block links
     P_SetThingPosition(mobj);
 
+    if (type == MT_TELEPORTMAN)
+        P_InvalidateTeleportDests();
+
     mobj->floorz = mobj->subsector->sector->floorheight;
     mobj->ceilingz = mobj->subsector->sector->ceilingheight;
 
@@ -480,10 +495,27 @@ mobj_t *P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type)
     mobj->thinker.function = P_MobjThinker;
 
     P_AddThinker(&mobj->thinker);
+    P_StopInterpolating(mobj);
 
     return mobj;
 }
 
+//
+// P_StopInterpolating
+// Draw the mobj where it is now until the next tic, rather than moving it
+// from where it was at the start of the tic, e.g. after a teleport.
+//
+void P_StopInterpolating(mobj_t *mobj)
+{
+    mobj->oldx = mobj->x;
+    mobj->oldy = mobj->y;
+    mobj->oldz = mobj->z;
+    mobj->oldangle = mobj->angle;
+
+    if (mobj->player)
+        mobj->player->oldviewz = mobj->player->viewz;
+}
+
 //
 // P_RemoveMobj
 //
@@ -507,6 +539,10 @@ void P_RemoveMobj(mobj_t *mobj)
 
     // unlink from sector and block lists
     P_UnsetThingPosition(mobj);
+    P_UnparkLooker(mobj);
+
+    if (mobj->type == MT_TELEPORTMAN)
+        P_InvalidateTeleportDests();
 
     // stop any playing sound
     S_StopSound(mobj);
@@ -633,6 +669,8 @@ void P_SpawnPlayer(mapthing_t *mthing)
         for (i = 0; i < NUMCARDS; i++)
             p->cards[i] = true;
 
+    p->statusdirty = true;
+
     if (mthing->type - 1 == consoleplayer) {
         // wake up the status bar
         ST_Start();
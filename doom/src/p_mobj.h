@@ -213,6 +213,19 @@ typedef struct mobj_s {
     struct mobj_s *bnext;
     struct mobj_s *bprev;
 
+    // Links in the finer cell of its block; fineblock is the cell's index in
+    // fineblocklinks, or -1 if it isn't in a block. Things are linked in at
+    // the head of a block, so the greater their blockstamp, the nearer to it
+    // they are; blockradius is the radius they were linked with.
+    struct mobj_s *fnext;
+    struct mobj_s *fprev;
+    int fineblock;
+    unsigned int blockstamp;
+    fixed_t blockradius;
+
+    // Sectors its bounding box touches, if it's in the blockmap.
+    struct msecnode_s *touching_sectorlist;
+
     struct subsector_s *subsector;
 
     // The closest interval over all contacted Sectors.
@@ -232,10 +245,10 @@ typedef struct mobj_s {
     int validcount;
 
     mobjtype_t type;
-    mobjinfo_t *info; // &mobjinfo[mobj->type]
+    const mobjinfo_t *info; // &mobjinfo[mobj->type]
 
     int tics; // state tic counter
-    state_t *state;
+    const state_t *state;
     int flags;
     int health;
 
@@ -268,6 +281,24 @@ typedef struct mobj_s {
     // Thing being chased/attacked for tracers.
     struct mobj_s *tracer;
 
+    // Links in the look wheel slot a far away monster waits in (see
+    // A_Look); lookprev is NULL if it isn't in one.
+    struct mobj_s *looknext;
+    struct mobj_s **lookprev;
+
+    // Where it was at the start of the tic, for drawing it between tics.
+    fixed_t oldx;
+    fixed_t oldy;
+    fixed_t oldz;
+    angle_t oldangle;
+
+    // Which mobj this is in an exact savegame being written or read.
+    int saveindex;
+
+    // Which of the mobjs P_SetupLevel spawned this is, counting from 1, for
+    // delta savegames; 0 if it's not one of them.
+    int baseline;
+
 } mobj_t;
 
 #endif
@@ -132,7 +132,7 @@ int EV_DoPlat(line_t *line, plattype_e type, int amount)
 
         // Find lowest & highest floors around sector
         rtn = 1;
-        plat = Z_Malloc(sizeof(*plat), PU_LEVSPEC, 0);
+        plat = P_AllocThinker(sizeof(*plat));
         P_AddThinker(&plat->thinker);
 
         plat->type = type;
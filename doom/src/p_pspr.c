@@ -44,7 +44,7 @@
 void P_SetPsprite(player_t *player, int position, statenum_t stnum)
 {
     pspdef_t *psp;
-    state_t *state;
+    const state_t *state;
 
     psp = &player->psprites[position];
 
@@ -59,10 +59,10 @@ void P_SetPsprite(player_t *player, int position, statenum_t stnum)
         psp->state = state;
         psp->tics = state->tics; // could be 0
 
-        if (state->misc1) {
+        if (statemisc[stnum].misc1) {
             // coordinate set
-            psp->sx = state->misc1 << FRACBITS;
-            psp->sy = state->misc2 << FRACBITS;
+            psp->sx = statemisc[stnum].misc1 << FRACBITS;
+            psp->sy = statemisc[stnum].misc2 << FRACBITS;
         }
 
         // Call action routine.
@@ -326,6 +326,7 @@ void A_Lower(player_t *player, pspdef_t *psp)
     }
 
     player->readyweapon = player->pendingweapon;
+    player->statusdirty = true;
 
     P_BringUpWeapon(player);
 }
@@ -448,6 +449,7 @@ static void DecreaseAmmo(player_t *player, int ammonum, int amount)
     } else {
         player->maxammo[ammonum - NUMAMMO] -= amount;
     }
+    player->statusdirty = true;
 }
 
 //
@@ -566,8 +568,11 @@ void A_FireShotgun(player_t *player, pspdef_t *psp)
 
     P_BulletSlope(player->mo);
 
+    P_StartPathFan(player->mo->x, player->mo->y, player->mo->angle, 255 << 18,
+                   MISSILERANGE);
     for (i = 0; i < 7; i++)
         P_GunShot(player->mo, false);
+    P_EndPathFan();
 }
 
 //
@@ -590,6 +595,8 @@ void A_FireShotgun2(player_t *player, pspdef_t *psp)
 
     P_BulletSlope(player->mo);
 
+    P_StartPathFan(player->mo->x, player->mo->y, player->mo->angle, 255 << 19,
+                   MISSILERANGE);
     for (i = 0; i < 20; i++) {
         damage = 5 * (P_Random() % 3 + 1);
         angle = player->mo->angle;
@@ -597,6 +604,7 @@ void A_FireShotgun2(player_t *player, pspdef_t *psp)
         P_LineAttack(player->mo, angle, MISSILERANGE,
                      bulletslope + ((P_Random() - P_Random()) << 5), damage);
     }
+    P_EndPathFan();
 }
 
 //
@@ -713,7 +721,7 @@ void P_MovePsprites(player_t *player)
 {
     int i;
     pspdef_t *psp;
-    state_t *state;
+    const state_t *state;
 
     psp = &player->psprites[0];
     for (i = 0; i < NUMPSPRITES; i++, psp++) {
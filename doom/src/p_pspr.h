@@ -52,7 +52,7 @@ typedef enum {
 } psprnum_t;
 
 typedef struct pspdef_s {
-    state_t *state; // a NULL state means not active
+    const state_t *state; // a NULL state means not active
     int tics;
     fixed_t sx;
     fixed_t sy;
@@ -16,15 +16,21 @@
 //      Archiving: SaveGame I/O.
 //
 
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "doomgeneric_deflate.h"
 #include "doomstat.h"
 #include "dstrings.h"
 #include "g_game.h"
 #include "i_system.h"
+#include "i_thread.h"
+#include "m_inflate.h"
 #include "m_misc.h"
+#include "m_random.h"
 #include "p_local.h"
 #include "p_saveg.h"
 #include "p_spec.h"
@@ -34,9 +40,69 @@
 #define SAVEGAME_EOF 0x1d
 #define VERSIONSIZE 16
 
-FILE *save_stream;
-int savegamelength;
+// Savegames are written to a buffer this big at first, doubled as needed.
+#define SAVEBUFFERSIZE (64 * 1024)
+
+// Compressed savegames keep the description at the start, where the menus
+// read it from, then this where the version would be, then the savegame's
+// length, its flags and its level's baseline checksum, each 32-bit little
+// endian, then the whole savegame as a zlib stream.
+#define SAVEGAME_ZMAGIC "DSGZ"
+#define ZHEADERSIZE (SAVESTRINGSIZE + 16)
+#define ZFLAG_DELTA 1
+
+byte *save_buffer;
+int save_length;
+int save_offset;
+static int save_size;
 boolean savegame_error;
+boolean savegame_exact;
+boolean savegame_delta;
+
+// A buffer savegame records are written to or read from.
+typedef struct {
+    byte *buffer;
+    int length;
+    int offset;
+    int size;
+} savestream_t;
+
+// The level as P_SetupLevel left it, as vanilla savegame records: its
+// sectors, then its lines, then the mobjs it spawned, numbered from 1.
+// Swapped in as save_buffer to write or read them.
+static savestream_t baseline;
+static unsigned int baselinechecksum;
+static int numbaselinemobjs;
+
+// Where each record of the baseline starts, and where the last one ends.
+static int *baselinerecords;
+static int maxbaselinerecords;
+
+// The checksum of the baseline a delta savegame being read was written
+// against.
+static unsigned int deltachecksum;
+
+// Where the delta record being written starts.
+static int deltastart;
+
+// The mobjs read from an exact savegame, by their saveindex, counting from
+// 1.
+static mobj_t **savemobjs;
+static int numsavemobjs;
+static int maxsavemobjs;
+
+// A save game to be written to a file on the I/O thread.
+typedef struct {
+    FILE *stream;
+    byte *buffer;
+    int length;
+    char *temp_file;
+    char *file;
+} savewrite_t;
+
+// The I/O job writing the last save game, if it may not have finished.
+static boolean writing;
+static unsigned int write_ticket;
 
 // Get the filename of a temporary file to write the savegame to.  After
 // the file has been successfully saved, it will be renamed to the
@@ -72,33 +138,259 @@ char *P_SaveGameFile(int slot)
     return filename;
 }
 
+static void WriteSaveGameJob(void *data)
+{
+    savewrite_t *write = data;
+    boolean ok;
+
+    ok = fwrite(write->buffer, 1, write->length, write->stream)
+         == (size_t)write->length;
+    ok &= fclose(write->stream) == 0;
+
+    // Only replace the old savegame with one that was written whole.
+    if (ok) {
+        remove(write->file);
+        ok = rename(write->temp_file, write->file) == 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "P_WriteSaveGame: Error while writing %s: %s\n",
+                write->file, strerror(errno));
+    }
+
+    free(write->buffer);
+    free(write->temp_file);
+    free(write->file);
+    free(write);
+}
+
+void P_FinishSaveGameWrite(void)
+{
+    if (writing) {
+        I_WaitIO(write_ticket);
+        writing = false;
+    }
+}
+
+void P_WriteSaveGame(FILE *stream, char *temp_file, char *filename)
+{
+    static boolean atexit_added;
+    savewrite_t *write;
+
+    if (!atexit_added) {
+        // Don't quit with a savegame half written.
+        I_AtExit(P_FinishSaveGameWrite, true);
+        atexit_added = true;
+    }
+
+    write = I_Realloc(NULL, sizeof(*write));
+    write->stream = stream;
+    write->buffer = save_buffer;
+    write->length = save_length;
+    write->temp_file = M_StringDuplicate(temp_file);
+    write->file = M_StringDuplicate(filename);
+    write_ticket = I_QueueIO(WriteSaveGameJob, write);
+    writing = true;
+
+    // The I/O job frees it.
+    save_buffer = NULL;
+    save_size = save_length = save_offset = 0;
+}
+
+static unsigned int GetLong(const byte *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static void PutLong(byte *p, unsigned int v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+}
+
+// 32-bit FNV-1a.
+static unsigned int Checksum(const byte *p, int length)
+{
+    unsigned int hash = 2166136261u;
+
+    while (length-- > 0) {
+        hash ^= *p++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// Exchange the savegame in memory with stream.
+static void SwapStream(savestream_t *stream)
+{
+    savestream_t current;
+
+    current.buffer = save_buffer;
+    current.length = save_length;
+    current.offset = save_offset;
+    current.size = save_size;
+
+    save_buffer = stream->buffer;
+    save_length = stream->length;
+    save_offset = stream->offset;
+    save_size = stream->size;
+
+    *stream = current;
+}
+
+void P_CompressSaveGame(void)
+{
+    byte *packed;
+    int size;
+
+    size = ZHEADERSIZE + DEFLATE_BOUND(save_length);
+    packed = I_Realloc(NULL, size);
+
+    memcpy(packed, save_buffer, SAVESTRINGSIZE);
+    memcpy(packed + SAVESTRINGSIZE, SAVEGAME_ZMAGIC, 4);
+    PutLong(packed + SAVESTRINGSIZE + 4, save_length);
+    PutLong(packed + SAVESTRINGSIZE + 8, savegame_delta ? ZFLAG_DELTA : 0);
+    PutLong(packed + SAVESTRINGSIZE + 12,
+            savegame_delta ? baselinechecksum : 0);
+
+    save_length = ZHEADERSIZE
+                  + Deflate_Zlib(save_buffer, save_length,
+                                 packed + ZHEADERSIZE);
+    free(save_buffer);
+    save_buffer = packed;
+    save_size = size;
+    save_offset = save_length;
+}
+
+// If the savegame just read from filename is compressed, put what it holds
+// in its place. Returns false if it's damaged.
+static boolean UncompressSaveGame(const char *filename)
+{
+    byte *unpacked;
+    unsigned int length;
+    unsigned int flags;
+
+    savegame_delta = false;
+    if (save_length < ZHEADERSIZE
+        || memcmp(save_buffer + SAVESTRINGSIZE, SAVEGAME_ZMAGIC, 4) != 0) {
+        return true;
+    }
+
+    length = GetLong(save_buffer + SAVESTRINGSIZE + 4);
+    flags = GetLong(save_buffer + SAVESTRINGSIZE + 8);
+
+    // DEFLATE can't shrink anything more than 1032 times.
+    if (length == 0 || length / 1032 > (unsigned int)save_length) {
+        fprintf(stderr, "P_ReadSaveGame: %s is damaged\n", filename);
+        return false;
+    }
+
+    unpacked = I_Realloc(NULL, length);
+    if (!M_InflateZlib(save_buffer + ZHEADERSIZE, save_length - ZHEADERSIZE,
+                       unpacked, length)) {
+        fprintf(stderr, "P_ReadSaveGame: %s is damaged\n", filename);
+        free(unpacked);
+        return false;
+    }
+
+    savegame_delta = (flags & ZFLAG_DELTA) != 0;
+    deltachecksum = GetLong(save_buffer + SAVESTRINGSIZE + 12);
+
+    free(save_buffer);
+    save_buffer = unpacked;
+    save_size = save_length = length;
+    save_offset = 0;
+
+    return true;
+}
+
+void P_BeginSaveGame(void)
+{
+    thinker_t *th;
+    int i;
+
+    save_length = save_offset = 0;
+    savegame_error = false;
+
+    // Number the mobjs for the pointers to them, in the order they're
+    // archived.
+    if (savegame_exact) {
+        i = 0;
+        for (th = thinkerclasscap[th_mobj].cnext;
+             th != &thinkerclasscap[th_mobj]; th = th->cnext) {
+            ((mobj_t *)th)->saveindex = ++i;
+        }
+    }
+}
+
+void P_ReadSaveGameBuffer(const byte *data, int length)
+{
+    if (length > save_size) {
+        save_buffer = I_Realloc(save_buffer, length);
+        save_size = length;
+    }
+    memcpy(save_buffer, data, length);
+    save_length = length;
+    save_offset = 0;
+
+    savegame_error = false;
+}
+
+boolean P_ReadSaveGame(char *filename)
+{
+    FILE *stream;
+    int length;
+
+    // It may be the savegame still being written.
+    P_FinishSaveGameWrite();
+
+    stream = fopen(filename, "rb");
+    if (stream == NULL) {
+        return false;
+    }
+
+    length = M_FileLength(stream);
+    if (length > save_size) {
+        save_buffer = I_Realloc(save_buffer, length);
+        save_size = length;
+    }
+    save_length = fread(save_buffer, 1, length, stream);
+    save_offset = 0;
+    fclose(stream);
+
+    savegame_error = false;
+    return UncompressSaveGame(filename);
+}
+
 // Endian-safe integer read/write functions
 
 static byte saveg_read8(void)
 {
-    byte result;
-
-    if (fread(&result, 1, 1, save_stream) < 1) {
+    if (save_offset >= save_length) {
         if (!savegame_error) {
             fprintf(stderr, "saveg_read8: Unexpected end of file while "
                             "reading save game\n");
 
             savegame_error = true;
         }
+
+        return 0;
     }
 
-    return result;
+    return save_buffer[save_offset++];
 }
 
 static void saveg_write8(byte value)
 {
-    if (fwrite(&value, 1, 1, save_stream) < 1) {
-        if (!savegame_error) {
-            fprintf(stderr, "saveg_write8: Error while writing save game\n");
-
-            savegame_error = true;
-        }
+    if (save_offset == save_size) {
+        save_size = save_size ? save_size * 2 : SAVEBUFFERSIZE;
+        save_buffer = I_Realloc(save_buffer, save_size);
     }
+
+    save_buffer[save_offset++] = value;
+    save_length = save_offset;
 }
 
 static short saveg_read16(void)
@@ -145,7 +437,7 @@ static void saveg_read_pad(void)
     int padding;
     int i;
 
-    pos = ftell(save_stream);
+    pos = save_offset;
 
     padding = (4 - (pos & 3)) & 3;
 
@@ -160,7 +452,7 @@ static void saveg_write_pad(void)
     int padding;
     int i;
 
-    pos = ftell(save_stream);
+    pos = save_offset;
 
     padding = (4 - (pos & 3)) & 3;
 
@@ -184,6 +476,45 @@ static void saveg_write_pad(void)
 #define saveg_readp() ((void)saveg_read32(), NULL)
 #define saveg_writep(p) ((void)p, saveg_write32(0))
 
+// Pointers to mobjs are kept in exact savegames, as the mobj's saveindex (0
+// for NULL and for mobjs that have been removed). They're read back as that
+// index, to be swizzled by MobjForIndex once all the mobjs have been read.
+
+static void saveg_write_mobjp(mobj_t *mobj)
+{
+    if (savegame_exact && mobj != NULL
+        && mobj->thinker.function == P_MobjThinker) {
+        saveg_write32(mobj->saveindex);
+    } else {
+        saveg_write32(0);
+    }
+}
+
+static mobj_t *saveg_read_mobjp(void)
+{
+    int index;
+
+    index = saveg_read32();
+    return savegame_exact ? (mobj_t *)(intptr_t)index : NULL;
+}
+
+static mobj_t *MobjForIndex(mobj_t *index)
+{
+    intptr_t i;
+
+    i = (intptr_t)index;
+    if (i < 0 || i > numsavemobjs)
+        I_Error("Bad mobj %i in savegame", (int)i);
+
+    return i == 0 ? NULL : savemobjs[i - 1];
+}
+
+// A saved thinker's function is only kept as whether it had one, since
+// ceilings and platforms in stasis don't. This stands in for it until the
+// kind of thinker is known.
+
+#define SAVEDFUNCTION ((think_t)(-2))
+
 // Enum values are 32-bit integers.
 
 #define saveg_read_enum saveg_read32
@@ -246,10 +577,7 @@ static void saveg_read_thinker_t(thinker_t *str)
     str->next = saveg_readp();
 
     // think_t function;
-    // Compilers may be too dumb to see that we're always setting it to NULL,
-    // which is OK for function pointers, so do it separately.
-    (void)saveg_readp();
-    str->function = NULL;
+    str->function = saveg_read32() ? SAVEDFUNCTION : NULL;
 }
 
 static void saveg_write_thinker_t(thinker_t *str)
@@ -261,7 +589,7 @@ static void saveg_write_thinker_t(thinker_t *str)
     saveg_writep(str->next);
 
     // think_t function;
-    saveg_writep(str->function);
+    saveg_write32(str->function != NULL);
 }
 
 //
@@ -285,7 +613,7 @@ static void saveg_read_mobj_t(mobj_t *str)
     str->z = saveg_read32();
 
     // struct mobj_s* snext;
-    str->snext = saveg_readp();
+    str->snext = saveg_read_mobjp();
 
     // struct mobj_s* sprev;
     str->sprev = saveg_readp();
@@ -300,7 +628,7 @@ static void saveg_read_mobj_t(mobj_t *str)
     str->frame = saveg_read32();
 
     // struct mobj_s* bnext;
-    str->bnext = saveg_readp();
+    str->bnext = saveg_read_mobjp();
 
     // struct mobj_s* bprev;
     str->bprev = saveg_readp();
@@ -357,7 +685,7 @@ static void saveg_read_mobj_t(mobj_t *str)
     str->movecount = saveg_read32();
 
     // struct mobj_s* target;
-    str->target = saveg_readp();
+    str->target = saveg_read_mobjp();
 
     // int reactiontime;
     str->reactiontime = saveg_read32();
@@ -382,7 +710,13 @@ static void saveg_read_mobj_t(mobj_t *str)
     saveg_read_mapthing_t(&str->spawnpoint);
 
     // struct mobj_s* tracer;
-    str->tracer = saveg_readp();
+    str->tracer = saveg_read_mobjp();
+
+    str->baseline = savegame_exact ? saveg_read32() : 0;
+
+    // Not saved; found again when it's linked in.
+    str->touching_sectorlist = NULL;
+    str->lookprev = NULL;
 }
 
 static void saveg_write_mobj_t(mobj_t *str)
@@ -400,7 +734,7 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write32(str->z);
 
     // struct mobj_s* snext;
-    saveg_writep(str->snext);
+    saveg_write_mobjp(str->snext);
 
     // struct mobj_s* sprev;
     saveg_writep(str->sprev);
@@ -415,7 +749,7 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write32(str->frame);
 
     // struct mobj_s* bnext;
-    saveg_writep(str->bnext);
+    saveg_write_mobjp(str->bnext);
 
     // struct mobj_s* bprev;
     saveg_writep(str->bprev);
@@ -472,7 +806,7 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write32(str->movecount);
 
     // struct mobj_s* target;
-    saveg_writep(str->target);
+    saveg_write_mobjp(str->target);
 
     // int reactiontime;
     saveg_write32(str->reactiontime);
@@ -494,7 +828,10 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write_mapthing_t(&str->spawnpoint);
 
     // struct mobj_s* tracer;
-    saveg_writep(str->tracer);
+    saveg_write_mobjp(str->tracer);
+
+    if (savegame_exact)
+        saveg_write32(str->baseline);
 }
 
 //
@@ -697,7 +1034,7 @@ static void saveg_read_player_t(player_t *str)
     str->bonuscount = saveg_read32();
 
     // mobj_t* attacker;
-    str->attacker = saveg_readp();
+    str->attacker = saveg_read_mobjp();
 
     // int extralight;
     str->extralight = saveg_read32();
@@ -821,7 +1158,7 @@ static void saveg_write_player_t(player_t *str)
     saveg_write32(str->bonuscount);
 
     // mobj_t* attacker;
-    saveg_writep(str->attacker);
+    saveg_write_mobjp(str->attacker);
 
     // int extralight;
     saveg_write32(str->extralight);
@@ -1280,6 +1617,49 @@ static void saveg_write_glow_t(glow_t *str)
     saveg_write32(str->direction);
 }
 
+//
+// fireflicker_t
+//
+
+static void saveg_read_fireflicker_t(fireflicker_t *str)
+{
+    int sector;
+
+    // thinker_t thinker;
+    saveg_read_thinker_t(&str->thinker);
+
+    // sector_t* sector;
+    sector = saveg_read32();
+    str->sector = &sectors[sector];
+
+    // int count;
+    str->count = saveg_read32();
+
+    // int maxlight;
+    str->maxlight = saveg_read32();
+
+    // int minlight;
+    str->minlight = saveg_read32();
+}
+
+static void saveg_write_fireflicker_t(fireflicker_t *str)
+{
+    // thinker_t thinker;
+    saveg_write_thinker_t(&str->thinker);
+
+    // sector_t* sector;
+    saveg_write32(str->sector - sectors);
+
+    // int count;
+    saveg_write32(str->count);
+
+    // int maxlight;
+    saveg_write32(str->maxlight);
+
+    // int minlight;
+    saveg_write32(str->minlight);
+}
+
 //
 // Write the header for a savegame
 //
@@ -1405,54 +1785,170 @@ void P_UnArchivePlayers(void)
         saveg_read_pad();
 
         saveg_read_player_t(&players[i]);
+        players[i].statusdirty = true;
 
         // will be set when unarc thinker
         players[i].mo = NULL;
         players[i].message = NULL;
-        players[i].attacker = NULL;
     }
 }
 
+//
+// Sectors and lines
+//
+
+static void ArchiveSector(sector_t *sec)
+{
+    if (savegame_exact) {
+        saveg_write32(sec->floorheight);
+        saveg_write32(sec->ceilingheight);
+    } else {
+        saveg_write16(sec->floorheight >> FRACBITS);
+        saveg_write16(sec->ceilingheight >> FRACBITS);
+    }
+    saveg_write16(sec->floorpic);
+    saveg_write16(sec->ceilingpic);
+    saveg_write16(sec->lightlevel);
+    saveg_write16(sec->special); // needed?
+    saveg_write16(sec->tag);     // needed?
+    if (savegame_exact)
+        saveg_write_mobjp(sec->soundtarget);
+}
+
+static void UnArchiveSector(sector_t *sec)
+{
+    if (savegame_exact) {
+        sec->floorheight = saveg_read32();
+        sec->ceilingheight = saveg_read32();
+    } else {
+        sec->floorheight = saveg_read16() << FRACBITS;
+        sec->ceilingheight = saveg_read16() << FRACBITS;
+    }
+    sec->floorpic = saveg_read16();
+    sec->ceilingpic = saveg_read16();
+    sec->lightlevel = saveg_read16();
+    sec->special = saveg_read16(); // needed?
+    sec->tag = saveg_read16();     // needed?
+    sec->specialdata = 0;
+    sec->soundtarget = 0;
+    if (savegame_exact)
+        sec->soundtarget = saveg_read_mobjp();
+}
+
+static void ArchiveLine(line_t *li)
+{
+    side_t *si;
+    int j;
+
+    saveg_write16(li->flags);
+    saveg_write16(li->special);
+    saveg_write16(li->tag);
+    for (j = 0; j < 2; j++) {
+        if (li->sidenum[j] == -1)
+            continue;
+
+        si = &sides[li->sidenum[j]];
+
+        saveg_write16(si->textureoffset >> FRACBITS);
+        saveg_write16(si->rowoffset >> FRACBITS);
+        saveg_write16(si->toptexture);
+        saveg_write16(si->bottomtexture);
+        saveg_write16(si->midtexture);
+    }
+}
+
+static void UnArchiveLine(line_t *li)
+{
+    side_t *si;
+    int j;
+
+    li->flags = saveg_read16();
+    li->special = saveg_read16();
+    li->tag = saveg_read16();
+    for (j = 0; j < 2; j++) {
+        if (li->sidenum[j] == -1)
+            continue;
+        si = &sides[li->sidenum[j]];
+        si->textureoffset = saveg_read16() << FRACBITS;
+        si->rowoffset = saveg_read16() << FRACBITS;
+        si->toptexture = saveg_read16();
+        si->bottomtexture = saveg_read16();
+        si->midtexture = saveg_read16();
+    }
+}
+
+//
+// Delta savegames
+// Each sector and line follows whether it's written: it's left out if it's
+// no different from the baseline's record, which is read in its place.
+//
+
+static void BeginDeltaRecord(void)
+{
+    deltastart = save_offset;
+    saveg_write8(1);
+}
+
+static void EndDeltaRecord(int record)
+{
+    int start = baselinerecords[record];
+    int length = baselinerecords[record + 1] - start;
+
+    if (save_offset - deltastart - 1 == length
+        && memcmp(save_buffer + deltastart + 1, baseline.buffer + start,
+                  length)
+               == 0) {
+        save_offset = save_length = deltastart;
+        saveg_write8(0);
+    }
+}
+
+// Returns true if the record was left out, in which case the baseline's is
+// read until EndBaselineRecord.
+static boolean BeginBaselineRecord(int record)
+{
+    if (saveg_read8() != 0)
+        return false;
+
+    SwapStream(&baseline);
+    save_offset = baselinerecords[record];
+    return true;
+}
+
+static void EndBaselineRecord(void)
+{
+    SwapStream(&baseline);
+}
+
 //
 // P_ArchiveWorld
 //
 void P_ArchiveWorld(void)
 {
     int i;
-    int j;
     sector_t *sec;
     line_t *li;
-    side_t *si;
 
     // do sectors
     for (i = 0, sec = sectors; i < numsectors; i++, sec++) {
-        saveg_write16(sec->floorheight >> FRACBITS);
-        saveg_write16(sec->ceilingheight >> FRACBITS);
-        saveg_write16(sec->floorpic);
-        saveg_write16(sec->ceilingpic);
-        saveg_write16(sec->lightlevel);
-        saveg_write16(sec->special); // needed?
-        saveg_write16(sec->tag);     // needed?
+        if (savegame_delta)
+            BeginDeltaRecord();
+        ArchiveSector(sec);
+        if (savegame_delta)
+            EndDeltaRecord(i);
     }
 
     // do lines
     for (i = 0, li = lines; i < numlines; i++, li++) {
-        saveg_write16(li->flags);
-        saveg_write16(li->special);
-        saveg_write16(li->tag);
-        for (j = 0; j < 2; j++) {
-            if (li->sidenum[j] == -1)
-                continue;
-
-            si = &sides[li->sidenum[j]];
-
-            saveg_write16(si->textureoffset >> FRACBITS);
-            saveg_write16(si->rowoffset >> FRACBITS);
-            saveg_write16(si->toptexture);
-            saveg_write16(si->bottomtexture);
-            saveg_write16(si->midtexture);
-        }
+        if (savegame_delta)
+            BeginDeltaRecord();
+        ArchiveLine(li);
+        if (savegame_delta)
+            EndDeltaRecord(numsectors + i);
     }
+
+    if (savegame_exact)
+        saveg_write32(prndindex);
 }
 
 //
@@ -1461,40 +1957,37 @@ void P_ArchiveWorld(void)
 void P_UnArchiveWorld(void)
 {
     int i;
-    int j;
     sector_t *sec;
     line_t *li;
-    side_t *si;
+    boolean frombaseline;
+
+    P_ClearSightCache();
+
+    if (savegame_delta && deltachecksum != baselinechecksum) {
+        I_Error("Savegame was saved from a different level; were the same "
+                "WADs and options used?");
+    }
 
     // do sectors
     for (i = 0, sec = sectors; i < numsectors; i++, sec++) {
-        sec->floorheight = saveg_read16() << FRACBITS;
-        sec->ceilingheight = saveg_read16() << FRACBITS;
-        sec->floorpic = saveg_read16();
-        sec->ceilingpic = saveg_read16();
-        sec->lightlevel = saveg_read16();
-        sec->special = saveg_read16(); // needed?
-        sec->tag = saveg_read16();     // needed?
-        sec->specialdata = 0;
-        sec->soundtarget = 0;
+        frombaseline = savegame_delta && BeginBaselineRecord(i);
+        UnArchiveSector(sec);
+        if (frombaseline)
+            EndBaselineRecord();
     }
 
     // do lines
     for (i = 0, li = lines; i < numlines; i++, li++) {
-        li->flags = saveg_read16();
-        li->special = saveg_read16();
-        li->tag = saveg_read16();
-        for (j = 0; j < 2; j++) {
-            if (li->sidenum[j] == -1)
-                continue;
-            si = &sides[li->sidenum[j]];
-            si->textureoffset = saveg_read16() << FRACBITS;
-            si->rowoffset = saveg_read16() << FRACBITS;
-            si->toptexture = saveg_read16();
-            si->bottomtexture = saveg_read16();
-            si->midtexture = saveg_read16();
-        }
+        frombaseline =
+            savegame_delta && BeginBaselineRecord(numsectors + i);
+        UnArchiveLine(li);
+        if (frombaseline)
+            EndBaselineRecord();
     }
+    surfacegeneration++;
+
+    if (savegame_exact)
+        prndindex = saveg_read32();
 }
 
 //
@@ -1506,6 +1999,49 @@ typedef enum {
 
 } thinkerclass_t;
 
+// Delta savegames write a mobj as its number in the baseline, or 0 if it
+// isn't from there, then its record, XORed with the baseline's if it is; the
+// fields that haven't changed since come out as runs of zeroes.
+static void XORBaselineMobj(int index, int start)
+{
+    int record = numsectors + numlines + index - 1;
+    const byte *base;
+    int length;
+    int i;
+
+    base = baseline.buffer + baselinerecords[record];
+    length = baselinerecords[record + 1] - baselinerecords[record];
+
+    for (i = 0; i < length && start + i < save_length; i++)
+        save_buffer[start + i] ^= base[i];
+}
+
+static void ArchiveDeltaMobj(mobj_t *mobj)
+{
+    int start;
+
+    saveg_write32(mobj->baseline);
+    start = save_offset;
+    saveg_write_mobj_t(mobj);
+
+    if (mobj->baseline != 0)
+        XORBaselineMobj(mobj->baseline, start);
+}
+
+static void UnArchiveDeltaMobj(mobj_t *mobj)
+{
+    int index;
+
+    index = saveg_read32();
+    if (index < 0 || index > numbaselinemobjs)
+        I_Error("Bad baseline mobj %i in savegame", index);
+
+    if (index != 0)
+        XORBaselineMobj(index, save_offset);
+    saveg_read_mobj_t(mobj);
+    mobj->baseline = index;
+}
+
 //
 // P_ArchiveThinkers
 //
@@ -1514,22 +2050,71 @@ void P_ArchiveThinkers(void)
     thinker_t *th;
 
     // save off the current thinkers
-    for (th = thinkercap.next; th != &thinkercap; th = th->next) {
-        if (th->function == P_MobjThinker) {
-            saveg_write8(tc_mobj);
-            saveg_write_pad();
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj];
+         th = th->cnext) {
+        saveg_write8(tc_mobj);
+        saveg_write_pad();
+        if (savegame_delta)
+            ArchiveDeltaMobj((mobj_t *)th);
+        else
             saveg_write_mobj_t((mobj_t *)th);
-
-            continue;
-        }
-
-        // I_Error ("P_ArchiveThinkers: Unknown thinker function");
     }
 
     // add a terminating marker
     saveg_write8(tc_end);
 }
 
+//
+// LinkMobj
+// Link a mobj from an exact savegame into its sector and block after the
+// mobjs saved after it there, so they end up in the same order as they were
+// saved in: things are linked in at the head.
+//
+static void LinkMobj(mobj_t *mobj)
+{
+    // Cleared once it's linked.
+    if (mobj->saveindex == 0)
+        return;
+    mobj->saveindex = 0;
+
+    if (mobj->snext != NULL)
+        LinkMobj(mobj->snext);
+    if (mobj->bnext != NULL)
+        LinkMobj(mobj->bnext);
+
+    P_SetThingPosition(mobj);
+}
+
+//
+// RelinkMobjs
+// Swizzle the pointers to mobjs in an exact savegame, once they've all been
+// read, and link them in.
+//
+static void RelinkMobjs(void)
+{
+    mobj_t *mobj;
+    int i;
+
+    for (i = 0; i < numsavemobjs; i++) {
+        mobj = savemobjs[i];
+        mobj->snext = MobjForIndex(mobj->snext);
+        mobj->bnext = MobjForIndex(mobj->bnext);
+        mobj->target = MobjForIndex(mobj->target);
+        mobj->tracer = MobjForIndex(mobj->tracer);
+    }
+
+    for (i = 0; i < MAXPLAYERS; i++) {
+        if (playeringame[i])
+            players[i].attacker = MobjForIndex(players[i].attacker);
+    }
+
+    for (i = 0; i < numsectors; i++)
+        sectors[i].soundtarget = MobjForIndex(sectors[i].soundtarget);
+
+    for (i = 0; i < numsavemobjs; i++)
+        LinkMobj(savemobjs[i]);
+}
+
 //
 // P_UnArchiveThinkers
 //
@@ -1541,39 +2126,58 @@ void P_UnArchiveThinkers(void)
     mobj_t *mobj;
 
     // remove all the current thinkers
+    P_WakeAllThinkers();
     currentthinker = thinkercap.next;
     while (currentthinker != &thinkercap) {
         next = currentthinker->next;
 
+        // Mobjs are freed too, since the level may be kept rather than
+        // reloaded.
         if (currentthinker->function == P_MobjThinker)
             P_RemoveMobj((mobj_t *)currentthinker);
-        else
-            Z_Free(currentthinker);
+        P_FreeThinker(currentthinker);
 
         currentthinker = next;
     }
     P_InitThinkers();
+    numsavemobjs = 0;
 
     // read in saved thinkers
     while (1) {
         tclass = saveg_read8();
         switch (tclass) {
         case tc_end:
+            if (savegame_exact)
+                RelinkMobjs();
             return; // end of list
 
         case tc_mobj:
             saveg_read_pad();
-            mobj = Z_Malloc(sizeof(*mobj), PU_LEVEL, NULL);
-            saveg_read_mobj_t(mobj);
-
-            mobj->target = NULL;
-            mobj->tracer = NULL;
-            P_SetThingPosition(mobj);
+            mobj = P_AllocThinker(sizeof(*mobj));
+            if (savegame_delta)
+                UnArchiveDeltaMobj(mobj);
+            else
+                saveg_read_mobj_t(mobj);
+
+            // Exact savegames' mobjs are linked in once they've all been
+            // read, and keep the floor and ceiling they were touching.
+            if (savegame_exact) {
+                if (numsavemobjs == maxsavemobjs) {
+                    maxsavemobjs = maxsavemobjs ? maxsavemobjs * 2 : 256;
+                    savemobjs = I_Realloc(savemobjs, maxsavemobjs
+                                                         * sizeof(*savemobjs));
+                }
+                savemobjs[numsavemobjs++] = mobj;
+                mobj->saveindex = numsavemobjs;
+            } else {
+                P_SetThingPosition(mobj);
+                mobj->floorz = mobj->subsector->sector->floorheight;
+                mobj->ceilingz = mobj->subsector->sector->ceilingheight;
+            }
             mobj->info = &mobjinfo[mobj->type];
-            mobj->floorz = mobj->subsector->sector->floorheight;
-            mobj->ceilingz = mobj->subsector->sector->ceilingheight;
             mobj->thinker.function = P_MobjThinker;
             P_AddThinker(&mobj->thinker);
+            P_StopInterpolating(mobj);
             break;
 
         default:
@@ -1593,10 +2197,172 @@ enum {
     tc_flash,
     tc_strobe,
     tc_glow,
-    tc_endspecials
+    tc_endspecials,
+
+    // Only in exact savegames: vanilla's lose fire flickers.
+    tc_fireflicker
 
 } specials_e;
 
+//
+// SpecialClass
+// Which tclass a special is archived as, or -1 for none. Vanilla savegames
+// also lose platforms in stasis; exact ones keep them.
+//
+static int SpecialClass(thinker_t *th)
+{
+    int i;
+
+    if (th->function == NULL) {
+        for (i = 0; i < MAXCEILINGS; i++)
+            if (activeceilings[i] == (ceiling_t *)th)
+                return tc_ceiling;
+
+        if (savegame_exact) {
+            for (i = 0; i < MAXPLATS; i++)
+                if (activeplats[i] == (plat_t *)th)
+                    return tc_plat;
+        }
+
+        return -1;
+    }
+
+    if (th->function == T_MoveCeiling)
+        return tc_ceiling;
+    if (th->function == T_VerticalDoor)
+        return tc_door;
+    if (th->function == T_MoveFloor)
+        return tc_floor;
+    if (th->function == T_PlatRaise)
+        return tc_plat;
+    if (th->function == T_LightFlash)
+        return tc_flash;
+    if (th->function == T_StrobeFlash)
+        return tc_strobe;
+    if (th->function == T_Glow)
+        return tc_glow;
+    if (th->function == T_FireFlicker && savegame_exact)
+        return tc_fireflicker;
+
+    return -1;
+}
+
+//
+// ArchiveExactSpecials
+// The rest of the level's state that only exact savegames keep: switches
+// waiting to pop back out, the boss brain's targets, the items waiting to
+// respawn and bodies waiting to be cleared away, and the order the mobjs
+// and specials think in.
+//
+static void ArchiveExactSpecials(void)
+{
+    thinker_t *th;
+    button_t *button;
+    int i;
+
+    for (i = 0, button = buttonlist; i < MAXBUTTONS; i++, button++) {
+        saveg_write32(button->line ? button->line - lines + 1 : 0);
+        saveg_write_enum(button->where);
+        saveg_write32(button->btexture);
+        saveg_write32(button->btimer);
+    }
+
+    saveg_write32(numbraintargets);
+    saveg_write32(braintargeton);
+    for (i = 0; i < numbraintargets; i++)
+        saveg_write_mobjp(braintargets[i]);
+
+    saveg_write32(iquehead);
+    saveg_write32(iquetail);
+    for (i = iquetail; i != iquehead; i = (i + 1) & (ITEMQUESIZE - 1)) {
+        saveg_write_mapthing_t(&itemrespawnque[i]);
+        saveg_write32(itemrespawntime[i]);
+    }
+
+    saveg_write32(bodyqueslot);
+    for (i = 0; i < bodyqueslot && i < BODYQUESIZE; i++)
+        saveg_write_mobjp(bodyque[i]);
+
+    // Each class is archived in order, so which comes next is enough.
+    P_WakeAllThinkers();
+    for (th = thinkercap.next; th != &thinkercap; th = th->next) {
+        if (th->function == P_MobjThinker)
+            saveg_write8(th_mobj);
+        else if (th->function != THINKER_REMOVED && SpecialClass(th) >= 0)
+            saveg_write8(th_special);
+    }
+    saveg_write8(NUMTHCLASSES);
+}
+
+//
+// UnArchiveExactSpecials
+//
+static void UnArchiveExactSpecials(void)
+{
+    thinker_t *next[NUMTHCLASSES];
+    thinker_t *th;
+    button_t *button;
+    int tclass;
+    int line;
+    int i;
+
+    for (i = 0, button = buttonlist; i < MAXBUTTONS; i++, button++) {
+        line = saveg_read32();
+        button->line = line ? &lines[line - 1] : NULL;
+        button->where = saveg_read_enum();
+        button->btexture = saveg_read32();
+        button->btimer = saveg_read32();
+        button->soundorg =
+            line ? &button->line->frontsector->soundorg : NULL;
+    }
+
+    numbraintargets = saveg_read32();
+    braintargeton = saveg_read32();
+    if (numbraintargets < 0 || numbraintargets > (int)arrlen(braintargets))
+        I_Error("Bad number of brain targets in savegame");
+    for (i = 0; i < numbraintargets; i++)
+        braintargets[i] = MobjForIndex(saveg_read_mobjp());
+
+    iquehead = saveg_read32() & (ITEMQUESIZE - 1);
+    iquetail = saveg_read32() & (ITEMQUESIZE - 1);
+    for (i = iquetail; i != iquehead; i = (i + 1) & (ITEMQUESIZE - 1)) {
+        saveg_read_mapthing_t(&itemrespawnque[i]);
+        itemrespawntime[i] = saveg_read32();
+    }
+
+    bodyqueslot = saveg_read32();
+    for (i = 0; i < bodyqueslot && i < BODYQUESIZE; i++)
+        bodyque[i] = MobjForIndex(saveg_read_mobjp());
+
+    // Put the unarchived thinkers back in the order they think in.
+    for (tclass = 0; tclass < NUMTHCLASSES; tclass++)
+        next[tclass] = thinkerclasscap[tclass].cnext;
+
+    thinkercap.prev = thinkercap.next = &thinkercap;
+
+    while ((tclass = saveg_read8()) != NUMTHCLASSES) {
+        if (tclass > NUMTHCLASSES
+            || next[tclass] == &thinkerclasscap[tclass]) {
+            I_Error("Bad thinker order in savegame");
+        }
+
+        th = next[tclass];
+        next[tclass] = th->cnext;
+
+        thinkercap.prev->next = th;
+        th->next = &thinkercap;
+        th->prev = thinkercap.prev;
+        thinkercap.prev = th;
+    }
+
+    for (tclass = 0; tclass < NUMTHCLASSES; tclass++) {
+        if (next[tclass] != &thinkerclasscap[tclass])
+            I_Error("Bad thinker order in savegame");
+    }
+
+    P_WakeAllThinkers();
+}
+
 //
 // Things to handle:
 //
@@ -1607,79 +2373,56 @@ enum {
 // T_StrobeFlash, (strobe_t: sector_t *),
 // T_Glow, (glow_t: sector_t *),
 // T_PlatRaise, (plat_t: sector_t *), - active list
+// T_FireFlicker, (fireflicker_t: sector_t *), - exact only
 //
 void P_ArchiveSpecials(void)
 {
     thinker_t *th;
-    int i;
+    int tclass;
 
     // save off the current thinkers
-    for (th = thinkercap.next; th != &thinkercap; th = th->next) {
-        if (th->function == NULL) {
-            for (i = 0; i < MAXCEILINGS; i++)
-                if (activeceilings[i] == (ceiling_t *)th)
-                    break;
-
-            if (i < MAXCEILINGS) {
-                saveg_write8(tc_ceiling);
-                saveg_write_pad();
-                saveg_write_ceiling_t((ceiling_t *)th);
-            }
+    for (th = thinkerclasscap[th_special].cnext;
+         th != &thinkerclasscap[th_special]; th = th->cnext) {
+        tclass = SpecialClass(th);
+        if (tclass < 0)
             continue;
-        }
 
-        if (th->function == T_MoveCeiling) {
-            saveg_write8(tc_ceiling);
-            saveg_write_pad();
-            saveg_write_ceiling_t((ceiling_t *)th);
-            continue;
-        }
+        saveg_write8(tclass);
+        saveg_write_pad();
 
-        if (th->function == T_VerticalDoor) {
-            saveg_write8(tc_door);
-            saveg_write_pad();
+        switch (tclass) {
+        case tc_ceiling:
+            saveg_write_ceiling_t((ceiling_t *)th);
+            break;
+        case tc_door:
             saveg_write_vldoor_t((vldoor_t *)th);
-            continue;
-        }
-
-        if (th->function == T_MoveFloor) {
-            saveg_write8(tc_floor);
-            saveg_write_pad();
+            break;
+        case tc_floor:
             saveg_write_floormove_t((floormove_t *)th);
-            continue;
-        }
-
-        if (th->function == T_PlatRaise) {
-            saveg_write8(tc_plat);
-            saveg_write_pad();
+            break;
+        case tc_plat:
             saveg_write_plat_t((plat_t *)th);
-            continue;
-        }
-
-        if (th->function == T_LightFlash) {
-            saveg_write8(tc_flash);
-            saveg_write_pad();
+            break;
+        case tc_flash:
             saveg_write_lightflash_t((lightflash_t *)th);
-            continue;
-        }
-
-        if (th->function == T_StrobeFlash) {
-            saveg_write8(tc_strobe);
-            saveg_write_pad();
+            break;
+        case tc_strobe:
             saveg_write_strobe_t((strobe_t *)th);
-            continue;
-        }
-
-        if (th->function == T_Glow) {
-            saveg_write8(tc_glow);
-            saveg_write_pad();
+            break;
+        case tc_glow:
             saveg_write_glow_t((glow_t *)th);
-            continue;
+            break;
+        case tc_fireflicker:
+            saveg_write_fireflicker_t((fireflicker_t *)th);
+            break;
         }
     }
 
     // add a terminating marker
     saveg_write8(tc_endspecials);
+
+    if (savegame_exact)
+        ArchiveExactSpecials();
 }
 
 //
@@ -1695,6 +2438,7 @@ void P_UnArchiveSpecials(void)
     lightflash_t *flash;
     strobe_t *strobe;
     glow_t *glow;
+    fireflicker_t *flick;
 
     // read in saved thinkers
     while (1) {
@@ -1702,11 +2446,13 @@ void P_UnArchiveSpecials(void)
 
         switch (tclass) {
         case tc_endspecials:
+            if (savegame_exact)
+                UnArchiveExactSpecials();
             return; // end of list
 
         case tc_ceiling:
             saveg_read_pad();
-            ceiling = Z_Malloc(sizeof(*ceiling), PU_LEVEL, NULL);
+            ceiling = P_AllocThinker(sizeof(*ceiling));
             saveg_read_ceiling_t(ceiling);
             ceiling->sector->specialdata = ceiling;
 
@@ -1719,7 +2465,7 @@ void P_UnArchiveSpecials(void)
 
         case tc_door:
             saveg_read_pad();
-            door = Z_Malloc(sizeof(*door), PU_LEVEL, NULL);
+            door = P_AllocThinker(sizeof(*door));
             saveg_read_vldoor_t(door);
             door->sector->specialdata = door;
             door->thinker.function = T_VerticalDoor;
@@ -1728,7 +2474,7 @@ void P_UnArchiveSpecials(void)
 
         case tc_floor:
             saveg_read_pad();
-            floor = Z_Malloc(sizeof(*floor), PU_LEVEL, NULL);
+            floor = P_AllocThinker(sizeof(*floor));
             saveg_read_floormove_t(floor);
             floor->sector->specialdata = floor;
             floor->thinker.function = T_MoveFloor;
@@ -1737,7 +2483,7 @@ void P_UnArchiveSpecials(void)
 
         case tc_plat:
             saveg_read_pad();
-            plat = Z_Malloc(sizeof(*plat), PU_LEVEL, NULL);
+            plat = P_AllocThinker(sizeof(*plat));
             saveg_read_plat_t(plat);
             plat->sector->specialdata = plat;
 
@@ -1750,7 +2496,7 @@ void P_UnArchiveSpecials(void)
 
         case tc_flash:
             saveg_read_pad();
-            flash = Z_Malloc(sizeof(*flash), PU_LEVEL, NULL);
+            flash = P_AllocThinker(sizeof(*flash));
             saveg_read_lightflash_t(flash);
             flash->thinker.function = T_LightFlash;
             P_AddThinker(&flash->thinker);
@@ -1758,7 +2504,7 @@ void P_UnArchiveSpecials(void)
 
         case tc_strobe:
             saveg_read_pad();
-            strobe = Z_Malloc(sizeof(*strobe), PU_LEVEL, NULL);
+            strobe = P_AllocThinker(sizeof(*strobe));
             saveg_read_strobe_t(strobe);
             strobe->thinker.function = T_StrobeFlash;
             P_AddThinker(&strobe->thinker);
@@ -1766,12 +2512,20 @@ void P_UnArchiveSpecials(void)
 
         case tc_glow:
             saveg_read_pad();
-            glow = Z_Malloc(sizeof(*glow), PU_LEVEL, NULL);
+            glow = P_AllocThinker(sizeof(*glow));
             saveg_read_glow_t(glow);
             glow->thinker.function = T_Glow;
             P_AddThinker(&glow->thinker);
             break;
 
+        case tc_fireflicker:
+            saveg_read_pad();
+            flick = P_AllocThinker(sizeof(*flick));
+            saveg_read_fireflicker_t(flick);
+            flick->thinker.function = T_FireFlicker;
+            P_AddThinker(&flick->thinker);
+            break;
+
         default:
             I_Error("P_UnarchiveSpecials:Unknown tclass %i "
                     "in savegame",
@@ -1779,3 +2533,79 @@ void P_UnArchiveSpecials(void)
         }
     }
 }
+
+//
+// P_SetSaveGameBaseline
+//
+
+static void AddBaselineRecord(int record)
+{
+    if (record >= maxbaselinerecords) {
+        maxbaselinerecords =
+            maxbaselinerecords ? maxbaselinerecords * 2 : 1024;
+        baselinerecords =
+            I_Realloc(baselinerecords,
+                      maxbaselinerecords * sizeof(*baselinerecords));
+    }
+
+    baselinerecords[record] = save_offset;
+}
+
+void P_SetSaveGameBaseline(void)
+{
+    boolean exact;
+    thinker_t *th;
+    mobj_t *mobj;
+    mobj_t copy;
+    int record;
+    int i;
+
+    // The savegame being loaded may be in save_buffer.
+    exact = savegame_exact;
+    savegame_exact = false;
+    SwapStream(&baseline);
+    save_length = save_offset = 0;
+    record = 0;
+
+    for (i = 0; i < numsectors; i++) {
+        AddBaselineRecord(record++);
+        ArchiveSector(&sectors[i]);
+    }
+
+    for (i = 0; i < numlines; i++) {
+        AddBaselineRecord(record++);
+        ArchiveLine(&lines[i]);
+    }
+
+    numbaselinemobjs = 0;
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj];
+         th = th->cnext) {
+        mobj = (mobj_t *)th;
+
+        // Players may be spawned at random in deathmatch.
+        if (mobj->player != NULL) {
+            mobj->baseline = 0;
+            continue;
+        }
+
+        // What P_Random gave it depends on what ran before the level, so
+        // may differ when a savegame of it is loaded.
+        copy = *mobj;
+        copy.tics = mobj->state->tics;
+        copy.lastlook = 0;
+        copy.validcount = 0;
+
+        mobj->baseline = ++numbaselinemobjs;
+        AddBaselineRecord(record++);
+        saveg_write_mobj_t(&copy);
+    }
+
+    AddBaselineRecord(record);
+
+    // Loading a delta savegame with different WADs or options, which would
+    // spawn different things, is caught by this not matching.
+    baselinechecksum = Checksum(save_buffer, save_length);
+
+    SwapStream(&baseline);
+    savegame_exact = exact;
+}
@@ -56,7 +56,57 @@ void P_UnArchiveThinkers(void);
 void P_ArchiveSpecials(void);
 void P_UnArchiveSpecials(void);
 
-extern FILE *save_stream;
+// The savegame being read or written, all in memory: save_length bytes of
+// save_buffer, of which save_offset have been read or written.
+
+extern byte *save_buffer;
+extern int save_length;
+extern int save_offset;
 extern boolean savegame_error;
 
+// Set to archive and unarchive the level exactly, so it plays on just as it
+// would have if it had never been saved: with the pointers between mobjs,
+// the order things think in and are linked into sectors and blocks, the
+// heights of moving floors to the fraction, and the P_Random index, none of
+// which vanilla savegames keep. For snapshots in memory, not files.
+
+extern boolean savegame_exact;
+
+// Set to archive the sectors, lines and mobjs of the level as deltas from
+// how P_SetupLevel left it, which only a savegame loaded into the same
+// level can read. For compressed savegames only, which keep whether they
+// are.
+
+extern boolean savegame_delta;
+
+// Remember the level as P_SetupLevel left it, for delta savegames.
+
+void P_SetSaveGameBaseline(void);
+
+// Start writing a new savegame in memory.
+
+void P_BeginSaveGame(void);
+
+// Read a whole savegame file into memory, uncompressing it if it was
+// compressed. Returns false if it can't be opened or is damaged.
+
+boolean P_ReadSaveGame(char *filename);
+
+// Read a savegame from somewhere else in memory.
+
+void P_ReadSaveGameBuffer(const byte *data, int length);
+
+// Compress the savegame written in memory, to be written to a file.
+
+void P_CompressSaveGame(void);
+
+// Write the savegame in memory to stream on the I/O thread, then close it
+// and rename temp_file to filename.
+
+void P_WriteSaveGame(FILE *stream, char *temp_file, char *filename);
+
+// Wait until the savegame being written, if any, is in its file.
+
+void P_FinishSaveGameWrite(void);
+
 #endif
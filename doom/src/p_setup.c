@@ -18,6 +18,9 @@
 //
 
 #include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "doomdef.h"
@@ -28,10 +31,13 @@
 #include "m_argv.h"
 #include "m_bbox.h"
 #include "p_local.h"
+#include "p_saveg.h"
 #include "p_spec.h"
 #include "r_data.h"
 #include "r_things.h"
+#include "r_view.h"
 #include "s_sound.h"
+#include "w_prefetch.h"
 #include "w_wad.h"
 #include "z_zone.h"
 
@@ -73,10 +79,10 @@ static int totallines;
 //
 // Blockmap size.
 int bmapwidth;
-int bmapheight;  // size in mapblocks
-short *blockmap; // int for larger maps
+int bmapheight; // size in mapblocks
+int *blockmap;  // int for larger maps
 // offsets in blockmap are from here
-short *blockmaplump;
+int *blockmaplump;
 // origin of block map
 fixed_t bmaporgx;
 fixed_t bmaporgy;
@@ -452,40 +458,308 @@ void P_LoadSideDefs(int lump)
     W_ReleaseLumpNum(lump);
 }
 
+//
+// LineTouchesBlock
+// Whether the line's segment touches the block whose bottom left corner is
+// at x, y, in map units.
+//
+static boolean LineTouchesBlock(line_t *ld, int x, int y)
+{
+    int64_t x1, y1, dx, dy;
+    int64_t side;
+    int i;
+    int sign;
+
+    if ((ld->bbox[BOXLEFT] >> FRACBITS) > x + MAPBLOCKUNITS
+        || (ld->bbox[BOXRIGHT] >> FRACBITS) < x
+        || (ld->bbox[BOXBOTTOM] >> FRACBITS) > y + MAPBLOCKUNITS
+        || (ld->bbox[BOXTOP] >> FRACBITS) < y) {
+        return false;
+    }
+
+    x1 = ld->v1->x >> FRACBITS;
+    y1 = ld->v1->y >> FRACBITS;
+    dx = ld->dx >> FRACBITS;
+    dy = ld->dy >> FRACBITS;
+
+    // It misses if every corner is strictly to one side of it.
+    sign = 0;
+    for (i = 0; i < 4; i++) {
+        side = dx * (y + (i >> 1) * MAPBLOCKUNITS - y1)
+               - dy * (x + (i & 1) * MAPBLOCKUNITS - x1);
+        if (side == 0)
+            return true;
+        if (sign == 0)
+            sign = side > 0 ? 1 : -1;
+        else if ((side > 0 ? 1 : -1) != sign)
+            return true;
+    }
+
+    return false;
+}
+
+//
+// ForEachLineBlock
+// Calls func with the index of each block the line touches.
+//
+static void ForEachLineBlock(line_t *ld, void (*func)(int block, int linenum))
+{
+    int bx1, bx2, by1, by2;
+    int bx, by;
+    int orgx = bmaporgx >> FRACBITS;
+    int orgy = bmaporgy >> FRACBITS;
+
+    bx1 = ((ld->bbox[BOXLEFT] >> FRACBITS) - orgx) / MAPBLOCKUNITS;
+    bx2 = ((ld->bbox[BOXRIGHT] >> FRACBITS) - orgx) / MAPBLOCKUNITS;
+    by1 = ((ld->bbox[BOXBOTTOM] >> FRACBITS) - orgy) / MAPBLOCKUNITS;
+    by2 = ((ld->bbox[BOXTOP] >> FRACBITS) - orgy) / MAPBLOCKUNITS;
+
+    // Lines along a block's edge touch the block before it too.
+    if (bx1 > 0)
+        bx1--;
+    if (by1 > 0)
+        by1--;
+    if (bx2 >= bmapwidth)
+        bx2 = bmapwidth - 1;
+    if (by2 >= bmapheight)
+        by2 = bmapheight - 1;
+
+    for (by = by1; by <= by2; by++) {
+        for (bx = bx1; bx <= bx2; bx++) {
+            if (LineTouchesBlock(ld, orgx + bx * MAPBLOCKUNITS,
+                                 orgy + by * MAPBLOCKUNITS)) {
+                func(by * bmapwidth + bx, ld - lines);
+            }
+        }
+    }
+}
+
+static int *blockcounts;
+static int *blocklines;
+
+static void CountBlockLine(int block, int linenum)
+{
+    (void)linenum;
+    blockcounts[block]++;
+}
+
+static void AddBlockLine(int block, int linenum)
+{
+    blocklines[blockcounts[block]++] = linenum;
+}
+
+//
+// HashBlockList
+//
+static unsigned HashBlockList(const int *list)
+{
+    unsigned hash = 5381;
+
+    for (; *list != -1; list++)
+        hash = hash * 33 + *list;
+    return hash;
+}
+
+//
+// CreateBlockMap
+// Build the blockmap from the lines, for maps whose BLOCKMAP lump can't be
+// used. Block lists that are the same are stored once, and don't start with
+// the line 0 that node builders put in every one.
+//
+static void CreateBlockMap(void)
+{
+    int i;
+    int numblocks;
+    int total;
+    int minx, miny, maxx, maxy;
+    int *starts;
+    int *list;
+    int *out;
+    int *table;
+    int tablemask;
+    int slot;
+    unsigned hash;
+
+    minx = miny = INT_MAX;
+    maxx = maxy = INT_MIN;
+    for (i = 0; i < numvertexes; i++) {
+        if (vertexes[i].x >> FRACBITS < minx)
+            minx = vertexes[i].x >> FRACBITS;
+        if (vertexes[i].x >> FRACBITS > maxx)
+            maxx = vertexes[i].x >> FRACBITS;
+        if (vertexes[i].y >> FRACBITS < miny)
+            miny = vertexes[i].y >> FRACBITS;
+        if (vertexes[i].y >> FRACBITS > maxy)
+            maxy = vertexes[i].y >> FRACBITS;
+    }
+
+    bmaporgx = minx << FRACBITS;
+    bmaporgy = miny << FRACBITS;
+    bmapwidth = (maxx - minx) / MAPBLOCKUNITS + 1;
+    bmapheight = (maxy - miny) / MAPBLOCKUNITS + 1;
+    numblocks = bmapwidth * bmapheight;
+
+    // Count the lines in each block, then lay the lists out one after
+    // another, in line order.
+    blockcounts = Z_Malloc(numblocks * sizeof(*blockcounts), PU_STATIC, 0);
+    starts = Z_Malloc((numblocks + 1) * sizeof(*starts), PU_STATIC, 0);
+    memset(blockcounts, 0, numblocks * sizeof(*blockcounts));
+
+    for (i = 0; i < numlines; i++)
+        ForEachLineBlock(&lines[i], CountBlockLine);
+
+    total = 0;
+    for (i = 0; i < numblocks; i++) {
+        starts[i] = total;
+        total += blockcounts[i] + 1;
+        blockcounts[i] = starts[i];
+    }
+    starts[numblocks] = total;
+
+    blocklines = Z_Malloc(total * sizeof(*blocklines), PU_STATIC, 0);
+    for (i = 0; i < numlines; i++)
+        ForEachLineBlock(&lines[i], AddBlockLine);
+    for (i = 0; i < numblocks; i++)
+        blocklines[starts[i + 1] - 1] = -1;
+
+    // Copy each list out unless the same one already was, finding those
+    // in an open-addressed hash of their offsets.
+    for (tablemask = 1; tablemask < numblocks * 2; tablemask <<= 1) {
+    }
+    table = Z_Malloc(tablemask * sizeof(*table), PU_STATIC, 0);
+    for (i = 0; i < tablemask; i++)
+        table[i] = -1;
+    tablemask--;
+
+    blockmaplump =
+        Z_Malloc((4 + numblocks + total) * sizeof(*blockmaplump), PU_LEVEL, 0);
+    blockmap = blockmaplump + 4;
+    blockmaplump[0] = minx;
+    blockmaplump[1] = miny;
+    blockmaplump[2] = bmapwidth;
+    blockmaplump[3] = bmapheight;
+    out = blockmap + numblocks;
+
+    for (i = 0; i < numblocks; i++) {
+        list = blocklines + starts[i];
+        hash = HashBlockList(list);
+
+        for (slot = hash & tablemask; table[slot] != -1;
+             slot = (slot + 1) & tablemask) {
+            if (!memcmp(blockmaplump + table[slot], list,
+                        (starts[i + 1] - starts[i]) * sizeof(*list))) {
+                break;
+            }
+        }
+
+        if (table[slot] == -1) {
+            table[slot] = out - blockmaplump;
+            memcpy(out, list, (starts[i + 1] - starts[i]) * sizeof(*list));
+            out += starts[i + 1] - starts[i];
+        }
+        blockmap[i] = table[slot];
+    }
+
+    Z_Free(table);
+    Z_Free(blocklines);
+    Z_Free(starts);
+    Z_Free(blockcounts);
+}
+
+//
+// BlockMapIsValid
+// Whether the header and every block list lie within the lump's count
+// shorts and only refer to lines that exist.
+//
+static boolean BlockMapIsValid(int count)
+{
+    int i;
+    int offset;
+
+    if (bmapwidth <= 0 || bmapheight <= 0
+        || 4 + bmapwidth * bmapheight > count) {
+        return false;
+    }
+
+    for (i = 0; i < bmapwidth * bmapheight; i++) {
+        offset = blockmap[i];
+        if (offset < 4 + bmapwidth * bmapheight)
+            return false;
+
+        for (; offset < count && blockmaplump[offset] != -1; offset++) {
+            if (blockmaplump[offset] >= numlines)
+                return false;
+        }
+        if (offset == count)
+            return false;
+    }
+
+    return true;
+}
+
 //
 // P_LoadBlockMap
+// The lump's offsets and line numbers are read as unsigned, for maps with
+// more lines than a short holds. It's rebuilt if it's missing or damaged,
+// or longer than 16-bit offsets reach.
 //
 void P_LoadBlockMap(int lump)
 {
     int i;
     int count;
-    int lumplen;
+    short *data;
+    boolean valid;
+
+    //!
+    // @category mod
+    //
+    // Build the blockmap rather than using the map's BLOCKMAP lump. Demos
+    // may play differently.
+    //
+
+    valid = false;
+    if (!M_CheckParm("-blockmap")
+        && !strncasecmp(lumpinfo[lump].name, "BLOCKMAP", 8)
+        && W_LumpLength(lump) >= 8) {
+        count = W_LumpLength(lump) / 2;
+        data = W_CacheLumpNum(lump, PU_STATIC);
+
+        blockmaplump = Z_Malloc(count * sizeof(*blockmaplump), PU_LEVEL, NULL);
+        blockmap = blockmaplump + 4;
+
+        // Swap all short integers to native byte ordering.
+
+        for (i = 0; i < count; i++) {
+            blockmaplump[i] = (unsigned short)SHORT(data[i]);
+            if (blockmaplump[i] == 0xffff)
+                blockmaplump[i] = -1;
+        }
 
-    lumplen = W_LumpLength(lump);
-    count = lumplen / 2;
+        // Read the header
 
-    blockmaplump = Z_Malloc(lumplen, PU_LEVEL, NULL);
-    W_ReadLump(lump, blockmaplump);
-    blockmap = blockmaplump + 4;
+        bmaporgx = SHORT(data[0]) << FRACBITS;
+        bmaporgy = SHORT(data[1]) << FRACBITS;
+        bmapwidth = SHORT(data[2]);
+        bmapheight = SHORT(data[3]);
 
-    // Swap all short integers to native byte ordering.
+        W_ReleaseLumpNum(lump);
 
-    for (i = 0; i < count; i++) {
-        blockmaplump[i] = SHORT(blockmaplump[i]);
+        valid = count <= 0x10000 && BlockMapIsValid(count);
+        if (!valid) {
+            fprintf(stderr, "P_LoadBlockMap: Rebuilding the blockmap\n");
+            Z_Free(blockmaplump);
+        }
     }
 
-    // Read the header
-
-    bmaporgx = blockmaplump[0] << FRACBITS;
-    bmaporgy = blockmaplump[1] << FRACBITS;
-    bmapwidth = blockmaplump[2];
-    bmapheight = blockmaplump[3];
+    if (!valid)
+        CreateBlockMap();
 
     // Clear out mobj chains
 
     count = sizeof(*blocklinks) * bmapwidth * bmapheight;
     blocklinks = Z_Malloc(count, PU_LEVEL, 0);
     memset(blocklinks, 0, count);
+    P_InitFineBlocks();
 }
 
 //
@@ -504,6 +778,7 @@ void P_GroupLines(void)
     seg_t *seg;
     fixed_t bbox[4];
     int block;
+    sectorlink_t *links;
 
     // look up sector number for each subsector
     ss = subsectors;
@@ -560,6 +835,43 @@ void P_GroupLines(void)
         }
     }
 
+    // Link sectors to their neighbours through their two-sided lines, in
+    // the order of their lines, as getNextSector() would find them. Only
+    // the line openings change during play.
+
+    totallines = 0;
+    for (i = 0; i < numsectors; i++) {
+        sector = &sectors[i];
+
+        for (j = 0; j < sector->linecount; j++) {
+            li = sector->lines[j];
+            if ((li->flags & ML_TWOSIDED) && li->sidenum[1] != -1)
+                totallines++;
+        }
+    }
+
+    links = Z_Malloc(totallines * sizeof(sectorlink_t), PU_LEVEL, 0);
+
+    for (i = 0; i < numsectors; i++) {
+        sector = &sectors[i];
+        sector->neighbours = links;
+        sector->neighbourcount = 0;
+
+        for (j = 0; j < sector->linecount; j++) {
+            li = sector->lines[j];
+            if (!(li->flags & ML_TWOSIDED) || li->sidenum[1] == -1)
+                continue;
+
+            links->line = li;
+            if (sides[li->sidenum[0]].sector == sector)
+                links->other = sides[li->sidenum[1]].sector;
+            else
+                links->other = sides[li->sidenum[0]].sector;
+            links++;
+            sector->neighbourcount++;
+        }
+    }
+
     // Generate bounding boxes for sectors
 
     sector = sectors;
@@ -645,10 +957,81 @@ static void PadRejectArray(byte *array, unsigned int len)
     }
 }
 
+static boolean P_RejectIsZero(byte *reject, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++) {
+        if (reject[i])
+            return false;
+    }
+    return true;
+}
+
+//
+// P_RejectUnconnectedSectors
+// Sight can't pass between sectors that no chain of two-sided lines joins,
+// so those pairs can be rejected without changing the result of any sight
+// check. Used to fill in the REJECT lumps that nodebuilders leave empty.
+//
+static void P_RejectUnconnectedSectors(void)
+{
+    int *group;
+    int i, j;
+    int a, b;
+    int pnum;
+
+    group = Z_Malloc(numsectors * sizeof(*group), PU_STATIC, NULL);
+    for (i = 0; i < numsectors; i++)
+        group[i] = i;
+
+    // Union the sectors on each side of two-sided lines.
+    for (i = 0; i < numlines; i++) {
+        if (!lines[i].backsector)
+            continue;
+
+        a = lines[i].frontsector - sectors;
+        while (group[a] != a)
+            a = group[a] = group[group[a]];
+        b = lines[i].backsector - sectors;
+        while (group[b] != b)
+            b = group[b] = group[group[b]];
+        if (a < b)
+            group[b] = a;
+        else
+            group[a] = b;
+    }
+
+    // A parent always has a lower number than its children, so one pass in
+    // order resolves every sector to its group's root.
+    for (i = 0; i < numsectors; i++)
+        group[i] = group[group[i]];
+
+    // Usually the whole level is one group.
+    for (i = 0; i < numsectors && group[i] == 0; i++)
+        ;
+    if (i == numsectors) {
+        Z_Free(group);
+        return;
+    }
+
+    for (i = 0; i < numsectors; i++) {
+        for (j = 0; j < numsectors; j++) {
+            if (group[i] != group[j]) {
+                pnum = i * numsectors + j;
+                rejectmatrix[pnum >> 3] |= 1 << (pnum & 7);
+            }
+        }
+    }
+
+    Z_Free(group);
+}
+
 static void P_LoadReject(int lumpnum)
 {
     int minlength;
     int lumplen;
+    boolean iszero;
 
     // Calculate the size that the REJECT lump *should* be.
 
@@ -662,14 +1045,63 @@ static void P_LoadReject(int lumpnum)
 
     if (lumplen >= minlength) {
         rejectmatrix = W_CacheLumpNum(lumpnum, PU_LEVEL);
+        if (!P_RejectIsZero(rejectmatrix, minlength))
+            return;
+
+        // Fill in a copy rather than the cached lump.
+        W_ReleaseLumpNum(lumpnum);
+        rejectmatrix = Z_Malloc(minlength, PU_LEVEL, &rejectmatrix);
+        memset(rejectmatrix, 0, minlength);
     } else {
         rejectmatrix = Z_Malloc(minlength, PU_LEVEL, &rejectmatrix);
         W_ReadLump(lumpnum, rejectmatrix);
+        iszero = P_RejectIsZero(rejectmatrix, lumplen);
 
         PadRejectArray(rejectmatrix + lumplen, minlength - lumplen);
+        if (!iszero)
+            return;
+    }
+
+    P_RejectUnconnectedSectors();
+}
+
+static void MapLumpName(char *lumpname, int episode, int map)
+{
+    if (gamemode == commercial) {
+        int len = snprintf(lumpname, 9, "map%.2d", map);
+        assert(len < 9);
+        (void)len;
+    } else {
+        lumpname[0] = 'E';
+        lumpname[1] = '0' + episode;
+        lumpname[2] = 'M';
+        lumpname[3] = '0' + map;
+        lumpname[4] = 0;
     }
 }
 
+//
+// P_PrefetchLevel
+// Starts reading a level's lumps in the background, so a later
+// P_SetupLevel for it doesn't wait on the disk. Only the reads are done
+// ahead: parsing the lumps would replace the current level's data.
+//
+void P_PrefetchLevel(int episode, int map)
+{
+    char lumpname[9];
+    int lumpnum;
+    int i;
+
+    MapLumpName(lumpname, episode, map);
+    lumpnum = W_CheckNumForName(lumpname);
+
+    if (lumpnum < 0 || lumpnum + ML_BLOCKMAP >= (int)numlumps)
+        return;
+
+    for (i = ML_THINGS; i <= ML_BLOCKMAP; i++)
+        W_PrefetchLump(lumpnum + i);
+}
+
 //
 // P_SetupLevel
 //
@@ -693,40 +1125,47 @@ void P_SetupLevel(int episode, int map)
     // Make sure all sounds are stopped before Z_FreeTags.
     S_Start();
 
+    // And the view's done with the level it's about to free.
+    R_ClearView();
+    R_UnpinLevel();
     Z_FreeTags(PU_LEVEL, PU_PURGELEVEL - 1);
+    P_ClearThinkerMemory();
+    P_ClearSightCache();
+    P_ClearSectorNodes();
+    P_ClearLookWheel();
 
     // UNUSED W_Profile ();
     P_InitThinkers();
 
     // find map name
-    if (gamemode == commercial) {
-        int len = snprintf(lumpname, 9, "map%.2d", map);
-        assert(len < 9);
-        (void)len;
-    } else {
-        lumpname[0] = 'E';
-        lumpname[1] = '0' + episode;
-        lumpname[2] = 'M';
-        lumpname[3] = '0' + map;
-        lumpname[4] = 0;
-    }
-
+    MapLumpName(lumpname, episode, map);
     lumpnum = W_GetNumForName(lumpname);
 
     leveltime = 0;
 
+    // Read the rest of the map's lumps while the first are parsed.
+    for (i = ML_THINGS; i <= ML_BLOCKMAP; i++)
+        W_PrefetchLump(lumpnum + i);
+
     // note: most of this ordering is important
-    P_LoadBlockMap(lumpnum + ML_BLOCKMAP);
+    // The lumps are parsed afresh each time rather than loaded from a
+    // preprocessed cache: the geometry takes well under a millisecond for a
+    // typical map, which SHA-1 over the same lumps to key a cache would cost
+    // nearly as much as. Spawning the things is the biggest part and can't
+    // be cached anyway.
     P_LoadVertexes(lumpnum + ML_VERTEXES);
     P_LoadSectors(lumpnum + ML_SECTORS);
     P_LoadSideDefs(lumpnum + ML_SIDEDEFS);
 
     P_LoadLineDefs(lumpnum + ML_LINEDEFS);
+    // After the lines, to check it against them or build it from them.
+    P_LoadBlockMap(lumpnum + ML_BLOCKMAP);
     P_LoadSubsectors(lumpnum + ML_SSECTORS);
     P_LoadNodes(lumpnum + ML_NODES);
     P_LoadSegs(lumpnum + ML_SEGS);
 
     P_GroupLines();
+    R_InitLevelSegs();
     P_LoadReject(lumpnum + ML_REJECT);
 
     bodyqueslot = 0;
@@ -748,6 +1187,9 @@ void P_SetupLevel(int episode, int map)
     // set up world state
     P_SpawnSpecials();
 
+    // What delta savegames of the level are written against.
+    P_SetSaveGameBaseline();
+
     // build subsector connect matrix
     //  UNUSED P_ConnectSubsectors ();
 
@@ -765,5 +1207,7 @@ void P_Init(void)
 {
     P_InitSwitchList();
     P_InitPicAnims();
+    P_InitLightBatch();
+    P_InitLookWheel();
     R_InitSprites(sprnames);
 }
@@ -22,6 +22,9 @@
 // NOT called by W_Ticker. FIXME.
 void P_SetupLevel(int episode, int map);
 
+// Reads a level's lumps ahead of P_SetupLevel, e.g. during intermission.
+void P_PrefetchLevel(int episode, int map);
+
 // Called by startup code.
 void P_Init(void);
 
@@ -20,6 +20,7 @@
 
 #include "doomdef.h"
 #include "i_system.h"
+#include "m_counts.h"
 #include "p_local.h"
 #include "r_main.h"
 #include "r_state.h"
@@ -37,6 +38,31 @@ fixed_t t2y;
 
 int sightcounts[2];
 
+// Results of recent full sight checks. A check only depends on where the two
+// things are and on the level's geometry, so it's keyed on their positions
+// and sizes plus a generation that changes whenever a floor or ceiling
+// moves, which also keeps entries from matching in a different level.
+#define SIGHTCACHESIZE 1024 // power of two
+
+typedef struct {
+    fixed_t x1, y1, z1, height1;
+    fixed_t x2, y2, z2, height2;
+    int generation;
+    boolean visible;
+} sightcache_t;
+
+static sightcache_t sightcache[SIGHTCACHESIZE];
+static int sightgeneration = 1;
+
+//
+// P_ClearSightCache
+// Call when sector heights change.
+//
+void P_ClearSightCache(void)
+{
+    ++sightgeneration;
+}
+
 //
 // P_DivlineSide
 // Returns side 0 (front), 1 (back), or 2 (on).
@@ -280,6 +306,10 @@ boolean P_CheckSight(mobj_t *t1, mobj_t *t2)
     int pnum;
     int bytenum;
     int bitnum;
+    unsigned int hash;
+    sightcache_t *cached;
+
+    M_CountWork(work_sightchecks, 1);
 
     // First check for trivial rejection.
 
@@ -293,6 +323,7 @@ boolean P_CheckSight(mobj_t *t1, mobj_t *t2)
     // Check in REJECT table.
     if (rejectmatrix[bytenum] & bitnum) {
         sightcounts[0]++;
+        M_CountWork(work_rejecthits, 1);
 
         // can't possibly be connected
         return false;
@@ -302,6 +333,19 @@ boolean P_CheckSight(mobj_t *t1, mobj_t *t2)
     // Now look from eyes of t1 to any part of t2.
     sightcounts[1]++;
 
+    hash = (unsigned int)t1->x ^ (unsigned int)t1->y * 31
+           ^ (unsigned int)t1->z * 17 ^ (unsigned int)t2->x * 7
+           ^ (unsigned int)t2->y * 13 ^ (unsigned int)t2->z * 5;
+    hash *= 2654435761u;
+    cached = &sightcache[(hash >> 22) & (SIGHTCACHESIZE - 1)];
+    if (cached->generation == sightgeneration && cached->x1 == t1->x
+        && cached->y1 == t1->y && cached->z1 == t1->z
+        && cached->height1 == t1->height && cached->x2 == t2->x
+        && cached->y2 == t2->y && cached->z2 == t2->z
+        && cached->height2 == t2->height) {
+        return cached->visible;
+    }
+
     validcount++;
 
     sightzstart = t1->z + t1->height - (t1->height >> 2);
@@ -315,6 +359,17 @@ boolean P_CheckSight(mobj_t *t1, mobj_t *t2)
     strace.dx = t2->x - t1->x;
     strace.dy = t2->y - t1->y;
 
+    cached->x1 = t1->x;
+    cached->y1 = t1->y;
+    cached->z1 = t1->z;
+    cached->height1 = t1->height;
+    cached->x2 = t2->x;
+    cached->y2 = t2->y;
+    cached->z2 = t2->z;
+    cached->height2 = t2->height;
+    cached->generation = sightgeneration;
+
     // the head node is the last node output
-    return P_CrossBSPNode(numnodes - 1);
+    cached->visible = P_CrossBSPNode(numnodes - 1);
+    return cached->visible;
 }
@@ -49,6 +49,10 @@ typedef struct {
     int numpics;
     int speed;
 
+    // The tics its current frame is shown for; nexttic exclusive.
+    int frametic;
+    int nexttic;
+
 } anim_t;
 
 //
@@ -157,6 +161,7 @@ void P_InitPicAnims(void)
                     endname);
 
         lastanim->speed = animdefs[i].speed;
+        lastanim->frametic = lastanim->nexttic = 0;
         lastanim++;
     }
 }
@@ -220,16 +225,11 @@ sector_t *getNextSector(line_t *line, sector_t *sec)
 fixed_t P_FindLowestFloorSurrounding(sector_t *sec)
 {
     int i;
-    line_t *check;
     sector_t *other;
     fixed_t floor = sec->floorheight;
 
-    for (i = 0; i < sec->linecount; i++) {
-        check = sec->lines[i];
-        other = getNextSector(check, sec);
-
-        if (!other)
-            continue;
+    for (i = 0; i < sec->neighbourcount; i++) {
+        other = sec->neighbours[i].other;
 
         if (other->floorheight < floor)
             floor = other->floorheight;
@@ -244,16 +244,11 @@ fixed_t P_FindLowestFloorSurrounding(sector_t *sec)
 fixed_t P_FindHighestFloorSurrounding(sector_t *sec)
 {
     int i;
-    line_t *check;
     sector_t *other;
     fixed_t floor = -500 * FRACUNIT;
 
-    for (i = 0; i < sec->linecount; i++) {
-        check = sec->lines[i];
-        other = getNextSector(check, sec);
-
-        if (!other)
-            continue;
+    for (i = 0; i < sec->neighbourcount; i++) {
+        other = sec->neighbours[i].other;
 
         if (other->floorheight > floor)
             floor = other->floorheight;
@@ -276,17 +271,13 @@ fixed_t P_FindNextHighestFloor(sector_t *sec, int currentheight)
     int i;
     int h;
     int min;
-    line_t *check;
     sector_t *other;
     fixed_t height = currentheight;
     fixed_t heightlist[MAX_ADJOINING_SECTORS + 2];
 
-    for (i = 0, h = 0; i < sec->linecount; i++) {
-        check = sec->lines[i];
-        other = getNextSector(check, sec);
-
-        if (!other)
-            continue;
+    // Once for each line to a neighbour, as the overflow depends on it.
+    for (i = 0, h = 0; i < sec->neighbourcount; i++) {
+        other = sec->neighbours[i].other;
 
         if (other->floorheight > height) {
             // Emulation of memory (stack) overflow
@@ -325,16 +316,11 @@ fixed_t P_FindNextHighestFloor(sector_t *sec, int currentheight)
 fixed_t P_FindLowestCeilingSurrounding(sector_t *sec)
 {
     int i;
-    line_t *check;
     sector_t *other;
     fixed_t height = INT_MAX;
 
-    for (i = 0; i < sec->linecount; i++) {
-        check = sec->lines[i];
-        other = getNextSector(check, sec);
-
-        if (!other)
-            continue;
+    for (i = 0; i < sec->neighbourcount; i++) {
+        other = sec->neighbours[i].other;
 
         if (other->ceilingheight < height)
             height = other->ceilingheight;
@@ -348,16 +334,11 @@ fixed_t P_FindLowestCeilingSurrounding(sector_t *sec)
 fixed_t P_FindHighestCeilingSurrounding(sector_t *sec)
 {
     int i;
-    line_t *check;
     sector_t *other;
     fixed_t height = 0;
 
-    for (i = 0; i < sec->linecount; i++) {
-        check = sec->lines[i];
-        other = getNextSector(check, sec);
-
-        if (!other)
-            continue;
+    for (i = 0; i < sec->neighbourcount; i++) {
+        other = sec->neighbours[i].other;
 
         if (other->ceilingheight > height)
             height = other->ceilingheight;
@@ -365,6 +346,50 @@ fixed_t P_FindHighestCeilingSurrounding(sector_t *sec)
     return height;
 }
 
+//
+// Sectors by tag: an open-addressed hash of each tag to the first sector
+// with it, which links to the rest in order through sector_t.nexttag.
+//
+static int *tagfirstsectors;
+static int tagmask;
+
+static int *FindTagSlot(int tag)
+{
+    int *slot;
+
+    for (slot = &tagfirstsectors[tag & tagmask];
+         *slot != -1 && sectors[*slot].tag != tag;
+         slot = &tagfirstsectors[(slot - tagfirstsectors + 1) & tagmask]) {
+    }
+
+    return slot;
+}
+
+//
+// InitSectorTags
+//
+static void InitSectorTags(void)
+{
+    int size;
+    int i;
+    int *slot;
+
+    for (size = 1; size < numsectors * 2; size <<= 1) {
+    }
+
+    tagfirstsectors = Z_Malloc(size * sizeof(*tagfirstsectors), PU_LEVEL, 0);
+    tagmask = size - 1;
+    for (i = 0; i < size; i++)
+        tagfirstsectors[i] = -1;
+
+    // Backwards, so each is put in front of the later ones.
+    for (i = numsectors - 1; i >= 0; i--) {
+        slot = FindTagSlot(sectors[i].tag);
+        sectors[i].nexttag = *slot;
+        *slot = i;
+    }
+}
+
 //
 // RETURN NEXT SECTOR # THAT LINE TAG REFERS TO
 //
@@ -372,6 +397,12 @@ int P_FindSectorFromLineTag(line_t *line, int start)
 {
     int i;
 
+    if (start < 0)
+        return *FindTagSlot(line->tag);
+
+    if (sectors[start].tag == line->tag)
+        return sectors[start].nexttag;
+
     for (i = start + 1; i < numsectors; i++)
         if (sectors[i].tag == line->tag)
             return i;
@@ -386,16 +417,11 @@ int P_FindMinSurroundingLight(sector_t *sector, int max)
 {
     int i;
     int min;
-    line_t *line;
     sector_t *check;
 
     min = max;
-    for (i = 0; i < sector->linecount; i++) {
-        line = sector->lines[i];
-        check = getNextSector(line, sector);
-
-        if (!check)
-            continue;
+    for (i = 0; i < sector->neighbourcount; i++) {
+        check = sector->neighbours[i].other;
 
         if (check->lightlevel < min)
             min = check->lightlevel;
@@ -996,7 +1022,17 @@ void P_UpdateSpecials(void)
     }
 
     //  ANIMATE FLATS AND TEXTURES GLOBALLY
+    // Only those whose frame changed; which frame is shown depends on
+    // leveltime alone, so that's also right after a new level or a loaded
+    // game puts leveltime back.
     for (anim = anims; anim < lastanim; anim++) {
+        if (leveltime >= anim->frametic && leveltime < anim->nexttic)
+            continue;
+
+        anim->frametic = leveltime - leveltime % anim->speed;
+        anim->nexttic = anim->frametic + anim->speed;
+        surfacegeneration++;
+
         for (i = anim->basepic; i < anim->basepic + anim->numpics; i++) {
             pic =
                 anim->basepic + ((leveltime / anim->speed + i) % anim->numpics);
@@ -1008,6 +1044,10 @@ void P_UpdateSpecials(void)
     }
 
     //  ANIMATE LINE SPECIALS
+    // linespeciallist only holds the scrolling walls.
+    if (numlinespecials > 0)
+        surfacegeneration++;
+
     for (i = 0; i < numlinespecials; i++) {
         line = linespeciallist[i];
         switch (line->special) {
@@ -1041,6 +1081,7 @@ void P_UpdateSpecials(void)
                 }
                 S_StartSound(&buttonlist[i].soundorg, sfx_swtchn);
                 memset(&buttonlist[i], 0, sizeof(button_t));
+                surfacegeneration++;
             }
         }
 }
@@ -1194,7 +1235,7 @@ int EV_DoDonut(line_t *line)
             }
 
             //  Spawn rising slime
-            floor = Z_Malloc(sizeof(*floor), PU_LEVSPEC, 0);
+            floor = P_AllocThinker(sizeof(*floor));
             P_AddThinker(&floor->thinker);
             s2->specialdata = floor;
             floor->thinker.function = T_MoveFloor;
@@ -1208,7 +1249,7 @@ int EV_DoDonut(line_t *line)
             floor->floordestheight = s3_floorheight;
 
             //  Spawn lowering donut-hole
-            floor = Z_Malloc(sizeof(*floor), PU_LEVSPEC, 0);
+            floor = P_AllocThinker(sizeof(*floor));
             P_AddThinker(&floor->thinker);
             s1->specialdata = floor;
             floor->thinker.function = T_MoveFloor;
@@ -1242,6 +1283,8 @@ void P_SpawnSpecials(void)
     sector_t *sector;
     int i;
 
+    InitSectorTags();
+
     // See if -TIMER was specified.
 
     if (timelimit > 0 && deathmatch) {
@@ -1331,6 +1374,21 @@ void P_SpawnSpecials(void)
     }
 
     //  Init other misc stuff
+    P_ClearActiveSpecials();
+
+    // UNUSED: no horizonal sliders.
+    //  P_InitSlidingDoorFrames();
+}
+
+//
+// P_ClearActiveSpecials
+// Forget the moving ceilings, platforms and switches, before the
+// specials are spawned or loaded.
+//
+void P_ClearActiveSpecials(void)
+{
+    int i;
+
     for (i = 0; i < MAXCEILINGS; i++)
         activeceilings[i] = NULL;
 
@@ -1339,7 +1397,4 @@ void P_SpawnSpecials(void)
 
     for (i = 0; i < MAXBUTTONS; i++)
         memset(&buttonlist[i], 0, sizeof(button_t));
-
-    // UNUSED: no horizonal sliders.
-    //  P_InitSlidingDoorFrames();
 }
@@ -41,6 +41,7 @@ void P_InitPicAnims(void);
 
 // at map load
 void P_SpawnSpecials(void);
+void P_ClearActiveSpecials(void);
 
 // every tic
 void P_UpdateSpecials(void);
@@ -127,6 +128,7 @@ typedef struct {
 #define FASTDARK 15
 #define SLOWDARK 35
 
+void T_FireFlicker(thinker_t *thinker);
 void P_SpawnFireFlicker(sector_t *sector);
 void T_LightFlash(thinker_t *thinker);
 void P_SpawnLightFlash(sector_t *sector);
@@ -142,6 +144,12 @@ void EV_LightTurnOn(line_t *line, int bright);
 void T_Glow(thinker_t *thinker);
 void P_SpawnGlowingLight(sector_t *sector);
 
+extern boolean parallellights;
+
+void P_InitLightBatch(void);
+boolean P_BatchLightThinker(thinker_t *thinker);
+void P_RunLightBatch(void);
+
 //
 // P_SWITCH
 //
@@ -486,5 +494,6 @@ void T_MoveFloor(thinker_t *thinker);
 // P_TELEPT
 //
 int EV_Teleport(line_t *line, int side, mobj_t *thing);
+void P_InvalidateTeleportDests(void);
 
 #endif
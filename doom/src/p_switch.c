@@ -168,6 +168,9 @@ void P_ChangeSwitchTexture(line_t *line, int useAgain)
     if (!useAgain)
         line->special = 0;
 
+    // Even if it turns out not to be a switch texture.
+    surfacegeneration++;
+
     texTop = sides[line->sidenum[0]].toptexture;
     texMid = sides[line->sidenum[0]].midtexture;
     texBot = sides[line->sidenum[0]].bottomtexture;
@@ -17,43 +17,177 @@
 //      Thinker, Ticker.
 //
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "d_think.h"
 #include "doomstat.h"
+#include "i_system.h"
+#include "m_counts.h"
+#include "m_profile.h"
 #include "p_local.h"
 #include "p_spec.h"
 #include "z_zone.h"
 
 int leveltime;
 
+// leveltime when mobjs' positions were last saved for drawing between tics.
+int savedpositionstime = -1;
+
 //
 // THINKERS
-// All thinkers should be allocated by Z_Malloc
+// All thinkers should be allocated by P_AllocThinker
 // so they can be operated on uniformly.
 // The actual structures will vary in size,
 // but the first element must be thinker_t.
 //
 
+// Thinkers come and go all the time (every puff and projectile is a mobj),
+// so rather than each being a zone block, they're carved from slabs in the
+// level's zone memory and recycled through free lists kept by size.
+
+#define THINKERSIZESTEP 16
+#define NUMTHINKERSIZES 32
+#define THINKERSPERSLAB 64
+
+// Precedes each thinker in a slab.
+typedef union thinkerblock_u {
+    union thinkerblock_u *next; // while free
+    int sizeclass;              // while in use
+} thinkerblock_t;
+
+static thinkerblock_t *freethinkers[NUMTHINKERSIZES];
+
 // Both the head and tail of the thinker list.
 thinker_t thinkercap;
 
+// Both the head and tail of the list for each class.
+thinker_t thinkerclasscap[NUMTHCLASSES];
+
+// Thinkers with nothing to do sleep on a list of their own, so
+// P_RunThinkers doesn't visit them. Woken ones wait to be put back in the
+// thinker list until P_RunThinkers reaches their place in it; those woken
+// after it has passed their place wait for the next tic, as that is when
+// vanilla would next have run them.
+
+typedef struct {
+    thinker_t **thinkers; // sorted by order
+    int num;
+    int max;
+} wakelist_t;
+
+static thinker_t sleepcap;
+
+static wakelist_t wakes;
+static int nextwake; // first of wakes not yet put back
+static wakelist_t latewakes;
+
+static int nextorder;
+static int thinkingorder = -1; // of the thinker being run, if any
+
 //
 // P_InitThinkers
 //
 void P_InitThinkers(void)
 {
+    int i;
+
     thinkercap.prev = thinkercap.next = &thinkercap;
+
+    for (i = 0; i < NUMTHCLASSES; i++) {
+        thinkerclasscap[i].cprev = thinkerclasscap[i].cnext =
+            &thinkerclasscap[i];
+    }
+
+    sleepcap.prev = sleepcap.next = &sleepcap;
+    wakes.num = latewakes.num = nextwake = 0;
+    nextorder = 0;
 }
 
 //
 // P_AddThinker
 // Adds a new thinker at the end of the list.
+// Mobjs must have their function set first, so they go in the right class.
 //
 void P_AddThinker(thinker_t *thinker)
 {
+    thinker_t *cap;
+
+    thinker->order = nextorder++;
+    thinker->sleep = ts_awake;
+
     thinkercap.prev->next = thinker;
     thinker->next = &thinkercap;
     thinker->prev = thinkercap.prev;
     thinkercap.prev = thinker;
+
+    if (thinker->function == P_MobjThinker)
+        cap = &thinkerclasscap[th_mobj];
+    else
+        cap = &thinkerclasscap[th_special];
+
+    cap->cprev->cnext = thinker;
+    thinker->cnext = cap;
+    thinker->cprev = cap->cprev;
+    cap->cprev = thinker;
+}
+
+//
+// P_AllocThinker
+// Allocates memory for a thinker of the given size, which lasts at most until
+// the level ends.
+//
+void *P_AllocThinker(size_t size)
+{
+    int sizeclass;
+    int i;
+    size_t blocksize;
+    byte *slab;
+    thinkerblock_t *block;
+
+    sizeclass = (size + THINKERSIZESTEP - 1) / THINKERSIZESTEP;
+    if (sizeclass >= NUMTHINKERSIZES)
+        I_Error("P_AllocThinker: %d bytes is too large", (int)size);
+
+    if (!freethinkers[sizeclass]) {
+        blocksize = sizeof(thinkerblock_t) + sizeclass * THINKERSIZESTEP;
+        slab = Z_Malloc(blocksize * THINKERSPERSLAB, PU_LEVEL, NULL);
+        for (i = THINKERSPERSLAB - 1; i >= 0; i--) {
+            block = (thinkerblock_t *)(slab + i * blocksize);
+            block->next = freethinkers[sizeclass];
+            freethinkers[sizeclass] = block;
+        }
+    }
+
+    block = freethinkers[sizeclass];
+    freethinkers[sizeclass] = block->next;
+    block->sizeclass = sizeclass;
+    return block + 1;
+}
+
+//
+// P_FreeThinker
+// Returns a thinker's memory to its free list. The thinker itself is left
+// intact, so its links can still be followed.
+//
+void P_FreeThinker(thinker_t *thinker)
+{
+    thinkerblock_t *block;
+    int sizeclass;
+
+    block = (thinkerblock_t *)thinker - 1;
+    sizeclass = block->sizeclass;
+    block->next = freethinkers[sizeclass];
+    freethinkers[sizeclass] = block;
+}
+
+//
+// P_ClearThinkerMemory
+// Forgets the free lists, after the level's zone memory has been freed.
+//
+void P_ClearThinkerMemory(void)
+{
+    memset(freethinkers, 0, sizeof(freethinkers));
 }
 
 //
@@ -63,29 +197,228 @@ void P_AddThinker(thinker_t *thinker)
 //
 void P_RemoveThinker(thinker_t *thinker)
 {
-    // FIXME: NOP.
+    // It's freed when P_RunThinkers gets to it, so it must be in the list.
+    P_WakeThinker(thinker);
+
+    // Unlinking from the class list is immediate. Point the links back at
+    // the thinker so it's harmless to remove it again.
+    thinker->cnext->cprev = thinker->cprev;
+    thinker->cprev->cnext = thinker->cnext;
+    thinker->cnext = thinker->cprev = thinker;
+
     thinker->function = THINKER_REMOVED;
 }
 
+//
+// P_SleepThinker
+// Called by a thinker that has nothing to do until something else changes
+// it, to stop being run once it returns. Whatever makes the change must
+// call P_WakeThinker.
+//
+void P_SleepThinker(thinker_t *thinker)
+{
+    thinker->sleep = ts_drowsy;
+}
+
+static void AddWake(wakelist_t *list, thinker_t *thinker)
+{
+    int lo;
+    int hi;
+    int mid;
+
+    if (list->num == list->max) {
+        list->max = list->max ? 2 * list->max : 64;
+        list->thinkers =
+            I_Realloc(list->thinkers, list->max * sizeof(*list->thinkers));
+    }
+
+    lo = 0;
+    hi = list->num;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (list->thinkers[mid]->order < thinker->order)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    memmove(&list->thinkers[lo + 1], &list->thinkers[lo],
+            (list->num - lo) * sizeof(*list->thinkers));
+    list->thinkers[lo] = thinker;
+    list->num++;
+}
+
+//
+// P_WakeThinker
+// Has a sleeping thinker run again from its place in the thinker list.
+//
+void P_WakeThinker(thinker_t *thinker)
+{
+    if (thinker->sleep == ts_drowsy) {
+        thinker->sleep = ts_awake;
+        return;
+    }
+
+    if (thinker->sleep != ts_asleep)
+        return;
+
+    thinker->next->prev = thinker->prev;
+    thinker->prev->next = thinker->next;
+    thinker->sleep = ts_waking;
+
+    if (thinker->order < thinkingorder)
+        AddWake(&latewakes, thinker);
+    else
+        AddWake(&wakes, thinker);
+}
+
+static int CompareOrder(const void *a, const void *b)
+{
+    return (*(thinker_t *const *)a)->order - (*(thinker_t *const *)b)->order;
+}
+
+//
+// P_WakeAllThinkers
+// Puts every sleeping thinker back in the thinker list, for code that walks
+// it, and renumbers the list after it has been rebuilt.
+//
+void P_WakeAllThinkers(void)
+{
+    thinker_t *th;
+    thinker_t *next;
+    thinker_t *wake;
+    int i;
+
+    for (th = sleepcap.next; th != &sleepcap; th = next) {
+        next = th->next;
+        if (wakes.num == wakes.max) {
+            wakes.max = wakes.max ? 2 * wakes.max : 64;
+            wakes.thinkers =
+                I_Realloc(wakes.thinkers, wakes.max * sizeof(*wakes.thinkers));
+        }
+        wakes.thinkers[wakes.num++] = th;
+    }
+    sleepcap.prev = sleepcap.next = &sleepcap;
+
+    qsort(wakes.thinkers, wakes.num, sizeof(*wakes.thinkers), CompareOrder);
+
+    th = thinkercap.next;
+    for (i = 0; i < wakes.num; i++) {
+        wake = wakes.thinkers[i];
+        while (th != &thinkercap && th->order < wake->order)
+            th = th->next;
+
+        wake->sleep = ts_awake;
+        wake->next = th;
+        wake->prev = th->prev;
+        th->prev->next = wake;
+        th->prev = wake;
+    }
+    wakes.num = 0;
+
+    nextorder = 0;
+    for (th = thinkercap.next; th != &thinkercap; th = th->next)
+        th->order = nextorder++;
+}
+
 //
 // P_RunThinkers
 //
 void P_RunThinkers(void)
 {
     thinker_t *currentthinker;
+    thinker_t *next;
+    thinker_t *wake;
+    wakelist_t swap;
+    boolean batchlights;
+
+    batchlights =
+        parallellights && !demoplayback && !demorecording && !netgame;
 
     currentthinker = thinkercap.next;
-    while (currentthinker != &thinkercap) {
+    for (;;) {
+        // Put back a woken thinker whose place comes first.
+        if (nextwake < wakes.num
+            && (currentthinker == &thinkercap
+                || wakes.thinkers[nextwake]->order < currentthinker->order)) {
+            wake = wakes.thinkers[nextwake++];
+            wake->sleep = ts_awake;
+            wake->next = currentthinker;
+            wake->prev = currentthinker->prev;
+            currentthinker->prev->next = wake;
+            currentthinker->prev = wake;
+            currentthinker = wake;
+        }
+
+        if (currentthinker == &thinkercap)
+            break;
+
+        thinkingorder = currentthinker->order;
+
         if (currentthinker->function == THINKER_REMOVED) {
             // time to remove it
             currentthinker->next->prev = currentthinker->prev;
             currentthinker->prev->next = currentthinker->next;
-            Z_Free(currentthinker);
+            P_FreeThinker(currentthinker);
+            M_CountWork(work_removedthinkers, 1);
         } else if (currentthinker->function) {
-            currentthinker->function(currentthinker);
+            M_CountWork(work_thinkers, 1);
+            if (!batchlights || !P_BatchLightThinker(currentthinker))
+                currentthinker->function(currentthinker);
+        }
+
+        next = currentthinker->next;
+
+        if (currentthinker->sleep == ts_drowsy) {
+            currentthinker->next->prev = currentthinker->prev;
+            currentthinker->prev->next = currentthinker->next;
+
+            currentthinker->next = &sleepcap;
+            currentthinker->prev = sleepcap.prev;
+            sleepcap.prev->next = currentthinker;
+            sleepcap.prev = currentthinker;
+            currentthinker->sleep = ts_asleep;
         }
-        currentthinker = currentthinker->next;
+
+        currentthinker = next;
+    }
+
+    // Those woken behind the run are put back next tic.
+    thinkingorder = -1;
+    swap = wakes;
+    wakes = latewakes;
+    latewakes = swap;
+    latewakes.num = 0;
+    nextwake = 0;
+
+    if (batchlights)
+        P_RunLightBatch();
+}
+
+//
+// P_SavePositions
+// Remember where everything is before it moves, so frames drawn before the
+// next tic can place it part way between.
+//
+static void P_SavePositions(void)
+{
+    thinker_t *th;
+    mobj_t *mo;
+    int i;
+
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj];
+         th = th->cnext) {
+        mo = (mobj_t *)th;
+        mo->oldx = mo->x;
+        mo->oldy = mo->y;
+        mo->oldz = mo->z;
+        mo->oldangle = mo->angle;
     }
+
+    for (i = 0; i < MAXPLAYERS; i++)
+        players[i].oldviewz = players[i].viewz;
+
+    savedpositionstime = leveltime;
 }
 
 //
@@ -96,6 +429,9 @@ void P_Ticker(void)
 {
     int i;
 
+    if (uncapped)
+        P_SavePositions();
+
     // run the tic
     if (paused)
         return;
@@ -110,7 +446,11 @@ void P_Ticker(void)
         if (playeringame[i])
             P_PlayerThink(&players[i]);
 
+    P_RunLookWheel();
+
+    M_ProfileBegin(prof_runthinkers);
     P_RunThinkers();
+    M_ProfileEnd(prof_runthinkers);
     P_UpdateSpecials();
     P_RespawnSpecials();
 
@@ -24,4 +24,8 @@
 // Carries out all thinking of monsters and players.
 void P_Ticker(void);
 
+// leveltime when P_Ticker saved where mobjs were, before moving them. If it's
+// one behind leveltime, they can be drawn part way between.
+extern int savedpositionstime;
+
 #endif
@@ -22,20 +22,22 @@
 #include "doomstat.h"
 #include "i_system.h"
 #include "m_bbox.h"
+#include "m_counts.h"
 #include "r_main.h"
 #include "r_plane.h"
 #include "r_state.h"
 #include "r_things.h"
 // #include "r_local.h"
 
-seg_t *curline;
-side_t *sidedef;
-line_t *linedef;
-sector_t *frontsector;
-sector_t *backsector;
+rseg_t *curline;
+rside_t *sidedef;
+rline_t *linedef;
+rsector_t *frontsector;
+rsector_t *backsector;
 
-drawseg_t drawsegs[MAXDRAWSEGS];
+drawseg_t *drawsegs;
 drawseg_t *ds_p;
+int numdrawsegs;
 
 void R_StoreWallRange(int start, int stop);
 
@@ -47,100 +49,159 @@ void R_ClearDrawSegs(void)
     ds_p = drawsegs;
 }
 
+//
+// R_GrowDrawSegs
+// Doubles the drawseg pool, called when ds_p reaches the end of it.
+//
+void R_GrowDrawSegs(void)
+{
+    int used = ds_p - drawsegs;
+
+    numdrawsegs = numdrawsegs ? 2 * numdrawsegs : MAXDRAWSEGS;
+    drawsegs = I_Realloc(drawsegs, numdrawsegs * sizeof(*drawsegs));
+    ds_p = drawsegs + used;
+}
+
 //
 // ClipWallSegment
 // Clips the given range of columns
 // and includes it in the new clip list.
 //
-typedef struct {
-    int first;
-    int last;
-
-} cliprange_t;
+// The clip list is a bitmap of the columns covered by solid walls so far, a
+//  bit per column, scanned a word at a time; unlike vanilla's list of ranges,
+//  it can't overflow, however broken up the view is.
+//
+#define SOLIDWORDBITS 64
+#define NUMSOLIDWORDS ((MAXWIDTH + SOLIDWORDBITS - 1) / SOLIDWORDBITS)
 
-#define MAXSEGS 32
+static uint64_t solidcols[NUMSOLIDWORDS];
+static int numsolidcols;
 
-// newend is one past the last valid seg
-cliprange_t *newend;
-cliprange_t solidsegs[MAXSEGS];
+// For each solid column, the scale of the wall there if it hides sprites at
+//  that scale or smaller (further away) entirely, else 0; see R_SpriteHidden.
+static fixed_t solidscales[MAXWIDTH];
+// Whether each column has a drawseg with a masked mid texture.
+static byte maskedcols[MAXWIDTH];
 
 //
-// R_ClipSolidWallSegment
-// Does handle solid walls,
-//  e.g. single sided LineDefs (middle texture)
-//  that entirely block the view.
+// R_FindColumn
+// Returns the first column from x to last that is solid (or clear, if not
+//  solid), or last + 1 if there's none.
 //
-void R_ClipSolidWallSegment(int first, int last)
+static int R_FindColumn(int x, int last, boolean solid)
 {
-    cliprange_t *next;
-    cliprange_t *start;
-
-    // Find the first range that touches the range
-    //  (adjacent pixels are touching).
-    start = solidsegs;
-    while (start->last < first - 1)
-        start++;
-
-    if (first < start->first) {
-        if (last < start->first - 1) {
-            // Post is entirely visible (above start),
-            //  so insert a new clippost.
-            R_StoreWallRange(first, last);
-            next = newend;
-            newend++;
-
-            while (next != start) {
-                *next = *(next - 1);
-                next--;
-            }
-            next->first = first;
-            next->last = last;
-            return;
+    uint64_t word;
+
+    while (x <= last) {
+        word = solidcols[x / SOLIDWORDBITS];
+        if (!solid)
+            word = ~word;
+        word &= ~(uint64_t)0 << (x % SOLIDWORDBITS);
+
+        if (word) {
+            x = x - x % SOLIDWORDBITS + __builtin_ctzll(word);
+            return x <= last ? x : last + 1;
         }
+        x = x - x % SOLIDWORDBITS + SOLIDWORDBITS;
+    }
 
-        // There is a fragment above *start.
-        R_StoreWallRange(first, start->first - 1);
-        // Now adjust the clip size.
-        start->first = first;
+    return last + 1;
+}
+
+//
+// R_MarkSolidColumns
+// Marks the clear columns from first to last as solid.
+//
+static void R_MarkSolidColumns(int first, int last)
+{
+    int i;
+    int bits;
+    uint64_t mask;
+
+    numsolidcols += last - first + 1;
+
+    while (first <= last) {
+        i = first / SOLIDWORDBITS;
+        bits = SOLIDWORDBITS - first % SOLIDWORDBITS;
+        if (bits > last - first + 1)
+            bits = last - first + 1;
+
+        mask = bits == SOLIDWORDBITS ? ~(uint64_t)0
+                                     : (((uint64_t)1 << bits) - 1);
+        solidcols[i] |= mask << (first % SOLIDWORDBITS);
+        first += bits;
     }
+}
 
-    // Bottom contained in start?
-    if (last <= start->last)
+//
+// R_NoteWallRange
+// Records what R_SpriteHidden needs to know of the drawseg just stored for
+//  the columns from first to last.
+//
+static void R_NoteWallRange(int first, int last, boolean solid)
+{
+    drawseg_t *ds;
+    fixed_t scale;
+    int x;
+
+    ds = ds_p - 1;
+    if (ds->maskedtexturecol)
+        memset(maskedcols + first, 1, last - first + 1);
+    if (!solid)
         return;
 
-    next = start;
-    while (last >= (next + 1)->first - 1) {
-        // There is a fragment between two posts.
-        R_StoreWallRange(next->last + 1, (next + 1)->first - 1);
-        next++;
-
-        if (last <= next->last) {
-            // Bottom is contained in next.
-            // Adjust the clip size.
-            start->last = next->last;
-            goto crunch;
-        }
+    // Only walls that clip sprites at every height hide them.
+    scale = 0;
+    if (ds->silhouette == SIL_BOTH && ds->sprtopclip == screenheightarray
+        && ds->sprbottomclip == negonearray && ds->bsilheight == INT_MAX
+        && ds->tsilheight == INT_MIN) {
+        scale = ds->scale1 < ds->scale2 ? ds->scale1 : ds->scale2;
     }
 
-    // There is a fragment after *next.
-    R_StoreWallRange(next->last + 1, last);
-    // Adjust the clip size.
-    start->last = last;
+    for (x = first; x <= last; x++)
+        solidscales[x] = maskedcols[x] ? 0 : scale;
+}
 
-    // Remove start+1 to next from the clip list,
-    // because start now covers their area.
-crunch:
-    if (next == start) {
-        // Post just extended past the bottom of one post.
-        return;
-    }
+//
+// R_SpriteHidden
+// No drawseg stored after a solid wall covers its columns, so it's the first
+//  R_DrawSprite finds there, and it clips the sprite wholly if the sprite is
+//  no nearer than any part of it. Columns with masked mid textures are never
+//  hidden, as drawing the sprite draws those behind it first.
+//
+boolean R_SpriteHidden(int x1, int x2, fixed_t scale)
+{
+    int x;
+
+    if (R_FindColumn(x1, x2, false) <= x2)
+        return false;
 
-    while (next++ != newend) {
-        // Remove a post.
-        *++start = *next;
+    for (x = x1; x <= x2; x++) {
+        if (solidscales[x] < scale)
+            return false;
     }
 
-    newend = start + 1;
+    return true;
+}
+
+//
+// R_ClipSolidWallSegment
+// Does handle solid walls,
+//  e.g. single sided LineDefs (middle texture)
+//  that entirely block the view.
+//
+void R_ClipSolidWallSegment(int first, int last)
+{
+    int end;
+
+    // Store each run of clear columns, then cover it.
+    while ((first = R_FindColumn(first, last, false)) <= last) {
+        end = R_FindColumn(first, last, true) - 1;
+        R_StoreWallRange(first, end);
+        R_MarkSolidColumns(first, end);
+        R_NoteWallRange(first, end, true);
+        first = end + 1;
+    }
 }
 
 //
@@ -152,52 +213,44 @@ crunch:
 //
 void R_ClipPassWallSegment(int first, int last)
 {
-    cliprange_t *start;
-
-    // Find the first range that touches the range
-    //  (adjacent pixels are touching).
-    start = solidsegs;
-    while (start->last < first - 1)
-        start++;
-
-    if (first < start->first) {
-        if (last < start->first - 1) {
-            // Post is entirely visible (above start).
-            R_StoreWallRange(first, last);
-            return;
-        }
+    int end;
 
-        // There is a fragment above *start.
-        R_StoreWallRange(first, start->first - 1);
+    while ((first = R_FindColumn(first, last, false)) <= last) {
+        end = R_FindColumn(first, last, true) - 1;
+        R_StoreWallRange(first, end);
+        R_NoteWallRange(first, end, false);
+        first = end + 1;
     }
+}
 
-    // Bottom contained in start?
-    if (last <= start->last)
-        return;
-
-    while (last >= (start + 1)->first - 1) {
-        // There is a fragment between two posts.
-        R_StoreWallRange(start->last + 1, (start + 1)->first - 1);
-        start++;
-
-        if (last <= start->last)
-            return;
-    }
+// Inward normals of the left and right edges of the view, for rejecting
+//  bboxes outside of it without the angle math of R_CheckBBox. The edges are
+//  widened by FRUSTUMMARGIN, so a bbox that's rejected is one R_CheckBBox
+//  would reject too, however it rounds the angles.
+#define FRUSTUMMARGIN ANG1
 
-    // There is a fragment after *next.
-    R_StoreWallRange(start->last + 1, last);
-}
+static fixed_t frustumnormals[2][2];
 
 //
 // R_ClearClipSegs
 //
 void R_ClearClipSegs(void)
 {
-    solidsegs[0].first = -0x7fffffff;
-    solidsegs[0].last = -1;
-    solidsegs[1].first = viewwidth;
-    solidsegs[1].last = 0x7fffffff;
-    newend = solidsegs + 2;
+    angle_t angle;
+
+    memset(solidcols, 0,
+           (viewwidth + SOLIDWORDBITS - 1) / SOLIDWORDBITS
+               * sizeof(*solidcols));
+    numsolidcols = 0;
+    memset(maskedcols, 0, viewwidth);
+
+    angle = (viewangle + clipangle + FRUSTUMMARGIN) >> ANGLETOFINESHIFT;
+    frustumnormals[0][0] = finesine[angle];
+    frustumnormals[0][1] = -finecosine[angle];
+
+    angle = (viewangle - clipangle - FRUSTUMMARGIN) >> ANGLETOFINESHIFT;
+    frustumnormals[1][0] = -finesine[angle];
+    frustumnormals[1][1] = finecosine[angle];
 }
 
 //
@@ -205,7 +258,7 @@ void R_ClearClipSegs(void)
 // Clips the given segment
 // and adds any visible pieces to the line list.
 //
-void R_AddLine(seg_t *line)
+void R_AddLine(rseg_t *line)
 {
     int x1;
     int x2;
@@ -217,8 +270,8 @@ void R_AddLine(seg_t *line)
     curline = line;
 
     // OPTIMIZE: quickly reject orthogonal back sides.
-    angle1 = R_PointToAngle(line->v1->x, line->v1->y);
-    angle2 = R_PointToAngle(line->v2->x, line->v2->y);
+    angle1 = R_PointToAngle(line->v1.x, line->v1.y);
+    angle2 = R_PointToAngle(line->v2.x, line->v2.y);
 
     // Clip to view edges.
     // OPTIMIZE: make constant out of 2*clipangle (FIELDOFVIEW).
@@ -264,7 +317,7 @@ void R_AddLine(seg_t *line)
     if (x1 == x2)
         return;
 
-    backsector = line->backsector;
+    backsector = line->backsector >= 0 ? &rsectors[line->backsector] : NULL;
 
     // Single sided line?
     if (!backsector)
@@ -288,7 +341,7 @@ void R_AddLine(seg_t *line)
     if (backsector->ceilingpic == frontsector->ceilingpic
         && backsector->floorpic == frontsector->floorpic
         && backsector->lightlevel == frontsector->lightlevel
-        && curline->sidedef->midtexture == 0) {
+        && rsides[curline->sidedef].midtexture == 0) {
         return;
     }
 
@@ -310,6 +363,30 @@ int checkcoord[12][4] = {{3, 0, 2, 1}, {3, 0, 2, 0}, {3, 1, 2, 0}, {0},
                          {2, 0, 2, 1}, {0, 0, 0, 0}, {3, 1, 3, 0}, {0},
                          {2, 0, 3, 1}, {2, 1, 3, 1}, {2, 1, 3, 0}};
 
+//
+// R_BBoxOutsideView
+// Returns true if the bbox is wholly outside either edge of the view,
+//  by testing its corner furthest inside that edge.
+//
+static boolean R_BBoxOutsideView(fixed_t *bspcoord)
+{
+    fixed_t *normal;
+    int64_t dx;
+    int64_t dy;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        normal = frustumnormals[i];
+        dx = (int64_t)bspcoord[normal[0] >= 0 ? BOXRIGHT : BOXLEFT] - viewx;
+        dy = (int64_t)bspcoord[normal[1] >= 0 ? BOXTOP : BOXBOTTOM] - viewy;
+
+        if (normal[0] * dx + normal[1] * dy < 0)
+            return true;
+    }
+
+    return false;
+}
+
 boolean R_CheckBBox(fixed_t *bspcoord)
 {
     int boxx;
@@ -326,8 +403,6 @@ boolean R_CheckBBox(fixed_t *bspcoord)
     angle_t span;
     angle_t tspan;
 
-    cliprange_t *start;
-
     int sx1;
     int sx2;
 
@@ -351,6 +426,9 @@ boolean R_CheckBBox(fixed_t *bspcoord)
     if (boxpos == 5)
         return true;
 
+    if (R_BBoxOutsideView(bspcoord))
+        return false;
+
     x1 = bspcoord[checkcoord[boxpos][0]];
     y1 = bspcoord[checkcoord[boxpos][1]];
     x2 = bspcoord[checkcoord[boxpos][2]];
@@ -388,9 +466,7 @@ boolean R_CheckBBox(fixed_t *bspcoord)
         angle2 = -clipangle;
     }
 
-    // Find the first clippost
-    //  that touches the source post
-    //  (adjacent pixels are touching).
+    // Find the columns the bbox spans.
     angle1 = (angle1 + ANG90) >> ANGLETOFINESHIFT;
     angle2 = (angle2 + ANG90) >> ANGLETOFINESHIFT;
     sx1 = viewangletox[angle1];
@@ -401,16 +477,8 @@ boolean R_CheckBBox(fixed_t *bspcoord)
         return false;
     sx2--;
 
-    start = solidsegs;
-    while (start->last < sx2)
-        start++;
-
-    if (sx1 >= start->first && sx2 <= start->last) {
-        // The clippost contains the new span.
-        return false;
-    }
-
-    return true;
+    // Any clear column within the span?
+    return R_FindColumn(sx1, sx2, false) <= sx2;
 }
 
 //
@@ -422,8 +490,8 @@ boolean R_CheckBBox(fixed_t *bspcoord)
 void R_Subsector(int num)
 {
     int count;
-    seg_t *line;
-    subsector_t *sub;
+    rseg_t *line;
+    rsubsector_t *sub;
 
 #ifdef RANGECHECK
     if (num >= numsubsectors)
@@ -431,10 +499,17 @@ void R_Subsector(int num)
 #endif
 
     sscount++;
-    sub = &subsectors[num];
-    frontsector = sub->sector;
+    sub = &rsubsectors[num];
+    frontsector = &rsectors[sub->sector];
     count = sub->numlines;
-    line = &segs[sub->firstline];
+    line = &rsegs[sub->firstline];
+
+    // Once solid walls cover the whole view, none of its walls or planes can
+    //  be seen, though sprites can still stick out in front of those walls.
+    if (numsolidcols == viewwidth) {
+        R_AddSprites(frontsector);
+        return;
+    }
 
     if (frontsector->floorheight < viewz) {
         floorplane =
@@ -469,6 +544,8 @@ void R_RenderBSPNode(int bspnum)
     node_t *bsp;
     int side;
 
+    M_CountWork(work_bspnodes, 1);
+
     // Found a subsector?
     if (bspnum & NF_SUBSECTOR) {
         if (bspnum == -1)
@@ -21,11 +21,11 @@
 
 #include "r_defs.h"
 
-extern seg_t *curline;
-extern side_t *sidedef;
-extern line_t *linedef;
-extern sector_t *frontsector;
-extern sector_t *backsector;
+extern rseg_t *curline;
+extern rside_t *sidedef;
+extern rline_t *linedef;
+extern rsector_t *frontsector;
+extern rsector_t *backsector;
 
 extern int rw_x;
 extern int rw_stopx;
@@ -38,8 +38,9 @@ extern boolean markceiling;
 
 extern boolean skymap;
 
-extern drawseg_t drawsegs[MAXDRAWSEGS];
+extern drawseg_t *drawsegs;
 extern drawseg_t *ds_p;
+extern int numdrawsegs;
 
 extern lighttable_t **hscalelight;
 extern lighttable_t **vscalelight;
@@ -50,7 +51,12 @@ typedef void (*drawfunc_t)(int start, int stop);
 // BSP?
 void R_ClearClipSegs(void);
 void R_ClearDrawSegs(void);
+void R_GrowDrawSegs(void);
 
 void R_RenderBSPNode(int bspnum);
 
+// Returns true if solid walls already stored hide columns x1 to x2 of a sprite
+//  at this scale, so that it needn't be drawn.
+boolean R_SpriteHidden(int x1, int x2, fixed_t scale);
+
 #endif
@@ -17,18 +17,24 @@
 //      generation of lookups, caching, retrieval by name.
 //
 
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "doomstat.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "m_argv.h"
 #include "m_misc.h"
 #include "p_local.h"
 #include "r_data.h"
+#include "r_main.h"
 #include "r_sky.h"
 #include "r_state.h"
+#include "sha1.h"
 #include "v_patch.h"
+#include "w_prefetch.h"
 #include "w_wad.h"
 #include "z_zone.h"
 
@@ -133,9 +139,40 @@ short **texturecolumnlump;
 unsigned short **texturecolumnofs;
 byte **texturecomposite;
 
+// Composite textures are kept in their own memory rather than purgable zone
+//  memory, so they aren't regenerated mid-frame whenever the zone runs low.
+//  Over budget, the least recently used are freed first.
+#define DEFAULT_COMPOSITE_CACHE_MB 8
+static size_t compositecachesize;
+static size_t compositecacheused;
+static int *texturecompositeframe; // framecount when last used
+static boolean *texturecompositepinned; // by R_PrecacheLevel
+
+// With -sharedtextures, composites are generated into shared memory named
+//  after a hash of everything they're made from, so DOOM processes playing
+//  with the same textures generate each only once between them. The memory
+//  starts with a flag per texture, set once its composite is complete.
+static byte *sharedcomposites;
+static int *sharedcompositeready;
+static size_t *sharedcompositeofs;
+
+// Pointers to each column of a texture drawn in the level, filled in when
+//  it's first drawn, so R_GetColumn is a single load; NULL until then. The
+//  lumps and composites they point into stay pinned until R_UnpinLevel.
+static byte ***texturecolumns;
+static byte **texturecolumnstorage;
+
+static byte **ResolveTextureColumns(int tex);
+
+// The posts of each column of a texture drawn as a masked mid texture, once
+//  read; purgable. Offsets are from where R_GetColumn's column starts, less
+//  the 3 bytes of its post header.
+static maskedposts_t **texturemaskedposts;
+
 // for global animation
 int *flattranslation;
 int *texturetranslation;
+int surfacegeneration;
 
 // needed for pre rendering
 fixed_t *spritewidth;
@@ -188,6 +225,37 @@ void R_DrawColumnInCache(column_t *patch, byte *cache, int originy,
     }
 }
 
+//
+// R_FreeComposites
+// Frees least recently used composites until size more bytes fit in the
+//  budget. Those used this frame are kept, even if that leaves it over.
+//
+static void R_FreeComposites(size_t size)
+{
+    int i;
+    int oldest;
+
+    while (compositecacheused + size > compositecachesize) {
+        oldest = -1;
+        for (i = 0; i < numtextures; i++) {
+            if (texturecomposite[i] && texturecompositeframe[i] != framecount
+                && !texturecompositepinned[i]
+                && (oldest < 0
+                    || texturecompositeframe[i]
+                           < texturecompositeframe[oldest])) {
+                oldest = i;
+            }
+        }
+
+        if (oldest < 0)
+            return;
+
+        free(texturecomposite[oldest]);
+        texturecomposite[oldest] = NULL;
+        compositecacheused -= texturecompositesize[oldest];
+    }
+}
+
 //
 // R_GenerateComposite
 // Using the texture definition,
@@ -210,8 +278,21 @@ void R_GenerateComposite(int texnum)
 
     texture = textures[texnum];
 
-    block = Z_Malloc(texturecompositesize[texnum], PU_STATIC,
-                     &texturecomposite[texnum]);
+    if (sharedcomposites) {
+        block = sharedcomposites + sharedcompositeofs[texnum];
+        texturecomposite[texnum] = block;
+        texturecompositeframe[texnum] = framecount;
+
+        // Already generated by this or another process.
+        if (__atomic_load_n(&sharedcompositeready[texnum], __ATOMIC_ACQUIRE))
+            return;
+    } else {
+        R_FreeComposites(texturecompositesize[texnum]);
+        block = I_Realloc(NULL, texturecompositesize[texnum]);
+        texturecomposite[texnum] = block;
+        texturecompositeframe[texnum] = framecount;
+        compositecacheused += texturecompositesize[texnum];
+    }
 
     collump = texturecolumnlump[texnum];
     colofs = texturecolumnofs[texnum];
@@ -221,7 +302,7 @@ void R_GenerateComposite(int texnum)
 
     for (i = 0, patch = texture->patches; i < texture->patchcount;
          i++, patch++) {
-        realpatch = W_CacheLumpNum(patch->patch, PU_CACHE);
+        realpatch = R_CacheLumpNum(patch->patch, PU_CACHE);
         x1 = patch->originx;
         x2 = x1 + SHORT(realpatch->width);
 
@@ -245,9 +326,10 @@ void R_GenerateComposite(int texnum)
         }
     }
 
-    // Now that the texture has been built in column cache,
-    //  it is purgable from zone memory.
-    Z_ChangeTag(block, PU_CACHE);
+    // Processes generating the same composite at once write the same bytes,
+    //  so whichever finishes first can publish it.
+    if (sharedcomposites)
+        __atomic_store_n(&sharedcompositeready[texnum], 1, __ATOMIC_RELEASE);
 }
 
 //
@@ -327,25 +409,159 @@ void R_GenerateLookup(int texnum)
     Z_Free(patchcount);
 }
 
+void *R_CacheLumpNum(int lump, int tag)
+{
+    if (viewthread)
+        return W_MappedLumpNum(lump);
+
+    return W_CacheLumpNum(lump, tag);
+}
+
+//
+// Lumps pinned until the view being drawn is finished, by number, so drawing
+// the same patch or flat again is just a load from the table rather than a
+// Z_ChangeTag to lock it and another to release it. With -viewthread, lumps
+// are read in place, so stay in the table for good.
+//
+static void **framelumps;
+static int *framepinnedlumps;
+static int numframepinnedlumps;
+static int maxframepinnedlumps;
+
+static void *PinFrameLump(int lump)
+{
+    void *result;
+
+    if (viewthread) {
+        result = W_MappedLumpNum(lump);
+    } else {
+        if (numframepinnedlumps == maxframepinnedlumps) {
+            maxframepinnedlumps =
+                maxframepinnedlumps ? 2 * maxframepinnedlumps : 256;
+            framepinnedlumps =
+                I_Realloc(framepinnedlumps,
+                          maxframepinnedlumps * sizeof(*framepinnedlumps));
+        }
+
+        result = W_PinLumpNum(lump);
+        framepinnedlumps[numframepinnedlumps++] = lump;
+    }
+
+    framelumps[lump] = result;
+    return result;
+}
+
+void *R_CacheFrameLumpNum(int lump)
+{
+    void *result = framelumps[lump];
+
+    return result != NULL ? result : PinFrameLump(lump);
+}
+
+void R_UnpinFrameLumps(void)
+{
+    int i;
+
+    for (i = 0; i < numframepinnedlumps; i++) {
+        W_UnpinLumpNum(framepinnedlumps[i]);
+        framelumps[framepinnedlumps[i]] = NULL;
+    }
+
+    numframepinnedlumps = 0;
+}
+
 //
 // R_GetColumn
 //
 byte *R_GetColumn(int tex, int col)
 {
-    int lump;
-    int ofs;
+    byte **columns = texturecolumns[tex];
+
+    if (columns == NULL)
+        columns = ResolveTextureColumns(tex);
 
-    col &= texturewidthmask[tex];
-    lump = texturecolumnlump[tex][col];
-    ofs = texturecolumnofs[tex][col];
+    return columns[col & texturewidthmask[tex]];
+}
+
+//
+// R_GetMaskedPosts
+// Columns composited from several patches aren't made of posts, and are left
+//  to R_DrawMaskedColumn to read as vanilla does.
+//
+const maskedposts_t *R_GetMaskedPosts(int tex)
+{
+    maskedposts_t *mp;
+    maskedpost_t *post;
+    int *columnstarts;
+    boolean *composite;
+    const short *collump = texturecolumnlump[tex];
+    const byte *start;
+    const column_t *column;
+    int width = texturewidthmask[tex] + 1;
+    int numposts;
+    int size;
+    int x;
 
-    if (lump > 0)
-        return (byte *)W_CacheLumpNum(lump, PU_CACHE) + ofs;
+    // Resolved first, even if the posts were already read, so nothing it
+    //  pins can purge them while they're drawn.
+    R_GetColumn(tex, 0);
 
-    if (!texturecomposite[tex])
-        R_GenerateComposite(tex);
+    if (texturemaskedposts[tex])
+        return texturemaskedposts[tex];
+
+    numposts = 0;
+    for (x = 0; x < width; x++) {
+        if (collump[x] <= 0)
+            continue;
+
+        column = (const column_t *)(R_GetColumn(tex, x) - 3);
+        for (; column->topdelta != 0xff;
+             column = (const column_t *)((const byte *)column + column->length
+                                         + 4)) {
+            numposts++;
+        }
+    }
+
+    size = sizeof(*mp) + numposts * sizeof(*mp->posts)
+           + (width + 1) * sizeof(*mp->columnstarts)
+           + width * sizeof(*mp->composite);
+
+    // Like sprites' posts, kept for good by views drawn on a thread of their
+    //  own, which mustn't touch the zone.
+    if (viewthread) {
+        mp = I_Realloc(NULL, size);
+        texturemaskedposts[tex] = mp;
+    } else
+        mp = Z_Malloc(size, PU_CACHE, &texturemaskedposts[tex]);
+    post = (maskedpost_t *)(mp + 1);
+    columnstarts = (int *)(post + numposts);
+    composite = (boolean *)(columnstarts + width + 1);
+    mp->posts = post;
+    mp->columnstarts = columnstarts;
+    mp->composite = composite;
+
+    numposts = 0;
+    for (x = 0; x < width; x++) {
+        columnstarts[x] = numposts;
+        composite[x] = collump[x] <= 0;
+        if (composite[x])
+            continue;
+
+        start = R_GetColumn(tex, x) - 3;
+        column = (const column_t *)start;
+        for (; column->topdelta != 0xff;
+             column = (const column_t *)((const byte *)column + column->length
+                                         + 4)) {
+            post->topdelta = column->topdelta;
+            post->length = column->length;
+            post->offset = (const byte *)column + 3 - start;
+            post++;
+            numposts++;
+        }
+    }
+    columnstarts[width] = numposts;
 
-    return texturecomposite[tex] + ofs;
+    return mp;
 }
 
 static void GenerateTextureHashTable(void)
@@ -387,6 +603,89 @@ static void GenerateTextureHashTable(void)
     }
 }
 
+//
+// InitSharedComposites
+// Maps the shared memory for -sharedtextures, if given, after the lookups
+//  are generated. Composites stay in private memory if it can't be mapped.
+//
+static void InitSharedComposites(void)
+{
+    sha1_context_t context;
+    sha1_digest_t digest;
+    texture_t *texture;
+    char name[32];
+    size_t size;
+    boolean created;
+    byte *base;
+    int i;
+    int j;
+
+    //!
+    // @category video
+    //
+    // Generate composite textures into shared memory that other DOOM
+    // processes playing with the same textures use too, rather than each
+    // keeping copies of their own. It's named after a hash of the textures
+    // and their patches, and left for later runs to use.
+    //
+
+    if (!M_ParmExists("-sharedtextures"))
+        return;
+
+    sharedcompositeofs =
+        Z_Malloc(numtextures * sizeof(*sharedcompositeofs), PU_STATIC, 0);
+
+    // The flags, then each composite.
+    size = numtextures * sizeof(*sharedcompositeready);
+
+    SHA1_Init(&context);
+    SHA1_UpdateInt32(&context, numtextures);
+
+    for (i = 0; i < numtextures; i++) {
+        sharedcompositeofs[i] = size;
+        if (texturecompositesize[i] <= 0)
+            continue;
+
+        size += texturecompositesize[i];
+        texture = textures[i];
+
+        SHA1_UpdateInt32(&context, i);
+        SHA1_UpdateInt32(&context, texture->width);
+        SHA1_UpdateInt32(&context, texture->height);
+        SHA1_UpdateInt32(&context, texture->patchcount);
+
+        for (j = 0; j < texture->patchcount; j++) {
+            SHA1_UpdateInt32(&context, texture->patches[j].originx);
+            SHA1_UpdateInt32(&context, texture->patches[j].originy);
+            SHA1_Update(&context,
+                        W_CacheLumpNum(texture->patches[j].patch, PU_CACHE),
+                        W_LumpLength(texture->patches[j].patch));
+        }
+    }
+
+    SHA1_Final(digest, &context);
+
+    // Short enough for macOS, which allows 31 characters.
+    M_StringCopy(name, "/actually-doom-", sizeof(name));
+    for (i = 0; i < 8; i++) {
+        M_snprintf(name + strlen(name), sizeof(name) - strlen(name), "%02x",
+                   digest[i]);
+    }
+
+    base = I_MapSharedMemory(name, size, &created);
+    if (base == NULL) {
+        Z_Free(sharedcompositeofs);
+        sharedcompositeofs = NULL;
+        return;
+    }
+
+    sharedcompositeready = (int *)base;
+    sharedcomposites = base;
+
+    printf("\nR_InitTextures: %s %i KiB of shared composites %s\n",
+           created ? "created" : "using", (int)(size >> 10), name);
+}
+
 //
 // R_InitTextures
 // Initializes the texture list
@@ -426,8 +725,6 @@ void R_InitTextures(void)
     int temp2;
     int temp3;
 
-    (void)totalwidth;
-
     // Load the patch names from pnames.lmp.
     name[8] = 0;
     names = W_CacheLumpName("PNAMES", PU_STATIC);
@@ -470,10 +767,22 @@ void R_InitTextures(void)
         Z_Malloc(numtextures * sizeof(*texturecomposite), PU_STATIC, 0);
     texturecompositesize =
         Z_Malloc(numtextures * sizeof(*texturecompositesize), PU_STATIC, 0);
+    texturecompositeframe =
+        Z_Malloc(numtextures * sizeof(*texturecompositeframe), PU_STATIC, 0);
+    texturecompositepinned =
+        Z_Malloc(numtextures * sizeof(*texturecompositepinned), PU_STATIC, 0);
+    memset(texturecompositepinned, 0,
+           numtextures * sizeof(*texturecompositepinned));
     texturewidthmask =
         Z_Malloc(numtextures * sizeof(*texturewidthmask), PU_STATIC, 0);
     textureheight =
         Z_Malloc(numtextures * sizeof(*textureheight), PU_STATIC, 0);
+    texturecolumns =
+        Z_Malloc(numtextures * sizeof(*texturecolumns), PU_STATIC, 0);
+    memset(texturecolumns, 0, numtextures * sizeof(*texturecolumns));
+    texturemaskedposts =
+        Z_Malloc(numtextures * sizeof(*texturemaskedposts), PU_STATIC, 0);
+    memset(texturemaskedposts, 0, numtextures * sizeof(*texturemaskedposts));
 
     totalwidth = 0;
 
@@ -552,6 +861,10 @@ void R_InitTextures(void)
 
     Z_Free(patchlookup);
 
+    // One block for every texture's column pointers.
+    texturecolumnstorage = Z_Malloc(totalwidth * sizeof(*texturecolumnstorage),
+                                    PU_STATIC, 0);
+
     W_ReleaseLumpName("TEXTURE1");
     if (maptex2)
         W_ReleaseLumpName("TEXTURE2");
@@ -561,6 +874,24 @@ void R_InitTextures(void)
     for (i = 0; i < numtextures; i++)
         R_GenerateLookup(i);
 
+    InitSharedComposites();
+
+    //!
+    // @arg <mb>
+    // @category video
+    //
+    // Memory to keep composite textures in, in MiB (default 8, or an
+    // eighth of the budget with -lowmem).
+    //
+
+    i = M_CheckParmWithArgs("-compositecache", 1);
+    if (i > 0)
+        compositecachesize = (size_t)atoi(myargv[i + 1]) << 20;
+    else if (I_LowMemoryBudget() > 0)
+        compositecachesize = I_LowMemoryBudget() / 8;
+    else
+        compositecachesize = (size_t)DEFAULT_COMPOSITE_CACHE_MB << 20;
+
     // Create translation table for global animation.
     texturetranslation =
         Z_Malloc((numtextures + 1) * sizeof(*texturetranslation), PU_STATIC, 0);
@@ -595,11 +926,13 @@ void R_InitFlats(void)
 // Finds the width and hoffset of all sprites in the wad,
 //  so the sprite does not need to be cached completely
 //  just for having the header info ready during rendering.
+// Only the fixed 8-byte patch header of each lump is read; the column
+//  data is left on disk until the sprite is first drawn.
 //
 void R_InitSpriteLumps(void)
 {
     int i;
-    patch_t *patch;
+    patch_t header;
 
     firstspritelump = W_GetNumForName("S_START") + 1;
     lastspritelump = W_GetNumForName("S_END") - 1;
@@ -615,10 +948,12 @@ void R_InitSpriteLumps(void)
         if (!(i & 63))
             printf(".");
 
-        patch = W_CacheLumpNum(firstspritelump + i, PU_CACHE);
-        spritewidth[i] = SHORT(patch->width) << FRACBITS;
-        spriteoffset[i] = SHORT(patch->leftoffset) << FRACBITS;
-        spritetopoffset[i] = SHORT(patch->topoffset) << FRACBITS;
+        memset(&header, 0, sizeof(header));
+        W_ReadLumpHeader(firstspritelump + i, &header,
+                         offsetof(patch_t, columnofs));
+        spritewidth[i] = SHORT(header.width) << FRACBITS;
+        spriteoffset[i] = SHORT(header.leftoffset) << FRACBITS;
+        spritetopoffset[i] = SHORT(header.topoffset) << FRACBITS;
     }
 }
 
@@ -643,6 +978,9 @@ void R_InitColormaps(void)
 //
 void R_InitData(void)
 {
+    framelumps = I_Realloc(NULL, numlumps * sizeof(*framelumps));
+    memset(framelumps, 0, numlumps * sizeof(*framelumps));
+
     R_InitTextures();
     printf(".");
     R_InitFlats();
@@ -719,11 +1057,149 @@ int R_TextureNumForName(char *name)
 //
 // R_PrecacheLevel
 // Preloads all relevant graphics for the level.
+// Up to a budget, they're pinned until R_UnpinLevel, so they can't be purged
+//  and read again mid-level.
+// Everything is listed and prefetched first, so reading runs ahead on the
+//  I/O thread while the list is pinned and composited.
 //
 int flatmemory;
 int texturememory;
 int spritememory;
 
+static int *pinnedlumps;
+static int numpinnedlumps;
+static int maxpinnedlumps;
+static int pinnedmemory;
+static int pinbudget;
+
+// Lump numbers, or -1 - texnum for composites, in the order to precache.
+static int *precachelist;
+static int numprecache;
+static int maxprecache;
+
+static void ListPrecache(int item)
+{
+    if (numprecache == maxprecache) {
+        maxprecache = maxprecache ? 2 * maxprecache : 256;
+        precachelist =
+            I_Realloc(precachelist, maxprecache * sizeof(*precachelist));
+    }
+
+    precachelist[numprecache++] = item;
+}
+
+static void ListLump(int lump)
+{
+    W_PrefetchLump(lump);
+    ListPrecache(lump);
+}
+
+// Pins lump until R_UnpinLevel.
+static void *PinLevelLump(int lump)
+{
+    if (numpinnedlumps == maxpinnedlumps) {
+        maxpinnedlumps = maxpinnedlumps ? 2 * maxpinnedlumps : 256;
+        pinnedlumps =
+            I_Realloc(pinnedlumps, maxpinnedlumps * sizeof(*pinnedlumps));
+    }
+
+    pinnedlumps[numpinnedlumps++] = lump;
+    return W_PinLumpNum(lump);
+}
+
+static void PrecacheLump(int lump)
+{
+    if (lumpinfo[lump].pins > 0)
+        return;
+
+    if (pinnedmemory + lumpinfo[lump].size > pinbudget) {
+        W_CacheLumpNum(lump, PU_CACHE);
+        return;
+    }
+
+    PinLevelLump(lump);
+    pinnedmemory += lumpinfo[lump].size;
+}
+
+static void PrecacheComposite(int texnum)
+{
+    if (texturecompositesize[texnum] <= 0)
+        return;
+
+    if (!texturecomposite[texnum])
+        R_GenerateComposite(texnum);
+
+    if (pinnedmemory + texturecompositesize[texnum] <= pinbudget) {
+        texturecompositepinned[texnum] = true;
+        pinnedmemory += texturecompositesize[texnum];
+    }
+}
+
+//
+// ResolveTextureColumns
+// Fills in the texture's column pointers for R_GetColumn. Its patches and
+//  composite are pinned for the level, whatever the precache budget, as the
+//  pointers must stay valid; with -viewthread, lumps are read in place.
+//
+static byte **ResolveTextureColumns(int tex)
+{
+    texture_t *texture = textures[tex];
+    short *collump = texturecolumnlump[tex];
+    unsigned short *colofs = texturecolumnofs[tex];
+    byte **columns;
+    byte *patch = NULL;
+    int lump = -1;
+    int x;
+
+    if (texturecompositesize[tex] > 0) {
+        if (!texturecomposite[tex])
+            R_GenerateComposite(tex);
+
+        texturecompositepinned[tex] = true;
+    }
+
+    columns = texturecolumnstorage;
+    for (x = 0; x < tex; x++)
+        columns += textures[x]->width;
+
+    for (x = 0; x < texture->width; x++) {
+        if (collump[x] <= 0) {
+            columns[x] = texturecomposite[tex] + colofs[x];
+            continue;
+        }
+
+        // Columns of the same patch are usually next to each other.
+        if (collump[x] != lump) {
+            lump = collump[x];
+            patch = viewthread ? W_MappedLumpNum(lump) : PinLevelLump(lump);
+        }
+
+        columns[x] = patch + colofs[x];
+    }
+
+    texturecolumns[tex] = columns;
+    return columns;
+}
+
+//
+// R_UnpinLevel
+// Lets what R_PrecacheLevel and ResolveTextureColumns pinned be purged again.
+//
+void R_UnpinLevel(void)
+{
+    int i;
+
+    for (i = 0; i < numpinnedlumps; i++)
+        W_UnpinLumpNum(pinnedlumps[i]);
+
+    memset(texturecompositepinned, 0,
+           numtextures * sizeof(*texturecompositepinned));
+    memset(texturecolumns, 0, numtextures * sizeof(*texturecolumns));
+
+    numpinnedlumps = 0;
+    pinnedmemory = 0;
+}
+
 void R_PrecacheLevel(void)
 {
     char *flatpresent;
@@ -742,6 +1218,17 @@ void R_PrecacheLevel(void)
     if (demoplayback)
         return;
 
+    //!
+    // @arg <mb>
+    // @category video
+    //
+    // Most memory to pin the level's graphics in, in MiB. Defaults to half of
+    // what's free in the zone; more than's free will run out of memory.
+    //
+
+    i = M_CheckParmWithArgs("-precachemb", 1);
+    pinbudget = i > 0 ? atoi(myargv[i + 1]) << 20 : Z_FreeMemory() / 2;
+
     // Precache flats.
     flatpresent = Z_Malloc(numflats, PU_STATIC, NULL);
     memset(flatpresent, 0, numflats);
@@ -757,7 +1244,7 @@ void R_PrecacheLevel(void)
         if (flatpresent[i]) {
             lump = firstflat + i;
             flatmemory += lumpinfo[lump].size;
-            W_CacheLumpNum(lump, PU_CACHE);
+            ListLump(lump);
         }
     }
 
@@ -791,8 +1278,11 @@ void R_PrecacheLevel(void)
         for (j = 0; j < texture->patchcount; j++) {
             lump = texture->patches[j].patch;
             texturememory += lumpinfo[lump].size;
-            W_CacheLumpNum(lump, PU_CACHE);
+            ListLump(lump);
         }
+
+        // Composite it now, rather than when first seen.
+        ListPrecache(-1 - i);
     }
 
     Z_Free(texturepresent);
@@ -801,9 +1291,9 @@ void R_PrecacheLevel(void)
     spritepresent = Z_Malloc(numsprites, PU_STATIC, NULL);
     memset(spritepresent, 0, numsprites);
 
-    for (th = thinkercap.next; th != &thinkercap; th = th->next) {
-        if (th->function == P_MobjThinker)
-            spritepresent[((mobj_t *)th)->sprite] = 1;
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj];
+         th = th->cnext) {
+        spritepresent[((mobj_t *)th)->sprite] = 1;
     }
 
     spritememory = 0;
@@ -816,10 +1306,19 @@ void R_PrecacheLevel(void)
             for (k = 0; k < 8; k++) {
                 lump = firstspritelump + sf->lump[k];
                 spritememory += lumpinfo[lump].size;
-                W_CacheLumpNum(lump, PU_CACHE);
+                ListLump(lump);
             }
         }
     }
 
     Z_Free(spritepresent);
+
+    for (i = 0; i < numprecache; i++) {
+        if (precachelist[i] >= 0)
+            PrecacheLump(precachelist[i]);
+        else
+            PrecacheComposite(-1 - precachelist[i]);
+    }
+
+    numprecache = 0;
 }
@@ -21,13 +21,31 @@
 #define __R_DATA__
 
 #include "doomtype.h"
+#include "r_defs.h"
 
 // Retrieve column data for span blitting.
 byte *R_GetColumn(int tex, int col);
 
+// The posts of a texture's columns, for drawing it as a masked mid texture
+// with R_DrawMaskedPosts from R_GetColumn(tex, col) - 3. There are
+// texturewidthmask[tex] + 1 columns, so col is masked as R_GetColumn does.
+const maskedposts_t *R_GetMaskedPosts(int tex);
+
+// W_CacheLumpNum for the renderer. With -viewthread, lumps are read in place
+// from the memory-mapped WADs instead, as views are drawn on a thread that
+// mustn't touch the zone.
+void *R_CacheLumpNum(int lump, int tag);
+
+// Like R_CacheLumpNum, but the lump stays pinned until R_UnpinFrameLumps is
+// called once the view is finished, so asking for it again meanwhile only
+// costs a table lookup. Not thread-safe, like the zone.
+void *R_CacheFrameLumpNum(int lump);
+void R_UnpinFrameLumps(void);
+
 // I/O, setting up the stuff.
 void R_InitData(void);
 void R_PrecacheLevel(void);
+void R_UnpinLevel(void);
 
 // Retrieval.
 // Floor/ceiling opaque texture tiles,
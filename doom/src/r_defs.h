@@ -38,6 +38,7 @@
 #define SIL_TOP 2
 #define SIL_BOTH 3
 
+// Initial size of the drawseg pool, which grows as needed.
 #define MAXDRAWSEGS 256
 
 //
@@ -73,11 +74,55 @@ typedef struct {
 
 } degenmobj_t;
 
+//
+// A thing in a sector's thinglist, with the position it was linked at.
+// Kept in an array next to the list so the renderer can cull sprites
+// without touching each mobj_t.
+//
+typedef struct {
+    fixed_t x;
+    fixed_t y;
+    mobj_t *mobj;
+
+} sectorthing_t;
+
+//
+// Links a thing to a sector its bounding box touches. Each thing in the
+// blockmap has a list of the sectors it touches, and each sector a list of
+// the things touching it, for moving floors and ceilings to check.
+//
+typedef struct msecnode_s {
+    struct sector_s *m_sector;
+    mobj_t *m_thing;
+
+    // Next in the thing's list of sectors.
+    struct msecnode_s *m_tnext;
+
+    // Links in the sector's list of things.
+    struct msecnode_s *m_sprev;
+    struct msecnode_s *m_snext;
+
+    // Set once P_ChangeSector() has checked the thing.
+    boolean visited;
+
+} msecnode_t;
+
+//
+// A two-sided line of a sector and the sector on its other side: the
+// sectors getNextSector() finds, for sound to flood through (see
+// P_RecursiveSound()) and the P_Find*Surrounding() height queries.
+//
+typedef struct {
+    struct line_s *line;
+    struct sector_s *other;
+
+} sectorlink_t;
+
 //
 // The SECTORS record, at runtime.
 // Stores things/mobjs.
 //
-typedef struct {
+typedef struct sector_s {
     fixed_t floorheight;
     fixed_t ceilingheight;
     short floorpic;
@@ -104,12 +149,29 @@ typedef struct {
     // list of mobjs in sector
     mobj_t *thinglist;
 
+    // the same mobjs, newest last
+    int numthings;
+    int maxthings;
+    sectorthing_t *things; // [maxthings] size
+
+    // things whose bounding boxes touch the sector
+    msecnode_t *touching_thinglist;
+
     // thinker_t for reversable actions
     void *specialdata;
 
     int linecount;
     struct line_s **lines; // [linecount] size
 
+    int neighbourcount;
+    sectorlink_t *neighbours; // [neighbourcount] size
+
+    // next sector with the same tag, or -1
+    int nexttag;
+
+    // first teleport destination in the sector, if any
+    mobj_t *teleportdest;
+
 } sector_t;
 
 //
@@ -252,11 +314,32 @@ typedef struct {
 // Could even us emore than 32 levels.
 typedef byte lighttable_t;
 
+//
+// The posts of a patch's columns, read out of it once rather than every
+// time a column is drawn, for sprites and masked mid textures. The texels
+// are still drawn from the patch.
+//
+typedef struct {
+    short topdelta;
+    short length;
+    int offset; // of the post's first texel, from where it's drawn from
+} maskedpost_t;
+
+typedef struct {
+    // Column i's posts are posts[columnstarts[i]] up to, but not including,
+    // posts[columnstarts[i + 1]].
+    const maskedpost_t *posts;
+    const int *columnstarts;
+    // For textures, true for the columns composited from several patches,
+    //  which have no posts of their own; NULL for sprites.
+    const boolean *composite;
+} maskedposts_t;
+
 //
 // ?
 //
 typedef struct drawseg_s {
-    seg_t *curline;
+    struct rseg_s *curline;
     int x1;
     int x2;
 
@@ -279,6 +362,9 @@ typedef struct drawseg_s {
     short *sprbottomclip;
     short *maskedtexturecol;
 
+    // Light table of a textured seg, for drawing its masked texture.
+    lighttable_t **walllights;
+
 } drawseg_t;
 
 // A vissprite_t is a thing
@@ -358,6 +444,97 @@ typedef struct {
 
 } spritedef_t;
 
+//
+// What the renderer draws the level from: copies of what changes as it's
+// played, taken by R_PublishView, so a view can be drawn while the next tics
+// change the level itself.
+//
+
+typedef struct {
+    fixed_t floorheight;
+    fixed_t ceilingheight;
+    short floorpic;
+    short ceilingpic;
+    short lightlevel;
+
+    // if == framecount, its sprites are already added
+    int validcount;
+
+    // its things, in rthings, newest last
+    int firstthing;
+    int numthings;
+
+} rsector_t;
+
+typedef struct {
+    fixed_t textureoffset;
+    fixed_t rowoffset;
+    short toptexture;
+    short bottomtexture;
+    short midtexture;
+
+} rside_t;
+
+typedef struct {
+    short flags;
+
+} rline_t;
+
+//
+// The level's segs and subsectors as the renderer walks them, built by
+// R_InitLevelSegs once it's loaded; the playsim keeps to segs and
+// subsectors. Vertices are copied in and the rest is referred to by number,
+// in the order R_AddLine then R_StoreWallRange read them, so a subsector's
+// segs sit side by side and the numbers don't run out on big maps.
+//
+
+typedef struct rseg_s {
+    vertex_t v1;
+    vertex_t v2;
+    // -1 for one sided lines.
+    int backsector;
+    int sidedef;
+
+    int frontsector;
+    int linedef;
+    angle_t angle;
+    fixed_t offset;
+
+} rseg_t;
+
+// What R_StoreWallRange last worked out for an rseg, and the view it was
+// worked out from; reused while the view stays put.
+typedef struct {
+    boolean cached;
+    fixed_t viewx, viewy;
+    fixed_t hyp, distance;
+    // Scales at the seg's ends, from the columns and angles it spanned.
+    int start, stop;
+    angle_t viewangle;
+    fixed_t projection;
+    fixed_t scale1, scale2, scalestep;
+
+} rsegcache_t;
+
+typedef struct {
+    int sector;
+    int firstline;
+    int numlines;
+
+} rsubsector_t;
+
+// A thing, where it's drawn: part way through the tic or where it is.
+typedef struct {
+    fixed_t x;
+    fixed_t y;
+    fixed_t z;
+    angle_t angle;
+    spritenum_t sprite;
+    int frame;
+    int flags;
+
+} rthing_t;
+
 //
 // Now what is a visplane, anyway?
 //
@@ -368,17 +545,14 @@ typedef struct {
     int minx;
     int maxx;
 
-    // leave pads for [minx-1]/[maxx+1]
-
-    byte pad1;
-    // Here lies the rub for all
-    //  dynamic resize/change of resolution.
-    byte top[SCREENWIDTH];
-    byte pad2;
-    byte pad3;
-    // See above.
-    byte bottom[SCREENWIDTH];
-    byte pad4;
+    // Index of the next visplane in the same R_FindPlane hash chain, or -1.
+    int hashnext;
+
+    // SCREENWIDTH entries each, allocated by R_NewVisplane.
+    // Leaves pads for [minx-1]/[maxx+1]; 0xffff if unused,
+    //  as screen rows may not fit in a byte with hires.
+    unsigned short *top;
+    unsigned short *bottom;
 
 } visplane_t;
 
@@ -20,10 +20,20 @@
 
 #include <string.h>
 
+#include "i_cpu.h"
+
+#ifdef I_CPU_X86
+#include <emmintrin.h>
+#endif
+
 #include "doomdef.h"
 #include "doomstat.h"
 #include "i_system.h"
+#include "i_thread.h"
+#include "m_argv.h"
+#include "m_counts.h"
 #include "r_defs.h"
+#include "r_draw.h"
 #include "r_main.h"
 #include "r_state.h"
 #include "st_stuff.h"
@@ -33,10 +43,6 @@
 // Needs access to LFB (guess what).
 #include "v_video.h"
 
-// ?
-#define MAXWIDTH 1120
-#define MAXHEIGHT 832
-
 //
 // All drawing to the view buffer is accomplished in this file.
 // The other refresh files only know about ccordinates,
@@ -54,6 +60,12 @@ int viewwindowx;
 int viewwindowy;
 byte *ylookup[MAXHEIGHT];
 int columnofs[MAXWIDTH];
+int rowpitch;
+int colpitch;
+
+// With -colmajor, the view is drawn column-major into here, so that the pixels
+// of a column are contiguous, then transposed into the frame buffer.
+static byte *colmajor_buffer = NULL;
 
 // Color tables for different players,
 //  translate a limited part to another
@@ -80,9 +92,71 @@ fixed_t dc_texturemid;
 // first pixel in a column (possibly virtual)
 byte *dc_source;
 
+// Texel row at which dc_source repeats.
+int dc_texheight = 128;
+
 // just for profiling
 int dccount;
 
+//
+// ColumnMask
+// Vanilla wrapped every column at 128 texels, so taller textures repeated
+//  early and shorter ones read past the end of their columns. Returns the
+//  mask to apply to texel rows for the column about to be drawn: all ones
+//  when it never leaves the texture, which is the common case, or
+//  dc_texheight - 1 when that is a power of two. Returns 0 otherwise, for
+//  DrawWrappedColumn.
+//
+static int ColumnMask(fixed_t frac, fixed_t fracstep, int count)
+{
+    int64_t last = (int64_t)frac + (int64_t)fracstep * count;
+
+    if (frac >= 0 && last >= 0 && last < (int64_t)dc_texheight << FRACBITS)
+        return -1;
+    if ((dc_texheight & (dc_texheight - 1)) == 0)
+        return dc_texheight - 1;
+    return 0;
+}
+
+//
+// DrawWrappedColumn
+// Slow path for columns of textures whose height isn't a power of two. The
+//  start and step are brought within the texture beforehand, so each pixel
+//  needs at most one subtraction to wrap. dest2, if not NULL, gets a copy of
+//  each pixel, for low detail.
+//
+static void DrawWrappedColumn(byte *dest, byte *dest2, int pitch,
+                              fixed_t frac, fixed_t fracstep, int count)
+{
+    fixed_t height = dc_texheight << FRACBITS;
+    unsigned int pos;
+    unsigned int step;
+    byte pixel;
+
+    frac %= height;
+    if (frac < 0)
+        frac += height;
+    fracstep %= height;
+    if (fracstep < 0)
+        fracstep += height;
+    pos = frac;
+    step = fracstep;
+
+    do {
+        pixel = dc_colormap[dc_source[pos >> FRACBITS]];
+        *dest = pixel;
+        if (dest2)
+            *dest2 = pixel;
+        dest += pitch;
+        if (dest2)
+            dest2 += pitch;
+
+        pos += step;
+        if (pos >= (unsigned int)height)
+            pos -= height;
+    } while (count--);
+}
+
 //
 // A column is a vertical slice/span from a wall texture that,
 //  given the DOOM style restrictions on the view orientation,
@@ -94,8 +168,12 @@ void R_DrawColumn(void)
 {
     int count;
     byte *dest;
+    // rowpitch could be aliased by dest, so would be reloaded every pixel if
+    // used directly.
+    int pitch = rowpitch;
     fixed_t frac;
     fixed_t fracstep;
+    int mask;
 
     count = dc_yh - dc_yl;
 
@@ -103,8 +181,12 @@ void R_DrawColumn(void)
     if (count < 0)
         return;
 
+    M_CountWork(work_columns, 1);
+    M_CountWork(work_pixels, count + 1);
+
 #ifdef RANGECHECK
-    if ((unsigned)dc_x >= SCREENWIDTH || dc_yl < 0 || dc_yh >= SCREENHEIGHT)
+    if ((unsigned)dc_x >= (unsigned)SCREENWIDTH || dc_yl < 0
+        || dc_yh >= SCREENHEIGHT)
         I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
 #endif
 
@@ -118,15 +200,21 @@ void R_DrawColumn(void)
     fracstep = dc_iscale;
     frac = dc_texturemid + (dc_yl - centery) * fracstep;
 
+    mask = ColumnMask(frac, fracstep, count);
+    if (!mask) {
+        DrawWrappedColumn(dest, NULL, pitch, frac, fracstep, count);
+        return;
+    }
+
     // Inner loop that does the actual texture mapping,
     //  e.g. a DDA-lile scaling.
     // This is as fast as it gets.
     do {
         // Re-map color indices from wall texture column
         //  using a lighting/special effects LUT.
-        *dest = dc_colormap[dc_source[(frac >> FRACBITS) & 127]];
+        *dest = dc_colormap[dc_source[(frac >> FRACBITS) & mask]];
 
-        dest += SCREENWIDTH;
+        dest += pitch;
         frac += fracstep;
 
     } while (count--);
@@ -194,10 +282,12 @@ void R_DrawColumnLow(void)
 {
     int count;
     byte *dest;
+    int pitch = rowpitch;
     byte *dest2;
     fixed_t frac;
     fixed_t fracstep;
     int x;
+    int mask;
 
     count = dc_yh - dc_yl;
 
@@ -205,8 +295,12 @@ void R_DrawColumnLow(void)
     if (count < 0)
         return;
 
+    M_CountWork(work_columns, 1);
+    M_CountWork(work_pixels, 2 * (count + 1));
+
 #ifdef RANGECHECK
-    if ((unsigned)dc_x >= SCREENWIDTH || dc_yl < 0 || dc_yh >= SCREENHEIGHT) {
+    if ((unsigned)dc_x >= (unsigned)SCREENWIDTH || dc_yl < 0
+        || dc_yh >= SCREENHEIGHT) {
         I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
     }
     //  dccount++;
@@ -220,21 +314,170 @@ void R_DrawColumnLow(void)
     fracstep = dc_iscale;
     frac = dc_texturemid + (dc_yl - centery) * fracstep;
 
+    mask = ColumnMask(frac, fracstep, count);
+    if (!mask) {
+        DrawWrappedColumn(dest, dest2, pitch, frac, fracstep, count);
+        return;
+    }
+
     do {
         // Hack. Does not work corretly.
-        *dest2 = *dest = dc_colormap[dc_source[(frac >> FRACBITS) & 127]];
-        dest += SCREENWIDTH;
-        dest2 += SCREENWIDTH;
+        *dest2 = *dest = dc_colormap[dc_source[(frac >> FRACBITS) & mask]];
+        dest += pitch;
+        dest2 += pitch;
         frac += fracstep;
 
     } while (count--);
 }
 
+//
+// Batched wall columns.
+// Adjacent wall columns are drawn into a small buffer with the four columns
+//  of each row next to each other, then flushed to the view together, so
+//  rows they have in common are written four pixels at a time.
+//
+#define QUEUECOLUMNS 4
+
+typedef struct {
+    byte buf[MAXHEIGHT * QUEUECOLUMNS];
+    int x; // of the first column
+    int count;
+    int yl[QUEUECOLUMNS];
+    int yh[QUEUECOLUMNS];
+} colqueue_t;
+
+static colqueue_t colqueues[NUMCOLQUEUES];
+
+static void FlushQueuedColumn(colqueue_t *q, int i, int yl, int yh)
+{
+    int pitch = rowpitch;
+    byte *src = q->buf + yl * QUEUECOLUMNS + i;
+    byte *dest = ylookup[yl] + columnofs[q->x + i];
+
+    for (; yl <= yh; yl++) {
+        *dest = *src;
+        src += QUEUECOLUMNS;
+        dest += pitch;
+    }
+}
+
+static void FlushColumnQueue(colqueue_t *q)
+{
+    int i;
+    int y;
+    int top;
+    int bottom;
+
+    if (q->count < QUEUECOLUMNS) {
+        for (i = 0; i < q->count; i++)
+            FlushQueuedColumn(q, i, q->yl[i], q->yh[i]);
+        q->count = 0;
+        return;
+    }
+
+    // Rows covered by all of the columns.
+    top = q->yl[0];
+    bottom = q->yh[0];
+    for (i = 1; i < QUEUECOLUMNS; i++) {
+        if (q->yl[i] > top)
+            top = q->yl[i];
+        if (q->yh[i] < bottom)
+            bottom = q->yh[i];
+    }
+
+    if (top > bottom) {
+        for (i = 0; i < QUEUECOLUMNS; i++)
+            FlushQueuedColumn(q, i, q->yl[i], q->yh[i]);
+        q->count = 0;
+        return;
+    }
+
+    // The ragged ends.
+    for (i = 0; i < QUEUECOLUMNS; i++) {
+        FlushQueuedColumn(q, i, q->yl[i], top - 1);
+        FlushQueuedColumn(q, i, bottom + 1, q->yh[i]);
+    }
+
+    for (y = top; y <= bottom; y++) {
+        memcpy(ylookup[y] + columnofs[q->x], q->buf + y * QUEUECOLUMNS,
+               QUEUECOLUMNS);
+    }
+
+    q->count = 0;
+}
+
+//
+// R_DrawColumnQueued
+// Like R_DrawColumn, but not drawn to the view until flushed by
+//  R_FlushColumnQueues or a column that isn't next to the others in
+//  the queue. Only for high detail, row-major views.
+//
+void R_DrawColumnQueued(int queue)
+{
+    colqueue_t *q = &colqueues[queue];
+    int count;
+    byte *dest;
+    fixed_t frac;
+    fixed_t fracstep;
+    int mask;
+
+    count = dc_yh - dc_yl;
+
+    if (count < 0)
+        return;
+
+    M_CountWork(work_columns, 1);
+    M_CountWork(work_pixels, count + 1);
+
+#ifdef RANGECHECK
+    if ((unsigned)dc_x >= (unsigned)SCREENWIDTH || dc_yl < 0
+        || dc_yh >= SCREENHEIGHT)
+        I_Error("R_DrawColumnQueued: %i to %i at %i", dc_yl, dc_yh, dc_x);
+#endif
+
+    if (q->count == QUEUECOLUMNS
+        || (q->count > 0 && q->x + q->count != dc_x)) {
+        FlushColumnQueue(q);
+    }
+
+    if (q->count == 0)
+        q->x = dc_x;
+
+    q->yl[q->count] = dc_yl;
+    q->yh[q->count] = dc_yh;
+    dest = q->buf + dc_yl * QUEUECOLUMNS + q->count;
+    q->count++;
+
+    fracstep = dc_iscale;
+    frac = dc_texturemid + (dc_yl - centery) * fracstep;
+
+    mask = ColumnMask(frac, fracstep, count);
+    if (!mask) {
+        DrawWrappedColumn(dest, NULL, QUEUECOLUMNS, frac, fracstep, count);
+        return;
+    }
+
+    do {
+        *dest = dc_colormap[dc_source[(frac >> FRACBITS) & mask]];
+        dest += QUEUECOLUMNS;
+        frac += fracstep;
+    } while (count--);
+}
+
+void R_FlushColumnQueues(void)
+{
+    int i;
+
+    for (i = 0; i < NUMCOLQUEUES; i++)
+        FlushColumnQueue(&colqueues[i]);
+}
+
 //
 // Spectre/Invisibility.
 //
 #define FUZZTABLE 50
-#define FUZZOFF (SCREENWIDTH)
+// Multiplied by the pitch, so the view can be drawn column-major.
+#define FUZZOFF 1
 
 int fuzzoffset[FUZZTABLE] = {
     FUZZOFF,  -FUZZOFF, FUZZOFF,  -FUZZOFF, FUZZOFF,  FUZZOFF,  -FUZZOFF,
@@ -248,6 +491,9 @@ int fuzzoffset[FUZZTABLE] = {
 
 int fuzzpos = 0;
 
+// fuzzoffset multiplied by the pitch, so it's not done every pixel.
+static int fuzzdelta[FUZZTABLE];
+
 //
 // Framebuffer postprocessing.
 // Creates a fuzzy image by copying pixels
@@ -260,10 +506,11 @@ void R_DrawFuzzColumn(void)
 {
     int count;
     byte *dest;
-    fixed_t frac;
-    fixed_t fracstep;
-
-    (void)frac;
+    int pitch = rowpitch;
+    lighttable_t *fuzzmap;
+    int *delta;
+    int run;
+    int i;
 
     // Adjust borders. Low...
     if (!dc_yl)
@@ -279,36 +526,43 @@ void R_DrawFuzzColumn(void)
     if (count < 0)
         return;
 
+    M_CountWork(work_columns, 1);
+    M_CountWork(work_pixels, count + 1);
+
 #ifdef RANGECHECK
-    if ((unsigned)dc_x >= SCREENWIDTH || dc_yl < 0 || dc_yh >= SCREENHEIGHT) {
+    if ((unsigned)dc_x >= (unsigned)SCREENWIDTH || dc_yl < 0
+        || dc_yh >= SCREENHEIGHT) {
         I_Error("R_DrawFuzzColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
     }
 #endif
 
     dest = ylookup[dc_yl] + columnofs[dc_x];
-
-    // Looks familiar.
-    fracstep = dc_iscale;
-    frac = dc_texturemid + (dc_yl - centery) * fracstep;
+    fuzzmap = colormaps + 6 * 256;
 
     // Looks like an attempt at dithering,
     //  using the colormap #6 (of 0-31, a bit
     //  brighter than average).
-    do {
-        // Lookup framebuffer, and retrieve
-        //  a pixel that is either one column
-        //  left or right of the current one.
-        // Add index from colormap to index.
-        *dest = colormaps[6 * 256 + dest[fuzzoffset[fuzzpos]]];
-
-        // Clamp table lookup index.
-        if (++fuzzpos == FUZZTABLE)
+    // Drawn in runs up to the end of the fuzz table, so the index needn't be
+    //  clamped every pixel.
+    for (count++; count > 0; count -= run) {
+        run = FUZZTABLE - fuzzpos;
+        if (run > count)
+            run = count;
+
+        delta = fuzzdelta + fuzzpos;
+        fuzzpos += run;
+        if (fuzzpos == FUZZTABLE)
             fuzzpos = 0;
 
-        dest += SCREENWIDTH;
-
-        frac += fracstep;
-    } while (count--);
+        for (i = 0; i < run; i++) {
+            // Lookup framebuffer, and retrieve
+            //  a pixel that is either one column
+            //  left or right of the current one.
+            // Add index from colormap to index.
+            *dest = fuzzmap[dest[delta[i]]];
+            dest += pitch;
+        }
+    }
 }
 
 // low detail mode version
@@ -317,13 +571,14 @@ void R_DrawFuzzColumnLow(void)
 {
     int count;
     byte *dest;
+    int pitch = rowpitch;
     byte *dest2;
-    fixed_t frac;
-    fixed_t fracstep;
+    lighttable_t *fuzzmap;
+    int *delta;
+    int run;
+    int i;
     int x;
 
-    (void)frac;
-
     // Adjust borders. Low...
     if (!dc_yl)
         dc_yl = 1;
@@ -338,43 +593,48 @@ void R_DrawFuzzColumnLow(void)
     if (count < 0)
         return;
 
+    M_CountWork(work_columns, 1);
+    M_CountWork(work_pixels, 2 * (count + 1));
+
     // low detail mode, need to multiply by 2
 
     x = dc_x << 1;
 
 #ifdef RANGECHECK
-    if ((unsigned)x >= SCREENWIDTH || dc_yl < 0 || dc_yh >= SCREENHEIGHT) {
+    if ((unsigned)x >= (unsigned)SCREENWIDTH || dc_yl < 0
+        || dc_yh >= SCREENHEIGHT) {
         I_Error("R_DrawFuzzColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
     }
 #endif
 
     dest = ylookup[dc_yl] + columnofs[x];
     dest2 = ylookup[dc_yl] + columnofs[x + 1];
-
-    // Looks familiar.
-    fracstep = dc_iscale;
-    frac = dc_texturemid + (dc_yl - centery) * fracstep;
+    fuzzmap = colormaps + 6 * 256;
 
     // Looks like an attempt at dithering,
     //  using the colormap #6 (of 0-31, a bit
     //  brighter than average).
-    do {
-        // Lookup framebuffer, and retrieve
-        //  a pixel that is either one column
-        //  left or right of the current one.
-        // Add index from colormap to index.
-        *dest = colormaps[6 * 256 + dest[fuzzoffset[fuzzpos]]];
-        *dest2 = colormaps[6 * 256 + dest2[fuzzoffset[fuzzpos]]];
-
-        // Clamp table lookup index.
-        if (++fuzzpos == FUZZTABLE)
+    for (count++; count > 0; count -= run) {
+        run = FUZZTABLE - fuzzpos;
+        if (run > count)
+            run = count;
+
+        delta = fuzzdelta + fuzzpos;
+        fuzzpos += run;
+        if (fuzzpos == FUZZTABLE)
             fuzzpos = 0;
 
-        dest += SCREENWIDTH;
-        dest2 += SCREENWIDTH;
-
-        frac += fracstep;
-    } while (count--);
+        for (i = 0; i < run; i++) {
+            // Lookup framebuffer, and retrieve
+            //  a pixel that is either one column
+            //  left or right of the current one.
+            // Add index from colormap to index.
+            *dest = fuzzmap[dest[delta[i]]];
+            *dest2 = fuzzmap[dest2[delta[i]]];
+            dest += pitch;
+            dest2 += pitch;
+        }
+    }
 }
 
 //
@@ -386,13 +646,18 @@ void R_DrawFuzzColumnLow(void)
 //  of the BaronOfHell, the HellKnight, uses
 //  identical sprites, kinda brightened up.
 //
-byte *dc_translation;
 byte *translationtables;
 
+// Each translation table composed with each colormap, so translated columns
+//  take one lookup per pixel. Each is made when first used.
+static byte **translatedcolormaps;
+static int numcolormaps;
+
 void R_DrawTranslatedColumn(void)
 {
     int count;
     byte *dest;
+    int pitch = rowpitch;
     fixed_t frac;
     fixed_t fracstep;
 
@@ -400,8 +665,12 @@ void R_DrawTranslatedColumn(void)
     if (count < 0)
         return;
 
+    M_CountWork(work_columns, 1);
+    M_CountWork(work_pixels, count + 1);
+
 #ifdef RANGECHECK
-    if ((unsigned)dc_x >= SCREENWIDTH || dc_yl < 0 || dc_yh >= SCREENHEIGHT) {
+    if ((unsigned)dc_x >= (unsigned)SCREENWIDTH || dc_yl < 0
+        || dc_yh >= SCREENHEIGHT) {
         I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
     }
 
@@ -420,8 +689,9 @@ void R_DrawTranslatedColumn(void)
         //  used with PLAY sprites.
         // Thus the "green" ramp of the player 0 sprite
         //  is mapped to gray, red, black/indigo.
-        *dest = dc_colormap[dc_translation[dc_source[frac >> FRACBITS]]];
-        dest += SCREENWIDTH;
+        // dc_colormap has the translation composed into it already.
+        *dest = dc_colormap[dc_source[frac >> FRACBITS]];
+        dest += pitch;
 
         frac += fracstep;
     } while (count--);
@@ -431,6 +701,7 @@ void R_DrawTranslatedColumnLow(void)
 {
     int count;
     byte *dest;
+    int pitch = rowpitch;
     byte *dest2;
     fixed_t frac;
     fixed_t fracstep;
@@ -440,11 +711,15 @@ void R_DrawTranslatedColumnLow(void)
     if (count < 0)
         return;
 
+    M_CountWork(work_columns, 1);
+    M_CountWork(work_pixels, 2 * (count + 1));
+
     // low detail, need to scale by 2
     x = dc_x << 1;
 
 #ifdef RANGECHECK
-    if ((unsigned)x >= SCREENWIDTH || dc_yl < 0 || dc_yh >= SCREENHEIGHT) {
+    if ((unsigned)x >= (unsigned)SCREENWIDTH || dc_yl < 0
+        || dc_yh >= SCREENHEIGHT) {
         I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, x);
     }
 
@@ -464,10 +739,10 @@ void R_DrawTranslatedColumnLow(void)
         //  used with PLAY sprites.
         // Thus the "green" ramp of the player 0 sprite
         //  is mapped to gray, red, black/indigo.
-        *dest = dc_colormap[dc_translation[dc_source[frac >> FRACBITS]]];
-        *dest2 = dc_colormap[dc_translation[dc_source[frac >> FRACBITS]]];
-        dest += SCREENWIDTH;
-        dest2 += SCREENWIDTH;
+        *dest = dc_colormap[dc_source[frac >> FRACBITS]];
+        *dest2 = dc_colormap[dc_source[frac >> FRACBITS]];
+        dest += pitch;
+        dest2 += pitch;
 
         frac += fracstep;
     } while (count--);
@@ -499,6 +774,39 @@ void R_InitTranslationTables(void)
                 translationtables[i + 512] = i;
         }
     }
+
+    numcolormaps = W_LumpLength(W_GetNumForName("COLORMAP")) / 256;
+    translatedcolormaps = Z_Malloc(3 * numcolormaps * sizeof(byte *),
+                                   PU_STATIC, 0);
+    memset(translatedcolormaps, 0, 3 * numcolormaps * sizeof(byte *));
+}
+
+//
+// R_TranslateColormap
+// Returns colormap with translation (one of translationtables) applied
+//  first, for drawing with R_DrawTranslatedColumn.
+//
+lighttable_t *R_TranslateColormap(byte *translation, lighttable_t *colormap)
+{
+    int table = (translation - translationtables) >> 8;
+    int map = (colormap - colormaps) >> 8;
+    byte **cached;
+    int i;
+
+#ifdef RANGECHECK
+    if (table < 0 || table >= 3 || map < 0 || map >= numcolormaps)
+        I_Error("R_TranslateColormap: bad table %i or map %i", table, map);
+#endif
+
+    cached = &translatedcolormaps[table * numcolormaps + map];
+
+    if (!*cached) {
+        *cached = I_Realloc(NULL, 256);
+        for (i = 0; i < 256; i++)
+            (*cached)[i] = colormap[translation[i]];
+    }
+
+    return *cached;
 }
 
 //
@@ -513,19 +821,19 @@ void R_InitTranslationTables(void)
 // In consequence, flats are not stored by column (like walls),
 //  and the inner loop has to step in texture space u and v.
 //
-int ds_y;
-int ds_x1;
-int ds_x2;
+THREAD_LOCAL int ds_y;
+THREAD_LOCAL int ds_x1;
+THREAD_LOCAL int ds_x2;
 
-lighttable_t *ds_colormap;
+THREAD_LOCAL lighttable_t *ds_colormap;
 
-fixed_t ds_xfrac;
-fixed_t ds_yfrac;
-fixed_t ds_xstep;
-fixed_t ds_ystep;
+THREAD_LOCAL fixed_t ds_xfrac;
+THREAD_LOCAL fixed_t ds_yfrac;
+THREAD_LOCAL fixed_t ds_xstep;
+THREAD_LOCAL fixed_t ds_ystep;
 
 // start of a 64*64 tile image
-byte *ds_source;
+THREAD_LOCAL byte *ds_source;
 
 // just for profiling
 int dscount;
@@ -536,13 +844,14 @@ void R_DrawSpan(void)
 {
     unsigned int position, step;
     byte *dest;
+    int pitch = colpitch;
     int count;
     int spot;
     unsigned int xtemp, ytemp;
 
 #ifdef RANGECHECK
     if (ds_x2 < ds_x1 || ds_x1 < 0 || ds_x2 >= SCREENWIDTH
-        || (unsigned)ds_y > SCREENHEIGHT) {
+        || (unsigned)ds_y > (unsigned)SCREENHEIGHT) {
         I_Error("R_DrawSpan: %i to %i at %i", ds_x1, ds_x2, ds_y);
     }
 //      dscount++;
@@ -561,6 +870,9 @@ void R_DrawSpan(void)
     // We do not check for zero spans here?
     count = ds_x2 - ds_x1;
 
+    M_CountWork(work_spans, 1);
+    M_CountWork(work_pixels, count + 1);
+
     do {
         // Calculate current texture index in u,v.
         ytemp = (position >> 4) & 0x0fc0;
@@ -569,13 +881,117 @@ void R_DrawSpan(void)
 
         // Lookup pixel from flat texture tile,
         //  re-index using light/colormap.
-        *dest++ = ds_colormap[ds_source[spot]];
+        *dest = ds_colormap[ds_source[spot]];
+        dest += pitch;
 
         position += step;
 
     } while (count--);
 }
 
+#ifdef I_CPU_X86
+//
+// R_DrawSpanSSE2
+// R_DrawSpan, working out the texture indices of four pixels at once.
+//
+__attribute__((target("sse2"))) static void R_DrawSpanSSE2(void)
+{
+    unsigned int position, step;
+    byte *dest;
+    int pitch = colpitch;
+    int count;
+    int spot;
+    unsigned int xtemp, ytemp;
+
+#ifdef RANGECHECK
+    if (ds_x2 < ds_x1 || ds_x1 < 0 || ds_x2 >= SCREENWIDTH
+        || (unsigned)ds_y > (unsigned)SCREENHEIGHT) {
+        I_Error("R_DrawSpan: %i to %i at %i", ds_x1, ds_x2, ds_y);
+    }
+//      dscount++;
+#endif
+
+    // Pack position and step variables into a single 32-bit integer,
+    // with x in the top 16 bits and y in the bottom 16 bits.  For
+    // each 16-bit part, the top 6 bits are the integer part and the
+    // bottom 10 bits are the fractional part of the pixel position.
+
+    position = ((ds_xfrac << 10) & 0xffff0000) | ((ds_yfrac >> 6) & 0x0000ffff);
+    step = ((ds_xstep << 10) & 0xffff0000) | ((ds_ystep >> 6) & 0x0000ffff);
+
+    dest = ylookup[ds_y] + columnofs[ds_x1];
+
+    // We do not check for zero spans here?
+    count = ds_x2 - ds_x1;
+
+    M_CountWork(work_spans, 1);
+    M_CountWork(work_pixels, count + 1);
+
+    // The lookups stay scalar, as SSE2 has no gather.
+    if (count >= 3) {
+        __m128i positions = _mm_setr_epi32(position, position + step,
+                                           position + 2 * step,
+                                           position + 3 * step);
+        __m128i steps = _mm_set1_epi32(4 * step);
+        __m128i ymask = _mm_set1_epi32(0x0fc0);
+        union {
+            __m128i v;
+            int i[4];
+        } spots;
+
+        do {
+            spots.v = _mm_or_si128(
+                _mm_and_si128(_mm_srli_epi32(positions, 4), ymask),
+                _mm_srli_epi32(positions, 26));
+
+            dest[0] = ds_colormap[ds_source[spots.i[0]]];
+            dest[pitch] = ds_colormap[ds_source[spots.i[1]]];
+            dest[2 * pitch] = ds_colormap[ds_source[spots.i[2]]];
+            dest[3 * pitch] = ds_colormap[ds_source[spots.i[3]]];
+            dest += 4 * pitch;
+
+            positions = _mm_add_epi32(positions, steps);
+            position += 4 * step;
+            count -= 4;
+        } while (count >= 3);
+
+        if (count < 0) {
+            return;
+        }
+    }
+
+    do {
+        // Calculate current texture index in u,v.
+        ytemp = (position >> 4) & 0x0fc0;
+        xtemp = (position >> 26);
+        spot = xtemp | ytemp;
+
+        // Lookup pixel from flat texture tile,
+        //  re-index using light/colormap.
+        *dest = ds_colormap[ds_source[spot]];
+        dest += pitch;
+
+        position += step;
+
+    } while (count--);
+}
+#endif
+
+void (*basespanfunc)(void) = R_DrawSpan;
+
+int R_InstallSpanDrawer(void)
+{
+#ifdef I_CPU_X86
+    if (cpufeatures & CPU_SSE2) {
+        basespanfunc = R_DrawSpanSSE2;
+        return CPU_SSE2;
+    }
+#endif
+
+    basespanfunc = R_DrawSpan;
+    return 0;
+}
+
 // UNUSED.
 // Loop unrolled by 4.
 #if 0
@@ -656,12 +1072,13 @@ void R_DrawSpanLow(void)
     unsigned int position, step;
     unsigned int xtemp, ytemp;
     byte *dest;
+    int pitch = colpitch;
     int count;
     int spot;
 
 #ifdef RANGECHECK
     if (ds_x2 < ds_x1 || ds_x1 < 0 || ds_x2 >= SCREENWIDTH
-        || (unsigned)ds_y > SCREENHEIGHT) {
+        || (unsigned)ds_y > (unsigned)SCREENHEIGHT) {
         I_Error("R_DrawSpan: %i to %i at %i", ds_x1, ds_x2, ds_y);
     }
 //      dscount++;
@@ -672,6 +1089,9 @@ void R_DrawSpanLow(void)
 
     count = (ds_x2 - ds_x1);
 
+    M_CountWork(work_spans, 1);
+    M_CountWork(work_pixels, 2 * (count + 1));
+
     // Blocky mode, need to multiply by 2.
     ds_x1 <<= 1;
     ds_x2 <<= 1;
@@ -686,8 +1106,9 @@ void R_DrawSpanLow(void)
 
         // Lowres/blocky mode does it twice,
         //  while scale is adjusted appropriately.
-        *dest++ = ds_colormap[ds_source[spot]];
-        *dest++ = ds_colormap[ds_source[spot]];
+        dest[0] = ds_colormap[ds_source[spot]];
+        dest[pitch] = ds_colormap[ds_source[spot]];
+        dest += 2 * pitch;
 
         position += step;
 
@@ -710,21 +1131,96 @@ void R_InitBuffer(int width, int height)
     //  with border and/or status bar.
     viewwindowx = (SCREENWIDTH - width) >> 1;
 
-    // Column offset. For windows.
-    for (i = 0; i < width; i++)
-        columnofs[i] = viewwindowx + i;
-
     // Same with base row offset.
     if (width == SCREENWIDTH) {
         viewwindowy = 0;
     } else {
         viewwindowy =
-            (SCREENHEIGHT - (detached_ui ? 0 : ST_HEIGHT) - height) >> 1;
+            (SCREENHEIGHT - (detached_ui ? 0 : ST_HEIGHT << hires) - height)
+            >> 1;
+    }
+
+    if (colmajor_buffer) {
+        rowpitch = 1;
+        colpitch = height;
+
+        for (i = 0; i < width; i++)
+            columnofs[i] = i * height;
+        for (i = 0; i < height; i++)
+            ylookup[i] = colmajor_buffer + i;
+    } else {
+        rowpitch = SCREENWIDTH;
+        colpitch = 1;
+
+        // Column offset. For windows.
+        for (i = 0; i < width; i++)
+            columnofs[i] = viewwindowx + i;
+
+        // Preclaculate all row offsets.
+        for (i = 0; i < height; i++)
+            ylookup[i] = I_VideoBuffer + (i + viewwindowy) * SCREENWIDTH;
     }
 
-    // Preclaculate all row offsets.
-    for (i = 0; i < height; i++)
-        ylookup[i] = I_VideoBuffer + (i + viewwindowy) * SCREENWIDTH;
+    for (i = 0; i < FUZZTABLE; i++)
+        fuzzdelta[i] = fuzzoffset[i] * rowpitch;
+}
+
+//
+// R_InitColumnMajor
+//
+void R_InitColumnMajor(void)
+{
+    //!
+    // @category video
+    //
+    // Draw the view column-major, which is friendlier to the cache when
+    // drawing walls and sprites, then transpose it into the frame buffer.
+    //
+
+    if (M_CheckParm("-colmajor")) {
+        colmajor_buffer = Z_Malloc(SCREENWIDTH * SCREENHEIGHT, PU_STATIC,
+                                   NULL);
+    }
+}
+
+//
+// R_TransposeView
+// Copies a view drawn column-major into the frame buffer.
+// Done in blocks, so neither buffer is walked with a large stride for long.
+//
+#define TRANSPOSE_BLOCK 16
+
+void R_TransposeView(void)
+{
+    int bx, by, x, y, xend, yend;
+    byte *src;
+    byte *dest;
+
+    if (!colmajor_buffer)
+        return;
+
+    for (by = 0; by < viewheight; by += TRANSPOSE_BLOCK) {
+        yend = by + TRANSPOSE_BLOCK;
+        if (yend > viewheight)
+            yend = viewheight;
+
+        for (bx = 0; bx < scaledviewwidth; bx += TRANSPOSE_BLOCK) {
+            xend = bx + TRANSPOSE_BLOCK;
+            if (xend > scaledviewwidth)
+                xend = scaledviewwidth;
+
+            for (y = by; y < yend; y++) {
+                src = colmajor_buffer + bx * viewheight + y;
+                dest = I_VideoBuffer + (y + viewwindowy) * SCREENWIDTH
+                       + viewwindowx + bx;
+
+                for (x = bx; x < xend; x++) {
+                    *dest++ = *src;
+                    src += viewheight;
+                }
+            }
+        }
+    }
 }
 
 //
@@ -740,6 +1236,10 @@ void R_FillBackScreen(void)
     int x;
     int y;
     patch_t *patch;
+    int windowx;
+    int windowy;
+    int windowwidth;
+    int windowheight;
 
     // DOOM border patch.
     const char *name1 = "FLOOR7_2";
@@ -778,56 +1278,59 @@ void R_FillBackScreen(void)
     src = W_CacheLumpName(name, PU_CACHE);
     dest = background_buffer;
 
-    for (y = 0; y < SCREENHEIGHT - (detached_ui ? 0 : ST_HEIGHT); y++) {
-        for (x = 0; x < SCREENWIDTH / 64; x++) {
-            memcpy(dest, src + ((y & 63) << 6), 64);
-            dest += 64;
-        }
+    // Each flat pixel covers 1 << hires by 1 << hires screen pixels.
+    for (y = 0; y < SCREENHEIGHT - (detached_ui ? 0 : ST_HEIGHT << hires);
+         y++) {
+        byte *row = src + (((y >> hires) & 63) << 6);
 
-        if (SCREENWIDTH & 63) {
-            memcpy(dest, src + ((y & 63) << 6), SCREENWIDTH & 63);
-            dest += (SCREENWIDTH & 63);
-        }
+        for (x = 0; x < SCREENWIDTH; x++)
+            *dest++ = row[(x >> hires) & 63];
     }
 
     // Draw screen and bezel; this is done to a separate screen buffer.
+    // Patches are positioned in original resolution coordinates.
 
     V_UseBuffer(background_buffer);
 
+    windowx = viewwindowx >> hires;
+    windowy = viewwindowy >> hires;
+    windowwidth = scaledviewwidth >> hires;
+    windowheight = viewheight >> hires;
+
     patch = W_CacheLumpName("brdr_b", PU_CACHE);
 
-    for (x = 0; x < scaledviewwidth; x += 8)
-        V_DrawPatch(viewwindowx + x, viewwindowy + viewheight, patch);
+    for (x = 0; x < windowwidth; x += 8)
+        V_DrawPatch(windowx + x, windowy + windowheight, patch);
 
-    if (scaledviewwidth != SCREENWIDTH) {
+    if (windowwidth != ORIGWIDTH) {
         patch = W_CacheLumpName("brdr_t", PU_CACHE);
 
-        for (x = 0; x < scaledviewwidth; x += 8)
-            V_DrawPatch(viewwindowx + x, viewwindowy - 8, patch);
+        for (x = 0; x < windowwidth; x += 8)
+            V_DrawPatch(windowx + x, windowy - 8, patch);
 
         patch = W_CacheLumpName("brdr_l", PU_CACHE);
 
-        for (y = 0; y < viewheight; y += 8)
-            V_DrawPatch(viewwindowx - 8, viewwindowy + y, patch);
+        for (y = 0; y < windowheight; y += 8)
+            V_DrawPatch(windowx - 8, windowy + y, patch);
 
         patch = W_CacheLumpName("brdr_r", PU_CACHE);
 
-        for (y = 0; y < viewheight; y += 8)
-            V_DrawPatch(viewwindowx + scaledviewwidth, viewwindowy + y, patch);
+        for (y = 0; y < windowheight; y += 8)
+            V_DrawPatch(windowx + windowwidth, windowy + y, patch);
     }
 
-    if (scaledviewwidth != SCREENWIDTH) {
+    if (windowwidth != ORIGWIDTH) {
         // Draw beveled edge.
-        V_DrawPatch(viewwindowx - 8, viewwindowy - 8,
+        V_DrawPatch(windowx - 8, windowy - 8,
                     W_CacheLumpName("brdr_tl", PU_CACHE));
 
-        V_DrawPatch(viewwindowx + scaledviewwidth, viewwindowy - 8,
+        V_DrawPatch(windowx + windowwidth, windowy - 8,
                     W_CacheLumpName("brdr_tr", PU_CACHE));
 
-        V_DrawPatch(viewwindowx - 8, viewwindowy + viewheight,
+        V_DrawPatch(windowx - 8, windowy + windowheight,
                     W_CacheLumpName("brdr_bl", PU_CACHE));
 
-        V_DrawPatch(viewwindowx + scaledviewwidth, viewwindowy + viewheight,
+        V_DrawPatch(windowx + windowwidth, windowy + windowheight,
                     W_CacheLumpName("brdr_br", PU_CACHE));
     }
 
@@ -872,7 +1375,8 @@ void R_DrawViewBorder(void)
         return;
     }
 
-    top = ((SCREENHEIGHT - (detached_ui ? 0 : ST_HEIGHT)) - viewheight) / 2;
+    top = ((SCREENHEIGHT - (detached_ui ? 0 : ST_HEIGHT << hires)) - viewheight)
+          / 2;
     side = (SCREENWIDTH - scaledviewwidth) / 2;
 
     // copy top and one line of left side
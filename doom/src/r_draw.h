@@ -19,6 +19,7 @@
 #ifndef __R_DRAW__
 #define __R_DRAW__
 
+#include "i_thread.h"
 #include "r_defs.h"
 
 extern lighttable_t *dc_colormap;
@@ -30,6 +31,7 @@ extern fixed_t dc_texturemid;
 
 // first pixel in a column
 extern byte *dc_source;
+extern int dc_texheight;
 
 // The span blitting interface.
 // Hook in assembler or system specific BLT
@@ -37,6 +39,13 @@ extern byte *dc_source;
 void R_DrawColumn(void);
 void R_DrawColumnLow(void);
 
+// Wall columns can be queued up to be drawn several at a time; each queue
+//  batches adjacent columns of one tier of a wall.
+#define NUMCOLQUEUES 2
+
+void R_DrawColumnQueued(int queue);
+void R_FlushColumnQueues(void);
+
 // The Spectre/Invisibility effect.
 void R_DrawFuzzColumn(void);
 void R_DrawFuzzColumnLow(void);
@@ -49,35 +58,54 @@ void R_DrawTranslatedColumnLow(void);
 
 void R_VideoErase(unsigned ofs, int count);
 
-extern int ds_y;
-extern int ds_x1;
-extern int ds_x2;
+// Spans of different planes may be drawn by different workers at once.
+extern THREAD_LOCAL int ds_y;
+extern THREAD_LOCAL int ds_x1;
+extern THREAD_LOCAL int ds_x2;
 
-extern lighttable_t *ds_colormap;
+extern THREAD_LOCAL lighttable_t *ds_colormap;
 
-extern fixed_t ds_xfrac;
-extern fixed_t ds_yfrac;
-extern fixed_t ds_xstep;
-extern fixed_t ds_ystep;
+extern THREAD_LOCAL fixed_t ds_xfrac;
+extern THREAD_LOCAL fixed_t ds_yfrac;
+extern THREAD_LOCAL fixed_t ds_xstep;
+extern THREAD_LOCAL fixed_t ds_ystep;
 
 // start of a 64*64 tile image
-extern byte *ds_source;
+extern THREAD_LOCAL byte *ds_source;
 
 extern byte *translationtables;
-extern byte *dc_translation;
 
 // Span blitting for rows, floor/ceiling.
 // No Sepctre effect needed.
 void R_DrawSpan(void);
 
+// R_DrawSpan or a SIMD variant of it, installed by R_InstallSpanDrawer.
+extern void (*basespanfunc)(void);
+
+// Install the variant of R_DrawSpan for cpufeatures, returning the CPU_*
+// feature it uses, or 0.
+int R_InstallSpanDrawer(void);
+
 // Low resolution mode, 160x200?
 void R_DrawSpanLow(void);
 
 void R_InitBuffer(int width, int height);
 
+// Distance between vertically and horizontally adjacent pixels of the view.
+extern int rowpitch;
+extern int colpitch;
+
+// Start of each row of the view, and offset of each of its columns.
+extern byte *ylookup[MAXHEIGHT];
+extern int columnofs[MAXWIDTH];
+
+void R_InitColumnMajor(void);
+void R_TransposeView(void);
+
 // Initialize color translation tables,
 //  for player rendering etc.
 void R_InitTranslationTables(void);
+lighttable_t *R_TranslateColormap(byte *translation, lighttable_t *colormap);
 
 // Rendering function.
 void R_FillBackScreen(void);
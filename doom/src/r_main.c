@@ -20,10 +20,14 @@
 
 #include <stdlib.h>
 
+#include "d_bench.h"
 #include "d_loop.h"
 #include "d_player.h"
+#include "i_thread.h"
+#include "m_argv.h"
 #include "m_bbox.h"
 #include "m_menu.h"
+#include "m_profile.h"
 #include "r_bsp.h"
 #include "r_data.h"
 #include "r_defs.h"
@@ -33,7 +37,9 @@
 #include "r_sky.h"
 #include "r_state.h"
 #include "r_things.h"
+#include "r_view.h"
 #include "st_stuff.h"
+#include "w_wad.h"
 
 // Fineangles in the SCREENWIDTH wide window.
 #define FIELDOFVIEW 2048
@@ -69,7 +75,12 @@ angle_t viewangle;
 fixed_t viewcos;
 fixed_t viewsin;
 
-player_t *viewplayer;
+fixed_t fractionaltic = FRACUNIT;
+
+boolean viewthread;
+
+// A view was started by R_StartPlayerView and not yet finished.
+static boolean viewstarted;
 
 // 0 = high, 1 = low
 int detailshift;
@@ -88,7 +99,7 @@ int viewangletox[FINEANGLES / 2];
 // The xtoviewangleangle[] table maps a screen pixel
 // to the lowest viewangle that maps back to x ranges
 // from clipangle to -clipangle.
-angle_t xtoviewangle[SCREENWIDTH + 1];
+angle_t xtoviewangle[MAXWIDTH + 1];
 
 lighttable_t *scalelight[LIGHTLEVELS][MAXLIGHTSCALE];
 lighttable_t *scalelightfixed[MAXLIGHTSCALE];
@@ -103,6 +114,9 @@ void (*fuzzcolfunc)(void);
 void (*transcolfunc)(void);
 void (*spanfunc)(void);
 
+poolusage_t maxpoolusage;
+poolusage_t lastpoolusage;
+
 //
 // R_AddPointToBox
 // Expand a given bbox
@@ -169,7 +183,7 @@ int R_PointOnSide(fixed_t x, fixed_t y, node_t *node)
     return 1;
 }
 
-int R_PointOnSegSide(fixed_t x, fixed_t y, seg_t *line)
+int R_PointOnSegSide(fixed_t x, fixed_t y, rseg_t *line)
 {
     fixed_t lx;
     fixed_t ly;
@@ -180,11 +194,11 @@ int R_PointOnSegSide(fixed_t x, fixed_t y, seg_t *line)
     fixed_t left;
     fixed_t right;
 
-    lx = line->v1->x;
-    ly = line->v1->y;
+    lx = line->v1.x;
+    ly = line->v1.y;
 
-    ldx = line->v2->x - lx;
-    ldy = line->v2->y - ly;
+    ldx = line->v2.x - lx;
+    ldy = line->v2.y - ly;
 
     if (!ldx) {
         if (x <= lx)
@@ -222,6 +236,73 @@ int R_PointOnSegSide(fixed_t x, fixed_t y, seg_t *line)
     return 1;
 }
 
+// Build with RECIPROCAL_SLOPES defined to have the renderer divide its slopes
+//  by multiplying with reciprocals, for CPUs whose dividers are slow; where
+//  division is quick (most desktop x86) it's slower than dividing outright.
+#ifdef RECIPROCAL_SLOPES
+
+//
+// R_DivSmall
+// Returns num / den rounded down, as dividing would, for quotients of no more
+//  than a few thousand: the reciprocal of den's top bits, from
+//  slopereciprocals, gives a quotient within a few of the answer, which is
+//  then corrected.
+//
+#define RECIPBITS 12
+
+// 2^32 / i, for each i with RECIPBITS bits.
+static uint32_t slopereciprocals[1 << (RECIPBITS - 1)];
+
+static unsigned R_DivSmall(uint64_t num, uint32_t den)
+{
+    int top;
+    uint64_t q;
+    int64_t rem;
+
+    top = 31 - __builtin_clz(den);
+    q = num
+        * slopereciprocals[((uint64_t)den << (RECIPBITS - 1) >> top)
+                           - (1 << (RECIPBITS - 1))]
+        >> (32 - (RECIPBITS - 1) + top);
+
+    rem = (int64_t)(num - q * den);
+    while (rem < 0) {
+        q--;
+        rem += den;
+    }
+    while (rem >= den) {
+        q++;
+        rem -= den;
+    }
+
+    return q;
+}
+
+//
+// R_SlopeDiv
+// SlopeDiv, with the same results, but by way of R_DivSmall.
+//
+static int R_SlopeDiv(unsigned int num, unsigned int den)
+{
+    unsigned ans;
+
+    if (den < 512)
+        return SLOPERANGE;
+
+    // Only coordinates that overflowed give num > den; their quotients can be
+    // too large to correct quickly.
+    if (num > den)
+        return SlopeDiv(num, den);
+
+    // The quotient is at most 8 * 256 * 2.
+    ans = R_DivSmall(num << 3, den >> 8);
+    return ans <= SLOPERANGE ? ans : SLOPERANGE;
+}
+
+#else
+#define R_SlopeDiv SlopeDiv
+#endif
+
 //
 // R_PointToAngle
 // To get a global angle from cartesian coordinates,
@@ -230,14 +311,17 @@ int R_PointOnSegSide(fixed_t x, fixed_t y, seg_t *line)
 //  the y (<=x) is scaled and divided by x to get a
 //  tangent (slope) value which is looked up in the
 //  tantoangle[] table.
-
+// The renderer's many calls divide with R_SlopeDiv; the playsim's, through
+//  R_PointToAngle2, keep vanilla's SlopeDiv, as demos depend on them.
 //
-
-angle_t R_PointToAngle(fixed_t x, fixed_t y)
+static inline int R_OctantSlope(unsigned int num, unsigned int den,
+                                boolean exact)
 {
-    x -= viewx;
-    y -= viewy;
+    return exact ? SlopeDiv(num, den) : R_SlopeDiv(num, den);
+}
 
+static inline angle_t R_PointToAngleWith(fixed_t x, fixed_t y, boolean exact)
+{
     if ((!x) && (!y))
         return 0;
 
@@ -248,10 +332,10 @@ angle_t R_PointToAngle(fixed_t x, fixed_t y)
 
             if (x > y) {
                 // octant 0
-                return tantoangle[SlopeDiv(y, x)];
+                return tantoangle[R_OctantSlope(y, x, exact)];
             } else {
                 // octant 1
-                return ANG90 - 1 - tantoangle[SlopeDiv(x, y)];
+                return ANG90 - 1 - tantoangle[R_OctantSlope(x, y, exact)];
             }
         } else {
             // y<0
@@ -259,10 +343,10 @@ angle_t R_PointToAngle(fixed_t x, fixed_t y)
 
             if (x > y) {
                 // octant 8
-                return -tantoangle[SlopeDiv(y, x)];
+                return -tantoangle[R_OctantSlope(y, x, exact)];
             } else {
                 // octant 7
-                return ANG270 + tantoangle[SlopeDiv(x, y)];
+                return ANG270 + tantoangle[R_OctantSlope(x, y, exact)];
             }
         }
     } else {
@@ -273,10 +357,10 @@ angle_t R_PointToAngle(fixed_t x, fixed_t y)
             // y>= 0
             if (x > y) {
                 // octant 3
-                return ANG180 - 1 - tantoangle[SlopeDiv(y, x)];
+                return ANG180 - 1 - tantoangle[R_OctantSlope(y, x, exact)];
             } else {
                 // octant 2
-                return ANG90 + tantoangle[SlopeDiv(x, y)];
+                return ANG90 + tantoangle[R_OctantSlope(x, y, exact)];
             }
         } else {
             // y<0
@@ -284,22 +368,25 @@ angle_t R_PointToAngle(fixed_t x, fixed_t y)
 
             if (x > y) {
                 // octant 4
-                return ANG180 + tantoangle[SlopeDiv(y, x)];
+                return ANG180 + tantoangle[R_OctantSlope(y, x, exact)];
             } else {
                 // octant 5
-                return ANG270 - 1 - tantoangle[SlopeDiv(x, y)];
+                return ANG270 - 1 - tantoangle[R_OctantSlope(x, y, exact)];
             }
         }
     }
     return 0;
 }
 
-angle_t R_PointToAngle2(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2)
+angle_t R_PointToAngle(fixed_t x, fixed_t y)
 {
-    viewx = x1;
-    viewy = y1;
+    return R_PointToAngleWith(x - viewx, y - viewy, false);
+}
 
-    return R_PointToAngle(x2, y2);
+// Leaves viewx and viewy alone, unlike vanilla; the view may be being drawn.
+angle_t R_PointToAngle2(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2)
+{
+    return R_PointToAngleWith(x2 - x1, y2 - y1, true);
 }
 
 fixed_t R_PointToDist(fixed_t x, fixed_t y)
@@ -322,6 +409,12 @@ fixed_t R_PointToDist(fixed_t x, fixed_t y)
 
     // Fix crashes in udm1.wad
 
+#ifdef RECIPROCAL_SLOPES
+    if (dx > 0 && dy >= 0) {
+        // FixedDiv(dy, dx) >> DBITS, as dy <= dx.
+        frac = R_DivSmall((uint64_t)dy << SLOPEBITS, dx) << DBITS;
+    } else
+#endif
     if (dx != 0) {
         frac = FixedDiv(dy, dx);
     } else {
@@ -341,6 +434,13 @@ fixed_t R_PointToDist(fixed_t x, fixed_t y)
 //
 void R_InitPointToAngle(void)
 {
+#ifdef RECIPROCAL_SLOPES
+    int i;
+
+    for (i = 0; i < 1 << (RECIPBITS - 1); i++)
+        slopereciprocals[i] = (1ull << 32) / (i + (1 << (RECIPBITS - 1)));
+#endif
+
     // UNUSED - now getting from tables.c
 #if 0
     int i;
@@ -401,15 +501,16 @@ fixed_t R_ScaleFromGlobalAngle(angle_t visangle)
     num = FixedMul(projection, sineb) << detailshift;
     den = FixedMul(rw_distance, sinea);
 
+    // Walls as close with hires are just as many times taller.
     if (den > num >> 16) {
         scale = FixedDiv(num, den);
 
-        if (scale > 64 * FRACUNIT)
-            scale = 64 * FRACUNIT;
+        if (scale > (64 * FRACUNIT) << hires)
+            scale = (64 * FRACUNIT) << hires;
         else if (scale < 256)
             scale = 256;
     } else
-        scale = 64 * FRACUNIT;
+        scale = (64 * FRACUNIT) << hires;
 
     return scale;
 }
@@ -485,8 +586,10 @@ void R_InitTextureMapping(void)
     // Scan viewangletox[] to generate xtoviewangle[]:
     //  xtoviewangle will give the smallest view angle
     //  that maps to x.
+    // viewangletox never increases, so the scan for each x carries on from
+    //  where the last one stopped.
+    i = 0;
     for (x = 0; x <= viewwidth; x++) {
-        i = 0;
         while (viewangletox[i] > x)
             i++;
         xtoviewangle[x] = (i << ANGLETOFINESHIFT) - ANG90;
@@ -527,7 +630,7 @@ void R_InitLightTables(void)
         startmap = ((LIGHTLEVELS - 1 - i) * 2) * NUMCOLORMAPS / LIGHTLEVELS;
         for (j = 0; j < MAXLIGHTZ; j++) {
             scale =
-                FixedDiv((SCREENWIDTH / 2 * FRACUNIT), (j + 1) << LIGHTZSHIFT);
+                FixedDiv((ORIGWIDTH / 2 * FRACUNIT), (j + 1) << LIGHTZSHIFT);
             scale >>= LIGHTSCALESHIFT;
             level = startmap - scale / DISTMAP;
 
@@ -551,6 +654,7 @@ void R_InitLightTables(void)
 boolean setsizeneeded;
 int setblocks;
 int setdetail;
+static int forcelowdetail;
 
 void R_SetViewSize(int blocks, int detail)
 {
@@ -559,6 +663,22 @@ void R_SetViewSize(int blocks, int detail)
     setdetail = detail;
 }
 
+//
+// R_SetForceLowDetail
+// Draw in low detail whatever the detail level, for when frames are shown
+// too small for high detail to make a difference, or are taking too long to
+// draw. Each reason is set and cleared on its own.
+//
+void R_SetForceLowDetail(lowdetailreason_t reason, boolean force)
+{
+    int reasons = force ? forcelowdetail | reason : forcelowdetail & ~reason;
+
+    if (reasons != forcelowdetail) {
+        forcelowdetail = reasons;
+        setsizeneeded = true;
+    }
+}
+
 //
 // R_ExecuteSetViewSize
 //
@@ -577,11 +697,12 @@ void R_ExecuteSetViewSize(void)
         scaledviewwidth = SCREENWIDTH;
         viewheight = SCREENHEIGHT;
     } else {
-        scaledviewwidth = setblocks * 32;
-        viewheight = (setblocks * (SCREENHEIGHT - ST_HEIGHT) / 10) & ~7;
+        scaledviewwidth = (setblocks * 32) << hires;
+        viewheight = ((setblocks * (ORIGHEIGHT - ST_HEIGHT) / 10) & ~7)
+                     << hires;
     }
 
-    detailshift = setdetail;
+    detailshift = setdetail || forcelowdetail != 0;
     viewwidth = scaledviewwidth >> detailshift;
 
     centery = viewheight / 2;
@@ -594,7 +715,7 @@ void R_ExecuteSetViewSize(void)
         colfunc = basecolfunc = R_DrawColumn;
         fuzzcolfunc = R_DrawFuzzColumn;
         transcolfunc = R_DrawTranslatedColumn;
-        spanfunc = R_DrawSpan;
+        spanfunc = basespanfunc;
     } else {
         colfunc = basecolfunc = R_DrawColumnLow;
         fuzzcolfunc = R_DrawFuzzColumnLow;
@@ -607,8 +728,8 @@ void R_ExecuteSetViewSize(void)
     R_InitTextureMapping();
 
     // psprite scales
-    pspritescale = FRACUNIT * viewwidth / SCREENWIDTH;
-    pspriteiscale = FRACUNIT * SCREENWIDTH / viewwidth;
+    pspritescale = FRACUNIT * viewwidth / ORIGWIDTH;
+    pspriteiscale = FRACUNIT * ORIGWIDTH / viewwidth;
 
     // thing clipping
     for (i = 0; i < viewwidth; i++)
@@ -660,6 +781,7 @@ void R_Init(void)
     printf(".");
 
     R_SetViewSize(screenblocks, detailLevel);
+    R_InitColumnMajor();
     R_InitPlanes();
     printf(".");
     R_InitLightTables();
@@ -669,6 +791,21 @@ void R_Init(void)
     printf(".");
 
     framecount = 0;
+
+    //!
+    // @category video
+    //
+    // Draw the view on a thread of its own while the next tics run, from a
+    // snapshot of the level taken at the end of each frame, so it's shown a
+    // frame behind the status bar and menus. Only if every WAD is
+    // memory-mapped.
+    //
+
+    if (M_CheckParm("-viewthread")) {
+        viewthread = W_AllMapped();
+        if (!viewthread)
+            printf("\nR_Init: -viewthread ignored; not all WADs are mapped");
+    }
 }
 
 //
@@ -695,47 +832,67 @@ subsector_t *R_PointInSubsector(fixed_t x, fixed_t y)
     return &subsectors[nodenum & ~NF_SUBSECTOR];
 }
 
+//
+// R_Interpolate
+//
+fixed_t R_Interpolate(fixed_t old, fixed_t cur)
+{
+    return old + FixedMul(cur - old, fractionaltic);
+}
+
+//
+// R_InterpolateAngle
+// Turns whichever way round is shorter.
+//
+angle_t R_InterpolateAngle(angle_t old, angle_t cur)
+{
+    return old + FixedMul((int)(cur - old), fractionaltic);
+}
+
 //
 // R_SetupFrame
 //
-void R_SetupFrame(player_t *player)
+void R_SetupFrame(void)
 {
     int i;
 
-    viewplayer = player;
-    viewx = player->mo->x;
-    viewy = player->mo->y;
-    viewangle = player->mo->angle + viewangleoffset;
-    extralight = player->extralight;
-
-    viewz = player->viewz;
+    viewx = rview.x;
+    viewy = rview.y;
+    viewz = rview.z;
+    viewangle = rview.angle;
+    extralight = rview.extralight;
 
     viewsin = finesine[viewangle >> ANGLETOFINESHIFT];
     viewcos = finecosine[viewangle >> ANGLETOFINESHIFT];
 
     sscount = 0;
 
-    if (player->fixedcolormap) {
+    if (rview.fixedcolormap) {
         fixedcolormap =
-            colormaps + player->fixedcolormap * 256 * sizeof(lighttable_t);
+            colormaps + rview.fixedcolormap * 256 * sizeof(lighttable_t);
 
         walllights = scalelightfixed;
 
-        for (i = 0; i < MAXLIGHTSCALE; i++)
-            scalelightfixed[i] = fixedcolormap;
+        // Only refill the table when the colormap changes.
+        if (scalelightfixed[0] != fixedcolormap) {
+            for (i = 0; i < MAXLIGHTSCALE; i++)
+                scalelightfixed[i] = fixedcolormap;
+        }
     } else
         fixedcolormap = 0;
 
     framecount++;
-    validcount++;
 }
 
 //
 // R_RenderView
+// Draws the view from the snapshot R_PublishView took.
 //
-void R_RenderPlayerView(player_t *player)
+static void R_RenderView(void)
 {
-    R_SetupFrame(player);
+    M_ProfileBegin(prof_renderplayerview);
+
+    R_SetupFrame();
 
     // Clear buffers.
     R_ClearClipSegs();
@@ -743,22 +900,104 @@ void R_RenderPlayerView(player_t *player)
     R_ClearPlanes();
     R_ClearSprites();
 
-    // check for new console commands.
-    NetUpdate();
+    // check for new console commands, unless the main thread's free to
+    if (!viewthread)
+        NetUpdate();
 
     // The head node is the last node output.
+    D_BenchBegin(bench_bsp);
     R_RenderBSPNode(numnodes - 1);
+    D_BenchEnd(bench_bsp);
 
     // Check for new console commands.
-    NetUpdate();
+    if (!viewthread)
+        NetUpdate();
 
+    D_BenchBegin(bench_planes);
+    M_ProfileBegin(prof_drawplanes);
     R_DrawPlanes();
+    M_ProfileEnd(prof_drawplanes);
+    D_BenchEnd(bench_planes);
 
     // Check for new console commands.
-    NetUpdate();
+    if (!viewthread)
+        NetUpdate();
 
+    D_BenchBegin(bench_masked);
+    M_ProfileBegin(prof_drawmasked);
     R_DrawMasked();
+    M_ProfileEnd(prof_drawmasked);
+    D_BenchEnd(bench_masked);
+
+    R_TransposeView();
 
     // Check for new console commands.
-    NetUpdate();
+    if (!viewthread)
+        NetUpdate();
+
+    M_ProfileEnd(prof_renderplayerview);
+}
+
+static void R_RenderViewJob(void *data)
+{
+    (void)data;
+    R_RenderView();
+}
+
+//
+// R_EndView
+// On the main thread, once a view is drawn.
+//
+static void R_EndView(void)
+{
+    lastpoolusage.visplanes = lastvisplane - visplanes;
+    lastpoolusage.drawsegs = ds_p - drawsegs;
+    lastpoolusage.vissprites = vissprite_p - vissprites;
+    lastpoolusage.openings = openingcount;
+
+    if (lastpoolusage.visplanes > maxpoolusage.visplanes)
+        maxpoolusage.visplanes = lastpoolusage.visplanes;
+    if (lastpoolusage.drawsegs > maxpoolusage.drawsegs)
+        maxpoolusage.drawsegs = lastpoolusage.drawsegs;
+    if (lastpoolusage.vissprites > maxpoolusage.vissprites)
+        maxpoolusage.vissprites = lastpoolusage.vissprites;
+    if (lastpoolusage.openings > maxpoolusage.openings)
+        maxpoolusage.openings = lastpoolusage.openings;
+
+    R_MarkMappedLines();
+    R_UnpinFrameLumps();
+}
+
+void R_RenderPlayerView(player_t *player)
+{
+    if (viewthread) {
+        R_StartPlayerView(player);
+        R_FinishPlayerView();
+        return;
+    }
+
+    R_PublishView(player);
+    R_RenderView();
+    R_EndView();
+}
+
+void R_StartPlayerView(player_t *player)
+{
+    R_FinishPlayerView();
+    R_PublishView(player);
+
+    I_StartBackground(R_RenderViewJob, NULL);
+    viewstarted = true;
+}
+
+boolean R_FinishPlayerView(void)
+{
+    if (!viewstarted)
+        return false;
+
+    I_WaitBackground();
+    viewstarted = false;
+    R_EndView();
+
+    return true;
 }
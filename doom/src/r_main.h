@@ -40,6 +40,10 @@ extern fixed_t projection;
 
 extern int validcount;
 
+// How far through the tic the frame is drawn, FRACUNIT to draw everything
+// where it is.
+extern fixed_t fractionaltic;
+
 extern int linecount;
 extern int loopcount;
 
@@ -55,6 +59,7 @@ extern int loopcount;
 #define LIGHTSEGSHIFT 4
 
 #define MAXLIGHTSCALE 48
+// Scales are 1 << hires times larger with hires, so are shifted by that too.
 #define LIGHTSCALESHIFT 12
 #define MAXLIGHTZ 128
 #define LIGHTZSHIFT 20
@@ -92,7 +97,7 @@ extern void (*spanfunc)(void);
 // Utility functions.
 int R_PointOnSide(fixed_t x, fixed_t y, node_t *node);
 
-int R_PointOnSegSide(fixed_t x, fixed_t y, seg_t *line);
+int R_PointOnSegSide(fixed_t x, fixed_t y, rseg_t *line);
 
 angle_t R_PointToAngle(fixed_t x, fixed_t y);
 
@@ -106,6 +111,10 @@ subsector_t *R_PointInSubsector(fixed_t x, fixed_t y);
 
 void R_AddPointToBox(int x, int y, fixed_t *box);
 
+// Part way from old to cur, by fractionaltic.
+fixed_t R_Interpolate(fixed_t old, fixed_t cur);
+angle_t R_InterpolateAngle(angle_t old, angle_t cur);
+
 //
 // REFRESH - the actual rendering functions.
 //
@@ -113,10 +122,44 @@ void R_AddPointToBox(int x, int y, fixed_t *box);
 // Called by G_Drawer.
 void R_RenderPlayerView(player_t *player);
 
+// Set by -viewthread: views are drawn on a thread of their own, started by
+// R_StartPlayerView and left to draw while the main thread runs the next
+// tics. R_RenderPlayerView still draws one and waits for it.
+extern boolean viewthread;
+
+void R_StartPlayerView(player_t *player);
+
+// Wait for the view R_StartPlayerView started, if it hasn't been waited for,
+// returning whether there was one. Needed before anything it draws from
+// outside the snapshot or into changes: the level's arrays, the view size,
+// the frame buffer.
+boolean R_FinishPlayerView(void);
+
+// Most of each of the renderer's pools used by a single frame, for sizing
+// them; reset by whoever reads them.
+typedef struct {
+    int visplanes;
+    int drawsegs;
+    int vissprites;
+    int openings;
+} poolusage_t;
+
+extern poolusage_t maxpoolusage;
+// Those used by the last view drawn.
+extern poolusage_t lastpoolusage;
+
 // Called by startup code.
 void R_Init(void);
 
 // Called by M_Responder.
 void R_SetViewSize(int blocks, int detail);
 
+// Why low detail is being forced; see R_SetForceLowDetail.
+typedef enum {
+    lowdetail_cells = 1,   // Frames shown as a cell grid too narrow for it.
+    lowdetail_quality = 2, // The quality controller is saving time.
+} lowdetailreason_t;
+
+void R_SetForceLowDetail(lowdetailreason_t reason, boolean force);
+
 #endif
@@ -24,6 +24,8 @@
 #include "doomdef.h"
 #include "doomstat.h"
 #include "i_system.h"
+#include "i_thread.h"
+#include "m_counts.h"
 #include "r_bsp.h"
 #include "r_data.h"
 #include "r_draw.h"
@@ -43,47 +45,100 @@ planefunction_t ceilingfunc;
 //
 
 // Here comes the obnoxious "visplane".
+// The pool starts with the vanilla limit and doubles whenever it's full.
 #define MAXVISPLANES 128
-visplane_t visplanes[MAXVISPLANES];
+visplane_t *visplanes;
 visplane_t *lastvisplane;
 visplane_t *floorplane;
 visplane_t *ceilingplane;
-
-// ?
-#define MAXOPENINGS SCREENWIDTH * 64
-short openings[MAXOPENINGS];
-short *lastopening;
+static int numvisplanes;
+
+// Chains of the visplanes made by R_FindPlane, by hash of what it matches on.
+//  Planes split off by R_CheckPlane needn't be in here, as the one they were
+//  split from, which R_FindPlane would find first, has a lower index.
+#define VISPLANEHASHSIZE 128
+#define VISPLANEHASH(height, picnum, lightlevel)      \
+    (((unsigned)(picnum) * 3 + (unsigned)(lightlevel) \
+      + (unsigned)((height) >> FRACBITS) * 7)         \
+     & (VISPLANEHASHSIZE - 1))
+
+static int visplanehash[VISPLANEHASHSIZE];
+
+// Openings are handed out from a list of blocks, each twice the size of the
+//  last, rather than one growable array, as drawsegs keep pointers into them.
+//  The blocks are kept between frames.
+#define MAXOPENINGS (SCREENWIDTH * 64)
+
+typedef struct openingblock_s {
+    struct openingblock_s *next;
+    int size;
+    short openings[];
+} openingblock_t;
+
+static openingblock_t *openingblocks;
+static openingblock_t *curopeningblock;
+static int curopeningused;
+int openingcount;
 
 //
 // Clip values are the solid pixel bounding the range.
 //  floorclip starts out SCREENHEIGHT
 //  ceilingclip starts out -1
 //
-short floorclip[SCREENWIDTH];
-short ceilingclip[SCREENWIDTH];
+short floorclip[MAXWIDTH];
+short ceilingclip[MAXWIDTH];
 
 //
 // spanstart holds the start of a plane span
 // initialized to 0 at start
 //
-int spanstart[SCREENHEIGHT];
-int spanstop[SCREENHEIGHT];
+// Like the rest of the texture mapping state below, each worker drawing planes
+// keeps its own.
+//
+THREAD_LOCAL int spanstart[MAXHEIGHT];
+THREAD_LOCAL int spanstop[MAXHEIGHT];
 
 //
 // texture mapping
 //
-lighttable_t **planezlight;
-fixed_t planeheight;
+THREAD_LOCAL lighttable_t **planezlight;
+THREAD_LOCAL fixed_t planeheight;
 
-fixed_t yslope[SCREENHEIGHT];
-fixed_t distscale[SCREENWIDTH];
+fixed_t yslope[MAXHEIGHT];
+fixed_t distscale[MAXWIDTH];
 fixed_t basexscale;
 fixed_t baseyscale;
 
-fixed_t cachedheight[SCREENHEIGHT];
-fixed_t cacheddistance[SCREENHEIGHT];
-fixed_t cachedxstep[SCREENHEIGHT];
-fixed_t cachedystep[SCREENHEIGHT];
+THREAD_LOCAL fixed_t cachedheight[MAXHEIGHT];
+THREAD_LOCAL fixed_t cacheddistance[MAXHEIGHT];
+THREAD_LOCAL fixed_t cachedxstep[MAXHEIGHT];
+THREAD_LOCAL fixed_t cachedystep[MAXHEIGHT];
+
+// Flats of each visplane, cached before the workers start drawing, as the zone
+// memory allocator isn't thread-safe.
+static byte **planesources;
+
+// The visible flat planes, sorted so the planes sharing a flat are drawn
+// together while it's in cache, and those also sharing a height reuse the
+// distances R_MapPlane cached for each row.
+static visplane_t **sortedplanes;
+static int sortedplanecount;
+
+// Bumped each time the planes are drawn, so each worker knows to clear its
+// cached rows before its first plane.
+static unsigned int planeframe;
+
+// Columns of the sky as R_DrawColumn would draw them down the whole view, so
+//  drawing the sky is a copy. Each is made when first drawn, and all are
+//  remade whenever the sky texture or the view's scale changes.
+static byte *skycolumns;
+static boolean *skycolumnsvalid;
+static int skycolumnsize;
+static int skycachetexture = -1;
+static int skycacheheight;
+static int skycachecentery;
+static fixed_t skycacheiscale;
+static fixed_t skycachetexturemid;
 
 //
 // R_InitPlanes
@@ -171,10 +226,11 @@ void R_ClearPlanes(void)
     }
 
     lastvisplane = visplanes;
-    lastopening = openings;
+    memset(visplanehash, 0xff, sizeof(visplanehash));
 
-    // texture calculation
-    memset(cachedheight, 0, sizeof(cachedheight));
+    curopeningblock = openingblocks;
+    curopeningused = 0;
+    openingcount = 0;
 
     // left to right mapping
     angle = (viewangle - ANG90) >> ANGLETOFINESHIFT;
@@ -184,32 +240,121 @@ void R_ClearPlanes(void)
     baseyscale = -FixedDiv(finesine[angle], centerxfrac);
 }
 
+//
+// R_NewOpenings
+// Returns room for count openings, valid until the next R_ClearPlanes.
+//
+short *R_NewOpenings(int count)
+{
+    openingblock_t *block = curopeningblock;
+    short *openings;
+
+    if (!block || block->size - curopeningused < count) {
+        if (block && block->next) {
+            block = block->next;
+        } else {
+            int size = block ? 2 * block->size : MAXOPENINGS;
+            openingblock_t *newblock;
+
+            if (size < count)
+                size = count;
+
+            newblock = I_Realloc(
+                NULL, sizeof(*newblock) + size * sizeof(*newblock->openings));
+            newblock->next = NULL;
+            newblock->size = size;
+
+            if (block)
+                block->next = newblock;
+            else
+                openingblocks = newblock;
+            block = newblock;
+        }
+
+        curopeningblock = block;
+        curopeningused = 0;
+    }
+
+    openings = block->openings + curopeningused;
+    curopeningused += count;
+    openingcount += count;
+    return openings;
+}
+
+//
+// R_NewVisplane
+// Returns the next free visplane, doubling the pool if it's full. As the pool
+//  may move, floorplane, ceilingplane and *pl are rebased to it.
+//
+static visplane_t *R_NewVisplane(visplane_t **pl)
+{
+    int used = lastvisplane - visplanes;
+    int floorindex = floorplane ? floorplane - visplanes : -1;
+    int ceilingindex = ceilingplane ? ceilingplane - visplanes : -1;
+    int plindex = pl ? *pl - visplanes : -1;
+    int oldnum = numvisplanes;
+    unsigned short *clips;
+    size_t clipslen;
+    int i;
+
+    M_CountWork(work_visplanes, 1);
+
+    if (used < numvisplanes)
+        return lastvisplane++;
+
+    numvisplanes = oldnum ? 2 * oldnum : MAXVISPLANES;
+    visplanes = I_Realloc(visplanes, numvisplanes * sizeof(*visplanes));
+    planesources =
+        I_Realloc(planesources, numvisplanes * sizeof(*planesources));
+
+    // Each new plane's top and bottom, with pads for [minx-1]/[maxx+1].
+    clipslen = (numvisplanes - oldnum) * 2 * (SCREENWIDTH + 2) * sizeof(*clips);
+    clips = I_Realloc(NULL, clipslen);
+    memset(clips, 0, clipslen);
+
+    for (i = oldnum; i < numvisplanes; i++) {
+        visplanes[i].top = clips + 1;
+        clips += SCREENWIDTH + 2;
+        visplanes[i].bottom = clips + 1;
+        clips += SCREENWIDTH + 2;
+    }
+
+    lastvisplane = visplanes + used;
+    floorplane = floorindex >= 0 ? visplanes + floorindex : NULL;
+    ceilingplane = ceilingindex >= 0 ? visplanes + ceilingindex : NULL;
+    if (pl)
+        *pl = visplanes + plindex;
+
+    return lastvisplane++;
+}
+
 //
 // R_FindPlane
 //
 visplane_t *R_FindPlane(fixed_t height, int picnum, int lightlevel)
 {
     visplane_t *check;
+    unsigned hash;
+    int i;
 
     if (picnum == skyflatnum) {
         height = 0; // all skys map together
         lightlevel = 0;
     }
 
-    for (check = visplanes; check < lastvisplane; check++) {
+    hash = VISPLANEHASH(height, picnum, lightlevel);
+
+    for (i = visplanehash[hash]; i != -1; i = check->hashnext) {
+        check = &visplanes[i];
         if (height == check->height && picnum == check->picnum
             && lightlevel == check->lightlevel) {
-            break;
+            return check;
         }
     }
 
-    if (check < lastvisplane)
-        return check;
-
-    if (lastvisplane - visplanes == MAXVISPLANES)
-        I_Error("R_FindPlane: no more visplanes");
-
-    lastvisplane++;
+    check = R_NewVisplane(NULL);
+    check->hashnext = visplanehash[hash];
+    visplanehash[hash] = check - visplanes;
 
     check->height = height;
     check->picnum = picnum;
@@ -217,7 +362,7 @@ visplane_t *R_FindPlane(fixed_t height, int picnum, int lightlevel)
     check->minx = SCREENWIDTH;
     check->maxx = -1;
 
-    memset(check->top, 0xff, sizeof(check->top));
+    memset(check->top, 0xff, SCREENWIDTH * sizeof(*check->top));
 
     return check;
 }
@@ -232,6 +377,7 @@ visplane_t *R_CheckPlane(visplane_t *pl, int start, int stop)
     int unionl;
     int unionh;
     int x;
+    visplane_t *newpl;
 
     if (start < pl->minx) {
         intrl = pl->minx;
@@ -250,7 +396,7 @@ visplane_t *R_CheckPlane(visplane_t *pl, int start, int stop)
     }
 
     for (x = intrl; x <= intrh; x++)
-        if (pl->top[x] != 0xff)
+        if (pl->top[x] != 0xffff)
             break;
 
     if (x > intrh) {
@@ -262,15 +408,16 @@ visplane_t *R_CheckPlane(visplane_t *pl, int start, int stop)
     }
 
     // make a new visplane
-    lastvisplane->height = pl->height;
-    lastvisplane->picnum = pl->picnum;
-    lastvisplane->lightlevel = pl->lightlevel;
+    newpl = R_NewVisplane(&pl);
+    newpl->height = pl->height;
+    newpl->picnum = pl->picnum;
+    newpl->lightlevel = pl->lightlevel;
 
-    pl = lastvisplane++;
+    pl = newpl;
     pl->minx = start;
     pl->maxx = stop;
 
-    memset(pl->top, 0xff, sizeof(pl->top));
+    memset(pl->top, 0xff, SCREENWIDTH * sizeof(*pl->top));
 
     return pl;
 }
@@ -300,83 +447,215 @@ void R_MakeSpans(int x, int t1, int b1, int t2, int b2)
 }
 
 //
-// R_DrawPlanes
-// At the end of each frame.
+// R_GetSkyColumn
+// Returns the cached column of the sky at angle, making it if needed.
 //
-void R_DrawPlanes(void)
+static byte *R_GetSkyColumn(int angle)
+{
+    int width = texturewidthmask[rview.skytexture] + 1;
+    byte *column;
+    byte *source;
+    fixed_t frac;
+    int y;
+
+    if (rview.skytexture != skycachetexture || viewheight != skycacheheight
+        || centery != skycachecentery || dc_iscale != skycacheiscale
+        || dc_texturemid != skycachetexturemid) {
+        if (width * viewheight > skycolumnsize) {
+            skycolumnsize = width * viewheight;
+            skycolumns = I_Realloc(skycolumns, skycolumnsize);
+        }
+
+        skycolumnsvalid =
+            I_Realloc(skycolumnsvalid, width * sizeof(*skycolumnsvalid));
+        memset(skycolumnsvalid, 0, width * sizeof(*skycolumnsvalid));
+
+        skycachetexture = rview.skytexture;
+        skycacheheight = viewheight;
+        skycachecentery = centery;
+        skycacheiscale = dc_iscale;
+        skycachetexturemid = dc_texturemid;
+    }
+
+    angle &= width - 1;
+    column = skycolumns + angle * viewheight;
+
+    if (!skycolumnsvalid[angle]) {
+        source = R_GetColumn(rview.skytexture, angle);
+        frac = dc_texturemid - centery * dc_iscale;
+
+        for (y = 0; y < viewheight; y++) {
+            column[y] = dc_colormap[source[(frac >> FRACBITS) & 127]];
+            frac += dc_iscale;
+        }
+
+        skycolumnsvalid[angle] = true;
+    }
+
+    return column;
+}
+
+//
+// R_DrawSkyPlane
+//
+static void R_DrawSkyPlane(visplane_t *pl)
 {
-    visplane_t *pl;
-    int light;
     int x;
-    int stop;
+    int y;
     int angle;
-    int lumpnum;
-
-#ifdef RANGECHECK
-    if (ds_p - drawsegs > MAXDRAWSEGS)
-        I_Error("R_DrawPlanes: drawsegs overflow (%i)", ds_p - drawsegs);
+    byte *source;
+    byte *dest;
+    int pitch = rowpitch;
+
+    dc_iscale = pspriteiscale >> detailshift;
+
+    // Sky is allways drawn full bright,
+    //  i.e. colormaps[0] is used.
+    // Because of this hack, sky is not affected
+    //  by INVUL inverse mapping.
+    dc_colormap = colormaps;
+    dc_texturemid = skytexturemid;
+    dc_texheight = 128; // as R_GetSkyColumn
+    for (x = pl->minx; x <= pl->maxx; x++) {
+        dc_yl = pl->top[x];
+        dc_yh = pl->bottom[x];
+
+        if (dc_yl <= dc_yh) {
+            angle = (viewangle + xtoviewangle[x]) >> ANGLETOSKYSHIFT;
+            dc_x = x;
+
+            // Low detail doubles up pixels, so still goes through colfunc.
+            if (colfunc != R_DrawColumn) {
+                dc_source = R_GetColumn(rview.skytexture, angle);
+                colfunc();
+                continue;
+            }
 
-    if (lastvisplane - visplanes > MAXVISPLANES)
-        I_Error("R_DrawPlanes: visplane overflow (%i)",
-                lastvisplane - visplanes);
+            source = R_GetSkyColumn(angle);
+            dest = ylookup[dc_yl] + columnofs[dc_x];
+            M_CountWork(work_columns, 1);
+            M_CountWork(work_pixels, dc_yh - dc_yl + 1);
 
-    if (lastopening - openings > MAXOPENINGS)
-        I_Error("R_DrawPlanes: opening overflow (%i)", lastopening - openings);
-#endif
+            if (pitch == 1) {
+                memcpy(dest, source + dc_yl, dc_yh - dc_yl + 1);
+                continue;
+            }
 
-    for (pl = visplanes; pl < lastvisplane; pl++) {
-        if (pl->minx > pl->maxx)
-            continue;
-
-        // sky flat
-        if (pl->picnum == skyflatnum) {
-            dc_iscale = pspriteiscale >> detailshift;
-
-            // Sky is allways drawn full bright,
-            //  i.e. colormaps[0] is used.
-            // Because of this hack, sky is not affected
-            //  by INVUL inverse mapping.
-            dc_colormap = colormaps;
-            dc_texturemid = skytexturemid;
-            for (x = pl->minx; x <= pl->maxx; x++) {
-                dc_yl = pl->top[x];
-                dc_yh = pl->bottom[x];
-
-                if (dc_yl <= dc_yh) {
-                    angle = (viewangle + xtoviewangle[x]) >> ANGLETOSKYSHIFT;
-                    dc_x = x;
-                    dc_source = R_GetColumn(skytexture, angle);
-                    colfunc();
-                }
+            for (y = dc_yl; y <= dc_yh; y++) {
+                *dest = source[y];
+                dest += pitch;
             }
-            continue;
         }
+    }
+}
 
-        // regular flat
-        lumpnum = firstflat + flattranslation[pl->picnum];
-        ds_source = W_CacheLumpNum(lumpnum, PU_STATIC);
+//
+// R_DrawFlatPlane
+//
+static void R_DrawFlatPlane(visplane_t *pl)
+{
+    int light;
+    int x;
+    int stop;
 
-        planeheight = abs(pl->height - viewz);
-        light = (pl->lightlevel >> LIGHTSEGSHIFT) + extralight;
+    ds_source = planesources[pl - visplanes];
 
-        if (light >= LIGHTLEVELS)
-            light = LIGHTLEVELS - 1;
+    planeheight = abs(pl->height - viewz);
+    light = (pl->lightlevel >> LIGHTSEGSHIFT) + extralight;
 
-        if (light < 0)
-            light = 0;
+    if (light >= LIGHTLEVELS)
+        light = LIGHTLEVELS - 1;
 
-        planezlight = zlight[light];
+    if (light < 0)
+        light = 0;
 
-        pl->top[pl->maxx + 1] = 0xff;
-        pl->top[pl->minx - 1] = 0xff;
+    planezlight = zlight[light];
 
-        stop = pl->maxx + 1;
+    pl->top[pl->maxx + 1] = 0xffff;
+    pl->top[pl->minx - 1] = 0xffff;
 
-        for (x = pl->minx; x <= stop; x++) {
-            R_MakeSpans(x, pl->top[x - 1], pl->bottom[x - 1], pl->top[x],
-                        pl->bottom[x]);
-        }
+    stop = pl->maxx + 1;
+
+    for (x = pl->minx; x <= stop; x++) {
+        R_MakeSpans(x, pl->top[x - 1], pl->bottom[x - 1], pl->top[x],
+                    pl->bottom[x]);
+    }
+}
+
+//
+// R_DrawPlaneJob
+// Visplanes never overlap, so each is a job of its own, run by any
+//  worker. The column drawers aren't thread-safe, so one more job
+//  draws all of the sky.
+//
+static void R_DrawPlaneJob(int worker_i, int job_i, void *data)
+{
+    static THREAD_LOCAL unsigned int cachedframe;
+    visplane_t *pl;
+
+    (void)worker_i;
+    (void)data;
+
+    // texture calculation
+    if (cachedframe != planeframe) {
+        memset(cachedheight, 0, SCREENHEIGHT * sizeof(*cachedheight));
+        cachedframe = planeframe;
+    }
 
-        W_ReleaseLumpNum(lumpnum);
+    if (job_i < sortedplanecount) {
+        R_DrawFlatPlane(sortedplanes[job_i]);
+        return;
     }
+
+    for (pl = visplanes; pl < lastvisplane; pl++) {
+        if (pl->minx <= pl->maxx && pl->picnum == skyflatnum)
+            R_DrawSkyPlane(pl);
+    }
+}
+
+static int ComparePlanes(const void *a, const void *b)
+{
+    const visplane_t *pl1 = *(visplane_t *const *)a;
+    const visplane_t *pl2 = *(visplane_t *const *)b;
+
+    if (pl1->picnum != pl2->picnum)
+        return pl1->picnum < pl2->picnum ? -1 : 1;
+    if (pl1->height != pl2->height)
+        return pl1->height < pl2->height ? -1 : 1;
+    if (pl1->lightlevel != pl2->lightlevel)
+        return pl1->lightlevel < pl2->lightlevel ? -1 : 1;
+
+    return pl1 < pl2 ? -1 : pl1 > pl2;
+}
+
+//
+// R_DrawPlanes
+// At the end of each frame.
+//
+void R_DrawPlanes(void)
+{
+    visplane_t *pl;
+    int i;
+
+    sortedplanes = Z_ArenaAlloc((lastvisplane - visplanes)
+                                * sizeof(*sortedplanes));
+
+    sortedplanecount = 0;
+    for (pl = visplanes; pl < lastvisplane; pl++) {
+        if (pl->minx <= pl->maxx && pl->picnum != skyflatnum)
+            sortedplanes[sortedplanecount++] = pl;
+    }
+
+    qsort(sortedplanes, sortedplanecount, sizeof(*sortedplanes),
+          ComparePlanes);
+
+    // Flats stay pinned until the view is finished, as the workers read them.
+    for (i = 0; i < sortedplanecount; i++) {
+        pl = sortedplanes[i];
+        planesources[pl - visplanes] =
+            R_CacheFrameLumpNum(firstflat + rflattranslation[pl->picnum]);
+    }
+
+    planeframe++;
+    I_RunJobs(R_DrawPlaneJob, NULL, sortedplanecount + 1);
 }
@@ -24,22 +24,28 @@
 #include "r_defs.h"
 
 // Visplane related.
-extern short *lastopening;
+extern visplane_t *visplanes;
+extern visplane_t *lastvisplane;
+
+// Openings handed out since the last R_ClearPlanes.
+extern int openingcount;
 
 typedef void (*planefunction_t)(int top, int bottom);
 
 extern planefunction_t floorfunc;
 extern planefunction_t ceilingfunc_t;
 
-extern short floorclip[SCREENWIDTH];
-extern short ceilingclip[SCREENWIDTH];
+extern short floorclip[MAXWIDTH];
+extern short ceilingclip[MAXWIDTH];
 
-extern fixed_t yslope[SCREENHEIGHT];
-extern fixed_t distscale[SCREENWIDTH];
+extern fixed_t yslope[MAXHEIGHT];
+extern fixed_t distscale[MAXWIDTH];
 
 void R_InitPlanes(void);
 void R_ClearPlanes(void);
 
+short *R_NewOpenings(int count);
+
 void R_MapPlane(int y, int x1, int x2);
 
 void R_MakeSpans(int x, int t1, int b1, int t2, int b2);
@@ -23,6 +23,7 @@
 #include "doomdef.h"
 #include "doomstat.h"
 #include "i_system.h"
+#include "m_counts.h"
 #include "r_bsp.h"
 #include "r_data.h"
 #include "r_defs.h"
@@ -31,6 +32,7 @@
 #include "r_plane.h"
 #include "r_state.h"
 #include "r_things.h"
+#include "r_view.h"
 #include "tables.h"
 #include "v_patch.h"
 
@@ -87,37 +89,47 @@ lighttable_t **walllights;
 short *maskedtexturecol;
 
 //
-// R_RenderMaskedSegRange
+// R_WallLights
+// Light table for curline in frontsector.
+// Use different light tables
+//   for horizontal / vertical / diagonal. Diagonal?
+// OPTIMIZE: get rid of LIGHTSEGSHIFT globally
 //
-void R_RenderMaskedSegRange(drawseg_t *ds, int x1, int x2)
+static lighttable_t **R_WallLights(void)
 {
-    unsigned index;
-    column_t *col;
-    int lightnum;
-    int texnum;
+    int lightnum = (frontsector->lightlevel >> LIGHTSEGSHIFT) + extralight;
 
-    // Calculate light table.
-    // Use different light tables
-    //   for horizontal / vertical / diagonal. Diagonal?
-    // OPTIMIZE: get rid of LIGHTSEGSHIFT globally
-    curline = ds->curline;
-    frontsector = curline->frontsector;
-    backsector = curline->backsector;
-    texnum = texturetranslation[curline->sidedef->midtexture];
-
-    lightnum = (frontsector->lightlevel >> LIGHTSEGSHIFT) + extralight;
-
-    if (curline->v1->y == curline->v2->y)
+    if (curline->v1.y == curline->v2.y)
         lightnum--;
-    else if (curline->v1->x == curline->v2->x)
+    else if (curline->v1.x == curline->v2.x)
         lightnum++;
 
     if (lightnum < 0)
-        walllights = scalelight[0];
+        return scalelight[0];
     else if (lightnum >= LIGHTLEVELS)
-        walllights = scalelight[LIGHTLEVELS - 1];
+        return scalelight[LIGHTLEVELS - 1];
     else
-        walllights = scalelight[lightnum];
+        return scalelight[lightnum];
+}
+
+//
+// R_RenderMaskedSegRange
+//
+void R_RenderMaskedSegRange(drawseg_t *ds, int x1, int x2)
+{
+    unsigned index;
+    int texnum;
+    int texturecolumn;
+    rside_t *side;
+    const maskedposts_t *mp;
+
+    // The light table was picked when the seg was stored.
+    curline = ds->curline;
+    frontsector = &rsectors[curline->frontsector];
+    backsector = &rsectors[curline->backsector];
+    side = &rsides[curline->sidedef];
+    texnum = rtexturetranslation[side->midtexture];
+    walllights = ds->walllights;
 
     maskedtexturecol = ds->maskedtexturecol;
 
@@ -127,7 +139,7 @@ void R_RenderMaskedSegRange(drawseg_t *ds, int x1, int x2)
     mceilingclip = ds->sprtopclip;
 
     // find positioning
-    if (curline->linedef->flags & ML_DONTPEGBOTTOM) {
+    if (rlines[curline->linedef].flags & ML_DONTPEGBOTTOM) {
         dc_texturemid = frontsector->floorheight > backsector->floorheight
                             ? frontsector->floorheight
                             : backsector->floorheight;
@@ -138,17 +150,22 @@ void R_RenderMaskedSegRange(drawseg_t *ds, int x1, int x2)
                             : backsector->ceilingheight;
         dc_texturemid = dc_texturemid - viewz;
     }
-    dc_texturemid += curline->sidedef->rowoffset;
+    dc_texturemid += side->rowoffset;
 
     if (fixedcolormap)
         dc_colormap = fixedcolormap;
 
+    mp = R_GetMaskedPosts(texnum);
+
     // draw the columns
     for (dc_x = x1; dc_x <= x2; dc_x++) {
-        // calculate lighting
-        if (maskedtexturecol[dc_x] != SHRT_MAX) {
+        // Columns sprites already drew it in, or closed off entirely by the
+        //  clips, draw nothing.
+        if (maskedtexturecol[dc_x] != SHRT_MAX
+            && mfloorclip[dc_x] - mceilingclip[dc_x] > 1) {
+            // calculate lighting
             if (!fixedcolormap) {
-                index = spryscale >> LIGHTSCALESHIFT;
+                index = spryscale >> (LIGHTSCALESHIFT + hires);
 
                 if (index >= MAXLIGHTSCALE)
                     index = MAXLIGHTSCALE - 1;
@@ -160,13 +177,18 @@ void R_RenderMaskedSegRange(drawseg_t *ds, int x1, int x2)
             dc_iscale = 0xffffffffu / (unsigned)spryscale;
 
             // draw the texture
-            col =
-                (column_t *)((byte *)R_GetColumn(texnum, maskedtexturecol[dc_x])
-                             - 3);
-
-            R_DrawMaskedColumn(col);
-            maskedtexturecol[dc_x] = SHRT_MAX;
+            texturecolumn = maskedtexturecol[dc_x] & texturewidthmask[texnum];
+            if (mp->composite[texturecolumn]) {
+                R_DrawMaskedColumn(
+                    (column_t *)(R_GetColumn(texnum, texturecolumn) - 3));
+            } else {
+                R_DrawMaskedPosts(
+                    R_GetColumn(texnum, texturecolumn) - 3,
+                    &mp->posts[mp->columnstarts[texturecolumn]],
+                    &mp->posts[mp->columnstarts[texturecolumn + 1]]);
+            }
         }
+        maskedtexturecol[dc_x] = SHRT_MAX;
         spryscale += rw_scalestep;
     }
 }
@@ -190,8 +212,14 @@ void R_RenderSegLoop(void)
     int yh;
     int mid;
     fixed_t texturecolumn;
+    fixed_t tangent;
     int top;
     int bottom;
+    // Queue what would be drawn by R_DrawColumn; single sided and upper walls
+    // use the first queue, lower walls the second. Only worth it once the
+    // frame buffer is too large to stay in the cache; otherwise the extra
+    // copy costs more than it saves.
+    boolean queued = hires > 1 && colfunc == R_DrawColumn && colpitch == 1;
 
     for (; rw_x < rw_stopx; rw_x++) {
         // mark floor / ceiling areas
@@ -234,11 +262,18 @@ void R_RenderSegLoop(void)
         if (segtextured) {
             // calculate texture offset
             angle = (rw_centerangle + xtoviewangle[rw_x]) >> ANGLETOFINESHIFT;
-            texturecolumn =
-                rw_offset - FixedMul(finetangent[angle], rw_distance);
+
+            // Walls seen nearly edge on can give angles past the end of
+            // finetangent. Vanilla read on into finesine, which followed it
+            // in memory; do so explicitly, as the linker may place the
+            // tables anywhere.
+            tangent = angle < FINEANGLES / 2
+                          ? finetangent[angle]
+                          : finesine[angle - FINEANGLES / 2];
+            texturecolumn = rw_offset - FixedMul(tangent, rw_distance);
             texturecolumn >>= FRACBITS;
             // calculate lighting
-            index = rw_scale >> LIGHTSCALESHIFT;
+            index = rw_scale >> (LIGHTSCALESHIFT + hires);
 
             if (index >= MAXLIGHTSCALE)
                 index = MAXLIGHTSCALE - 1;
@@ -259,7 +294,11 @@ void R_RenderSegLoop(void)
             dc_yh = yh;
             dc_texturemid = rw_midtexturemid;
             dc_source = R_GetColumn(midtexture, texturecolumn);
-            colfunc();
+            dc_texheight = textureheight[midtexture] >> FRACBITS;
+            if (queued)
+                R_DrawColumnQueued(0);
+            else
+                colfunc();
             ceilingclip[rw_x] = viewheight;
             floorclip[rw_x] = -1;
         } else {
@@ -277,7 +316,11 @@ void R_RenderSegLoop(void)
                     dc_yh = mid;
                     dc_texturemid = rw_toptexturemid;
                     dc_source = R_GetColumn(toptexture, texturecolumn);
-                    colfunc();
+                    dc_texheight = textureheight[toptexture] >> FRACBITS;
+                    if (queued)
+                        R_DrawColumnQueued(0);
+                    else
+                        colfunc();
                     ceilingclip[rw_x] = mid;
                 } else
                     ceilingclip[rw_x] = yl - 1;
@@ -301,7 +344,11 @@ void R_RenderSegLoop(void)
                     dc_yh = yh;
                     dc_texturemid = rw_bottomtexturemid;
                     dc_source = R_GetColumn(bottomtexture, texturecolumn);
-                    colfunc();
+                    dc_texheight = textureheight[bottomtexture] >> FRACBITS;
+                    if (queued)
+                        R_DrawColumnQueued(1);
+                    else
+                        colfunc();
                     floorclip[rw_x] = mid;
                 } else
                     floorclip[rw_x] = yh + 1;
@@ -322,6 +369,9 @@ void R_RenderSegLoop(void)
         topfrac += topstep;
         bottomfrac += bottomstep;
     }
+
+    if (queued)
+        R_FlushColumnQueues();
 }
 
 //
@@ -335,22 +385,27 @@ void R_StoreWallRange(int start, int stop)
     fixed_t sineval;
     angle_t distangle, offsetangle;
     fixed_t vtop;
-    int lightnum;
+    rsegcache_t *cache = &rsegcaches[curline - rsegs];
+
+    // Grow the drawsegs; unlike vanilla, which dropped the wall.
+    if (ds_p == drawsegs + numdrawsegs)
+        R_GrowDrawSegs();
 
-    // don't overflow and crash
-    if (ds_p == &drawsegs[MAXDRAWSEGS])
-        return;
+    M_CountWork(work_segs, 1);
 
 #ifdef RANGECHECK
     if (start >= viewwidth || start > stop)
         I_Error("Bad R_RenderWallRange: %i to %i", start, stop);
 #endif
 
-    sidedef = curline->sidedef;
-    linedef = curline->linedef;
+    sidedef = &rsides[curline->sidedef];
+    linedef = &rlines[curline->linedef];
 
     // mark the segment as visible for auto map
-    linedef->flags |= ML_MAPPED;
+    if (!(linedef->flags & ML_MAPPED)) {
+        linedef->flags |= ML_MAPPED;
+        R_LineMapped(curline->linedef);
+    }
 
     // calculate rw_distance for scale calculation
     rw_normalangle = curline->angle + ANG90;
@@ -359,10 +414,24 @@ void R_StoreWallRange(int start, int stop)
     if (offsetangle > ANG90)
         offsetangle = ANG90;
 
-    distangle = ANG90 - offsetangle;
-    hyp = R_PointToDist(curline->v1->x, curline->v1->y);
-    sineval = finesine[distangle >> ANGLETOFINESHIFT];
-    rw_distance = FixedMul(hyp, sineval);
+    // Only the view's position decides these, so a seg seen from where it
+    // was last drawn keeps them.
+    if (cache->cached && cache->viewx == viewx && cache->viewy == viewy) {
+        hyp = cache->hyp;
+        rw_distance = cache->distance;
+    } else {
+        distangle = ANG90 - offsetangle;
+        hyp = R_PointToDist(curline->v1.x, curline->v1.y);
+        sineval = finesine[distangle >> ANGLETOFINESHIFT];
+        rw_distance = FixedMul(hyp, sineval);
+
+        cache->cached = true;
+        cache->viewx = viewx;
+        cache->viewy = viewy;
+        cache->hyp = hyp;
+        cache->distance = rw_distance;
+        cache->projection = 0; // Scales need redoing too.
+    }
 
     ds_p->x1 = rw_x = start;
     ds_p->x2 = stop;
@@ -370,14 +439,21 @@ void R_StoreWallRange(int start, int stop)
     rw_stopx = stop + 1;
 
     // calculate scale at both ends and step
-    ds_p->scale1 = rw_scale =
-        R_ScaleFromGlobalAngle(viewangle + xtoviewangle[start]);
-
-    if (stop > start) {
+    if (cache->projection == projection && cache->viewangle == viewangle
+        && cache->start == start && cache->stop == stop) {
+        ds_p->scale1 = rw_scale = cache->scale1;
+        ds_p->scale2 = cache->scale2;
+        ds_p->scalestep = rw_scalestep = cache->scalestep;
+    } else if (stop > start) {
+        ds_p->scale1 = rw_scale =
+            R_ScaleFromGlobalAngle(viewangle + xtoviewangle[start]);
         ds_p->scale2 = R_ScaleFromGlobalAngle(viewangle + xtoviewangle[stop]);
         ds_p->scalestep = rw_scalestep =
             (ds_p->scale2 - rw_scale) / (stop - start);
     } else {
+        ds_p->scale1 = rw_scale =
+            R_ScaleFromGlobalAngle(viewangle + xtoviewangle[start]);
+
         // UNUSED: try to fix the stretched line bug
 #if 0
         if (rw_distance < FRACUNIT/2)
@@ -385,8 +461,8 @@ void R_StoreWallRange(int start, int stop)
             fixed_t             trx,try;
             fixed_t             gxt,gyt;
 
-            trx = curline->v1->x - viewx;
-            try = curline->v1->y - viewy;
+            trx = curline->v1.x - viewx;
+            try = curline->v1.y - viewy;
 
             gxt = FixedMul(trx,viewcos);
             gyt = -FixedMul(try,viewsin);
@@ -396,6 +472,14 @@ void R_StoreWallRange(int start, int stop)
         ds_p->scale2 = ds_p->scale1;
     }
 
+    cache->start = start;
+    cache->stop = stop;
+    cache->viewangle = viewangle;
+    cache->projection = projection;
+    cache->scale1 = ds_p->scale1;
+    cache->scale2 = ds_p->scale2;
+    cache->scalestep = ds_p->scalestep;
+
     // calculate texture boundaries
     //  and decide if floor / ceiling marks are needed
     worldtop = frontsector->ceilingheight - viewz;
@@ -406,7 +490,7 @@ void R_StoreWallRange(int start, int stop)
 
     if (!backsector) {
         // single sided line
-        midtexture = texturetranslation[sidedef->midtexture];
+        midtexture = rtexturetranslation[sidedef->midtexture];
         // a single sided line is terminal, so it must mark ends
         markfloor = markceiling = true;
         if (linedef->flags & ML_DONTPEGBOTTOM) {
@@ -495,7 +579,7 @@ void R_StoreWallRange(int start, int stop)
 
         if (worldhigh < worldtop) {
             // top texture
-            toptexture = texturetranslation[sidedef->toptexture];
+            toptexture = rtexturetranslation[sidedef->toptexture];
             if (linedef->flags & ML_DONTPEGTOP) {
                 // top of texture at top
                 rw_toptexturemid = worldtop;
@@ -509,7 +593,7 @@ void R_StoreWallRange(int start, int stop)
         }
         if (worldlow > worldbottom) {
             // bottom texture
-            bottomtexture = texturetranslation[sidedef->bottomtexture];
+            bottomtexture = rtexturetranslation[sidedef->bottomtexture];
 
             if (linedef->flags & ML_DONTPEGBOTTOM) {
                 // bottom of texture at bottom
@@ -525,8 +609,8 @@ void R_StoreWallRange(int start, int stop)
         if (sidedef->midtexture) {
             // masked midtexture
             maskedtexture = true;
-            ds_p->maskedtexturecol = maskedtexturecol = lastopening - rw_x;
-            lastopening += rw_stopx - rw_x;
+            ds_p->maskedtexturecol = maskedtexturecol =
+                R_NewOpenings(rw_stopx - rw_x) - rw_x;
         }
     }
 
@@ -552,24 +636,9 @@ void R_StoreWallRange(int start, int stop)
         rw_centerangle = ANG90 + viewangle - rw_normalangle;
 
         // calculate light table
-        //  use different light tables
-        //  for horizontal / vertical / diagonal
-        // OPTIMIZE: get rid of LIGHTSEGSHIFT globally
-        if (!fixedcolormap) {
-            lightnum = (frontsector->lightlevel >> LIGHTSEGSHIFT) + extralight;
-
-            if (curline->v1->y == curline->v2->y)
-                lightnum--;
-            else if (curline->v1->x == curline->v2->x)
-                lightnum++;
-
-            if (lightnum < 0)
-                walllights = scalelight[0];
-            else if (lightnum >= LIGHTLEVELS)
-                walllights = scalelight[LIGHTLEVELS - 1];
-            else
-                walllights = scalelight[lightnum];
-        }
+        if (!fixedcolormap)
+            walllights = R_WallLights();
+        ds_p->walllights = walllights;
     }
 
     // if a floor / ceiling plane is on the wrong side
@@ -623,16 +692,16 @@ void R_StoreWallRange(int start, int stop)
 
     // save sprite clipping info
     if (((ds_p->silhouette & SIL_TOP) || maskedtexture) && !ds_p->sprtopclip) {
-        memcpy(lastopening, ceilingclip + start, 2 * (rw_stopx - start));
-        ds_p->sprtopclip = lastopening - start;
-        lastopening += rw_stopx - start;
+        ds_p->sprtopclip = R_NewOpenings(rw_stopx - start) - start;
+        memcpy(ds_p->sprtopclip + start, ceilingclip + start,
+               2 * (rw_stopx - start));
     }
 
     if (((ds_p->silhouette & SIL_BOTTOM) || maskedtexture)
         && !ds_p->sprbottomclip) {
-        memcpy(lastopening, floorclip + start, 2 * (rw_stopx - start));
-        ds_p->sprbottomclip = lastopening - start;
-        lastopening += rw_stopx - start;
+        ds_p->sprbottomclip = R_NewOpenings(rw_stopx - start) - start;
+        memcpy(ds_p->sprbottomclip + start, floorclip + start,
+               2 * (rw_stopx - start));
     }
 
     if (maskedtexture && !(ds_p->silhouette & SIL_TOP)) {
@@ -30,6 +30,7 @@
 
 // needed for texture pegging
 extern fixed_t *textureheight;
+extern int *texturewidthmask;
 
 // needed for pre rendering (fracs)
 extern fixed_t *spritewidth;
@@ -49,6 +50,10 @@ extern int firstflat;
 extern int *flattranslation;
 extern int *texturetranslation;
 
+// Changes whenever a wall or flat changes how it looks: animations stepping,
+// walls scrolling and switches flipping.
+extern int surfacegeneration;
+
 // Sprite....
 extern int firstspritelump;
 extern int lastspritelump;
@@ -81,6 +86,48 @@ extern line_t *lines;
 extern int numsides;
 extern side_t *sides;
 
+//
+// The snapshot views are drawn from; see R_PublishView.
+//
+extern rsector_t *rsectors; // [numsectors]
+extern rside_t *rsides;     // [numsides]
+extern rline_t *rlines;     // [numlines]
+extern rthing_t *rthings;
+
+extern int *rflattranslation;
+extern int *rtexturetranslation;
+
+#define RSECTOR(sec) (&rsectors[(sec) - sectors])
+#define RSIDE(side) (&rsides[(side) - sides])
+#define RLINE(line) (&rlines[(line) - lines])
+
+// The segs and subsectors views are drawn from; see R_InitLevelSegs.
+extern rseg_t *rsegs;             // [numsegs]
+extern rsegcache_t *rsegcaches;   // [numsegs]
+extern rsubsector_t *rsubsectors; // [numsubsectors]
+
+// The player's view.
+typedef struct {
+    fixed_t x;
+    fixed_t y;
+    fixed_t z;
+    angle_t angle;
+    int extralight;
+    int fixedcolormap;
+
+    // the sector the player is in
+    rsector_t *sector;
+
+    // the weapon, drawn as a shadow while invisible
+    pspdef_t psprites[NUMPSPRITES];
+    boolean shadowpsprites;
+
+    int skytexture;
+
+} rview_t;
+
+extern rview_t rview;
+
 //
 // POV data.
 //
@@ -89,13 +136,12 @@ extern fixed_t viewy;
 extern fixed_t viewz;
 
 extern angle_t viewangle;
-extern player_t *viewplayer;
 
 // ?
 extern angle_t clipangle;
 
 extern int viewangletox[FINEANGLES / 2];
-extern angle_t xtoviewangle[SCREENWIDTH + 1];
+extern angle_t xtoviewangle[MAXWIDTH + 1];
 // extern fixed_t               finetangent[FINEANGLES/2];
 
 extern fixed_t rw_distance;
@@ -107,6 +153,9 @@ extern int rw_angle1;
 // Segs count?
 extern int sscount;
 
+// Frames rendered.
+extern int framecount;
+
 extern visplane_t *floorplane;
 extern visplane_t *ceilingplane;
 
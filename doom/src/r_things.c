@@ -16,7 +16,6 @@
 //      Refresh of things, i.e. objects represented by sprites.
 //
 
-#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -24,7 +23,9 @@
 #include "doomstat.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "m_counts.h"
 #include "r_bsp.h"
+#include "r_data.h"
 #include "r_defs.h"
 #include "r_draw.h"
 #include "r_main.h"
@@ -64,8 +65,8 @@ lighttable_t **spritelights;
 
 // constant arrays
 //  used for psprite clipping and initializing clipping
-short negonearray[SCREENWIDTH];
-short screenheightarray[SCREENWIDTH];
+short negonearray[MAXWIDTH];
+short screenheightarray[MAXWIDTH];
 
 //
 // INITIALIZATION FUNCTIONS
@@ -80,6 +81,9 @@ spriteframe_t sprtemp[29];
 int maxframe;
 char *spritename;
 
+// For each sprite lump, once read; purgable. Offsets are from the patch.
+static maskedposts_t **spriteposts;
+
 //
 // R_InstallSpriteLump
 // Local function for R_InitSprites.
@@ -252,8 +256,9 @@ void R_InitSpriteDefs(char **namelist)
 //
 // GAME FUNCTIONS
 //
-vissprite_t vissprites[MAXVISSPRITES];
+vissprite_t *vissprites;
 vissprite_t *vissprite_p;
+int numvissprites;
 int newvissprite;
 
 //
@@ -269,6 +274,10 @@ void R_InitSprites(char **namelist)
     }
 
     R_InitSpriteDefs(namelist);
+
+    spriteposts =
+        Z_Malloc(numspritelumps * sizeof(*spriteposts), PU_STATIC, NULL);
+    memset(spriteposts, 0, numspritelumps * sizeof(*spriteposts));
 }
 
 //
@@ -282,13 +291,19 @@ void R_ClearSprites(void)
 
 //
 // R_NewVisSprite
+// Doubles the pool if it's full, rather than dropping the sprite like vanilla.
 //
-vissprite_t overflowsprite;
-
 vissprite_t *R_NewVisSprite(void)
 {
-    if (vissprite_p == &vissprites[MAXVISSPRITES])
-        return &overflowsprite;
+    M_CountWork(work_vissprites, 1);
+
+    if (vissprite_p == vissprites + numvissprites) {
+        int used = vissprite_p - vissprites;
+
+        numvissprites = numvissprites ? 2 * numvissprites : MAXVISSPRITES;
+        vissprites = I_Realloc(vissprites, numvissprites * sizeof(*vissprites));
+        vissprite_p = vissprites + used;
+    }
 
     vissprite_p++;
     return vissprite_p - 1;
@@ -331,6 +346,9 @@ void R_DrawMaskedColumn(column_t *column)
         if (dc_yl <= dc_yh) {
             dc_source = (byte *)column + 3;
             dc_texturemid = basetexturemid - (column->topdelta << FRACBITS);
+            // Rounding can step just outside the post; keep vanilla's 128
+            //  texel wrap for that unless the post is longer.
+            dc_texheight = column->length > 128 ? 256 : 128;
             // dc_source = (byte *)column + 3 - column->topdelta;
 
             // Drawn by either R_DrawColumn
@@ -343,18 +361,129 @@ void R_DrawMaskedColumn(column_t *column)
     dc_texturemid = basetexturemid;
 }
 
+//
+// SPRITE POSTS
+// The posts of each column of a sprite, read out of its patch once rather
+// than every time it's drawn. The texels are still drawn from the patch.
+//
+
+//
+// GetSpritePosts
+// patch is the sprite lump's, which must be locked, as this may allocate.
+//
+static const maskedposts_t *GetSpritePosts(int lump, const patch_t *patch)
+{
+    maskedposts_t *sp;
+    maskedpost_t *post;
+    int *columnstarts;
+    const column_t *column;
+    int width;
+    int numposts;
+    int size;
+    int x;
+
+    if (spriteposts[lump])
+        return spriteposts[lump];
+
+    width = SHORT(patch->width);
+    numposts = 0;
+    for (x = 0; x < width; x++) {
+        column = (const column_t *)((const byte *)patch
+                                    + LONG(patch->columnofs[x]));
+        for (; column->topdelta != 0xff;
+             column = (const column_t *)((const byte *)column + column->length
+                                         + 4)) {
+            numposts++;
+        }
+    }
+
+    size = sizeof(*sp) + numposts * sizeof(*sp->posts)
+           + (width + 1) * sizeof(*sp->columnstarts);
+
+    // Views drawn on a thread of their own mustn't touch the zone, so keep
+    //  their posts for good instead.
+    if (viewthread) {
+        sp = I_Realloc(NULL, size);
+        spriteposts[lump] = sp;
+    } else
+        sp = Z_Malloc(size, PU_CACHE, &spriteposts[lump]);
+    post = (maskedpost_t *)(sp + 1);
+    columnstarts = (int *)(post + numposts);
+    sp->posts = post;
+    sp->columnstarts = columnstarts;
+    sp->composite = NULL;
+
+    numposts = 0;
+    for (x = 0; x < width; x++) {
+        columnstarts[x] = numposts;
+        column = (const column_t *)((const byte *)patch
+                                    + LONG(patch->columnofs[x]));
+        for (; column->topdelta != 0xff;
+             column = (const column_t *)((const byte *)column + column->length
+                                         + 4)) {
+            post->topdelta = column->topdelta;
+            post->length = column->length;
+            post->offset = (const byte *)column + 3 - (const byte *)patch;
+            post++;
+            numposts++;
+        }
+    }
+    columnstarts[width] = numposts;
+
+    return sp;
+}
+
+//
+// R_DrawMaskedPosts
+// R_DrawMaskedColumn for a column's posts, with texels at their offsets from
+//  source.
+//
+void R_DrawMaskedPosts(const byte *source, const maskedpost_t *post,
+                       const maskedpost_t *end)
+{
+    int topscreen;
+    int bottomscreen;
+    fixed_t basetexturemid;
+
+    basetexturemid = dc_texturemid;
+
+    for (; post < end; post++) {
+        topscreen = sprtopscreen + spryscale * post->topdelta;
+        bottomscreen = topscreen + spryscale * post->length;
+
+        dc_yl = (topscreen + FRACUNIT - 1) >> FRACBITS;
+        dc_yh = (bottomscreen - 1) >> FRACBITS;
+
+        if (dc_yh >= mfloorclip[dc_x])
+            dc_yh = mfloorclip[dc_x] - 1;
+        if (dc_yl <= mceilingclip[dc_x])
+            dc_yl = mceilingclip[dc_x] + 1;
+
+        if (dc_yl <= dc_yh) {
+            dc_source = (byte *)source + post->offset;
+            dc_texturemid = basetexturemid - (post->topdelta << FRACBITS);
+            dc_texheight = post->length > 128 ? 256 : 128;
+            colfunc();
+        }
+    }
+
+    dc_texturemid = basetexturemid;
+}
+
 //
 // R_DrawVisSprite
 //  mfloorclip and mceilingclip should also be set.
 //
 void R_DrawVisSprite(vissprite_t *vis)
 {
-    column_t *column;
+    const maskedposts_t *sp;
     int texturecolumn;
     fixed_t frac;
     patch_t *patch;
 
-    patch = W_CacheLumpNum(vis->patch + firstspritelump, PU_CACHE);
+    // Pinned until the view is finished, so reading its posts can't purge it.
+    patch = R_CacheFrameLumpNum(vis->patch + firstspritelump);
+    sp = GetSpritePosts(vis->patch, patch);
 
     dc_colormap = vis->colormap;
 
@@ -363,9 +492,10 @@ void R_DrawVisSprite(vissprite_t *vis)
         colfunc = fuzzcolfunc;
     } else if (vis->mobjflags & MF_TRANSLATION) {
         colfunc = transcolfunc;
-        dc_translation =
+        dc_colormap = R_TranslateColormap(
             translationtables - 256
-            + ((vis->mobjflags & MF_TRANSLATION) >> (MF_TRANSSHIFT - 8));
+                + ((vis->mobjflags & MF_TRANSLATION) >> (MF_TRANSSHIFT - 8)),
+            dc_colormap);
     }
 
     dc_iscale = abs(vis->xiscale) >> detailshift;
@@ -380,9 +510,9 @@ void R_DrawVisSprite(vissprite_t *vis)
         if (texturecolumn < 0 || texturecolumn >= SHORT(patch->width))
             I_Error("R_DrawSpriteRange: bad texturecolumn");
 #endif
-        column =
-            (column_t *)((byte *)patch + LONG(patch->columnofs[texturecolumn]));
-        R_DrawMaskedColumn(column);
+        R_DrawMaskedPosts((const byte *)patch,
+                          &sp->posts[sp->columnstarts[texturecolumn]],
+                          &sp->posts[sp->columnstarts[texturecolumn + 1]]);
     }
 
     colfunc = basecolfunc;
@@ -393,8 +523,12 @@ void R_DrawVisSprite(vissprite_t *vis)
 // Generates a vissprite for a thing
 //  if it might be visible.
 //
-void R_ProjectSprite(mobj_t *thing)
+void R_ProjectSprite(rthing_t *thing)
 {
+    fixed_t x;
+    fixed_t y;
+    fixed_t z;
+    angle_t angle;
     fixed_t tr_x;
     fixed_t tr_y;
 
@@ -423,9 +557,12 @@ void R_ProjectSprite(mobj_t *thing)
     angle_t ang;
     fixed_t iscale;
 
+    x = thing->x;
+    y = thing->y;
+
     // transform the origin point
-    tr_x = thing->x - viewx;
-    tr_y = thing->y - viewy;
+    tr_x = x - viewx;
+    tr_y = y - viewy;
 
     gxt = FixedMul(tr_x, viewcos);
     gyt = -FixedMul(tr_y, viewsin);
@@ -446,6 +583,9 @@ void R_ProjectSprite(mobj_t *thing)
     if (abs(tx) > (tz << 2))
         return;
 
+    z = thing->z;
+    angle = thing->angle;
+
     // decide which patch to use for sprite relative to player
 #ifdef RANGECHECK
     if ((unsigned int)thing->sprite >= (unsigned int)numsprites)
@@ -461,8 +601,8 @@ void R_ProjectSprite(mobj_t *thing)
 
     if (sprframe->rotate) {
         // choose a different rotation based on player view
-        ang = R_PointToAngle(thing->x, thing->y);
-        rot = (ang - thing->angle + (unsigned)(ANG45 / 2) * 9) >> 29;
+        ang = R_PointToAngle(x, y);
+        rot = (ang - angle + (unsigned)(ANG45 / 2) * 9) >> 29;
         lump = sprframe->lump[rot];
         flip = (boolean)sprframe->flip[rot];
     } else {
@@ -486,14 +626,22 @@ void R_ProjectSprite(mobj_t *thing)
     if (x2 < 0)
         return;
 
+    // wholly behind walls already drawn?
+    if (x1 < viewwidth
+        && R_SpriteHidden(x1 < 0 ? 0 : x1,
+                          x2 >= viewwidth ? viewwidth - 1 : x2,
+                          xscale << detailshift)) {
+        return;
+    }
+
     // store information in a vissprite
     vis = R_NewVisSprite();
     vis->mobjflags = thing->flags;
     vis->scale = xscale << detailshift;
-    vis->gx = thing->x;
-    vis->gy = thing->y;
-    vis->gz = thing->z;
-    vis->gzt = thing->z + spritetopoffset[lump];
+    vis->gx = x;
+    vis->gy = y;
+    vis->gz = z;
+    vis->gzt = z + spritetopoffset[lump];
     vis->texturemid = vis->gzt - viewz;
     vis->x1 = x1 < 0 ? 0 : x1;
     vis->x2 = x2 >= viewwidth ? viewwidth - 1 : x2;
@@ -525,7 +673,7 @@ void R_ProjectSprite(mobj_t *thing)
 
     else {
         // diminished light
-        index = xscale >> (LIGHTSCALESHIFT - detailshift);
+        index = xscale >> (LIGHTSCALESHIFT - detailshift + hires);
 
         if (index >= MAXLIGHTSCALE)
             index = MAXLIGHTSCALE - 1;
@@ -538,20 +686,20 @@ void R_ProjectSprite(mobj_t *thing)
 // R_AddSprites
 // During BSP traversal, this adds sprites by sector.
 //
-void R_AddSprites(sector_t *sec)
+void R_AddSprites(rsector_t *sec)
 {
-    mobj_t *thing;
+    int i;
     int lightnum;
 
     // BSP is traversed by subsector.
     // A sector might have been split into several
     //  subsectors during BSP building.
     // Thus we check whether its already added.
-    if (sec->validcount == validcount)
+    if (sec->validcount == framecount)
         return;
 
     // Well, now it will be done.
-    sec->validcount = validcount;
+    sec->validcount = framecount;
 
     lightnum = (sec->lightlevel >> LIGHTSEGSHIFT) + extralight;
 
@@ -562,9 +710,9 @@ void R_AddSprites(sector_t *sec)
     else
         spritelights = scalelight[lightnum];
 
-    // Handle all things in sector.
-    for (thing = sec->thinglist; thing; thing = thing->snext)
-        R_ProjectSprite(thing);
+    // Handle all things in sector, in thinglist order.
+    for (i = sec->numthings - 1; i >= 0; i--)
+        R_ProjectSprite(&rthings[sec->firstthing + i]);
 }
 
 //
@@ -638,8 +786,7 @@ void R_DrawPSprite(pspdef_t *psp)
 
     vis->patch = lump;
 
-    if (viewplayer->powers[pw_invisibility] > 4 * 32
-        || viewplayer->powers[pw_invisibility] & 8) {
+    if (rview.shadowpsprites) {
         // shadow draw
         vis->colormap = NULL;
     } else if (fixedcolormap) {
@@ -666,8 +813,7 @@ void R_DrawPlayerSprites(void)
     pspdef_t *psp;
 
     // get light level
-    lightnum = (viewplayer->mo->subsector->sector->lightlevel >> LIGHTSEGSHIFT)
-               + extralight;
+    lightnum = (rview.sector->lightlevel >> LIGHTSEGSHIFT) + extralight;
 
     if (lightnum < 0)
         spritelights = scalelight[0];
@@ -681,7 +827,7 @@ void R_DrawPlayerSprites(void)
     mceilingclip = negonearray;
 
     // add all active psprites
-    for (i = 0, psp = viewplayer->psprites; i < NUMPSPRITES; i++, psp++) {
+    for (i = 0, psp = rview.psprites; i < NUMPSPRITES; i++, psp++) {
         if (psp->state)
             R_DrawPSprite(psp);
     }
@@ -689,65 +835,112 @@ void R_DrawPlayerSprites(void)
 
 //
 // R_SortVisSprites
+// Links the vissprites into vsprsortedhead from the smallest scale to the
+//  largest, those of equal scale in the order they were made.
 //
 vissprite_t vsprsortedhead;
 
+// Sorted in place of the vissprites themselves, as they must stay in order.
+static vissprite_t **sortedvissprites;
+static int numsortedvissprites;
+
+static int CompareVisSprites(const void *a, const void *b)
+{
+    const vissprite_t *spr1 = *(vissprite_t *const *)a;
+    const vissprite_t *spr2 = *(vissprite_t *const *)b;
+
+    if (spr1->scale != spr2->scale)
+        return spr1->scale < spr2->scale ? -1 : 1;
+
+    // Keep the sort stable, so the order matches vanilla with equal scales.
+    return spr1 < spr2 ? -1 : spr1 > spr2;
+}
+
 void R_SortVisSprites(void)
 {
     int i;
     int count;
-    vissprite_t *ds;
-    vissprite_t *best;
-    // Static to quash compiler warnings about storing the address of a local;
-    // after the sort it should no longer be referenced by the list anyway.
-    static vissprite_t unsorted;
-    fixed_t bestscale;
+    vissprite_t *spr;
 
     count = vissprite_p - vissprites;
 
-    unsorted.next = unsorted.prev = &unsorted;
+    vsprsortedhead.next = vsprsortedhead.prev = &vsprsortedhead;
 
     if (!count)
         return;
 
-    for (ds = vissprites; ds < vissprite_p; ds++) {
-        ds->next = ds + 1;
-        ds->prev = ds - 1;
+    if (count > numsortedvissprites) {
+        numsortedvissprites = numvissprites;
+        sortedvissprites =
+            I_Realloc(sortedvissprites,
+                      numsortedvissprites * sizeof(*sortedvissprites));
     }
 
-    vissprites[0].prev = &unsorted;
-    unsorted.next = &vissprites[0];
-    (vissprite_p - 1)->next = &unsorted;
-    unsorted.prev = vissprite_p - 1;
+    for (i = 0; i < count; i++)
+        sortedvissprites[i] = &vissprites[i];
 
-    // pull the vissprites out by scale
+    qsort(sortedvissprites, count, sizeof(*sortedvissprites),
+          CompareVisSprites);
 
-    vsprsortedhead.next = vsprsortedhead.prev = &vsprsortedhead;
     for (i = 0; i < count; i++) {
-        bestscale = INT_MAX;
-        best = unsorted.next;
-        for (ds = unsorted.next; ds != &unsorted; ds = ds->next) {
-            if (ds->scale < bestscale) {
-                bestscale = ds->scale;
-                best = ds;
-            }
-        }
-        best->next->prev = best->prev;
-        best->prev->next = best->next;
-        best->next = &vsprsortedhead;
-        best->prev = vsprsortedhead.prev;
-        vsprsortedhead.prev->next = best;
-        vsprsortedhead.prev = best;
+        spr = sortedvissprites[i];
+        spr->next = &vsprsortedhead;
+        spr->prev = vsprsortedhead.prev;
+        vsprsortedhead.prev->next = spr;
+        vsprsortedhead.prev = spr;
     }
+}
 
-    assert(unsorted.next == &unsorted && unsorted.prev == &unsorted);
+//
+// R_BinDrawSegs
+// Buckets the drawsegs that can clip sprites (those with a silhouette or
+// masked mid texture) by the columns they cover, so that each sprite only
+// scans those overlapping it, rather than every drawseg.
+//
+#define DSBINSHIFT 4
+#define NUMDSBINS (MAXWIDTH >> DSBINSHIFT)
+
+// Indices into drawsegs of each bin's drawsegs, last stored first, from
+// dsbinstarts[bin] up to dsbinstarts[bin + 1].
+static int dsbinstarts[NUMDSBINS + 1];
+static int *dsbins;
+static int numdsbins;
+
+static void R_BinDrawSegs(void)
+{
+    drawseg_t *ds;
+    int bin;
+    int next[NUMDSBINS];
+
+    memset(dsbinstarts, 0, sizeof(dsbinstarts));
+    for (ds = drawsegs; ds < ds_p; ds++) {
+        if (!ds->silhouette && !ds->maskedtexturecol)
+            continue;
+        for (bin = ds->x1 >> DSBINSHIFT; bin <= ds->x2 >> DSBINSHIFT; bin++)
+            dsbinstarts[bin + 1]++;
+    }
+    for (bin = 0; bin < NUMDSBINS; bin++)
+        dsbinstarts[bin + 1] += dsbinstarts[bin];
+
+    if (dsbinstarts[NUMDSBINS] > numdsbins) {
+        numdsbins = 2 * dsbinstarts[NUMDSBINS];
+        dsbins = I_Realloc(dsbins, numdsbins * sizeof(*dsbins));
+    }
+
+    memcpy(next, dsbinstarts, sizeof(next));
+    for (ds = ds_p - 1; ds >= drawsegs; ds--) {
+        if (!ds->silhouette && !ds->maskedtexturecol)
+            continue;
+        for (bin = ds->x1 >> DSBINSHIFT; bin <= ds->x2 >> DSBINSHIFT; bin++)
+            dsbins[next[bin]++] = ds - drawsegs;
+    }
 }
 
 //
 // R_DrawSprite
 //
-static short clipbot[SCREENWIDTH];
-static short cliptop[SCREENWIDTH];
+static short clipbot[MAXWIDTH];
+static short cliptop[MAXWIDTH];
 void R_DrawSprite(vissprite_t *spr)
 {
     drawseg_t *ds;
@@ -757,14 +950,37 @@ void R_DrawSprite(vissprite_t *spr)
     fixed_t scale;
     fixed_t lowscale;
     int silhouette;
+    int bin, bin1, bin2, i;
+    int next[NUMDSBINS];
 
     for (x = spr->x1; x <= spr->x2; x++)
         clipbot[x] = cliptop[x] = -2;
 
+    bin1 = spr->x1 >> DSBINSHIFT;
+    bin2 = spr->x2 >> DSBINSHIFT;
+    for (bin = bin1; bin <= bin2; bin++)
+        next[bin] = dsbinstarts[bin];
+
     // Scan drawsegs from end to start for obscuring segs.
     // The first drawseg that has a greater scale
     //  is the clip seg.
-    for (ds = ds_p - 1; ds >= drawsegs; ds--) {
+    // Those in the sprite's bins are merged, as ones covering more than one
+    //  are in each of them; the order matters, as masked mid textures are
+    //  drawn along the way.
+    while (true) {
+        i = -1;
+        for (bin = bin1; bin <= bin2; bin++) {
+            if (next[bin] < dsbinstarts[bin + 1] && dsbins[next[bin]] > i)
+                i = dsbins[next[bin]];
+        }
+        if (i < 0)
+            break;
+        for (bin = bin1; bin <= bin2; bin++) {
+            if (next[bin] < dsbinstarts[bin + 1] && dsbins[next[bin]] == i)
+                next[bin]++;
+        }
+        ds = drawsegs + i;
+
         // determine if the drawseg obscures the sprite
         if (ds->x1 > spr->x2 || ds->x2 < spr->x1
             || (!ds->silhouette && !ds->maskedtexturecol)) {
@@ -850,6 +1066,8 @@ void R_DrawMasked(void)
     R_SortVisSprites();
 
     if (vissprite_p > vissprites) {
+        R_BinDrawSegs();
+
         // draw all vissprites back to front
         for (spr = vsprsortedhead.next; spr != &vsprsortedhead;
              spr = spr->next) {
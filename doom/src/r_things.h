@@ -22,16 +22,18 @@
 #include "r_defs.h"
 #include "v_patch.h"
 
+// Initial size of the vissprite pool, which grows as needed.
 #define MAXVISSPRITES 128
 
-extern vissprite_t vissprites[MAXVISSPRITES];
+extern vissprite_t *vissprites;
 extern vissprite_t *vissprite_p;
+extern int numvissprites;
 extern vissprite_t vsprsortedhead;
 
 // Constant arrays used for psprite clipping
 //  and initializing clipping.
-extern short negonearray[SCREENWIDTH];
-extern short screenheightarray[SCREENWIDTH];
+extern short negonearray[MAXWIDTH];
+extern short screenheightarray[MAXWIDTH];
 
 // vars for R_DrawMaskedColumn
 extern short *mfloorclip;
@@ -43,10 +45,12 @@ extern fixed_t pspritescale;
 extern fixed_t pspriteiscale;
 
 void R_DrawMaskedColumn(column_t *column);
+void R_DrawMaskedPosts(const byte *source, const maskedpost_t *post,
+                       const maskedpost_t *end);
 
 void R_SortVisSprites(void);
 
-void R_AddSprites(sector_t *sec);
+void R_AddSprites(rsector_t *sec);
 void R_AddPSprites(void);
 void R_DrawSprites(void);
 void R_InitSprites(char **namelist);
@@ -0,0 +1,237 @@
+#include <string.h>
+
+#include "doomdata.h"
+#include "doomstat.h"
+#include "i_system.h"
+#include "r_main.h"
+#include "r_sky.h"
+#include "r_state.h"
+#include "r_view.h"
+
+extern int numtextures;
+extern int numflats;
+
+rsector_t *rsectors;
+rside_t *rsides;
+rline_t *rlines;
+rthing_t *rthings;
+
+rseg_t *rsegs;
+rsegcache_t *rsegcaches;
+rsubsector_t *rsubsectors;
+
+int *rflattranslation;
+int *rtexturetranslation;
+
+rview_t rview;
+
+static int maxrsectors;
+static int maxrsides;
+static int maxrlines;
+static int maxrthings;
+static int maxrsegs;
+static int maxrsegcaches;
+static int maxrsubsectors;
+
+// Sides, lines and the animations only change along with surfacegeneration,
+// so are only copied again when it does, or the level changes.
+static boolean surfacespublished;
+static int publishedgeneration;
+
+// Lines the view drew for the first time, by number.
+static int *mappedlines;
+static int nummappedlines;
+static int maxmappedlines;
+
+// Make room in array, which has room for *max elements of size bytes, for
+// count of them.
+static void *Reserve(void *array, int *max, int count, size_t size)
+{
+    if (count > *max) {
+        *max = count > 2 * *max ? count : 2 * *max;
+        array = I_Realloc(array, *max * size);
+    }
+
+    return array;
+}
+
+void R_InitLevelSegs(void)
+{
+    const seg_t *seg;
+    rseg_t *rseg;
+    int i;
+
+    rsegs = Reserve(rsegs, &maxrsegs, numsegs, sizeof(*rsegs));
+    rsegcaches =
+        Reserve(rsegcaches, &maxrsegcaches, numsegs, sizeof(*rsegcaches));
+    rsubsectors = Reserve(rsubsectors, &maxrsubsectors, numsubsectors,
+                          sizeof(*rsubsectors));
+
+    for (i = 0, seg = segs, rseg = rsegs; i < numsegs; i++, seg++, rseg++) {
+        rseg->v1 = *seg->v1;
+        rseg->v2 = *seg->v2;
+        rseg->backsector =
+            seg->backsector != NULL ? seg->backsector - sectors : -1;
+        rseg->sidedef = seg->sidedef - sides;
+        rseg->frontsector = seg->frontsector - sectors;
+        rseg->linedef = seg->linedef - lines;
+        rseg->angle = seg->angle;
+        rseg->offset = seg->offset;
+    }
+
+    memset(rsegcaches, 0, numsegs * sizeof(*rsegcaches));
+
+    for (i = 0; i < numsubsectors; i++) {
+        rsubsectors[i].sector = subsectors[i].sector - sectors;
+        // Past 32767 segs, only read as unsigned do these make sense.
+        rsubsectors[i].firstline = (unsigned short)subsectors[i].firstline;
+        rsubsectors[i].numlines = (unsigned short)subsectors[i].numlines;
+    }
+}
+
+static void PublishThing(rthing_t *rthing, const sectorthing_t *st)
+{
+    const mobj_t *thing = st->mobj;
+
+    if (fractionaltic < FRACUNIT) {
+        rthing->x = R_Interpolate(thing->oldx, thing->x);
+        rthing->y = R_Interpolate(thing->oldy, thing->y);
+        rthing->z = R_Interpolate(thing->oldz, thing->z);
+        rthing->angle = R_InterpolateAngle(thing->oldangle, thing->angle);
+    } else {
+        rthing->x = st->x;
+        rthing->y = st->y;
+        rthing->z = thing->z;
+        rthing->angle = thing->angle;
+    }
+
+    rthing->sprite = thing->sprite;
+    rthing->frame = thing->frame;
+    rthing->flags = thing->flags;
+}
+
+static void PublishSurfaces(void)
+{
+    int i;
+
+    rsides = Reserve(rsides, &maxrsides, numsides, sizeof(*rsides));
+
+    for (i = 0; i < numsides; i++) {
+        rsides[i].textureoffset = sides[i].textureoffset;
+        rsides[i].rowoffset = sides[i].rowoffset;
+        rsides[i].toptexture = sides[i].toptexture;
+        rsides[i].bottomtexture = sides[i].bottomtexture;
+        rsides[i].midtexture = sides[i].midtexture;
+    }
+
+    rlines = Reserve(rlines, &maxrlines, numlines, sizeof(*rlines));
+
+    for (i = 0; i < numlines; i++)
+        rlines[i].flags = lines[i].flags;
+
+    if (rtexturetranslation == NULL) {
+        rtexturetranslation = I_Realloc(
+            NULL, (numtextures + 1) * sizeof(*rtexturetranslation));
+        rflattranslation =
+            I_Realloc(NULL, (numflats + 1) * sizeof(*rflattranslation));
+    }
+
+    memcpy(rtexturetranslation, texturetranslation,
+           (numtextures + 1) * sizeof(*rtexturetranslation));
+    memcpy(rflattranslation, flattranslation,
+           (numflats + 1) * sizeof(*rflattranslation));
+
+    surfacespublished = true;
+    publishedgeneration = surfacegeneration;
+}
+
+static void PublishPlayer(player_t *player)
+{
+    mobj_t *mo = player->mo;
+
+    if (fractionaltic < FRACUNIT) {
+        rview.x = R_Interpolate(mo->oldx, mo->x);
+        rview.y = R_Interpolate(mo->oldy, mo->y);
+        rview.angle = R_InterpolateAngle(mo->oldangle, mo->angle);
+        rview.z = R_Interpolate(player->oldviewz, player->viewz);
+    } else {
+        rview.x = mo->x;
+        rview.y = mo->y;
+        rview.angle = mo->angle;
+        rview.z = player->viewz;
+    }
+
+    rview.angle += viewangleoffset;
+    rview.extralight = player->extralight;
+    rview.fixedcolormap = player->fixedcolormap;
+    rview.sector = RSECTOR(mo->subsector->sector);
+
+    memcpy(rview.psprites, player->psprites, sizeof(rview.psprites));
+    rview.shadowpsprites = player->powers[pw_invisibility] > 4 * 32
+                           || player->powers[pw_invisibility] & 8;
+
+    rview.skytexture = skytexture;
+}
+
+void R_PublishView(player_t *player)
+{
+    sector_t *sec;
+    rsector_t *rsec;
+    int numthings;
+    int i;
+    int j;
+
+    if (numsectors > maxrsectors) {
+        rsectors = I_Realloc(rsectors, numsectors * sizeof(*rsectors));
+        memset(rsectors + maxrsectors, 0,
+               (numsectors - maxrsectors) * sizeof(*rsectors));
+        maxrsectors = numsectors;
+    }
+
+    numthings = 0;
+
+    for (i = 0, sec = sectors, rsec = rsectors; i < numsectors;
+         i++, sec++, rsec++) {
+        rsec->floorheight = sec->floorheight;
+        rsec->ceilingheight = sec->ceilingheight;
+        rsec->floorpic = sec->floorpic;
+        rsec->ceilingpic = sec->ceilingpic;
+        rsec->lightlevel = sec->lightlevel;
+
+        rthings = Reserve(rthings, &maxrthings, numthings + sec->numthings,
+                          sizeof(*rthings));
+        rsec->firstthing = numthings;
+        rsec->numthings = sec->numthings;
+
+        for (j = 0; j < sec->numthings; j++)
+            PublishThing(&rthings[numthings++], &sec->things[j]);
+    }
+
+    if (!surfacespublished || publishedgeneration != surfacegeneration)
+        PublishSurfaces();
+
+    PublishPlayer(player);
+}
+
+void R_ClearView(void)
+{
+    R_FinishPlayerView();
+    surfacespublished = false;
+}
+
+void R_LineMapped(int linenum)
+{
+    mappedlines = Reserve(mappedlines, &maxmappedlines, nummappedlines + 1,
+                          sizeof(*mappedlines));
+    mappedlines[nummappedlines++] = linenum;
+}
+
+void R_MarkMappedLines(void)
+{
+    int i;
+
+    for (i = 0; i < nummappedlines; i++)
+        lines[mappedlines[i]].flags |= ML_MAPPED;
+
+    nummappedlines = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef __R_VIEW__
+#define __R_VIEW__
+
+#include "d_player.h"
+#include "r_defs.h"
+
+// The snapshot of the level views are drawn from, so one can be drawn on a
+// thread of its own while the next tics change the level; see r_state.h.
+
+// Build rsegs and rsubsectors from the level just loaded, after
+// P_GroupLines.
+void R_InitLevelSegs(void);
+
+// Copy what's changed of the level, its things and the player's view into
+// the snapshot. On the main thread, with no view being drawn.
+void R_PublishView(player_t *player);
+
+// Forget the snapshot, before the level it was taken from is freed; waits
+// for any view being drawn from it.
+void R_ClearView(void);
+
+// While drawing a view: note that line linenum was drawn for the first time,
+// for R_MarkMappedLines to show on the automap.
+void R_LineMapped(int linenum);
+
+// Once the view is drawn: mark the lines it drew ML_MAPPED.
+void R_MarkMappedLines(void);
+
+#endif
@@ -64,6 +64,17 @@ typedef struct {
     // handle of the sound being played
     int handle;
 
+    // Where the listener and origin were and the volume the sound had
+    // before adjusting for them, when its params were last worked out;
+    // they're only worked out again once one of them changes.
+    // last_volume is -1 before the first update.
+    fixed_t last_listener_x;
+    fixed_t last_listener_y;
+    angle_t last_listener_angle;
+    fixed_t last_origin_x;
+    fixed_t last_origin_y;
+    int last_volume;
+
 } channel_t;
 
 // The set of channels available
@@ -166,6 +177,17 @@ static void S_StopChannel(int cnum)
     }
 }
 
+void S_StopSounds(void)
+{
+    int cnum;
+
+    for (cnum = 0; cnum < snd_channels; cnum++) {
+        if (channels[cnum].sfxinfo) {
+            S_StopChannel(cnum);
+        }
+    }
+}
+
 //
 // Per level startup code.
 // Kills playing sounds at start of level,
@@ -174,16 +196,11 @@ static void S_StopChannel(int cnum)
 
 void S_Start(void)
 {
-    int cnum;
     int mnum;
 
     // kill all playing sounds at start of level
     //  (trust me - a good idea)
-    for (cnum = 0; cnum < snd_channels; cnum++) {
-        if (channels[cnum].sfxinfo) {
-            S_StopChannel(cnum);
-        }
-    }
+    S_StopSounds();
 
     // start new music for the level
     mus_paused = 0;
@@ -237,34 +254,37 @@ static int S_GetChannel(mobj_t *origin, sfxinfo_t *sfxinfo)
     // channel number to use
     int cnum;
 
+    // first channel of lower priority, in case none are open
+    int lowcnum;
+
     channel_t *c;
 
-    // Find an open channel
+    // Find an open channel, noting lower priority ones on the way
+    // rather than looking through them all again.
+    lowcnum = -1;
+
     for (cnum = 0; cnum < snd_channels; cnum++) {
         if (!channels[cnum].sfxinfo) {
             break;
         } else if (origin && channels[cnum].origin == origin) {
             S_StopChannel(cnum);
             break;
+        } else if (lowcnum < 0
+                   && channels[cnum].sfxinfo->priority >= sfxinfo->priority) {
+            lowcnum = cnum;
         }
     }
 
     // None available
     if (cnum == snd_channels) {
-        // Look for lower priority
-        for (cnum = 0; cnum < snd_channels; cnum++) {
-            if (channels[cnum].sfxinfo->priority >= sfxinfo->priority) {
-                break;
-            }
-        }
-
-        if (cnum == snd_channels) {
+        if (lowcnum < 0) {
             // FUCK!  No lower priority.  Sorry, Charlie.
             return -1;
-        } else {
-            // Otherwise, kick out lower priority.
-            S_StopChannel(cnum);
         }
+
+        // Otherwise, kick out lower priority.
+        cnum = lowcnum;
+        S_StopChannel(cnum);
     }
 
     c = &channels[cnum];
@@ -272,10 +292,35 @@ static int S_GetChannel(mobj_t *origin, sfxinfo_t *sfxinfo)
     // channel is decided to be cnum.
     c->sfxinfo = sfxinfo;
     c->origin = origin;
+    c->last_volume = -1;
 
     return cnum;
 }
 
+//
+// Whether a channel's listener, origin or volume changed since its params
+// were last worked out, noting them for next time.
+//
+
+static boolean S_ChannelMoved(channel_t *c, mobj_t *listener, int volume)
+{
+    if (c->last_volume == volume && c->last_listener_x == listener->x
+        && c->last_listener_y == listener->y
+        && c->last_listener_angle == listener->angle
+        && c->last_origin_x == c->origin->x
+        && c->last_origin_y == c->origin->y) {
+        return false;
+    }
+
+    c->last_listener_x = listener->x;
+    c->last_listener_y = listener->y;
+    c->last_listener_angle = listener->angle;
+    c->last_origin_x = c->origin->x;
+    c->last_origin_y = c->origin->y;
+    c->last_volume = volume;
+    return true;
+}
+
 //
 // Changes volume and stereo-separation variables
 //  from the norm of a sound effect to be played.
@@ -466,8 +511,9 @@ void S_UpdateSounds(mobj_t *listener)
                 }
 
                 // check non-local sounds for distance clipping
-                //  or modify their params
-                if (c->origin && listener != c->origin) {
+                //  or modify their params, if anything's moved
+                if (c->origin && listener != c->origin
+                    && S_ChannelMoved(c, listener, volume)) {
                     audible =
                         S_AdjustSoundParams(listener, c->origin, &volume, &sep);
 
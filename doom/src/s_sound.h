@@ -51,6 +51,9 @@ void S_StartSound(void *origin, int sound_id);
 // Stop sound for thing at <origin>
 void S_StopSound(mobj_t *origin);
 
+// Stop every sound effect, leaving the music playing.
+void S_StopSounds(void);
+
 // Start music using <music_id> from sounds.h
 void S_StartMusic(int music_id);
 
@@ -36,6 +36,7 @@ patch_t *sttminus;
 void STlib_init(void)
 {
     sttminus = (patch_t *)W_CacheLumpName("STTMINUS", PU_STATIC);
+    V_CachePatchSpans(sttminus);
 }
 
 // ?
@@ -236,7 +236,7 @@
 // Height, in lines.
 #define ST_OUTHEIGHT 1
 
-#define ST_MAPTITLEX (SCREENWIDTH - ST_MAPWIDTH * ST_CHATFONTWIDTH)
+#define ST_MAPTITLEX (ORIGWIDTH - ST_MAPWIDTH * ST_CHATFONTWIDTH)
 
 #define ST_MAPTITLEY 0
 #define ST_MAPHEIGHT 1
@@ -434,6 +434,7 @@ boolean ST_Responder(event_t *ev)
                         plyr->mo->health = 100;
 
                     plyr->health = 100;
+                    plyr->statusdirty = true;
                     plyr->message = STSTR_DQDON;
                 } else
                     plyr->message = STSTR_DQDOFF;
@@ -449,6 +450,7 @@ boolean ST_Responder(event_t *ev)
                 for (i = 0; i < NUMAMMO; i++)
                     plyr->ammo[i] = plyr->maxammo[i];
 
+                plyr->statusdirty = true;
                 plyr->message = STSTR_FAADDED;
             }
             // 'kfa' cheat for key full ammo
@@ -465,6 +467,7 @@ boolean ST_Responder(event_t *ev)
                 for (i = 0; i < NUMCARDS; i++)
                     plyr->cards[i] = true;
 
+                plyr->statusdirty = true;
                 plyr->message = STSTR_KFAADDED;
             }
             // 'mus' cheat for changing music
@@ -534,6 +537,7 @@ boolean ST_Responder(event_t *ev)
             else if (cht_CheckCheat(&cheat_choppers, ev->data2)) {
                 plyr->weaponowned[wp_chainsaw] = true;
                 plyr->powers[pw_invulnerability] = true;
+                plyr->statusdirty = true;
                 plyr->message = STSTR_CHOPPERS;
             }
             // 'mypos' for player position
@@ -822,7 +826,6 @@ static int st_palette = 0;
 void ST_doPaletteStuff(void)
 {
     int palette;
-    byte *pal;
     int cnt;
     int bzc;
 
@@ -872,8 +875,7 @@ void ST_doPaletteStuff(void)
 
     if (palette != st_palette) {
         st_palette = palette;
-        pal = (byte *)W_CacheLumpNum(lu_palette, PU_CACHE) + palette * 768;
-        I_SetPalette(pal);
+        I_SetPlaypal(palette);
     }
 }
 
@@ -1036,6 +1038,7 @@ static void ST_loadUnloadGraphics(load_callback_t callback)
 static void ST_loadCallback(char *lumpname, patch_t **variable)
 {
     *variable = W_CacheLumpName(lumpname, PU_STATIC);
+    V_CachePatchSpans(*variable);
 }
 
 void ST_loadGraphics(void)
@@ -1051,6 +1054,7 @@ void ST_loadData(void)
 
 static void ST_unloadCallback(char *lumpname, patch_t **variable)
 {
+    V_UncachePatchSpans(*variable);
     W_ReleaseLumpName(lumpname);
     *variable = NULL;
 }
@@ -1187,7 +1191,7 @@ void ST_Stop(void)
     if (st_stopped)
         return;
 
-    I_SetPalette(W_CacheLumpNum(lu_palette, PU_CACHE));
+    I_SetPlaypal(0);
 
     st_stopped = true;
 }
@@ -1195,5 +1199,6 @@ void ST_Stop(void)
 void ST_Init(void)
 {
     ST_loadData();
-    st_backing_screen = (byte *)Z_Malloc(ST_WIDTH * ST_HEIGHT, PU_STATIC, 0);
+    st_backing_screen = (byte *)Z_Malloc(
+        (ST_WIDTH << hires) * (ST_HEIGHT << hires), PU_STATIC, 0);
 }
@@ -28,9 +28,10 @@
 
 // Size of statusbar.
 // Now sensitive for scaling.
+// In original resolution pixels, like the rest of the UI.
 #define ST_HEIGHT 32
-#define ST_WIDTH SCREENWIDTH
-#define ST_Y (SCREENHEIGHT - ST_HEIGHT)
+#define ST_WIDTH ORIGWIDTH
+#define ST_Y (ORIGHEIGHT - ST_HEIGHT)
 
 //
 // STATUS BAR
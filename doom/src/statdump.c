@@ -19,10 +19,14 @@ buffer to a file.
 
 */
 
+#include <stdio.h>
 #include <string.h>
 
 #include "d_player.h"
+#include "doomgeneric.h"
+#include "doomstat.h"
 #include "m_argv.h"
+#include "m_misc.h"
 #include "statdump.h"
 
 /* Par times for E1M1-E1M9. */
@@ -35,23 +39,146 @@ static const int doom2_par_times[] = {
     30, 90, 120, 120, 90, 150, 120, 120, 270,
 };
 
+// Histograms of frame and tic times over the level being played, in buckets
+// of HISTBUCKETUS; the last also holds everything longer.
+
+#define HISTBUCKETUS 100
+#define HISTBUCKETS 1000
+
+typedef struct {
+    unsigned int buckets[HISTBUCKETS];
+    unsigned int count;
+    uint64_t max;
+} histogram_t;
+
+static histogram_t frametimes;
+static histogram_t tictimes;
+
 // Array of end-of-level statistics that have been captured.
 
 #define MAX_CAPTURES 32
 static wbstartstruct_t captured_stats[MAX_CAPTURES];
+static char captured_maps[MAX_CAPTURES][9];
+static duitimes_t captured_frames[MAX_CAPTURES];
+static duitimes_t captured_tics[MAX_CAPTURES];
 static int num_captured_stats = 0;
 
+static void AddTime(histogram_t *hist, uint64_t us)
+{
+    uint64_t bucket = us / HISTBUCKETUS;
+
+    ++hist->buckets[bucket < HISTBUCKETS ? bucket : HISTBUCKETS - 1];
+    ++hist->count;
+    if (us > hist->max)
+        hist->max = us;
+}
+
+void StatFrameTime(uint64_t us)
+{
+    AddTime(&frametimes, us);
+}
+
+void StatTicTime(uint64_t us)
+{
+    AddTime(&tictimes, us);
+}
+
+// Upper bound of the bucket holding the time that percent of them are within.
+static unsigned int Percentile(const histogram_t *hist, int percent)
+{
+    uint64_t want = ((uint64_t)hist->count * percent + 99) / 100;
+    uint64_t seen = 0;
+    uint64_t us;
+    int i;
+
+    for (i = 0; i < HISTBUCKETS - 1; ++i) {
+        seen += hist->buckets[i];
+        if (seen >= want)
+            break;
+    }
+
+    us = (uint64_t)(i + 1) * HISTBUCKETUS;
+    return us < hist->max ? us : hist->max;
+}
+
+static void GetTimes(duitimes_t *times, histogram_t *hist)
+{
+    times->count = hist->count;
+    times->p50 = Percentile(hist, 50);
+    times->p95 = Percentile(hist, 95);
+    times->p99 = Percentile(hist, 99);
+    times->max = hist->max;
+
+    memset(hist, 0, sizeof(*hist));
+}
+
 void StatCopy(wbstartstruct_t *stats)
 {
+    char map[9];
+    duitimes_t frames, tics;
+
+    if (gamemode == commercial)
+        M_snprintf(map, sizeof(map), "MAP%02d", stats->last + 1);
+    else
+        M_snprintf(map, sizeof(map), "E%dM%d", stats->epsd + 1,
+                   stats->last + 1);
+
+    GetTimes(&frames, &frametimes);
+    GetTimes(&tics, &tictimes);
+    DG_OnLevelTimes(map, &frames, &tics);
+
     if (M_ParmExists("-statdump") && num_captured_stats < MAX_CAPTURES) {
         memcpy(&captured_stats[num_captured_stats], stats,
                sizeof(wbstartstruct_t));
+        M_StringCopy(captured_maps[num_captured_stats], map,
+                     sizeof(captured_maps[0]));
+        captured_frames[num_captured_stats] = frames;
+        captured_tics[num_captured_stats] = tics;
         ++num_captured_stats;
     }
 }
 
+static void PrintTimes(FILE *stream, const char *name, const duitimes_t *times)
+{
+    fprintf(stream,
+            "%s: %u, p50 %.1fms, p95 %.1fms, p99 %.1fms, max %.1fms\n", name,
+            times->count, times->p50 / 1000.0, times->p95 / 1000.0,
+            times->p99 / 1000.0, times->max / 1000.0);
+}
+
+// Writes how long the frames and tics of each level took to the -statdump
+// file, or stdout if it's "-".
 void StatDump(void)
 {
+    FILE *dumpfile;
+    int p;
+    int i;
+
     (void)doom1_par_times;
     (void)doom2_par_times;
+
+    p = M_CheckParmWithArgs("-statdump", 1);
+    if (!p || num_captured_stats == 0)
+        return;
+
+    if (strcmp(myargv[p + 1], "-") == 0) {
+        dumpfile = stdout;
+    } else {
+        dumpfile = fopen(myargv[p + 1], "w");
+        if (dumpfile == NULL) {
+            fprintf(stderr, "StatDump: Failed to open %s for writing\n",
+                    myargv[p + 1]);
+            return;
+        }
+    }
+
+    for (i = 0; i < num_captured_stats; ++i) {
+        fprintf(dumpfile, "=== %s ===\n", captured_maps[i]);
+        PrintTimes(dumpfile, "Frames", &captured_frames[i]);
+        PrintTimes(dumpfile, "Tics", &captured_tics[i]);
+        fprintf(dumpfile, "\n");
+    }
+
+    if (dumpfile != stdout)
+        fclose(dumpfile);
 }
@@ -17,9 +17,16 @@ GNU General Public License for more details.
 #ifndef DOOM_STATDUMP_H
 #define DOOM_STATDUMP_H
 
+#include <stdint.h>
+
 #include "d_player.h"
 
 void StatCopy(wbstartstruct_t *stats);
 void StatDump(void);
 
+// Time taken by frames (from one to the next) and tics while in a level,
+// reported per level by StatCopy.
+void StatFrameTime(uint64_t us);
+void StatTicTime(uint64_t us);
+
 #endif /* #ifndef DOOM_STATDUMP_H */
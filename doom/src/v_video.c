@@ -20,12 +20,14 @@
 //
 
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "config.h"
 #include "doomtype.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_thread.h"
 #include "i_video.h"
 #include "m_bbox.h"
 #include "m_misc.h"
@@ -67,16 +69,18 @@ void V_CopyRect(int srcx, int srcy, byte *source, int width, int height,
     byte *dest;
 
 #ifdef RANGECHECK
-    if (srcx < 0 || srcx + width > SCREENWIDTH || srcy < 0
-        || srcy + height > SCREENHEIGHT || destx < 0
-        || destx + width > SCREENWIDTH || desty < 0
-        || desty + height > SCREENHEIGHT) {
+    if (srcx < 0 || srcx + width > ORIGWIDTH || srcy < 0
+        || srcy + height > ORIGHEIGHT || destx < 0
+        || destx + width > ORIGWIDTH || desty < 0
+        || desty + height > ORIGHEIGHT) {
         I_Error("Bad V_CopyRect");
     }
 #endif
 
-    src = source + SCREENWIDTH * srcy + srcx;
-    dest = dest_screen + SCREENWIDTH * desty + destx;
+    src = source + ((SCREENWIDTH * srcy + srcx) << hires);
+    dest = dest_screen + ((SCREENWIDTH * desty + destx) << hires);
+    width <<= hires;
+    height <<= hires;
 
     for (; height > 0; height--) {
         memcpy(dest, src, width);
@@ -100,6 +104,216 @@ void V_SetPatchClipCallback(vpatchclipfunc_t func)
     patchclip_callback = func;
 }
 
+//
+// Patch span cache
+//
+// Patches that stay in memory, like the status bar and heads-up font, can be
+// registered with V_CachePatchSpans. The first time one is drawn it is
+// rasterised at the hires scale into rows of opaque spans, which V_DrawPatch
+// then copies a span at a time rather than walking the posts pixel by pixel.
+//
+
+typedef struct {
+    short x;
+    short length;
+    int data; // offset into pixels
+} vpatchspan_t;
+
+typedef struct {
+    int height;
+    int *rows; // height + 1 indices into spans
+    vpatchspan_t *spans;
+    byte *pixels;
+} vpatchspans_t;
+
+// Must be a power of two.
+#define PATCHSPANSLOTS 1024
+
+typedef struct {
+    patch_t *patch;
+    vpatchspans_t *spans;
+} vpatchspanslot_t;
+
+static vpatchspanslot_t patchspanslots[PATCHSPANSLOTS];
+
+// Left in a slot when its patch is uncached, so probing continues past it.
+static patch_t patchspanremoved;
+
+static vpatchspanslot_t *V_FindPatchSpanSlot(patch_t *patch)
+{
+    unsigned int i;
+    unsigned int n;
+    vpatchspanslot_t *slot;
+
+    i = (unsigned int)(((uintptr_t)patch >> 4) * 2654435761u);
+    for (n = 0; n < PATCHSPANSLOTS; n++, i++) {
+        slot = &patchspanslots[i & (PATCHSPANSLOTS - 1)];
+        if (slot->patch == patch)
+            return slot;
+        if (!slot->patch)
+            return NULL;
+    }
+    return NULL;
+}
+
+void V_CachePatchSpans(patch_t *patch)
+{
+    unsigned int i;
+    unsigned int n;
+    vpatchspanslot_t *slot;
+
+    if (V_FindPatchSpanSlot(patch))
+        return;
+
+    // The spans themselves are only built when the patch is first drawn, so
+    // this is cheap to call while loading. A full table just means patches
+    // are drawn the slow way.
+    i = (unsigned int)(((uintptr_t)patch >> 4) * 2654435761u);
+    for (n = 0; n < PATCHSPANSLOTS; n++, i++) {
+        slot = &patchspanslots[i & (PATCHSPANSLOTS - 1)];
+        if (!slot->patch || slot->patch == &patchspanremoved) {
+            slot->patch = patch;
+            slot->spans = NULL;
+            return;
+        }
+    }
+}
+
+void V_UncachePatchSpans(patch_t *patch)
+{
+    vpatchspanslot_t *slot;
+
+    slot = V_FindPatchSpanSlot(patch);
+    if (!slot)
+        return;
+
+    if (slot->spans)
+        Z_Free(slot->spans);
+    slot->patch = &patchspanremoved;
+    slot->spans = NULL;
+}
+
+static vpatchspans_t *V_BuildPatchSpans(patch_t *patch)
+{
+    static byte *image;
+    static byte *opaque;
+    static int imagesize;
+    vpatchspans_t *result;
+    vpatchspan_t *span;
+    column_t *column;
+    byte *source;
+    int w, h;
+    int x, y;
+    int count;
+    int numspans;
+    int numpixels;
+    int i;
+
+    // Posts can run past the patch's height, which the column drawer doesn't
+    // clip either.
+    w = SHORT(patch->width) << hires;
+    h = SHORT(patch->height);
+    for (x = 0; x < SHORT(patch->width); x++) {
+        column = (column_t *)((byte *)patch + LONG(patch->columnofs[x]));
+        for (; column->topdelta != 0xff;
+             column = (column_t *)((byte *)column + column->length + 4)) {
+            if (column->topdelta + column->length > h)
+                h = column->topdelta + column->length;
+        }
+    }
+    h <<= hires;
+
+    if (w * h > imagesize) {
+        imagesize = w * h;
+        image = I_Realloc(image, imagesize);
+        opaque = I_Realloc(opaque, imagesize);
+    }
+    memset(opaque, 0, w * h);
+
+    // Rasterise the posts exactly as V_DrawPatch's column loop would.
+    for (x = 0; x < w; x++) {
+        column =
+            (column_t *)((byte *)patch + LONG(patch->columnofs[x >> hires]));
+
+        while (column->topdelta != 0xff) {
+            source = (byte *)column + 3;
+            y = column->topdelta << hires;
+            count = column->length << hires;
+            for (i = 0; i < count; i++) {
+                image[(y + i) * w + x] = source[i >> hires];
+                opaque[(y + i) * w + x] = 1;
+            }
+            column = (column_t *)((byte *)column + column->length + 4);
+        }
+    }
+
+    numspans = 0;
+    numpixels = 0;
+    for (i = 0; i < w * h; i++) {
+        if (opaque[i]) {
+            ++numpixels;
+            if (i % w == 0 || !opaque[i - 1])
+                ++numspans;
+        }
+    }
+
+    result = Z_Malloc(sizeof(*result) + (h + 1) * sizeof(*result->rows)
+                          + numspans * sizeof(*result->spans) + numpixels,
+                      PU_STATIC, NULL);
+    result->height = h;
+    result->rows = (int *)(result + 1);
+    result->spans = (vpatchspan_t *)(result->rows + h + 1);
+    result->pixels = (byte *)(result->spans + numspans);
+
+    span = result->spans;
+    numpixels = 0;
+    for (y = 0; y < h; y++) {
+        result->rows[y] = span - result->spans;
+        for (x = 0; x < w; x++) {
+            if (!opaque[y * w + x])
+                continue;
+            span->x = x;
+            span->data = numpixels;
+            while (x < w && opaque[y * w + x])
+                result->pixels[numpixels++] = image[y * w + x++];
+            span->length = numpixels - span->data;
+            ++span;
+        }
+    }
+    result->rows[h] = numspans;
+
+    return result;
+}
+
+static void V_DrawPatchSpans(byte *desttop, vpatchspans_t *spans)
+{
+    vpatchspan_t *span;
+    vpatchspan_t *end;
+    byte *source;
+    byte *dest;
+    int count;
+    int y;
+
+    for (y = 0; y < spans->height; y++, desttop += SCREENWIDTH) {
+        span = spans->spans + spans->rows[y];
+        end = spans->spans + spans->rows[y + 1];
+        for (; span < end; span++) {
+            source = spans->pixels + span->data;
+            dest = desttop + span->x;
+            count = span->length;
+
+            // Most spans in small graphics are a few pixels wide, where a
+            // plain loop beats calling memcpy.
+            if (count < 16) {
+                while (count--)
+                    *dest++ = *source++;
+            } else {
+                memcpy(dest, source, count);
+            }
+        }
+    }
+}
+
 //
 // V_DrawPatch
 // Masks a column based masked pic to the screen.
@@ -114,6 +328,9 @@ void V_DrawPatch(int x, int y, patch_t *patch)
     byte *dest;
     byte *source;
     int w;
+    int i;
+    int pitch = SCREENWIDTH;
+    vpatchspanslot_t *slot;
 
     y -= SHORT(patch->topoffset);
     x -= SHORT(patch->leftoffset);
@@ -125,8 +342,8 @@ void V_DrawPatch(int x, int y, patch_t *patch)
     }
 
 #ifdef RANGECHECK
-    if (x < 0 || x + SHORT(patch->width) > SCREENWIDTH || y < 0
-        || y + SHORT(patch->height) > SCREENHEIGHT) {
+    if (x < 0 || x + SHORT(patch->width) > ORIGWIDTH || y < 0
+        || y + SHORT(patch->height) > ORIGHEIGHT) {
         I_Error("Bad V_DrawPatch x=%i y=%i patch.width=%i patch.height=%i "
                 "topoffset=%i leftoffset=%i",
                 x, y, patch->width, patch->height, patch->topoffset,
@@ -135,22 +352,32 @@ void V_DrawPatch(int x, int y, patch_t *patch)
 #endif
 
     col = 0;
-    desttop = dest_screen + y * SCREENWIDTH + x;
+    desttop = dest_screen + ((y * SCREENWIDTH + x) << hires);
 
-    w = SHORT(patch->width);
+    slot = V_FindPatchSpanSlot(patch);
+    if (slot) {
+        if (!slot->spans)
+            slot->spans = V_BuildPatchSpans(patch);
+        V_DrawPatchSpans(desttop, slot->spans);
+        return;
+    }
 
-    for (; col < w; x++, col++, desttop++) {
-        column = (column_t *)((byte *)patch + LONG(patch->columnofs[col]));
+    w = SHORT(patch->width) << hires;
+
+    for (; col < w; col++, desttop++) {
+        column =
+            (column_t *)((byte *)patch + LONG(patch->columnofs[col >> hires]));
 
         // step through the posts in a column
         while (column->topdelta != 0xff) {
             source = (byte *)column + 3;
-            dest = desttop + column->topdelta * SCREENWIDTH;
-            count = column->length;
+            dest = desttop + (column->topdelta * pitch << hires);
+            count = column->length << hires;
+            i = 0;
 
             while (count--) {
-                *dest = *source++;
-                dest += SCREENWIDTH;
+                *dest = source[i++ >> hires];
+                dest += pitch;
             }
             column = (column_t *)((byte *)column + column->length + 4);
         }
@@ -172,6 +399,8 @@ void V_DrawPatchFlipped(int x, int y, patch_t *patch)
     byte *dest;
     byte *source;
     int w;
+    int i;
+    int pitch = SCREENWIDTH;
 
     y -= SHORT(patch->topoffset);
     x -= SHORT(patch->leftoffset);
@@ -183,30 +412,31 @@ void V_DrawPatchFlipped(int x, int y, patch_t *patch)
     }
 
 #ifdef RANGECHECK
-    if (x < 0 || x + SHORT(patch->width) > SCREENWIDTH || y < 0
-        || y + SHORT(patch->height) > SCREENHEIGHT) {
+    if (x < 0 || x + SHORT(patch->width) > ORIGWIDTH || y < 0
+        || y + SHORT(patch->height) > ORIGHEIGHT) {
         I_Error("Bad V_DrawPatchFlipped");
     }
 #endif
 
     col = 0;
-    desttop = dest_screen + y * SCREENWIDTH + x;
+    desttop = dest_screen + ((y * SCREENWIDTH + x) << hires);
 
-    w = SHORT(patch->width);
+    w = SHORT(patch->width) << hires;
 
-    for (; col < w; x++, col++, desttop++) {
-        column =
-            (column_t *)((byte *)patch + LONG(patch->columnofs[w - 1 - col]));
+    for (; col < w; col++, desttop++) {
+        column = (column_t *)((byte *)patch
+                              + LONG(patch->columnofs[(w - 1 - col) >> hires]));
 
         // step through the posts in a column
         while (column->topdelta != 0xff) {
             source = (byte *)column + 3;
-            dest = desttop + column->topdelta * SCREENWIDTH;
-            count = column->length;
+            dest = desttop + (column->topdelta * pitch << hires);
+            count = column->length << hires;
+            i = 0;
 
             while (count--) {
-                *dest = *source++;
-                dest += SCREENWIDTH;
+                *dest = source[i++ >> hires];
+                dest += pitch;
             }
             column = (column_t *)((byte *)column + column->length + 4);
         }
@@ -235,32 +465,36 @@ void V_DrawTLPatch(int x, int y, patch_t *patch)
     column_t *column;
     byte *desttop, *dest, *source;
     int w;
+    int i;
+    int pitch = SCREENWIDTH;
 
     y -= SHORT(patch->topoffset);
     x -= SHORT(patch->leftoffset);
 
-    if (x < 0 || x + SHORT(patch->width) > SCREENWIDTH || y < 0
-        || y + SHORT(patch->height) > SCREENHEIGHT) {
+    if (x < 0 || x + SHORT(patch->width) > ORIGWIDTH || y < 0
+        || y + SHORT(patch->height) > ORIGHEIGHT) {
         I_Error("Bad V_DrawTLPatch");
     }
 
     col = 0;
-    desttop = dest_screen + y * SCREENWIDTH + x;
+    desttop = dest_screen + ((y * SCREENWIDTH + x) << hires);
 
-    w = SHORT(patch->width);
-    for (; col < w; x++, col++, desttop++) {
-        column = (column_t *)((byte *)patch + LONG(patch->columnofs[col]));
+    w = SHORT(patch->width) << hires;
+    for (; col < w; col++, desttop++) {
+        column =
+            (column_t *)((byte *)patch + LONG(patch->columnofs[col >> hires]));
 
         // step through the posts in a column
 
         while (column->topdelta != 0xff) {
             source = (byte *)column + 3;
-            dest = desttop + column->topdelta * SCREENWIDTH;
-            count = column->length;
+            dest = desttop + (column->topdelta * pitch << hires);
+            count = column->length << hires;
+            i = 0;
 
             while (count--) {
-                *dest = tinttable[((*dest) << 8) + *source++];
-                dest += SCREENWIDTH;
+                *dest = tinttable[((*dest) << 8) + source[i++ >> hires]];
+                dest += pitch;
             }
             column = (column_t *)((byte *)column + column->length + 4);
         }
@@ -279,6 +513,8 @@ void V_DrawXlaPatch(int x, int y, patch_t *patch)
     column_t *column;
     byte *desttop, *dest, *source;
     int w;
+    int i;
+    int pitch = SCREENWIDTH;
 
     y -= SHORT(patch->topoffset);
     x -= SHORT(patch->leftoffset);
@@ -289,23 +525,24 @@ void V_DrawXlaPatch(int x, int y, patch_t *patch)
     }
 
     col = 0;
-    desttop = dest_screen + y * SCREENWIDTH + x;
+    desttop = dest_screen + ((y * SCREENWIDTH + x) << hires);
 
-    w = SHORT(patch->width);
-    for (; col < w; x++, col++, desttop++) {
-        column = (column_t *)((byte *)patch + LONG(patch->columnofs[col]));
+    w = SHORT(patch->width) << hires;
+    for (; col < w; col++, desttop++) {
+        column =
+            (column_t *)((byte *)patch + LONG(patch->columnofs[col >> hires]));
 
         // step through the posts in a column
 
         while (column->topdelta != 0xff) {
             source = (byte *)column + 3;
-            dest = desttop + column->topdelta * SCREENWIDTH;
-            count = column->length;
+            dest = desttop + (column->topdelta * pitch << hires);
+            count = column->length << hires;
+            i = 0;
 
             while (count--) {
-                *dest = xlatab[*dest + ((*source) << 8)];
-                source++;
-                dest += SCREENWIDTH;
+                *dest = xlatab[*dest + (source[i++ >> hires] << 8)];
+                dest += pitch;
             }
             column = (column_t *)((byte *)column + column->length + 4);
         }
@@ -324,32 +561,36 @@ void V_DrawAltTLPatch(int x, int y, patch_t *patch)
     column_t *column;
     byte *desttop, *dest, *source;
     int w;
+    int i;
+    int pitch = SCREENWIDTH;
 
     y -= SHORT(patch->topoffset);
     x -= SHORT(patch->leftoffset);
 
-    if (x < 0 || x + SHORT(patch->width) > SCREENWIDTH || y < 0
-        || y + SHORT(patch->height) > SCREENHEIGHT) {
+    if (x < 0 || x + SHORT(patch->width) > ORIGWIDTH || y < 0
+        || y + SHORT(patch->height) > ORIGHEIGHT) {
         I_Error("Bad V_DrawAltTLPatch");
     }
 
     col = 0;
-    desttop = dest_screen + y * SCREENWIDTH + x;
+    desttop = dest_screen + ((y * SCREENWIDTH + x) << hires);
 
-    w = SHORT(patch->width);
-    for (; col < w; x++, col++, desttop++) {
-        column = (column_t *)((byte *)patch + LONG(patch->columnofs[col]));
+    w = SHORT(patch->width) << hires;
+    for (; col < w; col++, desttop++) {
+        column =
+            (column_t *)((byte *)patch + LONG(patch->columnofs[col >> hires]));
 
         // step through the posts in a column
 
         while (column->topdelta != 0xff) {
             source = (byte *)column + 3;
-            dest = desttop + column->topdelta * SCREENWIDTH;
-            count = column->length;
+            dest = desttop + (column->topdelta * pitch << hires);
+            count = column->length << hires;
+            i = 0;
 
             while (count--) {
-                *dest = tinttable[((*dest) << 8) + *source++];
-                dest += SCREENWIDTH;
+                *dest = tinttable[((*dest) << 8) + source[i++ >> hires]];
+                dest += pitch;
             }
             column = (column_t *)((byte *)column + column->length + 4);
         }
@@ -369,36 +610,40 @@ void V_DrawShadowedPatch(int x, int y, patch_t *patch)
     byte *desttop, *dest, *source;
     byte *desttop2, *dest2;
     int w;
+    int i;
+    int pitch = SCREENWIDTH;
 
     y -= SHORT(patch->topoffset);
     x -= SHORT(patch->leftoffset);
 
-    if (x < 0 || x + SHORT(patch->width) > SCREENWIDTH || y < 0
-        || y + SHORT(patch->height) > SCREENHEIGHT) {
+    if (x < 0 || x + SHORT(patch->width) > ORIGWIDTH || y < 0
+        || y + SHORT(patch->height) > ORIGHEIGHT) {
         I_Error("Bad V_DrawShadowedPatch");
     }
 
     col = 0;
-    desttop = dest_screen + y * SCREENWIDTH + x;
-    desttop2 = dest_screen + (y + 2) * SCREENWIDTH + x + 2;
+    desttop = dest_screen + ((y * SCREENWIDTH + x) << hires);
+    desttop2 = dest_screen + (((y + 2) * SCREENWIDTH + x + 2) << hires);
 
-    w = SHORT(patch->width);
-    for (; col < w; x++, col++, desttop++, desttop2++) {
-        column = (column_t *)((byte *)patch + LONG(patch->columnofs[col]));
+    w = SHORT(patch->width) << hires;
+    for (; col < w; col++, desttop++, desttop2++) {
+        column =
+            (column_t *)((byte *)patch + LONG(patch->columnofs[col >> hires]));
 
         // step through the posts in a column
 
         while (column->topdelta != 0xff) {
             source = (byte *)column + 3;
-            dest = desttop + column->topdelta * SCREENWIDTH;
-            dest2 = desttop2 + column->topdelta * SCREENWIDTH;
-            count = column->length;
+            dest = desttop + (column->topdelta * pitch << hires);
+            dest2 = desttop2 + (column->topdelta * pitch << hires);
+            count = column->length << hires;
+            i = 0;
 
             while (count--) {
                 *dest2 = tinttable[((*dest2) << 8)];
-                dest2 += SCREENWIDTH;
-                *dest = *source++;
-                dest += SCREENWIDTH;
+                dest2 += pitch;
+                *dest = source[i++ >> hires];
+                dest += pitch;
             }
             column = (column_t *)((byte *)column + column->length + 4);
         }
@@ -455,7 +700,9 @@ void V_DrawFilledBox(int x, int y, int w, int h, int c)
     uint8_t *buf, *buf1;
     int x1, y1;
 
-    buf = I_VideoBuffer + SCREENWIDTH * y + x;
+    buf = I_VideoBuffer + ((SCREENWIDTH * y + x) << hires);
+    w <<= hires;
+    h <<= hires;
 
     for (y1 = 0; y1 < h; ++y1) {
         buf1 = buf;
@@ -468,29 +715,16 @@ void V_DrawFilledBox(int x, int y, int w, int h, int c)
     }
 }
 
+// Lines are 1 << hires pixels thick.
+
 void V_DrawHorizLine(int x, int y, int w, int c)
 {
-    uint8_t *buf;
-    int x1;
-
-    buf = I_VideoBuffer + SCREENWIDTH * y + x;
-
-    for (x1 = 0; x1 < w; ++x1) {
-        *buf++ = c;
-    }
+    V_DrawFilledBox(x, y, w, 1, c);
 }
 
 void V_DrawVertLine(int x, int y, int h, int c)
 {
-    uint8_t *buf;
-    int y1;
-
-    buf = I_VideoBuffer + SCREENWIDTH * y + x;
-
-    for (y1 = 0; y1 < h; ++y1) {
-        *buf = c;
-        buf += SCREENWIDTH;
-    }
+    V_DrawFilledBox(x, y, 1, h, c);
 }
 
 void V_DrawBox(int x, int y, int w, int h, int c)
@@ -508,7 +742,18 @@ void V_DrawBox(int x, int y, int w, int h, int c)
 
 void V_DrawRawScreen(byte *raw)
 {
-    memcpy(dest_screen, raw, SCREENWIDTH * SCREENHEIGHT);
+    int x, y;
+
+    if (!hires) {
+        memcpy(dest_screen, raw, SCREENWIDTH * SCREENHEIGHT);
+        return;
+    }
+
+    for (y = 0; y < SCREENHEIGHT; y++) {
+        for (x = 0; x < SCREENWIDTH; x++)
+            dest_screen[y * SCREENWIDTH + x] =
+                raw[(y >> hires) * ORIGWIDTH + (x >> hires)];
+    }
 }
 
 //
@@ -521,6 +766,33 @@ void V_Init(void)
     // now handled in the upper layers.
 }
 
+//
+// V_SaveScreenCache
+// Copy the screen into cache, allocating it the first time.
+//
+
+void V_SaveScreenCache(vscreencache_t *cache)
+{
+    if (!cache->data)
+        cache->data = I_Realloc(NULL, SCREENWIDTH * SCREENHEIGHT);
+
+    memcpy(cache->data, dest_screen, SCREENWIDTH * SCREENHEIGHT);
+    cache->valid = true;
+}
+
+//
+// V_RestoreScreenCache
+//
+
+boolean V_RestoreScreenCache(vscreencache_t *cache)
+{
+    if (!cache->valid)
+        return false;
+
+    memcpy(dest_screen, cache->data, SCREENWIDTH * SCREENHEIGHT);
+    return true;
+}
+
 // Set the buffer that the code draws to.
 
 void V_UseBuffer(byte *buffer)
@@ -568,15 +840,17 @@ typedef struct {
 // WritePCXfile
 //
 
-void WritePCXfile(char *filename, byte *data, int width, int height,
-                  byte *palette)
+static boolean WritePCXfile(char *filename, byte *data, int width, int height,
+                            byte *palette)
 {
     int i;
     int length;
     pcx_t *pcx;
     byte *pack;
+    boolean ok;
 
-    pcx = Z_Malloc(width * height * 2 + 1000, PU_STATIC, NULL);
+    // Not from the zone, as screenshots are written on the I/O thread.
+    pcx = I_Realloc(NULL, width * height * 2 + 1000);
 
     pcx->manufacturer = 0x0a; // PCX id
     pcx->version = 5;         // 256 color
@@ -613,9 +887,10 @@ void WritePCXfile(char *filename, byte *data, int width, int height,
 
     // write output file
     length = pack - (byte *)pcx;
-    M_WriteFile(filename, pcx, length);
+    ok = M_WriteFile(filename, pcx, length);
 
-    Z_Free(pcx);
+    free(pcx);
+    return ok;
 }
 
 #ifdef HAVE_LIBPNG
@@ -633,8 +908,8 @@ static void warning_fn(png_structp p, png_const_charp s)
     printf("libpng warning: %s\n", s);
 }
 
-void WritePNGfile(char *filename, byte *data, int width, int height,
-                  byte *palette)
+static boolean WritePNGfile(char *filename, byte *data, int width, int height,
+                            byte *palette)
 {
     png_structp ppng;
     png_infop pinfo;
@@ -644,19 +919,21 @@ void WritePNGfile(char *filename, byte *data, int width, int height,
 
     handle = fopen(filename, "wb");
     if (!handle) {
-        return;
+        return false;
     }
 
     ppng = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, error_fn,
                                    warning_fn);
     if (!ppng) {
-        return;
+        fclose(handle);
+        return false;
     }
 
     pinfo = png_create_info_struct(ppng);
     if (!pinfo) {
         png_destroy_write_struct(&ppng, NULL);
-        return;
+        fclose(handle);
+        return false;
     }
 
     png_init_io(ppng, handle);
@@ -668,7 +945,8 @@ void WritePNGfile(char *filename, byte *data, int width, int height,
     pcolor = malloc(sizeof(*pcolor) * 256);
     if (!pcolor) {
         png_destroy_write_struct(&ppng, &pinfo);
-        return;
+        fclose(handle);
+        return false;
     }
 
     for (i = 0; i < 256; i++) {
@@ -688,20 +966,77 @@ void WritePNGfile(char *filename, byte *data, int width, int height,
 
     png_write_end(ppng, pinfo);
     png_destroy_write_struct(&ppng, &pinfo);
-    fclose(handle);
+    return fclose(handle) == 0;
 }
 #endif
 
 //
 // V_ScreenShot
 //
+// Screenshots are encoded and written on the I/O thread, so taking one doesn't
+// hold up the game. Taken as often as every tic by automated runs, so a few
+// can be pending at once, each with a copy of the screen; their buffers are
+// kept for the next.
+//
+
+#define MAX_PENDING_SHOTS 8
+
+typedef struct
+{
+    byte *data;
+    byte palette[256 * 3];
+    char filename[16];
+    boolean png;
+    boolean ok;
+    boolean pending;
+    unsigned int ticket;
+} screenshot_t;
+
+static screenshot_t shots[MAX_PENDING_SHOTS];
+static int nextshot; // Index of shots to use next; the oldest if pending.
+static int shotnumber; // No file is named with a number below this.
+static char shotmessage[32];
+
+static void WriteScreenShotJob(void *data)
+{
+    screenshot_t *shot = data;
+
+#ifdef HAVE_LIBPNG
+    if (shot->png) {
+        shot->ok = WritePNGfile(shot->filename, shot->data, SCREENWIDTH,
+                                SCREENHEIGHT, shot->palette);
+    } else
+#endif
+    {
+        // save the pcx file
+        shot->ok = WritePCXfile(shot->filename, shot->data, SCREENWIDTH,
+                                SCREENHEIGHT, shot->palette);
+    }
+}
+
+// Don't quit with screenshots half written.
+static void FinishScreenShots(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_PENDING_SHOTS; i++) {
+        if (shots[i].pending)
+            I_WaitIO(shots[i].ticket);
+    }
+}
 
 void V_ScreenShot(char *format)
 {
+    static boolean atexit_added;
+    screenshot_t *shot;
     int i;
-    char lbmname[16]; // haleyjd 20110213: BUG FIX - 12 is too small!
     char *ext;
 
+    if (!atexit_added) {
+        I_AtExit(FinishScreenShots, true);
+        atexit_added = true;
+    }
+
     // find a file name to save it to
 
 #ifdef HAVE_LIBPNG
@@ -714,29 +1049,63 @@ void V_ScreenShot(char *format)
         ext = "pcx";
     }
 
-    for (i = 0; i <= 99; i++) {
-        M_snprintf(lbmname, sizeof(lbmname), format, i, ext);
+    shot = &shots[nextshot];
+
+    if (shot->pending) {
+        // Every buffer is in use, so wait for the oldest.
+        I_WaitIO(shot->ticket);
+    }
 
-        if (!M_FileExists(lbmname)) {
+    // Files being written may not exist yet, so carry on from the last.
+    for (i = shotnumber; i <= 9999; i++) {
+        M_snprintf(shot->filename, sizeof(shot->filename), format, i, ext);
+
+        if (!M_FileExists(shot->filename)) {
             break; // file doesn't exist
         }
     }
 
-    if (i == 100) {
+    if (i == 10000) {
         I_Error("V_ScreenShot: Couldn't create a PCX");
     }
 
+    shotnumber = i + 1;
+    nextshot = (nextshot + 1) % MAX_PENDING_SHOTS;
+
+    if (shot->data == NULL) {
+        shot->data = I_Realloc(NULL, SCREENWIDTH * SCREENHEIGHT);
+    }
+    memcpy(shot->data, I_VideoBuffer, SCREENWIDTH * SCREENHEIGHT);
+    memcpy(shot->palette, W_CacheLumpName("PLAYPAL", PU_CACHE),
+           sizeof(shot->palette));
 #ifdef HAVE_LIBPNG
-    if (png_screenshots) {
-        WritePNGfile(lbmname, I_VideoBuffer, SCREENWIDTH, SCREENHEIGHT,
-                     W_CacheLumpName("PLAYPAL", PU_CACHE));
-    } else
+    shot->png = png_screenshots;
 #endif
-    {
-        // save the pcx file
-        WritePCXfile(lbmname, I_VideoBuffer, SCREENWIDTH, SCREENHEIGHT,
-                     W_CacheLumpName("PLAYPAL", PU_CACHE));
+    shot->pending = true;
+    shot->ticket = I_QueueIO(WriteScreenShotJob, shot);
+}
+
+char *V_ScreenShotWritten(void)
+{
+    screenshot_t *shot;
+    int i;
+
+    // Oldest first.
+    for (i = 0; i < MAX_PENDING_SHOTS; i++) {
+        shot = &shots[(nextshot + i) % MAX_PENDING_SHOTS];
+
+        if (!shot->pending || !I_IODone(shot->ticket)) {
+            continue;
+        }
+
+        shot->pending = false;
+        M_snprintf(shotmessage, sizeof(shotmessage),
+                   shot->ok ? "screen shot %s" : "couldn't write %s",
+                   shot->filename);
+        return shotmessage;
     }
+
+    return NULL;
 }
 
 #define MOUSE_SPEED_BOX_WIDTH 120
@@ -770,7 +1139,7 @@ void V_DrawMouseSpeedBox(int speed)
 
     // Calculate box position
 
-    box_x = SCREENWIDTH - MOUSE_SPEED_BOX_WIDTH - 10;
+    box_x = ORIGWIDTH - MOUSE_SPEED_BOX_WIDTH - 10;
     box_y = 15;
 
     V_DrawFilledBox(box_x, box_y, MOUSE_SPEED_BOX_WIDTH, MOUSE_SPEED_BOX_HEIGHT,
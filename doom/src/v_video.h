@@ -30,7 +30,7 @@
 // VIDEO
 //
 
-#define CENTERY (SCREENHEIGHT / 2)
+#define CENTERY (ORIGHEIGHT / 2)
 
 extern byte *tinttable;
 
@@ -43,6 +43,9 @@ void V_SetPatchClipCallback(vpatchclipfunc_t func);
 // Allocates buffer screens, call before R_Init.
 void V_Init(void);
 
+// Unless noted otherwise, positions and sizes are in original resolution
+// pixels, scaled by hires when drawn.
+
 // Draw a block from the specified source screen to the screen.
 
 void V_CopyRect(int srcx, int srcy, byte *source, int width, int height,
@@ -56,7 +59,14 @@ void V_DrawShadowedPatch(int x, int y, patch_t *patch);
 void V_DrawXlaPatch(int x, int y, patch_t *patch); // villsa [STRIFE]
 void V_DrawPatchDirect(int x, int y, patch_t *patch);
 
+// Have V_DrawPatch blit this patch from a cached copy split into rows of
+// opaque spans. The patch must stay in memory until it's uncached.
+
+void V_CachePatchSpans(patch_t *patch);
+void V_UncachePatchSpans(patch_t *patch);
+
 // Draw a linear block of pixels into the view buffer.
+// Unlike anything else here, this isn't scaled by hires.
 
 void V_DrawBlock(int x, int y, int width, int height, byte *src);
 
@@ -69,6 +79,20 @@ void V_DrawBox(int x, int y, int w, int h, int c);
 
 void V_DrawRawScreen(byte *raw);
 
+// A copy of the whole screen, for redrawing a static background with one copy
+// rather than drawing it again. Clear valid when the background changes.
+
+typedef struct {
+    byte *data;
+    boolean valid;
+} vscreencache_t;
+
+void V_SaveScreenCache(vscreencache_t *cache);
+
+// Returns false, drawing nothing, if the cache isn't valid.
+
+boolean V_RestoreScreenCache(vscreencache_t *cache);
+
 // Temporarily switch to using a different buffer to draw graphics, etc.
 
 void V_UseBuffer(byte *buffer);
@@ -83,6 +107,11 @@ void V_RestoreBuffer(void);
 
 void V_ScreenShot(char *format);
 
+// Screenshots are written in the background. Returns a message for one that
+// has been written since the last call, naming its file, or NULL if none has.
+
+char *V_ScreenShotWritten(void);
+
 // Load the lookup table for translucency calculations from the TINTTAB
 // lump.
 
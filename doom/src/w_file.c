@@ -47,17 +47,17 @@ static wad_file_class_t *wad_file_classes[] = {
     &stdc_wad_file,
 };
 
-wad_file_t *W_OpenFile(char *path)
+static wad_file_t *OpenFile(char *path)
 {
     wad_file_t *result;
     size_t i;
 
     //!
-    // Use the OS's virtual memory subsystem to map WAD files
-    // directly into memory.
+    // Read WAD files into memory instead of using the OS's virtual memory
+    // subsystem to map them directly.
     //
 
-    if (!M_CheckParm("-mmap")) {
+    if (M_CheckParm("-nommap")) {
         return stdc_wad_file.OpenFile(path);
     }
 
@@ -76,6 +76,25 @@ wad_file_t *W_OpenFile(char *path)
     return result;
 }
 
+wad_file_t *W_OpenFile(char *path)
+{
+    wad_file_t *result;
+    wad_file_t *zip;
+
+    result = OpenFile(path);
+
+    if (result != NULL && W_IsZipFile(path)) {
+        zip = W_OpenZip(result);
+        if (zip == NULL) {
+            printf("W_OpenFile: %s isn't a zip archive\n", path);
+            W_CloseFile(result);
+        }
+        result = zip;
+    }
+
+    return result;
+}
+
 void W_CloseFile(wad_file_t *wad)
 {
     wad->file_class->CloseFile(wad);
@@ -61,6 +61,13 @@ struct _wad_file_s {
 
 wad_file_t *W_OpenFile(char *path);
 
+// Zip archives (.zip and .pk3) are read as a WAD whose lumps are the entries,
+// see w_file_zip.c. W_OpenFile opens them with W_OpenZip, which takes over
+// an archive opened as an ordinary file, or returns NULL if it isn't one.
+
+boolean W_IsZipFile(const char *path);
+wad_file_t *W_OpenZip(wad_file_t *archive);
+
 // Close the specified WAD file.
 
 void W_CloseFile(wad_file_t *wad);
@@ -0,0 +1,380 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "i_system.h"
+#include "m_inflate.h"
+#include "w_file.h"
+#include "z_zone.h"
+
+// Zip archives (.zip or .pk3) are read as a PWAD of their entries in the
+// order they were added, each named after its file name without directories
+// or extension, so a WAD's lumps zipped in order load like the WAD. Reads
+// see a "virtual" WAD: the header and directory, made up when the archive is
+// opened, then every entry's data, stored or inflated on demand.
+
+#define WADHEADERSIZE 12
+#define WADDIRENTRYSIZE 16
+
+// End of central directory, its maximum comment, and the headers.
+#define EOCDSIZE 22
+#define MAXCOMMENT 65535
+#define EOCDSIG 0x06054b50
+#define CENTRALSIG 0x02014b50
+#define CENTRALSIZE 46
+#define LOCALSIG 0x04034b50
+#define LOCALSIZE 30
+
+#define METHOD_STORED 0
+#define METHOD_DEFLATED 8
+
+typedef struct {
+    unsigned int pos;   // in the virtual WAD
+    unsigned int size;  // once inflated
+    unsigned int csize; // in the archive
+    unsigned int local; // offset of the local header
+    unsigned int data;  // offset of the data, or 0 until it has been looked up
+    int method;
+} zipentry_t;
+
+typedef struct {
+    wad_file_t wad;
+    wad_file_t *archive;
+    zipentry_t *entries;
+    unsigned int numentries;
+    // The made up WAD header and directory.
+    byte *directory;
+    unsigned int dirlength;
+} zip_wad_file_t;
+
+extern wad_file_class_t zip_wad_file;
+
+// Compressed data read from unmapped archives, and the entry last inflated
+// for a read of part of it, so reading the rest doesn't inflate it again.
+static byte *inbuf;
+static unsigned int maxinbuf;
+static byte *partbuf;
+static unsigned int maxpartbuf;
+static const zipentry_t *partentry;
+
+static unsigned int Get16(const byte *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int Get32(const byte *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static void Put32(byte *p, unsigned int v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+}
+
+//
+// ARCHIVES
+//
+
+boolean W_IsZipFile(const char *path)
+{
+    size_t len;
+
+    len = strlen(path);
+
+    return len >= 4
+           && (!strcasecmp(path + len - 4, ".zip")
+               || !strcasecmp(path + len - 4, ".pk3"));
+}
+
+// Lump name from an entry's file name: the base, up to the extension.
+static void EntryName(const byte *name, unsigned int len, byte *dest)
+{
+    unsigned int start;
+    unsigned int i;
+
+    for (start = len; start > 0 && name[start - 1] != '/'; start--)
+        ;
+
+    memset(dest, 0, 8);
+
+    for (i = 0; i < 8 && start + i < len && name[start + i] != '.'; i++)
+        dest[i] = toupper(name[start + i]);
+}
+
+wad_file_t *W_OpenZip(wad_file_t *archive)
+{
+    zip_wad_file_t *result;
+    byte *tail;
+    byte *central;
+    byte *p;
+    byte *dir;
+    byte *names;
+    unsigned int taillen;
+    unsigned int centrallen;
+    unsigned int centralofs;
+    unsigned int numentries;
+    unsigned int pos;
+    unsigned int namelen;
+    zipentry_t *entry;
+    unsigned int i;
+
+    // Find the end of central directory record, after which there's only
+    // the archive's comment.
+
+    taillen = archive->length < EOCDSIZE + MAXCOMMENT ? archive->length
+                                                      : EOCDSIZE + MAXCOMMENT;
+    tail = Z_Malloc(taillen, PU_STATIC, NULL);
+
+    if (taillen < EOCDSIZE
+        || W_Read(archive, archive->length - taillen, tail, taillen)
+               < taillen) {
+        Z_Free(tail);
+        return NULL;
+    }
+
+    for (p = tail + taillen - EOCDSIZE; p >= tail; p--) {
+        if (Get32(p) == EOCDSIG)
+            break;
+    }
+
+    if (p < tail) {
+        Z_Free(tail);
+        return NULL;
+    }
+
+    numentries = Get16(p + 10);
+    centrallen = Get32(p + 12);
+    centralofs = Get32(p + 16);
+    Z_Free(tail);
+
+    if (numentries == 0xffff || centralofs == 0xffffffff) {
+        I_Error("W_OpenZip: Zip64 archives aren't supported");
+    }
+
+    central = Z_Malloc(centrallen, PU_STATIC, NULL);
+    if (W_Read(archive, centralofs, central, centrallen) < centrallen) {
+        Z_Free(central);
+        return NULL;
+    }
+
+    result = Z_Malloc(sizeof(zip_wad_file_t), PU_STATIC, NULL);
+    result->wad.file_class = &zip_wad_file;
+    result->wad.mapped = NULL;
+    result->archive = archive;
+    result->entries = Z_Malloc(numentries * sizeof(zipentry_t), PU_STATIC,
+                               NULL);
+    result->numentries = 0;
+
+    // Entries can't be named until the lumps are laid out after the
+    // directory, which is as long as how many entries aren't directories.
+    names = Z_Malloc(numentries * 8, PU_STATIC, NULL);
+    p = central;
+
+    for (i = 0; i < numentries; i++) {
+        if (p + CENTRALSIZE > central + centrallen || Get32(p) != CENTRALSIG) {
+            I_Error("W_OpenZip: Bad central directory");
+        }
+
+        namelen = Get16(p + 28);
+
+        if (namelen > 0 && p[CENTRALSIZE + namelen - 1] != '/') {
+            if (Get16(p + 8) & 1) {
+                I_Error("W_OpenZip: %.*s is encrypted", (int)namelen,
+                        p + CENTRALSIZE);
+            }
+
+            entry = &result->entries[result->numentries];
+            entry->method = Get16(p + 10);
+            entry->csize = Get32(p + 20);
+            entry->size = Get32(p + 24);
+            entry->local = Get32(p + 42);
+            entry->data = 0;
+
+            if (entry->method != METHOD_STORED
+                && entry->method != METHOD_DEFLATED) {
+                I_Error("W_OpenZip: %.*s uses unsupported compression "
+                        "method %i",
+                        (int)namelen, p + CENTRALSIZE, entry->method);
+            }
+
+            EntryName(p + CENTRALSIZE, namelen,
+                      names + result->numentries * 8);
+            result->numentries++;
+        }
+
+        p += CENTRALSIZE + namelen + Get16(p + 30) + Get16(p + 32);
+    }
+
+    Z_Free(central);
+
+    result->dirlength = WADHEADERSIZE + result->numentries * WADDIRENTRYSIZE;
+    result->directory = Z_Malloc(result->dirlength, PU_STATIC, NULL);
+
+    memcpy(result->directory, "PWAD", 4);
+    Put32(result->directory + 4, result->numentries);
+    Put32(result->directory + 8, WADHEADERSIZE);
+
+    dir = result->directory + WADHEADERSIZE;
+    pos = result->dirlength;
+
+    for (i = 0; i < result->numentries; i++) {
+        entry = &result->entries[i];
+        entry->pos = pos;
+        Put32(dir, pos);
+        Put32(dir + 4, entry->size);
+        memcpy(dir + 8, names + i * 8, 8);
+        dir += WADDIRENTRYSIZE;
+        pos += entry->size;
+    }
+
+    Z_Free(names);
+    result->wad.length = pos;
+
+    return &result->wad;
+}
+
+static void W_Zip_CloseFile(wad_file_t *wad)
+{
+    zip_wad_file_t *zip;
+
+    zip = (zip_wad_file_t *)wad;
+
+    if (partentry >= zip->entries
+        && partentry < zip->entries + zip->numentries)
+        partentry = NULL;
+
+    W_CloseFile(zip->archive);
+    Z_Free(zip->entries);
+    Z_Free(zip->directory);
+    Z_Free(zip);
+}
+
+// Read all of an entry into dest.
+static void ReadEntry(zip_wad_file_t *zip, zipentry_t *entry, byte *dest)
+{
+    byte local[LOCALSIZE];
+    const byte *in;
+
+    if (entry->data == 0) {
+        if (W_Read(zip->archive, entry->local, local, LOCALSIZE) < LOCALSIZE
+            || Get32(local) != LOCALSIG) {
+            I_Error("W_Read: Bad local header for zip entry %i",
+                    (int)(entry - zip->entries));
+        }
+        entry->data =
+            entry->local + LOCALSIZE + Get16(local + 26) + Get16(local + 28);
+    }
+
+    if (entry->method == METHOD_STORED) {
+        if (W_Read(zip->archive, entry->data, dest, entry->size)
+            < entry->size) {
+            I_Error("W_Read: Zip entry %i is truncated",
+                    (int)(entry - zip->entries));
+        }
+        return;
+    }
+
+    if (zip->archive->mapped != NULL
+        && entry->data + entry->csize <= zip->archive->length) {
+        in = zip->archive->mapped + entry->data;
+    } else {
+        if (entry->csize > maxinbuf) {
+            maxinbuf = entry->csize;
+            inbuf = I_Realloc(inbuf, maxinbuf);
+        }
+        if (W_Read(zip->archive, entry->data, inbuf, entry->csize)
+            < entry->csize) {
+            I_Error("W_Read: Zip entry %i is truncated",
+                    (int)(entry - zip->entries));
+        }
+        in = inbuf;
+    }
+
+    if (!M_Inflate(in, entry->csize, dest, entry->size)) {
+        I_Error("W_Read: Zip entry %i is corrupt",
+                (int)(entry - zip->entries));
+    }
+}
+
+// The last entry starting at or before pos, which holds pos unless it's past
+// the end.
+static zipentry_t *FindEntry(zip_wad_file_t *zip, unsigned int pos)
+{
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = zip->numentries;
+
+    while (hi - lo > 1) {
+        mid = (lo + hi) / 2;
+        if (zip->entries[mid].pos <= pos)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return &zip->entries[lo];
+}
+
+static size_t W_Zip_Read(wad_file_t *wad, unsigned int offset, void *buffer,
+                         size_t buffer_len)
+{
+    zip_wad_file_t *zip;
+    zipentry_t *entry;
+    byte *dest;
+    size_t result;
+    unsigned int skip;
+    unsigned int count;
+
+    zip = (zip_wad_file_t *)wad;
+    dest = buffer;
+    result = 0;
+
+    while (result < buffer_len && offset < wad->length) {
+        if (offset < zip->dirlength) {
+            count = zip->dirlength - offset;
+            if (count > buffer_len - result)
+                count = buffer_len - result;
+            memcpy(dest, zip->directory + offset, count);
+        } else {
+            entry = FindEntry(zip, offset);
+            skip = offset - entry->pos;
+            count = entry->size - skip;
+            if (count > buffer_len - result)
+                count = buffer_len - result;
+
+            if (skip == 0 && count == entry->size) {
+                ReadEntry(zip, entry, dest);
+            } else {
+                if (partentry != entry) {
+                    if (entry->size > maxpartbuf) {
+                        maxpartbuf = entry->size;
+                        partbuf = I_Realloc(partbuf, maxpartbuf);
+                    }
+                    ReadEntry(zip, entry, partbuf);
+                    partentry = entry;
+                }
+                memcpy(dest, partbuf + skip, count);
+            }
+        }
+
+        dest += count;
+        offset += count;
+        result += count;
+    }
+
+    return result;
+}
+
+// Archives are opened as ordinary files first, then with W_OpenZip.
+wad_file_class_t zip_wad_file = {
+    NULL,
+    W_Zip_CloseFile,
+    W_Zip_Read,
+};
@@ -0,0 +1,163 @@
+#include <pthread.h>
+
+#include "i_system.h"
+#include "i_thread.h"
+#include "w_prefetch.h"
+#include "w_wad.h"
+#include "z_zone.h"
+
+// Most bytes that may be waiting to be read at once. Lumps being read are
+// PU_STATIC, so this keeps a long precache from filling the zone with them.
+#define MAXPENDINGBYTES (1 << 20)
+
+// Lumps in memory-mapped files are paged in by reading a byte of each page.
+#define PAGESIZE 4096
+
+typedef struct {
+    int lump;
+    int read; // bytes read, set by the I/O thread
+} prefetch_t;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t read_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Lumps in the order they were asked for. The I/O thread has finished those
+// before numdone; the main thread has handed back those before numfinished.
+// Guarded by mutex, except that only the main thread writes queuelen and
+// numfinished.
+static prefetch_t *queue;
+static int queuelen;
+static int maxqueue;
+static int numdone;
+static int numfinished;
+
+// Size of the lumps queued but not handed back. Only used by the main thread.
+static int pendingbytes;
+
+static volatile byte pagesink;
+
+// An I/O job for each lump queued. As they're run in the order queued, each
+// reads the first lump not yet done.
+static void PrefetchJob(void *data)
+{
+    lumpinfo_t *lump;
+    int lumpnum;
+    int read;
+    int i;
+
+    (void)data;
+
+    pthread_mutex_lock(&mutex);
+    lumpnum = queue[numdone].lump;
+    pthread_mutex_unlock(&mutex);
+
+    lump = &lumpinfo[lumpnum];
+
+    if (lump->wad_file->mapped != NULL) {
+        for (i = 0; i < lump->size; i += PAGESIZE)
+            pagesink = lump->wad_file->mapped[lump->position + i];
+        read = lump->size;
+    } else {
+        W_LockReads();
+        read = W_Read(lump->wad_file, lump->position, lump->cache,
+                      lump->size);
+        W_UnlockReads();
+    }
+
+    pthread_mutex_lock(&mutex);
+    queue[numdone++].read = read;
+    pthread_cond_signal(&done_cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+// Hand back what the I/O thread has finished, after waiting for it to finish
+// something if wait is set.
+static void FinishDone(boolean wait)
+{
+    prefetch_t *p;
+    lumpinfo_t *lump;
+
+    pthread_mutex_lock(&mutex);
+
+    while (wait && numdone == numfinished)
+        pthread_cond_wait(&done_cond, &mutex);
+
+    for (; numfinished < numdone; numfinished++) {
+        p = &queue[numfinished];
+        lump = &lumpinfo[p->lump];
+
+        if (p->read < lump->size) {
+            I_Error("W_FinishPrefetches: only read %i of %i on lump %i",
+                    p->read, lump->size, p->lump);
+        }
+
+        if (lump->wad_file->mapped == NULL) {
+            lump->prefetching = false;
+            pendingbytes -= lump->size;
+            if (lump->pins == 0)
+                Z_ChangeTag(lump->cache, PU_CACHE);
+        }
+    }
+
+    // Start again from the front once the thread has caught up.
+    if (numfinished == queuelen)
+        queuelen = numdone = numfinished = 0;
+
+    pthread_mutex_unlock(&mutex);
+}
+
+void W_PrefetchLump(int lumpnum)
+{
+    lumpinfo_t *lump;
+
+    if ((unsigned)lumpnum >= numlumps) {
+        I_Error("W_PrefetchLump: %i >= numlumps", lumpnum);
+    }
+
+    lump = &lumpinfo[lumpnum];
+
+    if (lump->wad_file->mapped == NULL) {
+        if (lump->cache != NULL)
+            return;
+
+        while (pendingbytes > 0
+               && pendingbytes + lump->size > MAXPENDINGBYTES)
+            FinishDone(true);
+
+        lump->cache = Z_Malloc(lump->size, PU_STATIC, &lump->cache);
+        lump->prefetching = true;
+        pendingbytes += lump->size;
+    }
+
+    pthread_mutex_lock(&mutex);
+    if (queuelen == maxqueue) {
+        maxqueue = maxqueue ? 2 * maxqueue : 256;
+        queue = I_Realloc(queue, maxqueue * sizeof(*queue));
+    }
+    queue[queuelen++].lump = lumpnum;
+    pthread_mutex_unlock(&mutex);
+
+    I_QueueIO(PrefetchJob, NULL);
+}
+
+void W_FinishPrefetches(int lump)
+{
+    if (numfinished == queuelen)
+        return;
+
+    FinishDone(false);
+
+    while (lump >= 0 && lumpinfo[lump].prefetching)
+        FinishDone(true);
+}
+
+void W_LockReads(void)
+{
+    pthread_mutex_lock(&read_mutex);
+}
+
+void W_UnlockReads(void)
+{
+    pthread_mutex_unlock(&read_mutex);
+}
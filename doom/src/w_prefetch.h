@@ -0,0 +1,20 @@
+#ifndef __W_PREFETCH__
+#define __W_PREFETCH__
+
+// Reading lumps ahead of their use on a background thread, so the game
+// doesn't stall on slow disks the first time it needs them.
+
+// Start reading a lump on the I/O thread, unless it's cached already. Lumps
+// in memory-mapped files are paged in instead. Blocks only if too much is
+// already being read.
+void W_PrefetchLump(int lump);
+
+// Hand lumps that have finished loading back to the zone as PU_CACHE, first
+// waiting for lump to finish if it's being prefetched. lump may be -1.
+void W_FinishPrefetches(int lump);
+
+// Held around reading from WAD files, so the threads take turns.
+void W_LockReads(void);
+void W_UnlockReads(void);
+
+#endif
@@ -28,6 +28,7 @@
 #include "i_system.h"
 #include "i_video.h"
 #include "m_misc.h"
+#include "w_prefetch.h"
 #include "w_wad.h"
 #include "z_zone.h"
 
@@ -53,9 +54,17 @@ typedef struct {
 lumpinfo_t *lumpinfo;
 unsigned int numlumps = 0;
 
-// Hash table for fast lookups
+// Hash table for fast lookups: open addressing with linear probing, keyed
+// by W_LumpNameKey so a probe is an integer compare. Each name appears once,
+// for the last lump with it, and the table is at most half full.
 
-static lumpinfo_t **lumphash;
+typedef struct {
+    uint64_t key;
+    int lump; // -1 if the slot is empty
+} lumphash_t;
+
+static lumphash_t *lumphash;
+static unsigned int lumphashmask;
 
 // Hash function used for lump names.
 
@@ -74,6 +83,28 @@ unsigned int W_LumpNameHash(const char *s)
     return result;
 }
 
+// Lump names up to 8 characters packed uppercase into an integer, equal for
+// names W_CheckNumForName considers the same.
+
+uint64_t W_LumpNameKey(const char *s)
+{
+    uint64_t result = 0;
+    unsigned int i;
+
+    for (i = 0; i < 8 && s[i] != '\0'; ++i) {
+        result |= (uint64_t)(byte)toupper((int)s[i]) << (i * 8);
+    }
+
+    return result;
+}
+
+// Slot to start probing at for a key.
+
+static unsigned int LumpHashSlot(uint64_t key)
+{
+    return (unsigned int)((key * 0x9e3779b97f4a7c15ull) >> 32) & lumphashmask;
+}
+
 // Increase the size of the lumpinfo[] array to the specified size.
 static void ExtendLumpInfo(unsigned int newnumlumps)
 {
@@ -95,13 +126,6 @@ static void ExtendLumpInfo(unsigned int newnumlumps)
         if (newlumpinfo[i].cache != NULL) {
             Z_ChangeUser(newlumpinfo[i].cache, &newlumpinfo[i].cache);
         }
-
-        // We shouldn't be generating a hash table until after all WADs have
-        // been loaded, but just in case...
-        if (lumpinfo[i].next != NULL) {
-            int nextlumpnum = lumpinfo[i].next - lumpinfo;
-            newlumpinfo[i].next = &newlumpinfo[nextlumpnum];
-        }
     }
 
     // All done.
@@ -146,7 +170,8 @@ wad_file_t *W_AddFile(char *filename)
 
     newnumlumps = numlumps;
 
-    if (strcasecmp(filename + strlen(filename) - 3, "wad")) {
+    if (strcasecmp(filename + strlen(filename) - 3, "wad")
+        && !W_IsZipFile(filename)) {
         // single lump file
 
         // fraggle: Swap the filepos and size here.  The WAD directory
@@ -200,6 +225,8 @@ wad_file_t *W_AddFile(char *filename)
         lump_p->position = LONG(filerover->filepos);
         lump_p->size = LONG(filerover->size);
         lump_p->cache = NULL;
+        lump_p->pins = 0;
+        lump_p->prefetching = false;
         strncpy(lump_p->name, filerover->name, 8);
 
         ++lump_p;
@@ -231,21 +258,22 @@ int W_NumLumps(void)
 
 int W_CheckNumForName(const char *name)
 {
-    lumpinfo_t *lump_p;
     int i;
 
     // Do we have a hash table yet?
 
     if (lumphash != NULL) {
-        int hash;
+        uint64_t key;
+        unsigned int slot;
 
         // We do! Excellent.
 
-        hash = W_LumpNameHash(name) % numlumps;
+        key = W_LumpNameKey(name);
 
-        for (lump_p = lumphash[hash]; lump_p != NULL; lump_p = lump_p->next) {
-            if (!strncasecmp(lump_p->name, name, 8)) {
-                return lump_p - lumpinfo;
+        for (slot = LumpHashSlot(key); lumphash[slot].lump != -1;
+             slot = (slot + 1) & lumphashmask) {
+            if (lumphash[slot].key == key) {
+                return lumphash[slot].lump;
             }
         }
     } else {
@@ -313,7 +341,9 @@ void W_ReadLump(unsigned int lump, void *dest)
 
     I_BeginRead();
 
+    W_LockReads();
     c = W_Read(l->wad_file, l->position, dest, l->size);
+    W_UnlockReads();
 
     if (c < l->size) {
         I_Error("W_ReadLump: only read %i of %i on lump %i", c, l->size, lump);
@@ -322,6 +352,52 @@ void W_ReadLump(unsigned int lump, void *dest)
     I_EndRead();
 }
 
+//
+// W_ReadLumpHeader
+// Loads at most the first len bytes of the lump into the given buffer,
+//  without loading the rest of it. Returns the number of bytes read.
+//
+int W_ReadLumpHeader(unsigned int lump, void *dest, int len)
+{
+    int c;
+    lumpinfo_t *l;
+
+    if (lump >= numlumps) {
+        I_Error("W_ReadLumpHeader: %i >= numlumps", lump);
+    }
+
+    l = lumpinfo + lump;
+
+    if (len > l->size)
+        len = l->size;
+
+    // Anything already in memory can be copied without touching the file.
+
+    if (l->wad_file->mapped != NULL) {
+        memcpy(dest, l->wad_file->mapped + l->position, len);
+        return len;
+    }
+    if (l->cache != NULL) {
+        memcpy(dest, l->cache, len);
+        return len;
+    }
+
+    I_BeginRead();
+
+    W_LockReads();
+    c = W_Read(l->wad_file, l->position, dest, len);
+    W_UnlockReads();
+
+    if (c < len) {
+        I_Error("W_ReadLumpHeader: only read %i of %i on lump %i", c, len,
+                lump);
+    }
+
+    I_EndRead();
+
+    return len;
+}
+
 //
 // W_CacheLumpNum
 //
@@ -345,6 +421,8 @@ void *W_CacheLumpNum(int lumpnum, int tag)
 
     lump = &lumpinfo[lumpnum];
 
+    W_FinishPrefetches(lumpnum);
+
     // Get the pointer to return.  If the lump is in a memory-mapped
     // file, we can just return a pointer to within the memory-mapped
     // region.  If the lump is in an ordinary file, we may already
@@ -358,7 +436,8 @@ void *W_CacheLumpNum(int lumpnum, int tag)
         // Already cached, so just switch the zone tag.
 
         result = lump->cache;
-        Z_ChangeTag(lump->cache, tag);
+        if (lump->pins == 0)
+            Z_ChangeTag(lump->cache, tag);
     } else {
         // Not yet loaded, so load it now
 
@@ -400,7 +479,7 @@ void W_ReleaseLumpNum(int lumpnum)
 
     if (lump->wad_file->mapped != NULL) {
         // Memory-mapped file, so nothing needs to be done here.
-    } else {
+    } else if (lump->pins == 0) {
         Z_ChangeTag(lump->cache, PU_CACHE);
     }
 }
@@ -410,6 +489,51 @@ void W_ReleaseLumpName(const char *name)
     W_ReleaseLumpNum(W_GetNumForName(name));
 }
 
+//
+// Cache a lump and keep it from being purged until W_UnpinLumpNum,
+// whatever tag it is cached or released with meanwhile. Pins are counted, so
+// a lump pinned twice stays cached until unpinned twice.
+//
+
+void *W_PinLumpNum(int lumpnum)
+{
+    void *result;
+
+    result = W_CacheLumpNum(lumpnum, PU_STATIC);
+    lumpinfo[lumpnum].pins++;
+
+    return result;
+}
+
+void W_UnpinLumpNum(int lumpnum)
+{
+    if ((unsigned)lumpnum >= numlumps) {
+        I_Error("W_UnpinLumpNum: %i >= numlumps", lumpnum);
+    }
+
+    if (--lumpinfo[lumpnum].pins == 0)
+        W_ReleaseLumpNum(lumpnum);
+}
+
+boolean W_AllMapped(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < numlumps; i++) {
+        if (lumpinfo[i].wad_file->mapped == NULL)
+            return false;
+    }
+
+    return true;
+}
+
+void *W_MappedLumpNum(int lumpnum)
+{
+    lumpinfo_t *lump = &lumpinfo[lumpnum];
+
+    return lump->wad_file->mapped + lump->position;
+}
+
 #if 0
 
 //
@@ -466,18 +590,34 @@ void W_GenerateHashTable(void)
 
     // Generate hash table
     if (numlumps > 0) {
-        lumphash = Z_Malloc(sizeof(lumpinfo_t *) * numlumps, PU_STATIC, NULL);
-        memset(lumphash, 0, sizeof(lumpinfo_t *) * numlumps);
+        unsigned int size;
+
+        for (size = 1; size < numlumps * 2; size <<= 1)
+            ;
+
+        lumphash = Z_Malloc(sizeof(lumphash_t) * size, PU_STATIC, NULL);
+        lumphashmask = size - 1;
+
+        for (i = 0; i < size; ++i) {
+            lumphash[i].lump = -1;
+        }
 
         for (i = 0; i < numlumps; ++i) {
-            unsigned int hash;
+            uint64_t key;
+            unsigned int slot;
 
-            hash = W_LumpNameHash(lumpinfo[i].name) % numlumps;
+            key = W_LumpNameKey(lumpinfo[i].name);
+            slot = LumpHashSlot(key);
 
-            // Hook into the hash table
+            // Later lumps replace earlier ones with the same name, so patch
+            // lump files take precedence
+
+            while (lumphash[slot].lump != -1 && lumphash[slot].key != key) {
+                slot = (slot + 1) & lumphashmask;
+            }
 
-            lumpinfo[i].next = lumphash[hash];
-            lumphash[hash] = &lumpinfo[i];
+            lumphash[slot].key = key;
+            lumphash[slot].lump = i;
         }
     }
 
@@ -39,9 +39,11 @@ struct lumpinfo_s {
     int size;
     void *cache;
 
-    // Used for hash table lookups
+    // Times pinned by W_PinLumpNum; kept cached while above 0.
+    int pins;
 
-    lumpinfo_t *next;
+    // Being read into cache by W_PrefetchLump.
+    boolean prefetching;
 };
 
 extern lumpinfo_t *lumpinfo;
@@ -54,6 +56,7 @@ int W_GetNumForName(const char *name);
 
 int W_LumpLength(unsigned int lump);
 void W_ReadLump(unsigned int lump, void *dest);
+int W_ReadLumpHeader(unsigned int lump, void *dest, int len);
 
 void *W_CacheLumpNum(int lump, int tag);
 void *W_CacheLumpName(const char *name, int tag);
@@ -61,10 +64,22 @@ void *W_CacheLumpName(const char *name, int tag);
 void W_GenerateHashTable(void);
 
 extern unsigned int W_LumpNameHash(const char *s);
+uint64_t W_LumpNameKey(const char *s);
 
 void W_ReleaseLumpNum(int lump);
 void W_ReleaseLumpName(const char *name);
 
+void *W_PinLumpNum(int lump);
+void W_UnpinLumpNum(int lump);
+
+// Whether every lump is in a memory-mapped file, so can be read with
+// W_MappedLumpNum.
+boolean W_AllMapped(void);
+
+// A lump in a memory-mapped file, read in place. Nothing is cached, so unlike
+// W_CacheLumpNum it can be called from any thread.
+void *W_MappedLumpNum(int lump);
+
 void W_CheckCorrectIWAD(GameMission_t mission);
 
 #endif
@@ -68,7 +68,7 @@
 #define SP_STATSY 50
 
 #define SP_TIMEX 16
-#define SP_TIMEY (SCREENHEIGHT - 32)
+#define SP_TIMEY (ORIGHEIGHT - 32)
 
 // NET GAME STUFF
 #define NG_STATSY 50
@@ -358,6 +358,9 @@ static patch_t **lnames;
 // Buffer storing the backdrop
 static patch_t *background;
 
+// The backdrop as drawn, while it's loaded.
+static vscreencache_t backgroundcache;
+
 //
 // CODE
 //
@@ -365,7 +368,11 @@ static patch_t *background;
 // slam background
 void WI_slamBackground(void)
 {
+    if (V_RestoreScreenCache(&backgroundcache))
+        return;
+
     V_DrawPatch(0, 0, background);
+    V_SaveScreenCache(&backgroundcache);
 }
 
 // Draws "<Levelname> Finished!"
@@ -375,13 +382,13 @@ void WI_drawLF(void)
 
     if (gamemode != commercial || wbs->last < NUMCMAPS) {
         // draw <LevelName>
-        V_DrawPatch((SCREENWIDTH - SHORT(lnames[wbs->last]->width)) / 2, y,
+        V_DrawPatch((ORIGWIDTH - SHORT(lnames[wbs->last]->width)) / 2, y,
                     lnames[wbs->last]);
 
         // draw "Finished!"
         y += (5 * SHORT(lnames[wbs->last]->height)) / 4;
 
-        V_DrawPatch((SCREENWIDTH - SHORT(finished->width)) / 2, y, finished);
+        V_DrawPatch((ORIGWIDTH - SHORT(finished->width)) / 2, y, finished);
     } else if (wbs->last == NUMCMAPS) {
         // MAP33 - nothing is displayed!
     } else if (wbs->last > NUMCMAPS) {
@@ -391,7 +398,7 @@ void WI_drawLF(void)
         // anyway.  This deliberately triggers a V_DrawPatch error.
 
         patch_t tmp = {
-            SCREENWIDTH, SCREENHEIGHT, 1, 1, {0, 0, 0, 0, 0, 0, 0, 0}};
+            ORIGWIDTH, ORIGHEIGHT, 1, 1, {0, 0, 0, 0, 0, 0, 0, 0}};
 
         V_DrawPatch(0, y, &tmp);
     }
@@ -406,12 +413,12 @@ void WI_drawEL(void)
     int y = WI_TITLEY;
 
     // draw "Entering"
-    V_DrawPatch((SCREENWIDTH - SHORT(entering->width)) / 2, y, entering);
+    V_DrawPatch((ORIGWIDTH - SHORT(entering->width)) / 2, y, entering);
 
     // draw level
     y += (5 * SHORT(lnames[wbs->next]->height)) / 4;
 
-    V_DrawPatch((SCREENWIDTH - SHORT(lnames[wbs->next]->width)) / 2, y,
+    V_DrawPatch((ORIGWIDTH - SHORT(lnames[wbs->next]->width)) / 2, y,
                 lnames[wbs->next]);
 }
 
@@ -431,8 +438,8 @@ void WI_drawOnLnode(int n, patch_t *c[])
         right = left + SHORT(c[i]->width);
         bottom = top + SHORT(c[i]->height);
 
-        if (left >= 0 && right < SCREENWIDTH && top >= 0
-            && bottom < SCREENHEIGHT) {
+        if (left >= 0 && right < ORIGWIDTH && top >= 0
+            && bottom < ORIGHEIGHT) {
             fits = true;
         } else {
             i++;
@@ -1246,20 +1253,20 @@ void WI_drawStats(void)
     WI_drawLF();
 
     V_DrawPatch(SP_STATSX, SP_STATSY, kills);
-    WI_drawPercent(SCREENWIDTH - SP_STATSX, SP_STATSY, cnt_kills[0]);
+    WI_drawPercent(ORIGWIDTH - SP_STATSX, SP_STATSY, cnt_kills[0]);
 
     V_DrawPatch(SP_STATSX, SP_STATSY + lh, items);
-    WI_drawPercent(SCREENWIDTH - SP_STATSX, SP_STATSY + lh, cnt_items[0]);
+    WI_drawPercent(ORIGWIDTH - SP_STATSX, SP_STATSY + lh, cnt_items[0]);
 
     V_DrawPatch(SP_STATSX, SP_STATSY + 2 * lh, sp_secret);
-    WI_drawPercent(SCREENWIDTH - SP_STATSX, SP_STATSY + 2 * lh, cnt_secret[0]);
+    WI_drawPercent(ORIGWIDTH - SP_STATSX, SP_STATSY + 2 * lh, cnt_secret[0]);
 
     V_DrawPatch(SP_TIMEX, SP_TIMEY, timepatch);
-    WI_drawTime(SCREENWIDTH / 2 - SP_TIMEX, SP_TIMEY, cnt_time);
+    WI_drawTime(ORIGWIDTH / 2 - SP_TIMEX, SP_TIMEY, cnt_time);
 
     if (wbs->epsd < 3) {
-        V_DrawPatch(SCREENWIDTH / 2 + SP_TIMEX, SP_TIMEY, par);
-        WI_drawTime(SCREENWIDTH - SP_TIMEX, SP_TIMEY, cnt_par);
+        V_DrawPatch(ORIGWIDTH / 2 + SP_TIMEX, SP_TIMEY, par);
+        WI_drawTime(ORIGWIDTH - SP_TIMEX, SP_TIMEY, cnt_par);
     }
 }
 
@@ -1485,6 +1492,7 @@ void WI_loadData(void)
     }
 
     WI_loadUnloadData(WI_loadCallback);
+    backgroundcache.valid = false;
 
     // These two graphics are special cased because we're sharing
     // them with the status bar code
@@ -16,9 +16,16 @@
 //      Zone Memory Allocation. Neat.
 //
 
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "z_zone.h"
 #include "doomtype.h"
 #include "i_system.h"
+#include "i_thread.h"
+#include "m_counts.h"
 
 //
 // ZONE MEMORY ALLOCATION
@@ -34,15 +41,255 @@
 #define MEM_ALIGN sizeof(void *)
 #define ZONEID 0x1d4a11
 
+// Every block header ends with its id, so that the id can be found from a
+// block's data without knowing what kind of block it is.
+#define BLOCKID(ptr) (((intptr_t *)(ptr))[-1])
+
 typedef struct memblock_s {
-    int size; // including the header and possibly tiny fragments
-    void **user;
-    int tag; // PU_FREE if this is free
-    int id;  // should be ZONEID
     struct memblock_s *next;
     struct memblock_s *prev;
+    void **user;
+    int size;    // including the header and possibly tiny fragments
+    int tag;     // PU_FREE if this is free
+    intptr_t id; // should be ZONEID
 } memblock_t;
 
+zonestats_t zonestats;
+
+static void CountBlock(int tag, int size)
+{
+    zonestats.tagbytes[tag] += size;
+    zonestats.tagblocks[tag]++;
+}
+
+static void UncountBlock(int tag, int size)
+{
+    zonestats.tagbytes[tag] -= size;
+    zonestats.tagblocks[tag]--;
+}
+
+//
+// SIZE CLASS SLABS
+//
+// Built with ZONE_SLABS, non-purgable blocks of up to MAXSLABBLOCK bytes
+// come from slabs of same-sized blocks instead of the rover. Each slab is
+// itself a PU_STATIC zone block, freed once its last block is. Blocks in
+// slabs keep their tags and users: Z_FreeTags frees them like any other,
+// and blocks changed to a purgable tag are purged when the rover runs out
+// of room.
+//
+
+#ifdef ZONE_SLABS
+
+#define SLABID 0x51ab
+#define SLABCLASSSIZE 16
+#define NUMSLABCLASSES 16
+#define MAXSLABBLOCK (SLABCLASSSIZE * NUMSLABCLASSES)
+#define BLOCKSPERSLAB 64
+
+struct slab_s;
+
+typedef struct smallblock_s {
+    void **user;
+    struct slab_s *slab;
+    int tag;     // PU_FREE if this is free
+    intptr_t id; // should be SLABID
+} smallblock_t;
+
+typedef struct slab_s {
+    // All slabs of the class; those with free blocks come first.
+    struct slab_s *next;
+    struct slab_s *prev;
+    smallblock_t *freelist;
+    int used;
+    int sizeclass;
+} slab_t;
+
+// Heads of each class's list of slabs.
+static slab_t *slabs[NUMSLABCLASSES];
+
+#define BLOCKSTRIDE(sizeclass)                                                 \
+    (sizeof(smallblock_t) + ((sizeclass) + 1) * SLABCLASSSIZE)
+#define SLABBLOCK(slab, i)                                                     \
+    ((smallblock_t *)((byte *)((slab) + 1)                                     \
+                      + (i) * BLOCKSTRIDE((slab)->sizeclass)))
+
+// Where the free list link of a free block is kept.
+#define NEXTFREE(block) (*(smallblock_t **)((block) + 1))
+
+static void UnlinkSlab(slab_t *slab)
+{
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        slabs[slab->sizeclass] = slab->next;
+
+    if (slab->next)
+        slab->next->prev = slab->prev;
+}
+
+static void LinkSlabFirst(slab_t *slab)
+{
+    slab->prev = NULL;
+    slab->next = slabs[slab->sizeclass];
+    if (slab->next)
+        slab->next->prev = slab;
+    slabs[slab->sizeclass] = slab;
+}
+
+static void LinkSlabLast(slab_t *slab)
+{
+    slab_t *last;
+
+    slab->next = NULL;
+    last = slabs[slab->sizeclass];
+    if (!last) {
+        slab->prev = NULL;
+        slabs[slab->sizeclass] = slab;
+        return;
+    }
+
+    while (last->next)
+        last = last->next;
+    last->next = slab;
+    slab->prev = last;
+}
+
+static slab_t *NewSlab(int sizeclass)
+{
+    slab_t *slab;
+    smallblock_t *block;
+    int i;
+
+    slab = Z_Malloc(sizeof(slab_t) + BLOCKSPERSLAB * BLOCKSTRIDE(sizeclass),
+                    PU_STATIC, NULL);
+
+    // Count the blocks in the slab rather than the slab itself.
+    UncountBlock(PU_STATIC, ((memblock_t *)slab - 1)->size);
+    slab->sizeclass = sizeclass;
+    slab->used = 0;
+    slab->freelist = NULL;
+
+    for (i = BLOCKSPERSLAB - 1; i >= 0; i--) {
+        block = SLABBLOCK(slab, i);
+        block->slab = slab;
+        block->tag = PU_FREE;
+        block->user = NULL;
+        block->id = 0;
+        NEXTFREE(block) = slab->freelist;
+        slab->freelist = block;
+    }
+
+    LinkSlabFirst(slab);
+
+    return slab;
+}
+
+static void *SlabMalloc(int size, int tag, void **user)
+{
+    slab_t *slab;
+    smallblock_t *block;
+    int sizeclass;
+
+    sizeclass = (size - 1) / SLABCLASSSIZE;
+
+    slab = slabs[sizeclass];
+    if (!slab || !slab->freelist)
+        slab = NewSlab(sizeclass);
+
+    block = slab->freelist;
+    slab->freelist = NEXTFREE(block);
+    slab->used++;
+
+    // Keep the slabs with free blocks at the front.
+    if (!slab->freelist && slab->next && slab->next->freelist) {
+        UnlinkSlab(slab);
+        LinkSlabLast(slab);
+    }
+
+    block->tag = tag;
+    block->user = user;
+    block->id = SLABID;
+    CountBlock(tag, BLOCKSTRIDE(sizeclass));
+
+    if (user)
+        *user = block + 1;
+
+    return block + 1;
+}
+
+// Returns true if that freed the whole slab.
+static boolean SlabFree(smallblock_t *block)
+{
+    slab_t *slab;
+
+    slab = block->slab;
+
+    UncountBlock(block->tag, BLOCKSTRIDE(slab->sizeclass));
+
+    if (block->user != NULL)
+        *block->user = 0;
+
+    block->tag = PU_FREE;
+    block->user = NULL;
+    block->id = 0;
+
+    if (!slab->freelist) {
+        UnlinkSlab(slab);
+        LinkSlabFirst(slab);
+    }
+
+    NEXTFREE(block) = slab->freelist;
+    slab->freelist = block;
+
+    if (--slab->used == 0) {
+        UnlinkSlab(slab);
+        CountBlock(PU_STATIC, ((memblock_t *)slab - 1)->size);
+        Z_Free(slab);
+        return true;
+    }
+
+    return false;
+}
+
+// Free the blocks in slabs tagged lowtag to hightag, returning whether any
+// slab was freed with them.
+static boolean SlabFreeTags(int lowtag, int hightag)
+{
+    slab_t *slab;
+    slab_t *next;
+    smallblock_t *block;
+    boolean freedslab;
+    int sizeclass;
+    int i;
+
+    freedslab = false;
+
+    for (sizeclass = 0; sizeclass < NUMSLABCLASSES; sizeclass++) {
+        for (slab = slabs[sizeclass]; slab; slab = next) {
+            next = slab->next;
+
+            for (i = 0; i < BLOCKSPERSLAB; i++) {
+                block = SLABBLOCK(slab, i);
+
+                if (block->tag == PU_FREE || block->tag < lowtag
+                    || block->tag > hightag) {
+                    continue;
+                }
+
+                if (SlabFree(block)) {
+                    freedslab = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    return freedslab;
+}
+
+#endif
+
 typedef struct {
     // total bytes malloced, including header
     int size;
@@ -54,8 +301,21 @@ typedef struct {
 
 } memzone_t;
 
+// The first zone is the one from I_ZoneBase. Later ones are added when
+// nothing fits, until MAXZONES, so memory grows with the WADs in use
+// instead of cached lumps being purged and read again; only then does
+// Z_Malloc purge. With -lowmem, zones are only added while the total stays
+// within its budget.
+#define MAXZONES 8
+
 memzone_t *mainzone;
 
+static memzone_t *zones[MAXZONES];
+static int numzones;
+
+// The zone that last had room, tried first.
+static int curzone;
+
 //
 // Z_ClearZone
 //
@@ -84,26 +344,70 @@ void Z_ClearZone(memzone_t *zone)
 //
 void Z_Init(void)
 {
-    memblock_t *block;
     int size;
 
     mainzone = (memzone_t *)I_ZoneBase(&size);
     mainzone->size = size;
+    Z_ClearZone(mainzone);
 
-    // set the entire zone to one free block
-    mainzone->blocklist.next = mainzone->blocklist.prev = block =
-        (memblock_t *)((byte *)mainzone + sizeof(memzone_t));
+    zones[0] = mainzone;
+    numzones = 1;
+    curzone = 0;
+}
+
+//
+// AddZone
+// Add a zone with room for a block of size bytes, or return NULL if there
+// are MAXZONES already or it can't be allocated.
+//
+static memzone_t *AddZone(int size)
+{
+    memzone_t *zone;
+    int zonesize;
 
-    mainzone->blocklist.user = (void *)mainzone;
-    mainzone->blocklist.tag = PU_STATIC;
-    mainzone->rover = block;
+    if (numzones == MAXZONES)
+        return NULL;
 
-    block->prev = block->next = &mainzone->blocklist;
+    zonesize = mainzone->size;
+    if (zonesize < size + (int)sizeof(memzone_t))
+        zonesize = size + sizeof(memzone_t);
 
-    // free block
-    block->tag = PU_FREE;
+    if (I_LowMemoryBudget() > 0
+        && (int)Z_ZoneSize() + zonesize > I_LowMemoryBudget()) {
+        return NULL;
+    }
+
+    zone = malloc(zonesize);
+    if (zone == NULL)
+        return NULL;
+
+    zone->size = zonesize;
+    Z_ClearZone(zone);
+
+    zones[numzones++] = zone;
+
+    printf("Z_Malloc: added a %i KiB zone (%i in use)\n", zonesize >> 10,
+           numzones);
+
+    return zone;
+}
+
+//
+// ZoneOf
+//
+static memzone_t *ZoneOf(memblock_t *block)
+{
+    int i;
+
+    for (i = 0; i < numzones; i++) {
+        if ((byte *)block > (byte *)zones[i]
+            && (byte *)block < (byte *)zones[i] + zones[i]->size) {
+            return zones[i];
+        }
+    }
 
-    block->size = mainzone->size - sizeof(memzone_t);
+    I_Error("Z_Free: block %p is not in any zone", (void *)block);
+    return NULL;
 }
 
 //
@@ -111,14 +415,27 @@ void Z_Init(void)
 //
 void Z_Free(void *ptr)
 {
+    memzone_t *zone;
     memblock_t *block;
     memblock_t *other;
 
+#ifdef ZONE_SLABS
+    if (BLOCKID(ptr) == SLABID) {
+        SlabFree((smallblock_t *)ptr - 1);
+        return;
+    }
+#endif
+
     block = (memblock_t *)((byte *)ptr - sizeof(memblock_t));
 
     if (block->id != ZONEID)
         I_Error("Z_Free: freed a pointer without ZONEID");
 
+    zone = ZoneOf(block);
+
+    if (block->tag != PU_FREE)
+        UncountBlock(block->tag, block->size);
+
     if (block->tag != PU_FREE && block->user != NULL) {
         // clear the user's mark
         *block->user = 0;
@@ -137,8 +454,8 @@ void Z_Free(void *ptr)
         other->next = block->next;
         other->next->prev = other;
 
-        if (block == mainzone->rover)
-            mainzone->rover = other;
+        if (block == zone->rover)
+            zone->rover = other;
 
         block = other;
     }
@@ -150,18 +467,20 @@ void Z_Free(void *ptr)
         block->next = other->next;
         block->next->prev = block;
 
-        if (other == mainzone->rover)
-            mainzone->rover = block;
+        if (other == zone->rover)
+            zone->rover = block;
     }
 }
 
 //
-// Z_Malloc
-// You can pass a NULL user if the tag is < PU_PURGELEVEL.
+// ZoneMalloc
+// Allocate from one zone, returning NULL if there is no room. If purge is
+// false, purgable blocks are passed over rather than freed.
 //
 #define MINFRAGMENT 64
 
-void *Z_Malloc(int size, int tag, void *user)
+static void *ZoneMalloc(memzone_t *zone, int size, int tag, void *user,
+                        boolean purge)
 {
     int extra;
     memblock_t *start;
@@ -170,19 +489,14 @@ void *Z_Malloc(int size, int tag, void *user)
     memblock_t *base;
     void *result;
 
-    size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
-
     // scan through the block list,
     // looking for the first free block
     // of sufficient size,
     // throwing out any purgable blocks along the way.
 
-    // account for size of block header
-    size += sizeof(memblock_t);
-
     // if there is a free block behind the rover,
     //  back up over them
-    base = mainzone->rover;
+    base = zone->rover;
 
     if (base->prev->tag == PU_FREE)
         base = base->prev;
@@ -193,11 +507,13 @@ void *Z_Malloc(int size, int tag, void *user)
     do {
         if (rover == start) {
             // scanned all the way around the list
-            I_Error("Z_Malloc: failed on allocation of %i bytes", size);
+            return NULL;
         }
 
+        zonestats.roversteps++;
+
         if (rover->tag != PU_FREE) {
-            if (rover->tag < PU_PURGELEVEL) {
+            if (rover->tag < PU_PURGELEVEL || !purge) {
                 // hit a block that can't be purged,
                 // so move base past it
                 base = rover = rover->next;
@@ -207,6 +523,7 @@ void *Z_Malloc(int size, int tag, void *user)
                 // the rover can be the base block
                 base = base->prev;
                 Z_Free((byte *)rover + sizeof(memblock_t));
+                zonestats.purges++;
                 base = base->next;
                 rover = base->next;
             }
@@ -234,11 +551,9 @@ void *Z_Malloc(int size, int tag, void *user)
         base->size = size;
     }
 
-    if (user == NULL && tag >= PU_PURGELEVEL)
-        I_Error("Z_Malloc: an owner is required for purgable blocks");
-
     base->user = user;
     base->tag = tag;
+    CountBlock(tag, base->size);
 
     result = (void *)((byte *)base + sizeof(memblock_t));
 
@@ -247,13 +562,84 @@ void *Z_Malloc(int size, int tag, void *user)
     }
 
     // next allocation will start looking here
-    mainzone->rover = base->next;
+    zone->rover = base->next;
 
     base->id = ZONEID;
 
     return result;
 }
 
+//
+// Z_Malloc
+// You can pass a NULL user if the tag is < PU_PURGELEVEL.
+//
+void *Z_Malloc(int size, int tag, void *user)
+{
+    memzone_t *zone;
+    void *result;
+    int i;
+    int z;
+#ifdef ZONE_SLABS
+    int requested;
+#endif
+
+    M_CountWork(work_zmallocs, 1);
+
+#ifdef ZONE_SLABS
+    if (size > 0 && size <= MAXSLABBLOCK && tag < PU_PURGELEVEL)
+        return SlabMalloc(size, tag, user);
+
+    requested = size;
+#endif
+
+    if (user == NULL && tag >= PU_PURGELEVEL)
+        I_Error("Z_Malloc: an owner is required for purgable blocks");
+
+    size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
+
+    // account for size of block header
+    size += sizeof(memblock_t);
+
+    zonestats.mallocs++;
+
+    // While zones can still be added, use free space or a new zone rather
+    // than purging anything.
+    if (numzones < MAXZONES) {
+        for (i = 0; i < numzones; i++) {
+            z = (curzone + i) % numzones;
+            result = ZoneMalloc(zones[z], size, tag, user, false);
+            if (result != NULL) {
+                curzone = z;
+                return result;
+            }
+        }
+
+        zone = AddZone(size);
+        if (zone != NULL) {
+            curzone = numzones - 1;
+            return ZoneMalloc(zone, size, tag, user, false);
+        }
+    }
+
+    for (i = 0; i < numzones; i++) {
+        z = (curzone + i) % numzones;
+        result = ZoneMalloc(zones[z], size, tag, user, true);
+        if (result != NULL) {
+            curzone = z;
+            return result;
+        }
+    }
+
+#ifdef ZONE_SLABS
+    // Purging blocks in slabs may free whole slabs.
+    if (SlabFreeTags(PU_PURGELEVEL, PU_NUM_TAGS - 1))
+        return Z_Malloc(requested, tag, user);
+#endif
+
+    I_Error("Z_Malloc: failed on allocation of %i bytes", size);
+    return NULL;
+}
+
 //
 // Z_FreeTags
 //
@@ -261,18 +647,25 @@ void Z_FreeTags(int lowtag, int hightag)
 {
     memblock_t *block;
     memblock_t *next;
+    int i;
 
-    for (block = mainzone->blocklist.next; block != &mainzone->blocklist;
-         block = next) {
-        // get link before freeing
-        next = block->next;
+#ifdef ZONE_SLABS
+    SlabFreeTags(lowtag, hightag);
+#endif
 
-        // free block?
-        if (block->tag == PU_FREE)
-            continue;
+    for (i = 0; i < numzones; i++) {
+        for (block = zones[i]->blocklist.next;
+             block != &zones[i]->blocklist; block = next) {
+            // get link before freeing
+            next = block->next;
 
-        if (block->tag >= lowtag && block->tag <= hightag)
-            Z_Free((byte *)block + sizeof(memblock_t));
+            // free block?
+            if (block->tag == PU_FREE)
+                continue;
+
+            if (block->tag >= lowtag && block->tag <= hightag)
+                Z_Free((byte *)block + sizeof(memblock_t));
+        }
     }
 }
 
@@ -280,20 +673,20 @@ void Z_FreeTags(int lowtag, int hightag)
 // Z_DumpHeap
 // Note: TFileDumpHeap( stdout ) ?
 //
-void Z_DumpHeap(int lowtag, int hightag)
+static void DumpZone(memzone_t *zone, int lowtag, int hightag)
 {
     memblock_t *block;
 
-    printf("zone size: %i  location: %p\n", mainzone->size, (void *)mainzone);
+    printf("zone size: %i  location: %p\n", zone->size, (void *)zone);
 
     printf("tag range: %i to %i\n", lowtag, hightag);
 
-    for (block = mainzone->blocklist.next;; block = block->next) {
+    for (block = zone->blocklist.next;; block = block->next) {
         if (block->tag >= lowtag && block->tag <= hightag)
             printf("block:%p    size:%7i    user:%p    tag:%3i\n",
                    (void *)block, block->size, (void *)block->user, block->tag);
 
-        if (block->next == &mainzone->blocklist) {
+        if (block->next == &zone->blocklist) {
             // all blocks have been hit
             break;
         }
@@ -309,21 +702,29 @@ void Z_DumpHeap(int lowtag, int hightag)
     }
 }
 
+void Z_DumpHeap(int lowtag, int hightag)
+{
+    int i;
+
+    for (i = 0; i < numzones; i++)
+        DumpZone(zones[i], lowtag, hightag);
+}
+
 //
 // Z_FileDumpHeap
 //
-void Z_FileDumpHeap(FILE *f)
+static void FileDumpZone(memzone_t *zone, FILE *f)
 {
     memblock_t *block;
 
-    fprintf(f, "zone size: %i  location: %p\n", mainzone->size,
-            (void *)mainzone);
+    fprintf(f, "zone size: %i  location: %p\n", zone->size,
+            (void *)zone);
 
-    for (block = mainzone->blocklist.next;; block = block->next) {
+    for (block = zone->blocklist.next;; block = block->next) {
         fprintf(f, "block:%p    size:%7i    user:%p    tag:%3i\n",
                 (void *)block, block->size, (void *)block->user, block->tag);
 
-        if (block->next == &mainzone->blocklist) {
+        if (block->next == &zone->blocklist) {
             // all blocks have been hit
             break;
         }
@@ -339,15 +740,23 @@ void Z_FileDumpHeap(FILE *f)
     }
 }
 
+void Z_FileDumpHeap(FILE *f)
+{
+    int i;
+
+    for (i = 0; i < numzones; i++)
+        FileDumpZone(zones[i], f);
+}
+
 //
 // Z_CheckHeap
 //
-void Z_CheckHeap(void)
+static void CheckZone(memzone_t *zone)
 {
     memblock_t *block;
 
-    for (block = mainzone->blocklist.next;; block = block->next) {
-        if (block->next == &mainzone->blocklist) {
+    for (block = zone->blocklist.next;; block = block->next) {
+        if (block->next == &zone->blocklist) {
             // all blocks have been hit
             break;
         }
@@ -363,6 +772,14 @@ void Z_CheckHeap(void)
     }
 }
 
+void Z_CheckHeap(void)
+{
+    int i;
+
+    for (i = 0; i < numzones; i++)
+        CheckZone(zones[i]);
+}
+
 //
 // Z_ChangeTag
 //
@@ -370,6 +787,24 @@ void Z_ChangeTag2(void *ptr, int tag, char *file, int line)
 {
     memblock_t *block;
 
+#ifdef ZONE_SLABS
+    smallblock_t *small;
+
+    if (BLOCKID(ptr) == SLABID) {
+        small = (smallblock_t *)ptr - 1;
+
+        if (tag >= PU_PURGELEVEL && small->user == NULL)
+            I_Error("%s:%i: Z_ChangeTag: an owner is required "
+                    "for purgable blocks",
+                    file, line);
+
+        UncountBlock(small->tag, BLOCKSTRIDE(small->slab->sizeclass));
+        CountBlock(tag, BLOCKSTRIDE(small->slab->sizeclass));
+        small->tag = tag;
+        return;
+    }
+#endif
+
     block = (memblock_t *)((byte *)ptr - sizeof(memblock_t));
 
     if (block->id != ZONEID)
@@ -380,6 +815,8 @@ void Z_ChangeTag2(void *ptr, int tag, char *file, int line)
                 "for purgable blocks",
                 file, line);
 
+    UncountBlock(block->tag, block->size);
+    CountBlock(tag, block->size);
     block->tag = tag;
 }
 
@@ -387,6 +824,14 @@ void Z_ChangeUser(void *ptr, void **user)
 {
     memblock_t *block;
 
+#ifdef ZONE_SLABS
+    if (BLOCKID(ptr) == SLABID) {
+        ((smallblock_t *)ptr - 1)->user = user;
+        *user = ptr;
+        return;
+    }
+#endif
+
     block = (memblock_t *)((byte *)ptr - sizeof(memblock_t));
 
     if (block->id != ZONEID) {
@@ -404,13 +849,16 @@ int Z_FreeMemory(void)
 {
     memblock_t *block;
     int free;
+    int i;
 
     free = 0;
 
-    for (block = mainzone->blocklist.next; block != &mainzone->blocklist;
-         block = block->next) {
-        if (block->tag == PU_FREE || block->tag >= PU_PURGELEVEL)
-            free += block->size;
+    for (i = 0; i < numzones; i++) {
+        for (block = zones[i]->blocklist.next; block != &zones[i]->blocklist;
+             block = block->next) {
+            if (block->tag == PU_FREE || block->tag >= PU_PURGELEVEL)
+                free += block->size;
+        }
     }
 
     return free;
@@ -418,5 +866,232 @@ int Z_FreeMemory(void)
 
 unsigned int Z_ZoneSize(void)
 {
-    return mainzone->size;
+    unsigned int size;
+    int i;
+
+    size = 0;
+    for (i = 0; i < numzones; i++)
+        size += zones[i]->size;
+
+    return size;
+}
+
+//
+// Z_LargestFreeBlock
+// The most that could be allocated without purging, including the header.
+//
+int Z_LargestFreeBlock(void)
+{
+    memblock_t *block;
+    int largest;
+    int i;
+
+    largest = 0;
+
+    for (i = 0; i < numzones; i++) {
+        for (block = zones[i]->blocklist.next; block != &zones[i]->blocklist;
+             block = block->next) {
+            if (block->tag == PU_FREE && block->size > largest)
+                largest = block->size;
+        }
+    }
+
+    return largest;
+}
+
+//
+// SumTags
+// Bytes and blocks in use with tags first to last.
+//
+static void SumTags(int first, int last, unsigned int *bytes,
+                    unsigned int *blocks)
+{
+    int tag;
+
+    *bytes = *blocks = 0;
+
+    for (tag = first; tag <= last; tag++) {
+        *bytes += zonestats.tagbytes[tag];
+        *blocks += zonestats.tagblocks[tag];
+    }
+}
+
+//
+// Z_PrintStats
+//
+void Z_PrintStats(void)
+{
+    unsigned int staticbytes, staticblocks;
+    unsigned int levelbytes, levelblocks;
+    unsigned int cachebytes, cacheblocks;
+
+    SumTags(PU_STATIC, PU_MUSIC, &staticbytes, &staticblocks);
+    SumTags(PU_LEVEL, PU_LEVSPEC, &levelbytes, &levelblocks);
+    SumTags(PU_PURGELEVEL, PU_CACHE, &cachebytes, &cacheblocks);
+
+    printf("Z_PrintStats: %u KiB in %i zones; static %u KiB in %u blocks, "
+           "level %u KiB in %u, cache %u KiB in %u; largest free %i KiB; "
+           "%u purges; %.1f blocks walked per allocation\n",
+           Z_ZoneSize() >> 10, numzones, staticbytes >> 10, staticblocks,
+           levelbytes >> 10, levelblocks, cachebytes >> 10, cacheblocks,
+           Z_LargestFreeBlock() >> 10, zonestats.purges,
+           zonestats.mallocs
+               ? (double)zonestats.roversteps / zonestats.mallocs
+               : 0.0);
+}
+
+//
+// FRAME ARENAS
+//
+// The zone is only for the main thread. Any thread can get scratch memory
+//  that lasts until the end of the frame from an arena of its own, carved
+//  off the front of a chunk, so it never waits on a lock or malloc. Each
+//  thread empties its own arena the first time it allocates in a new frame,
+//  so threads still running across the end of a frame keep what they have
+//  until they next allocate.
+//
+
+#define ARENACHUNK (64 * 1024)
+#define ARENA_ALIGN 16
+
+typedef struct arenachunk_s {
+    struct arenachunk_s *next;
+    size_t size;
+    size_t used;
+    // Keeps the data after the header aligned.
+    byte pad[ARENA_ALIGN - (2 * sizeof(size_t) + sizeof(void *)) % ARENA_ALIGN];
+} arenachunk_t;
+
+typedef struct {
+    arenachunk_t *chunks; // the one being carved up first
+    unsigned int frame;
+} arena_t;
+
+static THREAD_LOCAL arena_t arena;
+static unsigned int arenaframe;
+
+// Results to be moved into the zone at the end of the frame, each followed by
+// a copy of its data. Guarded by handoff_mutex.
+typedef struct handoff_s {
+    struct handoff_s *next;
+    int size;
+    int tag;
+    void **user;
+} handoff_t;
+
+static pthread_mutex_t handoff_mutex = PTHREAD_MUTEX_INITIALIZER;
+static handoff_t *handoffs;
+
+static arenachunk_t *NewArenaChunk(size_t size)
+{
+    arenachunk_t *chunk = I_Realloc(NULL, sizeof(*chunk) + size);
+
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+
+    return chunk;
+}
+
+// Empty the calling thread's arena. If the last frame spilled into more than
+// one chunk, they're replaced by one big enough for all of it.
+static void ResetArena(void)
+{
+    arenachunk_t *chunk;
+    arenachunk_t *next;
+    size_t total = 0;
+
+    if (arena.chunks != NULL && arena.chunks->next != NULL) {
+        for (chunk = arena.chunks; chunk != NULL; chunk = next) {
+            next = chunk->next;
+            total += chunk->size;
+            free(chunk);
+        }
+        arena.chunks = NewArenaChunk(total);
+    } else if (arena.chunks != NULL) {
+        arena.chunks->used = 0;
+    }
+
+    arena.frame = __atomic_load_n(&arenaframe, __ATOMIC_ACQUIRE);
+}
+
+void *Z_ArenaAlloc(int size)
+{
+    arenachunk_t *chunk;
+    size_t rounded;
+    void *result;
+
+    if (size < 0)
+        I_Error("Z_ArenaAlloc: bad size %i", size);
+
+    if (arena.frame != __atomic_load_n(&arenaframe, __ATOMIC_ACQUIRE))
+        ResetArena();
+
+    rounded = ((size_t)size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    chunk = arena.chunks;
+
+    if (chunk == NULL || chunk->size - chunk->used < rounded) {
+        chunk = NewArenaChunk(rounded > ARENACHUNK ? rounded : ARENACHUNK);
+        chunk->next = arena.chunks;
+        arena.chunks = chunk;
+    }
+
+    result = (byte *)(chunk + 1) + chunk->used;
+    chunk->used += rounded;
+
+    return result;
+}
+
+void Z_HandOff(const void *data, int size, int tag, void **user)
+{
+    handoff_t *handoff;
+
+    if (tag >= PU_PURGELEVEL && user == NULL)
+        I_Error("Z_HandOff: an owner is required for purgable blocks");
+
+    // Copied rather than left in the arena, as the thread may be running
+    // on into the next frame.
+    handoff = I_Realloc(NULL, sizeof(*handoff) + size);
+    memcpy(handoff + 1, data, size);
+    handoff->size = size;
+    handoff->tag = tag;
+    handoff->user = user;
+
+    pthread_mutex_lock(&handoff_mutex);
+    handoff->next = handoffs;
+    handoffs = handoff;
+    pthread_mutex_unlock(&handoff_mutex);
+}
+
+void Z_FinishHandOffs(void)
+{
+    handoff_t *list;
+    handoff_t *reversed = NULL;
+    handoff_t *next;
+    void *block;
+
+    pthread_mutex_lock(&handoff_mutex);
+    list = handoffs;
+    handoffs = NULL;
+    pthread_mutex_unlock(&handoff_mutex);
+
+    // In the order they were handed off.
+    for (; list != NULL; list = next) {
+        next = list->next;
+        list->next = reversed;
+        reversed = list;
+    }
+
+    for (; reversed != NULL; reversed = next) {
+        next = reversed->next;
+        block = Z_Malloc(reversed->size, reversed->tag, reversed->user);
+        memcpy(block, reversed + 1, reversed->size);
+        free(reversed);
+    }
+}
+
+void Z_EndFrame(void)
+{
+    Z_FinishHandOffs();
+    __atomic_add_fetch(&arenaframe, 1, __ATOMIC_RELEASE);
 }
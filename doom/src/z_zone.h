@@ -56,6 +56,47 @@ void Z_ChangeTag2(void *ptr, int tag, char *file, int line);
 void Z_ChangeUser(void *ptr, void **user);
 int Z_FreeMemory(void);
 unsigned int Z_ZoneSize(void);
+int Z_LargestFreeBlock(void);
+void Z_PrintStats(void);
+
+//
+// Running totals, for telemetry.
+//
+typedef struct {
+    // Bytes (including headers) and blocks in use with each tag.
+    unsigned int tagbytes[PU_NUM_TAGS];
+    unsigned int tagblocks[PU_NUM_TAGS];
+
+    // Purgable blocks freed to make room.
+    unsigned int purges;
+
+    // Allocations that searched a zone, and the blocks they stepped over.
+    unsigned int mallocs;
+    unsigned int roversteps;
+} zonestats_t;
+
+extern zonestats_t zonestats;
+
+//
+// Frame arenas, for scratch memory on any thread.
+//
+
+// Allocate size bytes from the calling thread's arena, aligned for any type.
+// Never freed on its own; it lasts until the thread first allocates after the
+// frame has ended.
+void *Z_ArenaAlloc(int size);
+
+// From any thread, have a copy of size bytes at data put in a new zone block
+// by the main thread, at the latest by the end of the frame, with *user set
+// to it.
+void Z_HandOff(const void *data, int size, int tag, void **user);
+
+// On the main thread, move everything handed off so far into the zone.
+void Z_FinishHandOffs(void);
+
+// On the main thread, at the end of each frame: finish handoffs, and let
+// each thread's arena be reused the next time it allocates.
+void Z_EndFrame(void);
 
 //
 // This is used to get the local FILE:LINE info from CPP
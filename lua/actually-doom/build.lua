@@ -23,8 +23,17 @@ local src_dir = fs.normalize(
   { expand_env = false }
 )
 
+-- Objects are kept here between builds, so only those whose source or headers
+-- changed since are recompiled.
+local object_dir =
+  fs.joinpath(fn.stdpath "cache", "actually-doom.nvim", "objects")
+-- Where profile-guided builds collect their profile.
+local profile_dir =
+  fs.joinpath(fn.stdpath "cache", "actually-doom.nvim", "profile")
+
 local object_names = {
   "am_map.o",
+  "d_bench.o",
   "d_event.o",
   "d_items.o",
   "d_iwad.o",
@@ -32,20 +41,27 @@ local object_names = {
   "d_main.o",
   "d_mode.o",
   "d_net.o",
+  "d_replay.o",
   "doomstat.o",
   "dstrings.o",
   "f_finale.o",
   "f_wipe.o",
   "g_game.o",
+  "g_rewind.o",
+  "g_seek.o",
   "hu_lib.o",
   "hu_stuff.o",
   "i_cdmus.o",
+  "i_cpu.o",
   "i_endoom.o",
   "i_input.o",
   "i_joystick.o",
+  "i_mixsound.o",
+  "i_oplmusic.o",
   "i_scale.o",
   "i_sound.o",
   "i_system.o",
+  "i_thread.o",
   "i_timer.o",
   "i_video.o",
   "info.o",
@@ -54,11 +70,28 @@ local object_names = {
   "m_cheat.o",
   "m_config.o",
   "m_controls.o",
+  "m_counts.o",
   "m_fixed.o",
+  "m_flight.o",
+  "m_inflate.o",
   "m_menu.o",
   "m_misc.o",
+  "m_profile.o",
   "m_random.o",
+  "m_writer.o",
   "memio.o",
+  "net_client.o",
+  "net_common.o",
+  "net_dedicated.o",
+  "net_gui.o",
+  "net_io.o",
+  "net_loop.o",
+  "net_packet.o",
+  "net_query.o",
+  "net_server.o",
+  "net_structrw.o",
+  "net_udp.o",
+  "opl.o",
   "p_ceilng.o",
   "p_doors.o",
   "p_enemy.o",
@@ -86,6 +119,7 @@ local object_names = {
   "r_segs.o",
   "r_sky.o",
   "r_things.o",
+  "r_view.o",
   "s_sound.o",
   "sha1.o",
   "sounds.o",
@@ -96,15 +130,35 @@ local object_names = {
   "v_video.o",
   "w_checksum.o",
   "w_file.o",
+  "w_file_posix.o",
   "w_file_stdc.o",
+  "w_file_zip.o",
   "w_main.o",
+  "w_prefetch.o",
   "w_wad.o",
   "wi_stuff.o",
   "z_zone.o",
   "doomgeneric.o",
   "doomgeneric_actually.o",
+  "doomgeneric_capture.o",
+  "doomgeneric_cells.o",
+  "doomgeneric_deflate.o",
+  "doomgeneric_quality.o",
+  "doomgeneric_sixel.o",
 }
 
+--- @param stat uv.fs_stat.result
+--- @param other_stat uv.fs_stat.result
+--- @return boolean
+--- @nodiscard
+local function is_newer_or_same(stat, other_stat)
+  return stat.mtime.sec > other_stat.mtime.sec
+    or (
+      stat.mtime.sec == other_stat.mtime.sec
+      and stat.mtime.nsec >= other_stat.mtime.nsec
+    )
+end
+
 --- @return boolean
 --- @nodiscard
 local function needs_rebuild()
@@ -139,11 +193,7 @@ local function needs_rebuild()
     end
 
     -- If the source file is newer than the executable, then we need a rebuild.
-    return stat.mtime.sec > exe_stat.mtime.sec
-      or (
-        stat.mtime.sec == exe_stat.mtime.sec
-        and stat.mtime.nsec >= exe_stat.mtime.nsec
-      )
+    return is_newer_or_same(stat, exe_stat)
   end
 
   -- If this script was modified, then it's probably a good idea to rebuild.
@@ -166,6 +216,115 @@ local function needs_rebuild()
   return false
 end
 
+--- @param path string
+--- @return string[]? deps Files listed by the Make-style dependency file at
+---                        path, or nil if it can't be read.
+--- @nodiscard
+local function read_dep_file(path)
+  local f = io.open(path, "rb")
+  if not f then
+    return nil
+  end
+  local data = f:read "*a"
+  f:close()
+
+  -- "target: dep dep \<newline> dep ...", where "\ " is a space in a path.
+  data = data:gsub("\\\n", " "):gsub("\\ ", "\0"):gsub("^[^:]*:", "")
+  local deps = {}
+  for dep in data:gmatch "%S+" do
+    deps[#deps + 1] = (dep:gsub("%z", " "))
+  end
+  return deps
+end
+
+--- @param object_name string
+--- @param ext string
+--- @return string
+--- @nodiscard
+local function replace_ext(object_name, ext)
+  return (object_name:gsub("%.o$", ext))
+end
+
+--- Returns the objects in object_dir that are missing or older than their
+--- source or the headers it includes, according to their dependency files.
+--- @return string[]
+--- @nodiscard
+local function stale_objects()
+  local stats = {} --- @type table<string, uv.fs_stat.result|false>
+  --- @param path string
+  --- @return uv.fs_stat.result|false
+  local function stat(path)
+    if stats[path] == nil then
+      stats[path] = uv.fs_stat(path) or false
+    end
+    return stats[path]
+  end
+
+  local headers --- @type string[]?
+  local stale = {} --- @type string[]
+  for _, object_name in ipairs(object_names) do
+    local object_stat = stat(fs.joinpath(object_dir, object_name))
+    local deps = object_stat
+      and read_dep_file(fs.joinpath(object_dir, replace_ext(object_name, ".d")))
+    if object_stat and not deps then
+      -- No dependency file (e.g: a custom compile_cmd), so assume the source
+      -- includes every header.
+      if not headers then
+        headers = {}
+        for name, type in fs.dir(src_dir) do
+          if type == "file" and name:find "%.h$" then
+            headers[#headers + 1] = fs.joinpath(src_dir, name)
+          end
+        end
+      end
+      deps = { fs.joinpath(src_dir, replace_ext(object_name, ".c")) }
+      vim.list_extend(deps, headers)
+    end
+
+    if
+      not object_stat
+      or vim.iter(deps):any(function(dep)
+        local dep_stat = stat(dep)
+        return not dep_stat or is_newer_or_same(dep_stat, object_stat)
+      end)
+    then
+      stale[#stale + 1] = object_name
+    end
+  end
+  return stale
+end
+
+--- Empties object_dir, creating it if needed, unless its objects were built
+--- by the same compile command as cc's.
+--- @param cc CCompiler
+--- @return boolean emptied
+local function prepare_object_dir(cc)
+  local cmd_path = fs.joinpath(object_dir, "compile_cmd")
+  local cmd = table.concat(cc.compile_cmd("<src>", "<object>"), "\n")
+  local f = io.open(cmd_path, "rb")
+  if f then
+    local old_cmd = f:read "*a"
+    f:close()
+    if old_cmd == cmd then
+      return false
+    end
+  end
+
+  local rm_ok, rm_rv = pcall(fs.rm, object_dir, { recursive = true })
+  if not rm_ok and uv.fs_stat(object_dir) then
+    error(("Failed to empty build directory: %s"):format(rm_rv), 0)
+  end
+  if fn.mkdir(object_dir, "p") == 0 then
+    error(('Failed to create build directory "%s"'):format(object_dir), 0)
+  end
+
+  f = io.open(cmd_path, "wb")
+  if not f or not f:write(cmd) or not f:close() then
+    error(('Failed to write "%s"'):format(cmd_path), 0)
+  end
+  return true
+end
+
 --- @param co thread
 --- @return boolean, any ...
 --- @async
@@ -498,6 +657,7 @@ end
 
 --- @class (exact) RebuildOpts
 --- @field force boolean?
+--- @field pgo boolean?
 --- @field ignore_lock boolean?
 --- @field cc string|CCompiler|nil
 --- @field result_cb fun(ok: boolean, err: any?)?
@@ -515,6 +675,9 @@ function M.rebuild(opts)
   local console = opts.console --[[@as Console]]
 
   opts.cc = opts.cc or uv.os_getenv "CC" or "cc"
+  -- Profile-guided builds need different flags for each stage, so they're only
+  -- possible with the default commands.
+  local new_cc --- @type (fun(extra_flags: string[]): CCompiler)?
   if type(opts.cc) == "string" then
     local cmd_with_cflags = { opts.cc }
     if opts.cc == "zig" then
@@ -525,6 +688,7 @@ function M.rebuild(opts)
       "-Wall",
       "-Wextra",
       "-Wpedantic",
+      "-pthread",
       "-DNDEBUG",
       "-O3",
       -- Optimizations are on, but some debug info is useful, just in case.
@@ -548,37 +712,43 @@ function M.rebuild(opts)
 
     vim.list_extend(cmd_with_cflags, cflags)
 
-    opts.cc = {
-      compile_cmd = function(src_path, object_name)
-        local cmd = vim.deepcopy(cmd_with_cflags)
-        vim.list_extend(cmd, {
-          "-c",
-          src_path,
-          "-o",
-          object_name,
-        })
-        return cmd
-      end,
-
-      link_cmd = function(objects, exe_name)
-        local cmd = vim.deepcopy(cmd_with_cflags)
-        vim.list_extend(cmd, {
-          "-lc",
-          "-lm",
-          "-o",
-          exe_name,
-        })
-        vim.list_extend(cmd, objects)
-        return cmd
-      end,
-    }
+    new_cc = function(extra_flags)
+      local cmd_with_flags =
+        vim.list_extend(vim.deepcopy(cmd_with_cflags), extra_flags)
+
+      --- @type CCompiler
+      return {
+        compile_cmd = function(src_path, object_name)
+          local cmd = vim.deepcopy(cmd_with_flags)
+          vim.list_extend(cmd, {
+            "-MMD",
+            "-MF",
+            replace_ext(object_name, ".d"),
+            "-c",
+            src_path,
+            "-o",
+            object_name,
+          })
+          return cmd
+        end,
+
+        link_cmd = function(objects, exe_name)
+          local cmd = vim.deepcopy(cmd_with_flags)
+          vim.list_extend(cmd, { "-o", exe_name })
+          vim.list_extend(cmd, objects)
+          -- Libraries after the objects that use them, or they may be skipped.
+          vim.list_extend(cmd, { "-lc", "-lm" })
+          return cmd
+        end,
+      }
+    end
+    opts.cc = new_cc {}
   end
 
   local finished = false
   local pid_to_process = {} --- @type table<integer, vim.SystemObj>
   local release_lock = function() end
   local finish_augroup
-  local out_dir
 
   --- @param ok boolean
   --- @param err any?
@@ -593,21 +763,6 @@ function M.rebuild(opts)
     end
 
     vim.schedule(function()
-      if out_dir then
-        console:plugin_print "Cleaning up the temporary build directory...\n"
-
-        local rm_ok, rm_rv = pcall(fs.rm, out_dir, { recursive = true })
-        if not rm_ok then
-          console:plugin_print(
-            ('Failed to delete temporary build directory "%s": %s\n'):format(
-              out_dir,
-              rm_rv
-            ),
-            "Warn"
-          )
-        end
-      end
-
       release_lock()
       if finish_augroup then
         api.nvim_del_augroup_by_id(finish_augroup)
@@ -697,34 +852,11 @@ function M.rebuild(opts)
       callback = finish_autocmd_cb "Console buffer was closed",
     })
 
-    local reason = opts.force and "Rebuild requested"
-      or "Executable out-of-date"
-    local parallelism = uv.available_parallelism()
     console:plugin_print(
-      ("%s; rebuilding DOOM using %d parallel jobs...\n"):format(
-        reason,
-        parallelism
-      )
-    )
-
-    local out_dir_template =
-      fs.joinpath(fs.dirname(fn.tempname()), "actually-doom.nvim.XXXXXX")
-    assert(uv.fs_mkdtemp(out_dir_template, resume_co))
-    local out_dir_err_msg
-    out_dir_err_msg, out_dir = coroutine.yield()
-
-    if not out_dir then
-      error(
-        ("Failed to create temporary build directory: %s"):format(
-          out_dir_err_msg
-        ),
-        0
-      )
-    end
-    console:plugin_print(
-      ('Using "%s" as the temporary build directory\n'):format(out_dir),
+      ('Using "%s" as the build directory\n'):format(object_dir),
       "Debug"
     )
+    local parallelism = uv.available_parallelism()
 
     local function install()
       if finished then
@@ -744,7 +876,7 @@ function M.rebuild(opts)
       end
 
       if
-        fn.rename(fs.joinpath(out_dir, "actually-doom"), M.exe_install_path)
+        fn.rename(fs.joinpath(object_dir, "actually-doom"), M.exe_install_path)
         ~= 0
       then
         error(
@@ -761,13 +893,23 @@ function M.rebuild(opts)
     --- @param job_name string
     --- @param cmd string[]
     --- @param after_cb fun()
-    --- @return vim.SystemObj
-    local function spawn_job(job_name, cmd, after_cb)
+    --- @param fail_cb fun(err: string)? If set, called instead of raising an
+    ---                                  error if the job fails.
+    --- @param cwd string? Defaults to the build directory.
+    local function spawn_job(job_name, cmd, after_cb, fail_cb, cwd)
+      --- @param err string
+      local function fail(err)
+        if not fail_cb then
+          error(err, 0)
+        end
+        fail_cb(err)
+      end
+
       local pid
       local ok, rv = pcall(
         vim.system,
         cmd,
-        { cwd = out_dir },
+        { cwd = cwd or object_dir },
         --- @param out vim.SystemCompleted
         finish_on_err_wrap(function(out)
           pid_to_process[pid] = nil
@@ -783,72 +925,226 @@ function M.rebuild(opts)
           end
 
           if out.code ~= 0 then
-            error(
-              ('Job "%s" exited with code: %d'):format(job_name, out.code),
-              0
-            )
+            fail(('Job "%s" exited with code: %d'):format(job_name, out.code))
+            return
           end
 
           after_cb()
         end)
       )
       if not ok then
-        error(('Failed to spawn job "%s": %s'):format(job_name, rv), 0)
+        fail(('Failed to spawn job "%s": %s'):format(job_name, rv))
+        return
       end
 
       pid = rv.pid
       pid_to_process[pid] = rv
-      return rv
     end
 
-    local function spawn_link_job()
-      if finished then
-        return
+    --- Compiles the objects that are out-of-date for cc, then links them all
+    --- into the DOOM executable in the build directory.
+    --- @param cc CCompiler
+    --- @param reason string
+    --- @param done_cb fun()
+    local function spawn_build(cc, reason, done_cb)
+      -- Objects compiled with different flags can't be reused.
+      local emptied = prepare_object_dir(cc)
+      local to_compile = (opts.force or emptied) and object_names
+        or stale_objects()
+      console:plugin_print(
+        ("%s; rebuilding %d of %d objects using %d parallel jobs...\n"):format(
+          reason,
+          #to_compile,
+          #object_names,
+          parallelism
+        )
+      )
+
+      local function spawn_link_job()
+        if finished then
+          return
+        end
+
+        console:plugin_print "Linking DOOM executable...\n"
+        spawn_job(
+          "link",
+          cc.link_cmd(object_names, "actually-doom"),
+          vim.schedule_wrap(finish_on_err_wrap(done_cb))
+        )
       end
 
-      console:plugin_print "Linking DOOM executable...\n"
-      spawn_job(
-        "link",
-        opts.cc.link_cmd(object_names, "actually-doom"),
-        vim.schedule_wrap(finish_on_err_wrap(install))
+      local compile_object_i = 1
+      local function spawn_next_compile_job()
+        if finished then
+          return
+        end
+        if compile_object_i > #to_compile then
+          if vim.tbl_isempty(pid_to_process) then
+            spawn_link_job()
+          end
+          return
+        end
+
+        local object_name = to_compile[compile_object_i]
+        console:plugin_print(
+          ('(%d/%d) Building DOOM object "%s"...\n'):format(
+            compile_object_i,
+            #to_compile,
+            object_name
+          )
+        )
+
+        local src_path = fs.joinpath(src_dir, replace_ext(object_name, ".c"))
+        compile_object_i = compile_object_i + 1
+
+        -- Compile to a temporary name first, so an object from an interrupted
+        -- job is never mistaken for an up-to-date one.
+        local tmp_name = replace_ext(object_name, ".tmp.o")
+        spawn_job(
+          ("compile '%s'"):format(object_name),
+          cc.compile_cmd(src_path, tmp_name),
+          function()
+            local rename_ok, rename_err = uv.fs_rename(
+              fs.joinpath(object_dir, tmp_name),
+              fs.joinpath(object_dir, object_name)
+            )
+            if not rename_ok then
+              error(
+                ('Failed to rename compiled object "%s": %s'):format(
+                  tmp_name,
+                  rename_err
+                ),
+                0
+              )
+            end
+            -- Missing if the compile command doesn't write dependency files.
+            uv.fs_rename(
+              fs.joinpath(object_dir, replace_ext(tmp_name, ".d")),
+              fs.joinpath(object_dir, replace_ext(object_name, ".d"))
+            )
+
+            spawn_next_compile_job()
+          end
+        )
+      end
+
+      for _ = 1, parallelism do
+        finish_on_err(spawn_next_compile_job)
+      end
+    end
+
+    local reason = opts.force and "Rebuild requested"
+      or "Executable out-of-date"
+    if not opts.pgo then
+      spawn_build(opts.cc, reason, install)
+      return
+    elseif not new_cc then
+      console:plugin_print(
+        "Profile-guided builds need the default compiler commands\n",
+        "Warn"
       )
+      spawn_build(opts.cc, reason, install)
+      return
     end
 
-    local compile_object_i = 1
-    local function spawn_next_compile_job()
-      if finished then
-        return
-      end
-      if compile_object_i > #object_names then
-        if vim.tbl_isempty(pid_to_process) then
-          spawn_link_job()
+    -- Profile-guided build: build DOOM instrumented to count what runs, play
+    -- the IWAD's demos with it to collect a profile, then rebuild using it.
+    console:plugin_print(
+      ("%s; rebuilding DOOM with profile-guided optimization...\n"):format(
+        reason
+      )
+    )
+    --- @param err string
+    local function build_without_profile(err)
+      console:plugin_print(
+        ("Failed to collect a profile: %s; building without one\n"):format(err),
+        "Warn"
+      )
+      spawn_build(opts.cc, reason, install)
+    end
+    local without_profile =
+      vim.schedule_wrap(finish_on_err_wrap(build_without_profile))
+
+    -- Counts from older builds may not match the sources anymore.
+    local rm_ok, rm_rv = pcall(fs.rm, profile_dir, { recursive = true })
+    if not rm_ok and uv.fs_stat(profile_dir) then
+      error(("Failed to empty profile directory: %s"):format(rm_rv), 0)
+    end
+    if fn.mkdir(profile_dir, "p") == 0 then
+      error(
+        ('Failed to create profile directory "%s"'):format(profile_dir),
+        0
+      )
+    end
+
+    local gen_cc = new_cc { "-fprofile-generate=" .. profile_dir }
+    -- For Clang, a directory means the "default.profdata" within it.
+    local use_cc = new_cc { "-fprofile-use=" .. profile_dir }
+
+    local function spawn_optimized_build()
+      spawn_build(use_cc, "Optimizing DOOM with the profile", install)
+    end
+
+    local function merge_profile()
+      -- Clang writes raw profiles that must be merged first; GCC's are used
+      -- as they are.
+      local raw_names = {} --- @type string[]
+      for name, type in fs.dir(profile_dir) do
+        if type == "file" and name:find "%.profraw$" then
+          raw_names[#raw_names + 1] = name
         end
+      end
+      if #raw_names == 0 then
+        spawn_optimized_build()
         return
       end
 
-      local object_name = object_names[compile_object_i]
-      console:plugin_print(
-        ('(%d/%d) Building DOOM object "%s"...\n'):format(
-          compile_object_i,
-          #object_names,
-          object_name
-        )
+      local cmd = { "llvm-profdata", "merge", "-output=default.profdata" }
+      vim.list_extend(cmd, raw_names)
+      spawn_job(
+        "merge profile",
+        cmd,
+        vim.schedule_wrap(finish_on_err_wrap(spawn_optimized_build)),
+        without_profile,
+        profile_dir
       )
+    end
 
-      local src_name = object_name:gsub(".o$", ".c")
-      local src_path = fs.joinpath(src_dir, src_name)
-      compile_object_i = compile_object_i + 1
+    local function collect_profile()
+      local iwad_path = api.nvim_get_runtime_file("iwad/DOOM1.WAD", false)[1]
+      if not iwad_path then
+        without_profile "No IWAD to play"
+        return
+      end
 
+      console:plugin_print "Collecting a profile from the IWAD's demos...\n"
       spawn_job(
-        ("compile '%s'"):format(object_name),
-        opts.cc.compile_cmd(src_path, object_name),
-        spawn_next_compile_job
+        "collect profile",
+        {
+          fs.joinpath(object_dir, "actually-doom"),
+          "-iwad",
+          iwad_path,
+          "-bench",
+        },
+        vim.schedule_wrap(finish_on_err_wrap(merge_profile)),
+        without_profile,
+        profile_dir
       )
     end
 
-    for _ = 1, parallelism do
-      finish_on_err(spawn_next_compile_job)
-    end
+    -- Check the compiler supports profiling before building everything.
+    spawn_job(
+      "check profiling support",
+      gen_cc.compile_cmd(
+        fs.joinpath(src_dir, "m_bbox.c"),
+        fs.joinpath(profile_dir, "check.o")
+      ),
+      vim.schedule_wrap(finish_on_err_wrap(function()
+        spawn_build(gen_cc, "Instrumenting DOOM for profiling", collect_profile)
+      end)),
+      without_profile,
+      profile_dir
+    )
   end)
 
   resume_co()
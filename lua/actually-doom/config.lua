@@ -4,6 +4,7 @@ local M = {
   --- @class (exact) ActuallyConfig
   --- @field game PlayOpts?
   --- @field build RebuildOpts?
+  --- @field console_max_lines integer?
   config = {
     game = {},
     build = {},
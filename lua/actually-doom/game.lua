@@ -7,6 +7,7 @@ local ui = vim.ui
 local uv = vim.uv
 
 local strbuf = require "actually-doom.strbuf"
+local timing = require "actually-doom.timing"
 
 local M = {
   --- @enum MenuType
@@ -58,31 +59,107 @@ local M = {
 --- @field key integer
 --- @field shift boolean
 --- @field alt boolean
+--- @field press_time integer
+--- @field repeats integer Times the terminal has repeated it while held.
 --- @field release_time integer
 
 --- @class (exact) Finale
 --- @field stage FinaleStage
 --- @field text string
 
+--- Totals since the last AMSG_STATS.
+--- @class (exact) ClientStats
+--- @field recv_ns integer Time handling data received from the socket.
+--- @field refresh_ns integer Time presenting frames.
+--- @field chan_send_ns integer Time within refresh_ns writing to the terminal.
+--- @field frames integer
+--- @field timings Timings? With PlayOpts.client_timing.
+
+--- @param timed boolean
+--- @return ClientStats
+--- @nodiscard
+local function new_client_stats(timed)
+  return {
+    recv_ns = 0,
+    refresh_ns = 0,
+    chan_send_ns = 0,
+    frames = 0,
+    timings = timed and timing.new() or nil,
+  }
+end
+
+-- CPU_* features in AMSG_STATS's simd_features (see i_cpu.h).
+local simd_features = { "SSE2", "SSSE3", "AVX2", "NEON" }
+
+--- @param features integer
+--- @return string
+--- @nodiscard
+local function simd_feature_names(features)
+  local names = {} --- @type string[]
+  for i, name in ipairs(simd_features) do
+    if bit.band(features, bit.lshift(1, i - 1)) ~= 0 then
+      names[#names + 1] = name
+    end
+  end
+  return #names > 0 and table.concat(names, ", ") or "none"
+end
+
+-- What AMSG_STATS's work_counts count, in order (see workcount_t in
+-- m_counts.h).
+local work_count_names = {
+  "BSP nodes",
+  "segs",
+  "visplanes",
+  "spans",
+  "columns",
+  "pixels",
+  "vissprites",
+  "sight checks",
+  "REJECT hits",
+  "path traverses",
+  "blockmap cells",
+  "thinkers",
+  "removed thinkers",
+  "Z_Mallocs",
+}
+
 --- @class (exact) Doom
 --- @field play_opts PlayOpts
 --- @field console Console
---- @field process vim.SystemObj
---- @field sock uv.uv_pipe_t
+--- @field process vim.SystemObj? nil if only viewing another's process.
+--- @field sock_path string Or "tcp:HOST:PORT"; see init_connection.
+--- @field sock uv.uv_pipe_t|uv.uv_tcp_t
 --- @field send_buf StrBuf
 --- @field check_timer uv.uv_timer_t
+--- @field listening boolean? Whether DOOM printed listening_line.
+--- @field on_listening function? Called once DOOM prints listening_line.
+--- @field standby boolean? Started ahead of time and not yet played; see
+--- start_standby.
+--- @field exe_stat uv.fs_stat.result? Of the executable, if standby.
 --- @field check_scheduled boolean?
 --- @field pressed_key PressedKey?
 --- @field mouse_button_mask integer
+--- @field mouse_pos integer[]? Screen row and column of the last mouse motion.
+--- @field mouse_motion_x integer Motion not yet sent, in mouse counts.
+--- @field mouse_motion_y integer
+--- @field mouse_motion_time integer? When motion was last sent.
+--- @field frames_outstanding integer
+--- @field engine_caps integer
+--- @field show_stats boolean?
+--- @field client_stats ClientStats
 --- @field screen Screen?
 --- @field player_status PlayerStatus?
 --- @field game_msg string
 --- @field menu_msg string
 --- @field automap_title string
 --- @field finale Finale?
+--- @field sound_cmd string[]? Plays sound; see find_sound_cmd.
+--- @field sound_rate integer?
+--- @field sound_process vim.SystemObj?
 --- @field closed boolean?
 ---
 --- @field run function
+--- @field spectate function
 local Doom = {}
 
 --- @param buf StrBuf
@@ -97,9 +174,126 @@ local function put_string(buf, s)
   )
 end
 
+-- Must match PROTOCOL_VERSION in doomgeneric_actually.c.
+local protocol_version = 8
+
+--- Optional protocol features; see CAP_* in doomgeneric_actually.c.
+--- @enum Cap
+local cap = {
+  FRAME_DELTA = 0x1,
+  FRAME_INDEXED = 0x2,
+  FRAME_CELLS = 0x4,
+  FRAME_SHM = 0x8,
+  GRANT_FRAMES = 0x10,
+  STATS = 0x20,
+  FRAME_SHM_REGIONS = 0x40,
+  FRAME_ZLIB = 0x80,
+  FRAME_SCALE = 0x100,
+  SOUND = 0x200,
+  FRAME_SIXEL = 0x400,
+  PALETTE_CACHE = 0x800,
+  CELL_ORIGIN = 0x1000,
+  FRAME_CACHE = 0x2000,
+  SIXEL_REGIONS = 0x4000,
+}
+
+-- Features we handle; sent in CMSG_HELLO.
+local client_caps = bit.bor(
+  cap.FRAME_CELLS,
+  cap.FRAME_SHM,
+  cap.FRAME_SHM_REGIONS,
+  cap.FRAME_ZLIB,
+  cap.FRAME_SCALE,
+  cap.FRAME_SIXEL,
+  cap.CELL_ORIGIN,
+  cap.FRAME_CACHE,
+  cap.GRANT_FRAMES,
+  cap.STATS
+)
+
+-- Tried in order if the sound option is true. Each plays the raw PCM that
+-- AMSG_SOUND has from stdin, at "{rate}" Hz.
+local default_sound_cmds = {
+  { "pacat", "--raw", "--format=s16le", "--channels=2", "--rate={rate}" },
+  { "aplay", "-q", "-t", "raw", "-f", "S16_LE", "-c", "2", "-r", "{rate}" },
+  -- SoX.
+  {
+    "play",
+    "-q",
+    "-t",
+    "raw",
+    "-e",
+    "signed",
+    "-b",
+    "16",
+    "-c",
+    "2",
+    "-r",
+    "{rate}",
+    "-",
+  },
+}
+
+--- @param console Console
+--- @param sound boolean|string[]|nil The sound option.
+--- @return string[]? cmd nil if there's no sound.
+--- @nodiscard
+local function find_sound_cmd(console, sound)
+  if type(sound) == "table" then
+    return sound
+  elseif not sound then
+    return nil
+  end
+
+  for _, cmd in ipairs(default_sound_cmds) do
+    if fn.executable(cmd[1]) == 1 then
+      return cmd
+    end
+  end
+  console:plugin_print(
+    "No sound player found (pacat, aplay or play); playing without sound\n",
+    "Warn"
+  )
+  return nil
+end
+
+-- Number of frames the engine may send before they're presented. More than
+-- one lets the engine render the next frame while we present the last.
+local frame_window = 2
+
+--- Grant the engine enough credits to have frame_window frames outstanding.
 function Doom:send_frame_request()
-  -- CMSG_WANT_FRAME (no payload)
-  self.send_buf:put "\0"
+  -- Nothing can present the frame until enable_kitty picks a Gfx, which
+  -- requests a frame itself afterwards.
+  if not self.screen or self.screen.gfx.type == "null" then
+    return
+  end
+
+  local count = frame_window - self.frames_outstanding
+  if count > 0 then
+    -- CMSG_GRANT_FRAMES
+    self.send_buf:put("\5", string.char(count))
+    self.frames_outstanding = frame_window
+  end
+end
+
+--- Have the engine send its next frame in full.
+function Doom:send_want_keyframe()
+  -- CMSG_WANT_KEYFRAME
+  self.send_buf:put "\7"
+  self:schedule_check()
+end
+
+--- Call after frames from the engine were presented (or dropped) to grant
+--- credit for more, if the screen is still visible.
+--- @param count integer? Number of frames; defaults to 1.
+function Doom:on_frame_presented(count)
+  self.frames_outstanding =
+    math.max(0, self.frames_outstanding - (count or 1))
+  if not self.closed and self.screen.visible then
+    self:send_frame_request()
+    self:schedule_check()
+  end
 end
 
 --- @param name string
@@ -111,6 +305,65 @@ function Doom:send_set_config_var(name, value)
   put_string(self.send_buf, value)
 end
 
+--- @param vars [string, string][] Names and values, set in order.
+function Doom:send_set_config_vars(vars)
+  -- CMSG_SET_CONFIG_VARS
+  assert(#vars <= 0xffff)
+  self.send_buf:put(
+    "\10",
+    string.char(bit.band(#vars, 0xff), bit.rshift(#vars, 8))
+  )
+  for _, var in ipairs(vars) do
+    put_string(self.send_buf, var[1])
+    put_string(self.send_buf, var[2])
+  end
+end
+
+--- @param width integer
+--- @param height integer
+--- @param true_colour boolean
+--- @param half_blocks boolean
+function Doom:send_set_cell_grid(width, height, true_colour, half_blocks)
+  -- CMSG_SET_CELL_GRID
+  self.send_buf:put(
+    "\4",
+    string.char(bit.band(width, 0xff), bit.rshift(width, 8)),
+    string.char(bit.band(height, 0xff), bit.rshift(height, 8)),
+    true_colour and "\1" or "\0",
+    half_blocks and "\1" or "\0"
+  )
+end
+
+--- Where the cell grid's top-left cell is drawn on the host terminal's screen;
+--- 0s for it to fill the screen buffer's terminal (the default).
+--- @param row integer
+--- @param col integer
+function Doom:send_set_cell_origin(row, col)
+  -- CMSG_SET_CELL_ORIGIN
+  self.send_buf:put(
+    "\12",
+    string.char(bit.band(row, 0xff), bit.rshift(row, 8)),
+    string.char(bit.band(col, 0xff), bit.rshift(col, 8))
+  )
+end
+
+--- Only affects frames sent via shared memory or as AMSG_FRAME_ZLIB.
+--- @param scale integer
+--- @param aspect_correct boolean
+function Doom:send_set_frame_scale(scale, aspect_correct)
+  if bit.band(self.engine_caps, cap.FRAME_SCALE) == 0 then
+    return
+  end
+  -- CMSG_SET_FRAME_SCALE
+  self.send_buf:put("\8", string.char(scale), aspect_correct and "\1" or "\0")
+end
+
+--- @param scale integer 0 to stop sending frames as sixel images.
+function Doom:send_set_sixel_scale(scale)
+  -- CMSG_SET_SIXEL_SCALE
+  self.send_buf:put("\11", string.char(scale))
+end
+
 -- Corresponds to the DOOM key codes defined in doomkeys.h.
 -- Non-exhaustive; contains those only referenced by us.
 --- @enum DoomKey
@@ -144,6 +397,15 @@ local doomkey = {
   DEL = 211,
 }
 
+-- Motion is sent at most about once a tic, as DOOM only reads it once a tic
+-- anyway; moving the mouse quickly otherwise reports motion far more often.
+local mouse_motion_interval_ms = 28
+
+-- Mouse counts for moving across a cell, which is roughly twice as tall as it
+-- is wide.
+local mouse_counts_per_col = 8
+local mouse_counts_per_row = 16
+
 --- Schedules a check to happen in approximately `ms` milliseconds from now.
 --- If a check is already scheduled, reschedule it if `ms` is sooner.
 --- @param ms integer? If nil, schedule for the next event loop iteration.
@@ -162,6 +424,16 @@ function Doom:schedule_check(ms)
       end
     end
 
+    if self.mouse_motion_x ~= 0 or self.mouse_motion_y ~= 0 then
+      local send_time = (self.mouse_motion_time or 0)
+        + mouse_motion_interval_ms
+      if now >= send_time then
+        self:send_mouse_motion()
+      else
+        next_sched_time = math.min(next_sched_time, send_time)
+      end
+    end
+
     self:flush_send()
     if next_sched_time < math.huge then
       -- As some time may have passed, use the updated now time.
@@ -191,6 +463,42 @@ function Doom:send_mouse_buttons()
   self.send_buf:put("\1", string.char(self.mouse_button_mask), "\255")
 end
 
+function Doom:send_mouse_motion()
+  local dx = math.max(-0x8000, math.min(self.mouse_motion_x, 0x7fff))
+  local dy = math.max(-0x8000, math.min(self.mouse_motion_y, 0x7fff))
+  self.mouse_motion_x = self.mouse_motion_x - dx
+  self.mouse_motion_y = self.mouse_motion_y - dy
+  self.mouse_motion_time = uv.now()
+
+  -- CMSG_MOUSE_MOTION
+  dx = bit.band(dx, 0xffff)
+  dy = bit.band(dy, 0xffff)
+  self.send_buf:put(
+    "\9",
+    string.char(bit.band(dx, 0xff), bit.rshift(dx, 8)),
+    string.char(bit.band(dy, 0xff), bit.rshift(dy, 8))
+  )
+end
+
+--- Accumulates the motion of the mouse since the last call, to be sent by a
+--- check.
+function Doom:move_mouse()
+  local pos = fn.getmousepos()
+  local last_pos = self.mouse_pos
+  self.mouse_pos = { pos.screenrow, pos.screencol }
+  if not last_pos then
+    return
+  end
+
+  self.mouse_motion_x = self.mouse_motion_x
+    + (pos.screencol - last_pos[2]) * mouse_counts_per_col
+  self.mouse_motion_y = self.mouse_motion_y
+    + (pos.screenrow - last_pos[1]) * mouse_counts_per_row
+  self:schedule_check(
+    (self.mouse_motion_time or 0) + mouse_motion_interval_ms - uv.now()
+  )
+end
+
 --- @param info PressedKey?
 function Doom:press_key(info)
   if self.pressed_key then
@@ -222,6 +530,10 @@ function Doom:press_key(info)
 end
 
 do
+  -- Shortest time a key repeated by the terminal is held for after each
+  -- repeat; a couple of tics, so one late repeat doesn't release it.
+  local min_repeat_hold_ms = 60
+
   --- @type table<string, DoomKey>
   local special_to_doomkey = {
     [vim.keycode "<BS>"] = doomkey.BACKSPACE,
@@ -276,6 +588,13 @@ do
   --- @param key string
   function Doom:press_vim_key(key)
     local keycode = fn.keytrans(key)
+    if
+      keycode:find("MouseMove>", 1, true) or keycode:find("Drag>", 1, true)
+    then
+      self:move_mouse()
+      return ""
+    end
+
     local mouse_prefix_i = keycode:find("Mouse>", 1, true)
       or keycode:find("Release>", 1, true)
     if mouse_prefix_i then
@@ -350,13 +669,38 @@ do
       end
     end
 
+    -- Without release events, a press is held for key_hold_ms, which must
+    -- outlast the delay before the terminal starts repeating a held key. Once
+    -- it's repeating at its steady rate, release soon after the repeats stop
+    -- instead, so letting go doesn't overshoot by the whole hold time.
     -- TODO: doesn't always work well for the plasma gun or chain gun, but the
     -- default of 375 isn't awful.
+    local now = uv.now()
+    local hold_ms = self.play_opts.key_hold_ms or 375
+    local repeats = 0
+    local prev = self.pressed_key
+    if
+      prev
+      and prev.key == dkey
+      and prev.shift == shift
+      and prev.alt == alt
+    then
+      repeats = prev.repeats + 1
+      if repeats >= 2 then -- The first repeat came after the delay.
+        hold_ms = math.min(
+          hold_ms,
+          math.max(min_repeat_hold_ms, (now - prev.press_time) * 3)
+        )
+      end
+    end
+
     self:press_key {
       key = dkey,
       shift = shift,
       alt = alt,
-      release_time = uv.now() + (self.play_opts.key_hold_ms or 375),
+      press_time = now,
+      repeats = repeats,
+      release_time = now + hold_ms,
     }
     self:schedule_check()
     return "" -- We handled the key, so eat it (yum!)
@@ -379,10 +723,12 @@ function Doom:enable_kitty(on)
   end
 
   --- @param name string?
-  local function send_frame_shm_name(name)
+  --- @param slot_count integer?
+  local function send_frame_shm_name(name, slot_count)
     -- CMSG_SET_FRAME_SHM_NAME
     self.send_buf:put "\2"
     put_string(self.send_buf, name or "")
+    self.send_buf:put(string.char(slot_count or 0))
   end
 
   local should_detect = on == nil
@@ -391,8 +737,11 @@ function Doom:enable_kitty(on)
     and vim.iter(api.nvim_list_uis()):find(function(u)
       return u.chan == 1 and u.stdout_tty
     end)
+  local kitty = require "actually-doom.ui.kitty"
+  local detection_key --- @type string
   local detect_cb = should_detect
       and function(kitty_gfx, result)
+        kitty.cache_detection(detection_key, result)
         if result ~= "OK" then
           self.console:plugin_print(
             (
@@ -406,34 +755,128 @@ function Doom:enable_kitty(on)
         end
 
         if kitty_gfx == self.screen:kitty_gfx() then
-          self.console:plugin_print "kitty graphics detected! Turning ON\n"
+          if not kitty_gfx.detect_in_background then
+            self.console:plugin_print "kitty graphics detected! Turning ON\n"
+          end
           kitty_gfx.detect = nil
+          kitty_gfx.detect_in_background = nil
         end
       end
     or nil
 
+  -- Shared memory doesn't work remotely, so transmit frames directly instead.
+  -- Viewers can't choose how frames are sent, but only direct ones reach them.
+  local direct = self.play_opts.kitty_direct or not self.process
+  if direct == nil then
+    direct = bit.band(self.engine_caps, cap.FRAME_SHM) == 0
+      or os.getenv "SSH_CONNECTION" ~= nil
+      or os.getenv "SSH_TTY" ~= nil
+  end
+  local engine_cap = direct and cap.FRAME_ZLIB or cap.FRAME_SHM
+
+  -- Detecting support can take a while, so go by what was detected last time
+  -- for this terminal. If it was supported, enable it straight away and check
+  -- again while frames are drawn; failures are trusted for a while.
+  detection_key = kitty.detection_key(direct, self.screen.tmux_passthrough)
+  local cached_detection = detect_cb and kitty.cached_detection(detection_key)
+  if cached_detection and cached_detection ~= "OK" then
+    self.console:plugin_print(
+      (
+        "kitty detection failed before: %s\n"
+        .. 'See ":help actually-doom-kitty" for advice\n'
+      ):format(cached_detection),
+      "Warn"
+    )
+    detect_cb = nil
+  end
+
+  if (on or detect_cb) and bit.band(self.engine_caps, engine_cap) == 0 then
+    self.console:plugin_print(
+      ("DOOM can't send frames via %s; kitty graphics unavailable\n"):format(
+        direct and "zlib" or "shared memory"
+      ),
+      "Warn"
+    )
+    on = false
+    detect_cb = nil
+  end
+
   if (on or detect_cb) and not self.screen:kitty_gfx() then
-    if detect_cb then
+    if cached_detection == "OK" then
+      self.console:plugin_print "kitty graphics detected before! Turning ON\n"
+    elseif detect_cb then
       self.console:plugin_print "Detecting kitty graphics support...\n"
     else
       self.console:plugin_print "kitty graphics protocol ON\n"
     end
 
     -- NOTE: macOS doesn't like colons in shm names
-    local shm_name = ("/actually-doom-%d"):format(self.process.pid)
-    send_frame_shm_name(shm_name)
+    local shm_name = not direct
+        and ("/actually-doom-%d"):format(self.process.pid)
+      or nil
+    send_frame_shm_name(shm_name, shm_name and kitty.shm_slot_count)
     self:send_set_config_var("detached_ui", "0")
-    self:schedule_check()
-    self.screen:set_gfx(require "actually-doom.ui.kitty", shm_name)
+    self.screen:set_gfx(kitty, shm_name)
     self.screen:kitty_gfx().detect = detect_cb
-  elseif not on and not self.screen:cell_gfx() then
+    if cached_detection == "OK" then
+      self.screen:kitty_gfx().detect_in_background = true
+    end
+  elseif
+    not on
+    and not self.screen:cell_gfx()
+    and not self.screen:sixel_gfx()
+  then
     self.console:plugin_print "kitty graphics protocol OFF\n"
 
-    send_frame_shm_name()
-    self:send_set_config_var("detached_ui", "1")
-    self:schedule_check()
-    self.screen:set_gfx(require "actually-doom.ui.cell")
+    local sixel = self.play_opts.sixel
+    if sixel and bit.band(self.engine_caps, cap.FRAME_SIXEL) == 0 then
+      self.console:plugin_print(
+        "DOOM can't send frames as sixels; sixel graphics unavailable\n",
+        "Warn"
+      )
+      sixel = false
+    end
+
+    -- Sets the cell grid or sixel scale, which must happen before shm is
+    -- turned off so that no pixel frames are sent in-between.
+    if sixel then
+      self.console:plugin_print "sixel graphics ON\n"
+      self.screen:set_gfx(require "actually-doom.ui.sixel")
+      send_frame_shm_name()
+      self:send_set_config_var("detached_ui", "0")
+    else
+      -- Viewers are sent the same cells, which wouldn't be placed right for
+      -- their screens, and can't place them themselves. As we can't tell if
+      -- we're a viewer of a DOOM we didn't start, assume we might be.
+      local cell_direct = self.play_opts.cell_direct
+      if cell_direct and (not self.process or self.play_opts.allow_viewers) then
+        self.console:plugin_print(
+          "cell_direct unavailable with viewers; drawing cells as usual\n",
+          "Warn"
+        )
+        cell_direct = false
+      elseif
+        cell_direct and bit.band(self.engine_caps, cap.CELL_ORIGIN) == 0
+      then
+        self.console:plugin_print(
+          "DOOM can't place cells; cell_direct unavailable\n",
+          "Warn"
+        )
+        cell_direct = false
+      end
+
+      self.screen:set_gfx(require "actually-doom.ui.cell", cell_direct)
+      send_frame_shm_name()
+      self:send_set_config_var("detached_ui", "1")
+    end
+  else
+    return
+  end
+
+  if self.screen.visible then
+    self:send_frame_request()
   end
+  self:schedule_check()
 end
 
 function Doom:flush_send()
@@ -456,19 +899,38 @@ function Doom:flush_send()
   handle_err(err)
 end
 
+-- Printed by DOOM to stdout once it's listening for our connection; see
+-- DG_Init in doomgeneric_actually.c.
+local listening_line = "[actually-doom] Listening for connections"
+
 --- @param doom Doom
 --- @param exe_path string
 --- @param sock_path string
-local function init_process(doom, exe_path, sock_path)
+--- @param standby boolean? Load, then wait for a connection before starting.
+local function init_process(doom, exe_path, sock_path, standby)
+  local out_tail = "" -- Last line of stdout so far, which may be unfinished.
+
   --- @param console_hl string?
+  --- @param watch_listening boolean?
   --- @return fun(err: nil|string, data: string|nil)
   --- @nodiscard
-  local function new_out_cb(console_hl)
+  local function new_out_cb(console_hl, watch_listening)
     return function(err, data)
       if err then
         doom.console:plugin_print(("Stream error: %s\n"):format(err), "Error")
       elseif data then
         doom.console:print(data, console_hl)
+
+        if watch_listening and not doom.listening then
+          local text = out_tail .. data
+          out_tail = text:match "[^\n]*$"
+          if text:find(listening_line, 1, true) then
+            doom.listening = true
+            if doom.on_listening then
+              doom.on_listening()
+            end
+          end
+        end
       end
     end
   end
@@ -480,11 +942,74 @@ local function init_process(doom, exe_path, sock_path)
     "-iwad",
     doom.play_opts.iwad_path,
   }
+  if doom.play_opts.render_scale then
+    vim.list_extend(cmd, { "-hires", tostring(doom.play_opts.render_scale) })
+  end
+  if doom.play_opts.cell_dither then
+    cmd[#cmd + 1] = "-celldither"
+  end
+  if doom.play_opts.allow_viewers then
+    cmd[#cmd + 1] = "-viewers"
+  end
+  if doom.play_opts.cpus then
+    vim.list_extend(cmd, { "-cpus", doom.play_opts.cpus })
+  end
+  vim.list_extend(cmd, {
+    "-workers",
+    tostring(doom.play_opts.workers or uv.available_parallelism()),
+  })
+  if doom.play_opts.nice then
+    vim.list_extend(cmd, { "-nice", tostring(doom.play_opts.nice) })
+  end
+  if doom.play_opts.huge_pages then
+    cmd[#cmd + 1] = "-hugepages"
+  end
+  if doom.play_opts.far_look_dist then
+    vim.list_extend(
+      cmd,
+      { "-farlook", tostring(doom.play_opts.far_look_dist) }
+    )
+  end
+  if doom.play_opts.target_fps then
+    vim.list_extend(
+      cmd,
+      { "-targetfps", tostring(doom.play_opts.target_fps) }
+    )
+  end
+  if doom.play_opts.view_thread then
+    cmd[#cmd + 1] = "-viewthread"
+  end
+  if doom.play_opts.capture_path then
+    vim.list_extend(
+      cmd,
+      { "-capture", fs.normalize(fs.abspath(doom.play_opts.capture_path)) }
+    )
+  end
+  if doom.play_opts.low_mem_mb then
+    vim.list_extend(cmd, { "-lowmem", tostring(doom.play_opts.low_mem_mb) })
+  end
+  if doom.play_opts.share_textures then
+    cmd[#cmd + 1] = "-sharedtextures"
+  end
+  if doom.play_opts.slow_frame_ms then
+    local dir =
+      fs.joinpath(fn.stdpath "state", "actually-doom.nvim", "slow-frames")
+    fn.mkdir(dir, "p")
+    vim.list_extend(cmd, {
+      "-slowframes",
+      tostring(doom.play_opts.slow_frame_ms),
+      "-slowframedir",
+      dir,
+    })
+  end
+  if standby then
+    cmd[#cmd + 1] = "-standby"
+  end
   vim.list_extend(cmd, doom.play_opts.extra_args or {})
 
   local sys_ok, sys_rv = pcall(vim.system, cmd, {
     cwd = fs.dirname(exe_path),
-    stdout = new_out_cb(),
+    stdout = new_out_cb(nil, true),
     stderr = new_out_cb "Warn",
   }, function(out)
     doom.console:print "\n"
@@ -511,19 +1036,35 @@ end
 --- @param doom Doom
 --- @param buf StrBuf
 local function recv_msg_loop(doom, buf)
+  local timed = doom.client_stats.timings ~= nil
+  -- Time spent waiting for more data during the message being handled, which
+  -- isn't counted towards its handler.
+  local waited_ns = 0
+
+  --- @param n integer
+  local function wait_for_bytes(n)
+    while n > buf:len() do
+      local start_ns = timed and uv.hrtime()
+      coroutine.yield()
+      if start_ns then
+        waited_ns = waited_ns + uv.hrtime() - start_ns
+      end
+    end
+  end
+
   --- @param n integer (0 gives an empty string)
   --- @return string
   --- @nodiscard
   local function read_bytes(n)
-    while n > buf:len() do
-      coroutine.yield()
-    end
+    wait_for_bytes(n)
     return buf:get(n)
   end
 
+  -- Integers are read with get_bytes, so no string is created for each.
   --- @return integer
   local function read_u8()
-    return read_bytes(1):byte()
+    wait_for_bytes(1)
+    return (buf:get_bytes(1))
   end
   --- @return integer
   local function read_i8()
@@ -531,7 +1072,8 @@ local function recv_msg_loop(doom, buf)
   end
   --- @return integer
   local function read_u16()
-    local a, b = read_bytes(2):byte(1, 2)
+    wait_for_bytes(2)
+    local a, b = buf:get_bytes(2)
     return bit.bor(a, bit.lshift(b, 8))
   end
   --- @return integer
@@ -540,7 +1082,8 @@ local function recv_msg_loop(doom, buf)
   end
   --- @return integer
   local function read_u32()
-    local a, b, c, d = read_bytes(4):byte(1, 4)
+    wait_for_bytes(4)
+    local a, b, c, d = buf:get_bytes(4)
     return bit.bor(a, bit.lshift(b, 8), bit.lshift(c, 16), bit.lshift(d, 24))
   end
   --- @return integer
@@ -554,64 +1097,189 @@ local function recv_msg_loop(doom, buf)
 
   local res_x = read_u16()
   local res_y = read_u16()
+  local engine_protocol_version = read_u16()
+  doom.engine_caps = read_u16()
   doom.console:plugin_print(
-    ("AMSG_INIT: res_x=%d res_y=%d\n"):format(res_x, res_y),
+    ("AMSG_INIT: res_x=%d res_y=%d protocol_version=%d caps=0x%x\n"):format(
+      res_x,
+      res_y,
+      engine_protocol_version,
+      doom.engine_caps
+    ),
     "Debug"
   )
+  if engine_protocol_version ~= protocol_version then
+    doom.console:plugin_print(
+      (
+        "DOOM executable uses protocol version %d, but version %d is "
+        .. "required; quitting\n"
+        .. 'Try rebuilding it: ":lua require(\"actually-doom\").rebuild()"\n'
+      ):format(engine_protocol_version, protocol_version),
+      "Error"
+    )
+    doom:close()
+    return
+  end
+
+  -- CMSG_HELLO
+  local caps = doom.sound_cmd and bit.bor(client_caps, cap.SOUND) or client_caps
+  if doom.play_opts.sixel_regions then
+    caps = bit.bor(caps, cap.SIXEL_REGIONS)
+  end
+  doom.send_buf:put(
+    "\6",
+    string.char(bit.band(protocol_version, 0xff)),
+    string.char(bit.rshift(protocol_version, 8)),
+    string.char(bit.band(caps, 0xff)),
+    string.char(bit.rshift(caps, 8))
+  )
 
   doom.screen = require("actually-doom.ui").Screen.new(doom, res_x, res_y)
   doom:enable_kitty(doom.play_opts.kitty_graphics)
 
   -- Can't use the typical Vanilla DOOM CTRL key to fire (as it's only available
   -- as a modifier for other keys), so use X.
-  doom:send_set_config_var("key_fire", "45") -- DOS scancode for x.
-  doom:send_frame_request()
+  local config_vars = { { "key_fire", "45" } } -- DOS scancode for x.
+  for name, value in vim.spairs(doom.play_opts.config_vars or {}) do
+    config_vars[#config_vars + 1] = { name, tostring(value) }
+  end
+  doom:send_set_config_vars(config_vars)
   doom:schedule_check()
 
-  -- TODO: merge AMSG_FRAME_DRAW_MENU with AMSG_FRAME so we don't need this.
-  --       same for intermission and finale crap
+  -- Overlays are only sent when they change, so they apply to every frame
+  -- until the next.
   local menu --- @type Menu?
   local intermission --- @type Intermission?
   local finale_text_len = 0 --- @type integer
+  --- Item lumps by MenuType, from AMSG_MENU_ITEMS.
+  local menu_items = {} --- @type table<MenuType, string[]>
+  --- Sixel images kept by slot (0-indexed), from AMSG_CACHE_FRAME, and the
+  --- slot to keep the next as, if any.
+  local cached_frames = {} --- @type table<integer, string>
+  local cache_frame_slot --- @type integer?
+
+  --- Frames received since the last refresh was scheduled; drawn together by
+  --- it, with the overlays of the newest. Reused for every refresh.
+  --- @class (exact) PendingFrame
+  --- @field scheduled boolean
+  --- @field cell_gfx CellGfx?
+  --- @field cells string[]
+  --- @field menu Menu?
+  --- @field intermission Intermission?
+  --- @field finale_text_len integer?
+  --- @field enabled_dui_bits integer?
+  local pending_frame = { scheduled = false, cells = {} } --- @type PendingFrame
+
+  --- Count the time since start_ns towards presenting frames, and with
+  --- PlayOpts.client_timing, towards name's histogram.
+  --- @param name string
+  --- @param start_ns number
+  local function add_refresh_time(name, start_ns)
+    local ns = uv.hrtime() - start_ns
+    local stats = doom.client_stats
+    stats.refresh_ns = stats.refresh_ns + ns
+    if stats.timings then
+      stats.timings:add(name, ns)
+    end
+  end
 
-  --- @type table<integer, fun(): boolean?>
-  local msg_handlers = {
-    -- AMSG_FRAME
-    [0] = function()
-      local len = require("actually-doom.ui.cell").pixel_index(
-        0,
-        doom.screen.res_y,
-        doom.screen.res_x
-      )
+  --- vim.schedule(callback), with PlayOpts.client_timing timing how long it
+  --- waits for Nvim to get to it.
+  --- @param callback fun()
+  local function schedule_refresh(callback)
+    if not timed then
+      vim.schedule(callback)
+      return
+    end
 
-      local pixels = read_bytes(len)
-      local enabled_dui_bits = read_u8()
-
-      local cell_gfx = doom.screen:cell_gfx()
-      if cell_gfx then
-        vim.schedule(function()
-          cell_gfx:refresh(
-            pixels,
-            menu,
-            intermission,
-            finale_text_len,
-            bit.band(enabled_dui_bits, 1) ~= 0,
-            bit.band(enabled_dui_bits, 2) ~= 0,
-            bit.band(enabled_dui_bits, 4) ~= 0,
-            bit.band(enabled_dui_bits, 8) ~= 0,
-            bit.band(enabled_dui_bits, 16) ~= 0
-          )
-          -- TODO: hack
-          menu = nil
-          intermission = nil
-          finale_text_len = 0
-        end)
-      end
+    local queued_ns = uv.hrtime()
+    vim.schedule(function()
+      local timings = doom.client_stats.timings --[[@as Timings]]
+      timings:add("schedule delay", uv.hrtime() - queued_ns)
+      callback()
+    end)
+  end
 
-      if doom.screen.visible then
-        doom:send_frame_request()
-        doom:schedule_check()
-      end
+  local function refresh_pending_frame()
+    local frame = pending_frame
+    local frame_count = #frame.cells
+    local bits = frame.enabled_dui_bits
+    local start_ns = uv.hrtime()
+    frame.cell_gfx:refresh(
+      -- Usually just the one frame; don't copy it.
+      frame_count == 1 and frame.cells[1] or table.concat(frame.cells),
+      frame.menu,
+      frame.intermission,
+      frame.finale_text_len,
+      bit.band(bits, 1) ~= 0,
+      bit.band(bits, 2) ~= 0,
+      bit.band(bits, 4) ~= 0,
+      bit.band(bits, 8) ~= 0,
+      bit.band(bits, 16) ~= 0
+    )
+    add_refresh_time("cell refresh", start_ns)
+
+    frame.scheduled = false
+    frame.cell_gfx = nil
+    frame.menu = nil
+    frame.intermission = nil
+    for i = frame_count, 1, -1 do
+      frame.cells[i] = nil
+    end
+    doom.client_stats.frames = doom.client_stats.frames + frame_count
+    doom:on_frame_presented(frame_count)
+  end
+
+  --- @param cells string
+  local function handle_frame(cells)
+    local enabled_dui_bits = read_u8()
+
+    local cell_gfx = doom.screen:cell_gfx()
+    if not cell_gfx then
+      doom:on_frame_presented()
+      return
+    end
+
+    -- If Nvim is busy, draw any frames that arrived in the meantime all in one
+    -- go, rather than one stale frame after another. Cell frames only draw
+    -- what changed since the last, so their cells are still needed, but only
+    -- the newest overlays are.
+    local frame = pending_frame
+    if not frame.scheduled then
+      frame.scheduled = true
+      frame.cell_gfx = cell_gfx
+      schedule_refresh(refresh_pending_frame)
+    end
+
+    frame.cells[#frame.cells + 1] = cells
+    frame.menu = menu
+    frame.intermission = intermission
+    frame.finale_text_len = finale_text_len
+    frame.enabled_dui_bits = enabled_dui_bits
+  end
+
+  --- @param data string
+  --- @param region boolean? Whether it's from AMSG_FRAME_SIXEL_REGION.
+  local function handle_sixel_frame(data, region)
+    local sixel_gfx = doom.screen:sixel_gfx()
+    if sixel_gfx then
+      schedule_refresh(function()
+        local start_ns = uv.hrtime()
+        sixel_gfx:refresh(data, region)
+        add_refresh_time("sixel refresh", start_ns)
+        doom.client_stats.frames = doom.client_stats.frames + 1
+        doom:on_frame_presented()
+      end)
+    else
+      doom:on_frame_presented()
+    end
+  end
+
+  --- @type table<integer, fun(): boolean?>
+  local msg_handlers = {
+    -- AMSG_FRAME_CELLS
+    [16] = function()
+      handle_frame(read_bytes(read_u32()))
     end,
 
     -- AMSG_PLAYER_STATUS
@@ -691,13 +1359,23 @@ local function recv_msg_loop(doom, buf)
       }
     end,
 
-    -- AMSG_FRAME_MENU
-    [8] = function()
+    -- AMSG_MENU_ITEMS
+    [22] = function()
       local type = read_u8()
       local lumps = {}
       for i = 1, read_u16() do
         lumps[i] = read_string()
       end
+      menu_items[type] = lumps
+    end,
+
+    -- AMSG_MENU
+    [8] = function()
+      local type = read_u8()
+      if type == 0xff then -- MENU_CLOSED
+        menu = nil
+        return
+      end
       local selected_i = read_u8() + 1 -- Adjust to 1-indexed.
 
       local vars
@@ -730,19 +1408,20 @@ local function recv_msg_loop(doom, buf)
         } --[[@as SoundMenuVars]]
       end
 
-      local cell_gfx = doom.screen:cell_gfx()
-      if cell_gfx then
-        menu = {
-          type = type,
-          lumps = lumps,
-          selected_i = selected_i,
-          vars = vars,
-        }
-      end
+      menu = {
+        type = type,
+        lumps = menu_items[type] or {},
+        selected_i = selected_i,
+        vars = vars,
+      }
     end,
 
-    -- AMSG_FRAME_INTERMISSION
+    -- AMSG_INTERMISSION
     [9] = function()
+      if read_u8() == 0 then
+        intermission = nil
+        return
+      end
       local state = read_i8()
 
       local kills = -1
@@ -758,42 +1437,138 @@ local function recv_msg_loop(doom, buf)
         par = read_i32()
       end
 
-      local cell_gfx = doom.screen:cell_gfx()
-      if cell_gfx then
-        intermission = {
-          state = state,
-          kills = kills >= 0 and kills or nil,
-          items = items >= 0 and items or nil,
-          secret = secret >= 0 and secret or nil,
-          time = time >= 0 and time or nil,
-          par = par >= 0 and par or nil,
-        }
-      end
+      intermission = {
+        state = state,
+        kills = kills >= 0 and kills or nil,
+        items = items >= 0 and items or nil,
+        secret = secret >= 0 and secret or nil,
+        time = time >= 0 and time or nil,
+        par = par >= 0 and par or nil,
+      }
     end,
 
-    -- AMSG_FRAME_FINALE
+    -- AMSG_FINALE
     [11] = function()
-      local text_len = read_u16()
+      finale_text_len = read_u16()
+    end,
 
-      local cell_gfx = doom.screen:cell_gfx()
-      if cell_gfx then
-        finale_text_len = text_len
+    -- AMSG_LEVEL_TIMES
+    [20] = function()
+      local map = read_string()
+      --- @return string
+      local function read_times()
+        local count = read_u32()
+        local p50_us = read_u32()
+        local p95_us = read_u32()
+        local p99_us = read_u32()
+        local max_us = read_u32()
+        return ("%d, p50 %.1fms, p95 %.1fms, p99 %.1fms, max %.1fms"):format(
+          count,
+          p50_us / 1000,
+          p95_us / 1000,
+          p99_us / 1000,
+          max_us / 1000
+        )
       end
+      local frames = read_times()
+      local tics = read_times()
+
+      doom.console:plugin_print(
+        ("Level times for %s: frames %s; tics %s\n"):format(map, frames, tics)
+      )
     end,
 
     -- AMSG_FRAME_SHM_READY
     [3] = function()
+      local slot = read_u8()
+      local x = read_u16()
+      local y = read_u16()
+      local width = read_u16()
+      local height = read_u16()
+
       local kitty_gfx = doom.screen:kitty_gfx()
       if kitty_gfx then
-        vim.schedule(function()
-          kitty_gfx:refresh()
+        schedule_refresh(function()
+          local start_ns = uv.hrtime()
+          kitty_gfx:refresh(slot, x, y, width, height)
+          add_refresh_time("kitty refresh", start_ns)
+          doom.client_stats.frames = doom.client_stats.frames + 1
+          doom:on_frame_presented()
         end)
+      else
+        doom:on_frame_presented()
+      end
+    end,
+
+    -- AMSG_FRAME_ZLIB
+    [18] = function()
+      local x = read_u16()
+      local y = read_u16()
+      local width = read_u16()
+      local height = read_u16()
+      local zlib_data = read_bytes(read_u32())
+      read_u8() -- enabled_dui_bits; detached UI is off for kitty.
+
+      local kitty_gfx = doom.screen:kitty_gfx()
+      if kitty_gfx and kitty_gfx.direct then
+        schedule_refresh(function()
+          local start_ns = uv.hrtime()
+          kitty_gfx:refresh(nil, x, y, width, height, zlib_data)
+          add_refresh_time("kitty refresh", start_ns)
+          doom.client_stats.frames = doom.client_stats.frames + 1
+          doom:on_frame_presented()
+        end)
+      else
+        doom:on_frame_presented()
       end
+    end,
 
-      if doom.screen.visible then
-        doom:send_frame_request()
-        doom:schedule_check()
+    -- AMSG_FRAME_SIXEL
+    [23] = function()
+      local data = read_bytes(read_u32())
+      read_u8() -- enabled_dui_bits; detached UI is off for sixel.
+      if cache_frame_slot then
+        cached_frames[cache_frame_slot] = data
+        cache_frame_slot = nil
       end
+      handle_sixel_frame(data)
+    end,
+
+    -- AMSG_FRAME_SIXEL_REGION
+    [28] = function()
+      local data = read_bytes(read_u32())
+      read_u8() -- enabled_dui_bits; detached UI is off for sixel.
+      handle_sixel_frame(data, true)
+    end,
+
+    -- AMSG_CACHE_FRAME
+    [26] = function()
+      cache_frame_slot = read_u8()
+    end,
+
+    -- AMSG_USE_FRAME
+    [27] = function()
+      local slot = read_u8()
+      read_u8() -- enabled_dui_bits; detached UI is off for sixel.
+      handle_sixel_frame(assert(cached_frames[slot], "frame not cached"))
+    end,
+
+    -- AMSG_FRAME_SIZE
+    [19] = function()
+      local width = read_u16()
+      local height = read_u16()
+      doom.console:plugin_print(
+        ("AMSG_FRAME_SIZE: width=%d height=%d\n"):format(width, height),
+        "Debug"
+      )
+
+      -- Scheduled, so frames of the old size still queued are refreshed first.
+      vim.schedule(function()
+        local kitty_gfx = doom.screen:kitty_gfx()
+        if kitty_gfx then
+          kitty_gfx:set_frame_size(width, height)
+        end
+      end)
     end,
 
     -- AMSG_SET_TITLE
@@ -808,6 +1583,137 @@ local function recv_msg_loop(doom, buf)
       end)
     end,
 
+    -- AMSG_STATS
+    [17] = function()
+      local interval_ms = read_u32()
+      local tics = read_u16()
+      local frames = read_u16()
+      local render_us = read_u32()
+      local convert_us = read_u32()
+      local send_us = read_u32()
+      local bytes_sent = read_u32()
+      local max_queued_bytes = read_u32()
+      local max_visplanes = read_u16()
+      local max_drawsegs = read_u16()
+      local max_vissprites = read_u16()
+      local max_openings = read_u32()
+      local zone_purges = read_u32()
+      local zone_kib = read_u32()
+      local zone_static_kib = read_u32()
+      local zone_static_blocks = read_u32()
+      local zone_level_kib = read_u32()
+      local zone_level_blocks = read_u32()
+      local zone_cache_kib = read_u32()
+      local zone_cache_blocks = read_u32()
+      local zone_largest_free_kib = read_u32()
+      local zone_mallocs = read_u32()
+      local zone_rover_steps = read_u32()
+      local parked_monsters = read_u32()
+      local deferred_looks = read_u32()
+      local peak_rss_kib = read_u32()
+      local simd_features = read_u32()
+      local work_counts = {} --- @type integer[]
+      for i = 1, read_u8() do
+        work_counts[i] = read_u32()
+      end
+
+      local client_stats = doom.client_stats
+      local timings = client_stats.timings
+      doom.client_stats = new_client_stats(timings ~= nil)
+      local log_path = doom.play_opts.client_timing_log
+      if timings and log_path then
+        local ok, err = timings:log(log_path, interval_ms)
+        if not ok then
+          doom.console:plugin_print(
+            ("Failed to log client timings; no longer logging: %s\n"):format(
+              err
+            ),
+            "Warn"
+          )
+          doom.play_opts.client_timing_log = nil
+        end
+      end
+      if not doom.show_stats then
+        return
+      end
+
+      local secs = math.max(interval_ms, 1) / 1000
+      --- @param total_us number
+      --- @param count integer
+      local function per_frame_ms(total_us, count)
+        return total_us / math.max(count, 1) / 1000
+      end
+      local work = {} --- @type string[]
+      for i, count in ipairs(work_counts) do
+        work[i] = ("%.1f %s"):format(
+          count / math.max(frames, 1),
+          work_count_names[i] or ("work count %d"):format(i)
+        )
+      end
+      doom.console:plugin_print(
+        (
+          "Stats: %.1f tics/s, %.1f frames/s (%.1f presented/s), %.1f KiB/s "
+          .. "sent (max %.1f KiB queued); per frame: render %.2fms, convert "
+          .. "%.2fms, send %.2fms; per presented frame: recv %.2fms, refresh "
+          .. "%.2fms (terminal write %.2fms); most used by a frame: %d "
+          .. "visplanes, %d drawsegs, %d vissprites, %d openings; zone "
+          .. "%d KiB (static %d KiB in %d blocks, level %d KiB in %d, "
+          .. "cache %d KiB in %d; largest free %d KiB), %.1f purges/s, "
+          .. "%.1f blocks walked per allocation; %d far monsters asleep, "
+          .. "%.1f looks put off/s; peak RSS %.1f MiB; SIMD: %s%s\n"
+        ):format(
+          tics / secs,
+          frames / secs,
+          client_stats.frames / secs,
+          bytes_sent / 1024 / secs,
+          max_queued_bytes / 1024,
+          per_frame_ms(render_us, frames),
+          per_frame_ms(convert_us, frames),
+          per_frame_ms(send_us, frames),
+          per_frame_ms(client_stats.recv_ns / 1000, client_stats.frames),
+          per_frame_ms(client_stats.refresh_ns / 1000, client_stats.frames),
+          per_frame_ms(client_stats.chan_send_ns / 1000, client_stats.frames),
+          max_visplanes,
+          max_drawsegs,
+          max_vissprites,
+          max_openings,
+          zone_kib,
+          zone_static_kib,
+          zone_static_blocks,
+          zone_level_kib,
+          zone_level_blocks,
+          zone_cache_kib,
+          zone_cache_blocks,
+          zone_largest_free_kib,
+          zone_purges / secs,
+          zone_rover_steps / math.max(zone_mallocs, 1),
+          parked_monsters,
+          deferred_looks / secs,
+          peak_rss_kib / 1024,
+          simd_feature_names(simd_features),
+          #work > 0 and ("; work per frame: " .. table.concat(work, ", "))
+            or ""
+        ),
+        "Debug"
+      )
+      if timings then
+        doom.console:plugin_print(
+          ("Client timings (%s):\n%s\n"):format(
+            timing.lua_version(),
+            timings:summary()
+          ),
+          "Debug"
+        )
+      end
+    end,
+
+    -- AMSG_SOUND
+    [21] = function()
+      local rate = read_u32()
+      local frame_count = read_u16()
+      doom:play_sound(rate, read_bytes(frame_count * 4))
+    end,
+
     -- AMSG_QUIT
     [2] = function()
       doom.console:plugin_print "DOOM process disconnected; quitting\n"
@@ -816,13 +1722,48 @@ local function recv_msg_loop(doom, buf)
     end,
   }
 
+  -- What handlers are called in PlayOpts.client_timing's histograms.
+  local msg_names = {
+    [1] = "AMSG_SET_TITLE",
+    [2] = "AMSG_QUIT",
+    [3] = "AMSG_FRAME_SHM_READY",
+    [4] = "AMSG_GAME_MESSAGE",
+    [5] = "AMSG_PLAYER_STATUS",
+    [6] = "AMSG_MENU_MESSAGE",
+    [7] = "AMSG_AUTOMAP_TITLE",
+    [8] = "AMSG_MENU",
+    [9] = "AMSG_INTERMISSION",
+    [10] = "AMSG_FINALE_TEXT",
+    [11] = "AMSG_FINALE",
+    [16] = "AMSG_FRAME_CELLS",
+    [17] = "AMSG_STATS",
+    [18] = "AMSG_FRAME_ZLIB",
+    [19] = "AMSG_FRAME_SIZE",
+    [20] = "AMSG_LEVEL_TIMES",
+    [21] = "AMSG_SOUND",
+    [22] = "AMSG_MENU_ITEMS",
+    [23] = "AMSG_FRAME_SIXEL",
+    [26] = "AMSG_CACHE_FRAME",
+    [27] = "AMSG_USE_FRAME",
+    [28] = "AMSG_FRAME_SIXEL_REGION",
+  }
+
   while true do
     local msg_type = read_u8()
     local handler = msg_handlers[msg_type]
     if handler then
+      local start_ns = timed and uv.hrtime()
+      waited_ns = 0
       if handler() then
         return -- Handlers can return truthy to quit the loop.
       end
+      if start_ns then
+        local timings = doom.client_stats.timings --[[@as Timings]]
+        timings:add(
+          msg_names[msg_type] or ("message %d"):format(msg_type),
+          uv.hrtime() - start_ns - waited_ns
+        )
+      end
     else
       doom.console:plugin_print(
         ("Received unknown message type: %d; quitting\n"):format(msg_type),
@@ -835,10 +1776,15 @@ local function recv_msg_loop(doom, buf)
 end
 
 --- @param doom Doom
---- @param sock_path string
-local function init_connection(doom, sock_path)
-  doom.sock = assert(uv.new_pipe())
+--- @param sock_path string Or "tcp:HOST:PORT", for a DOOM started elsewhere
+--- with "-listen tcp:[HOST]:PORT".
+--- @param await_listening boolean? Whether to wait for the process we started
+--- to listen for the connection.
+local function init_connection(doom, sock_path, await_listening)
+  local tcp_host, tcp_port = sock_path:match "^tcp:%[?(.-)%]?:(%d+)$"
+  doom.sock = assert(tcp_host and uv.new_tcp() or uv.new_pipe())
   local tries_left = 20
+  local tcp_attempted = false
   local schedule_connect -- Late assignment so connect_cb can call it.
 
   --- @param conn_err nil|string
@@ -866,6 +1812,10 @@ local function init_connection(doom, sock_path)
     end
 
     doom.console:plugin_print "Connected to the DOOM process\n"
+    if tcp_host then
+      -- Don't hold back key presses to batch them up.
+      doom.sock:nodelay(true)
+    end
     local recv_buf = strbuf.new(256)
     local recv_co = coroutine.create(recv_msg_loop)
     -- Pass the initial arguments.
@@ -885,8 +1835,12 @@ local function init_connection(doom, sock_path)
         return -- No error, but reached EOF.
       end
 
+      local start_ns = uv.hrtime()
       recv_buf:put(data)
       assert(coroutine.resume(recv_co))
+      doom.client_stats.recv_ns = doom.client_stats.recv_ns
+        + uv.hrtime()
+        - start_ns
     end)))
   end
 
@@ -895,8 +1849,31 @@ local function init_connection(doom, sock_path)
     -- Forward the libuv errors from trying to schedule the operations so that
     -- they count as a failed connection attempt.
     local _, err = doom.check_timer:start(ms, 0, function()
-      local _, err =
-        doom.sock:connect(sock_path, doom:close_on_err_wrap(connect_cb))
+      doom.on_listening = nil
+      local _, err
+      if tcp_host then
+        -- A TCP handle can't connect again after failing, so use a new one.
+        if tcp_attempted then
+          doom.sock:close()
+          doom.sock = assert(uv.new_tcp())
+        end
+        tcp_attempted = true
+        -- Resolving blocks, but only briefly, and only once per attempt.
+        local addrs, gai_err =
+          uv.getaddrinfo(tcp_host, tcp_port, { socktype = "stream" })
+        if not addrs or #addrs == 0 then
+          err = gai_err or "no addresses found"
+        else
+          _, err = doom.sock:connect(
+            addrs[1].addr,
+            tonumber(tcp_port),
+            doom:close_on_err_wrap(connect_cb)
+          )
+        end
+      else
+        _, err =
+          doom.sock:connect(sock_path, doom:close_on_err_wrap(connect_cb))
+      end
       if err then
         connect_cb(err) -- Forward the error.
       end
@@ -907,24 +1884,145 @@ local function init_connection(doom, sock_path)
     end
   end
 
-  schedule_connect(500)
+  if await_listening and not doom.listening then
+    -- Connect the moment DOOM says it's listening, or after a while in case
+    -- we somehow missed that.
+    doom.on_listening = function()
+      schedule_connect(0)
+    end
+    schedule_connect(5000)
+  else
+    schedule_connect(0)
+  end
 end
 
 --- @param console Console
---- @param exe_path string
 --- @param opts PlayOpts
---- @return Doom?
-function Doom.run(console, exe_path, opts)
-  local doom = setmetatable({
+--- @param sock_path string
+--- @return Doom
+--- @nodiscard
+local function new_doom(console, opts, sock_path)
+  return setmetatable({
     console = console,
     play_opts = opts,
+    sock_path = sock_path,
     check_timer = assert(uv.new_timer()),
     send_buf = strbuf.new(256),
     mouse_button_mask = 0,
+    mouse_motion_x = 0,
+    mouse_motion_y = 0,
+    frames_outstanding = 0,
+    engine_caps = 0,
+    sound_cmd = find_sound_cmd(console, opts.sound),
+    client_stats = new_client_stats(
+      opts.client_timing or opts.client_timing_log ~= nil
+    ),
     game_msg = "",
     menu_msg = "",
     automap_title = "",
   }, { __index = Doom })
+end
+
+--- @return string
+--- @nodiscard
+local function new_sock_path()
+  return fs.joinpath(
+    fn.stdpath "run",
+    ("actually-doom.%d.%d"):format(uv.os_getpid(), uv.hrtime())
+  )
+end
+
+--- DOOM process started by start_standby, if any.
+--- @type Doom?
+local standby_doom
+
+--- Stands in for the console of a standby DOOM until it's played, keeping what
+--- was printed to it.
+--- @return Console
+--- @nodiscard
+local function new_standby_console()
+  return {
+    printed = {},
+    print = function(self, text, console_hl)
+      self.printed[#self.printed + 1] = { text, console_hl }
+    end,
+    plugin_print = require("actually-doom.ui").Console.plugin_print,
+    close = function() end,
+  } --[[@as Console]]
+end
+
+--- Start a DOOM process that loads, then waits to be played by the next
+--- [`Doom.run`](lua://Doom.run) with the same options, so it starts instantly.
+--- Only the executable already built is used; nothing is rebuilt for it.
+--- @param opts PlayOpts
+local function start_standby(opts)
+  local exe_path = require("actually-doom.build").exe_install_path
+  local exe_stat = uv.fs_stat(exe_path)
+  if (standby_doom and not standby_doom.closed) or not exe_stat then
+    return
+  end
+
+  local sock_path = new_sock_path()
+  local doom = new_doom(new_standby_console(), opts, sock_path)
+  doom.standby = true
+  doom.exe_stat = exe_stat
+  if not pcall(init_process, doom, exe_path, sock_path, true) then
+    doom:close()
+    return
+  end
+  standby_doom = doom
+end
+
+--- Take over the standby DOOM process, if it was started with these options
+--- from the same executable.
+--- @param console Console
+--- @param exe_path string
+--- @param opts PlayOpts
+--- @return Doom?
+--- @nodiscard
+local function take_standby(console, exe_path, opts)
+  local doom = standby_doom
+  standby_doom = nil
+  if not doom or doom.closed then
+    return nil
+  end
+
+  local exe_stat = uv.fs_stat(exe_path)
+  if
+    not vim.deep_equal(doom.play_opts, opts)
+    or not exe_stat
+    or exe_stat.ino ~= doom.exe_stat.ino
+    or exe_stat.mtime.sec ~= doom.exe_stat.mtime.sec
+    or exe_stat.mtime.nsec ~= doom.exe_stat.mtime.nsec
+  then
+    doom:close()
+    return nil
+  end
+
+  for _, printed in ipairs(doom.console.printed) do
+    console:print(printed[1], printed[2])
+  end
+  doom.console = console
+  doom.standby = nil
+  return doom
+end
+
+--- @param console Console
+--- @param exe_path string
+--- @param opts PlayOpts
+--- @return Doom?
+function Doom.run(console, exe_path, opts)
+  local standby = take_standby(console, exe_path, opts)
+  if standby then
+    standby:close_on_err(function()
+      console:set_doom(standby)
+      init_connection(standby, standby.sock_path, true)
+    end)
+    return standby
+  end
+
+  local sock_path = new_sock_path()
+  local doom = new_doom(console, opts, sock_path)
 
   -- Less verbose Doom.close_on_err and doesn't include a stack trace.
   local function close_on_err_quieter(...)
@@ -937,26 +2035,116 @@ function Doom.run(console, exe_path, opts)
     return rv
   end
 
-  local sock_path = fs.joinpath(
-    fn.stdpath "run",
-    ("actually-doom.%d.%d"):format(uv.os_getpid(), uv.hrtime())
-  )
   close_on_err_quieter(init_process, doom, exe_path, sock_path)
 
   doom:close_on_err(function()
     doom.console:set_doom(doom)
-    init_connection(doom, sock_path)
+    init_connection(doom, sock_path, true)
   end)
 
   return doom
 end
 
+--- Watch the game of a DOOM process started with allow_viewers, without
+--- controlling it. Frames are shown as that process's player chose to have
+--- them sent.
+--- @param console Console
+--- @param sock_path string
+--- @param opts PlayOpts
+--- @return Doom
+function Doom.spectate(console, sock_path, opts)
+  local doom = new_doom(console, opts, sock_path)
+  doom:close_on_err(function()
+    doom.console:set_doom(doom)
+    init_connection(doom, sock_path)
+  end)
+  return doom
+end
+
+--- @param rate integer
+function Doom:start_sound_process(rate)
+  if self.closed or not self.sound_cmd or rate ~= self.sound_rate then
+    return
+  end
+
+  local rate_str = tostring(rate)
+  local cmd = vim.tbl_map(function(arg)
+    return (arg:gsub("{rate}", rate_str))
+  end, self.sound_cmd)
+
+  local process
+  local ok, rv = pcall(vim.system, cmd, {
+    stdin = true,
+    stdout = false,
+    stderr = function(_, data)
+      if data then
+        self.console:print(data, "Warn")
+      end
+    end,
+  }, function(out)
+    -- Not if we killed it.
+    if self.sound_process == process then
+      self.sound_process = nil
+      self.sound_cmd = nil
+      self.console:plugin_print(
+        ("Sound player exited with code %d; playing without sound\n"):format(
+          out.code
+        ),
+        "Warn"
+      )
+    end
+  end)
+  if not ok then
+    self.sound_cmd = nil
+    self.console:plugin_print(
+      ("Failed to run sound player: %s; playing without sound\n"):format(rv),
+      "Warn"
+    )
+    return
+  end
+  process = rv
+  self.sound_process = rv
+end
+
+--- Plays AMSG_SOUND samples with the sound_cmd process, starting it afresh if
+--- the sample rate changed.
+--- @param rate integer
+--- @param samples string
+function Doom:play_sound(rate, samples)
+  if not self.sound_cmd or self.closed then
+    return
+  end
+
+  if rate ~= self.sound_rate then
+    self.sound_rate = rate
+    if self.sound_process then
+      self.sound_process:kill "sigterm"
+      self.sound_process = nil
+    end
+    -- vim.system can't be called from fast events; samples are dropped until
+    -- the player has started.
+    vim.schedule(function()
+      self:start_sound_process(rate)
+    end)
+    return
+  end
+
+  if self.sound_process then
+    self.sound_process:write(samples)
+  end
+end
+
 function Doom:close()
   if self.closed then
     return
   end
   self.closed = true
 
+  -- Have another ready for the next game once this one's done.
+  if self.play_opts.standby and not self.standby and self.process then
+    vim.schedule(M.start_standby)
+  end
+
   -- Non-nil fields may be nil if we're called during initialization.
   if self.check_timer then
     self.check_timer:stop()
@@ -968,6 +2156,10 @@ function Doom:close()
   if self.process then
     self.process:kill "sigterm" -- Try a clean shutdown.
   end
+  if self.sound_process then
+    self.sound_process:kill "sigterm"
+    self.sound_process = nil
+  end
   -- Close console before the screen so it doesn't print the "buffer was
   -- unloaded" message from us closing the screen.
   if self.console then
@@ -1034,9 +2226,60 @@ end
 --- @class (exact) PlayOpts
 --- @field iwad_path string?
 --- @field kitty_graphics boolean?
+--- @field kitty_direct boolean?
+--- @field kitty_scale integer?
+--- @field sixel boolean?
+--- @field sixel_scale integer?
+--- @field sixel_regions boolean?
+--- @field render_scale integer?
 --- @field tmux_passthrough boolean?
+--- @field half_blocks boolean?
+--- @field cell_dither boolean?
+--- @field cell_direct boolean?
+--- @field allow_viewers boolean?
+--- @field sound boolean|string[]|nil
+--- @field cpus string?
+--- @field workers integer?
+--- @field nice integer?
+--- @field huge_pages boolean?
+--- @field far_look_dist integer?
+--- @field target_fps integer?
+--- @field view_thread boolean?
+--- @field capture_path string?
+--- @field low_mem_mb integer?
+--- @field share_textures boolean?
+--- @field slow_frame_ms integer?
+--- @field client_timing boolean?
+--- @field client_timing_log string?
 --- @field extra_args string[]?
 --- @field key_hold_ms integer?
+--- @field mouse_aim boolean?
+--- @field config_vars table<string, string|number>?
+--- @field standby boolean?
+
+--- If the configured game options have standby set, start a DOOM process with
+--- them in the background once Nvim is idle, for the next `:Doom` to play.
+function M.start_standby()
+  local opts = require("actually-doom.config").config.game --[[@as PlayOpts]]
+  if not opts.standby or not opts.iwad_path then
+    return
+  end
+
+  api.nvim_create_autocmd("SafeState", {
+    once = true,
+    callback = function()
+      start_standby(opts)
+    end,
+  })
+  api.nvim_create_autocmd("VimLeavePre", {
+    group = api.nvim_create_augroup("actually-doom.standby", {}),
+    callback = function()
+      if standby_doom then
+        standby_doom:close()
+      end
+    end,
+  })
+end
 
 --- @param opts PlayOpts?
 function M.play(opts)
@@ -1119,10 +2362,168 @@ function M.play(opts)
   end)
 end
 
+--- @class (exact) SpectateOpts: PlayOpts
+--- @field sock_path string? Socket of the DOOM process to watch. Defaults to
+---                          that of the newest one in this Nvim allowing it.
+
+--- Watch a game being played in another screen, or by another Nvim, as a
+--- read-only viewer; see allow_viewers.
+--- @param opts SpectateOpts?
+function M.spectate(opts)
+  opts = opts or {}
+  local sock_path = opts.sock_path
+  local play_opts = nil --- @type PlayOpts?
+  if not sock_path then
+    local screen_buf = vim
+      .iter(pairs(require("actually-doom.ui").screen_buf_to_doom))
+      :fold(0, function(acc, buf, doom)
+        return not doom.closed
+            and doom.process
+            and doom.play_opts.allow_viewers
+            and math.max(acc, buf)
+          or acc
+      end)
+    if screen_buf == 0 then
+      error("No DOOM is running with allow_viewers set", 0)
+    end
+
+    -- Show frames the same way as the player's screen does.
+    local doom = require("actually-doom.ui").screen_buf_to_doom[screen_buf]
+    sock_path = doom.sock_path
+    play_opts = doom.play_opts
+  end
+
+  opts = vim.tbl_extend(
+    "force",
+    play_opts or require("actually-doom.config").config.game,
+    opts
+  ) --[[@as SpectateOpts]]
+  opts.sock_path = nil
+  Doom.spectate(require("actually-doom.ui").Console.new(), sock_path, opts)
+end
+
+--- @class (exact) ConnectOpts: PlayOpts
+--- @field address string "tcp:HOST:PORT" of a DOOM started elsewhere with
+---                       "-listen tcp:[HOST]:PORT", or its socket path.
+
+--- Play a DOOM process started elsewhere, like on another host, by connecting
+--- to it; whoever connects first plays, and any after watch as viewers.
+--- @param opts ConnectOpts
+function M.connect(opts)
+  if type(opts) ~= "table" or type(opts.address) ~= "string" then
+    error("An address to connect to is required", 0)
+  end
+  local address = opts.address
+  opts = vim.tbl_extend(
+    "force",
+    require("actually-doom.config").config.game,
+    opts
+  ) --[[@as ConnectOpts]]
+  opts.address = nil
+  Doom.spectate(require("actually-doom.ui").Console.new(), address, opts)
+end
+
+--- @class (exact) BenchOpts
+--- @field iwad_path string? Defaults to the bundled IWAD.
+--- @field runs integer? Times to play the demos over; defaults to 5.
+--- @field out_path string? Where the results are written as JSON.
+
+--- Builds DOOM if needed, then times the IWAD's demos with "-bench" in the
+--- console, writing the medians and variances to a JSON file.
+--- @param opts BenchOpts?
+function M.bench(opts)
+  opts = opts or {}
+  local iwad_path = opts.iwad_path
+    or api.nvim_get_runtime_file("iwad/DOOM1.WAD", false)[1]
+  if not iwad_path then
+    error("No IWAD to benchmark with", 0)
+  end
+
+  local build = require "actually-doom.build"
+  local out_path = opts.out_path
+    or fs.joinpath(fs.dirname(build.exe_install_path), "bench.json")
+  local console = require("actually-doom.ui").Console.new()
+
+  build.rebuild {
+    console = console,
+    result_cb = function(ok, _)
+      if not ok then
+        vim.notify("[actually-doom.nvim] DOOM build failed!", log.levels.ERROR)
+        return
+      end
+
+      --- @param console_hl string?
+      --- @return fun(err: nil|string, data: string|nil)
+      --- @nodiscard
+      local function new_out_cb(console_hl)
+        return function(err, data)
+          if err then
+            console:plugin_print(("Stream error: %s\n"):format(err), "Error")
+          elseif data then
+            console:print(data, console_hl)
+          end
+        end
+      end
+
+      local cmd = {
+        build.exe_install_path,
+        "-iwad",
+        iwad_path,
+        "-bench",
+        "-benchruns",
+        tostring(opts.runs or 5),
+        "-benchout",
+        out_path,
+      }
+
+      console:plugin_print "Benchmarking; this takes a while...\n"
+      local sys_ok, sys_rv = pcall(vim.system, cmd, {
+        cwd = fs.dirname(build.exe_install_path),
+        stdout = new_out_cb(),
+        stderr = new_out_cb "Warn",
+      }, function(out)
+        if out.code ~= 0 then
+          console:plugin_print(
+            ("Benchmark failed with exit code %d\n"):format(out.code),
+            "Error"
+          )
+          return
+        end
+        console:plugin_print(("Results written to %s\n"):format(out_path))
+      end)
+
+      if not sys_ok then
+        vim.notify(
+          ("[actually-doom.nvim] Failed to run DOOM: %s"):format(sys_rv),
+          log.levels.ERROR
+        )
+      end
+    end,
+  }
+end
+
 --- @param args vim.api.keyset.create_user_command.command_args
 function M.play_cmd(args)
   local iwad_path = args.fargs[1]
 
+  if iwad_path == "spectate" then
+    local ok, rv = pcall(M.spectate)
+    if not ok then
+      vim.notify(("[actually-doom.nvim] %s"):format(rv), log.levels.ERROR)
+    end
+    return
+  end
+
+  if iwad_path == "bench" then
+    local ok, rv = pcall(M.bench, {
+      runs = args.count > 0 and args.count or nil,
+    })
+    if not ok then
+      vim.notify(("[actually-doom.nvim] %s"):format(rv), log.levels.ERROR)
+    end
+    return
+  end
+
   if not args.bang then
     local doom_ui = require "actually-doom.ui"
     local screen_buf = args.count
@@ -8,6 +8,14 @@ function M.play(...)
   return require("actually-doom.game").play(...)
 end
 
+function M.spectate(...)
+  return require("actually-doom.game").spectate(...)
+end
+
+function M.connect(...)
+  return require("actually-doom.game").connect(...)
+end
+
 function M.rebuild(...)
   return require("actually-doom.build").rebuild(...)
 end
@@ -63,6 +63,29 @@ do
       return self.inner:get(...)
     end
 
+    --- Like get(n):byte(1, n), but reads the bytes in place rather than
+    --- creating a string. n must be at most len().
+    --- @param n integer
+    --- @return integer ...
+    --- @nodiscard
+    function M:get_bytes(n)
+      local p = self.inner:ref()
+      if n == 1 then
+        local a = p[0]
+        self.inner:skip(1)
+        return a
+      elseif n == 2 then
+        local a, b = p[0], p[1]
+        self.inner:skip(2)
+        return a, b
+      elseif n == 4 then
+        local a, b, c, d = p[0], p[1], p[2], p[3]
+        self.inner:skip(4)
+        return a, b, c, d
+      end
+      return self.inner:get(n):byte(1, n)
+    end
+
     return M
   end
 end
@@ -70,6 +93,7 @@ end
 --- @class (exact) StrBufPuc
 --- @field chunks string[]
 --- @field slen integer
+--- @field head integer Bytes of chunks[1] already consumed by get_bytes.
 ---
 --- @field new function
 local M = {}
@@ -80,10 +104,20 @@ function M.new(_)
   return setmetatable({}, { __index = M }):reset()
 end
 
+--- Keeps the chunks table, so a buffer reset every frame doesn't make a new
+--- one each time.
 --- @return StrBufPuc
 function M:reset()
-  self.chunks = {}
+  local chunks = self.chunks
+  if chunks then
+    for i = #chunks, 1, -1 do
+      chunks[i] = nil
+    end
+  else
+    self.chunks = {}
+  end
   self.slen = 0
+  self.head = 0
   return self
 end
 
@@ -120,6 +154,10 @@ function M:get(...)
 
   -- Cba to implement a ring buffer (dunno how efficient it'd be from PUC
   -- anyway); easier to merge the chunks and slice it into the return values.
+  if self.head > 0 then
+    self.chunks[1] = self.chunks[1]:sub(self.head + 1)
+    self.head = 0
+  end
   local merged = table.concat(self.chunks)
   local start_i = 1
   local rvs = {}
@@ -128,9 +166,36 @@ function M:get(...)
     start_i = start_i + len
   end
 
-  self.chunks = { merged:sub(start_i) }
-  self.slen = #self.chunks[1]
+  local chunks = self.chunks
+  for i = #chunks, 2, -1 do
+    chunks[i] = nil
+  end
+  chunks[1] = merged:sub(start_i)
+  self.slen = #chunks[1]
   return unpack(rvs)
 end
 
+--- @param n integer
+--- @return integer ...
+--- @nodiscard
+function M:get_bytes(n)
+  if self.chunks[1] == "" then
+    table.remove(self.chunks, 1) -- Left behind by get.
+  end
+  local chunk = self.chunks[1]
+  if self.head + n > #chunk then
+    -- Spans chunks; rarely worth avoiding the merge for.
+    return self:get(n):byte(1, n)
+  end
+
+  local start_i = self.head + 1
+  self.head = self.head + n
+  self.slen = self.slen - n
+  if self.head == #chunk then
+    table.remove(self.chunks, 1)
+    self.head = 0
+  end
+  return chunk:byte(start_i, start_i + n - 1)
+end
+
 return M
@@ -0,0 +1,140 @@
+--- Histograms of how long the client spends on each part of playing, kept with
+--- PlayOpts.client_timing. Times are put in power of two buckets of
+--- microseconds, so recording one is cheap, and percentiles are only as exact
+--- as the bucket they land in.
+
+--- Bucket i holds times under 2^(i - 1) microseconds; the last holds the rest.
+local bucket_count = 24
+
+--- @class (exact) TimingHist
+--- @field count integer
+--- @field total_ns number
+--- @field max_ns number
+--- @field buckets integer[]
+
+--- @class (exact) Timings
+--- @field hists table<string, TimingHist>
+local M = {}
+
+--- @return Timings
+--- @nodiscard
+function M.new()
+  return setmetatable({ hists = {} }, { __index = M })
+end
+
+--- @param name string
+--- @param ns number
+function M:add(name, ns)
+  local hist = self.hists[name]
+  if not hist then
+    hist = { count = 0, total_ns = 0, max_ns = 0, buckets = {} }
+    for i = 1, bucket_count do
+      hist.buckets[i] = 0
+    end
+    self.hists[name] = hist
+  end
+
+  local i, bound = 1, 1000
+  while ns >= bound and i < bucket_count do
+    i, bound = i + 1, bound * 2
+  end
+  hist.buckets[i] = hist.buckets[i] + 1
+  hist.count = hist.count + 1
+  hist.total_ns = hist.total_ns + ns
+  hist.max_ns = math.max(hist.max_ns, ns)
+end
+
+--- Upper bound in milliseconds of the bucket holding the time below which
+--- fraction p of hist's times are.
+--- @param hist TimingHist
+--- @param p number
+--- @return number
+--- @nodiscard
+local function percentile_ms(hist, p)
+  local want = math.ceil(hist.count * p)
+  local seen = 0
+  for i, count in ipairs(hist.buckets) do
+    seen = seen + count
+    if seen >= want then
+      -- The last bucket has no bound; the max is as good as any.
+      return i < bucket_count and 2 ^ (i - 1) / 1000 or hist.max_ns / 1e6
+    end
+  end
+  return hist.max_ns / 1e6
+end
+
+--- Names of the histograms, those that took the most time in total first.
+--- @return string[]
+--- @nodiscard
+function M:names()
+  local names = vim.tbl_keys(self.hists) --- @type string[]
+  table.sort(names, function(a, b)
+    return self.hists[a].total_ns > self.hists[b].total_ns
+  end)
+  return names
+end
+
+--- @return string
+--- @nodiscard
+function M:summary()
+  local lines = {} --- @type string[]
+  for _, name in ipairs(self:names()) do
+    local hist = self.hists[name]
+    lines[#lines + 1] = (
+      "  %s: %d, mean %.3fms, p50 <%.3fms, p99 <%.3fms, max %.3fms"
+    ):format(
+      name,
+      hist.count,
+      hist.total_ns / hist.count / 1e6,
+      percentile_ms(hist, 0.5),
+      percentile_ms(hist, 0.99),
+      hist.max_ns / 1e6
+    )
+  end
+  return table.concat(lines, "\n")
+end
+
+--- The Lua running the client, as timings differ a lot between LuaJIT and PUC
+--- Lua.
+--- @return string
+--- @nodiscard
+function M.lua_version()
+  return jit and jit.version or _VERSION
+end
+
+--- Append the histograms to the file at path as a line of JSON, with the
+--- bucket counts as they are, for comparing runs later.
+--- @param path string
+--- @param interval_ms integer
+--- @return boolean ok
+--- @return string? err
+function M:log(path, interval_ms)
+  local hists = {} --- @type table<string, table>
+  for name, hist in pairs(self.hists) do
+    hists[name] = {
+      count = hist.count,
+      total_us = math.floor(hist.total_ns / 1000),
+      max_us = math.floor(hist.max_ns / 1000),
+      p50_ms = percentile_ms(hist, 0.5),
+      p99_ms = percentile_ms(hist, 0.99),
+      log2_us_buckets = hist.buckets,
+    }
+  end
+
+  local line = vim.json.encode {
+    time = os.time(),
+    lua = M.lua_version(),
+    interval_ms = interval_ms,
+    timings = hists,
+  }
+
+  local f, err = io.open(path, "a")
+  if not f then
+    return false, err
+  end
+  local ok, write_err = f:write(line, "\n")
+  f:close()
+  return ok ~= nil, write_err
+end
+
+return M
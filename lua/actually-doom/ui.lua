@@ -8,8 +8,9 @@ local M = {
   --- @type table<integer, Doom>
   screen_buf_to_doom = {},
   -- Scratch buffer for holding temporary data to be used for various purposes.
-  -- It lives at this scope so the allocated space can be re-used.
-  scratch_buf = strbuf.new(),
+  -- It lives at this scope so the allocated space can be re-used; sized for
+  -- the cell overlays, it grows once to fit kitty frames and stays that size.
+  scratch_buf = strbuf.new(4096),
 }
 
 local ns = api.nvim_create_namespace "actually-doom"
@@ -20,6 +21,7 @@ do
   local ctrl_k = vim.keycode "<C-K>"
   local ctrl_n = vim.keycode "<C-N>"
   local ctrl_o = vim.keycode "<C-O>"
+  local ctrl_s = vim.keycode "<C-S>"
   local ctrl_t = vim.keycode "<C-T>"
 
   vim.on_key(function(key)
@@ -43,6 +45,13 @@ do
     elseif key == ctrl_t then
       doom.screen:enable_tmux_passthrough(not doom.screen.tmux_passthrough)
       return "" -- *crunch*
+    elseif key == ctrl_s then
+      doom.show_stats = not doom.show_stats
+      doom.console:plugin_print(
+        ("Performance stats %s\n"):format(doom.show_stats and "ON" or "OFF"),
+        "Debug"
+      )
+      return "" -- *munch*
     end
 
     -- Bubbling up the error will cause on_key to unregister our callback, which
@@ -54,6 +63,12 @@ do
       doom,
       key
     )
+    -- Send input straight away, rather than waiting for the check scheduled
+    -- for the next event loop iteration; the engine wakes up as soon as it's
+    -- received, so this is the main source of latency left on our side.
+    if ok and rv == "" and not doom.closed then
+      pcall(doom.close_on_err, doom, doom.flush_send, doom)
+    end
     return ok and rv or nil
   end, ns)
 end
@@ -146,6 +161,33 @@ local function new_screen_win_config(width, height)
   }
 end
 
+-- Value of 'mousemoveevent' from before it was set for a screen.
+--- @type boolean?
+local old_mousemoveevent
+
+api.nvim_create_autocmd({ "TermEnter", "TermLeave" }, {
+  group = augroup,
+  callback = function(args)
+    local doom = M.screen_buf_to_doom[args.buf]
+    if not doom then
+      return
+    end
+    -- Motion is measured from where the mouse was when it's next moved.
+    doom.mouse_pos = nil
+
+    if args.event == "TermEnter" and doom.play_opts.mouse_aim ~= false then
+      if old_mousemoveevent == nil then
+        old_mousemoveevent = vim.o.mousemoveevent
+      end
+      vim.o.mousemoveevent = true
+    elseif args.event == "TermLeave" and old_mousemoveevent ~= nil then
+      vim.o.mousemoveevent = old_mousemoveevent
+      old_mousemoveevent = nil
+    end
+  end,
+  desc = "[actually-doom.nvim] Report mouse motion while playing",
+})
+
 -- As there's no way to get the correct &cmdheight of a non-current tabpage,
 -- run this on TabEnter too and only resize windows in the current tabpage.
 api.nvim_create_autocmd({ "VimResized", "VimEnter", "TabEnter", "OptionSet" }, {
@@ -254,10 +296,15 @@ api.nvim_set_hl(0, "DoomConsoleDebug", {
 --- @field doom Doom?
 --- @field buf integer
 --- @field close_autocmd integer?
+--- @field pending {text: string[], hl: string?}[] Printed, yet to be written.
+--- @field flush_scheduled boolean?
 ---
 --- @field new function
 local Console = {}
 
+--- Lines kept in a console buffer when not configured otherwise.
+local default_console_max_lines = 10000
+
 --- @param console Console
 local function update_console_buf_name(console)
   if not api.nvim_buf_is_valid(console.buf) then
@@ -289,6 +336,7 @@ function Console.new()
     last_row = 0,
     last_col = 0,
     buf = api.nvim_create_buf(true, true),
+    pending = {},
   }, { __index = Console })
 
   api.nvim_set_option_value("modifiable", false, { buf = console.buf })
@@ -327,42 +375,25 @@ function Console:set_doom(doom)
   })
 end
 
+--- Append text to the end of the console buffer, highlighted as console_hl.
+--- The buffer must be modifiable.
+--- @param console Console
 --- @param text string
 --- @param console_hl string?
-function Console:print(text, console_hl)
-  if text == "" then
-    return
-  end
-  if vim.in_fast_event() then
-    vim.schedule(function()
-      self:print(text, console_hl)
-    end)
-    return
-  end
-  if not api.nvim_buf_is_loaded(self.buf) then
-    return
-  end
+local function append_console_text(console, text, console_hl)
   console_hl = console_hl and ("DoomConsole" .. console_hl) or nil
 
-  -- Avoid side-effects, particularly from OptionSet.
-  -- Not using vim._with here to avoid breakage when it graduates. Also not
-  -- saving/restoring &eventignore as I can't be bothered to handle the
-  -- possibility of Lua errors bailing out before restoring it. I'm lazy >:(
-  api.nvim_command(
-    ("noautocmd call setbufvar(%d, '&modifiable', 1)"):format(self.buf)
-  )
-
   -- Previously we cached the details of the last extmark and the position of
   -- end of the buffer, but as it's possible for those to be invalidated (e.g:
   -- naughty plugins messing with the buffer), it's easier to just not do that.
-  local last_line_row = math.max(0, api.nvim_buf_line_count(self.buf) - 1)
+  local last_line_row = math.max(0, api.nvim_buf_line_count(console.buf) - 1)
   local last_line_len
   local hl_extmark
 
   if console_hl then
-    last_line_len = #api.nvim_buf_get_lines(self.buf, -2, -1, true)[1]
+    last_line_len = #api.nvim_buf_get_lines(console.buf, -2, -1, true)[1]
     hl_extmark =
-      api.nvim_buf_get_extmarks(self.buf, ns, -1, { last_line_row, 0 }, {
+      api.nvim_buf_get_extmarks(console.buf, ns, -1, { last_line_row, 0 }, {
         limit = 1,
         type = "highlight",
         details = true,
@@ -379,14 +410,16 @@ function Console:print(text, console_hl)
   end
 
   local lines = vim.split(text, "\n", { plain = true })
-  api.nvim_buf_set_text(self.buf, -1, -1, -1, -1, lines)
-  local new_last_line_row = math.max(0, api.nvim_buf_line_count(self.buf) - 1)
+  api.nvim_buf_set_text(console.buf, -1, -1, -1, -1, lines)
+  local new_last_line_row =
+    math.max(0, api.nvim_buf_line_count(console.buf) - 1)
 
   if hl_extmark or console_hl then
-    local new_last_line_len = #api.nvim_buf_get_lines(self.buf, -2, -1, true)[1]
+    local new_last_line_len =
+      #api.nvim_buf_get_lines(console.buf, -2, -1, true)[1]
     if hl_extmark then
       -- Same highlight as the last extmark; extend its range.
-      api.nvim_buf_set_extmark(self.buf, ns, hl_extmark[2], hl_extmark[3], {
+      api.nvim_buf_set_extmark(console.buf, ns, hl_extmark[2], hl_extmark[3], {
         id = hl_extmark[1],
         hl_group = console_hl,
         end_row = new_last_line_row,
@@ -394,13 +427,48 @@ function Console:print(text, console_hl)
       })
     else
       -- Last extmark has different highlight or doesn't exist; can't reuse it.
-      api.nvim_buf_set_extmark(self.buf, ns, last_line_row, last_line_len, {
+      api.nvim_buf_set_extmark(console.buf, ns, last_line_row, last_line_len, {
         hl_group = console_hl,
         end_row = new_last_line_row,
         end_col = new_last_line_len,
       })
     end
   end
+end
+
+--- Write everything printed since the last flush to the console buffer, in one
+--- go, then trim its oldest lines if it's grown past the configured limit.
+function Console:flush()
+  local pending = self.pending
+  if #pending == 0 then
+    return
+  end
+  self.pending = {}
+  if not api.nvim_buf_is_loaded(self.buf) then
+    return
+  end
+
+  -- Avoid side-effects, particularly from OptionSet.
+  -- Not using vim._with here to avoid breakage when it graduates. Also not
+  -- saving/restoring &eventignore as I can't be bothered to handle the
+  -- possibility of Lua errors bailing out before restoring it. I'm lazy >:(
+  api.nvim_command(
+    ("noautocmd call setbufvar(%d, '&modifiable', 1)"):format(self.buf)
+  )
+
+  for _, chunk in ipairs(pending) do
+    append_console_text(self, table.concat(chunk.text), chunk.hl)
+  end
+
+  -- Trim down to three quarters of the limit, so it's not done again for every
+  -- line printed after.
+  local max_lines = require("actually-doom.config").config.console_max_lines
+    or default_console_max_lines
+  local line_count = api.nvim_buf_line_count(self.buf)
+  if max_lines > 0 and line_count > max_lines then
+    local trim_count = line_count - math.ceil(max_lines * 3 / 4)
+    api.nvim_buf_set_lines(self.buf, 0, trim_count, true, {})
+  end
 
   api.nvim_command(
     ("noautocmd call setbufvar(%d, '&modifiable', 0)"):format(self.buf)
@@ -409,14 +477,43 @@ function Console:print(text, console_hl)
   -- Tail console windows on the last line to the output.
   -- nvim_buf_set_text does not automatically scroll windows, even if it changes
   -- the cursor position to be outside of it.
+  local last_line_row = math.max(0, api.nvim_buf_line_count(self.buf) - 1)
   for _, win in ipairs(fn.win_findbuf(self.buf)) do
     local row, col = unpack(api.nvim_win_get_cursor(win))
-    if row == new_last_line_row + 1 then
-      api.nvim_win_set_cursor(win, { new_last_line_row + 1, col })
+    if row == last_line_row + 1 then
+      api.nvim_win_set_cursor(win, { last_line_row + 1, col })
     end
   end
 end
 
+--- Print text to the console. Output printed from fast callbacks (like DOOM's
+--- stdout) is gathered up and written once per event loop iteration, rather
+--- than editing the buffer for every chunk.
+--- @param text string
+--- @param console_hl string?
+function Console:print(text, console_hl)
+  if text == "" then
+    return
+  end
+
+  local last = self.pending[#self.pending]
+  if last and last.hl == console_hl then
+    last.text[#last.text + 1] = text
+  else
+    self.pending[#self.pending + 1] = { text = { text }, hl = console_hl }
+  end
+
+  if not vim.in_fast_event() then
+    self:flush()
+  elseif not self.flush_scheduled then
+    self.flush_scheduled = true
+    vim.schedule(function()
+      self.flush_scheduled = false
+      self:flush()
+    end)
+  end
+end
+
 --- @see Console.print
 --- @param text string
 --- @param console_hl string? If nil, defaults to "Plugin"
@@ -569,6 +666,13 @@ function Screen:kitty_gfx()
     or nil
 end
 
+--- @return SixelGfx?
+--- @nodiscard
+function Screen:sixel_gfx()
+  return self.gfx.type == "sixel" and self.gfx --[[@as SixelGfx]]
+    or nil
+end
+
 function Screen:goto_win()
   if self.closed or self.doom.closed then
     return
@@ -1,6 +1,6 @@
 local api = vim.api
-local bit = require "bit"
 local fn = vim.fn
+local uv = vim.uv
 
 local game = require "actually-doom.game"
 
@@ -15,6 +15,26 @@ do
   end
 end
 
+--- Whether to bracket frames in synchronized updates: only if 'termsync' (Nvim
+--- 0.10+) is set, as the user may have turned it off for a terminal that
+--- mishandles them.
+--- @return boolean
+local function sync_updates()
+  return fn.exists "+termsync" == 1 and vim.o.termsync
+end
+
+--- Count the time since start_ns towards writing frames to the terminal.
+--- @param doom Doom
+--- @param start_ns number
+local function add_write_time(doom, start_ns)
+  local ns = uv.hrtime() - start_ns
+  local stats = doom.client_stats
+  stats.chan_send_ns = stats.chan_send_ns + ns
+  if stats.timings then
+    stats.timings:add("cell terminal write", ns)
+  end
+end
+
 --- @class (exact) LoadOrSaveGameMenuVars
 --- @field save_slots string[]
 --- @field save_slot_edit_i integer?
@@ -46,105 +66,103 @@ end
 --- @class (exact) CellGfx: Gfx
 --- @field screen Screen
 --- @field clear_hl_tables_ticker integer
+--- @field grid_width integer?
+--- @field grid_height integer?
+--- @field grid_true_colour boolean?
+--- @field prev_overlays string?
+--- @field direct boolean Cells written straight to the host terminal.
+--- @field win_pos [integer, integer]? Where the grid's origin was last set.
 ---
 --- @field new function
---- @field pixel_index function
 --- @field type string
 local M = {
   type = "cell",
 }
 
 --- @param screen Screen
+--- @param direct boolean? Write cells straight to the host terminal over the
+---                        screen window, rather than to its terminal buffer.
 --- @return CellGfx
-function M.new(screen)
-  return setmetatable({
+function M.new(screen, direct)
+  local cell = setmetatable({
     screen = screen,
     frame_text_lines = {},
     clear_hl_tables_ticker = 0,
+    direct = direct or false,
   }, { __index = M })
-end
+  cell:update_grid()
 
-function M:close()
-  -- No-op.
+  if direct then
+    -- Clear any cells already drawn, otherwise Nvim paints them over ours
+    -- whenever it redraws the window.
+    api.nvim_chan_send(screen.term_chan, "\27[m\27[2J\27[H")
+  end
+  return cell
 end
 
--- https://gist.github.com/MicahElliott/719710?permalink_comment_id=1442838#gistcomment-1442838
--- Keep this sorted.
-local cube_levels = { 0, 95, 135, 175, 215, 255 }
--- DOOM generally only uses a limited palette, so caching the result of
--- rgb_to_xterm256 brings a performance uplift.
-local xterm_colour_cache = {}
-
---- @param r integer
---- @param g integer
---- @param b integer
---- @return integer
---- @nodiscard
-local function rgb_key(r, g, b)
-  return bit.bor(r, bit.lshift(g, 8), bit.lshift(b, 16))
+function M:close()
+  if self.direct then
+    self.screen.doom:send_set_cell_origin(0, 0)
+    -- Nvim doesn't know what we drew, so have it repaint everything.
+    vim.schedule(function()
+      api.nvim_command "redraw!"
+    end)
+  end
 end
 
---- Convert RGB to the closest xterm-256 colour. Excludes the first 16 system
---- colours. Not intended to be super accurate.
---- @param r integer
---- @param g integer
---- @param b integer
---- @return integer
---- @nodiscard
-local function rgb_to_xterm256(r, g, b)
-  local cache_key = rgb_key(r, g, b)
-  if xterm_colour_cache[cache_key] then
-    return xterm_colour_cache[cache_key]
+--- Where to write cells straight to the host terminal: the screen window's
+--- position, or nil if it isn't shown. If it moved, frames already sent are for
+--- the old position, so have the engine redraw everything at the new one.
+--- @return [integer, integer]?
+function M:direct_pos()
+  local win = self.screen.win
+  local pos = win and api.nvim_win_is_valid(win) and fn.win_screenpos(win)
+  if not pos or pos[1] == 0 then -- Not in the current tabpage.
+    self.win_pos = nil
+    return nil
   end
 
-  --- @param x integer
-  --- @return integer
-  --- @nodiscard
-  local function nearest_cube_idx(x)
-    local min_diff = math.abs(x - cube_levels[1])
-    for i = 2, #cube_levels do
-      local diff = math.abs(x - cube_levels[i])
-      if diff >= min_diff then
-        -- Levels are sorted, so we can return as soon as the difference starts
-        -- increasing again.
-        return i - 1
-      end
-      min_diff = diff
-    end
-    return #cube_levels
+  if
+    not self.win_pos
+    or pos[1] ~= self.win_pos[1]
+    or pos[2] ~= self.win_pos[2]
+  then
+    self.win_pos = pos
+    self.screen.doom:send_set_cell_origin(pos[1], pos[2])
+    self.screen.doom:schedule_check()
+    return nil
   end
+  return pos
+end
 
-  --- @param r2 integer
-  --- @param b2 integer
-  --- @param g2 integer
-  --- @return integer
-  --- @nodiscard
-  local function dist_sq(r2, g2, b2)
-    return (r - r2) ^ 2 + (g - g2) ^ 2 + (b - b2) ^ 2
-  end
+--- Tell the engine the size of the terminal to render frames for, if it
+--- changed since last time. Frames are then sent as ready-to-draw cells, which
+--- only include the cells that changed, unless the grid was just set.
+--- @param force boolean? Send it even if unchanged, forcing a full redraw.
+function M:update_grid(force)
+  self.screen:update_term_size()
+  local width = self.screen.term_width
+  local height = self.screen.term_height
+  local true_colour = api.nvim_get_option_value("termguicolors", {})
+    or fn.has "gui_running" == 1
 
-  -- Cube colour.
-  local ri = nearest_cube_idx(r)
-  local gi = nearest_cube_idx(g)
-  local bi = nearest_cube_idx(b)
-  local cube_dist = dist_sq(cube_levels[ri], cube_levels[gi], cube_levels[bi])
-
-  -- Grayscale (232–255): 24 shades from levels 8-238 (in increments of 10).
-  local brightness = math.floor((r + g + b) / 3) -- Average brightness.
-  local gray_i = math.floor((brightness - 8) / 10 + 0.5)
-  gray_i = math.max(0, math.min(23, gray_i))
-  -- Clamp to number of shades. (0-indexed)
-  local gray_level = 8 + gray_i * 10
-  local gray_dist = dist_sq(gray_level, gray_level, gray_level)
-
-  local colour
-  if gray_dist < cube_dist then
-    colour = 232 + gray_i -- Gray is closer.
-  else
-    colour = 16 + 36 * (ri - 1) + 6 * (gi - 1) + (bi - 1) -- Cube is closer.
+  if
+    force
+    or width ~= self.grid_width
+    or height ~= self.grid_height
+    or true_colour ~= self.grid_true_colour
+  then
+    self.grid_width = width
+    self.grid_height = height
+    self.grid_true_colour = true_colour
+    self.screen.doom:send_set_cell_grid(
+      width,
+      height,
+      true_colour,
+      self.screen.doom.play_opts.half_blocks or false
+    )
+    self.screen.doom:schedule_check()
   end
-  xterm_colour_cache[cache_key] = colour
-  return colour
 end
 
 local menu_lump_to_label = {
@@ -195,7 +213,7 @@ local pause_label = "Pause"
 local finished_label = "Finished"
 local leaving_label = "Leaving"
 
---- @param pixels string
+--- @param cells string Frame from AMSG_FRAME_CELLS.
 --- @param menu Menu?
 --- @param intermission Intermission?
 --- @param finale_text_len integer
@@ -205,7 +223,7 @@ local leaving_label = "Leaving"
 --- @param draw_status_bar boolean?
 --- @param draw_pause boolean?
 function M:refresh(
-  pixels,
+  cells,
   menu,
   intermission,
   finale_text_len,
@@ -218,75 +236,16 @@ function M:refresh(
   if not self.screen.term_chan then
     return
   end
+  local timings = self.screen.doom.client_stats.timings
+  local start_ns = timings and uv.hrtime()
 
-  --- @param x integer (0-indexed)
-  --- @param y integer (0-indexed)
-  --- @return integer, integer (0-indexed)
-  --- @nodiscard
-  local function pixel_topleft_pos(x, y)
-    local pix_x = math.min(
-      math.floor((x / self.screen.term_width) * self.screen.res_x),
-      self.screen.res_x
-    )
-    local pix_y = math.min(
-      math.floor((y / self.screen.term_height) * self.screen.res_y),
-      self.screen.res_y
-    )
-    return pix_x, pix_y
+  -- If the size changed, this frame is for the old size; the next won't be.
+  self:update_grid()
+  local direct_pos = self.direct and self:direct_pos()
+  if self.direct and not direct_pos then
+    return
   end
-
-  local true_colour = api.nvim_get_option_value("termguicolors", {})
-    or fn.has "gui_running" == 1
-
-  self.screen:update_term_size()
   local scratch_buf = require("actually-doom.ui").scratch_buf:reset()
-  -- Reset attributes, clear screen, clear scrollback, cursor to 1,1.
-  scratch_buf:put "\27[m\27[2J\27[3J\27[H"
-
-  local prev_colour
-  for y = 0, self.screen.term_height - 1 do -- 0-indexed
-    for x = 0, self.screen.term_width - 1 do -- 0-indexed
-      -- Pixel positions are 0-indexed.
-      local pix_x, pix_y = pixel_topleft_pos(x, y)
-      local pix_x2, pix_y2 = pixel_topleft_pos(x + 1, y + 1)
-      pix_x2 = math.min(self.screen.res_x - 1, pix_x2)
-      pix_y2 = math.min(self.screen.res_y - 1, pix_y2)
-      local pix_count = (pix_x2 + 1 - pix_x) * (pix_y2 + 1 - pix_y)
-
-      -- Average the colours of all pixels within this cell.
-      local r, g, b = 0, 0, 0
-      for py = pix_y, pix_y2 do
-        for px = pix_x, pix_x2 do
-          local pi = M.pixel_index(px, py, self.screen.res_x) + 1
-          local pr, pg, pb = pixels:byte(pi, pi + 3)
-          r = r + pr
-          g = g + pg
-          b = b + pb
-        end
-      end
-      r = math.min(0xff, math.floor(r / pix_count + 0.5))
-      g = math.min(0xff, math.floor(g / pix_count + 0.5))
-      b = math.min(0xff, math.floor(b / pix_count + 0.5))
-      local colour = true_colour and rgb_key(r, g, b)
-        or rgb_to_xterm256(r, g, b)
-
-      -- Only emit an escape sequence if the colour changed.
-      if colour ~= prev_colour then
-        if true_colour then
-          -- Set background RGB "true" colour.
-          scratch_buf:put("\27[48;2;", r, ";", g, ";", b, "m")
-        else
-          -- Set background xterm-256 colour.
-          scratch_buf:put("\27[48;5;", colour, "m")
-        end
-        prev_colour = colour
-      end
-      scratch_buf:put " "
-    end
-    if y + 1 < self.screen.term_height then
-      scratch_buf:put "\r\n"
-    end
-  end
 
   local doom = self.screen.doom
   local player_status = doom.player_status
@@ -657,7 +616,7 @@ function M:refresh(
   -- background colour of the Screen window) after Nvim clears and rebuilds
   -- the attribute tables. We can work around this by forcing a rebuild of the
   -- tables before we send the frame, but this requires LuaJIT.
-  if true_colour and ffi then
+  if self.grid_true_colour and ffi and not self.direct then
     self.clear_hl_tables_ticker = self.clear_hl_tables_ticker + 1
     -- Has some performance overhead, and is only needed occasionally.
     if self.clear_hl_tables_ticker >= 30 then
@@ -665,16 +624,81 @@ function M:refresh(
       self.clear_hl_tables_ticker = 0
     end
   end
-  api.nvim_chan_send(self.screen.term_chan, scratch_buf:get())
+
+  -- The engine only redraws cells that changed, so anything drawn over them
+  -- sticks around until then. If the overlays changed, have the next frame
+  -- redraw everything to clear away what's left of the old ones.
+  local overlays = scratch_buf:get()
+  if timings then
+    timings:add("cell overlays", uv.hrtime() - start_ns)
+  end
+  if overlays ~= self.prev_overlays then
+    self:update_grid(true)
+    self.prev_overlays = overlays
+  end
+
+  if direct_pos then
+    self:write_direct(direct_pos, cells, overlays)
+    return
+  end
+
+  -- Sending to a terminal channel feeds the terminal immediately, so sending
+  -- the two separately can't tear, and saves copying the frame to join them.
+  -- Still bracket the frame in a synchronized update (DEC mode 2026), like Nvim
+  -- does its own redraws for the host terminal with 'termsync', so a terminal
+  -- that honours it repaints the frame once rather than as it arrives.
+  local sync = sync_updates()
+  local send_ns = uv.hrtime()
+  if sync then
+    api.nvim_chan_send(self.screen.term_chan, "\27[?2026h")
+  end
+  api.nvim_chan_send(self.screen.term_chan, cells)
+  api.nvim_chan_send(self.screen.term_chan, overlays)
+  if sync then
+    api.nvim_chan_send(self.screen.term_chan, "\27[?2026l")
+  end
+  add_write_time(doom, send_ns)
 end
 
---- @param x integer (0-based)
---- @param y integer (0-based)
---- @param res_x integer
---- @return integer (0-based)
---- @nodiscard
-function M.pixel_index(x, y, res_x)
-  return (y * res_x + x) * 3
+--- Write the frame straight to the host terminal at pos, skipping the terminal
+--- buffer (and Nvim parsing it, then drawing it again for the host terminal).
+--- The engine already placed the cells there; the overlays are drawn relative
+--- to the window, so are moved there too.
+--- @param pos [integer, integer]
+--- @param cells string
+--- @param overlays string
+function M:write_direct(pos, cells, overlays)
+  local row_off, col_off = pos[1] - 1, pos[2] - 1
+  overlays = overlays:gsub("\27%[(%d*);?(%d*)([GH])", function(a, b, final)
+    if final == "G" then
+      return ("\27[%dG"):format((tonumber(a) or 1) + col_off)
+    end
+    return ("\27[%d;%dH"):format(
+      (tonumber(a) or 1) + row_off,
+      (tonumber(b) or 1) + col_off
+    )
+  end)
+
+  local sync = sync_updates()
+  local doom = self.screen.doom
+  local start_ns = uv.hrtime()
+  -- Save the cursor and attributes, which Nvim expects to be as it left them,
+  -- and disable line wrapping for anything written past the right edge, like
+  -- the terminal buffer does. Not passed through tmux, whose pane is where it
+  -- should be drawn.
+  local scratch_buf = require("actually-doom.ui").scratch_buf:reset()
+  scratch_buf:put(
+    "\0277",
+    sync and "\27[?2026h" or "",
+    "\27[?7l",
+    cells,
+    overlays,
+    "\27[?7h",
+    sync and "\27[?2026l" or "",
+    "\0278"
+  )
+  io.stderr:write(scratch_buf:get())
+  add_write_time(doom, start_ns)
 end
 
 return M
@@ -2,22 +2,117 @@ local api = vim.api
 local base64 = vim.base64
 local bit = require "bit"
 local fn = vim.fn
+local fs = vim.fs
+local uv = vim.uv
 
 --- @class (exact) KittyGfx: Gfx
 --- @field screen Screen
---- @field shm_name_base64 string
+--- @field shm_slot_names_base64 string[]
+--- @field direct boolean Image data sent in escapes rather than shared memory.
+--- @field frame_width integer
+--- @field frame_height integer Size of frames from DOOM, after any scaling.
 --- @field image_id integer
 --- @field image_id_msb integer
 --- @field image_id_lsb integer
 --- @field has_image boolean?
 --- @field detect fun(KittyGfx, result: string)|boolean?
+--- @field detect_in_background boolean? Draw frames while detecting.
 ---
 --- @field new function
 --- @field type string
+--- @field shm_slot_count integer
+--- @field direct_chunk_len integer
+--- @field detection_retry_secs integer
 local M = {
   type = "kitty",
+  -- Number of frame slots in the shared memory ring. More than one reduces the
+  -- chance of DOOM replacing a frame before the terminal has read it.
+  shm_slot_count = 3,
+  -- Max base64 bytes of image data per escape when transmitting directly, as
+  -- required by the protocol.
+  direct_chunk_len = 4096,
+  -- How long a cached detection failure is trusted before detecting again.
+  detection_retry_secs = 24 * 60 * 60,
 }
 
+--- @class (exact) KittyCachedDetection
+--- @field result string
+--- @field time integer
+
+local detection_cache_path = fs.joinpath(
+  fn.stdpath "state",
+  "actually-doom.nvim",
+  "kitty_detection.json"
+)
+
+--- @return table<string, KittyCachedDetection>
+--- @nodiscard
+local function read_detection_cache()
+  local f = io.open(detection_cache_path, "rb")
+  if not f then
+    return {}
+  end
+  local data = f:read "*a"
+  f:close()
+  local ok, cache = pcall(vim.json.decode, data)
+  return ok and type(cache) == "table" and cache or {}
+end
+
+--- Identifies the terminal detection results are cached for. Window IDs and
+--- the like aren't included, as they differ for every window of a terminal.
+--- @param direct boolean
+--- @param tmux_passthrough boolean
+--- @return string
+--- @nodiscard
+function M.detection_key(direct, tmux_passthrough)
+  return table.concat({
+    os.getenv "TERM" or "",
+    os.getenv "TERM_PROGRAM" or "",
+    os.getenv "TERM_PROGRAM_VERSION" or "",
+    os.getenv "KITTY_WINDOW_ID" and "kitty" or "",
+    os.getenv "TMUX" and "tmux" or "",
+    tmux_passthrough and "passthrough" or "",
+    direct and "direct" or "shm",
+  }, "|")
+end
+
+--- @param key string From detection_key().
+--- @return string? result Last result of detecting support for the terminal,
+---                        if there is one, or it failed recently enough.
+--- @nodiscard
+function M.cached_detection(key)
+  local cached = read_detection_cache()[key]
+  if
+    type(cached) ~= "table"
+    or type(cached.result) ~= "string"
+    or type(cached.time) ~= "number"
+  then
+    return nil
+  end
+  if
+    cached.result ~= "OK"
+    and os.time() - cached.time >= M.detection_retry_secs
+  then
+    return nil
+  end
+  return cached.result
+end
+
+--- Failing to save the result only means detecting again next time, so errors
+--- are ignored.
+--- @param key string From detection_key().
+--- @param result string
+function M.cache_detection(key, result)
+  local cache = read_detection_cache()
+  cache[key] = { result = result, time = os.time() }
+  fn.mkdir(fs.dirname(detection_cache_path), "p")
+  local f = io.open(detection_cache_path, "wb")
+  if f then
+    f:write(vim.json.encode(cache))
+    f:close()
+  end
+end
+
 -- Extracted from kitty's rowcolumn-diacritics.txt using these commands in Nvim:
 --
 -- :v/^\w\+/d
@@ -365,16 +460,39 @@ local function setup_term_buf(kitty)
 end
 
 --- @param screen Screen
---- @param shm_name string
+--- @param shm_name string? If nil, frames are transmitted directly, as zlib
+---                         compressed data within the escapes.
 --- @return KittyGfx
 --- @nodiscard
 function M.new(screen, shm_name)
   local kitty = setmetatable({
     screen = screen,
-    shm_name_base64 = base64.encode(shm_name),
+    shm_slot_names_base64 = {},
+    direct = shm_name == nil,
+    frame_width = screen.res_x,
+    frame_height = screen.res_y,
     image_id = 0,
   }, { __index = M })
 
+  local scale = screen.doom.play_opts.kitty_scale
+  if scale then
+    -- Scaling up to a 4:3 aspect ratio in DOOM is cheaper than the terminal
+    -- resampling our tiny frames every time.
+    screen.doom:send_set_frame_scale(scale, true)
+  end
+
+  if shm_name then
+    -- Corresponds to the slot object names used by the DOOM process.
+    for i = 1, M.shm_slot_count do
+      kitty.shm_slot_names_base64[i] =
+        base64.encode(("%s.%d"):format(shm_name, i - 1))
+    end
+  else
+    -- Have the engine send pixels (as AMSG_FRAME_ZLIB) rather than cells.
+    screen.doom:send_set_cell_grid(0, 0, false, false)
+    screen.doom:schedule_check()
+  end
+
   while true do
     kitty.image_id = fn.rand() -- Random 32-bit number.
 
@@ -407,6 +525,10 @@ function M.new(screen, shm_name)
 end
 
 function M:close()
+  if self.screen.doom.play_opts.kitty_scale then
+    self.screen.doom:send_set_frame_scale(1, false)
+  end
+
   if self.has_image then
     -- Delete the image and its virtual placement.
     io.stderr:write(
@@ -419,8 +541,48 @@ function M:close()
   end
 end
 
+--- Put a graphics command transmitting image data: either from a frame ring
+--- slot, or directly as zlib compressed data, split into as many escapes as
+--- needed.
 --- @param kitty KittyGfx
-local function handle_detection(kitty)
+--- @param buf StrBuf
+--- @param keys string Control data, excluding transmission keys.
+--- @param slot integer? (0-indexed)
+--- @param zlib_data string?
+local function put_transmit(kitty, buf, keys, slot, zlib_data)
+  if not kitty.direct then
+    buf:putf(
+      "\27_G%s,t=s;%s\27\\",
+      keys,
+      kitty.shm_slot_names_base64[assert(slot) + 1]
+    )
+    return
+  end
+
+  local data_base64 = base64.encode(assert(zlib_data))
+  local chunk_len = M.direct_chunk_len
+  for i = 1, #data_base64, chunk_len do
+    local more = i + chunk_len <= #data_base64 and 1 or 0
+    if i == 1 then
+      buf:putf("\27_G%s,t=d,o=z,m=%d;", keys, more)
+    else
+      -- Only the first chunk has the control data.
+      buf:putf("\27_Gq=2,m=%d;", more)
+    end
+    buf:put(data_base64:sub(i, i + chunk_len - 1), "\27\\")
+  end
+end
+
+--- @param width integer
+--- @param height integer
+function M:set_frame_size(width, height)
+  self.frame_width = width
+  self.frame_height = height
+end
+
+--- @param kitty KittyGfx
+--- @param slot integer? (0-indexed)
+local function handle_detection(kitty, slot)
   if type(kitty.detect) ~= "function" then
     return -- Already started, finished, or detection unwanted.
   end
@@ -454,20 +616,31 @@ local function handle_detection(kitty)
   })
 
   -- Query is similar to what we'll typically send to the terminal.
-  -- Particuarly, we ensure it can read from the shared memory object.
-  io.stderr:write(
-    kitty.screen:passthrough_escape(
-      (
-        "\27_Ga=q,t=s,f=24,i=%u,s=%u,v=%u;%s\27\\" -- Image info.
-        .. "\27[c" -- DA1.
-      ):format(
+  -- Particuarly, we ensure it can read from the shared memory object, or
+  -- decompress zlib data if transmitting directly (a single black pixel).
+  local scratch_buf = require("actually-doom.ui").scratch_buf:reset()
+  if kitty.direct then
+    put_transmit(
+      kitty,
+      scratch_buf,
+      ("a=q,f=24,i=%u,s=1,v=1"):format(kitty.image_id),
+      nil,
+      base64.decode "eJxjYGAAAAADAAE="
+    )
+  else
+    put_transmit(
+      kitty,
+      scratch_buf,
+      ("a=q,f=24,i=%u,s=%u,v=%u"):format(
         kitty.image_id,
-        kitty.screen.res_x,
-        kitty.screen.res_y,
-        kitty.shm_name_base64
-      )
+        kitty.frame_width,
+        kitty.frame_height
+      ),
+      slot
     )
-  )
+  end
+  scratch_buf:put "\27[c" -- DA1.
+  io.stderr:write(kitty.screen:passthrough_escape(scratch_buf:get()))
 
   timer = vim.defer_fn(function() -- Already implicitly vim.scheduled.
     if autocmd then
@@ -482,42 +655,115 @@ local function handle_detection(kitty)
   end, 350)
 end
 
-function M:refresh()
+--- Write a frame's escapes to the terminal, timing it with
+--- PlayOpts.client_timing.
+--- @param kitty KittyGfx
+--- @param escapes string
+local function write_frame(kitty, escapes)
+  local timings = kitty.screen.doom.client_stats.timings
+  local start_ns = timings and uv.hrtime()
+  io.stderr:write(kitty.screen:passthrough_escape(escapes))
+  if timings then
+    timings:add("kitty terminal write", uv.hrtime() - start_ns)
+  end
+end
+
+--- @param slot integer? (0-indexed) Frame ring slot holding the frame.
+--- @param x integer
+--- @param y integer
+--- @param width integer
+--- @param height integer Region of the frame that changed, held by the slot.
+--- @param zlib_data string? If transmitting directly, the region's pixels as
+---                          zlib compressed data instead.
+function M:refresh(slot, x, y, width, height, zlib_data)
   if self.detect then
-    handle_detection(self)
+    handle_detection(self, slot)
+    if not self.detect_in_background then
+      return
+    end
+  end
+
+  local full = x == 0
+    and y == 0
+    and width == self.frame_width
+    and height == self.frame_height
+  if not self.has_image and not full then
+    -- Regions are relative to the last frame, which the terminal doesn't have
+    -- (e.g: frames were sent during detection); wait for a full one.
+    self.screen.doom:send_want_keyframe()
     return
   end
 
   local old_term_width = self.screen.term_width
   local old_term_height = self.screen.term_height
   self.screen:update_term_size()
-  if
-    not self.has_image
-    or self.screen.term_width ~= old_term_width
+  local resized = self.screen.term_width ~= old_term_width
     or self.screen.term_height ~= old_term_height
-  then
+  if not self.has_image or resized then
     setup_term_buf(self)
   end
 
-  -- Read frame image data (24-bit RGB) from the shared memory object.
-  -- Create/re-use and place the virtual placement for it.
-  io.stderr:write(
-    self.screen:passthrough_escape(
+  local scratch_buf = require("actually-doom.ui").scratch_buf:reset()
+  if full then
+    -- Read frame image data (24-bit RGB) from the shared memory object (or the
+    -- escapes themselves). Create/re-use and place the virtual placement for it.
+    put_transmit(
+      self,
+      scratch_buf,
       (
-        "\27_Gq=2,a=T,U=1,z=-1,p=%u,c=%u,r=%u," -- Control and placement info.
-        .. "t=s,f=24,i=%u,s=%u,v=%u;%s\27\\" -- Image info.
+        "q=2,a=T,U=1,z=-1,p=%u,c=%u,r=%u," -- Control and placement info.
+        .. "f=24,i=%u,s=%u,v=%u" -- Image info.
       ):format(
         self.image_id, -- Placement ID same as image ID for convenience.
         self.screen.term_width,
         self.screen.term_height,
         self.image_id,
-        self.screen.res_x,
-        self.screen.res_y,
-        self.shm_name_base64
-      )
+        self.frame_width,
+        self.frame_height
+      ),
+      slot,
+      zlib_data
     )
-  )
-  self.has_image = true
+    write_frame(self, scratch_buf:get())
+    self.has_image = true
+    return
+  end
+
+  if resized then
+    -- Re-place the virtual placement to fit the new size.
+    scratch_buf:putf(
+      "\27_Gq=2,a=p,U=1,z=-1,i=%u,p=%u,c=%u,r=%u\27\\",
+      self.image_id,
+      self.image_id, -- Placement ID same as image ID for convenience.
+      self.screen.term_width,
+      self.screen.term_height
+    )
+  end
+  if width > 0 and height > 0 then
+    -- Edit the changed region of the image's root frame in place, reading just
+    -- that region's pixels from the shared memory object (or the escapes).
+    put_transmit(
+      self,
+      scratch_buf,
+      (
+        "q=2,a=f,r=1,i=%u,x=%u,y=%u," -- Control and frame info.
+        .. "f=24,s=%u,v=%u%s" -- Region data info.
+      ):format(
+        self.image_id,
+        x,
+        y,
+        width,
+        height,
+        -- Size of the data read from the object; not for direct transmission.
+        self.direct and "" or (",S=%u"):format(width * height * 3)
+      ),
+      slot,
+      zlib_data
+    )
+  end
+  if scratch_buf:len() > 0 then
+    write_frame(self, scratch_buf:get())
+  end
 end
 
 return M
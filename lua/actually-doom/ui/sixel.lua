@@ -0,0 +1,74 @@
+local api = vim.api
+local fn = vim.fn
+
+--- @class (exact) SixelGfx: Gfx
+--- @field screen Screen
+--- @field scale integer
+--- @field win_pos [integer, integer]? Where the last image was drawn.
+---
+--- @field new function
+--- @field type string
+local M = {
+  type = "sixel",
+}
+
+--- @param screen Screen
+--- @return SixelGfx
+--- @nodiscard
+function M.new(screen)
+  local sixel = setmetatable({
+    screen = screen,
+    scale = screen.doom.play_opts.sixel_scale or 2,
+  }, { __index = M })
+
+  -- Have the engine encode frames as sixel images rather than cells.
+  screen.doom:send_set_cell_grid(0, 0, false, false)
+  screen.doom:send_set_sixel_scale(sixel.scale)
+  screen.doom:schedule_check()
+
+  -- Clear any cells already drawn, otherwise Nvim paints them over the image
+  -- whenever it redraws the window.
+  api.nvim_chan_send(screen.term_chan, "\27[m\27[2J\27[H")
+  return sixel
+end
+
+function M:close()
+  self.screen.doom:send_set_sixel_scale(0)
+end
+
+--- @param data string Sixel image of the frame; empty if it's unchanged.
+--- @param region boolean? Whether the image is just the region that changed,
+---                        to be drawn over the last.
+function M:refresh(data, region)
+  local win = self.screen.win
+  if not win or not api.nvim_win_is_valid(win) then
+    return
+  end
+  local pos = fn.win_screenpos(win)
+  if pos[1] == 0 then
+    return -- Not in the current tabpage.
+  end
+
+  local moved = not self.win_pos
+    or pos[1] ~= self.win_pos[1]
+    or pos[2] ~= self.win_pos[2]
+  self.win_pos = pos
+  if moved and (#data == 0 or region) then
+    -- Nothing was drawn at the new position yet for the image to go over;
+    -- have it sent again.
+    self.screen.doom:send_want_keyframe()
+    return
+  elseif #data == 0 then
+    return
+  end
+
+  -- Draw at the top-left of the window, then restore the cursor, which Nvim
+  -- expects to be where it left it.
+  io.stderr:write(
+    self.screen:passthrough_escape(
+      ("\0277\27[%d;%dH%s\0278"):format(pos[1], pos[2], data)
+    )
+  )
+end
+
+return M
@@ -23,3 +23,16 @@ end, {
   complete = "file",
   bar = true,
 })
+
+-- Start a standby DOOM process if configured to. The config is only loaded by
+-- setup, so otherwise there's nothing to check.
+local function start_standby()
+  if package.loaded["actually-doom.config"] then
+    require("actually-doom.game").start_standby()
+  end
+end
+if vim.v.vim_did_enter == 1 then
+  start_standby()
+else
+  api.nvim_create_autocmd("VimEnter", { once = true, callback = start_standby })
+end